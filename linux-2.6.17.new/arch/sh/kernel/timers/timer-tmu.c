@@ -19,6 +19,7 @@
 #include <linux/interrupt.h>
 #include <linux/spinlock.h>
 #include <linux/seqlock.h>
+#include <linux/clockchips.h>
 #include <asm/timer.h>
 #include <asm/rtc.h>
 #include <asm/io.h>
@@ -33,6 +34,20 @@
 
 static DEFINE_SPINLOCK(tmu0_lock);
 
+/* TMU0 and TMU1 share the start register */
+static DEFINE_SPINLOCK(tmu_tstr_lock);
+
+static void tmu_tstr_set(u8 mask, int start)
+{
+	unsigned long flags;
+	u8 tstr;
+
+	spin_lock_irqsave(&tmu_tstr_lock, flags);
+	tstr = ctrl_inb(TMU_TSTR);
+	ctrl_outb(start ? tstr | mask : tstr & ~mask, TMU_TSTR);
+	spin_unlock_irqrestore(&tmu_tstr_lock, flags);
+}
+
 static unsigned long tmu_timer_get_offset(void)
 {
 	int count;
@@ -190,16 +205,95 @@ static struct clk tmu0_clk = {
 
 static int tmu_timer_start(void)
 {
-	ctrl_outb(TMU_TSTR_INIT, TMU_TSTR);
+	tmu_tstr_set(TMU_TSTR_INIT, 1);
 	return 0;
 }
 
 static int tmu_timer_stop(void)
 {
-	ctrl_outb(0, TMU_TSTR);
+	tmu_tstr_set(TMU_TSTR_INIT, 0);
 	return 0;
 }
 
+#ifdef CONFIG_GENERIC_CLOCKEVENTS
+/*
+ * TMU1 as a one-shot clock event device for high resolution timers,
+ * TMU0 keeps providing the tick. TMU1 counts down from the programmed
+ * delta at the rate of TMU0 and interrupts on underflow. The interrupt
+ * handler stops it until it is programmed again.
+ */
+#define TMU1_TCR_INIT	0x0020	/* underflow interrupt, Pclk/4 */
+#define TMU1_TSTR	2
+
+static struct clock_event_device tmu1_clockevent;
+
+static int tmu1_set_next_event(unsigned long cycles,
+			       struct clock_event_device *evt)
+{
+	tmu_tstr_set(TMU1_TSTR, 0);
+	ctrl_outw(TMU1_TCR_INIT, TMU1_TCR);	/* clears UNF */
+	ctrl_outl(cycles, TMU1_TCNT);
+	tmu_tstr_set(TMU1_TSTR, 1);
+	return 0;
+}
+
+static void tmu1_set_mode(enum clock_event_mode mode,
+			  struct clock_event_device *evt)
+{
+	tmu_tstr_set(TMU1_TSTR, 0);
+	if (mode == CLOCK_EVT_MODE_ONESHOT) {
+		ctrl_outw(TMU1_TCR_INIT, TMU1_TCR);
+		ctrl_outl(0xffffffff, TMU1_TCOR);
+	}
+}
+
+static irqreturn_t tmu1_interrupt(int irq, void *dev_id, struct pt_regs *regs)
+{
+	struct clock_event_device *evt = &tmu1_clockevent;
+
+	tmu_tstr_set(TMU1_TSTR, 0);
+	ctrl_outw(TMU1_TCR_INIT, TMU1_TCR);	/* clears UNF */
+
+	if (evt->event_handler)
+		evt->event_handler(evt);
+
+	return IRQ_HANDLED;
+}
+
+static struct irqaction tmu1_irq = {
+	.name		= "hrtimer",
+	.handler	= tmu1_interrupt,
+	.flags		= SA_INTERRUPT,
+	.mask		= CPU_MASK_NONE,
+};
+
+static struct clock_event_device tmu1_clockevent = {
+	.name		= "tmu1",
+	.features	= CLOCK_EVT_FEAT_ONESHOT,
+	.shift		= 32,
+	.rating		= 200,
+	.irq		= TIMER1_IRQ,
+	.set_next_event	= tmu1_set_next_event,
+	.set_mode	= tmu1_set_mode,
+};
+
+static void tmu1_clockevent_init(unsigned long rate)
+{
+	struct clock_event_device *evt = &tmu1_clockevent;
+
+	tmu_tstr_set(TMU1_TSTR, 0);
+	ctrl_outw(TMU1_TCR_INIT, TMU1_TCR);
+
+	evt->mult = div_sc(rate, NSEC_PER_SEC, evt->shift);
+	evt->max_delta_ns = clockevent_delta2ns(0x7fffffff, evt);
+	evt->min_delta_ns = clockevent_delta2ns(0x1f, evt);
+	evt->cpumask = cpumask_of_cpu(0);
+
+	setup_irq(TIMER1_IRQ, &tmu1_irq);
+	clockevents_register_device(evt);
+}
+#endif /* CONFIG_GENERIC_CLOCKEVENTS */
+
 static int tmu_timer_init(void)
 {
 	unsigned long interval;
@@ -225,6 +319,10 @@ static int tmu_timer_init(void)
 
 	tmu_timer_start();
 
+#ifdef CONFIG_GENERIC_CLOCKEVENTS
+	tmu1_clockevent_init(clk_get_rate(&tmu0_clk));
+#endif
+
 	return 0;
 }
 
@@ -0,0 +1,1730 @@
+/*
+ *  BFQ, or budget fair queueing, disk scheduler.
+ *
+ *  Like CFQ, every process gets a queue of its own for its synchronous
+ *  requests. Unlike CFQ, a queue is not served for a time slice but for a
+ *  budget of sectors, and the order in which the queues get the disk is
+ *  decided by weighted fair queueing on the sectors they were actually
+ *  served: queues of equal weight get the same amount of data transferred
+ *  whatever their access pattern. The queues are grouped by the cpuset of
+ *  the process that issued the requests, and the disk is first shared out
+ *  between the groups by the io_weight of their cpusets, then within a
+ *  group between its queues by I/O priority.
+ *
+ *  See Documentation/block/bfq-iosched.txt
+ */
+#include <linux/config.h>
+#include <linux/module.h>
+#include <linux/blkdev.h>
+#include <linux/elevator.h>
+#include <linux/hash.h>
+#include <linux/rbtree.h>
+#include <linux/ioprio.h>
+#include <linux/cpuset.h>
+#include <asm/div64.h>
+
+/*
+ * tunables
+ */
+static const int bfq_fifo_expire[2] = { HZ / 4, HZ / 8 };
+static int bfq_slice_idle = HZ / 125;
+static const int bfq_max_budget = 16 * 1024;	/* sectors */
+static const int bfq_timeout[2] = { HZ / 4, HZ / 8 };
+static const int bfq_low_latency = 1;
+static const int bfq_wr_coeff = 10;
+static const int bfq_wr_max_time = HZ;
+static const int bfq_wr_min_idle = 2 * HZ;
+
+/*
+ * The smallest budget a sync queue is cut down to, and the budget of an
+ * async queue, as fractions of max_budget.
+ */
+#define BFQ_MIN_BUDGET_DIV	32
+#define BFQ_ASYNC_BUDGET_DIV	4
+
+/* weight of a queue is (IOPRIO_BE_NR - ioprio) * this */
+#define BFQ_WEIGHT_PRIO_STEP	10
+
+/* virtual time is service in sectors << this, divided by weight */
+#define BFQ_SERVICE_SHIFT	10
+
+/* mean seek distance, in sectors, above which a queue is not idled for */
+#define BFQ_SEEKY_THRESH	(8 * 1024)
+#define sample_valid(samples)	((samples) > 80)
+
+/*
+ * for the hash of sync bfqq inside the bfqd, by pid
+ */
+#define BFQ_QHASH_SHIFT		6
+#define BFQ_QHASH_ENTRIES	(1 << BFQ_QHASH_SHIFT)
+
+/*
+ * for the hash of brq inside the bfqd
+ */
+#define BFQ_MHASH_SHIFT		6
+#define BFQ_MHASH_BLOCK(sec)	((sec) >> 3)
+#define BFQ_MHASH_ENTRIES	(1 << BFQ_MHASH_SHIFT)
+#define BFQ_MHASH_FN(sec)	hash_long(BFQ_MHASH_BLOCK(sec), BFQ_MHASH_SHIFT)
+#define rq_hash_key(rq)		((rq)->sector + (rq)->nr_sectors)
+#define list_entry_hash(ptr)	hlist_entry((ptr), struct bfq_rq, hash)
+#define list_entry_fifo(ptr)	list_entry((ptr), struct request, queuelist)
+
+#define RQ_DATA(rq)		(rq)->elevator_private
+
+#define RB_NONE			(2)
+#define RB_EMPTY(root)		((root)->rb_node == NULL)
+#define RB_CLEAR_COLOR(node)	(node)->rb_color = RB_NONE
+#define RB_CLEAR(node)		do {	\
+	(node)->rb_parent = NULL;	\
+	RB_CLEAR_COLOR((node));		\
+	(node)->rb_right = NULL;	\
+	(node)->rb_left = NULL;		\
+} while (0)
+#define rb_entry_brq(node)	rb_entry((node), struct bfq_rq, rb_node)
+#define rb_entry_entity(node)	rb_entry((node), struct bfq_entity, rb_node)
+
+#define ASYNC			(0)
+#define SYNC			(1)
+
+static kmem_cache_t *brq_pool;
+static kmem_cache_t *bfq_pool;
+static kmem_cache_t *bfq_group_pool;
+
+/*
+ * Something that is scheduled by weighted fair queueing: a queue among
+ * the queues of its group, or a group among the groups of the disk. An
+ * entity that has requests waits in the service tree of its parent,
+ * sorted by virtual finish time; the one being served is off the tree.
+ */
+struct bfq_entity {
+	struct rb_node rb_node;
+	int on_st;
+	u64 start, finish;		/* virtual times */
+	unsigned int weight;
+};
+
+struct bfq_service_tree {
+	struct rb_root active;
+	u64 vtime;			/* virtual time of the tree */
+	struct bfq_entity *in_service;
+};
+
+/*
+ * The queues of a cpuset on this disk.
+ */
+struct bfq_group {
+	struct bfq_entity entity;	/* in bfqd->root */
+	struct bfq_service_tree st;	/* of its busy queues */
+	unsigned int nr_busy;		/* busy queues, in service or not */
+
+	unsigned long id;		/* cpuset io_id */
+	int ref;			/* queues */
+	struct hlist_node hash;
+	struct list_head list;		/* on bfqd->group_list */
+	struct bfq_queue *async_queue;
+
+	/* statistics */
+	unsigned long service;		/* sectors */
+	unsigned long dispatched;	/* requests */
+};
+
+/*
+ * Per block device queue structure
+ */
+struct bfq_data {
+	request_queue_t *queue;
+
+	struct bfq_service_tree root;	/* of the groups with busy queues */
+	unsigned int busy_queues;
+
+	struct bfq_queue *active_queue;
+
+	/*
+	 * sync bfqq lookup hash, all queues and all groups
+	 */
+	struct hlist_head *bfq_hash;
+	struct hlist_head *group_hash;
+	struct list_head queue_list;
+	struct list_head group_list;
+
+	/* queues without requests, oldest first, see bfq_reap_queues() */
+	struct list_head idle_list;
+
+	/*
+	 * global brq hash for all queues
+	 */
+	struct hlist_head *brq_hash;
+
+	mempool_t *brq_pool;
+
+	int rq_in_driver;
+	sector_t last_position;
+	unsigned int rq_starved;
+
+	struct timer_list idle_slice_timer;
+	struct work_struct unplug_work;
+
+	/*
+	 * tunables, see top of file
+	 */
+	unsigned int bfq_fifo_expire[2];
+	unsigned int bfq_slice_idle;
+	unsigned int bfq_max_budget;
+	unsigned int bfq_timeout[2];
+	unsigned int bfq_low_latency;
+	unsigned int bfq_wr_coeff;
+	unsigned int bfq_wr_max_time;
+	unsigned int bfq_wr_min_idle;
+};
+
+/*
+ * Why a queue stopped being served.
+ */
+enum {
+	BFQ_EXP_EXHAUSTED,		/* used up its budget */
+	BFQ_EXP_TIMEOUT,		/* took too long doing it */
+	BFQ_EXP_IDLE,			/* no new request while idling */
+	BFQ_EXP_EMPTY,			/* ran out, not worth idling for */
+	BFQ_EXP_PREEMPTED,		/* a weight raised queue came along */
+	BFQ_EXP_FORCED,			/* the queue was drained */
+	BFQ_EXP_NR,
+};
+
+static const char *bfq_exp_names[BFQ_EXP_NR] = {
+	"exhausted", "timeout", "idle", "empty", "preempted", "forced",
+};
+
+/*
+ * Per process-grouping structure
+ */
+struct bfq_queue {
+	struct bfq_entity entity;	/* in bfqg->st */
+	struct bfq_data *bfqd;
+	struct bfq_group *bfqg;
+	int ref;			/* allocated requests */
+
+	pid_t pid;			/* 0 for the async queue of a group */
+	struct hlist_node bfq_hash;
+	struct list_head list;		/* on bfqd->queue_list */
+	struct list_head idle_list;	/* on bfqd->idle_list while ref is 0 */
+
+	/* sorted list of pending requests */
+	struct rb_root sort_list;
+	/* fifo list of requests in sort_list */
+	struct list_head fifo;
+	int queued;
+	int allocated[2];
+	int dispatched;			/* in the driver */
+
+	unsigned long budget;		/* sectors */
+	unsigned long service;		/* sectors served from the budget */
+	unsigned long budget_timeout;
+	unsigned int base_weight;	/* by I/O priority */
+
+	unsigned long last_active;	/* last request queued or completed */
+	unsigned long wr_end;		/* weight raised until */
+
+	sector_t last_pos;
+	sector_t seek_mean;
+	u64 seek_total;
+	unsigned int seek_samples;
+
+	/* various state flags, see below */
+	unsigned int flags;
+
+	/* statistics */
+	unsigned long total_service;	/* sectors */
+	unsigned long nr_dispatched;	/* requests */
+	unsigned long nr_raised;
+	unsigned long nr_expired[BFQ_EXP_NR];
+};
+
+struct bfq_rq {
+	struct rb_node rb_node;
+	sector_t rb_key;
+	struct request *request;
+	struct hlist_node hash;
+
+	struct bfq_queue *bfq_queue;
+	unsigned int is_sync;
+};
+
+enum bfqq_state_flags {
+	BFQ_BFQQ_FLAG_busy = 0,		/* has requests, or is in service */
+	BFQ_BFQQ_FLAG_wait_request,	/* idle_slice_timer is running */
+	BFQ_BFQQ_FLAG_sync,
+	BFQ_BFQQ_FLAG_raised,		/* weight raised for low latency */
+};
+
+#define BFQ_BFQQ_FNS(name)						\
+static inline void bfq_mark_bfqq_##name(struct bfq_queue *bfqq)		\
+{									\
+	bfqq->flags |= (1 << BFQ_BFQQ_FLAG_##name);			\
+}									\
+static inline void bfq_clear_bfqq_##name(struct bfq_queue *bfqq)	\
+{									\
+	bfqq->flags &= ~(1 << BFQ_BFQQ_FLAG_##name);			\
+}									\
+static inline int bfq_bfqq_##name(const struct bfq_queue *bfqq)		\
+{									\
+	return (bfqq->flags & (1 << BFQ_BFQQ_FLAG_##name)) != 0;	\
+}
+
+BFQ_BFQQ_FNS(busy);
+BFQ_BFQQ_FNS(wait_request);
+BFQ_BFQQ_FNS(sync);
+BFQ_BFQQ_FNS(raised);
+#undef BFQ_BFQQ_FNS
+
+static void bfq_dispatch_insert(request_queue_t *, struct bfq_rq *);
+
+#define process_sync(tsk)	((tsk)->flags & PF_SYNCWRITE)
+
+/*
+ * the back merge hash support functions, as in cfq
+ */
+static inline void bfq_del_brq_hash(struct bfq_rq *brq)
+{
+	hlist_del_init(&brq->hash);
+}
+
+static inline void bfq_add_brq_hash(struct bfq_data *bfqd, struct bfq_rq *brq)
+{
+	const int hash_idx = BFQ_MHASH_FN(rq_hash_key(brq->request));
+
+	hlist_add_head(&brq->hash, &bfqd->brq_hash[hash_idx]);
+}
+
+static struct request *bfq_find_rq_hash(struct bfq_data *bfqd, sector_t offset)
+{
+	struct hlist_head *hash_list = &bfqd->brq_hash[BFQ_MHASH_FN(offset)];
+	struct hlist_node *entry, *next;
+
+	hlist_for_each_safe(entry, next, hash_list) {
+		struct bfq_rq *brq = list_entry_hash(entry);
+		struct request *__rq = brq->request;
+
+		if (!rq_mergeable(__rq)) {
+			bfq_del_brq_hash(brq);
+			continue;
+		}
+
+		if (rq_hash_key(__rq) == offset)
+			return __rq;
+	}
+
+	return NULL;
+}
+
+/*
+ * scheduler run of queue, if there are requests pending and no one in the
+ * driver that will restart queueing
+ */
+static inline void bfq_schedule_dispatch(struct bfq_data *bfqd)
+{
+	if (bfqd->busy_queues)
+		kblockd_schedule_work(&bfqd->unplug_work);
+}
+
+static int bfq_queue_empty(request_queue_t *q)
+{
+	struct bfq_data *bfqd = q->elevator->elevator_data;
+
+	return !bfqd->busy_queues;
+}
+
+static void bfq_start_queueing(struct bfq_data *bfqd)
+{
+	request_queue_t *q = bfqd->queue;
+
+	if (!blk_queue_plugged(q))
+		q->request_fn(q);
+	else
+		__generic_unplug_device(q);
+}
+
+/*
+ * Weighted fair queueing. An entity that gets busy starts at the virtual
+ * time of its tree, or where its last service finished if that is later,
+ * and is expected to finish after its budget divided by its weight. The
+ * entity served next is the one with the earliest finish among those
+ * that have started (start <= vtime); the virtual time of the tree then
+ * moves to its start. When it is done, it is charged the service it
+ * actually got.
+ */
+static inline u64 bfq_delta(unsigned long service, unsigned int weight)
+{
+	u64 d = (u64) service << BFQ_SERVICE_SHIFT;
+
+	do_div(d, weight);
+	return d;
+}
+
+static void bfq_st_insert(struct bfq_service_tree *st, struct bfq_entity *e)
+{
+	struct rb_node **p = &st->active.rb_node;
+	struct rb_node *parent = NULL;
+
+	while (*p) {
+		parent = *p;
+		if (e->finish < rb_entry_entity(parent)->finish)
+			p = &(*p)->rb_left;
+		else
+			p = &(*p)->rb_right;
+	}
+
+	rb_link_node(&e->rb_node, parent, p);
+	rb_insert_color(&e->rb_node, &st->active);
+	e->on_st = 1;
+}
+
+static void bfq_st_remove(struct bfq_service_tree *st, struct bfq_entity *e)
+{
+	rb_erase(&e->rb_node, &st->active);
+	e->on_st = 0;
+}
+
+static void bfq_activate_entity(struct bfq_service_tree *st,
+				struct bfq_entity *e, unsigned long budget)
+{
+	e->start = max(st->vtime, e->finish);
+	e->finish = e->start + bfq_delta(budget, e->weight);
+	bfq_st_insert(st, e);
+}
+
+/*
+ * The entity to serve next, without touching the tree: if nobody has
+ * started yet, the one with the earliest start.
+ */
+static struct bfq_entity *bfq_lookup_first(struct bfq_service_tree *st)
+{
+	struct bfq_entity *e, *first = NULL;
+	struct rb_node *n;
+
+	for (n = rb_first(&st->active); n; n = rb_next(n)) {
+		e = rb_entry_entity(n);
+		if (e->start <= st->vtime)
+			return e;
+		if (!first || e->start < first->start)
+			first = e;
+	}
+	return first;
+}
+
+static struct bfq_entity *bfq_first_active(struct bfq_service_tree *st)
+{
+	struct bfq_entity *e = bfq_lookup_first(st);
+
+	/*
+	 * nobody has started yet, virtual time jumps to the earliest start.
+	 * bfq_lookup_first() returns an entity with start > vtime only in
+	 * that case, so this is the only case the virtual time moves in.
+	 */
+	if (e && e->start > st->vtime)
+		st->vtime = e->start;
+	return e;
+}
+
+static struct bfq_entity *bfq_serve_first(struct bfq_service_tree *st)
+{
+	struct bfq_entity *e = bfq_first_active(st);
+
+	if (e) {
+		bfq_st_remove(st, e);
+		st->vtime = max(st->vtime, e->start);
+		st->in_service = e;
+	}
+	return e;
+}
+
+static inline void bfq_charge_entity(struct bfq_entity *e,
+				     unsigned long service)
+{
+	e->finish = e->start + bfq_delta(service, e->weight);
+}
+
+/*
+ * Budget of the queue a group would be served for next, to estimate when
+ * the group's service will finish.
+ */
+static unsigned long bfq_group_budget(struct bfq_data *bfqd,
+				      struct bfq_group *bfqg)
+{
+	struct bfq_entity *e = bfq_lookup_first(&bfqg->st);
+
+	if (!e)
+		return bfqd->bfq_max_budget;
+	return container_of(e, struct bfq_queue, entity)->budget;
+}
+
+/*
+ * Weight raising: a sync queue that gets busy after having been idle for
+ * a while, an interactive task or one just started, gets its weight
+ * multiplied for a short time, so that it is served quickly even if
+ * large sequential readers or writers share the disk with it.
+ */
+static void bfq_update_weight(struct bfq_data *bfqd, struct bfq_queue *bfqq)
+{
+	if (bfq_bfqq_raised(bfqq) &&
+	    (!bfqd->bfq_low_latency || time_after(jiffies, bfqq->wr_end)))
+		bfq_clear_bfqq_raised(bfqq);
+
+	bfqq->entity.weight = bfqq->base_weight;
+	if (bfq_bfqq_raised(bfqq))
+		bfqq->entity.weight *= bfqd->bfq_wr_coeff;
+}
+
+static void bfq_add_bfqq_busy(struct bfq_data *bfqd, struct bfq_queue *bfqq)
+{
+	struct bfq_group *bfqg = bfqq->bfqg;
+
+	BUG_ON(bfq_bfqq_busy(bfqq));
+	bfq_mark_bfqq_busy(bfqq);
+	bfqd->busy_queues++;
+
+	if (bfqd->bfq_low_latency && bfq_bfqq_sync(bfqq) &&
+	    time_after(jiffies, bfqq->last_active + bfqd->bfq_wr_min_idle)) {
+		bfq_mark_bfqq_raised(bfqq);
+		bfqq->wr_end = jiffies + bfqd->bfq_wr_max_time;
+		bfqq->nr_raised++;
+	}
+	bfq_update_weight(bfqd, bfqq);
+
+	bfq_activate_entity(&bfqg->st, &bfqq->entity, bfqq->budget);
+	if (!bfqg->nr_busy++ && bfqd->root.in_service != &bfqg->entity)
+		bfq_activate_entity(&bfqd->root, &bfqg->entity, bfqq->budget);
+}
+
+static void bfq_del_bfqq_busy(struct bfq_data *bfqd, struct bfq_queue *bfqq)
+{
+	struct bfq_group *bfqg = bfqq->bfqg;
+
+	BUG_ON(!bfq_bfqq_busy(bfqq));
+	bfq_clear_bfqq_busy(bfqq);
+	bfqd->busy_queues--;
+
+	if (bfqq->entity.on_st)
+		bfq_st_remove(&bfqg->st, &bfqq->entity);
+	if (!--bfqg->nr_busy && bfqg->entity.on_st)
+		bfq_st_remove(&bfqd->root, &bfqg->entity);
+}
+
+/*
+ * Adapt the budget of a sync queue to what it actually uses: double it
+ * for a queue that used it all up, cut it down to what was used for one
+ * that ran out of requests, halve it for one too slow to use it in time.
+ */
+static void bfq_update_budget(struct bfq_data *bfqd, struct bfq_queue *bfqq,
+			      int reason)
+{
+	unsigned long max_budget = bfqd->bfq_max_budget;
+	unsigned long min_budget = max(max_budget / BFQ_MIN_BUDGET_DIV, 1UL);
+
+	if (!bfq_bfqq_sync(bfqq)) {
+		bfqq->budget = max(max_budget / BFQ_ASYNC_BUDGET_DIV, 1UL);
+		return;
+	}
+
+	switch (reason) {
+	case BFQ_EXP_EXHAUSTED:
+		bfqq->budget = min(bfqq->budget * 2, max_budget);
+		break;
+	case BFQ_EXP_IDLE:
+	case BFQ_EXP_EMPTY:
+		bfqq->budget = max(bfqq->service, min_budget);
+		break;
+	case BFQ_EXP_TIMEOUT:
+		bfqq->budget = max(bfqq->budget / 2, min_budget);
+		break;
+	}
+	bfqq->budget = min(bfqq->budget, max_budget);
+}
+
+/*
+ * The active queue is done: charge it and its group for the service it
+ * got, and put them back in line if they have requests left. A queue
+ * that did not manage to use its budget in time is charged the whole
+ * budget, so that random I/O does not get more disk time than sequential
+ * I/O of the same weight.
+ */
+static void bfq_expire_queue(struct bfq_data *bfqd, int reason)
+{
+	struct bfq_queue *bfqq = bfqd->active_queue;
+	struct bfq_group *bfqg = bfqq->bfqg;
+	unsigned long charge = bfqq->service;
+
+	del_timer(&bfqd->idle_slice_timer);
+	bfq_clear_bfqq_wait_request(bfqq);
+
+	if (reason == BFQ_EXP_TIMEOUT)
+		charge = max(charge, bfqq->budget);
+	bfqq->nr_expired[reason]++;
+
+	bfq_charge_entity(&bfqq->entity, charge);
+	bfq_charge_entity(&bfqg->entity, charge);
+	bfqg->st.in_service = NULL;
+	bfqd->root.in_service = NULL;
+	bfqd->active_queue = NULL;
+
+	if (reason != BFQ_EXP_PREEMPTED && reason != BFQ_EXP_FORCED)
+		bfq_update_budget(bfqd, bfqq, reason);
+	bfq_update_weight(bfqd, bfqq);
+
+	if (!RB_EMPTY(&bfqq->sort_list))
+		bfq_activate_entity(&bfqg->st, &bfqq->entity, bfqq->budget);
+	else
+		bfq_del_bfqq_busy(bfqd, bfqq);
+
+	if (bfqg->nr_busy)
+		bfq_activate_entity(&bfqd->root, &bfqg->entity,
+				    bfq_group_budget(bfqd, bfqg));
+}
+
+static struct bfq_queue *bfq_set_active_queue(struct bfq_data *bfqd)
+{
+	struct bfq_queue *bfqq;
+	struct bfq_group *bfqg;
+	struct bfq_entity *e;
+
+	if (!bfqd->busy_queues)
+		return NULL;
+
+	e = bfq_serve_first(&bfqd->root);
+	BUG_ON(!e);
+	bfqg = container_of(e, struct bfq_group, entity);
+	e = bfq_serve_first(&bfqg->st);
+	BUG_ON(!e);
+	bfqq = container_of(e, struct bfq_queue, entity);
+
+	bfqq->service = 0;
+	bfqq->budget_timeout = jiffies +
+		bfqd->bfq_timeout[bfq_bfqq_sync(bfqq)];
+	bfqd->active_queue = bfqq;
+	return bfqq;
+}
+
+static inline int bfq_bfqq_seeky(struct bfq_queue *bfqq)
+{
+	return sample_valid(bfqq->seek_samples) &&
+		bfqq->seek_mean > BFQ_SEEKY_THRESH;
+}
+
+/*
+ * The active queue ran out of requests. Keep the disk idle for a moment
+ * if it is likely to issue another one soon, it would lose its turn
+ * otherwise: a sync queue that is not seeky, or one that is weight
+ * raised.
+ */
+static int bfq_arm_slice_timer(struct bfq_data *bfqd, struct bfq_queue *bfqq)
+{
+	if (!bfqd->bfq_slice_idle || !bfq_bfqq_sync(bfqq))
+		return 0;
+	if (bfq_bfqq_seeky(bfqq) && !bfq_bfqq_raised(bfqq))
+		return 0;
+
+	bfq_mark_bfqq_wait_request(bfqq);
+	mod_timer(&bfqd->idle_slice_timer, jiffies + bfqd->bfq_slice_idle);
+	return 1;
+}
+
+/*
+ * The oldest request of the queue if it has waited too long, else the
+ * first one at or after the head position.
+ */
+static struct bfq_rq *bfq_next_brq(struct bfq_data *bfqd,
+				   struct bfq_queue *bfqq)
+{
+	struct rb_node *n = bfqq->sort_list.rb_node;
+	struct bfq_rq *brq, *next = NULL;
+	struct request *rq;
+
+	if (!list_empty(&bfqq->fifo)) {
+		rq = list_entry_fifo(bfqq->fifo.next);
+		if (time_after(jiffies, rq->start_time +
+			       bfqd->bfq_fifo_expire[bfq_bfqq_sync(bfqq)]))
+			return RQ_DATA(rq);
+	}
+
+	while (n) {
+		brq = rb_entry_brq(n);
+		if (brq->rb_key >= bfqd->last_position) {
+			next = brq;
+			n = n->rb_left;
+		} else
+			n = n->rb_right;
+	}
+	if (!next)
+		next = rb_entry_brq(rb_first(&bfqq->sort_list));
+	return next;
+}
+
+static struct bfq_queue *bfq_select_queue(struct bfq_data *bfqd)
+{
+	struct bfq_queue *bfqq = bfqd->active_queue;
+	struct bfq_rq *brq;
+	int reason;
+
+	if (!bfqq)
+		goto new_queue;
+
+	/*
+	 * idling, the timer or a new request will get things going again
+	 */
+	if (bfq_bfqq_wait_request(bfqq))
+		return NULL;
+
+	if (time_after(jiffies, bfqq->budget_timeout)) {
+		reason = BFQ_EXP_TIMEOUT;
+		goto expire;
+	}
+
+	if (!RB_EMPTY(&bfqq->sort_list)) {
+		brq = bfq_next_brq(bfqd, bfqq);
+		if (bfqq->service &&
+		    bfqq->service + brq->request->nr_sectors > bfqq->budget) {
+			reason = BFQ_EXP_EXHAUSTED;
+			goto expire;
+		}
+		return bfqq;
+	}
+
+	/*
+	 * out of requests: wait for those in the driver to complete before
+	 * deciding whether to idle, see bfq_completed_request()
+	 */
+	if (bfqq->dispatched && bfq_bfqq_sync(bfqq))
+		return NULL;
+	if (bfq_arm_slice_timer(bfqd, bfqq))
+		return NULL;
+	reason = BFQ_EXP_EMPTY;
+expire:
+	bfq_expire_queue(bfqd, reason);
+new_queue:
+	return bfq_set_active_queue(bfqd);
+}
+
+/*
+ * rb tree support functions
+ */
+static struct bfq_rq *__bfq_add_brq_rb(struct bfq_rq *brq)
+{
+	struct rb_node **p = &brq->bfq_queue->sort_list.rb_node;
+	struct rb_node *parent = NULL;
+	struct bfq_rq *__brq;
+
+	while (*p) {
+		parent = *p;
+		__brq = rb_entry_brq(parent);
+
+		if (brq->rb_key < __brq->rb_key)
+			p = &(*p)->rb_left;
+		else if (brq->rb_key > __brq->rb_key)
+			p = &(*p)->rb_right;
+		else
+			return __brq;
+	}
+
+	rb_link_node(&brq->rb_node, parent, p);
+	return NULL;
+}
+
+static void bfq_add_brq_rb(struct bfq_rq *brq)
+{
+	struct bfq_queue *bfqq = brq->bfq_queue;
+	struct bfq_rq *__alias;
+
+	brq->rb_key = brq->request->sector;
+	bfqq->queued++;
+
+	/*
+	 * looks a little odd, but the first insert might return an alias.
+	 * if that happens, put the alias on the dispatch list
+	 */
+	while ((__alias = __bfq_add_brq_rb(brq)) != NULL)
+		bfq_dispatch_insert(bfqq->bfqd->queue, __alias);
+
+	rb_insert_color(&brq->rb_node, &bfqq->sort_list);
+}
+
+static void bfq_del_brq_rb(struct bfq_rq *brq)
+{
+	struct bfq_queue *bfqq = brq->bfq_queue;
+	struct bfq_data *bfqd = bfqq->bfqd;
+
+	BUG_ON(!bfqq->queued);
+	bfqq->queued--;
+
+	rb_erase(&brq->rb_node, &bfqq->sort_list);
+	RB_CLEAR_COLOR(&brq->rb_node);
+
+	/*
+	 * the active queue stays busy until it is expired
+	 */
+	if (RB_EMPTY(&bfqq->sort_list) && bfq_bfqq_busy(bfqq) &&
+	    bfqq != bfqd->active_queue)
+		bfq_del_bfqq_busy(bfqd, bfqq);
+}
+
+static void bfq_remove_request(struct request *rq)
+{
+	struct bfq_rq *brq = RQ_DATA(rq);
+
+	list_del_init(&rq->queuelist);
+	bfq_del_brq_rb(brq);
+	bfq_del_brq_hash(brq);
+}
+
+static void bfq_dispatch_insert(request_queue_t *q, struct bfq_rq *brq)
+{
+	struct bfq_data *bfqd = q->elevator->elevator_data;
+	struct bfq_queue *bfqq = brq->bfq_queue;
+	struct request *rq = brq->request;
+
+	bfq_remove_request(rq);
+	bfqq->dispatched++;
+
+	bfqq->service += rq->nr_sectors;
+	bfqq->total_service += rq->nr_sectors;
+	bfqq->nr_dispatched++;
+	bfqq->bfqg->service += rq->nr_sectors;
+	bfqq->bfqg->dispatched++;
+
+	bfqd->last_position = rq->sector + rq->nr_sectors;
+	elv_dispatch_sort(q, rq);
+}
+
+static struct bfq_group *bfq_find_group(struct bfq_data *bfqd,
+					unsigned long id)
+{
+	struct hlist_head *hash_list;
+	struct hlist_node *entry;
+	struct bfq_group *bfqg;
+
+	hash_list = &bfqd->group_hash[hash_long(id, BFQ_QHASH_SHIFT)];
+	hlist_for_each_entry(bfqg, entry, hash_list, hash)
+		if (bfqg->id == id)
+			return bfqg;
+
+	return NULL;
+}
+
+static struct bfq_queue *bfq_find_queue(struct bfq_data *bfqd,
+					struct bfq_group *bfqg, pid_t pid)
+{
+	struct hlist_head *hash_list;
+	struct hlist_node *entry;
+	struct bfq_queue *bfqq;
+
+	if (!pid)
+		return bfqg->async_queue;
+
+	hash_list = &bfqd->bfq_hash[hash_long(pid, BFQ_QHASH_SHIFT)];
+	hlist_for_each_entry(bfqq, entry, hash_list, bfq_hash)
+		if (bfqq->pid == pid && bfqq->bfqg == bfqg)
+			return bfqq;
+
+	return NULL;
+}
+
+/*
+ * A front merge candidate in the sync queue the bio would go to, the one
+ * of the current task in its cpuset's group.
+ */
+static struct request *
+bfq_find_rq_fmerge(struct bfq_data *bfqd, struct bio *bio)
+{
+	struct bfq_queue *bfqq;
+	struct bfq_group *bfqg;
+	struct rb_node *n;
+	sector_t sector;
+	unsigned int weight;
+
+	if (bio_data_dir(bio) == WRITE && !process_sync(current))
+		return NULL;
+
+	bfqg = bfq_find_group(bfqd, cpuset_io_group(&weight));
+	if (!bfqg)
+		return NULL;
+	bfqq = bfq_find_queue(bfqd, bfqg, current->pid);
+	if (!bfqq)
+		return NULL;
+
+	sector = bio->bi_sector + bio_sectors(bio);
+	n = bfqq->sort_list.rb_node;
+	while (n) {
+		struct bfq_rq *brq = rb_entry_brq(n);
+
+		if (sector < brq->rb_key)
+			n = n->rb_left;
+		else if (sector > brq->rb_key)
+			n = n->rb_right;
+		else
+			return brq->request;
+	}
+
+	return NULL;
+}
+
+static int
+bfq_merge(request_queue_t *q, struct request **req, struct bio *bio)
+{
+	struct bfq_data *bfqd = q->elevator->elevator_data;
+	struct request *__rq;
+	int ret;
+
+	__rq = bfq_find_rq_hash(bfqd, bio->bi_sector);
+	if (__rq && elv_rq_merge_ok(__rq, bio)) {
+		ret = ELEVATOR_BACK_MERGE;
+		goto out;
+	}
+
+	__rq = bfq_find_rq_fmerge(bfqd, bio);
+	if (__rq && elv_rq_merge_ok(__rq, bio)) {
+		ret = ELEVATOR_FRONT_MERGE;
+		goto out;
+	}
+
+	return ELEVATOR_NO_MERGE;
+out:
+	*req = __rq;
+	return ret;
+}
+
+static void bfq_merged_request(request_queue_t *q, struct request *req)
+{
+	struct bfq_data *bfqd = q->elevator->elevator_data;
+	struct bfq_rq *brq = RQ_DATA(req);
+
+	bfq_del_brq_hash(brq);
+	bfq_add_brq_hash(bfqd, brq);
+
+	if (req->sector != brq->rb_key) {
+		struct bfq_queue *bfqq = brq->bfq_queue;
+
+		rb_erase(&brq->rb_node, &bfqq->sort_list);
+		bfqq->queued--;
+		bfq_add_brq_rb(brq);
+
+		/*
+		 * an alias dispatched by bfq_add_brq_rb() may have emptied
+		 * the queue for a moment
+		 */
+		if (!bfq_bfqq_busy(bfqq))
+			bfq_add_bfqq_busy(bfqd, bfqq);
+	}
+}
+
+static void
+bfq_merged_requests(request_queue_t *q, struct request *rq,
+		    struct request *next)
+{
+	bfq_merged_request(q, rq);
+
+	/*
+	 * reposition in fifo if next is older than rq
+	 */
+	if (!list_empty(&rq->queuelist) && !list_empty(&next->queuelist) &&
+	    time_before(next->start_time, rq->start_time))
+		list_move(&rq->queuelist, &next->queuelist);
+
+	bfq_remove_request(next);
+}
+
+static int bfq_dispatch_requests(request_queue_t *q, int force)
+{
+	struct bfq_data *bfqd = q->elevator->elevator_data;
+	struct bfq_queue *bfqq;
+	int dispatched = 0;
+
+	if (!bfqd->busy_queues)
+		return 0;
+
+	if (unlikely(force)) {
+		if (bfqd->active_queue)
+			bfq_expire_queue(bfqd, BFQ_EXP_FORCED);
+		while ((bfqq = bfq_set_active_queue(bfqd)) != NULL) {
+			while (!RB_EMPTY(&bfqq->sort_list)) {
+				bfq_dispatch_insert(q,
+					rb_entry_brq(rb_first(&bfqq->sort_list)));
+				dispatched++;
+			}
+			bfq_expire_queue(bfqd, BFQ_EXP_FORCED);
+		}
+		return dispatched;
+	}
+
+	/*
+	 * one request at a time, so that the budget is checked before each
+	 */
+	bfqq = bfq_select_queue(bfqd);
+	if (!bfqq)
+		return 0;
+
+	bfq_dispatch_insert(q, bfq_next_brq(bfqd, bfqq));
+	return 1;
+}
+
+static void bfq_update_io_seektime(struct bfq_queue *bfqq, struct request *rq)
+{
+	sector_t sdist;
+
+	if (rq->sector >= bfqq->last_pos)
+		sdist = rq->sector - bfqq->last_pos;
+	else
+		sdist = bfqq->last_pos - rq->sector;
+	sdist = min_t(sector_t, sdist, 4 * BFQ_SEEKY_THRESH);
+
+	/*
+	 * decaying average as in cfq, 7/8 of the old value
+	 */
+	bfqq->seek_samples = (7 * bfqq->seek_samples + 256) / 8;
+	bfqq->seek_total = (7 * bfqq->seek_total + (u64) 256 * sdist) / 8;
+	bfqq->seek_mean = bfqq->seek_total + bfqq->seek_samples / 2;
+	if (bfqq->seek_samples)
+		do_div(bfqq->seek_mean, bfqq->seek_samples);
+
+	bfqq->last_pos = rq->sector + rq->nr_sectors;
+}
+
+static void bfq_insert_request(request_queue_t *q, struct request *rq)
+{
+	struct bfq_data *bfqd = q->elevator->elevator_data;
+	struct bfq_rq *brq = RQ_DATA(rq);
+	struct bfq_queue *bfqq = brq->bfq_queue;
+	struct bfq_queue *active;
+
+	bfq_add_brq_rb(brq);
+	list_add_tail(&rq->queuelist, &bfqq->fifo);
+	if (rq_mergeable(rq))
+		bfq_add_brq_hash(bfqd, brq);
+
+	if (brq->is_sync)
+		bfq_update_io_seektime(bfqq, rq);
+
+	if (!bfq_bfqq_busy(bfqq))
+		bfq_add_bfqq_busy(bfqd, bfqq);
+	bfqq->last_active = jiffies;
+
+	active = bfqd->active_queue;
+	if (bfqq == active) {
+		/*
+		 * if we are waiting for a request for this queue, let it rip
+		 */
+		if (bfq_bfqq_wait_request(bfqq)) {
+			bfq_clear_bfqq_wait_request(bfqq);
+			del_timer(&bfqd->idle_slice_timer);
+			bfq_start_queueing(bfqd);
+		}
+	} else if (active && bfq_bfqq_raised(bfqq) &&
+		   !bfq_bfqq_raised(active) &&
+		   (!bfq_bfqq_sync(active) || bfq_bfqq_wait_request(active))) {
+		/*
+		 * a weight raised queue does not wait behind an async queue,
+		 * or for one that is idling
+		 */
+		bfq_expire_queue(bfqd, BFQ_EXP_PREEMPTED);
+		bfq_start_queueing(bfqd);
+	}
+}
+
+static void bfq_activate_request(request_queue_t *q, struct request *rq)
+{
+	struct bfq_data *bfqd = q->elevator->elevator_data;
+
+	bfqd->rq_in_driver++;
+}
+
+static void bfq_deactivate_request(request_queue_t *q, struct request *rq)
+{
+	struct bfq_data *bfqd = q->elevator->elevator_data;
+
+	WARN_ON(!bfqd->rq_in_driver);
+	bfqd->rq_in_driver--;
+}
+
+static void bfq_completed_request(request_queue_t *q, struct request *rq)
+{
+	struct bfq_rq *brq = RQ_DATA(rq);
+	struct bfq_queue *bfqq = brq->bfq_queue;
+	struct bfq_data *bfqd = bfqq->bfqd;
+
+	WARN_ON(!bfqd->rq_in_driver);
+	WARN_ON(!bfqq->dispatched);
+	bfqd->rq_in_driver--;
+	bfqq->dispatched--;
+
+	if (brq->is_sync)
+		bfqq->last_active = jiffies;
+
+	/*
+	 * the last request of an active queue that ran out of them is done:
+	 * idle for its next one, or move on
+	 */
+	if (bfqq == bfqd->active_queue && !bfqq->dispatched &&
+	    RB_EMPTY(&bfqq->sort_list) && !bfq_bfqq_wait_request(bfqq)) {
+		if (time_after(jiffies, bfqq->budget_timeout))
+			bfq_expire_queue(bfqd, BFQ_EXP_TIMEOUT);
+		else if (!bfq_arm_slice_timer(bfqd, bfqq))
+			bfq_expire_queue(bfqd, BFQ_EXP_EMPTY);
+	}
+
+	if (!bfqd->rq_in_driver)
+		bfq_schedule_dispatch(bfqd);
+}
+
+static struct request *
+bfq_former_request(request_queue_t *q, struct request *rq)
+{
+	struct bfq_rq *brq = RQ_DATA(rq);
+	struct rb_node *rbprev = rb_prev(&brq->rb_node);
+
+	if (rbprev)
+		return rb_entry_brq(rbprev)->request;
+
+	return NULL;
+}
+
+static struct request *
+bfq_latter_request(request_queue_t *q, struct request *rq)
+{
+	struct bfq_rq *brq = RQ_DATA(rq);
+	struct rb_node *rbnext = rb_next(&brq->rb_node);
+
+	if (rbnext)
+		return rb_entry_brq(rbnext)->request;
+
+	return NULL;
+}
+
+static unsigned int bfq_ioprio_weight(struct task_struct *tsk)
+{
+	int ioprio;
+
+	if (IOPRIO_PRIO_CLASS(tsk->ioprio) == IOPRIO_CLASS_IDLE)
+		return 1;
+	if (ioprio_valid(tsk->ioprio))
+		ioprio = task_ioprio(tsk);
+	else
+		ioprio = task_nice_ioprio(tsk);
+
+	return (IOPRIO_BE_NR - ioprio) * BFQ_WEIGHT_PRIO_STEP;
+}
+
+static void bfq_free_group(struct bfq_data *bfqd, struct bfq_group *bfqg)
+{
+	BUG_ON(bfqg->nr_busy || bfqg->entity.on_st);
+
+	hlist_del(&bfqg->hash);
+	list_del(&bfqg->list);
+	kmem_cache_free(bfq_group_pool, bfqg);
+}
+
+static void bfq_free_queue(struct bfq_data *bfqd, struct bfq_queue *bfqq)
+{
+	struct bfq_group *bfqg = bfqq->bfqg;
+
+	BUG_ON(bfqq->ref || bfq_bfqq_busy(bfqq));
+	BUG_ON(bfqq == bfqd->active_queue);
+
+	if (bfqq->pid)
+		hlist_del(&bfqq->bfq_hash);
+	else
+		bfqg->async_queue = NULL;
+	list_del(&bfqq->list);
+	list_del(&bfqq->idle_list);
+	kmem_cache_free(bfq_pool, bfqq);
+
+	if (!--bfqg->ref)
+		bfq_free_group(bfqd, bfqg);
+}
+
+/*
+ * A queue without requests is kept for a while, so that the weight
+ * raising heuristic and the fair queueing remember its recent past. Free
+ * the ones that have been idle longer than that matters.
+ */
+static void bfq_reap_queues(struct bfq_data *bfqd)
+{
+	struct bfq_queue *bfqq, *next;
+
+	list_for_each_entry_safe(bfqq, next, &bfqd->idle_list, idle_list) {
+		if (bfqq == bfqd->active_queue || bfq_bfqq_busy(bfqq))
+			continue;
+		if (time_before(jiffies,
+				bfqq->last_active + bfqd->bfq_wr_min_idle))
+			continue;
+		bfq_free_queue(bfqd, bfqq);
+	}
+}
+
+static void bfq_init_group(struct bfq_data *bfqd, struct bfq_group *bfqg,
+			   unsigned long id)
+{
+	memset(bfqg, 0, sizeof(*bfqg));
+	RB_CLEAR(&bfqg->entity.rb_node);
+	bfqg->entity.weight = CPUSET_IO_WEIGHT_DEFAULT;
+	bfqg->st.active = RB_ROOT;
+	bfqg->st.vtime = bfqd->root.vtime;
+	bfqg->id = id;
+	hlist_add_head(&bfqg->hash,
+		       &bfqd->group_hash[hash_long(id, BFQ_QHASH_SHIFT)]);
+	list_add_tail(&bfqg->list, &bfqd->group_list);
+}
+
+static void bfq_init_queue_data(struct bfq_data *bfqd, struct bfq_queue *bfqq,
+				struct bfq_group *bfqg, pid_t pid)
+{
+	memset(bfqq, 0, sizeof(*bfqq));
+	RB_CLEAR(&bfqq->entity.rb_node);
+	bfqq->entity.finish = bfqg->st.vtime;
+	bfqq->bfqd = bfqd;
+	bfqq->bfqg = bfqg;
+	bfqg->ref++;
+	bfqq->pid = pid;
+	bfqq->sort_list = RB_ROOT;
+	INIT_LIST_HEAD(&bfqq->fifo);
+	INIT_LIST_HEAD(&bfqq->idle_list);
+	bfqq->budget = bfqd->bfq_max_budget;
+	bfqq->last_active = jiffies - bfqd->bfq_wr_min_idle - 1;
+
+	if (pid) {
+		bfq_mark_bfqq_sync(bfqq);
+		hlist_add_head(&bfqq->bfq_hash,
+			       &bfqd->bfq_hash[hash_long(pid, BFQ_QHASH_SHIFT)]);
+	} else {
+		bfqq->budget = max(bfqd->bfq_max_budget /
+				   BFQ_ASYNC_BUDGET_DIV, 1U);
+		bfqg->async_queue = bfqq;
+	}
+	list_add_tail(&bfqq->list, &bfqd->queue_list);
+}
+
+/*
+ * The queue for a request of the current task: its sync queue, or the
+ * async queue of its cpuset. Called with the queue lock held, which is
+ * dropped to allocate if the gfp_mask allows.
+ */
+static struct bfq_queue *
+bfq_get_queue(struct bfq_data *bfqd, pid_t pid, gfp_t gfp_mask)
+{
+	request_queue_t *q = bfqd->queue;
+	struct bfq_queue *bfqq, *new_bfqq = NULL;
+	struct bfq_group *bfqg, *new_bfqg = NULL;
+	unsigned long id;
+	unsigned int weight;
+
+retry:
+	id = cpuset_io_group(&weight);
+	bfqg = bfq_find_group(bfqd, id);
+	bfqq = bfqg ? bfq_find_queue(bfqd, bfqg, pid) : NULL;
+
+	if (!bfqq) {
+		/*
+		 * a new group is allocated even if there is one already, as
+		 * reaping the idle queues below may free it
+		 */
+		if (!new_bfqg || !new_bfqq) {
+			if (gfp_mask & __GFP_WAIT) {
+				spin_unlock_irq(q->queue_lock);
+				if (!new_bfqg)
+					new_bfqg = kmem_cache_alloc(bfq_group_pool,
+								    gfp_mask);
+				if (!new_bfqq)
+					new_bfqq = kmem_cache_alloc(bfq_pool,
+								    gfp_mask);
+				spin_lock_irq(q->queue_lock);
+				if (new_bfqg && new_bfqq)
+					goto retry;
+			} else {
+				if (!new_bfqg)
+					new_bfqg = kmem_cache_alloc(bfq_group_pool,
+								    gfp_mask);
+				if (!new_bfqq)
+					new_bfqq = kmem_cache_alloc(bfq_pool,
+								    gfp_mask);
+			}
+			if (!new_bfqg || !new_bfqq)
+				goto out;
+		}
+
+		bfq_reap_queues(bfqd);
+
+		bfqg = bfq_find_group(bfqd, id);
+		if (!bfqg) {
+			bfqg = new_bfqg;
+			new_bfqg = NULL;
+			bfq_init_group(bfqd, bfqg, id);
+		}
+		bfqq = new_bfqq;
+		new_bfqq = NULL;
+		bfq_init_queue_data(bfqd, bfqq, bfqg, pid);
+	}
+
+	bfqg->entity.weight = weight;
+	bfqq->base_weight = bfq_ioprio_weight(current);
+out:
+	if (new_bfqq)
+		kmem_cache_free(bfq_pool, new_bfqq);
+	if (new_bfqg)
+		kmem_cache_free(bfq_group_pool, new_bfqg);
+	return bfqq;
+}
+
+static void bfq_check_waiters(request_queue_t *q)
+{
+	struct request_list *rl = &q->rq;
+
+	smp_mb();
+	if (waitqueue_active(&rl->wait[READ]))
+		wake_up(&rl->wait[READ]);
+	if (waitqueue_active(&rl->wait[WRITE]))
+		wake_up(&rl->wait[WRITE]);
+}
+
+/*
+ * queue lock held here
+ */
+static void bfq_put_request(request_queue_t *q, struct request *rq)
+{
+	struct bfq_data *bfqd = q->elevator->elevator_data;
+	struct bfq_rq *brq = RQ_DATA(rq);
+
+	if (brq) {
+		struct bfq_queue *bfqq = brq->bfq_queue;
+		const int rw = rq_data_dir(rq);
+
+		BUG_ON(!bfqq->allocated[rw]);
+		bfqq->allocated[rw]--;
+
+		mempool_free(brq, bfqd->brq_pool);
+		rq->elevator_private = NULL;
+
+		if (bfqd->rq_starved)
+			bfq_check_waiters(q);
+
+		BUG_ON(bfqq->ref <= 0);
+		if (!--bfqq->ref)
+			list_add_tail(&bfqq->idle_list, &bfqd->idle_list);
+	}
+}
+
+/*
+ * Allocate bfq data structures associated with this request.
+ */
+static int
+bfq_set_request(request_queue_t *q, struct request *rq, struct bio *bio,
+		gfp_t gfp_mask)
+{
+	struct bfq_data *bfqd = q->elevator->elevator_data;
+	struct task_struct *tsk = current;
+	const int rw = rq_data_dir(rq);
+	const int is_sync = rw == READ || process_sync(tsk);
+	struct bfq_queue *bfqq;
+	struct bfq_rq *brq;
+	unsigned long flags;
+
+	might_sleep_if(gfp_mask & __GFP_WAIT);
+
+	spin_lock_irqsave(q->queue_lock, flags);
+
+	bfqq = bfq_get_queue(bfqd, is_sync ? tsk->pid : 0, gfp_mask);
+	if (!bfqq)
+		goto queue_fail;
+
+	if (!bfqq->ref++)
+		list_del_init(&bfqq->idle_list);
+	bfqq->allocated[rw]++;
+	bfqd->rq_starved = 0;
+	spin_unlock_irqrestore(q->queue_lock, flags);
+
+	brq = mempool_alloc(bfqd->brq_pool, gfp_mask);
+	if (brq) {
+		RB_CLEAR(&brq->rb_node);
+		brq->rb_key = 0;
+		brq->request = rq;
+		INIT_HLIST_NODE(&brq->hash);
+		brq->bfq_queue = bfqq;
+		brq->is_sync = is_sync;
+
+		rq->elevator_private = brq;
+		return 0;
+	}
+
+	spin_lock_irqsave(q->queue_lock, flags);
+	bfqq->allocated[rw]--;
+	if (!--bfqq->ref)
+		list_add_tail(&bfqq->idle_list, &bfqd->idle_list);
+queue_fail:
+	/*
+	 * mark us rq allocation starved. we need to kickstart the process
+	 * ourselves if there are no pending requests that can do it for us.
+	 * that would be an extremely rare OOM situation
+	 */
+	bfqd->rq_starved = 1;
+	kblockd_schedule_work(&bfqd->unplug_work);
+	spin_unlock_irqrestore(q->queue_lock, flags);
+	return 1;
+}
+
+static void bfq_kick_queue(void *data)
+{
+	request_queue_t *q = data;
+	struct bfq_data *bfqd = q->elevator->elevator_data;
+	unsigned long flags;
+
+	spin_lock_irqsave(q->queue_lock, flags);
+
+	/*
+	 * we aren't guaranteed to get a request after this, but we
+	 * have to be opportunistic
+	 */
+	if (bfqd->rq_starved)
+		bfq_check_waiters(q);
+
+	blk_remove_plug(q);
+	q->request_fn(q);
+	spin_unlock_irqrestore(q->queue_lock, flags);
+}
+
+/*
+ * Timer running if the active_queue is idling for its next request
+ */
+static void bfq_idle_slice_timer(unsigned long data)
+{
+	struct bfq_data *bfqd = (struct bfq_data *) data;
+	struct bfq_queue *bfqq;
+	unsigned long flags;
+
+	spin_lock_irqsave(bfqd->queue->queue_lock, flags);
+
+	bfqq = bfqd->active_queue;
+	if (bfqq && bfq_bfqq_wait_request(bfqq)) {
+		bfq_clear_bfqq_wait_request(bfqq);
+		if (RB_EMPTY(&bfqq->sort_list))
+			bfq_expire_queue(bfqd, BFQ_EXP_IDLE);
+	}
+	bfq_schedule_dispatch(bfqd);
+
+	spin_unlock_irqrestore(bfqd->queue->queue_lock, flags);
+}
+
+static void bfq_shutdown_timer_wq(struct bfq_data *bfqd)
+{
+	del_timer_sync(&bfqd->idle_slice_timer);
+	blk_sync_queue(bfqd->queue);
+}
+
+static void bfq_exit_queue(elevator_t *e)
+{
+	struct bfq_data *bfqd = e->elevator_data;
+	request_queue_t *q = bfqd->queue;
+	struct bfq_queue *bfqq, *next;
+
+	bfq_shutdown_timer_wq(bfqd);
+
+	spin_lock_irq(q->queue_lock);
+
+	if (bfqd->active_queue)
+		bfq_expire_queue(bfqd, BFQ_EXP_FORCED);
+
+	/*
+	 * the queue is drained, no requests hold a reference any longer
+	 */
+	list_for_each_entry_safe(bfqq, next, &bfqd->queue_list, list)
+		bfq_free_queue(bfqd, bfqq);
+
+	spin_unlock_irq(q->queue_lock);
+
+	bfq_shutdown_timer_wq(bfqd);
+
+	mempool_destroy(bfqd->brq_pool);
+	kfree(bfqd->brq_hash);
+	kfree(bfqd->group_hash);
+	kfree(bfqd->bfq_hash);
+	kfree(bfqd);
+}
+
+static void *bfq_init_queue(request_queue_t *q, elevator_t *e)
+{
+	struct bfq_data *bfqd;
+	int i;
+
+	bfqd = kmalloc(sizeof(*bfqd), GFP_KERNEL);
+	if (!bfqd)
+		return NULL;
+
+	memset(bfqd, 0, sizeof(*bfqd));
+
+	bfqd->root.active = RB_ROOT;
+	INIT_LIST_HEAD(&bfqd->queue_list);
+	INIT_LIST_HEAD(&bfqd->group_list);
+	INIT_LIST_HEAD(&bfqd->idle_list);
+
+	bfqd->brq_hash = kmalloc(sizeof(struct hlist_head) * BFQ_MHASH_ENTRIES, GFP_KERNEL);
+	if (!bfqd->brq_hash)
+		goto out_brqhash;
+
+	bfqd->bfq_hash = kmalloc(sizeof(struct hlist_head) * BFQ_QHASH_ENTRIES, GFP_KERNEL);
+	if (!bfqd->bfq_hash)
+		goto out_bfqhash;
+
+	bfqd->group_hash = kmalloc(sizeof(struct hlist_head) * BFQ_QHASH_ENTRIES, GFP_KERNEL);
+	if (!bfqd->group_hash)
+		goto out_grouphash;
+
+	bfqd->brq_pool = mempool_create_slab_pool(BLKDEV_MIN_RQ, brq_pool);
+	if (!bfqd->brq_pool)
+		goto out_brqpool;
+
+	for (i = 0; i < BFQ_MHASH_ENTRIES; i++)
+		INIT_HLIST_HEAD(&bfqd->brq_hash[i]);
+	for (i = 0; i < BFQ_QHASH_ENTRIES; i++) {
+		INIT_HLIST_HEAD(&bfqd->bfq_hash[i]);
+		INIT_HLIST_HEAD(&bfqd->group_hash[i]);
+	}
+
+	bfqd->queue = q;
+
+	init_timer(&bfqd->idle_slice_timer);
+	bfqd->idle_slice_timer.function = bfq_idle_slice_timer;
+	bfqd->idle_slice_timer.data = (unsigned long) bfqd;
+
+	INIT_WORK(&bfqd->unplug_work, bfq_kick_queue, q);
+
+	bfqd->bfq_fifo_expire[0] = bfq_fifo_expire[0];
+	bfqd->bfq_fifo_expire[1] = bfq_fifo_expire[1];
+	bfqd->bfq_slice_idle = bfq_slice_idle;
+	bfqd->bfq_max_budget = bfq_max_budget;
+	bfqd->bfq_timeout[0] = bfq_timeout[0];
+	bfqd->bfq_timeout[1] = bfq_timeout[1];
+	bfqd->bfq_low_latency = bfq_low_latency;
+	bfqd->bfq_wr_coeff = bfq_wr_coeff;
+	bfqd->bfq_wr_max_time = bfq_wr_max_time;
+	bfqd->bfq_wr_min_idle = bfq_wr_min_idle;
+
+	return bfqd;
+out_brqpool:
+	kfree(bfqd->group_hash);
+out_grouphash:
+	kfree(bfqd->bfq_hash);
+out_bfqhash:
+	kfree(bfqd->brq_hash);
+out_brqhash:
+	kfree(bfqd);
+	return NULL;
+}
+
+static void bfq_slab_kill(void)
+{
+	if (brq_pool)
+		kmem_cache_destroy(brq_pool);
+	if (bfq_pool)
+		kmem_cache_destroy(bfq_pool);
+	if (bfq_group_pool)
+		kmem_cache_destroy(bfq_group_pool);
+}
+
+static int __init bfq_slab_setup(void)
+{
+	brq_pool = kmem_cache_create("brq_pool", sizeof(struct bfq_rq), 0, 0,
+					NULL, NULL);
+	if (!brq_pool)
+		goto fail;
+
+	bfq_pool = kmem_cache_create("bfq_pool", sizeof(struct bfq_queue), 0, 0,
+					NULL, NULL);
+	if (!bfq_pool)
+		goto fail;
+
+	bfq_group_pool = kmem_cache_create("bfq_group_pool",
+			sizeof(struct bfq_group), 0, 0, NULL, NULL);
+	if (!bfq_group_pool)
+		goto fail;
+
+	return 0;
+fail:
+	bfq_slab_kill();
+	return -ENOMEM;
+}
+
+/*
+ * sysfs parts below -->
+ */
+
+static ssize_t
+bfq_var_show(unsigned int var, char *page)
+{
+	return sprintf(page, "%d\n", var);
+}
+
+static ssize_t
+bfq_var_store(unsigned int *var, const char *page, size_t count)
+{
+	char *p = (char *) page;
+
+	*var = simple_strtoul(p, &p, 10);
+	return count;
+}
+
+#define SHOW_FUNCTION(__FUNC, __VAR, __CONV)				\
+static ssize_t __FUNC(elevator_t *e, char *page)			\
+{									\
+	struct bfq_data *bfqd = e->elevator_data;			\
+	unsigned int __data = __VAR;					\
+	if (__CONV)							\
+		__data = jiffies_to_msecs(__data);			\
+	return bfq_var_show(__data, (page));				\
+}
+SHOW_FUNCTION(bfq_fifo_expire_sync_show, bfqd->bfq_fifo_expire[1], 1);
+SHOW_FUNCTION(bfq_fifo_expire_async_show, bfqd->bfq_fifo_expire[0], 1);
+SHOW_FUNCTION(bfq_slice_idle_show, bfqd->bfq_slice_idle, 1);
+SHOW_FUNCTION(bfq_max_budget_show, bfqd->bfq_max_budget, 0);
+SHOW_FUNCTION(bfq_timeout_sync_show, bfqd->bfq_timeout[1], 1);
+SHOW_FUNCTION(bfq_timeout_async_show, bfqd->bfq_timeout[0], 1);
+SHOW_FUNCTION(bfq_low_latency_show, bfqd->bfq_low_latency, 0);
+SHOW_FUNCTION(bfq_wr_coeff_show, bfqd->bfq_wr_coeff, 0);
+SHOW_FUNCTION(bfq_wr_max_time_show, bfqd->bfq_wr_max_time, 1);
+SHOW_FUNCTION(bfq_wr_min_idle_show, bfqd->bfq_wr_min_idle, 1);
+#undef SHOW_FUNCTION
+
+#define STORE_FUNCTION(__FUNC, __PTR, MIN, MAX, __CONV)			\
+static ssize_t __FUNC(elevator_t *e, const char *page, size_t count)	\
+{									\
+	struct bfq_data *bfqd = e->elevator_data;			\
+	unsigned int __data;						\
+	int ret = bfq_var_store(&__data, (page), count);		\
+	if (__data < (MIN))						\
+		__data = (MIN);						\
+	else if (__data > (MAX))					\
+		__data = (MAX);						\
+	if (__CONV)							\
+		*(__PTR) = msecs_to_jiffies(__data);			\
+	else								\
+		*(__PTR) = __data;					\
+	return ret;							\
+}
+STORE_FUNCTION(bfq_fifo_expire_sync_store, &bfqd->bfq_fifo_expire[1], 1, UINT_MAX, 1);
+STORE_FUNCTION(bfq_fifo_expire_async_store, &bfqd->bfq_fifo_expire[0], 1, UINT_MAX, 1);
+STORE_FUNCTION(bfq_slice_idle_store, &bfqd->bfq_slice_idle, 0, UINT_MAX, 1);
+STORE_FUNCTION(bfq_max_budget_store, &bfqd->bfq_max_budget, BFQ_MIN_BUDGET_DIV, UINT_MAX >> BFQ_SERVICE_SHIFT, 0);
+STORE_FUNCTION(bfq_timeout_sync_store, &bfqd->bfq_timeout[1], 1, UINT_MAX, 1);
+STORE_FUNCTION(bfq_timeout_async_store, &bfqd->bfq_timeout[0], 1, UINT_MAX, 1);
+STORE_FUNCTION(bfq_low_latency_store, &bfqd->bfq_low_latency, 0, 1, 0);
+STORE_FUNCTION(bfq_wr_coeff_store, &bfqd->bfq_wr_coeff, 1, 100, 0);
+STORE_FUNCTION(bfq_wr_max_time_store, &bfqd->bfq_wr_max_time, 1, UINT_MAX, 1);
+STORE_FUNCTION(bfq_wr_min_idle_store, &bfqd->bfq_wr_min_idle, 1, UINT_MAX, 1);
+#undef STORE_FUNCTION
+
+/*
+ * Service statistics: a line for each group (cpuset), then one for each
+ * queue. Queues idle for long are freed, and their counts with them.
+ */
+static ssize_t bfq_stats_show(elevator_t *e, char *page)
+{
+	struct bfq_data *bfqd = e->elevator_data;
+	request_queue_t *q = bfqd->queue;
+	struct bfq_group *bfqg;
+	struct bfq_queue *bfqq;
+	char *s = page, *end = page + PAGE_SIZE;
+	int i;
+
+	spin_lock_irq(q->queue_lock);
+	list_for_each_entry(bfqg, &bfqd->group_list, list)
+		s += scnprintf(s, end - s, "group %lu weight %u queues %d "
+			       "busy %u service %lu dispatched %lu\n",
+			       bfqg->id, bfqg->entity.weight, bfqg->ref,
+			       bfqg->nr_busy, bfqg->service,
+			       bfqg->dispatched);
+
+	list_for_each_entry(bfqq, &bfqd->queue_list, list) {
+		if (bfqq->pid)
+			s += scnprintf(s, end - s, "queue %d", bfqq->pid);
+		else
+			s += scnprintf(s, end - s, "queue async");
+		s += scnprintf(s, end - s, " group %lu weight %u budget %lu "
+			       "service %lu dispatched %lu raised %lu",
+			       bfqq->bfqg->id, bfqq->entity.weight,
+			       bfqq->budget, bfqq->total_service,
+			       bfqq->nr_dispatched, bfqq->nr_raised);
+		for (i = 0; i < BFQ_EXP_NR; i++)
+			s += scnprintf(s, end - s, " %s %lu", bfq_exp_names[i],
+				       bfqq->nr_expired[i]);
+		s += scnprintf(s, end - s, "\n");
+	}
+	spin_unlock_irq(q->queue_lock);
+
+	return s - page;
+}
+
+#define BFQ_ATTR(name) \
+	__ATTR(name, S_IRUGO|S_IWUSR, bfq_##name##_show, bfq_##name##_store)
+
+static struct elv_fs_entry bfq_attrs[] = {
+	BFQ_ATTR(fifo_expire_sync),
+	BFQ_ATTR(fifo_expire_async),
+	BFQ_ATTR(slice_idle),
+	BFQ_ATTR(max_budget),
+	BFQ_ATTR(timeout_sync),
+	BFQ_ATTR(timeout_async),
+	BFQ_ATTR(low_latency),
+	BFQ_ATTR(wr_coeff),
+	BFQ_ATTR(wr_max_time),
+	BFQ_ATTR(wr_min_idle),
+	__ATTR(stats, S_IRUGO, bfq_stats_show, NULL),
+	__ATTR_NULL
+};
+
+static struct elevator_type iosched_bfq = {
+	.ops = {
+		.elevator_merge_fn = 		bfq_merge,
+		.elevator_merged_fn =		bfq_merged_request,
+		.elevator_merge_req_fn =	bfq_merged_requests,
+		.elevator_dispatch_fn =		bfq_dispatch_requests,
+		.elevator_add_req_fn =		bfq_insert_request,
+		.elevator_activate_req_fn =	bfq_activate_request,
+		.elevator_deactivate_req_fn =	bfq_deactivate_request,
+		.elevator_queue_empty_fn =	bfq_queue_empty,
+		.elevator_completed_req_fn =	bfq_completed_request,
+		.elevator_former_req_fn =	bfq_former_request,
+		.elevator_latter_req_fn =	bfq_latter_request,
+		.elevator_set_req_fn =		bfq_set_request,
+		.elevator_put_req_fn =		bfq_put_request,
+		.elevator_init_fn =		bfq_init_queue,
+		.elevator_exit_fn =		bfq_exit_queue,
+	},
+	.elevator_attrs =	bfq_attrs,
+	.elevator_name =	"bfq",
+	.elevator_owner =	THIS_MODULE,
+};
+
+static int __init bfq_init(void)
+{
+	int ret;
+
+	/*
+	 * could be 0 on HZ < 1000 setups
+	 */
+	if (!bfq_slice_idle)
+		bfq_slice_idle = 1;
+
+	if (bfq_slab_setup())
+		return -ENOMEM;
+
+	ret = elv_register(&iosched_bfq);
+	if (ret)
+		bfq_slab_kill();
+
+	return ret;
+}
+
+static void __exit bfq_exit(void)
+{
+	elv_unregister(&iosched_bfq);
+	bfq_slab_kill();
+}
+
+module_init(bfq_init);
+module_exit(bfq_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Budget Fair Queueing IO scheduler");
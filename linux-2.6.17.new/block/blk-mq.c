@@ -0,0 +1,581 @@
+/*
+ * Multi-queue block devices
+ *
+ * A request_fn queue pushes every request through q->queue_lock: the
+ * merge lookup, the elevator and the driver all take it, which becomes
+ * the limit long before a fast device is saturated. Here every CPU
+ * queues to a software queue of its own, and the software queues are
+ * drained into the hardware dispatch contexts of the driver. Tags come
+ * from a per context map with atomic bit operations, and requests are
+ * preallocated, one for every tag. There is no elevator; the only
+ * merging done is appending to the last request of a software queue,
+ * which has requests on it only while the hardware context is busy.
+ *
+ * Completions are steered to the CPU that submitted the request, when
+ * rq_affinity is set for the queue.
+ *
+ * See Documentation/block/multiqueue.txt
+ */
+#include <linux/config.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/bio.h>
+#include <linux/blkdev.h>
+#include <linux/blk-mq.h>
+#include <linux/init.h>
+#include <linux/slab.h>
+#include <linux/percpu.h>
+#include <linux/writeback.h>
+#include <linux/blktrace_api.h>
+
+#include "blk.h"
+
+/*
+ * Requests completed on another CPU than the one that submitted them
+ * are handed back to it through kblockd.
+ */
+struct blk_mq_done {
+	spinlock_t		lock;
+	struct list_head	list;
+	struct work_struct	work;
+};
+
+static DEFINE_PER_CPU(struct blk_mq_done, blk_mq_done);
+
+static inline struct blk_mq_ctx *blk_mq_get_ctx(request_queue_t *q)
+{
+	return per_cpu_ptr(q->queue_ctx, get_cpu());
+}
+
+static inline void blk_mq_put_ctx(struct blk_mq_ctx *ctx)
+{
+	put_cpu();
+}
+
+static inline int blk_mq_hctx_has_pending(struct blk_mq_hw_ctx *hctx)
+{
+	return !cpus_empty(hctx->pending) || !list_empty(&hctx->dispatch);
+}
+
+/*
+ * Get a request for a tag of the hardware context of *ctxp, waiting for
+ * one if they are all busy. Sleeping may move us to another CPU, so the
+ * software queue is passed back. Called with preemption disabled.
+ */
+static struct request *blk_mq_get_request(request_queue_t *q, int rw,
+					  struct blk_mq_ctx **ctxp)
+{
+	struct blk_mq_ctx *ctx = *ctxp;
+	struct blk_mq_hw_ctx *hctx;
+	struct request *rq;
+	DEFINE_WAIT(wait);
+	int tag;
+
+	for (;;) {
+		hctx = ctx->hctx;
+		tag = blk_get_tag(hctx->tags, ctx->last_tag);
+		if (tag >= 0)
+			break;
+
+		prepare_to_wait(&hctx->wait, &wait, TASK_UNINTERRUPTIBLE);
+		tag = blk_get_tag(hctx->tags, 0);
+		if (tag >= 0) {
+			finish_wait(&hctx->wait, &wait);
+			break;
+		}
+		blk_mq_put_ctx(ctx);
+
+		blk_add_trace_generic(q, NULL, rw, BLK_TA_SLEEPRQ);
+		io_schedule();
+		finish_wait(&hctx->wait, &wait);
+
+		ctx = blk_mq_get_ctx(q);
+	}
+
+	ctx->last_tag = tag + 1;
+	*ctxp = ctx;
+
+	rq = blk_mq_tag_to_rq(hctx, tag);
+	rq_init(q, rq);
+	rq->flags = rw | REQ_QUEUED;
+	rq->rl = NULL;
+	rq->elevator_private = NULL;
+	rq->mq_ctx = ctx;
+	rq->cpu = ctx->cpu;
+	return rq;
+}
+
+static void blk_mq_put_request(struct request *rq)
+{
+	struct blk_mq_hw_ctx *hctx = rq->mq_ctx->hctx;
+
+	rq->rq_status = RQ_INACTIVE;
+	blk_put_tag(hctx->tags, rq->tag);
+
+	smp_mb__after_clear_bit();
+	if (waitqueue_active(&hctx->wait))
+		wake_up(&hctx->wait);
+}
+
+/*
+ * Append to the last request of the software queue if we can. Called
+ * with ctx->lock held.
+ */
+static int blk_mq_attempt_merge(request_queue_t *q, struct blk_mq_ctx *ctx,
+				struct bio *bio)
+{
+	struct request *rq;
+
+	if (list_empty(&ctx->rq_list))
+		return 0;
+
+	rq = list_entry_rq(ctx->rq_list.prev);
+	if (!elv_rq_merge_ok(rq, bio) ||
+	    rq->sector + rq->nr_sectors != bio->bi_sector)
+		return 0;
+	if (!q->back_merge_fn(q, rq, bio))
+		return 0;
+
+	blk_add_trace_bio(q, bio, BLK_TA_BACKMERGE);
+
+	rq->biotail->bi_next = bio;
+	rq->biotail = bio;
+	rq->nr_sectors = rq->hard_nr_sectors += bio_sectors(bio);
+	rq->ioprio = ioprio_best(rq->ioprio, bio_prio(bio));
+	__disk_stat_inc(rq->rq_disk, merges[rq_data_dir(rq)]);
+	return 1;
+}
+
+static int blk_mq_make_request(request_queue_t *q, struct bio *bio)
+{
+	const int rw = bio_data_dir(bio);
+	struct blk_mq_ctx *ctx;
+	struct blk_mq_hw_ctx *hctx;
+	struct request *rq;
+
+	blk_queue_bounce(q, &bio);
+
+	/*
+	 * no ordering support, the file systems fall back to waiting
+	 */
+	if (unlikely(bio_barrier(bio))) {
+		bio_endio(bio, bio->bi_size, -EOPNOTSUPP);
+		return 0;
+	}
+
+	ctx = blk_mq_get_ctx(q);
+
+	spin_lock(&ctx->lock);
+	if (blk_mq_attempt_merge(q, ctx, bio)) {
+		spin_unlock(&ctx->lock);
+		blk_mq_put_ctx(ctx);
+		return 0;
+	}
+	spin_unlock(&ctx->lock);
+
+	rq = blk_mq_get_request(q, rw, &ctx);
+	blk_add_trace_generic(q, bio, rw, BLK_TA_GETRQ);
+	init_request_from_bio(rq, bio);
+
+	hctx = ctx->hctx;
+	spin_lock(&ctx->lock);
+	list_add_tail(&rq->queuelist, &ctx->rq_list);
+	spin_unlock(&ctx->lock);
+	blk_add_trace_rq(q, rq, BLK_TA_INSERT);
+
+	cpu_set(ctx->cpu, hctx->pending);
+	blk_mq_put_ctx(ctx);
+
+	blk_mq_run_hw_queue(hctx, 0);
+	return 0;
+}
+
+/*
+ * Move what the software queues of the context have to the hardware.
+ * Only ever runs on one CPU at a time for a context.
+ */
+static void __blk_mq_run_hw_queue(struct blk_mq_hw_ctx *hctx)
+{
+	request_queue_t *q = hctx->queue;
+	struct blk_mq_ctx *ctx;
+	struct request *rq;
+	LIST_HEAD(rq_list);
+	int cpu, ret;
+
+	/*
+	 * what the driver was busy for last time goes first
+	 */
+	list_splice_init(&hctx->dispatch, &rq_list);
+
+	for_each_cpu_mask(cpu, hctx->cpumask) {
+		if (!cpu_isset(cpu, hctx->pending) ||
+		    !test_and_clear_bit(cpu, cpus_addr(hctx->pending)))
+			continue;
+
+		ctx = per_cpu_ptr(q->queue_ctx, cpu);
+		spin_lock(&ctx->lock);
+		list_splice_init(&ctx->rq_list, rq_list.prev);
+		spin_unlock(&ctx->lock);
+	}
+
+	while (!list_empty(&rq_list)) {
+		rq = list_entry_rq(rq_list.next);
+		list_del_init(&rq->queuelist);
+
+		rq->flags |= REQ_STARTED;
+		blk_add_trace_rq(q, rq, BLK_TA_ISSUE);
+		blk_lat_issued(rq);
+
+		ret = q->mq_ops->queue_rq(hctx, rq);
+		if (ret == BLK_MQ_RQ_QUEUE_OK)
+			continue;
+		if (ret == BLK_MQ_RQ_QUEUE_BUSY) {
+			rq->flags &= ~REQ_STARTED;
+			list_add(&rq->queuelist, &rq_list);
+			break;
+		}
+
+		blk_mq_end_io(rq, -EIO);
+	}
+
+	list_splice(&rq_list, &hctx->dispatch);
+}
+
+/**
+ * blk_mq_run_hw_queue - dispatch pending requests of a hardware context
+ * @hctx:	the hardware context
+ * @async:	leave it to kblockd
+ *
+ * Description:
+ *    Nothing is done if the context is stopped. If another CPU is
+ *    running the context already, it will see the requests we queued.
+ *    Called from interrupt context, @async must be set.
+ **/
+void blk_mq_run_hw_queue(struct blk_mq_hw_ctx *hctx, int async)
+{
+	if (async) {
+		kblockd_schedule_work(&hctx->run_work);
+		return;
+	}
+
+	while (!test_bit(BLK_MQ_S_STOPPED, &hctx->state) &&
+	       blk_mq_hctx_has_pending(hctx)) {
+		if (test_and_set_bit(BLK_MQ_S_RUNNING, &hctx->state))
+			return;
+
+		__blk_mq_run_hw_queue(hctx);
+
+		/*
+		 * Whoever found us running queued their request before
+		 * they looked, so look again once we are done.
+		 */
+		smp_mb__before_clear_bit();
+		clear_bit(BLK_MQ_S_RUNNING, &hctx->state);
+		smp_mb__after_clear_bit();
+	}
+}
+
+EXPORT_SYMBOL(blk_mq_run_hw_queue);
+
+static void blk_mq_run_work(void *data)
+{
+	blk_mq_run_hw_queue(data, 0);
+}
+
+void blk_mq_run_queues(request_queue_t *q, int async)
+{
+	struct blk_mq_hw_ctx *hctx;
+	int i;
+
+	queue_for_each_hw_ctx(q, hctx, i)
+		blk_mq_run_hw_queue(hctx, async);
+}
+
+EXPORT_SYMBOL(blk_mq_run_queues);
+
+/**
+ * blk_mq_stop_hw_queue - stop dispatching to a hardware context
+ * @hctx:	the hardware context
+ *
+ * Description:
+ *    Like blk_stop_queue(), for a driver that is out of room. Requests
+ *    keep being queued to the software queues until the context is
+ *    started again with blk_mq_start_hw_queue().
+ **/
+void blk_mq_stop_hw_queue(struct blk_mq_hw_ctx *hctx)
+{
+	set_bit(BLK_MQ_S_STOPPED, &hctx->state);
+}
+
+EXPORT_SYMBOL(blk_mq_stop_hw_queue);
+
+/**
+ * blk_mq_start_hw_queue - restart a stopped hardware context
+ * @hctx:	the hardware context
+ *
+ * Description:
+ *    May be called from interrupt context, the pending requests are
+ *    dispatched by kblockd.
+ **/
+void blk_mq_start_hw_queue(struct blk_mq_hw_ctx *hctx)
+{
+	clear_bit(BLK_MQ_S_STOPPED, &hctx->state);
+	smp_mb__after_clear_bit();
+	blk_mq_run_hw_queue(hctx, 1);
+}
+
+EXPORT_SYMBOL(blk_mq_start_hw_queue);
+
+void blk_mq_start_stopped_hw_queues(request_queue_t *q)
+{
+	struct blk_mq_hw_ctx *hctx;
+	int i;
+
+	queue_for_each_hw_ctx(q, hctx, i)
+		if (test_bit(BLK_MQ_S_STOPPED, &hctx->state))
+			blk_mq_start_hw_queue(hctx);
+}
+
+EXPORT_SYMBOL(blk_mq_start_stopped_hw_queues);
+
+static void __blk_mq_end_io(struct request *rq, int error)
+{
+	struct gendisk *disk = rq->rq_disk;
+
+	if (end_that_request_first(rq, error ? error : 1, rq->hard_nr_sectors))
+		BUG();
+
+	if (unlikely(laptop_mode))
+		laptop_io_completion();
+
+	/*
+	 * There is no queue lock to keep disk->in_flight with, so the
+	 * queue length and utilisation are not accounted.
+	 */
+	if (disk) {
+		const int rw = rq_data_dir(rq);
+
+		preempt_disable();
+		__disk_stat_inc(disk, ios[rw]);
+		__disk_stat_add(disk, ticks[rw], jiffies - rq->start_time);
+#ifdef CONFIG_BLK_LATENCY_HIST
+		disk_lat_account(disk, rq, 0);
+#endif
+		preempt_enable();
+	}
+
+	blk_mq_put_request(rq);
+}
+
+static void blk_mq_done_work(void *data)
+{
+	struct blk_mq_done *done = data;
+	struct request *rq;
+	LIST_HEAD(list);
+
+	spin_lock_irq(&done->lock);
+	list_splice_init(&done->list, &list);
+	spin_unlock_irq(&done->lock);
+
+	while (!list_empty(&list)) {
+		rq = list_entry(list.next, struct request, donelist);
+		list_del_init(&rq->donelist);
+		__blk_mq_end_io(rq, rq->errors);
+	}
+}
+
+/**
+ * blk_mq_end_io - end I/O on a request
+ * @rq:		the request
+ * @error:	0 or a negative errno
+ *
+ * Description:
+ *    Completes all of the request and frees its tag. May be called from
+ *    any context. If the queue has rq_affinity set and we are not on the
+ *    CPU the request was submitted on, the completion is done there.
+ **/
+void blk_mq_end_io(struct request *rq, int error)
+{
+	struct blk_mq_done *done;
+	unsigned long flags;
+	int kick;
+
+	/*
+	 * interrupts stay off so the CPU can't go away under us
+	 */
+	local_irq_save(flags);
+	if (rq->cpu == smp_processor_id() || !cpu_online(rq->cpu) ||
+	    !test_bit(QUEUE_FLAG_SAME_COMP, &rq->q->queue_flags)) {
+		local_irq_restore(flags);
+		__blk_mq_end_io(rq, error);
+		return;
+	}
+
+	rq->errors = error;
+	done = &per_cpu(blk_mq_done, rq->cpu);
+	spin_lock(&done->lock);
+	kick = list_empty(&done->list);
+	list_add_tail(&rq->donelist, &done->list);
+	spin_unlock(&done->lock);
+	if (kick)
+		kblockd_schedule_work_on(rq->cpu, &done->work);
+	local_irq_restore(flags);
+}
+
+EXPORT_SYMBOL(blk_mq_end_io);
+
+static int blk_mq_init_hw_ctx(request_queue_t *q, struct blk_mq_hw_ctx *hctx,
+			      unsigned int depth, void *driver_data)
+{
+	struct request *rq;
+	int tag;
+
+	INIT_LIST_HEAD(&hctx->dispatch);
+	init_waitqueue_head(&hctx->wait);
+	INIT_WORK(&hctx->run_work, blk_mq_run_work, hctx);
+	cpus_clear(hctx->pending);
+	cpus_clear(hctx->cpumask);
+	hctx->queue = q;
+	hctx->driver_data = driver_data;
+
+	hctx->tags = blk_init_tags(depth);
+	if (!hctx->tags)
+		return -ENOMEM;
+
+	hctx->rqs = kmalloc_node(depth * sizeof(struct request), GFP_KERNEL,
+				 q->node);
+	if (!hctx->rqs)
+		return -ENOMEM;
+	memset(hctx->rqs, 0, depth * sizeof(struct request));
+
+	for (tag = 0; tag < depth; tag++) {
+		rq = &hctx->rqs[tag];
+		rq->tag = tag;
+		rq->rq_status = RQ_INACTIVE;
+		hctx->tags->tag_index[tag] = rq;
+	}
+
+	return 0;
+}
+
+/**
+ * blk_mq_init_queue - set up a multi-queue request queue
+ * @reg:	the operations, the number of hardware contexts and tags
+ * @driver_data: stored in q->queuedata and in every hardware context
+ *
+ * Description:
+ *    The CPUs are spread over the hardware contexts in turn. Each
+ *    context gets @reg->queue_depth tags, at most BLK_MQ_MAX_DEPTH, and
+ *    as many preallocated requests. Release the queue with
+ *    blk_cleanup_queue() as usual. Returns %NULL on failure.
+ **/
+request_queue_t *blk_mq_init_queue(struct blk_mq_reg *reg, void *driver_data)
+{
+	struct blk_mq_hw_ctx *hctx;
+	struct blk_mq_ctx *ctx;
+	request_queue_t *q;
+	unsigned int i;
+	int cpu;
+
+	if (!reg->nr_hw_queues || !reg->queue_depth ||
+	    reg->queue_depth > BLK_MQ_MAX_DEPTH || !reg->ops->queue_rq)
+		return NULL;
+
+	q = blk_alloc_queue_node(GFP_KERNEL, reg->numa_node);
+	if (!q)
+		return NULL;
+
+	q->node = reg->numa_node;
+	q->kobj.ktype = &blk_mq_queue_ktype;
+	q->mq_ops = reg->ops;
+	q->queuedata = driver_data;
+
+	q->queue_ctx = alloc_percpu(struct blk_mq_ctx);
+	if (!q->queue_ctx)
+		goto fail;
+
+	q->queue_hw_ctx = kzalloc(reg->nr_hw_queues * sizeof(hctx), GFP_KERNEL);
+	if (!q->queue_hw_ctx)
+		goto fail;
+	q->nr_hw_queues = reg->nr_hw_queues;
+
+	for (i = 0; i < q->nr_hw_queues; i++) {
+		hctx = kmalloc_node(sizeof(*hctx), GFP_KERNEL, q->node);
+		if (!hctx)
+			goto fail;
+		memset(hctx, 0, sizeof(*hctx));
+		q->queue_hw_ctx[i] = hctx;
+		hctx->queue_num = i;
+
+		if (blk_mq_init_hw_ctx(q, hctx, reg->queue_depth, driver_data))
+			goto fail;
+	}
+
+	i = 0;
+	for_each_possible_cpu(cpu) {
+		ctx = per_cpu_ptr(q->queue_ctx, cpu);
+		spin_lock_init(&ctx->lock);
+		INIT_LIST_HEAD(&ctx->rq_list);
+		ctx->cpu = cpu;
+		ctx->last_tag = 0;
+		ctx->hctx = q->queue_hw_ctx[i++ % q->nr_hw_queues];
+		cpu_set(cpu, ctx->hctx->cpumask);
+	}
+
+	spin_lock_init(&q->__queue_lock);
+	q->queue_lock		= &q->__queue_lock;
+	q->back_merge_fn	= ll_back_merge_fn;
+	q->front_merge_fn	= ll_front_merge_fn;
+	q->merge_requests_fn	= ll_merge_requests_fn;
+	q->queue_flags		= (1 << QUEUE_FLAG_CLUSTER) |
+				  (1 << QUEUE_FLAG_SAME_COMP);
+
+	blk_queue_make_request(q, blk_mq_make_request);
+	blk_queue_segment_boundary(q, 0xffffffff);
+	blk_queue_max_segment_size(q, MAX_SEGMENT_SIZE);
+
+	return q;
+fail:
+	blk_put_queue(q);
+	return NULL;
+}
+
+EXPORT_SYMBOL(blk_mq_init_queue);
+
+/*
+ * called when the last reference to the queue is dropped
+ */
+void blk_mq_free_queue(request_queue_t *q)
+{
+	struct blk_mq_hw_ctx *hctx;
+	unsigned int i;
+
+	for (i = 0; i < q->nr_hw_queues; i++) {
+		hctx = q->queue_hw_ctx[i];
+		if (!hctx)
+			continue;
+		if (hctx->tags)
+			blk_free_tags(hctx->tags);
+		kfree(hctx->rqs);
+		kfree(hctx);
+	}
+	kfree(q->queue_hw_ctx);
+	if (q->queue_ctx)
+		free_percpu(q->queue_ctx);
+}
+
+static int __init blk_mq_init(void)
+{
+	struct blk_mq_done *done;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		done = &per_cpu(blk_mq_done, cpu);
+		spin_lock_init(&done->lock);
+		INIT_LIST_HEAD(&done->list);
+		INIT_WORK(&done->work, blk_mq_done_work, done);
+	}
+	return 0;
+}
+
+subsys_initcall(blk_mq_init);
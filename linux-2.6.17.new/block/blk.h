@@ -0,0 +1,44 @@
+#ifndef BLK_INTERNAL_H
+#define BLK_INTERNAL_H
+
+/*
+ * Block layer internals shared between ll_rw_blk.c and blk-mq.c, not
+ * for drivers.
+ */
+
+static inline void rq_init(request_queue_t *q, struct request *rq)
+{
+	INIT_LIST_HEAD(&rq->queuelist);
+	INIT_LIST_HEAD(&rq->donelist);
+
+	rq->errors = 0;
+	rq->rq_status = RQ_ACTIVE;
+	rq->bio = rq->biotail = NULL;
+	rq->ioprio = 0;
+	rq->buffer = NULL;
+	rq->ref_count = 1;
+	rq->q = q;
+	rq->waiting = NULL;
+	rq->special = NULL;
+	rq->data_len = 0;
+	rq->data = NULL;
+	rq->nr_phys_segments = 0;
+	rq->sense = NULL;
+	rq->end_io = NULL;
+	rq->end_io_data = NULL;
+	rq->completion_data = NULL;
+}
+
+void init_request_from_bio(struct request *req, struct bio *bio);
+
+int ll_back_merge_fn(request_queue_t *q, struct request *req,
+		     struct bio *bio);
+int ll_front_merge_fn(request_queue_t *q, struct request *req,
+		      struct bio *bio);
+int ll_merge_requests_fn(request_queue_t *q, struct request *req,
+			 struct request *next);
+
+extern struct kobj_type blk_mq_queue_ktype;
+void blk_mq_free_queue(request_queue_t *q);
+
+#endif
@@ -145,6 +145,350 @@ void __blk_add_trace(struct blk_trace *bt, sector_t sector, int bytes,
 
 EXPORT_SYMBOL_GPL(__blk_add_trace);
 
+/*
+ * Summary mode. Each CPU sums what it sees into small tables keyed by
+ * pid and by disk range, under a lock of its own that only the flush
+ * takes otherwise. Every interval, a timer relays an event for each
+ * entry of every table and clears them.
+ */
+#define BLK_SUM_HASH_BITS	6
+#define BLK_SUM_ENTRIES		(1 << BLK_SUM_HASH_BITS)
+
+struct blk_sum_table {
+	struct blk_io_trace_summary entries[BLK_SUM_ENTRIES];
+	struct blk_io_trace_summary other;	/* when the table is full */
+};
+
+struct blk_sum_cpu {
+	spinlock_t lock;
+	struct blk_sum_table pid;
+	struct blk_sum_table range;
+};
+
+struct blk_trace_sum {
+	struct blk_sum_cpu *cpu;
+	struct timer_list timer;
+	struct blk_trace *bt;
+	unsigned long interval;		/* jiffies */
+	unsigned int range_shift;
+	u64 start;			/* of the current interval */
+};
+
+static inline u64 blk_trace_time(void)
+{
+	return sched_clock() - per_cpu(blk_trace_cpu_offset,
+				       smp_processor_id());
+}
+
+/*
+ * Linear probing; entries are only added until the next flush, when the
+ * table is cleared. The caller sets the type of the entry it gets.
+ */
+static struct blk_io_trace_summary *blk_sum_lookup(struct blk_sum_table *t,
+						   u64 key)
+{
+	struct blk_io_trace_summary *e;
+	unsigned int i, idx = hash_long((unsigned long) key, BLK_SUM_HASH_BITS);
+
+	for (i = 0; i < BLK_SUM_ENTRIES; i++) {
+		e = &t->entries[idx];
+		if (!e->type) {
+			e->key = key;
+			return e;
+		}
+		if (e->key == key)
+			return e;
+		idx = (idx + 1) & (BLK_SUM_ENTRIES - 1);
+	}
+
+	return &t->other;
+}
+
+static struct blk_sum_cpu *blk_sum_lock(struct blk_trace_sum *sum,
+					unsigned long *flags)
+{
+	struct blk_sum_cpu *sc;
+
+	local_irq_save(*flags);
+	sc = per_cpu_ptr(sum->cpu, smp_processor_id());
+	spin_lock(&sc->lock);
+	return sc;
+}
+
+static inline void blk_sum_unlock(struct blk_sum_cpu *sc, unsigned long flags)
+{
+	spin_unlock(&sc->lock);
+	local_irq_restore(flags);
+}
+
+static void blk_sum_entries(struct blk_trace_sum *sum, struct blk_sum_cpu *sc,
+			    pid_t pid, sector_t sector,
+			    struct blk_io_trace_summary **e)
+{
+	e[0] = blk_sum_lookup(&sc->pid, pid);
+	e[0]->type = BLK_TS_PID;
+	e[1] = blk_sum_lookup(&sc->range, sector >> sum->range_shift);
+	e[1]->type = BLK_TS_RANGE;
+}
+
+static inline int blk_sum_filtered(struct blk_trace *bt, sector_t sector,
+				   pid_t pid)
+{
+	if (sector < bt->start_lba || sector > bt->end_lba)
+		return 1;
+	return bt->pid && pid != bt->pid;
+}
+
+/**
+ * __blk_trace_sum_rq - Sum a request event in summary mode
+ * @bt:		the trace
+ * @rq:		the request
+ * @what:	the action
+ *
+ * Description:
+ *     The completion of a fs request is summed once, with its queue and
+ *     service times. Returns whether the event is to be relayed as well.
+ *
+ **/
+int __blk_trace_sum_rq(struct blk_trace *bt, struct request *rq, u32 what)
+{
+	struct blk_trace_sum *sum = bt->sum;
+	struct blk_io_trace_summary *e[2];
+	struct blk_sum_cpu *sc;
+	unsigned long long now, queued, issued, q2d, d2c;
+	unsigned long flags;
+	const int rw = rq_data_dir(rq);
+	int i;
+
+	if (unlikely(bt->trace_state != Blktrace_running) ||
+	    !blk_fs_request(rq))
+		return 0;
+
+	if (what == BLK_TA_COMPLETE && !(rq->trace_flags & BLK_RQ_TRACE_DONE) &&
+	    !blk_sum_filtered(bt, rq->hard_sector, rq->trace_pid)) {
+		rq->trace_flags |= BLK_RQ_TRACE_DONE;
+
+		now = sched_clock();
+		queued = rq->queue_ns;
+		issued = rq->issue_ns ? rq->issue_ns : queued;
+		if ((long long)(issued - queued) < 0)
+			issued = queued;
+		if ((long long)(now - issued) < 0)
+			now = issued;
+		q2d = issued - queued;
+		d2c = now - issued;
+
+		sc = blk_sum_lock(sum, &flags);
+		blk_sum_entries(sum, sc, rq->trace_pid, rq->hard_sector, e);
+		for (i = 0; i < 2; i++) {
+			e[i]->ios[rw]++;
+			e[i]->bytes[rw] += rq->hard_nr_sectors << 9;
+			e[i]->q2d_total += q2d;
+			e[i]->d2c_total += d2c;
+			if (q2d > e[i]->q2d_max)
+				e[i]->q2d_max = q2d;
+			if (d2c > e[i]->d2c_max)
+				e[i]->d2c_max = d2c;
+		}
+		blk_sum_unlock(sc, flags);
+	}
+
+	return rq->trace_flags & BLK_RQ_TRACE_SAMPLED;
+}
+
+EXPORT_SYMBOL_GPL(__blk_trace_sum_rq);
+
+/**
+ * __blk_trace_sum_bio - Sum a bio event in summary mode
+ * @bt:		the trace
+ * @bio:	the bio
+ * @what:	the action
+ *
+ * Description:
+ *     Queued and merged bios are counted against the current process.
+ *     Returns whether the event is to be relayed as well.
+ *
+ **/
+int __blk_trace_sum_bio(struct blk_trace *bt, struct bio *bio, u32 what)
+{
+	struct task_struct *tsk = current;
+	struct blk_io_trace_summary *e[2];
+	struct blk_sum_cpu *sc;
+	unsigned long flags;
+	int i;
+
+	if (unlikely(bt->trace_state != Blktrace_running))
+		return 0;
+
+	if ((what == BLK_TA_QUEUE || what == BLK_TA_BACKMERGE ||
+	     what == BLK_TA_FRONTMERGE) &&
+	    !blk_sum_filtered(bt, bio->bi_sector, tsk->pid)) {
+		sc = blk_sum_lock(bt->sum, &flags);
+
+		/*
+		 * the summaries refer to pids, userspace needs their names
+		 */
+		if (unlikely(tsk->btrace_seq != blktrace_seq))
+			trace_note_tsk(bt, tsk);
+
+		blk_sum_entries(bt->sum, sc, tsk->pid, bio->bi_sector, e);
+		for (i = 0; i < 2; i++) {
+			if (what == BLK_TA_QUEUE)
+				e[i]->bios++;
+			else
+				e[i]->merges++;
+		}
+		blk_sum_unlock(sc, flags);
+	}
+
+	return blk_trace_sampled(bt, bio->bi_sector);
+}
+
+EXPORT_SYMBOL_GPL(__blk_trace_sum_bio);
+
+static void blk_sum_relay(struct blk_trace *bt, struct blk_io_trace_summary *e,
+			  u64 start)
+{
+	struct blk_io_trace *t;
+	int cpu;
+
+	e->start = start;
+	if (e->type == BLK_TS_RANGE && !(e->flags & BLK_TS_OTHER)) {
+		e->nr_sectors = 1ULL << bt->sum->range_shift;
+		e->key <<= bt->sum->range_shift;
+	}
+
+	t = relay_reserve(bt->rchan, sizeof(*t) + sizeof(*e));
+	if (!t)
+		return;
+
+	cpu = smp_processor_id();
+	t->magic = BLK_IO_TRACE_MAGIC | BLK_IO_TRACE_VERSION;
+	t->sequence = ++(*per_cpu_ptr(bt->sequence, cpu));
+	t->time = blk_trace_time();
+	t->sector = e->type == BLK_TS_RANGE ? e->key : 0;
+	t->bytes = 0;
+	t->action = BLK_TA_SUMMARY;
+	t->pid = e->type == BLK_TS_PID ? e->key : 0;
+	t->device = bt->dev;
+	t->cpu = cpu;
+	t->error = 0;
+	t->pdu_len = sizeof(*e);
+	memcpy((void *) t + sizeof(*t), e, sizeof(*e));
+}
+
+static void blk_sum_flush_table(struct blk_trace *bt, struct blk_sum_table *t,
+				u64 start)
+{
+	int i;
+
+	for (i = 0; i < BLK_SUM_ENTRIES; i++)
+		if (t->entries[i].type)
+			blk_sum_relay(bt, &t->entries[i], start);
+
+	if (t->other.type) {
+		t->other.flags = BLK_TS_OTHER;
+		t->other.key = 0;
+		blk_sum_relay(bt, &t->other, start);
+	}
+
+	memset(t, 0, sizeof(*t));
+}
+
+/*
+ * Relay the summaries of all CPUs and start a new interval. The tables
+ * of other CPUs are relayed through the buffer of this one. Entries of
+ * the same key from different CPUs are relayed separately, for
+ * userspace to add up.
+ */
+static void blk_sum_flush(struct blk_trace *bt)
+{
+	struct blk_trace_sum *sum = bt->sum;
+	struct blk_sum_cpu *sc;
+	unsigned long flags;
+	u64 start;
+	int cpu;
+
+	local_irq_save(flags);
+	start = sum->start;
+	sum->start = blk_trace_time();
+
+	for_each_possible_cpu(cpu) {
+		sc = per_cpu_ptr(sum->cpu, cpu);
+		spin_lock(&sc->lock);
+		blk_sum_flush_table(bt, &sc->pid, start);
+		blk_sum_flush_table(bt, &sc->range, start);
+		spin_unlock(&sc->lock);
+	}
+	local_irq_restore(flags);
+}
+
+static void blk_sum_timer(unsigned long data)
+{
+	struct blk_trace *bt = (struct blk_trace *) data;
+
+	if (bt->trace_state != Blktrace_running)
+		return;
+
+	blk_sum_flush(bt);
+	mod_timer(&bt->sum->timer, jiffies + bt->sum->interval);
+}
+
+static void blk_sum_start(struct blk_trace *bt)
+{
+	struct blk_trace_sum *sum = bt->sum;
+
+	local_irq_disable();
+	sum->start = blk_trace_time();
+	local_irq_enable();
+	mod_timer(&sum->timer, jiffies + sum->interval);
+}
+
+/*
+ * The trace is no longer running: what was summed since the last
+ * interval is relayed right away
+ */
+static void blk_sum_stop(struct blk_trace *bt)
+{
+	del_timer_sync(&bt->sum->timer);
+	blk_sum_flush(bt);
+}
+
+static struct blk_trace_sum *blk_sum_alloc(struct blk_trace *bt,
+				struct blk_user_trace_summary_setup *buss)
+{
+	struct blk_trace_sum *sum;
+	int cpu;
+
+	sum = kzalloc(sizeof(*sum), GFP_KERNEL);
+	if (!sum)
+		return NULL;
+
+	sum->cpu = alloc_percpu(struct blk_sum_cpu);
+	if (!sum->cpu) {
+		kfree(sum);
+		return NULL;
+	}
+	for_each_possible_cpu(cpu)
+		spin_lock_init(&per_cpu_ptr(sum->cpu, cpu)->lock);
+
+	sum->bt = bt;
+	sum->interval = msecs_to_jiffies(buss->interval ? buss->interval : 1000);
+	if (!sum->interval)
+		sum->interval = 1;
+	sum->range_shift = buss->range_shift ? buss->range_shift : 21;
+	setup_timer(&sum->timer, blk_sum_timer, (unsigned long) bt);
+
+	return sum;
+}
+
+static void blk_sum_free(struct blk_trace_sum *sum)
+{
+	del_timer_sync(&sum->timer);
+	free_percpu(sum->cpu);
+	kfree(sum);
+}
+
 static struct dentry *blk_tree_root;
 static struct mutex blk_tree_mutex;
 static unsigned int root_users;
@@ -191,6 +535,8 @@ err:
 
 static void blk_trace_cleanup(struct blk_trace *bt)
 {
+	if (bt->sum)
+		blk_sum_free(bt->sum);
 	relay_close(bt->rchan);
 	debugfs_remove(bt->dropped_file);
 	blk_remove_tree(bt->dir);
@@ -277,10 +623,12 @@ static struct rchan_callbacks blk_relay_callbacks = {
 };
 
 /*
- * Setup everything required to start tracing
+ * Setup everything required to start tracing, in summary mode if buss
+ * is given
  */
-static int blk_trace_setup(request_queue_t *q, struct block_device *bdev,
-			   char __user *arg)
+static int __blk_trace_setup(request_queue_t *q, struct block_device *bdev,
+			     char __user *arg,
+			     struct blk_user_trace_summary_setup *buss)
 {
 	struct blk_user_trace_setup buts;
 	struct blk_trace *old_bt, *bt = NULL;
@@ -293,6 +641,8 @@ static int blk_trace_setup(request_queue_t *q, struct block_device *bdev,
 
 	if (!buts.buf_size || !buts.buf_nr)
 		return -EINVAL;
+	if (buss && buss->range_shift > 48)
+		return -EINVAL;
 
 	strcpy(buts.name, bdevname(bdev, b));
 
@@ -316,6 +666,13 @@ static int blk_trace_setup(request_queue_t *q, struct block_device *bdev,
 	if (!bt->sequence)
 		goto err;
 
+	if (buss) {
+		bt->sum = blk_sum_alloc(bt, buss);
+		if (!bt->sum)
+			goto err;
+		bt->sample = buss->sample;
+	}
+
 	ret = -ENOENT;
 	dir = blk_create_tree(buts.name);
 	if (!dir)
@@ -365,11 +722,30 @@ err:
 			free_percpu(bt->sequence);
 		if (bt->rchan)
 			relay_close(bt->rchan);
+		if (bt->sum)
+			blk_sum_free(bt->sum);
 		kfree(bt);
 	}
 	return ret;
 }
 
+static int blk_trace_setup(request_queue_t *q, struct block_device *bdev,
+			   char __user *arg)
+{
+	return __blk_trace_setup(q, bdev, arg, NULL);
+}
+
+static int blk_trace_setup_summary(request_queue_t *q,
+				   struct block_device *bdev, char __user *arg)
+{
+	struct blk_user_trace_summary_setup buss;
+
+	if (copy_from_user(&buss, arg, sizeof(buss)))
+		return -EFAULT;
+
+	return __blk_trace_setup(q, bdev, arg, &buss);
+}
+
 static int blk_trace_startstop(request_queue_t *q, int start)
 {
 	struct blk_trace *bt;
@@ -389,11 +765,15 @@ static int blk_trace_startstop(request_queue_t *q, int start)
 			blktrace_seq++;
 			smp_mb();
 			bt->trace_state = Blktrace_running;
+			if (bt->sum)
+				blk_sum_start(bt);
 			ret = 0;
 		}
 	} else {
 		if (bt->trace_state == Blktrace_running) {
 			bt->trace_state = Blktrace_stopped;
+			if (bt->sum)
+				blk_sum_stop(bt);
 			relay_flush(bt->rchan);
 			ret = 0;
 		}
@@ -424,6 +804,9 @@ int blk_trace_ioctl(struct block_device *bdev, unsigned cmd, char __user *arg)
 	case BLKTRACESETUP:
 		ret = blk_trace_setup(q, bdev, arg);
 		break;
+	case BLKTRACESETUPSUM:
+		ret = blk_trace_setup_summary(q, bdev, arg);
+		break;
 	case BLKTRACESTART:
 		start = 1;
 	case BLKTRACESTOP:
@@ -513,6 +513,7 @@ struct request *elv_next_request(request_queue_t *q)
 			 */
 			rq->flags |= REQ_STARTED;
 			blk_add_trace_rq(q, rq, BLK_TA_ISSUE);
+			blk_lat_issued(rq);
 		}
 
 		if (!q->boundary_rq || q->boundary_rq == rq) {
@@ -389,6 +389,88 @@ static ssize_t disk_stats_read(struct gendisk * disk, char *page)
 		jiffies_to_msecs(disk_stat_read(disk, io_ticks)),
 		jiffies_to_msecs(disk_stat_read(disk, time_in_queue)));
 }
+#ifdef CONFIG_BLK_LATENCY_HIST
+#define DISK_HIST_VERSION 1
+
+static const char *disk_lat_names[DISK_LAT_NR] = {
+	"queue", "service", "total",
+};
+
+static ssize_t disk_lat_hist_print(struct gendisk *disk, char *page,
+				   int depth)
+{
+	static const char *dir[2] = { "read", "write" };
+	char *s = page, *end = page + PAGE_SIZE;
+	int rw, t, i;
+
+	s += scnprintf(s, end - s, "version %d\n", DISK_HIST_VERSION);
+	s += scnprintf(s, end - s, "buckets %d\n",
+		       depth ? DISK_DEPTH_BUCKETS : DISK_LAT_BUCKETS);
+
+	for (rw = READ; rw <= WRITE; rw++) {
+		if (depth) {
+			s += scnprintf(s, end - s, "%s", dir[rw]);
+			for (i = 0; i < DISK_DEPTH_BUCKETS; i++)
+				s += scnprintf(s, end - s, " %lu",
+					disk_stat_read(disk, depth_hist[rw][i]));
+			s += scnprintf(s, end - s, "\n");
+			continue;
+		}
+		for (t = 0; t < DISK_LAT_NR; t++) {
+			s += scnprintf(s, end - s, "%s %s", dir[rw],
+				       disk_lat_names[t]);
+			for (i = 0; i < DISK_LAT_BUCKETS; i++)
+				s += scnprintf(s, end - s, " %lu",
+					disk_stat_read(disk, lat_hist[rw][t][i]));
+			s += scnprintf(s, end - s, "\n");
+		}
+	}
+	return s - page;
+}
+
+static ssize_t disk_lat_hist_read(struct gendisk *disk, char *page)
+{
+	return disk_lat_hist_print(disk, page, 0);
+}
+
+static ssize_t disk_depth_hist_read(struct gendisk *disk, char *page)
+{
+	return disk_lat_hist_print(disk, page, 1);
+}
+
+/*
+ * Writing anything clears both histograms. Counts being added on other
+ * CPUs at the same time may survive.
+ */
+static ssize_t disk_lat_hist_store(struct gendisk *disk, const char *page,
+				   size_t count)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+#ifdef CONFIG_SMP
+		struct disk_stats *stats = per_cpu_ptr(disk->dkstats, cpu);
+#else
+		struct disk_stats *stats = &disk->dkstats;
+#endif
+		memset(stats->lat_hist, 0, sizeof(stats->lat_hist));
+		memset(stats->depth_hist, 0, sizeof(stats->depth_hist));
+	}
+	return count;
+}
+
+static struct disk_attribute disk_attr_lat_hist = {
+	.attr = {.name = "latency_hist", .mode = S_IRUGO | S_IWUSR },
+	.show	= disk_lat_hist_read,
+	.store	= disk_lat_hist_store
+};
+static struct disk_attribute disk_attr_depth_hist = {
+	.attr = {.name = "depth_hist", .mode = S_IRUGO | S_IWUSR },
+	.show	= disk_depth_hist_read,
+	.store	= disk_lat_hist_store
+};
+#endif
+
 static struct disk_attribute disk_attr_uevent = {
 	.attr = {.name = "uevent", .mode = S_IWUSR },
 	.store	= disk_uevent_store
@@ -421,6 +503,10 @@ static struct attribute * default_attrs[] = {
 	&disk_attr_removable.attr,
 	&disk_attr_size.attr,
 	&disk_attr_stat.attr,
+#ifdef CONFIG_BLK_LATENCY_HIST
+	&disk_attr_lat_hist.attr,
+	&disk_attr_depth_hist.attr,
+#endif
 	NULL,
 };
 
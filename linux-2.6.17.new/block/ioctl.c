@@ -194,6 +194,7 @@ static int blkdev_locked_ioctl(struct file *file, struct block_device *bdev,
 	case BLKTRACESTOP:
 	case BLKTRACESETUP:
 	case BLKTRACETEARDOWN:
+	case BLKTRACESETUPSUM:
 		return blk_trace_ioctl(bdev, cmd, (char __user *) arg);
 	}
 	return -ENOIOCTLCMD;
@@ -29,6 +29,9 @@
 #include <linux/interrupt.h>
 #include <linux/cpu.h>
 #include <linux/blktrace_api.h>
+#include <linux/seq_file.h>
+
+#include "blk.h"
 
 /*
  * for max sense size
@@ -38,7 +41,6 @@
 static void blk_unplug_work(void *data);
 static void blk_unplug_timeout(unsigned long data);
 static void drive_stat_acct(struct request *rq, int nr_sectors, int new_io);
-static void init_request_from_bio(struct request *req, struct bio *bio);
 static int __make_request(request_queue_t *q, struct bio *bio);
 
 /*
@@ -218,6 +220,27 @@ void blk_queue_softirq_done(request_queue_t *q, softirq_done_fn *fn)
 
 EXPORT_SYMBOL(blk_queue_softirq_done);
 
+/**
+ * blk_queue_poll - set the completion poll function of a queue
+ * @q:  the request queue for the device
+ * @fn: reaps completions the device has posted, without waiting for its
+ *      interrupt, and returns how many it found
+ *
+ * Description:
+ *    Drivers of devices fast enough that an interrupt and a context
+ *    switch take longer than the I/O itself set this. It is called from
+ *    process context, with no locks held and interrupts enabled, by
+ *    synchronous waiters spinning in blk_poll(), on any CPU and possibly
+ *    on several at once. Polling stays off until it is switched on with
+ *    the io_poll queue attribute.
+ */
+void blk_queue_poll(request_queue_t *q, poll_q_fn *fn)
+{
+	q->poll_fn = fn;
+}
+
+EXPORT_SYMBOL(blk_queue_poll);
+
 /**
  * blk_queue_make_request - define an alternate make_request function for a device
  * @q:  the request queue for the device to be affected
@@ -278,29 +301,6 @@ void blk_queue_make_request(request_queue_t * q, make_request_fn * mfn)
 
 EXPORT_SYMBOL(blk_queue_make_request);
 
-static inline void rq_init(request_queue_t *q, struct request *rq)
-{
-	INIT_LIST_HEAD(&rq->queuelist);
-	INIT_LIST_HEAD(&rq->donelist);
-
-	rq->errors = 0;
-	rq->rq_status = RQ_ACTIVE;
-	rq->bio = rq->biotail = NULL;
-	rq->ioprio = 0;
-	rq->buffer = NULL;
-	rq->ref_count = 1;
-	rq->q = q;
-	rq->waiting = NULL;
-	rq->special = NULL;
-	rq->data_len = 0;
-	rq->data = NULL;
-	rq->nr_phys_segments = 0;
-	rq->sense = NULL;
-	rq->end_io = NULL;
-	rq->end_io_data = NULL;
-	rq->completion_data = NULL;
-}
-
 /**
  * blk_queue_ordered - does this queue support ordered writes
  * @q:        the request queue
@@ -856,13 +856,8 @@ EXPORT_SYMBOL(blk_queue_find_tag);
  *    blk_cleanup_queue() will take care of calling this function, if tagging
  *    has been used. So there's no need to call this directly.
  **/
-static void __blk_queue_free_tags(request_queue_t *q)
+static void __blk_free_tags(struct blk_queue_tag *bqt)
 {
-	struct blk_queue_tag *bqt = q->queue_tags;
-
-	if (!bqt)
-		return;
-
 	if (atomic_dec_and_test(&bqt->refcnt)) {
 		BUG_ON(bqt->busy);
 		BUG_ON(!list_empty(&bqt->busy_list));
@@ -875,6 +870,16 @@ static void __blk_queue_free_tags(request_queue_t *q)
 
 		kfree(bqt);
 	}
+}
+
+static void __blk_queue_free_tags(request_queue_t *q)
+{
+	struct blk_queue_tag *bqt = q->queue_tags;
+
+	if (!bqt)
+		return;
+
+	__blk_free_tags(bqt);
 
 	q->queue_tags = NULL;
 	q->queue_flags &= ~(1 << QUEUE_FLAG_QUEUED);
@@ -902,7 +907,7 @@ init_tag_map(request_queue_t *q, struct blk_queue_tag *tags, int depth)
 	unsigned long *tag_map;
 	int nr_ulongs;
 
-	if (depth > q->nr_requests * 2) {
+	if (q && depth > q->nr_requests * 2) {
 		depth = q->nr_requests * 2;
 		printk(KERN_ERR "%s: adjusted depth to %d\n",
 				__FUNCTION__, depth);
@@ -973,6 +978,47 @@ fail:
 
 EXPORT_SYMBOL(blk_queue_init_tags);
 
+/**
+ * blk_init_tags - allocate a tag map that is not attached to a queue
+ * @depth:  the number of tags
+ *
+ *  Description:
+ *    For tag maps managed with blk_get_tag() and blk_put_tag(), such as
+ *    the ones of the hardware contexts of a multi-queue device. Release
+ *    it with blk_free_tags().
+ **/
+struct blk_queue_tag *blk_init_tags(int depth)
+{
+	struct blk_queue_tag *tags;
+
+	tags = kmalloc(sizeof(struct blk_queue_tag), GFP_KERNEL);
+	if (!tags)
+		return NULL;
+
+	if (init_tag_map(NULL, tags, depth)) {
+		kfree(tags);
+		return NULL;
+	}
+
+	INIT_LIST_HEAD(&tags->busy_list);
+	tags->busy = 0;
+	atomic_set(&tags->refcnt, 1);
+	return tags;
+}
+
+EXPORT_SYMBOL(blk_init_tags);
+
+/**
+ * blk_free_tags - release a tag map allocated with blk_init_tags()
+ * @bqt:  the tag map
+ **/
+void blk_free_tags(struct blk_queue_tag *bqt)
+{
+	__blk_free_tags(bqt);
+}
+
+EXPORT_SYMBOL(blk_free_tags);
+
 /**
  * blk_queue_resize_tags - change the queueing depth
  * @q:  the request queue for the device
@@ -1119,6 +1165,66 @@ int blk_queue_start_tag(request_queue_t *q, struct request *rq)
 
 EXPORT_SYMBOL(blk_queue_start_tag);
 
+/**
+ * blk_get_tag - find a free tag and claim it without the queue lock
+ * @bqt:  the tag map
+ * @hint: the tag to start looking at
+ *
+ *  Description:
+ *    Claims the tag with an atomic bit operation, so any number of CPUs
+ *    may allocate from @bqt at once. Starting every CPU at a different
+ *    @hint keeps them from fighting over the same bits. Returns the tag,
+ *    or -1 if all of them are busy.
+ *
+ *  Notes:
+ *    Unlike blk_queue_start_tag(), neither the busy count nor the busy
+ *    list are maintained, and filling in the tag_index is up to the
+ *    caller.
+ **/
+int blk_get_tag(struct blk_queue_tag *bqt, int hint)
+{
+	int depth = bqt->max_depth;
+	int tag, wrapped;
+
+	if (hint >= depth)
+		hint = 0;
+	wrapped = !hint;
+
+	tag = hint;
+	for (;;) {
+		tag = find_next_zero_bit(bqt->tag_map, depth, tag);
+		if (tag >= depth) {
+			if (wrapped)
+				return -1;
+			wrapped = 1;
+			tag = 0;
+			continue;
+		}
+		if (!test_and_set_bit(tag, bqt->tag_map))
+			return tag;
+		tag++;
+	}
+}
+
+EXPORT_SYMBOL(blk_get_tag);
+
+/**
+ * blk_put_tag - release a tag claimed with blk_get_tag()
+ * @bqt:  the tag map
+ * @tag:  the tag
+ **/
+void blk_put_tag(struct blk_queue_tag *bqt, int tag)
+{
+	BUG_ON(tag < 0 || tag >= bqt->real_max_depth);
+
+	smp_mb__before_clear_bit();
+	if (unlikely(!test_and_clear_bit(tag, bqt->tag_map)))
+		printk(KERN_ERR "%s: attempt to clear non-busy tag (%d)\n",
+		       __FUNCTION__, tag);
+}
+
+EXPORT_SYMBOL(blk_put_tag);
+
 /**
  * blk_queue_invalidate_tags - invalidate all pending tags
  * @q:  the request queue for the device
@@ -1413,7 +1519,7 @@ static inline int ll_new_hw_segment(request_queue_t *q,
 	return 1;
 }
 
-static int ll_back_merge_fn(request_queue_t *q, struct request *req, 
+int ll_back_merge_fn(request_queue_t *q, struct request *req, 
 			    struct bio *bio)
 {
 	unsigned short max_sectors;
@@ -1451,7 +1557,7 @@ static int ll_back_merge_fn(request_queue_t *q, struct request *req,
 	return ll_new_hw_segment(q, req, bio);
 }
 
-static int ll_front_merge_fn(request_queue_t *q, struct request *req, 
+int ll_front_merge_fn(request_queue_t *q, struct request *req, 
 			     struct bio *bio)
 {
 	unsigned short max_sectors;
@@ -1490,7 +1596,7 @@ static int ll_front_merge_fn(request_queue_t *q, struct request *req,
 	return ll_new_hw_segment(q, req, bio);
 }
 
-static int ll_merge_requests_fn(request_queue_t *q, struct request *req,
+int ll_merge_requests_fn(request_queue_t *q, struct request *req,
 				struct request *next)
 {
 	int total_phys_segments;
@@ -1723,14 +1829,14 @@ void blk_sync_queue(struct request_queue *q)
 EXPORT_SYMBOL(blk_sync_queue);
 
 /**
- * blk_run_queue - run a single device queue
+ * __blk_run_queue - run a single device queue
  * @q:	The queue to run
+ *
+ * Description:
+ *    Like blk_run_queue(), but the caller must hold the queue lock.
  */
-void blk_run_queue(struct request_queue *q)
+void __blk_run_queue(request_queue_t *q)
 {
-	unsigned long flags;
-
-	spin_lock_irqsave(q->queue_lock, flags);
 	blk_remove_plug(q);
 
 	/*
@@ -1746,7 +1852,19 @@ void blk_run_queue(struct request_queue *q)
 			kblockd_schedule_work(&q->unplug_work);
 		}
 	}
+}
+EXPORT_SYMBOL(__blk_run_queue);
 
+/**
+ * blk_run_queue - run a single device queue
+ * @q:	The queue to run
+ */
+void blk_run_queue(struct request_queue *q)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(q->queue_lock, flags);
+	__blk_run_queue(q);
 	spin_unlock_irqrestore(q->queue_lock, flags);
 }
 EXPORT_SYMBOL(blk_run_queue);
@@ -1782,6 +1900,10 @@ static void blk_release_queue(struct kobject *kobj)
 	if (q->blk_trace)
 		blk_trace_shutdown(q);
 
+	if (q->mq_ops)
+		blk_mq_free_queue(q);
+
+	free_percpu(q->poll_stat);
 	kmem_cache_free(requestq_cachep, q);
 }
 
@@ -1841,6 +1963,13 @@ request_queue_t *blk_alloc_queue_node(gfp_t gfp_mask, int node_id)
 		return NULL;
 
 	memset(q, 0, sizeof(*q));
+
+	q->poll_stat = alloc_percpu(struct blk_poll_stats);
+	if (!q->poll_stat) {
+		kmem_cache_free(requestq_cachep, q);
+		return NULL;
+	}
+
 	init_timer(&q->unplug_timer);
 
 	snprintf(q->kobj.name, KOBJ_NAME_LEN, "%s", "queue");
@@ -1852,6 +1981,8 @@ request_queue_t *blk_alloc_queue_node(gfp_t gfp_mask, int node_id)
 
 	mutex_init(&q->sysfs_lock);
 
+	q->poll_max_ns = BLK_POLL_MAX_NS;
+
 	return q;
 }
 EXPORT_SYMBOL(blk_alloc_queue_node);
@@ -1904,6 +2035,7 @@ blk_init_queue_node(request_fn_proc *rfn, spinlock_t *lock, int node_id)
 
 	q->node = node_id;
 	if (blk_init_free_list(q)) {
+		free_percpu(q->poll_stat);
 		kmem_cache_free(requestq_cachep, q);
 		return NULL;
 	}
@@ -2637,6 +2769,52 @@ void disk_round_stats(struct gendisk *disk)
 
 EXPORT_SYMBOL_GPL(disk_round_stats);
 
+#ifdef CONFIG_BLK_LATENCY_HIST
+#define disk_lat_bucket(ns)	log2_bucket((ns) >> 10, DISK_LAT_BUCKETS)
+
+/**
+ * disk_lat_account - account a completed request in the disk histograms
+ * @disk:	the disk
+ * @rq:		the request
+ * @depth:	requests in the driver, this one included, or 0 if unknown
+ *
+ * Description:
+ *    A latency of n nanoseconds is counted in bucket fls64(n >> 10):
+ *    bucket 0 is below ~1us, bucket k holds [2^(k-1), 2^k) units of
+ *    1024ns, the last one is open-ended. A request the driver took
+ *    without going through elv_next_request() is all service time.
+ *    The counters are per-CPU, so the caller must not be preemptible.
+ */
+void disk_lat_account(struct gendisk *disk, struct request *rq, int depth)
+{
+	unsigned long long now = sched_clock();
+	unsigned long long queued = rq->queue_ns;
+	unsigned long long issued = rq->issue_ns ? rq->issue_ns : queued;
+	const int rw = rq_data_dir(rq);
+
+	/*
+	 * sched_clock() is per-CPU, and the request may have been issued
+	 * or completed on another CPU than it was queued on
+	 */
+	if ((long long)(issued - queued) < 0)
+		issued = queued;
+	if ((long long)(now - issued) < 0)
+		now = issued;
+
+	__disk_stat_inc(disk, lat_hist[rw][DISK_LAT_QUEUE]
+				       [disk_lat_bucket(issued - queued)]);
+	__disk_stat_inc(disk, lat_hist[rw][DISK_LAT_SERVICE]
+				       [disk_lat_bucket(now - issued)]);
+	__disk_stat_inc(disk, lat_hist[rw][DISK_LAT_TOTAL]
+				       [disk_lat_bucket(now - queued)]);
+
+	if (depth > 0)
+		__disk_stat_inc(disk, depth_hist[rw]
+				[log2_bucket(depth, DISK_DEPTH_BUCKETS)]);
+}
+EXPORT_SYMBOL_GPL(disk_lat_account);
+#endif
+
 /*
  * queue lock must be held
  */
@@ -2769,6 +2947,7 @@ static int attempt_merge(request_queue_t *q, struct request *req,
 	 */
 	if (time_after(req->start_time, next->start_time))
 		req->start_time = next->start_time;
+	blk_lat_merged(req, next);
 
 	req->biotail->bi_next = next->bio;
 	req->biotail = next->biotail;
@@ -2808,7 +2987,7 @@ static inline int attempt_front_merge(request_queue_t *q, struct request *rq)
 	return 0;
 }
 
-static void init_request_from_bio(struct request *req, struct bio *bio)
+void init_request_from_bio(struct request *req, struct bio *bio)
 {
 	req->flags |= REQ_CMD;
 
@@ -2836,10 +3015,249 @@ static void init_request_from_bio(struct request *req, struct bio *bio)
 	req->ioprio = bio_prio(bio);
 	req->rq_disk = bio->bi_bdev->bd_disk;
 	req->start_time = jiffies;
+	blk_lat_queued(req);
+	blk_trace_init_rq(req, bio);
+}
+
+#ifdef CONFIG_BLK_PLUG_STATS
+#define PLUG_STATS_BUCKETS	8
+
+/*
+ * Bios submitted under a plug and how many of them merged into a request
+ * held back there, and a log2 histogram of the number of requests handed
+ * to a queue at once when the plug is flushed.
+ */
+struct plug_stats {
+	unsigned long	bios;
+	unsigned long	merges;
+	unsigned long	requests;
+	unsigned long	flushes;
+	unsigned long	sched_flushes;	/* flushed because the task slept */
+	unsigned int	batch[PLUG_STATS_BUCKETS];
+};
+
+static DEFINE_PER_CPU(struct plug_stats, plug_stats);
+
+#define plug_stats_inc(field)						\
+	do {								\
+		get_cpu_var(plug_stats).field++;			\
+		put_cpu_var(plug_stats);				\
+	} while (0)
+
+/* Interrupts are disabled. */
+static inline void plug_stats_batch(unsigned int depth, int from_schedule)
+{
+	struct plug_stats *ps = &__get_cpu_var(plug_stats);
+
+	ps->flushes++;
+	if (from_schedule)
+		ps->sched_flushes++;
+	ps->batch[log2_bucket(depth, PLUG_STATS_BUCKETS)]++;
+}
+#else
+#define plug_stats_inc(field)				do { } while (0)
+#define plug_stats_batch(depth, from_schedule)	do { } while (0)
+#endif
+
+/*
+ * Try to merge @bio into a request held back on @plug. The requests there
+ * are not visible to anyone but the task, so this needs no queue lock.
+ */
+static int attempt_plug_merge(struct blk_plug *plug, request_queue_t *q,
+			      struct bio *bio)
+{
+	const int nr_sectors = bio_sectors(bio);
+	struct request *req;
+
+	/* the most recent request is the most likely to be contiguous */
+	list_for_each_entry_reverse(req, &plug->list, queuelist) {
+		if (req->q != q || !elv_rq_merge_ok(req, bio))
+			continue;
+
+		if (req->sector + req->nr_sectors == bio->bi_sector) {
+			if (!q->back_merge_fn(q, req, bio))
+				continue;
+
+			blk_add_trace_bio(q, bio, BLK_TA_BACKMERGE);
+
+			req->biotail->bi_next = bio;
+			req->biotail = bio;
+		} else if (req->sector - nr_sectors == bio->bi_sector) {
+			if (!q->front_merge_fn(q, req, bio))
+				continue;
+
+			blk_add_trace_bio(q, bio, BLK_TA_FRONTMERGE);
+
+			bio->bi_next = req->bio;
+			req->bio = bio;
+			req->buffer = bio_data(bio);
+			req->current_nr_sectors = bio_cur_sectors(bio);
+			req->hard_cur_sectors = req->current_nr_sectors;
+			req->sector = req->hard_sector = bio->bi_sector;
+		} else
+			continue;
+
+		req->nr_sectors = req->hard_nr_sectors += nr_sectors;
+		req->ioprio = ioprio_best(req->ioprio, bio_prio(bio));
+		disk_stat_inc(req->rq_disk, merges[rq_data_dir(req)]);
+		plug_stats_inc(merges);
+		return 1;
+	}
+
+	return 0;
+}
+
+static inline int plug_rq_before(struct request *a, struct request *b)
+{
+	if (a->q != b->q)
+		return a->q < b->q;
+	return a->sector <= b->sector;
+}
+
+/*
+ * Sort the requests by queue and then by sector, so that each queue is
+ * locked once and gets its requests in ascending order. The list is at
+ * most BLK_MAX_REQUEST_COUNT long and mostly sorted already, an insertion
+ * sort does.
+ */
+static void plug_list_sort(struct list_head *list)
+{
+	struct request *req, *pos;
+	LIST_HEAD(sorted);
+
+	while (!list_empty(list)) {
+		req = list_entry_rq(list->next);
+		list_del(&req->queuelist);
+
+		list_for_each_entry_reverse(pos, &sorted, queuelist)
+			if (plug_rq_before(pos, req))
+				break;
+		list_add(&req->queuelist, &pos->queuelist);
+	}
+
+	list_splice(&sorted, list);
+}
+
+/*
+ * Queue lock held, interrupts disabled. Drops the lock.
+ */
+static void queue_unplugged(request_queue_t *q, unsigned int depth,
+			    int from_schedule)
+{
+	blk_add_trace_pdu_int(q, BLK_TA_UNPLUG_IO, NULL, depth);
+	plug_stats_batch(depth, from_schedule);
+
+	if (from_schedule) {
+		blk_plug_device(q);
+		kblockd_schedule_work(&q->unplug_work);
+	} else if (!blk_queue_stopped(q))
+		__blk_run_queue(q);
+
+	spin_unlock(q->queue_lock);
+}
+
+/**
+ * blk_flush_plug_list - hand the requests held back on a plug to the queues
+ * @plug:	the plug
+ * @from_schedule: called from schedule(), leave running the queues to kblockd
+ */
+void blk_flush_plug_list(struct blk_plug *plug, int from_schedule)
+{
+	request_queue_t *q = NULL;
+	struct request *req;
+	unsigned int depth = 0;
+	unsigned long flags;
+	LIST_HEAD(list);
+
+	if (list_empty(&plug->list))
+		return;
+
+	list_splice_init(&plug->list, &list);
+	plug->count = 0;
+	plug_list_sort(&list);
+
+	local_irq_save(flags);
+	while (!list_empty(&list)) {
+		req = list_entry_rq(list.next);
+		list_del_init(&req->queuelist);
+
+		if (req->q != q) {
+			if (q)
+				queue_unplugged(q, depth, from_schedule);
+			q = req->q;
+			depth = 0;
+			spin_lock(q->queue_lock);
+		}
+		add_request(q, req);
+		depth++;
+	}
+	queue_unplugged(q, depth, from_schedule);
+	local_irq_restore(flags);
 }
+EXPORT_SYMBOL(blk_flush_plug_list);
+
+/**
+ * blk_start_plug - hold back the requests the task is about to submit
+ * @plug:	the plug, normally on the caller's stack
+ *
+ * Description:
+ *    Until blk_finish_plug(), or until the task sleeps, the requests the
+ *    task submits are collected on @plug instead of going to the elevator
+ *    one by one. Calls nest; an inner plug collects nothing.
+ */
+void blk_start_plug(struct blk_plug *plug)
+{
+	struct task_struct *tsk = current;
+
+	INIT_LIST_HEAD(&plug->list);
+	plug->count = 0;
+
+	if (!tsk->plug)
+		tsk->plug = plug;
+}
+EXPORT_SYMBOL(blk_start_plug);
+
+/**
+ * blk_finish_plug - submit the requests held back since blk_start_plug()
+ * @plug:	the plug passed to blk_start_plug()
+ */
+void blk_finish_plug(struct blk_plug *plug)
+{
+	blk_flush_plug_list(plug, 0);
+
+	if (plug == current->plug)
+		current->plug = NULL;
+}
+EXPORT_SYMBOL(blk_finish_plug);
+
+#ifdef CONFIG_BLK_PLUG_STATS
+#define PLUG_STAT_VERSION 1
+
+static int show_plug_stat(struct seq_file *seq, void *v)
+{
+	struct plug_stats *ps;
+	int cpu;
+
+	seq_printf(seq, "version %d\n", PLUG_STAT_VERSION);
+	seq_printf(seq, "buckets %d\n", PLUG_STATS_BUCKETS);
+	for_each_online_cpu(cpu) {
+		ps = &per_cpu(plug_stats, cpu);
+		seq_printf(seq, "cpu%d bios %lu merges %lu requests %lu "
+			   "flushes %lu sched_flushes %lu\n", cpu, ps->bios,
+			   ps->merges, ps->requests, ps->flushes,
+			   ps->sched_flushes);
+		seq_printf(seq, "cpu%d batch", cpu);
+		seq_put_hist(seq, ps->batch, PLUG_STATS_BUCKETS);
+	}
+	return 0;
+}
+
+DEFINE_SEQ_STAT_FILE(plug_stat);
+#endif /* CONFIG_BLK_PLUG_STATS */
 
 static int __make_request(request_queue_t *q, struct bio *bio)
 {
+	struct blk_plug *plug;
 	struct request *req;
 	int el_ret, rw, nr_sectors, cur_nr_sectors, barrier, err, sync;
 	unsigned short prio;
@@ -2868,6 +3286,25 @@ static int __make_request(request_queue_t *q, struct bio *bio)
 		goto end_io;
 	}
 
+	/*
+	 * A barrier orders the requests queued before it: hand the plugged
+	 * ones to their queues first, then the barrier goes straight to
+	 * the queue.
+	 */
+	plug = current->plug;
+	if (unlikely(barrier) && plug) {
+		blk_flush_plug_list(plug, 0);
+		plug = NULL;
+	}
+	if (plug) {
+		plug_stats_inc(bios);
+		if (attempt_plug_merge(plug, q, bio)) {
+			if (sync)
+				blk_flush_plug_list(plug, 0);
+			return 0;
+		}
+	}
+
 	spin_lock_irq(q->queue_lock);
 
 	if (unlikely(barrier) || elv_queue_empty(q))
@@ -2939,6 +3376,21 @@ get_rq:
 	 */
 	init_request_from_bio(req, bio);
 
+	if (plug) {
+		/*
+		 * Hold the request back. A synchronous one is waited for
+		 * right away, so it takes the others along with it.
+		 */
+		if (plug->count >= BLK_MAX_REQUEST_COUNT)
+			blk_flush_plug_list(plug, 0);
+		list_add_tail(&req->queuelist, &plug->list);
+		plug->count++;
+		plug_stats_inc(requests);
+		if (sync)
+			blk_flush_plug_list(plug, 0);
+		return 0;
+	}
+
 	spin_lock_irq(q->queue_lock);
 	if (elv_queue_empty(q))
 		blk_plug_device(q);
@@ -3433,6 +3885,107 @@ void blk_complete_request(struct request *req)
 }
 
 EXPORT_SYMBOL(blk_complete_request);
+
+/*
+ * Update the average time to complete with a wait of @ns, and from it
+ * the spin budget: twice the average, or nothing if that is more than
+ * poll_max_ns. With no budget waiters sleep, but their waits still feed
+ * the average, so polling comes back once the device is fast again.
+ */
+static void blk_poll_update(request_queue_t *q, unsigned long long ns)
+{
+	unsigned int mean = q->poll_mean_ns;
+	unsigned int wait = min_t(unsigned long long, ns, UINT_MAX);
+
+	if (!mean)
+		mean = wait;
+	else if (wait > mean)
+		mean += (wait - mean) / 8;
+	else
+		mean -= (mean - wait) / 8;
+	q->poll_mean_ns = mean;
+
+	if (2ULL * mean <= q->poll_max_ns)
+		q->poll_budget_ns = 2 * mean;
+	else
+		q->poll_budget_ns = 0;
+}
+
+/**
+ * blk_poll - spin for a completion instead of sleeping for it
+ * @q:		queue the I/O was submitted to
+ * @done:	returns non-zero once the caller's I/O has completed
+ * @data:	passed to @done
+ * @start:	set to when the wait started
+ *
+ * Description:
+ *    For a synchronous waiter on a queue with polling switched on. The
+ *    I/O must have been submitted and the queue unplugged. Calls the
+ *    driver's poll_fn until @done() is true, for at most the current
+ *    spin budget and only as long as nothing else wants the CPU.
+ *
+ *    Returns 1 if the I/O completed. If it returns 0 the caller sleeps
+ *    as it would have done without polling, and when woken reports how
+ *    long it waited with blk_poll_slept(q, *start).
+ **/
+int blk_poll(request_queue_t *q, int (*done)(void *), void *data,
+	     unsigned long long *start)
+{
+	unsigned long long now, budget = q->poll_budget_ns;
+	struct blk_poll_stats *st;
+	int reaped = 0, ret;
+
+	now = *start = sched_clock();
+	while (!(ret = done(data))) {
+		if (now - *start >= budget || need_resched())
+			break;
+		reaped += q->poll_fn(q);
+		cpu_relax();
+		now = sched_clock();
+		/* sched_clock() is per-CPU, we may have migrated */
+		if ((long long)(now - *start) < 0)
+			now = *start;
+	}
+	now -= *start;
+
+	st = per_cpu_ptr(q->poll_stat, get_cpu());
+	st->reaped += reaped;
+	if (ret) {
+		st->hits++;
+		st->hit_ns += now;
+	} else if (budget) {
+		st->misses++;
+		st->miss_ns += now;
+	} else
+		st->skipped++;
+	put_cpu();
+
+	if (ret)
+		blk_poll_update(q, now);
+
+	return ret;
+}
+
+EXPORT_SYMBOL(blk_poll);
+
+/**
+ * blk_poll_slept - account a wait blk_poll() gave up on
+ * @q:		queue the I/O was submitted to
+ * @start:	when the wait started, as returned by blk_poll()
+ **/
+void blk_poll_slept(request_queue_t *q, unsigned long long start)
+{
+	unsigned long long now = sched_clock();
+
+	if ((long long)(now - start) < 0)
+		now = start;
+
+	per_cpu_ptr(q->poll_stat, get_cpu())->sleep_ns += now - start;
+	put_cpu();
+	blk_poll_update(q, now - start);
+}
+
+EXPORT_SYMBOL(blk_poll_slept);
 	
 /*
  * queue lock must be held
@@ -3463,6 +4016,9 @@ void end_that_request_last(struct request *req, int uptodate)
 
 		__disk_stat_inc(disk, ios[rw]);
 		__disk_stat_add(disk, ticks[rw], duration);
+#ifdef CONFIG_BLK_LATENCY_HIST
+		disk_lat_account(disk, req, req->q->in_flight);
+#endif
 		disk_round_stats(disk);
 		disk->in_flight--;
 	}
@@ -3509,6 +4065,13 @@ int kblockd_schedule_work(struct work_struct *work)
 
 EXPORT_SYMBOL(kblockd_schedule_work);
 
+int kblockd_schedule_work_on(int cpu, struct work_struct *work)
+{
+	return queue_work_on(cpu, kblockd_workqueue, work);
+}
+
+EXPORT_SYMBOL(kblockd_schedule_work_on);
+
 void kblockd_flush(void)
 {
 	flush_workqueue(kblockd_workqueue);
@@ -3809,6 +4372,126 @@ static ssize_t queue_max_hw_sectors_show(struct request_queue *q, char *page)
 }
 
 
+static ssize_t queue_rq_affinity_show(struct request_queue *q, char *page)
+{
+	return queue_var_show(test_bit(QUEUE_FLAG_SAME_COMP, &q->queue_flags),
+			      page);
+}
+
+static ssize_t
+queue_rq_affinity_store(struct request_queue *q, const char *page, size_t count)
+{
+	unsigned long val;
+	ssize_t ret = queue_var_store(&val, page, count);
+
+	if (val)
+		set_bit(QUEUE_FLAG_SAME_COMP, &q->queue_flags);
+	else
+		clear_bit(QUEUE_FLAG_SAME_COMP, &q->queue_flags);
+
+	return ret;
+}
+
+static ssize_t queue_nr_hw_queues_show(struct request_queue *q, char *page)
+{
+	return queue_var_show(q->nr_hw_queues, page);
+}
+
+static ssize_t queue_poll_show(struct request_queue *q, char *page)
+{
+	return queue_var_show(blk_queue_polled(q), page);
+}
+
+static ssize_t
+queue_poll_store(struct request_queue *q, const char *page, size_t count)
+{
+	unsigned long val;
+	ssize_t ret = queue_var_store(&val, page, count);
+
+	if (!q->poll_fn)
+		return -EINVAL;
+	if (val)
+		set_bit(QUEUE_FLAG_POLL, &q->queue_flags);
+	else
+		clear_bit(QUEUE_FLAG_POLL, &q->queue_flags);
+
+	return ret;
+}
+
+static ssize_t queue_poll_max_show(struct request_queue *q, char *page)
+{
+	return queue_var_show(q->poll_max_ns / 1000, page);
+}
+
+static ssize_t
+queue_poll_max_store(struct request_queue *q, const char *page, size_t count)
+{
+	unsigned long max_us;
+	ssize_t ret = queue_var_store(&max_us, page, count);
+
+	if (max_us > UINT_MAX / 1000)
+		return -EINVAL;
+
+	q->poll_max_ns = max_us * 1000;
+	blk_poll_update(q, q->poll_mean_ns);
+
+	return ret;
+}
+
+/*
+ * The saving is an estimate: what the hits would have waited had they
+ * slept as long as the waits that did sleep, less what they did wait
+ * and what the misses spun for nothing.
+ */
+static ssize_t queue_poll_stats_show(struct request_queue *q, char *page)
+{
+	struct blk_poll_stats st;
+	unsigned long long sleep_mean = 0;
+	unsigned long sleeps;
+	long long saved = 0;
+	int cpu;
+
+	memset(&st, 0, sizeof(st));
+	for_each_possible_cpu(cpu) {
+		struct blk_poll_stats *c = per_cpu_ptr(q->poll_stat, cpu);
+
+		st.hits += c->hits;
+		st.misses += c->misses;
+		st.skipped += c->skipped;
+		st.reaped += c->reaped;
+		st.hit_ns += c->hit_ns;
+		st.miss_ns += c->miss_ns;
+		st.sleep_ns += c->sleep_ns;
+	}
+
+	sleeps = st.misses + st.skipped;
+	if (sleeps) {
+		sleep_mean = st.sleep_ns;
+		do_div(sleep_mean, sleeps);
+		saved = st.hits * sleep_mean - st.hit_ns - st.miss_ns;
+	}
+
+	return sprintf(page,
+		       "hits %lu\nmisses %lu\nskipped %lu\nreaped %lu\n"
+		       "hit_ns %llu\nmiss_ns %llu\nsleep_ns %llu\n"
+		       "mean_ns %u\nbudget_ns %u\nsaved_ns %lld\n",
+		       st.hits, st.misses, st.skipped, st.reaped,
+		       st.hit_ns, st.miss_ns, st.sleep_ns,
+		       q->poll_mean_ns, q->poll_budget_ns, saved);
+}
+
+static ssize_t
+queue_poll_stats_store(struct request_queue *q, const char *page, size_t count)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		memset(per_cpu_ptr(q->poll_stat, cpu), 0,
+		       sizeof(struct blk_poll_stats));
+
+	return count;
+}
+
 static struct queue_sysfs_entry queue_requests_entry = {
 	.attr = {.name = "nr_requests", .mode = S_IRUGO | S_IWUSR },
 	.show = queue_requests_show,
@@ -3838,12 +4521,59 @@ static struct queue_sysfs_entry queue_iosched_entry = {
 	.store = elv_iosched_store,
 };
 
+static struct queue_sysfs_entry queue_rq_affinity_entry = {
+	.attr = {.name = "rq_affinity", .mode = S_IRUGO | S_IWUSR },
+	.show = queue_rq_affinity_show,
+	.store = queue_rq_affinity_store,
+};
+
+static struct queue_sysfs_entry queue_nr_hw_queues_entry = {
+	.attr = {.name = "nr_hw_queues", .mode = S_IRUGO },
+	.show = queue_nr_hw_queues_show,
+};
+
+static struct queue_sysfs_entry queue_poll_entry = {
+	.attr = {.name = "io_poll", .mode = S_IRUGO | S_IWUSR },
+	.show = queue_poll_show,
+	.store = queue_poll_store,
+};
+
+static struct queue_sysfs_entry queue_poll_max_entry = {
+	.attr = {.name = "io_poll_max_us", .mode = S_IRUGO | S_IWUSR },
+	.show = queue_poll_max_show,
+	.store = queue_poll_max_store,
+};
+
+static struct queue_sysfs_entry queue_poll_stats_entry = {
+	.attr = {.name = "io_poll_stats", .mode = S_IRUGO | S_IWUSR },
+	.show = queue_poll_stats_show,
+	.store = queue_poll_stats_store,
+};
+
 static struct attribute *default_attrs[] = {
 	&queue_requests_entry.attr,
 	&queue_ra_entry.attr,
 	&queue_max_hw_sectors_entry.attr,
 	&queue_max_sectors_entry.attr,
 	&queue_iosched_entry.attr,
+	&queue_poll_entry.attr,
+	&queue_poll_max_entry.attr,
+	&queue_poll_stats_entry.attr,
+	NULL,
+};
+
+/*
+ * Multi-queue devices have no request lists and no elevator.
+ */
+static struct attribute *mq_default_attrs[] = {
+	&queue_ra_entry.attr,
+	&queue_max_hw_sectors_entry.attr,
+	&queue_max_sectors_entry.attr,
+	&queue_rq_affinity_entry.attr,
+	&queue_nr_hw_queues_entry.attr,
+	&queue_poll_entry.attr,
+	&queue_poll_max_entry.attr,
+	&queue_poll_stats_entry.attr,
 	NULL,
 };
 
@@ -3900,13 +4630,19 @@ static struct kobj_type queue_ktype = {
 	.release	= blk_release_queue,
 };
 
+struct kobj_type blk_mq_queue_ktype = {
+	.sysfs_ops	= &queue_sysfs_ops,
+	.default_attrs	= mq_default_attrs,
+	.release	= blk_release_queue,
+};
+
 int blk_register_queue(struct gendisk *disk)
 {
 	int ret;
 
 	request_queue_t *q = disk->queue;
 
-	if (!q || !q->request_fn)
+	if (!q || !(q->request_fn || q->mq_ops))
 		return -ENXIO;
 
 	q->kobj.parent = kobject_get(&disk->kobj);
@@ -3917,6 +4653,9 @@ int blk_register_queue(struct gendisk *disk)
 
 	kobject_uevent(&q->kobj, KOBJ_ADD);
 
+	if (!q->elevator)
+		return 0;
+
 	ret = elv_register_queue(q);
 	if (ret) {
 		kobject_uevent(&q->kobj, KOBJ_REMOVE);
@@ -3931,8 +4670,9 @@ void blk_unregister_queue(struct gendisk *disk)
 {
 	request_queue_t *q = disk->queue;
 
-	if (q && q->request_fn) {
-		elv_unregister_queue(q);
+	if (q && (q->request_fn || q->mq_ops)) {
+		if (q->elevator)
+			elv_unregister_queue(q);
 
 		kobject_uevent(&q->kobj, KOBJ_REMOVE);
 		kobject_del(&q->kobj);
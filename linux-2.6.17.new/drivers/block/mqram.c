@@ -0,0 +1,370 @@
+/*
+ * mqram.c - RAM disk on the multi-queue block layer
+ *
+ * Like rd.c this is a disk in memory, but the data lives in pages the
+ * driver allocates up front rather than in the page cache, and every
+ * bio goes through the request layer: with use_mq=1 (the default)
+ * through per-CPU software queues and hw_queues hardware contexts, with
+ * use_mq=0 through a classic request_fn queue and its queue_lock. The
+ * transfer itself is a memcpy, so the difference between the two is
+ * the cost of the block layer. See Documentation/block/multiqueue.txt.
+ *
+ * With poll=1 a multi-queue disk does not complete requests when they
+ * are queued but from a tasklet, as a real device would from its
+ * interrupt, and lets synchronous waiters reap them first through the
+ * queue's poll function. See Documentation/block/poll.txt.
+ */
+
+#include <linux/config.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/highmem.h>
+#include <linux/bio.h>
+#include <linux/blkdev.h>
+#include <linux/blk-mq.h>
+#include <linux/genhd.h>
+#include <linux/interrupt.h>
+
+#define MQRAM_MAX_DEVICES	16
+
+static int mqram_nr = 1;		/* number of disks */
+static int mqram_size = 65536;		/* size of each disk in kbytes */
+static int use_mq = 1;
+static int hw_queues;			/* 0: one for every CPU */
+static int queue_depth = 64;
+static int poll;
+
+/*
+ * Requests done but not yet completed, one for every hardware queue
+ */
+struct mqram_cq {
+	spinlock_t		lock;
+	struct list_head	list;
+	struct tasklet_struct	tasklet;
+} ____cacheline_aligned_in_smp;
+
+struct mqram_dev {
+	struct page		**pages;
+	unsigned long		nr_pages;
+	request_queue_t		*queue;
+	struct gendisk		*disk;
+	spinlock_t		lock;		/* queue_lock, use_mq=0 only */
+	struct mqram_cq		*cqs;		/* poll=1 only */
+};
+
+static struct mqram_dev mqram_devs[MQRAM_MAX_DEVICES];
+static int mqram_major;
+
+/*
+ * Copy one segment. It is sector aligned, but may straddle two of our
+ * pages.
+ */
+static void mqram_copy(struct mqram_dev *dev, sector_t sector,
+		       struct bio_vec *bvec, int rw)
+{
+	unsigned int len = bvec->bv_len, off = bvec->bv_offset;
+	unsigned int pgoff, n;
+	char *mem, *buf;
+
+	while (len) {
+		pgoff = (sector & ((PAGE_SIZE >> 9) - 1)) << 9;
+		n = min_t(unsigned int, len, PAGE_SIZE - pgoff);
+
+		mem = kmap_atomic(dev->pages[sector >> (PAGE_SHIFT - 9)],
+				  KM_USER0);
+		buf = kmap_atomic(bvec->bv_page, KM_USER1);
+		if (rw == WRITE)
+			memcpy(mem + pgoff, buf + off, n);
+		else {
+			memcpy(buf + off, mem + pgoff, n);
+			flush_dcache_page(bvec->bv_page);
+		}
+		kunmap_atomic(buf, KM_USER1);
+		kunmap_atomic(mem, KM_USER0);
+
+		sector += n >> 9;
+		off += n;
+		len -= n;
+	}
+}
+
+static void mqram_transfer(struct mqram_dev *dev, struct request *rq)
+{
+	sector_t sector = rq->sector;
+	struct bio_vec *bvec;
+	struct bio *bio;
+	int i;
+
+	rq_for_each_bio(bio, rq) {
+		bio_for_each_segment(bvec, bio, i) {
+			mqram_copy(dev, sector, bvec, rq_data_dir(rq));
+			sector += bvec->bv_len >> 9;
+		}
+	}
+}
+
+/*
+ * Complete the requests on @cq; called both from its tasklet and by
+ * pollers, so whoever gets the lock first takes them all.
+ */
+static int mqram_reap(struct mqram_cq *cq)
+{
+	struct request *rq;
+	unsigned long flags;
+	LIST_HEAD(list);
+	int nr = 0;
+
+	spin_lock_irqsave(&cq->lock, flags);
+	list_splice_init(&cq->list, &list);
+	spin_unlock_irqrestore(&cq->lock, flags);
+
+	while (!list_empty(&list)) {
+		rq = list_entry(list.next, struct request, queuelist);
+		list_del_init(&rq->queuelist);
+		blk_mq_end_io(rq, 0);
+		nr++;
+	}
+	return nr;
+}
+
+static void mqram_tasklet(unsigned long data)
+{
+	mqram_reap((struct mqram_cq *)data);
+}
+
+static int mqram_poll(request_queue_t *q)
+{
+	struct mqram_dev *dev = q->queuedata;
+	unsigned int i;
+	int nr = 0;
+
+	for (i = 0; i < q->nr_hw_queues; i++)
+		if (!list_empty(&dev->cqs[i].list))
+			nr += mqram_reap(&dev->cqs[i]);
+	return nr;
+}
+
+static int mqram_queue_rq(struct blk_mq_hw_ctx *hctx, struct request *rq)
+{
+	struct mqram_dev *dev = hctx->driver_data;
+	struct mqram_cq *cq;
+	unsigned long flags;
+
+	if (!blk_fs_request(rq))
+		return BLK_MQ_RQ_QUEUE_ERROR;
+
+	mqram_transfer(dev, rq);
+	if (!dev->cqs) {
+		blk_mq_end_io(rq, 0);
+		return BLK_MQ_RQ_QUEUE_OK;
+	}
+
+	cq = &dev->cqs[hctx->queue_num];
+	spin_lock_irqsave(&cq->lock, flags);
+	list_add_tail(&rq->queuelist, &cq->list);
+	spin_unlock_irqrestore(&cq->lock, flags);
+	tasklet_schedule(&cq->tasklet);
+	return BLK_MQ_RQ_QUEUE_OK;
+}
+
+static struct blk_mq_ops mqram_mq_ops = {
+	.queue_rq	= mqram_queue_rq,
+};
+
+static void mqram_request(request_queue_t *q)
+{
+	struct request *rq;
+	int uptodate;
+
+	while ((rq = elv_next_request(q)) != NULL) {
+		blkdev_dequeue_request(rq);
+
+		uptodate = blk_fs_request(rq);
+		if (uptodate)
+			mqram_transfer(q->queuedata, rq);
+		if (!end_that_request_first(rq, uptodate, rq->hard_nr_sectors))
+			end_that_request_last(rq, uptodate);
+	}
+}
+
+static struct block_device_operations mqram_fops = {
+	.owner		= THIS_MODULE,
+};
+
+static void mqram_free_pages(struct mqram_dev *dev)
+{
+	unsigned long i;
+
+	if (!dev->pages)
+		return;
+	for (i = 0; i < dev->nr_pages; i++)
+		if (dev->pages[i])
+			__free_page(dev->pages[i]);
+	vfree(dev->pages);
+	dev->pages = NULL;
+}
+
+static int __init mqram_alloc_pages(struct mqram_dev *dev)
+{
+	unsigned long i;
+
+	dev->nr_pages = ((unsigned long)mqram_size << 10) >> PAGE_SHIFT;
+	dev->pages = vmalloc(dev->nr_pages * sizeof(struct page *));
+	if (!dev->pages)
+		return -ENOMEM;
+	memset(dev->pages, 0, dev->nr_pages * sizeof(struct page *));
+
+	for (i = 0; i < dev->nr_pages; i++) {
+		dev->pages[i] = alloc_page(GFP_KERNEL | __GFP_HIGHMEM |
+					   __GFP_ZERO);
+		if (!dev->pages[i])
+			return -ENOMEM;
+	}
+	return 0;
+}
+
+static request_queue_t * __init mqram_init_queue(struct mqram_dev *dev)
+{
+	struct blk_mq_reg reg;
+	request_queue_t *q;
+
+	if (!use_mq) {
+		spin_lock_init(&dev->lock);
+		q = blk_init_queue(mqram_request, &dev->lock);
+		if (q)
+			q->queuedata = dev;
+		return q;
+	}
+
+	if (poll) {
+		struct mqram_cq *cq;
+		int i;
+
+		dev->cqs = kmalloc(hw_queues * sizeof(*cq), GFP_KERNEL);
+		if (!dev->cqs)
+			return NULL;
+		for (i = 0; i < hw_queues; i++) {
+			cq = &dev->cqs[i];
+			spin_lock_init(&cq->lock);
+			INIT_LIST_HEAD(&cq->list);
+			tasklet_init(&cq->tasklet, mqram_tasklet,
+				     (unsigned long)cq);
+		}
+	}
+
+	reg.ops = &mqram_mq_ops;
+	reg.nr_hw_queues = hw_queues;
+	reg.queue_depth = queue_depth;
+	reg.numa_node = -1;
+	q = blk_mq_init_queue(&reg, dev);
+	if (q && poll)
+		blk_queue_poll(q, mqram_poll);
+	return q;
+}
+
+static void mqram_cleanup_dev(struct mqram_dev *dev)
+{
+	if (dev->disk) {
+		del_gendisk(dev->disk);
+		put_disk(dev->disk);
+	}
+	if (dev->cqs) {
+		int i;
+
+		for (i = 0; i < hw_queues; i++)
+			tasklet_kill(&dev->cqs[i].tasklet);
+		kfree(dev->cqs);
+		dev->cqs = NULL;
+	}
+	if (dev->queue)
+		blk_cleanup_queue(dev->queue);
+	mqram_free_pages(dev);
+}
+
+static void __exit mqram_exit(void)
+{
+	int i;
+
+	for (i = 0; i < mqram_nr; i++)
+		mqram_cleanup_dev(&mqram_devs[i]);
+	unregister_blkdev(mqram_major, "mqram");
+}
+
+static int __init mqram_init(void)
+{
+	struct mqram_dev *dev;
+	struct gendisk *disk;
+	int i, err;
+
+	if (mqram_nr < 1 || mqram_nr > MQRAM_MAX_DEVICES || mqram_size < 4 ||
+	    queue_depth < 1 || queue_depth > BLK_MQ_MAX_DEPTH)
+		return -EINVAL;
+	if (hw_queues <= 0)
+		hw_queues = num_possible_cpus();
+
+	mqram_major = register_blkdev(0, "mqram");
+	if (mqram_major < 0)
+		return mqram_major;
+
+	for (i = 0; i < mqram_nr; i++) {
+		dev = &mqram_devs[i];
+
+		err = mqram_alloc_pages(dev);
+		if (err)
+			goto out;
+
+		err = -ENOMEM;
+		dev->queue = mqram_init_queue(dev);
+		if (!dev->queue)
+			goto out;
+		blk_queue_bounce_limit(dev->queue, BLK_BOUNCE_ANY);
+
+		disk = alloc_disk(1);
+		if (!disk)
+			goto out;
+		disk->major = mqram_major;
+		disk->first_minor = i;
+		disk->fops = &mqram_fops;
+		disk->private_data = dev;
+		disk->queue = dev->queue;
+		sprintf(disk->disk_name, "mqram%d", i);
+		set_capacity(disk, dev->nr_pages << (PAGE_SHIFT - 9));
+		dev->disk = disk;
+		add_disk(disk);
+	}
+
+	printk(KERN_INFO "mqram: %d disks of %dK, %s\n", mqram_nr, mqram_size,
+	       use_mq ? "multi-queue" : "request_fn queue");
+	if (use_mq)
+		printk(KERN_INFO "mqram: %d hardware queues of depth %d%s\n",
+		       hw_queues, queue_depth,
+		       poll ? ", completion polling" : "");
+	return 0;
+out:
+	for (; i >= 0; i--)
+		mqram_cleanup_dev(&mqram_devs[i]);
+	unregister_blkdev(mqram_major, "mqram");
+	return err;
+}
+
+module_init(mqram_init);
+module_exit(mqram_exit);
+
+module_param_named(nr_devices, mqram_nr, int, 0);
+MODULE_PARM_DESC(nr_devices, "Number of disks.");
+module_param_named(size, mqram_size, int, 0);
+MODULE_PARM_DESC(size, "Size of each disk in kbytes.");
+module_param(use_mq, int, 0);
+MODULE_PARM_DESC(use_mq, "Use the multi-queue block layer (default 1).");
+module_param(hw_queues, int, 0);
+MODULE_PARM_DESC(hw_queues, "Number of hardware queues (default one per CPU).");
+module_param(queue_depth, int, 0);
+MODULE_PARM_DESC(queue_depth, "Depth of each hardware queue.");
+module_param(poll, int, 0);
+MODULE_PARM_DESC(poll, "Complete from a tasklet, and support polling (multi-queue only).");
+
+MODULE_LICENSE("GPL");
@@ -29,6 +29,8 @@
 #include <linux/highmem.h>
 #include <linux/workqueue.h>
 #include <linux/security.h>
+#include <linux/net.h>
+#include <linux/socket.h>
 
 #include <asm/kmap_types.h>
 #include <asm/uaccess.h>
@@ -50,6 +52,7 @@ static kmem_cache_t	*kiocb_cachep;
 static kmem_cache_t	*kioctx_cachep;
 
 static struct workqueue_struct *aio_wq;
+static struct workqueue_struct *aio_fsync_wq;
 
 /* Used for rare fput completion. */
 static void aio_fput_routine(void *);
@@ -73,6 +76,7 @@ static int __init aio_setup(void)
 				0, SLAB_HWCACHE_ALIGN|SLAB_PANIC, NULL, NULL);
 
 	aio_wq = create_workqueue("aio");
+	aio_fsync_wq = create_unbound_workqueue("aio_fsync");
 
 	pr_debug("aio_setup: sizeof(struct page) = %d\n", (int)sizeof(struct page));
 
@@ -107,6 +111,22 @@ static int aio_setup_ring(struct kioctx *ctx)
 	unsigned long size;
 	int nr_pages;
 
+	/*
+	 * Nothing is put on the event ring of an I/O ring's kioctx. Its
+	 * header is only there for __aio_get_req() to count requests
+	 * against: one page, not mapped into the process.
+	 */
+	if (ctx->ops) {
+		info->ring_pages = info->internal_pages;
+		info->ring_pages[0] = alloc_page(GFP_KERNEL);
+		if (!info->ring_pages[0])
+			return -ENOMEM;
+		info->nr_pages = 1;
+		info->mmap_size = 0;
+		nr_events++;
+		goto init_ring;
+	}
+
 	/* Compensate for the ring buffer's head/tail overlap entry */
 	nr_events += 2;	/* 1 is required, 2 for good luck */
 
@@ -154,6 +174,7 @@ static int aio_setup_ring(struct kioctx *ctx)
 
 	ctx->user_id = info->mmap_base;
 
+init_ring:
 	info->nr = nr_events;		/* trusted copy */
 
 	ring = kmap_atomic(info->ring_pages[0], KM_USER0);
@@ -194,8 +215,10 @@ static int aio_setup_ring(struct kioctx *ctx)
 
 /* ioctx_alloc
  *	Allocates and initializes an ioctx.  Returns an ERR_PTR if it failed.
+ *	ops and private are only set by ioctx_alloc_ring().
  */
-static struct kioctx *ioctx_alloc(unsigned nr_events)
+static struct kioctx *ioctx_alloc(unsigned nr_events,
+				  const struct kioctx_ops *ops, void *private)
 {
 	struct mm_struct *mm;
 	struct kioctx *ctx;
@@ -221,13 +244,16 @@ static struct kioctx *ioctx_alloc(unsigned nr_events)
 
 	atomic_set(&ctx->users, 1);
 	spin_lock_init(&ctx->ctx_lock);
-	spin_lock_init(&ctx->ring_info.ring_lock);
+	mutex_init(&ctx->ring_info.ring_lock);
 	init_waitqueue_head(&ctx->wait);
 
 	INIT_LIST_HEAD(&ctx->active_reqs);
 	INIT_LIST_HEAD(&ctx->run_list);
 	INIT_WORK(&ctx->wq, aio_kick_handler, ctx);
 
+	ctx->ops = ops;
+	ctx->private = private;
+
 	if (aio_setup_ring(ctx) < 0)
 		goto out_freectx;
 
@@ -253,6 +279,7 @@ static struct kioctx *ioctx_alloc(unsigned nr_events)
 	return ctx;
 
 out_cleanup:
+	ctx->ops = NULL;	/* the caller frees private */
 	__put_ioctx(ctx);
 	return ERR_PTR(-EAGAIN);
 
@@ -265,6 +292,24 @@ out_freectx:
 	return ctx;
 }
 
+/* ioctx_alloc_ring
+ *	An ioctx for fs/ioring.c, whose requests complete to ops->complete()
+ *	rather than to an event ring. It is on the mm's list for exit_aio()
+ *	to find, but io_submit() and friends can't look it up. The caller
+ *	gets two references, one for the list, and tears the ioctx down
+ *	with io_destroy(). ops->free() isn't called if this fails.
+ */
+struct kioctx *ioctx_alloc_ring(unsigned nr_events,
+				const struct kioctx_ops *ops, void *private)
+{
+	struct kioctx *ctx;
+
+	ctx = ioctx_alloc(nr_events, ops, private);
+	if (!IS_ERR(ctx))
+		get_ioctx(ctx);
+	return ctx;
+}
+
 /* aio_cancel_all
  *	Cancels all outstanding aio requests on an aio context.  Used 
  *	when the processes owning a context have all exited to encourage 
@@ -334,11 +379,19 @@ ssize_t fastcall wait_on_sync_kiocb(struct kiocb *iocb)
  */
 void fastcall exit_aio(struct mm_struct *mm)
 {
-	struct kioctx *ctx = mm->ioctx_list;
+	struct kioctx *ctx;
+
+	/* an I/O ring's file may outlive the mm, and io_destroy() it */
+	write_lock(&mm->ioctx_list_lock);
+	ctx = mm->ioctx_list;
 	mm->ioctx_list = NULL;
+	write_unlock(&mm->ioctx_list_lock);
+
 	while (ctx) {
 		struct kioctx *next = ctx->next;
 		ctx->next = NULL;
+		if (ctx->ops)
+			ctx->ops->exit(ctx);
 		aio_cancel_all(ctx);
 
 		wait_for_all_aios(ctx);
@@ -348,7 +401,7 @@ void fastcall exit_aio(struct mm_struct *mm)
 		 */
 		flush_workqueue(aio_wq);
 
-		if (1 != atomic_read(&ctx->users))
+		if (1 != atomic_read(&ctx->users) && !ctx->ops)
 			printk(KERN_DEBUG
 				"exit_aio:ioctx still alive: %d %d %d\n",
 				atomic_read(&ctx->users), ctx->dead,
@@ -372,6 +425,8 @@ void fastcall __put_ioctx(struct kioctx *ctx)
 	cancel_delayed_work(&ctx->wq);
 	flush_workqueue(aio_wq);
 	aio_free_ring(ctx);
+	if (ctx->ops)
+		ctx->ops->free(ctx);
 	mmdrop(ctx->mm);
 	ctx->mm = NULL;
 	pr_debug("__put_ioctx: freeing %p\n", ctx);
@@ -414,6 +469,7 @@ static struct kiocb fastcall *__aio_get_req(struct kioctx *ctx)
 	req->ki_retry = NULL;
 	req->ki_dtor = NULL;
 	req->private = NULL;
+	req->ki_iovec = NULL;
 	INIT_LIST_HEAD(&req->ki_run_list);
 
 	/* Check if the completion queue has enough free space to
@@ -459,6 +515,8 @@ static inline void really_put_req(struct kioctx *ctx, struct kiocb *req)
 
 	if (req->ki_dtor)
 		req->ki_dtor(req);
+	if (req->ki_iovec != &req->ki_inline_vec)
+		kfree(req->ki_iovec);
 	kmem_cache_free(kiocb_cachep, req);
 	ctx->reqs_active--;
 
@@ -550,7 +608,8 @@ struct kioctx *lookup_ioctx(unsigned long ctx_id)
 	mm = current->mm;
 	read_lock(&mm->ioctx_list_lock);
 	for (ioctx = mm->ioctx_list; ioctx; ioctx = ioctx->next)
-		if (likely(ioctx->user_id == ctx_id && !ioctx->dead)) {
+		if (likely(ioctx->user_id == ctx_id && !ioctx->dead &&
+			   !ioctx->ops)) {
 			get_ioctx(ioctx);
 			break;
 		}
@@ -569,7 +628,7 @@ struct kioctx *lookup_ioctx(unsigned long ctx_id)
  *	(Note: this routine is intended to be called only
  *	from a kernel thread context)
  */
-static void use_mm(struct mm_struct *mm)
+void use_mm(struct mm_struct *mm)
 {
 	struct mm_struct *active_mm;
 	struct task_struct *tsk = current;
@@ -601,7 +660,7 @@ static void use_mm(struct mm_struct *mm)
  * Comments: Called with ctx->ctx_lock held. This nests
  * task_lock instead ctx_lock.
  */
-static void unuse_mm(struct mm_struct *mm)
+void unuse_mm(struct mm_struct *mm)
 {
 	struct task_struct *tsk = current;
 
@@ -729,12 +788,12 @@ static ssize_t aio_run_iocb(struct kiocb *iocb)
 	 * the aio_wake_function callback).
 	 */
 	BUG_ON(current->io_wait != NULL);
-	current->io_wait = &iocb->ki_wait;
+	current->io_wait = &iocb->ki_wait.wait;
 	ret = retry(iocb);
 	current->io_wait = NULL;
 
 	if (ret != -EIOCBRETRY && ret != -EIOCBQUEUED) {
-		BUG_ON(!list_empty(&iocb->ki_wait.task_list));
+		BUG_ON(!list_empty(&iocb->ki_wait.wait.task_list));
 		aio_complete(iocb, ret, 0);
 	}
 out:
@@ -751,7 +810,13 @@ out:
 		/* will make __queue_kicked_iocb succeed from here on */
 		INIT_LIST_HEAD(&iocb->ki_run_list);
 		/* we must queue the next iteration ourselves, if it
-		 * has already been kicked */
+		 * has already been kicked. A kick left over from an
+		 * earlier wait doesn't count while the iocb is queued on
+		 * a new one: that wait's wakeup will kick it again, and
+		 * the retry must not run while the wait is queued. */
+		if (kiocbIsKicked(iocb) &&
+		    !list_empty_careful(&iocb->ki_wait.wait.task_list))
+			kiocbClearKicked(iocb);
 		if (kiocbIsKicked(iocb)) {
 			__queue_kicked_iocb(iocb);
 
@@ -804,10 +869,13 @@ static void aio_queue_work(struct kioctx * ctx)
 	unsigned long timeout;
 	/*
 	 * if someone is waiting, get the work started right
-	 * away, otherwise, use a longer delay
+	 * away, otherwise, use a longer delay. I/O rings are
+	 * reaped without anyone waiting: never delay those.
 	 */
 	smp_mb();
-	if (waitqueue_active(&ctx->wait))
+	if (ctx->ops)
+		timeout = 0;
+	else if (waitqueue_active(&ctx->wait))
 		timeout = 1;
 	else
 		timeout = HZ/10;
@@ -892,7 +960,7 @@ static void try_queue_kicked_iocb(struct kiocb *iocb)
 	 * than retry has happened before we could queue the iocb.  This also
 	 * means that the retry could have completed and freed our iocb, no
 	 * good. */
-	BUG_ON((!list_empty(&iocb->ki_wait.task_list)));
+	BUG_ON((!list_empty(&iocb->ki_wait.wait.task_list)));
 
 	spin_lock_irqsave(&ctx->ctx_lock, flags);
 	/* set this inside the lock so that we can't race with aio_run_iocb()
@@ -975,6 +1043,11 @@ int fastcall aio_complete(struct kiocb *iocb, long res, long res2)
 	if (kiocbIsCancelled(iocb))
 		goto put_rq;
 
+	if (ctx->ops) {
+		ctx->ops->complete(ctx, iocb, res, res2);
+		goto put_rq;
+	}
+
 	ring = kmap_atomic(info->ring_pages[0], KM_IRQ1);
 
 	tail = info->tail;
@@ -1021,48 +1094,83 @@ put_rq:
 	return ret;
 }
 
-/* aio_read_evt
- *	Pull an event off of the ioctx's event ring.  Returns the number of 
- *	events fetched (0 or 1 ;-)
- *	FIXME: make this use cmpxchg.
- *	TODO: make the ringbuffer user mmap()able (requires FIXME).
+/* aio_read_events_ring
+ *	Pull up to nr events off the ioctx's event ring into the user's
+ *	array, as many at a time as sit together in one page of the ring.
+ *	Returns the number of events copied, or -EFAULT if none could be.
+ *	The ring is mapped into the process too, see Documentation/aio.txt:
+ *	the head is only read from it, the tail is the kernel's own copy.
  */
-static int aio_read_evt(struct kioctx *ioctx, struct io_event *ent)
+static long aio_read_events_ring(struct kioctx *ctx,
+				 struct io_event __user *event, long nr)
 {
-	struct aio_ring_info *info = &ioctx->ring_info;
+	struct aio_ring_info *info = &ctx->ring_info;
 	struct aio_ring *ring;
-	unsigned long head;
-	int ret = 0;
+	struct io_event *ev;
+	struct page *page;
+	unsigned head, tail, pos;
+	long avail, ret = 0;
+
+	mutex_lock(&info->ring_lock);
 
 	ring = kmap_atomic(info->ring_pages[0], KM_USER0);
-	dprintk("in aio_read_evt h%lu t%lu m%lu\n",
-		 (unsigned long)ring->head, (unsigned long)ring->tail,
-		 (unsigned long)ring->nr);
+	head = ring->head % info->nr;
+	kunmap_atomic(ring, KM_USER0);
+	tail = info->tail;
+	smp_rmb();	/* read the tail before the events behind it */
 
-	if (ring->head == ring->tail)
-		goto out;
+	dprintk("in aio_read_events_ring h%u t%u m%u\n", head, tail, info->nr);
 
-	spin_lock(&info->ring_lock);
+	while (ret < nr && head != tail) {
+		avail = (head <= tail ? tail : info->nr) - head;
+		avail = min(avail, nr - ret);
 
-	head = ring->head % info->nr;
-	if (head != ring->tail) {
-		struct io_event *evp = aio_ring_event(info, head, KM_USER1);
-		*ent = *evp;
-		head = (head + 1) % info->nr;
-		smp_mb(); /* finish reading the event before updatng the head */
+		pos = head + AIO_EVENTS_OFFSET;
+		page = info->ring_pages[pos / AIO_EVENTS_PER_PAGE];
+		pos %= AIO_EVENTS_PER_PAGE;
+		avail = min_t(long, avail, AIO_EVENTS_PER_PAGE - pos);
+
+		ev = kmap(page);
+		if (unlikely(copy_to_user(event + ret, ev + pos,
+					  sizeof(*ev) * avail))) {
+			kunmap(page);
+			dprintk("aio: lost an event due to EFAULT.\n");
+			if (!ret)
+				ret = -EFAULT;
+			break;
+		}
+		kunmap(page);
+
+		ret += avail;
+		head = (head + avail) % info->nr;
+	}
+
+	if (ret > 0) {
+		smp_mb(); /* finish reading the events before updating the head */
+		ring = kmap_atomic(info->ring_pages[0], KM_USER0);
 		ring->head = head;
-		ret = 1;
-		put_aio_ring_event(evp, KM_USER1);
+		kunmap_atomic(ring, KM_USER0);
 	}
-	spin_unlock(&info->ring_lock);
 
-out:
-	kunmap_atomic(ring, KM_USER0);
-	dprintk("leaving aio_read_evt: %d  h%lu t%lu\n", ret,
-		 (unsigned long)ring->head, (unsigned long)ring->tail);
+	mutex_unlock(&info->ring_lock);
 	return ret;
 }
 
+/*
+ * Racy check whether there are events to read, for the wait loop
+ */
+static int aio_events_available(struct kioctx *ctx)
+{
+	struct aio_ring_info *info = &ctx->ring_info;
+	struct aio_ring *ring;
+	unsigned head;
+
+	ring = kmap_atomic(info->ring_pages[0], KM_USER0);
+	head = ring->head % info->nr;
+	kunmap_atomic(ring, KM_USER0);
+	return head != info->tail;
+}
+
 struct aio_timeout {
 	struct timer_list	timer;
 	int			timed_out;
@@ -1101,7 +1209,7 @@ static inline void clear_timeout(struct aio_timeout *to)
 	del_singleshot_timer_sync(&to->timer);
 }
 
-static int read_events(struct kioctx *ctx,
+static long read_events(struct kioctx *ctx,
 			long min_nr, long nr,
 			struct io_event __user *event,
 			struct timespec __user *timeout)
@@ -1109,43 +1217,18 @@ static int read_events(struct kioctx *ctx,
 	long			start_jiffies = jiffies;
 	struct task_struct	*tsk = current;
 	DECLARE_WAITQUEUE(wait, tsk);
-	int			ret;
-	int			i = 0;
-	struct io_event		ent;
+	long			ret;
+	long			i = 0;
 	struct aio_timeout	to;
 	int			retry = 0;
 
-	/* needed to zero any padding within an entry (there shouldn't be 
-	 * any, but C is fun!
-	 */
-	memset(&ent, 0, sizeof(ent));
 retry:
-	ret = 0;
-	while (likely(i < nr)) {
-		ret = aio_read_evt(ctx, &ent);
-		if (unlikely(ret <= 0))
-			break;
-
-		dprintk("read event: %Lx %Lx %Lx %Lx\n",
-			ent.data, ent.obj, ent.res, ent.res2);
-
-		/* Could we split the check in two? */
-		ret = -EFAULT;
-		if (unlikely(copy_to_user(event, &ent, sizeof(ent)))) {
-			dprintk("aio: lost an event due to EFAULT.\n");
-			break;
-		}
-		ret = 0;
-
-		/* Good, event copied to userland, update counts. */
-		event ++;
-		i ++;
-	}
-
+	ret = aio_read_events_ring(ctx, event + i, nr - i);
+	if (unlikely(ret < 0))
+		return i ? i : ret;
+	i += ret;
 	if (min_nr <= i)
 		return i;
-	if (ret)
-		return ret;
 
 	/* End fast path */
 
@@ -1166,41 +1249,35 @@ retry:
 		set_timeout(start_jiffies, &to, &ts);
 	}
 
-	while (likely(i < nr)) {
+	while (likely(i < min_nr)) {
 		add_wait_queue_exclusive(&ctx->wait, &wait);
 		do {
 			set_task_state(tsk, TASK_INTERRUPTIBLE);
-			ret = aio_read_evt(ctx, &ent);
-			if (ret)
-				break;
-			if (min_nr <= i)
-				break;
 			ret = 0;
-			if (to.timed_out)	/* Only check after read evt */
+			if (aio_events_available(ctx))
+				break;
+			if (to.timed_out)
 				break;
 			schedule();
 			if (signal_pending(tsk)) {
 				ret = -EINTR;
 				break;
 			}
-			/*ret = aio_read_evt(ctx, &ent);*/
 		} while (1) ;
 
 		set_task_state(tsk, TASK_RUNNING);
 		remove_wait_queue(&ctx->wait, &wait);
 
-		if (unlikely(ret <= 0))
+		if (unlikely(ret))
 			break;
 
-		ret = -EFAULT;
-		if (unlikely(copy_to_user(event, &ent, sizeof(ent)))) {
-			dprintk("aio: lost an event due to EFAULT.\n");
+		/* take everything there is, up to nr, in one go */
+		ret = aio_read_events_ring(ctx, event + i, nr - i);
+		if (unlikely(ret < 0))
+			break;
+		i += ret;
+		if (!ret && to.timed_out)
 			break;
-		}
-
-		/* Good, event copied to userland, update counts. */
-		event ++;
-		i ++;
 	}
 
 	if (timeout)
@@ -1209,28 +1286,30 @@ out:
 	return i ? i : ret;
 }
 
-/* Take an ioctx and remove it from the list of ioctx's.  Protects 
- * against races with itself via ->dead.
+/* Take an ioctx and remove it from the list of ioctx's.  Only whoever
+ * finds it on the list drops the list's reference: io_destroy() racing
+ * with itself, or with exit_aio() for an I/O ring's ioctx.
  */
-static void io_destroy(struct kioctx *ioctx)
+void io_destroy(struct kioctx *ioctx)
 {
-	struct mm_struct *mm = current->mm;
+	struct mm_struct *mm = ioctx->mm;
 	struct kioctx **tmp;
-	int was_dead;
+	int was_listed = 0;
 
 	/* delete the entry from the list is someone else hasn't already */
 	write_lock(&mm->ioctx_list_lock);
-	was_dead = ioctx->dead;
 	ioctx->dead = 1;
 	for (tmp = &mm->ioctx_list; *tmp && *tmp != ioctx;
 	     tmp = &(*tmp)->next)
 		;
-	if (*tmp)
+	if (*tmp) {
 		*tmp = ioctx->next;
+		was_listed = 1;
+	}
 	write_unlock(&mm->ioctx_list_lock);
 
 	dprintk("aio_release(%p)\n", ioctx);
-	if (likely(!was_dead))
+	if (likely(was_listed))
 		put_ioctx(ioctx);	/* twice for the list */
 
 	aio_cancel_all(ioctx);
@@ -1268,7 +1347,7 @@ asmlinkage long sys_io_setup(unsigned nr_events, aio_context_t __user *ctxp)
 		goto out;
 	}
 
-	ioctx = ioctx_alloc(nr_events);
+	ioctx = ioctx_alloc(nr_events, NULL, NULL);
 	ret = PTR_ERR(ioctx);
 	if (!IS_ERR(ioctx)) {
 		ret = put_user(ioctx->user_id, ctxp);
@@ -1363,6 +1442,165 @@ static ssize_t aio_pwrite(struct kiocb *iocb)
 	return ret;
 }
 
+/*
+ * Skip the part of a vectored request done by the last call
+ */
+static void aio_advance_iovec(struct kiocb *iocb, ssize_t ret)
+{
+	struct iovec *iov = &iocb->ki_iovec[iocb->ki_cur_seg];
+	size_t this;
+
+	iocb->ki_left -= ret;
+	while (ret > 0) {
+		BUG_ON(iocb->ki_cur_seg >= iocb->ki_nr_segs);
+		this = min_t(size_t, iov->iov_len, ret);
+		iov->iov_base += this;
+		iov->iov_len -= this;
+		ret -= this;
+		if (!iov->iov_len) {
+			iocb->ki_cur_seg++;
+			iov++;
+		}
+	}
+}
+
+/*
+ * The ki_retry method for IOCB_CMD_PREADV and IOCB_CMD_PWRITEV. Files
+ * using the generic page cache methods get the whole vector in one go,
+ * which is what makes O_DIRECT work, others one segment at a time.
+ */
+static ssize_t aio_rw_vect_retry(struct kiocb *iocb)
+{
+	struct file *file = iocb->ki_filp;
+	struct inode *inode = file->f_mapping->host;
+	int rw = iocb->ki_opcode == IOCB_CMD_PWRITEV ? WRITE : READ;
+	struct iovec *iov;
+	unsigned long nr_segs;
+	ssize_t ret = 0;
+
+	if (!iocb->ki_left)
+		return 0;
+
+	do {
+		iov = &iocb->ki_iovec[iocb->ki_cur_seg];
+		nr_segs = iocb->ki_nr_segs - iocb->ki_cur_seg;
+
+		if (rw == READ && file->f_op->aio_read == generic_file_aio_read)
+			ret = __generic_file_aio_read(iocb, iov, nr_segs,
+						      &iocb->ki_pos);
+		else if (rw == READ)
+			ret = file->f_op->aio_read(iocb, iov->iov_base,
+						   iov->iov_len, iocb->ki_pos);
+		else if (file->f_op->aio_write == generic_file_aio_write)
+			ret = generic_file_aio_writev(iocb, iov, nr_segs,
+						      &iocb->ki_pos);
+		else
+			ret = file->f_op->aio_write(iocb, iov->iov_base,
+						    iov->iov_len, iocb->ki_pos);
+		if (ret > 0)
+			aio_advance_iovec(iocb, ret);
+
+		/* as in aio_pread(), pipes and sockets return what they got */
+	} while (ret > 0 && iocb->ki_left > 0 && (rw == WRITE ||
+		 (!S_ISFIFO(inode->i_mode) && !S_ISSOCK(inode->i_mode))));
+
+	if ((ret == 0) || (iocb->ki_left == 0))
+		ret = iocb->ki_nbytes - iocb->ki_left;
+
+	return ret;
+}
+
+/*
+ * Copy in and check the iovec array of a vectored request. Empty
+ * segments are dropped, so that every segment left makes progress.
+ */
+static ssize_t aio_setup_vectored_rw(int type, struct kiocb *kiocb)
+{
+	struct file *file = kiocb->ki_filp;
+	unsigned long nr_segs = kiocb->ki_nbytes;
+	unsigned long seg, nr = 0;
+	struct iovec *iov;
+	size_t len = 0;
+	int generic;
+
+	if (type == VERIFY_WRITE)
+		generic = file->f_op->aio_read == generic_file_aio_read;
+	else
+		generic = file->f_op->aio_write == generic_file_aio_write;
+	/*
+	 * an O_DIRECT segment queued through a single buffer method
+	 * would complete the whole iocb
+	 */
+	if ((file->f_flags & O_DIRECT) && !generic)
+		return -EINVAL;
+
+	if (nr_segs == 0 || nr_segs > UIO_MAXIOV)
+		return -EINVAL;
+	if (nr_segs == 1)
+		iov = &kiocb->ki_inline_vec;
+	else {
+		iov = kmalloc(nr_segs * sizeof(*iov), GFP_KERNEL);
+		if (!iov)
+			return -ENOMEM;
+	}
+	kiocb->ki_iovec = iov;		/* freed with the kiocb */
+
+	if (copy_from_user(iov, kiocb->ki_buf, nr_segs * sizeof(*iov)))
+		return -EFAULT;
+
+	for (seg = 0; seg < nr_segs; seg++) {
+		ssize_t seg_len = iov[seg].iov_len;
+
+		if (seg_len < 0 || (ssize_t)(len + seg_len) < 0)
+			return -EINVAL;
+		if (unlikely(!access_ok(type, iov[seg].iov_base, seg_len)))
+			return -EFAULT;
+		if (!seg_len)
+			continue;
+		iov[nr++] = iov[seg];
+		len += seg_len;
+	}
+
+	kiocb->ki_nr_segs = nr;
+	kiocb->ki_cur_seg = 0;
+	kiocb->ki_nbytes = kiocb->ki_left = len;
+	return 0;
+}
+
+/*
+ * For files without an aio_fsync method, fsync is run by a worker
+ * thread and the iocb completed from there.
+ */
+struct aio_fsync_work {
+	struct work_struct	work;
+	struct kiocb		*iocb;
+	int			datasync;
+};
+
+static void aio_fsync_work(void *data)
+{
+	struct aio_fsync_work *fw = data;
+	long ret;
+
+	ret = do_fsync(fw->iocb->ki_filp, fw->datasync);
+	aio_complete(fw->iocb, ret, 0);
+	kfree(fw);
+}
+
+static ssize_t aio_queue_fsync(struct kiocb *iocb, int datasync)
+{
+	struct aio_fsync_work *fw;
+
+	fw = kmalloc(sizeof(*fw), GFP_KERNEL);
+	if (!fw)
+		return -ENOMEM;
+	INIT_WORK(&fw->work, aio_fsync_work, fw);
+	fw->iocb = iocb;
+	fw->datasync = datasync;
+	queue_work(aio_fsync_wq, &fw->work);
+	return -EIOCBQUEUED;
+}
+
 static ssize_t aio_fdsync(struct kiocb *iocb)
 {
 	struct file *file = iocb->ki_filp;
@@ -1370,6 +1608,8 @@ static ssize_t aio_fdsync(struct kiocb *iocb)
 
 	if (file->f_op->aio_fsync)
 		ret = file->f_op->aio_fsync(iocb, 1);
+	else if (file->f_op->fsync)
+		ret = aio_queue_fsync(iocb, 1);
 	return ret;
 }
 
@@ -1380,6 +1620,8 @@ static ssize_t aio_fsync(struct kiocb *iocb)
 
 	if (file->f_op->aio_fsync)
 		ret = file->f_op->aio_fsync(iocb, 0);
+	else if (file->f_op->fsync)
+		ret = aio_queue_fsync(iocb, 0);
 	return ret;
 }
 
@@ -1388,7 +1630,7 @@ static ssize_t aio_fsync(struct kiocb *iocb)
  *	Performs the initial checks and aio retry method
  *	setup for the kiocb at the time of io submission.
  */
-static ssize_t aio_setup_iocb(struct kiocb *kiocb)
+static ssize_t aio_setup_iocb(struct kiocb *kiocb, int compat)
 {
 	struct file *file = kiocb->ki_filp;
 	ssize_t ret = 0;
@@ -1424,16 +1666,58 @@ static ssize_t aio_setup_iocb(struct kiocb *kiocb)
 		if (file->f_op->aio_write)
 			kiocb->ki_retry = aio_pwrite;
 		break;
+	case IOCB_CMD_PREADV:
+		ret = -EBADF;
+		if (unlikely(!(file->f_mode & FMODE_READ)))
+			break;
+		ret = security_file_permission(file, MAY_READ);
+		if (unlikely(ret))
+			break;
+		ret = -EINVAL;
+		if (!file->f_op->aio_read)
+			break;
+		ret = aio_setup_vectored_rw(VERIFY_WRITE, kiocb);
+		if (!ret)
+			kiocb->ki_retry = aio_rw_vect_retry;
+		break;
+	case IOCB_CMD_PWRITEV:
+		ret = -EBADF;
+		if (unlikely(!(file->f_mode & FMODE_WRITE)))
+			break;
+		ret = security_file_permission(file, MAY_WRITE);
+		if (unlikely(ret))
+			break;
+		ret = -EINVAL;
+		if (!file->f_op->aio_write)
+			break;
+		ret = aio_setup_vectored_rw(VERIFY_READ, kiocb);
+		if (!ret)
+			kiocb->ki_retry = aio_rw_vect_retry;
+		break;
 	case IOCB_CMD_FDSYNC:
 		ret = -EINVAL;
-		if (file->f_op->aio_fsync)
+		if (file->f_op->aio_fsync || file->f_op->fsync)
 			kiocb->ki_retry = aio_fdsync;
 		break;
 	case IOCB_CMD_FSYNC:
 		ret = -EINVAL;
-		if (file->f_op->aio_fsync)
+		if (file->f_op->aio_fsync || file->f_op->fsync)
 			kiocb->ki_retry = aio_fsync;
 		break;
+#ifdef CONFIG_NET
+	case IOCB_CMD_SENDMSG:
+	case IOCB_CMD_RECVMSG:
+		ret = -ENOTSOCK;
+		if (!S_ISSOCK(file->f_dentry->d_inode->i_mode))
+			break;
+		/* the msghdr is in the layout of the submitter */
+		kiocb->ki_nbytes &= ~MSG_CMSG_COMPAT;
+		if (compat)
+			kiocb->ki_nbytes |= MSG_CMSG_COMPAT;
+		kiocb->ki_retry = sock_aio_msg_retry;
+		kiocb->ki_cancel = sock_aio_msg_cancel;
+		break;
+#endif
 	default:
 		dprintk("EINVAL: io_submit: no operation provided\n");
 		ret = -EINVAL;
@@ -1464,9 +1748,20 @@ static ssize_t aio_setup_iocb(struct kiocb *kiocb)
  * are nested inside ioctx lock (i.e. ctx->wait)
  */
 static int aio_wake_function(wait_queue_t *wait, unsigned mode,
-			     int sync, void *key)
+			     int sync, void *arg)
 {
-	struct kiocb *iocb = container_of(wait, struct kiocb, ki_wait);
+	struct kiocb *iocb = container_of(wait, struct kiocb, ki_wait.wait);
+	struct wait_bit_key *key = arg;
+
+	/*
+	 * Bit waits share hashed wait queues: as wake_bit_function(),
+	 * only take the wakeup for the bit we wait for, once it's clear.
+	 */
+	if (key && iocb->ki_wait.key.flags &&
+	    (iocb->ki_wait.key.flags != key->flags ||
+	     iocb->ki_wait.key.bit_nr != key->bit_nr ||
+	     test_bit(key->bit_nr, key->flags)))
+		return 0;
 
 	list_del_init(&wait->task_list);
 	kick_iocb(iocb);
@@ -1474,7 +1769,7 @@ static int aio_wake_function(wait_queue_t *wait, unsigned mode,
 }
 
 int fastcall io_submit_one(struct kioctx *ctx, struct iocb __user *user_iocb,
-			 struct iocb *iocb)
+			 struct iocb *iocb, int compat)
 {
 	struct kiocb *req;
 	struct file *file;
@@ -1508,10 +1803,13 @@ int fastcall io_submit_one(struct kioctx *ctx, struct iocb __user *user_iocb,
 	}
 
 	req->ki_filp = file;
-	ret = put_user(req->ki_key, &user_iocb->aio_key);
-	if (unlikely(ret)) {
-		dprintk("EFAULT: aio_key\n");
-		goto out_put_req;
+	/* I/O rings have no user iocb, see fs/ioring.c */
+	if (user_iocb) {
+		ret = put_user(req->ki_key, &user_iocb->aio_key);
+		if (unlikely(ret)) {
+			dprintk("EFAULT: aio_key\n");
+			goto out_put_req;
+		}
 	}
 
 	req->ki_obj.user = user_iocb;
@@ -1521,11 +1819,12 @@ int fastcall io_submit_one(struct kioctx *ctx, struct iocb __user *user_iocb,
 	req->ki_buf = (char __user *)(unsigned long)iocb->aio_buf;
 	req->ki_left = req->ki_nbytes = iocb->aio_nbytes;
 	req->ki_opcode = iocb->aio_lio_opcode;
-	init_waitqueue_func_entry(&req->ki_wait, aio_wake_function);
-	INIT_LIST_HEAD(&req->ki_wait.task_list);
+	init_waitqueue_func_entry(&req->ki_wait.wait, aio_wake_function);
+	INIT_LIST_HEAD(&req->ki_wait.wait.task_list);
+	req->ki_wait.key.flags = NULL;
 	req->ki_retried = 0;
 
-	ret = aio_setup_iocb(req);
+	ret = aio_setup_iocb(req, compat);
 
 	if (ret)
 		goto out_put_req;
@@ -1559,8 +1858,8 @@ out_put_req:
  *	are available to queue any iocbs.  Will return 0 if nr is 0.  Will
  *	fail with -ENOSYS if not implemented.
  */
-asmlinkage long sys_io_submit(aio_context_t ctx_id, long nr,
-			      struct iocb __user * __user *iocbpp)
+long do_io_submit(aio_context_t ctx_id, long nr,
+		  struct iocb __user * __user *iocbpp, int compat)
 {
 	struct kioctx *ctx;
 	long ret = 0;
@@ -1596,7 +1895,7 @@ asmlinkage long sys_io_submit(aio_context_t ctx_id, long nr,
 			break;
 		}
 
-		ret = io_submit_one(ctx, user_iocb, &tmp);
+		ret = io_submit_one(ctx, user_iocb, &tmp, compat);
 		if (ret)
 			break;
 	}
@@ -1605,6 +1904,12 @@ asmlinkage long sys_io_submit(aio_context_t ctx_id, long nr,
 	return i ? i : ret;
 }
 
+asmlinkage long sys_io_submit(aio_context_t ctx_id, long nr,
+			      struct iocb __user * __user *iocbpp)
+{
+	return do_io_submit(ctx_id, nr, iocbpp, 0);
+}
+
 /* lookup_kiocb
  *	Finds a given iocb for cancellation.
  */
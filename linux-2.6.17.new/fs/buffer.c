@@ -2856,8 +2856,10 @@ int submit_bh(int rw, struct buffer_head * bh)
  */
 void ll_rw_block(int rw, int nr, struct buffer_head *bhs[])
 {
+	struct blk_plug plug;
 	int i;
 
+	blk_start_plug(&plug);
 	for (i = 0; i < nr; i++) {
 		struct buffer_head *bh = bhs[i];
 
@@ -2883,6 +2885,7 @@ void ll_rw_block(int rw, int nr, struct buffer_head *bhs[])
 		}
 		unlock_buffer(bh);
 	}
+	blk_finish_plug(&plug);
 }
 
 /*
@@ -125,6 +125,7 @@ struct dio {
 	int bios_in_flight;		/* nr bios in flight */
 	struct bio *bio_list;		/* singly linked via bi_private */
 	struct task_struct *waiter;	/* waiting task (NULL if none) */
+	request_queue_t *poll_queue;	/* to poll for completions, or NULL */
 
 	/* AIO related stuff */
 	struct kiocb *iocb;		/* kiocb */
@@ -359,6 +360,12 @@ static void dio_bio_submit(struct dio *dio)
 	spin_unlock_irqrestore(&dio->bio_lock, flags);
 	if (dio->is_async && dio->rw == READ)
 		bio_set_pages_dirty(bio);
+	else if (!dio->is_async && !dio->poll_queue) {
+		request_queue_t *q = bdev_get_queue(bio->bi_bdev);
+
+		if (q && blk_queue_polled(q))
+			dio->poll_queue = q;
+	}
 	submit_bio(dio->rw, bio);
 
 	dio->bio = NULL;
@@ -377,10 +384,30 @@ static void dio_cleanup(struct dio *dio)
 /*
  * Wait for the next BIO to complete.  Remove it and return it.
  */
+static int dio_bio_done(void *data)
+{
+	struct dio *dio = data;
+
+	return dio->bio_list != NULL;
+}
+
 static struct bio *dio_await_one(struct dio *dio)
 {
+	unsigned long long start;
 	unsigned long flags;
 	struct bio *bio;
+	int slept = 0;
+
+	/*
+	 * On a queue with polling switched on, spin for the completion for
+	 * a while first: for a fast enough device that is quicker than the
+	 * interrupt and the wakeup.
+	 */
+	if (dio->poll_queue && dio->bio_list == NULL) {
+		blk_run_address_space(dio->inode->i_mapping);
+		if (!blk_poll(dio->poll_queue, dio_bio_done, dio, &start))
+			slept = 1;
+	}
 
 	spin_lock_irqsave(&dio->bio_lock, flags);
 	while (dio->bio_list == NULL) {
@@ -398,6 +425,9 @@ static struct bio *dio_await_one(struct dio *dio)
 	bio = dio->bio_list;
 	dio->bio_list = bio->bi_private;
 	spin_unlock_irqrestore(&dio->bio_lock, flags);
+
+	if (slept)
+		blk_poll_slept(dio->poll_queue, start);
 	return bio;
 }
 
@@ -956,6 +986,7 @@ direct_io_worker(int rw, struct kiocb *iocb, struct inode *inode,
 	ssize_t ret = 0;
 	ssize_t ret2;
 	size_t bytes;
+	struct blk_plug plug;
 
 	dio->bio = NULL;
 	dio->inode = inode;
@@ -995,6 +1026,7 @@ direct_io_worker(int rw, struct kiocb *iocb, struct inode *inode,
 	spin_lock_init(&dio->bio_lock);
 	dio->bio_list = NULL;
 	dio->waiter = NULL;
+	dio->poll_queue = NULL;
 
 	/*
 	 * In case of non-aligned buffers, we may need 2 more
@@ -1012,6 +1044,8 @@ direct_io_worker(int rw, struct kiocb *iocb, struct inode *inode,
 				- user_addr/PAGE_SIZE);
 	}
 
+	blk_start_plug(&plug);
+
 	for (seg = 0; seg < nr_segs; seg++) {
 		user_addr = (unsigned long)iov[seg].iov_base;
 		dio->size += bytes = iov[seg].iov_len;
@@ -1068,6 +1102,8 @@ direct_io_worker(int rw, struct kiocb *iocb, struct inode *inode,
 	if (dio->bio)
 		dio_bio_submit(dio);
 
+	blk_finish_plug(&plug);
+
 	/*
 	 * It is possible that, we return short IO due to end of file.
 	 * In that case, we need to release all the pages we got hold on.
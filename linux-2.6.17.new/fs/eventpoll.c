@@ -35,6 +35,8 @@
 #include <linux/mount.h>
 #include <linux/bitops.h>
 #include <linux/mutex.h>
+#include <linux/percpu.h>
+#include <linux/seq_file.h>
 #include <asm/uaccess.h>
 #include <asm/system.h>
 #include <asm/io.h>
@@ -73,6 +75,11 @@
  * Events that require holding "epmutex" are very rare, while for
  * normal operations the epoll private "ep->sem" will guarantee
  * a greater scalability.
+ * The poll callback only read-holds "ep->lock", so that events coming
+ * in on several CPUs do not serialize on it: each CPU queues the items
+ * it finds ready on a ready list of its own and marks the CPU in
+ * "ep->rdlmask", and whoever write-holds "ep->lock" moves the items on
+ * the lists of the marked CPUs to "ep->rdllist" ( ep_merge_ready() ).
  */
 
 
@@ -97,7 +104,7 @@
 #endif /* #if DEBUG_EPI != 0 */
 
 /* Epoll private bits inside the event mask */
-#define EP_PRIVATE_BITS (EPOLLONESHOT | EPOLLET)
+#define EP_PRIVATE_BITS (EPOLLONESHOT | EPOLLET | EPOLLEXCLUSIVE)
 
 /* Maximum number of poll wake up nests we are allowing */
 #define EP_MAX_POLLWAKE_NESTS 4
@@ -105,6 +112,12 @@
 /* Maximum msec timeout value storeable in a long int */
 #define EP_MAX_MSTIMEO min(1000ULL * MAX_SCHEDULE_TIMEOUT / HZ, (LONG_MAX - 999ULL) / HZ)
 
+/* Number of events ep_send_events() copies to user space at once */
+#define EP_SEND_BATCH 16
+
+/* Bits inside the "flags" member of the "struct epitem" */
+#define EPI_READY 0	/* "rdllink" is linked to a ready list */
+
 
 struct epoll_filefd {
 	struct file *file;
@@ -159,6 +172,12 @@ struct eventpoll {
 	/* List of ready file descriptors */
 	struct list_head rdllist;
 
+	/* Per CPU lists the poll callback queues ready items on */
+	struct list_head *cpu_rdllists;
+
+	/* CPUs whose list in "cpu_rdllists" may be non-empty */
+	cpumask_t rdlmask;
+
 	/* RB-Tree root used to store monitored fd structs */
 	struct rb_root rbr;
 };
@@ -189,9 +208,15 @@ struct epitem {
 	/* RB-Tree node used to link this structure to the eventpoll rb-tree */
 	struct rb_node rbn;
 
-	/* List header used to link this structure to the eventpoll ready list */
+	/*
+	 * List header used to link this structure to the eventpoll ready list,
+	 * or to one of the per CPU ones.
+	 */
 	struct list_head rdllink;
 
+	/* EPI_READY, set while "rdllink" is linked */
+	unsigned long flags;
+
 	/* The file descriptor information this item refers to */
 	struct epoll_filefd ffd;
 
@@ -232,6 +257,24 @@ struct ep_pqueue {
 	struct epitem *epi;
 };
 
+#ifdef CONFIG_EPOLL_STATS
+/*
+ * Wake up statistics, reported in /proc/epoll_stat. Updated with either
+ * preemption or interrupts disabled.
+ */
+struct ep_stat {
+	unsigned long callbacks;	/* poll callbacks on enabled items */
+	unsigned long queued;		/* ... that made the item ready */
+	unsigned long wake_all;		/* wake ups of all the waiters */
+	unsigned long wake_one;		/* ... of one of them (EPOLLEXCLUSIVE) */
+	unsigned long sleeps;		/* epoll_wait() going to sleep */
+	unsigned long wakeups;		/* ... and being woken up */
+	unsigned long spurious;		/* ... to find nothing to return */
+	unsigned long events;		/* events returned */
+	unsigned long copies;		/* batches they were copied in */
+};
+#endif
+
 
 
 static void ep_poll_safewake_init(struct poll_safewake *psw);
@@ -286,6 +329,22 @@ static kmem_cache_t *epi_cache __read_mostly;
 /* Slab cache used to allocate "struct eppoll_entry" */
 static kmem_cache_t *pwq_cache __read_mostly;
 
+#ifdef CONFIG_EPOLL_STATS
+static DEFINE_PER_CPU(struct ep_stat, ep_stats);
+
+#define ep_stat_add(field, n)						\
+	do {								\
+		get_cpu_var(ep_stats).field += (n);			\
+		put_cpu_var(ep_stats);					\
+	} while (0)
+/* Interrupts are disabled */
+#define __ep_stat_inc(field)	(__get_cpu_var(ep_stats).field++)
+#else
+#define ep_stat_add(field, n)	do { } while (0)
+#define __ep_stat_inc(field)	do { } while (0)
+#endif
+#define ep_stat_inc(field)	ep_stat_add(field, 1)
+
 /* Virtual fs used to allocate inodes for eventpoll files */
 static struct vfsmount *eventpoll_mnt __read_mostly;
 
@@ -388,6 +447,72 @@ static inline int ep_op_hash_event(int op)
 	return op != EPOLL_CTL_DEL;
 }
 
+/*
+ * Links the item to the ready list. Must be called with write lock on
+ * "ep->lock", and the item not already linked.
+ */
+static inline void ep_rdllist_add(struct eventpoll *ep, struct epitem *epi)
+{
+	set_bit(EPI_READY, &epi->flags);
+	list_add_tail(&epi->rdllink, &ep->rdllist);
+}
+
+/*
+ * Unlinks the item from the ready list it is on, the main one or a per CPU
+ * one. Must be called with write lock on "ep->lock".
+ */
+static inline void ep_rdllist_del(struct epitem *epi)
+{
+	ep_list_del(&epi->rdllink);
+	clear_bit(EPI_READY, &epi->flags);
+}
+
+/*
+ * Moves the items the poll callback queued on the per CPU ready lists to
+ * the tail of "ep->rdllist". Must be called with write lock on "ep->lock".
+ */
+static void ep_merge_ready(struct eventpoll *ep)
+{
+	int cpu;
+	struct list_head *lsthead;
+
+	for_each_cpu_mask(cpu, ep->rdlmask) {
+		lsthead = per_cpu_ptr(ep->cpu_rdllists, cpu);
+		if (!list_empty(lsthead))
+			list_splice_init(lsthead, ep->rdllist.prev);
+	}
+	cpus_clear(ep->rdlmask);
+}
+
+/* Tells if any item is ready. Must be called with "ep->lock" held */
+static int ep_ready_avail(struct eventpoll *ep)
+{
+	int cpu;
+
+	if (!list_empty(&ep->rdllist))
+		return 1;
+	for_each_cpu_mask(cpu, ep->rdlmask)
+		if (!list_empty(per_cpu_ptr(ep->cpu_rdllists, cpu)))
+			return 1;
+	return 0;
+}
+
+/*
+ * Wakes up the tasks waiting inside epoll_wait(): only one of them for
+ * an EPOLLEXCLUSIVE item, all of them otherwise. They wait exclusive, see
+ * ep_poll(). Must be called with "ep->lock" held.
+ */
+static inline void ep_wake_waiters(struct eventpoll *ep, int exclusive)
+{
+	if (exclusive) {
+		wake_up(&ep->wq);
+		ep_stat_inc(wake_one);
+	} else {
+		wake_up_all(&ep->wq);
+		ep_stat_inc(wake_all);
+	}
+}
+
 /* Initialize the poll safe wake up structure */
 static void ep_poll_safewake_init(struct poll_safewake *psw)
 {
@@ -776,16 +901,26 @@ eexit_1:
 
 static int ep_alloc(struct eventpoll **pep)
 {
+	int cpu;
 	struct eventpoll *ep = kzalloc(sizeof(*ep), GFP_KERNEL);
 
 	if (!ep)
 		return -ENOMEM;
 
+	ep->cpu_rdllists = alloc_percpu(struct list_head);
+	if (!ep->cpu_rdllists) {
+		kfree(ep);
+		return -ENOMEM;
+	}
+	for_each_possible_cpu(cpu)
+		INIT_LIST_HEAD(per_cpu_ptr(ep->cpu_rdllists, cpu));
+
 	rwlock_init(&ep->lock);
 	init_rwsem(&ep->sem);
 	init_waitqueue_head(&ep->wq);
 	init_waitqueue_head(&ep->poll_wait);
 	INIT_LIST_HEAD(&ep->rdllist);
+	cpus_clear(ep->rdlmask);
 	ep->rbr = RB_ROOT;
 
 	*pep = ep;
@@ -836,6 +971,8 @@ static void ep_free(struct eventpoll *ep)
 	}
 
 	mutex_unlock(&epmutex);
+
+	free_percpu(ep->cpu_rdllists);
 }
 
 
@@ -967,6 +1104,7 @@ static int ep_insert(struct eventpoll *ep, struct epoll_event *event,
 	epi->event = *event;
 	atomic_set(&epi->usecnt, 1);
 	epi->nwait = 0;
+	epi->flags = 0;
 
 	/* Initialize the poll table using the queue callback */
 	epq.epi = epi;
@@ -1000,11 +1138,11 @@ static int ep_insert(struct eventpoll *ep, struct epoll_event *event,
 
 	/* If the file is already "ready" we drop it inside the ready list */
 	if ((revents & event->events) && !ep_is_linked(&epi->rdllink)) {
-		list_add_tail(&epi->rdllink, &ep->rdllist);
+		ep_rdllist_add(ep, epi);
 
 		/* Notify waiting tasks that events are available */
 		if (waitqueue_active(&ep->wq))
-			wake_up(&ep->wq);
+			ep_wake_waiters(ep, event->events & EPOLLEXCLUSIVE);
 		if (waitqueue_active(&ep->poll_wait))
 			pwake++;
 	}
@@ -1029,7 +1167,7 @@ eexit_2:
 	 */
 	write_lock_irqsave(&ep->lock, flags);
 	if (ep_is_linked(&epi->rdllink))
-		ep_list_del(&epi->rdllink);
+		ep_rdllist_del(epi);
 	write_unlock_irqrestore(&ep->lock, flags);
 
 	kmem_cache_free(epi_cache, epi);
@@ -1079,11 +1217,12 @@ static int ep_modify(struct eventpoll *ep, struct epitem *epi, struct epoll_even
 		 */
 		if (revents & event->events) {
 			if (!ep_is_linked(&epi->rdllink)) {
-				list_add_tail(&epi->rdllink, &ep->rdllist);
+				ep_rdllist_add(ep, epi);
 
 				/* Notify waiting tasks that events are available */
 				if (waitqueue_active(&ep->wq))
-					wake_up(&ep->wq);
+					ep_wake_waiters(ep, event->events &
+							EPOLLEXCLUSIVE);
 				if (waitqueue_active(&ep->poll_wait))
 					pwake++;
 			}
@@ -1161,7 +1300,7 @@ static int ep_unlink(struct eventpoll *ep, struct epitem *epi)
 	 * we want to remove it from this list to avoid stale events.
 	 */
 	if (ep_is_linked(&epi->rdllink))
-		ep_list_del(&epi->rdllink);
+		ep_rdllist_del(epi);
 
 	error = 0;
 eexit_1:
@@ -1237,7 +1376,14 @@ static int ep_poll_callback(wait_queue_t *wait, unsigned mode, int sync, void *k
 	DNPRINTK(3, (KERN_INFO "[%p] eventpoll: poll_callback(%p) epi=%p ep=%p\n",
 		     current, epi->file, epi, ep));
 
-	write_lock_irqsave(&ep->lock, flags);
+	/*
+	 * Callbacks on different CPUs only read-hold "ep->lock" and each
+	 * queue on their CPU's ready list, which nothing else touches without
+	 * write-holding "ep->lock". The EPI_READY bit settles which of them
+	 * links the item. The item can't go away under us: it is only freed
+	 * after its wait queues have been unhooked, which waits for us.
+	 */
+	read_lock_irqsave(&ep->lock, flags);
 
 	/*
 	 * If the event mask does not contain any poll(2) event, we consider the
@@ -1248,11 +1394,17 @@ static int ep_poll_callback(wait_queue_t *wait, unsigned mode, int sync, void *k
 	if (!(epi->event.events & ~EP_PRIVATE_BITS))
 		goto is_disabled;
 
-	/* If this file is already in the ready list we exit soon */
-	if (ep_is_linked(&epi->rdllink))
+	__ep_stat_inc(callbacks);
+
+	/* If this file is already in a ready list we exit soon */
+	if (test_and_set_bit(EPI_READY, &epi->flags))
 		goto is_linked;
 
-	list_add_tail(&epi->rdllink, &ep->rdllist);
+	list_add_tail(&epi->rdllink,
+		      per_cpu_ptr(ep->cpu_rdllists, smp_processor_id()));
+	if (!cpu_isset(smp_processor_id(), ep->rdlmask))
+		cpu_set(smp_processor_id(), ep->rdlmask);
+	__ep_stat_inc(queued);
 
 is_linked:
 	/*
@@ -1260,12 +1412,12 @@ is_linked:
 	 * wait list.
 	 */
 	if (waitqueue_active(&ep->wq))
-		wake_up(&ep->wq);
+		ep_wake_waiters(ep, epi->event.events & EPOLLEXCLUSIVE);
 	if (waitqueue_active(&ep->poll_wait))
 		pwake++;
 
 is_disabled:
-	write_unlock_irqrestore(&ep->lock, flags);
+	read_unlock_irqrestore(&ep->lock, flags);
 
 	/* We have to call this outside the lock */
 	if (pwake)
@@ -1300,7 +1452,7 @@ static unsigned int ep_eventpoll_poll(struct file *file, poll_table *wait)
 
 	/* Check our condition */
 	read_lock_irqsave(&ep->lock, flags);
-	if (!list_empty(&ep->rdllist))
+	if (ep_ready_avail(ep))
 		pollflags = POLLIN | POLLRDNORM;
 	read_unlock_irqrestore(&ep->lock, flags);
 
@@ -1322,6 +1474,8 @@ static int ep_collect_ready_items(struct eventpoll *ep, struct list_head *txlist
 
 	write_lock_irqsave(&ep->lock, flags);
 
+	ep_merge_ready(ep);
+
 	for (nepi = 0, lnk = lsthead->next; lnk != lsthead && nepi < maxevents;) {
 		epi = list_entry(lnk, struct epitem, rdllink);
 
@@ -1343,7 +1497,7 @@ static int ep_collect_ready_items(struct eventpoll *ep, struct list_head *txlist
 			/*
 			 * Unlink the item from the ready list.
 			 */
-			ep_list_del(&epi->rdllink);
+			ep_rdllist_del(epi);
 		}
 	}
 
@@ -1353,18 +1507,41 @@ static int ep_collect_ready_items(struct eventpoll *ep, struct list_head *txlist
 }
 
 
+/*
+ * Copies a batch of events gathered by ep_send_events() to user space, and
+ * disables the EPOLLONESHOT items among them once they are out.
+ */
+static int ep_flush_events(struct epoll_event __user *uevents,
+			   struct epoll_event *events, struct epitem **epis,
+			   int nevents)
+{
+	int i;
+
+	if (__copy_to_user(uevents, events, nevents * sizeof(struct epoll_event)))
+		return -EFAULT;
+	for (i = 0; i < nevents; i++)
+		if (epis[i]->event.events & EPOLLONESHOT)
+			epis[i]->event.events &= EP_PRIVATE_BITS;
+	ep_stat_inc(copies);
+	return 0;
+}
+
+
 /*
  * This function is called without holding the "ep->lock" since the call to
  * __copy_to_user() might sleep, and also f_op->poll() might reenable the IRQ
- * because of the way poll() is traditionally implemented in Linux.
+ * because of the way poll() is traditionally implemented in Linux. Events
+ * are gathered on the stack and copied EP_SEND_BATCH at a time.
  */
 static int ep_send_events(struct eventpoll *ep, struct list_head *txlist,
 			  struct epoll_event __user *events)
 {
-	int eventcnt = 0;
+	int eventcnt = 0, nbatch = 0;
 	unsigned int revents;
 	struct list_head *lnk;
 	struct epitem *epi;
+	struct epoll_event batch[EP_SEND_BATCH];
+	struct epitem *batch_epi[EP_SEND_BATCH];
 
 	/*
 	 * We can loop without lock because this is a task private list.
@@ -1390,16 +1567,24 @@ static int ep_send_events(struct eventpoll *ep, struct list_head *txlist,
 		epi->revents = revents & epi->event.events;
 
 		if (epi->revents) {
-			if (__put_user(epi->revents,
-				       &events[eventcnt].events) ||
-			    __put_user(epi->event.data,
-				       &events[eventcnt].data))
-				return -EFAULT;
-			if (epi->event.events & EPOLLONESHOT)
-				epi->event.events &= EP_PRIVATE_BITS;
-			eventcnt++;
+			batch[nbatch].events = epi->revents;
+			batch[nbatch].data = epi->event.data;
+			batch_epi[nbatch++] = epi;
+			if (nbatch == EP_SEND_BATCH) {
+				if (ep_flush_events(&events[eventcnt], batch,
+						    batch_epi, nbatch))
+					return -EFAULT;
+				eventcnt += nbatch;
+				nbatch = 0;
+			}
 		}
 	}
+	if (nbatch) {
+		if (ep_flush_events(&events[eventcnt], batch, batch_epi, nbatch))
+			return -EFAULT;
+		eventcnt += nbatch;
+	}
+	ep_stat_add(events, eventcnt);
 	return eventcnt;
 }
 
@@ -1412,7 +1597,7 @@ static int ep_send_events(struct eventpoll *ep, struct list_head *txlist,
  */
 static void ep_reinject_items(struct eventpoll *ep, struct list_head *txlist)
 {
-	int ricnt = 0, pwake = 0;
+	int ricnt = 0, exclusive = 1, pwake = 0;
 	unsigned long flags;
 	struct epitem *epi;
 
@@ -1433,7 +1618,9 @@ static void ep_reinject_items(struct eventpoll *ep, struct list_head *txlist)
 		 */
 		if (ep_rb_linked(&epi->rbn) && !(epi->event.events & EPOLLET) &&
 		    (epi->revents & epi->event.events) && !ep_is_linked(&epi->rdllink)) {
-			list_add_tail(&epi->rdllink, &ep->rdllist);
+			ep_rdllist_add(ep, epi);
+			if (!(epi->event.events & EPOLLEXCLUSIVE))
+				exclusive = 0;
 			ricnt++;
 		}
 	}
@@ -1444,9 +1631,15 @@ static void ep_reinject_items(struct eventpoll *ep, struct list_head *txlist)
 		 * wait list.
 		 */
 		if (waitqueue_active(&ep->wq))
-			wake_up(&ep->wq);
+			ep_wake_waiters(ep, exclusive);
 		if (waitqueue_active(&ep->poll_wait))
 			pwake++;
+	} else if (!list_empty(&ep->rdllist) && waitqueue_active(&ep->wq)) {
+		/*
+		 * We left items behind, for lack of room in the caller's array.
+		 * Their own wake up may have gone to us only, so pass it on.
+		 */
+		ep_wake_waiters(ep, 1);
 	}
 
 	write_unlock_irqrestore(&ep->lock, flags);
@@ -1492,7 +1685,7 @@ static int ep_events_transfer(struct eventpoll *ep,
 static int ep_poll(struct eventpoll *ep, struct epoll_event __user *events,
 		   int maxevents, long timeout)
 {
-	int res, eavail;
+	int res, eavail, slept = 0;
 	unsigned long flags;
 	long jtimeout;
 	wait_queue_t wait;
@@ -1509,14 +1702,18 @@ retry:
 	write_lock_irqsave(&ep->lock, flags);
 
 	res = 0;
+	ep_merge_ready(ep);
 	if (list_empty(&ep->rdllist)) {
 		/*
 		 * We don't have any available event to return to the caller.
 		 * We need to sleep here, and we will be wake up by
 		 * ep_poll_callback() when events will become available.
+		 * We wait exclusive, so that an EPOLLEXCLUSIVE item wakes up
+		 * only one of the tasks waiting on this epoll; the others
+		 * wake up all of them.
 		 */
 		init_waitqueue_entry(&wait, current);
-		add_wait_queue(&ep->wq, &wait);
+		add_wait_queue_exclusive(&ep->wq, &wait);
 
 		for (;;) {
 			/*
@@ -1525,15 +1722,22 @@ retry:
 			 * to TASK_INTERRUPTIBLE before doing the checks.
 			 */
 			set_current_state(TASK_INTERRUPTIBLE);
+			ep_merge_ready(ep);
 			if (!list_empty(&ep->rdllist) || !jtimeout)
 				break;
 			if (signal_pending(current)) {
 				res = -EINTR;
 				break;
 			}
+			if (slept)
+				ep_stat_inc(spurious);
 
 			write_unlock_irqrestore(&ep->lock, flags);
+			ep_stat_inc(sleeps);
 			jtimeout = schedule_timeout(jtimeout);
+			if (jtimeout)
+				ep_stat_inc(wakeups);
+			slept = jtimeout != 0;
 			write_lock_irqsave(&ep->lock, flags);
 		}
 		remove_wait_queue(&ep->wq, &wait);
@@ -1544,6 +1748,13 @@ retry:
 	/* Is it worth to try to dig for events ? */
 	eavail = !list_empty(&ep->rdllist);
 
+	/*
+	 * A signal took us out with events ready: if they woke up only us,
+	 * somebody else must get them.
+	 */
+	if (res && eavail && waitqueue_active(&ep->wq))
+		ep_wake_waiters(ep, 1);
+
 	write_unlock_irqrestore(&ep->lock, flags);
 
 	/*
@@ -1552,13 +1763,55 @@ retry:
 	 * more luck.
 	 */
 	if (!res && eavail &&
-	    !(res = ep_events_transfer(ep, events, maxevents)) && jtimeout)
+	    !(res = ep_events_transfer(ep, events, maxevents)) && jtimeout) {
+		if (slept)
+			ep_stat_inc(spurious);
+		slept = 0;
 		goto retry;
+	}
 
 	return res;
 }
 
 
+#ifdef CONFIG_EPOLL_STATS
+#define EPOLL_STAT_VERSION 1
+
+static int show_epoll_stat(struct seq_file *seq, void *v)
+{
+	struct ep_stat sum;
+	int cpu;
+
+	memset(&sum, 0, sizeof(sum));
+	for_each_possible_cpu(cpu) {
+		struct ep_stat *st = &per_cpu(ep_stats, cpu);
+
+		sum.callbacks += st->callbacks;
+		sum.queued += st->queued;
+		sum.wake_all += st->wake_all;
+		sum.wake_one += st->wake_one;
+		sum.sleeps += st->sleeps;
+		sum.wakeups += st->wakeups;
+		sum.spurious += st->spurious;
+		sum.events += st->events;
+		sum.copies += st->copies;
+	}
+
+	seq_printf(seq, "version %d\n", EPOLL_STAT_VERSION);
+	seq_printf(seq, "callbacks %lu queued %lu\n", sum.callbacks, sum.queued);
+	seq_printf(seq, "wake_all %lu wake_one %lu\n", sum.wake_all,
+		   sum.wake_one);
+	seq_printf(seq, "sleeps %lu wakeups %lu spurious %lu\n", sum.sleeps,
+		   sum.wakeups, sum.spurious);
+	seq_printf(seq, "events %lu copies %lu\n", sum.events, sum.copies);
+
+	return 0;
+}
+
+DEFINE_SEQ_STAT_FILE(epoll_stat);
+#endif
+
+
 static int eventpollfs_delete_dentry(struct dentry *dentry)
 {
 
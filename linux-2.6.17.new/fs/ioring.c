@@ -0,0 +1,760 @@
+/*
+ *	I/O rings
+ *
+ *	Requests are queued on a submission ring shared with the process,
+ *	and their results put on a shared completion ring: one system call
+ *	submits and reaps as many requests as there are, and with a polling
+ *	thread none is needed at all. The requests themselves are kiocbs,
+ *	run by the AIO core on a kioctx of the ring's own.
+ *
+ *	See Documentation/ioring.txt.
+ */
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/errno.h>
+#include <linux/module.h>
+#include <linux/syscalls.h>
+#include <linux/sched.h>
+#include <linux/fs.h>
+#include <linux/file.h>
+#include <linux/mm.h>
+#include <linux/mount.h>
+#include <linux/slab.h>
+#include <linux/aio.h>
+#include <linux/kthread.h>
+#include <linux/mutex.h>
+#include <linux/wait.h>
+#include <linux/capability.h>
+#include <linux/ioring.h>
+
+#include <asm/uaccess.h>
+#include <asm/io.h>
+
+#define IORINGFS_MAGIC		0x10a1a10a
+
+/*
+ * The rings as they are mapped into the process. User space finds the
+ * fields through ioring_params, so their layout is ours to change. The
+ * index each side writes sits on a cache line of its own.
+ */
+struct ioring_sq_ring {
+	u32			head;
+	u32			tail ____cacheline_aligned_in_smp;
+	u32			ring_mask;
+	u32			ring_entries;
+	u32			flags;
+	u32			dropped;
+	u32			array[0];
+};
+
+struct ioring_cq_ring {
+	u32			head;
+	u32			tail ____cacheline_aligned_in_smp;
+	u32			ring_mask;
+	u32			ring_entries;
+	u32			overflow;
+	struct ioring_cqe	cqes[0] ____cacheline_aligned_in_smp;
+};
+
+struct ioring_ctx {
+	struct kioctx		*ioctx;
+	unsigned int		flags;		/* IORING_SETUP_* */
+
+	struct ioring_sq_ring	*sq_ring;
+	struct ioring_sqe	*sqes;
+	struct ioring_cq_ring	*cq_ring;
+	size_t			sq_ring_size, sqes_size, cq_ring_size;
+	unsigned int		sq_entries, sq_mask;
+	unsigned int		cq_entries, cq_mask;
+
+	/*
+	 * Our own copies of the indexes we move, user space can't be
+	 * trusted with them
+	 */
+	unsigned int		sq_head;	/* under submit_lock */
+	unsigned int		cq_tail;	/* under ioctx->ctx_lock */
+	/* submitted, not completed yet, under ioctx->ctx_lock */
+	unsigned int		inflight;
+
+	struct mutex		submit_lock;
+
+	struct mutex		thread_lock;	/* stopping sq_thread */
+	struct task_struct	*sq_thread;
+	struct files_struct	*sq_files;	/* the process's fds, for it */
+	wait_queue_head_t	sq_wait;
+	unsigned long		sq_idle;	/* jiffies */
+};
+
+static struct vfsmount *ioring_mnt __read_mostly;
+static const struct file_operations ioring_fops;
+
+/*
+ * Post a completion, with ioctx->ctx_lock held. Room for it was
+ * reserved at submission, so there is no overflow unless user space
+ * moved the head beyond what it was given.
+ */
+static void __ioring_post(struct ioring_ctx *ctx, u64 user_data, long res)
+{
+	struct ioring_cq_ring *ring = ctx->cq_ring;
+	unsigned int tail = ctx->cq_tail;
+	struct ioring_cqe *cqe;
+
+	ctx->inflight--;
+	if (tail - ring->head >= ctx->cq_entries) {
+		ring->overflow++;
+		return;
+	}
+
+	cqe = &ring->cqes[tail & ctx->cq_mask];
+	cqe->user_data = user_data;
+	cqe->res = res;
+	cqe->flags = 0;
+	smp_wmb();	/* the entry before the tail that covers it */
+	ctx->cq_tail = ring->tail = tail + 1;
+}
+
+static void ioring_post(struct ioring_ctx *ctx, u64 user_data, long res)
+{
+	struct kioctx *ioctx = ctx->ioctx;
+	unsigned long flags;
+
+	spin_lock_irqsave(&ioctx->ctx_lock, flags);
+	__ioring_post(ctx, user_data, res);
+	spin_unlock_irqrestore(&ioctx->ctx_lock, flags);
+
+	if (waitqueue_active(&ioctx->wait))
+		wake_up(&ioctx->wait);
+}
+
+/*
+ * Reserve a completion entry for a request about to be submitted
+ */
+static int ioring_reserve_cqe(struct ioring_ctx *ctx)
+{
+	struct kioctx *ioctx = ctx->ioctx;
+	int ok;
+
+	spin_lock_irq(&ioctx->ctx_lock);
+	ok = ctx->inflight + (ctx->cq_tail - ctx->cq_ring->head) <
+		ctx->cq_entries;
+	if (ok)
+		ctx->inflight++;
+	spin_unlock_irq(&ioctx->ctx_lock);
+	return ok;
+}
+
+/*
+ * aio_complete() of the ring's kiocbs ends up here, with
+ * ioctx->ctx_lock held
+ */
+static void ioring_complete(struct kioctx *ioctx, struct kiocb *iocb,
+			    long res, long res2)
+{
+	__ioring_post(ioctx->private, iocb->ki_user_data, res);
+}
+
+/*
+ * Turn an sqe into an iocb for io_submit_one(). What fails before the
+ * request is started, and NOP, complete right away.
+ */
+static void ioring_submit_sqe(struct ioring_ctx *ctx, struct ioring_sqe *sqe)
+{
+	struct iocb iocb;
+	long ret = -EINVAL;
+
+	memset(&iocb, 0, sizeof(iocb));
+	iocb.aio_data = sqe->user_data;
+	iocb.aio_fildes = sqe->fd;
+	iocb.aio_buf = sqe->addr;
+	iocb.aio_nbytes = sqe->len;
+	iocb.aio_offset = sqe->off;
+
+	if (sqe->flags)
+		goto post;
+
+	switch (sqe->opcode) {
+	case IORING_OP_NOP:
+		ret = 0;
+		goto post;
+	case IORING_OP_READ:
+		iocb.aio_lio_opcode = IOCB_CMD_PREAD;
+		break;
+	case IORING_OP_WRITE:
+		iocb.aio_lio_opcode = IOCB_CMD_PWRITE;
+		break;
+	case IORING_OP_READV:
+		iocb.aio_lio_opcode = IOCB_CMD_PREADV;
+		break;
+	case IORING_OP_WRITEV:
+		iocb.aio_lio_opcode = IOCB_CMD_PWRITEV;
+		break;
+	case IORING_OP_FSYNC:
+		if (sqe->op_flags & ~IORING_FSYNC_DATASYNC)
+			goto post;
+		if (sqe->op_flags & IORING_FSYNC_DATASYNC)
+			iocb.aio_lio_opcode = IOCB_CMD_FDSYNC;
+		else
+			iocb.aio_lio_opcode = IOCB_CMD_FSYNC;
+		break;
+	case IORING_OP_SENDMSG:
+		iocb.aio_lio_opcode = IOCB_CMD_SENDMSG;
+		iocb.aio_nbytes = sqe->op_flags;
+		break;
+	case IORING_OP_RECVMSG:
+		iocb.aio_lio_opcode = IOCB_CMD_RECVMSG;
+		iocb.aio_nbytes = sqe->op_flags;
+		break;
+	default:
+		goto post;
+	}
+	if (sqe->op_flags && sqe->opcode != IORING_OP_FSYNC &&
+	    sqe->opcode != IORING_OP_SENDMSG &&
+	    sqe->opcode != IORING_OP_RECVMSG)
+		goto post;
+
+	ret = io_submit_one(ctx->ioctx, NULL, &iocb, 0);
+	if (!ret)
+		return;
+post:
+	ioring_post(ctx, sqe->user_data, ret);
+}
+
+/*
+ * Submit up to to_submit entries from the submission ring, with
+ * submit_lock held. Returns how many were consumed, or -EBUSY if none
+ * could be for lack of room on the completion ring.
+ */
+static int ioring_submit(struct ioring_ctx *ctx, unsigned int to_submit)
+{
+	struct ioring_sq_ring *ring = ctx->sq_ring;
+	unsigned int head = ctx->sq_head;
+	unsigned int nr, idx, done = 0;
+	struct ioring_sqe sqe;
+	int busy = 0;
+
+	nr = ring->tail - head;
+	smp_rmb();	/* read the tail before the entries behind it */
+	nr = min(nr, ctx->sq_entries);	/* a bogus tail */
+	nr = min(nr, to_submit);
+
+	while (done < nr) {
+		idx = ring->array[head & ctx->sq_mask];
+		if (idx >= ctx->sq_entries) {
+			ring->dropped++;
+			head++;
+			done++;
+			continue;
+		}
+		if (!ioring_reserve_cqe(ctx)) {
+			busy = 1;
+			break;
+		}
+		/* copy it: user space may change it under us */
+		sqe = ctx->sqes[idx];
+		head++;
+		done++;
+		ioring_submit_sqe(ctx, &sqe);
+	}
+
+	if (done) {
+		smp_mb();	/* done with the entries before they're reused */
+		ctx->sq_head = ring->head = head;
+	}
+	return done ? done : (busy ? -EBUSY : 0);
+}
+
+/*
+ * Racy check whether the polling thread has something to submit
+ */
+static int ioring_sq_ready(struct ioring_ctx *ctx)
+{
+	return ctx->sq_ring->tail != ctx->sq_head &&
+		ctx->inflight + (ctx->cq_tail - ctx->cq_ring->head) <
+		ctx->cq_entries;
+}
+
+/*
+ * The polling thread takes the requests off the submission ring as user
+ * space puts them there. After sq_idle with nothing to do it sleeps,
+ * setting IORING_SQ_NEED_WAKEUP for user space to wake it up with
+ * ioring_enter(). It runs in the process's mm, as the aio retry threads
+ * do, and looks the fds up in the process's table; exit_aio() stops it
+ * before the mm goes away.
+ */
+static int ioring_sq_thread(void *data)
+{
+	struct ioring_ctx *ctx = data;
+	struct mm_struct *mm = ctx->ioctx->mm;
+	struct files_struct *old_files;
+	mm_segment_t oldfs = get_fs();
+	unsigned long idle_end = jiffies + ctx->sq_idle;
+	DEFINE_WAIT(wait);
+	int ret;
+
+	task_lock(current);
+	old_files = current->files;
+	current->files = ctx->sq_files;
+	task_unlock(current);
+	set_fs(USER_DS);
+	use_mm(mm);
+	while (!kthread_should_stop()) {
+		ret = 0;
+		if (ioring_sq_ready(ctx)) {
+			mutex_lock(&ctx->submit_lock);
+			ret = ioring_submit(ctx, ctx->sq_entries);
+			mutex_unlock(&ctx->submit_lock);
+		}
+		if (ret > 0 || time_before(jiffies, idle_end)) {
+			if (ret > 0)
+				idle_end = jiffies + ctx->sq_idle;
+			else
+				cpu_relax();
+			cond_resched();
+			continue;
+		}
+
+		prepare_to_wait(&ctx->sq_wait, &wait, TASK_INTERRUPTIBLE);
+		ctx->sq_ring->flags |= IORING_SQ_NEED_WAKEUP;
+		smp_mb();	/* the flag before looking at the tail */
+		if (!ioring_sq_ready(ctx) && !kthread_should_stop())
+			schedule();
+		finish_wait(&ctx->sq_wait, &wait);
+		ctx->sq_ring->flags &= ~IORING_SQ_NEED_WAKEUP;
+		idle_end = jiffies + ctx->sq_idle;
+	}
+	unuse_mm(mm);
+	set_fs(oldfs);
+	task_lock(current);
+	current->files = old_files;
+	task_unlock(current);
+	return 0;
+}
+
+/*
+ * The reference to the fd table is dropped last, outside thread_lock: it
+ * may be the last one, and closing the fds can release this very ring.
+ */
+static void ioring_stop_thread(struct ioring_ctx *ctx)
+{
+	struct files_struct *files = NULL;
+
+	mutex_lock(&ctx->thread_lock);
+	if (ctx->sq_thread) {
+		kthread_stop(ctx->sq_thread);
+		ctx->sq_thread = NULL;
+		files = ctx->sq_files;
+		ctx->sq_files = NULL;
+	}
+	mutex_unlock(&ctx->thread_lock);
+	if (files)
+		put_files_struct(files);
+}
+
+static void ioring_exit(struct kioctx *ioctx)
+{
+	ioring_stop_thread(ioctx->private);
+}
+
+static void ioring_free_ctx(struct ioring_ctx *ctx)
+{
+	if (ctx->sq_ring)
+		free_pages((unsigned long)ctx->sq_ring,
+			   get_order(ctx->sq_ring_size));
+	if (ctx->sqes)
+		free_pages((unsigned long)ctx->sqes, get_order(ctx->sqes_size));
+	if (ctx->cq_ring)
+		free_pages((unsigned long)ctx->cq_ring,
+			   get_order(ctx->cq_ring_size));
+	kfree(ctx);
+}
+
+static void ioring_free(struct kioctx *ioctx)
+{
+	ioring_free_ctx(ioctx->private);
+}
+
+static const struct kioctx_ops ioring_kioctx_ops = {
+	.complete	= ioring_complete,
+	.exit		= ioring_exit,
+	.free		= ioring_free,
+};
+
+static void *ioring_alloc_mem(size_t size)
+{
+	return (void *)__get_free_pages(GFP_KERNEL | __GFP_ZERO,
+					get_order(size));
+}
+
+/*
+ * Waits for min_complete entries on the completion ring
+ */
+static int ioring_wait(struct ioring_ctx *ctx, unsigned int min_complete)
+{
+	struct kioctx *ioctx = ctx->ioctx;
+	DEFINE_WAIT(wait);
+	int ret = 0;
+
+	min_complete = min(min_complete, ctx->cq_entries);
+	for (;;) {
+		prepare_to_wait(&ioctx->wait, &wait, TASK_INTERRUPTIBLE);
+		if (ctx->cq_tail - ctx->cq_ring->head >= min_complete)
+			break;
+		if (signal_pending(current)) {
+			ret = -EINTR;
+			break;
+		}
+		schedule();
+	}
+	finish_wait(&ioctx->wait, &wait);
+	return ret;
+}
+
+static int ioring_release(struct inode *inode, struct file *file)
+{
+	struct ioring_ctx *ctx = file->private_data;
+
+	/* the last reference to the kioctx frees ctx */
+	ioring_stop_thread(ctx);
+	io_destroy(ctx->ioctx);
+	return 0;
+}
+
+static int ioring_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct ioring_ctx *ctx = file->private_data;
+	unsigned long size = vma->vm_end - vma->vm_start;
+	unsigned long off = vma->vm_pgoff << PAGE_SHIFT;
+	void *ptr;
+	size_t len;
+
+	switch (off) {
+	case IORING_OFF_SQ_RING:
+		ptr = ctx->sq_ring;
+		len = ctx->sq_ring_size;
+		break;
+	case IORING_OFF_SQES:
+		ptr = ctx->sqes;
+		len = ctx->sqes_size;
+		break;
+	case IORING_OFF_CQ_RING:
+		ptr = ctx->cq_ring;
+		len = ctx->cq_ring_size;
+		break;
+	default:
+		return -EINVAL;
+	}
+	if (size > PAGE_ALIGN(len))
+		return -EINVAL;
+
+	return remap_pfn_range(vma, vma->vm_start,
+			       virt_to_phys(ptr) >> PAGE_SHIFT, size,
+			       vma->vm_page_prot);
+}
+
+static const struct file_operations ioring_fops = {
+	.release	= ioring_release,
+	.mmap		= ioring_mmap,
+};
+
+static int ioringfs_delete_dentry(struct dentry *dentry)
+{
+	return 1;
+}
+
+static struct dentry_operations ioringfs_dentry_operations = {
+	.d_delete	= ioringfs_delete_dentry,
+};
+
+/*
+ * Creates the file descriptor of a ring, as ep_getfd() does for epoll
+ */
+static int ioring_getfd(struct ioring_ctx *ctx)
+{
+	struct qstr this;
+	char name[32];
+	struct dentry *dentry;
+	struct inode *inode;
+	struct file *file;
+	int error, fd;
+
+	error = -ENFILE;
+	file = get_empty_filp();
+	if (!file)
+		goto out;
+
+	error = -ENOMEM;
+	inode = new_inode(ioring_mnt->mnt_sb);
+	if (!inode)
+		goto out_filp;
+	inode->i_fop = &ioring_fops;
+	/* never put on the dirty list, see ep_eventpoll_inode() */
+	inode->i_state = I_DIRTY;
+	inode->i_mode = S_IRUSR | S_IWUSR;
+	inode->i_uid = current->fsuid;
+	inode->i_gid = current->fsgid;
+	inode->i_atime = inode->i_mtime = inode->i_ctime = CURRENT_TIME;
+	inode->i_blksize = PAGE_SIZE;
+
+	error = get_unused_fd();
+	if (error < 0)
+		goto out_inode;
+	fd = error;
+
+	error = -ENOMEM;
+	sprintf(name, "[%lu]", inode->i_ino);
+	this.name = name;
+	this.len = strlen(name);
+	this.hash = inode->i_ino;
+	dentry = d_alloc(ioring_mnt->mnt_sb->s_root, &this);
+	if (!dentry)
+		goto out_fd;
+	dentry->d_op = &ioringfs_dentry_operations;
+	d_add(dentry, inode);
+	file->f_vfsmnt = mntget(ioring_mnt);
+	file->f_dentry = dentry;
+	file->f_mapping = inode->i_mapping;
+
+	file->f_pos = 0;
+	file->f_flags = O_RDWR;
+	file->f_op = &ioring_fops;
+	file->f_mode = FMODE_READ | FMODE_WRITE;
+	file->f_version = 0;
+	file->private_data = ctx;
+
+	fd_install(fd, file);
+	return fd;
+
+out_fd:
+	put_unused_fd(fd);
+out_inode:
+	iput(inode);
+out_filp:
+	put_filp(file);
+out:
+	return error;
+}
+
+static int ioring_alloc_rings(struct ioring_ctx *ctx, unsigned int entries)
+{
+	ctx->sq_entries = roundup_pow_of_two(entries);
+	ctx->sq_mask = ctx->sq_entries - 1;
+	ctx->cq_entries = 2 * ctx->sq_entries;
+	ctx->cq_mask = ctx->cq_entries - 1;
+
+	ctx->sq_ring_size = sizeof(struct ioring_sq_ring) +
+		ctx->sq_entries * sizeof(u32);
+	ctx->sqes_size = ctx->sq_entries * sizeof(struct ioring_sqe);
+	ctx->cq_ring_size = sizeof(struct ioring_cq_ring) +
+		ctx->cq_entries * sizeof(struct ioring_cqe);
+
+	ctx->sq_ring = ioring_alloc_mem(ctx->sq_ring_size);
+	ctx->sqes = ioring_alloc_mem(ctx->sqes_size);
+	ctx->cq_ring = ioring_alloc_mem(ctx->cq_ring_size);
+	if (!ctx->sq_ring || !ctx->sqes || !ctx->cq_ring)
+		return -ENOMEM;
+
+	ctx->sq_ring->ring_mask = ctx->sq_mask;
+	ctx->sq_ring->ring_entries = ctx->sq_entries;
+	ctx->cq_ring->ring_mask = ctx->cq_mask;
+	ctx->cq_ring->ring_entries = ctx->cq_entries;
+	return 0;
+}
+
+static void ioring_fill_offsets(struct ioring_ctx *ctx, struct ioring_params *p)
+{
+	p->sq_entries = ctx->sq_entries;
+	p->cq_entries = ctx->cq_entries;
+
+	memset(&p->sq_off, 0, sizeof(p->sq_off));
+	p->sq_off.head = offsetof(struct ioring_sq_ring, head);
+	p->sq_off.tail = offsetof(struct ioring_sq_ring, tail);
+	p->sq_off.ring_mask = offsetof(struct ioring_sq_ring, ring_mask);
+	p->sq_off.ring_entries = offsetof(struct ioring_sq_ring, ring_entries);
+	p->sq_off.flags = offsetof(struct ioring_sq_ring, flags);
+	p->sq_off.dropped = offsetof(struct ioring_sq_ring, dropped);
+	p->sq_off.array = offsetof(struct ioring_sq_ring, array);
+
+	memset(&p->cq_off, 0, sizeof(p->cq_off));
+	p->cq_off.head = offsetof(struct ioring_cq_ring, head);
+	p->cq_off.tail = offsetof(struct ioring_cq_ring, tail);
+	p->cq_off.ring_mask = offsetof(struct ioring_cq_ring, ring_mask);
+	p->cq_off.ring_entries = offsetof(struct ioring_cq_ring, ring_entries);
+	p->cq_off.overflow = offsetof(struct ioring_cq_ring, overflow);
+	p->cq_off.cqes = offsetof(struct ioring_cq_ring, cqes);
+}
+
+/* sys_ioring_setup:
+ *	Creates a ring of at least entries submission entries, and twice
+ *	as many completion entries, and returns its file descriptor for
+ *	the rings to be mapped from. params says where the fields are.
+ *	May fail with -EINVAL for bad entries, flags or reserved fields,
+ *	-EPERM for IORING_SETUP_SQPOLL without CAP_SYS_ADMIN, -EAGAIN if
+ *	the ring would take the system over aio-max-nr, -ENOMEM, -EMFILE
+ *	or -EFAULT.
+ */
+asmlinkage long sys_ioring_setup(u32 entries,
+				 struct ioring_params __user *params)
+{
+	struct ioring_params p;
+	struct ioring_ctx *ctx;
+	struct kioctx *ioctx;
+	struct task_struct *t;
+	int i, ret;
+
+	if (copy_from_user(&p, params, sizeof(p)))
+		return -EFAULT;
+	for (i = 0; i < ARRAY_SIZE(p.resv); i++)
+		if (p.resv[i])
+			return -EINVAL;
+	if (p.flags & ~(IORING_SETUP_SQPOLL | IORING_SETUP_SQ_AFF))
+		return -EINVAL;
+	if (!entries || entries > IORING_MAX_ENTRIES)
+		return -EINVAL;
+	if (p.flags & IORING_SETUP_SQPOLL) {
+		/* it busy waits, a CPU's worth */
+		if (!capable(CAP_SYS_ADMIN))
+			return -EPERM;
+	} else if (p.flags & IORING_SETUP_SQ_AFF)
+		return -EINVAL;
+	if ((p.flags & IORING_SETUP_SQ_AFF) &&
+	    (p.sq_thread_cpu >= NR_CPUS || !cpu_online(p.sq_thread_cpu)))
+		return -EINVAL;
+
+	ctx = kzalloc(sizeof(*ctx), GFP_KERNEL);
+	if (!ctx)
+		return -ENOMEM;
+	ctx->flags = p.flags;
+	mutex_init(&ctx->submit_lock);
+	mutex_init(&ctx->thread_lock);
+	init_waitqueue_head(&ctx->sq_wait);
+	ctx->sq_idle = msecs_to_jiffies(p.sq_thread_idle ?
+					p.sq_thread_idle : 1000);
+
+	ret = ioring_alloc_rings(ctx, entries);
+	if (ret)
+		goto out_free;
+
+	ioring_fill_offsets(ctx, &p);
+	ret = -EFAULT;
+	if (copy_to_user(params, &p, sizeof(p)))
+		goto out_free;
+
+	/* from here on the kioctx owns ctx */
+	ioctx = ioctx_alloc_ring(ctx->cq_entries, &ioring_kioctx_ops, ctx);
+	if (IS_ERR(ioctx)) {
+		ret = PTR_ERR(ioctx);
+		goto out_free;
+	}
+	ctx->ioctx = ioctx;
+
+	if (p.flags & IORING_SETUP_SQPOLL) {
+		ctx->sq_files = get_files_struct(current);
+		t = kthread_create(ioring_sq_thread, ctx, "ioring-sq/%d",
+				   current->pid);
+		if (IS_ERR(t)) {
+			put_files_struct(ctx->sq_files);
+			ctx->sq_files = NULL;
+			ret = PTR_ERR(t);
+			goto out_destroy;
+		}
+		if (p.flags & IORING_SETUP_SQ_AFF)
+			kthread_bind(t, p.sq_thread_cpu);
+		ctx->sq_thread = t;
+		wake_up_process(t);
+	}
+
+	ret = ioring_getfd(ctx);
+	if (ret >= 0)
+		return ret;
+
+out_destroy:
+	ioring_stop_thread(ctx);
+	io_destroy(ioctx);
+	return ret;
+
+out_free:
+	ioring_free_ctx(ctx);
+	return ret;
+}
+
+/* sys_ioring_enter:
+ *	Submits up to to_submit entries from the submission ring and, with
+ *	IORING_ENTER_GETEVENTS, waits for min_complete entries to be on the
+ *	completion ring. With a polling thread nothing is submitted here,
+ *	IORING_ENTER_SQ_WAKEUP wakes the thread up instead. Returns the
+ *	number of entries submitted, or -EBUSY if there was no room for
+ *	their completions; -EINTR if interrupted while waiting.
+ */
+asmlinkage long sys_ioring_enter(unsigned int fd, u32 to_submit,
+				 u32 min_complete, u32 flags)
+{
+	struct ioring_ctx *ctx;
+	struct file *file;
+	int fput_needed;
+	long ret, submitted = 0;
+
+	if (flags & ~(IORING_ENTER_GETEVENTS | IORING_ENTER_SQ_WAKEUP))
+		return -EINVAL;
+
+	file = fget_light(fd, &fput_needed);
+	if (!file)
+		return -EBADF;
+	ret = -EINVAL;
+	if (file->f_op != &ioring_fops)
+		goto out;
+	ctx = file->private_data;
+	/* requests run in the mm of the process that set the ring up */
+	if (current->mm != ctx->ioctx->mm)
+		goto out;
+
+	ret = 0;
+	if (ctx->flags & IORING_SETUP_SQPOLL) {
+		if (flags & IORING_ENTER_SQ_WAKEUP)
+			wake_up(&ctx->sq_wait);
+		submitted = to_submit;
+	} else if (to_submit) {
+		mutex_lock(&ctx->submit_lock);
+		ret = ioring_submit(ctx, to_submit);
+		mutex_unlock(&ctx->submit_lock);
+		if (ret > 0) {
+			submitted = ret;
+			ret = 0;
+		}
+	}
+	if (!ret && (flags & IORING_ENTER_GETEVENTS))
+		ret = ioring_wait(ctx, min_complete);
+out:
+	fput_light(file, fput_needed);
+	return submitted ? submitted : ret;
+}
+
+static struct super_block *
+ioringfs_get_sb(struct file_system_type *fs_type, int flags,
+		const char *dev_name, void *data)
+{
+	return get_sb_pseudo(fs_type, "ioring:", NULL, IORINGFS_MAGIC);
+}
+
+static struct file_system_type ioring_fs_type = {
+	.name		= "ioringfs",
+	.get_sb		= ioringfs_get_sb,
+	.kill_sb	= kill_anon_super,
+};
+
+static int __init ioring_init(void)
+{
+	int error;
+
+	error = register_filesystem(&ioring_fs_type);
+	if (error)
+		goto epanic;
+	ioring_mnt = kern_mount(&ioring_fs_type);
+	if (IS_ERR(ioring_mnt))
+		goto epanic;
+	return 0;
+
+epanic:
+	panic("ioring_init() failed\n");
+}
+
+module_init(ioring_init);
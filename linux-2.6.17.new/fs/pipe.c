@@ -16,6 +16,8 @@
 #include <linux/uio.h>
 #include <linux/highmem.h>
 #include <linux/pagemap.h>
+#include <linux/capability.h>
+#include <linux/seq_file.h>
 
 #include <asm/uaccess.h>
 #include <asm/ioctls.h>
@@ -35,6 +37,26 @@
  * -- Manfred Spraul <manfred@colorfullife.com> 2002-05-09
  */
 
+/*
+ * The largest pipe buffer an unprivileged user may ask for, in bytes, and
+ * the most buffers the pipes of one user may have in all, 0 for no limit.
+ * Only growing a pipe is checked against the latter.
+ */
+int pipe_max_size = 1048576;
+int pipe_user_pages = 16384;
+
+#ifdef CONFIG_PIPE_STATS
+/* Pipes in existence, and their buffers */
+static atomic_t pipe_nr = ATOMIC_INIT(0);
+static atomic_t pipe_nr_bufs = ATOMIC_INIT(0);
+
+DEFINE_PER_CPU(struct pipe_stat, pipe_stats);
+
+#define pipe_stat_add(counter, nr)	atomic_add(nr, &counter)
+#else
+#define pipe_stat_add(counter, nr)	do { } while (0)
+#endif
+
 /* Drop the inode semaphore and wait for a pipe event, atomically */
 void pipe_wait(struct pipe_inode_info *pipe)
 {
@@ -280,7 +302,7 @@ redo:
 			if (!buf->len) {
 				buf->ops = NULL;
 				ops->release(pipe, buf);
-				curbuf = (curbuf + 1) & (PIPE_BUFFERS-1);
+				curbuf = (curbuf + 1) & (pipe->buffers - 1);
 				pipe->curbuf = curbuf;
 				pipe->nrbufs = --bufs;
 				do_wakeup = 1;
@@ -315,6 +337,7 @@ redo:
 			wake_up_interruptible_sync(&pipe->wait);
  			kill_fasync(&pipe->fasync_writers, SIGIO, POLL_OUT);
 		}
+		pipe_stat_inc(read_waits);
 		pipe_wait(pipe);
 	}
 	mutex_unlock(&inode->i_mutex);
@@ -365,11 +388,13 @@ pipe_writev(struct file *filp, const struct iovec *_iov,
 		goto out;
 	}
 
+	pipe_stat_write(pipe);
+
 	/* We try to merge small writes */
 	chars = total_len & (PAGE_SIZE-1); /* size of the last buffer */
 	if (pipe->nrbufs && chars != 0) {
 		int lastbuf = (pipe->curbuf + pipe->nrbufs - 1) &
-							(PIPE_BUFFERS-1);
+							(pipe->buffers - 1);
 		struct pipe_buffer *buf = pipe->bufs + lastbuf;
 		struct pipe_buf_operations *ops = buf->ops;
 		int offset = buf->offset + buf->len;
@@ -415,8 +440,8 @@ redo1:
 			break;
 		}
 		bufs = pipe->nrbufs;
-		if (bufs < PIPE_BUFFERS) {
-			int newbuf = (pipe->curbuf + bufs) & (PIPE_BUFFERS-1);
+		if (bufs < pipe->buffers) {
+			int newbuf = (pipe->curbuf + bufs) & (pipe->buffers - 1);
 			struct pipe_buffer *buf = pipe->bufs + newbuf;
 			struct page *page = pipe->tmp_page;
 			char *src;
@@ -477,7 +502,7 @@ redo2:
 			if (!total_len)
 				break;
 		}
-		if (bufs < PIPE_BUFFERS)
+		if (bufs < pipe->buffers)
 			continue;
 		if (filp->f_flags & O_NONBLOCK) {
 			if (!ret)
@@ -495,6 +520,7 @@ redo2:
 			do_wakeup = 0;
 		}
 		pipe->waiting_writers++;
+		pipe_stat_inc(write_waits);
 		pipe_wait(pipe);
 		pipe->waiting_writers--;
 	}
@@ -548,7 +574,7 @@ pipe_ioctl(struct inode *pino, struct file *filp,
 			nrbufs = pipe->nrbufs;
 			while (--nrbufs >= 0) {
 				count += pipe->bufs[buf].len;
-				buf = (buf+1) & (PIPE_BUFFERS-1);
+				buf = (buf+1) & (pipe->buffers - 1);
 			}
 			mutex_unlock(&inode->i_mutex);
 
@@ -579,7 +605,7 @@ pipe_poll(struct file *filp, poll_table *wait)
 	}
 
 	if (filp->f_mode & FMODE_WRITE) {
-		mask |= (nrbufs < PIPE_BUFFERS) ? POLLOUT | POLLWRNORM : 0;
+		mask |= (nrbufs < pipe->buffers) ? POLLOUT | POLLWRNORM : 0;
 		/*
 		 * Most Unices do not set POLLERR for FIFOs but on Linux they
 		 * behave exactly like pipes for poll().
@@ -808,12 +834,30 @@ static struct file_operations rdwr_pipe_fops = {
 	.fasync		= pipe_rdwr_fasync,
 };
 
+/* Charges, or with a negative nr refunds, nr buffers to the pipe's user */
+static inline void pipe_account_bufs(struct pipe_inode_info *pipe, int nr)
+{
+	atomic_add(nr, &pipe->user->pipe_bufs);
+	pipe_stat_add(pipe_nr_bufs, nr);
+}
+
 struct pipe_inode_info * alloc_pipe_info(struct inode *inode)
 {
 	struct pipe_inode_info *pipe;
 
 	pipe = kzalloc(sizeof(struct pipe_inode_info), GFP_KERNEL);
 	if (pipe) {
+		pipe->bufs = kcalloc(PIPE_DEF_BUFFERS,
+				     sizeof(struct pipe_buffer), GFP_KERNEL);
+		if (!pipe->bufs) {
+			kfree(pipe);
+			return NULL;
+		}
+		pipe->buffers = PIPE_DEF_BUFFERS;
+		pipe->user = get_uid(current->user);
+		pipe_account_bufs(pipe, pipe->buffers);
+		pipe_stat_add(pipe_nr, 1);
+
 		init_waitqueue_head(&pipe->wait);
 		pipe->r_counter = pipe->w_counter = 1;
 		pipe->inode = inode;
@@ -826,13 +870,17 @@ void __free_pipe_info(struct pipe_inode_info *pipe)
 {
 	int i;
 
-	for (i = 0; i < PIPE_BUFFERS; i++) {
+	for (i = 0; i < pipe->buffers; i++) {
 		struct pipe_buffer *buf = pipe->bufs + i;
 		if (buf->ops)
 			buf->ops->release(pipe, buf);
 	}
 	if (pipe->tmp_page)
 		__free_page(pipe->tmp_page);
+	pipe_account_bufs(pipe, -pipe->buffers);
+	pipe_stat_add(pipe_nr, -1);
+	free_uid(pipe->user);
+	kfree(pipe->bufs);
 	kfree(pipe);
 }
 
@@ -842,6 +890,141 @@ void free_pipe_info(struct inode *inode)
 	inode->i_pipe = NULL;
 }
 
+/*
+ * Resizes the pipe's ring to nr_bufs buffers, a power of two. The buffers
+ * in use move to the start of the new ring, in order. Called with the
+ * pipe locked.
+ */
+static long pipe_set_size(struct pipe_inode_info *pipe, unsigned int nr_bufs)
+{
+	struct pipe_buffer *bufs;
+	unsigned int head, tail;
+	int more = nr_bufs - pipe->buffers;
+
+	if (nr_bufs < pipe->nrbufs)
+		return -EBUSY;
+
+	if (more > 0) {
+		atomic_add(more, &pipe->user->pipe_bufs);
+		if (pipe_user_pages && !capable(CAP_SYS_RESOURCE) &&
+		    atomic_read(&pipe->user->pipe_bufs) > pipe_user_pages) {
+			atomic_sub(more, &pipe->user->pipe_bufs);
+			return -EPERM;
+		}
+	}
+
+	bufs = kcalloc(nr_bufs, sizeof(struct pipe_buffer), GFP_KERNEL);
+	if (!bufs) {
+		if (more > 0)
+			atomic_sub(more, &pipe->user->pipe_bufs);
+		return -ENOMEM;
+	}
+
+	/* The ring may wrap: copy from curbuf to the end, then the rest */
+	head = min(pipe->nrbufs, pipe->buffers - pipe->curbuf);
+	tail = pipe->nrbufs - head;
+	memcpy(bufs, pipe->bufs + pipe->curbuf,
+	       head * sizeof(struct pipe_buffer));
+	memcpy(bufs + head, pipe->bufs, tail * sizeof(struct pipe_buffer));
+
+	if (more > 0)
+		pipe_stat_add(pipe_nr_bufs, more);
+	else
+		pipe_account_bufs(pipe, more);
+	kfree(pipe->bufs);
+	pipe->bufs = bufs;
+	pipe->buffers = nr_bufs;
+	pipe->curbuf = 0;
+	pipe_stat_inc(resizes);
+
+	/* Writers waiting for room may have some now */
+	if (more > 0) {
+		wake_up_interruptible(&pipe->wait);
+		kill_fasync(&pipe->fasync_writers, SIGIO, POLL_OUT);
+	}
+
+	return nr_bufs * PAGE_SIZE;
+}
+
+long pipe_fcntl(struct file *file, unsigned int cmd, unsigned long arg)
+{
+	struct inode *inode = file->f_dentry->d_inode;
+	struct pipe_inode_info *pipe;
+	unsigned long nr_bufs;
+	long ret;
+
+	if (!S_ISFIFO(inode->i_mode))
+		return -EBADF;
+
+	mutex_lock(&inode->i_mutex);
+	pipe = inode->i_pipe;
+	ret = -EBADF;
+	if (!pipe)
+		goto out;
+
+	switch (cmd) {
+	case F_SETPIPE_SZ:
+		ret = -EINVAL;
+		if (!arg || arg > (unsigned long)PIPE_MAX_BUFFERS * PAGE_SIZE)
+			break;
+		nr_bufs = roundup_pow_of_two((arg + PAGE_SIZE - 1) >> PAGE_SHIFT);
+		/* the limit applies to the ring actually allocated */
+		ret = -EPERM;
+		if (nr_bufs * PAGE_SIZE > pipe_max_size &&
+		    !capable(CAP_SYS_RESOURCE))
+			break;
+		ret = pipe_set_size(pipe, nr_bufs);
+		break;
+	case F_GETPIPE_SZ:
+		ret = pipe->buffers * PAGE_SIZE;
+		break;
+	default:
+		ret = -EINVAL;
+		break;
+	}
+out:
+	mutex_unlock(&inode->i_mutex);
+	return ret;
+}
+
+#ifdef CONFIG_PIPE_STATS
+#define PIPE_STAT_VERSION 1
+
+static int show_pipe_stat(struct seq_file *seq, void *v)
+{
+	struct pipe_stat sum;
+	int cpu, i;
+
+	memset(&sum, 0, sizeof(sum));
+	for_each_possible_cpu(cpu) {
+		struct pipe_stat *st = &per_cpu(pipe_stats, cpu);
+
+		sum.writes += st->writes;
+		for (i = 0; i < PIPE_STAT_FILL; i++)
+			sum.fill[i] += st->fill[i];
+		sum.write_waits += st->write_waits;
+		sum.read_waits += st->read_waits;
+		sum.resizes += st->resizes;
+	}
+
+	seq_printf(seq, "version %d\n", PIPE_STAT_VERSION);
+	seq_printf(seq, "pipes %d buffers %d\n", atomic_read(&pipe_nr),
+		   atomic_read(&pipe_nr_bufs));
+	seq_printf(seq, "writes %lu\n", sum.writes);
+	seq_printf(seq, "fill");
+	for (i = 0; i < PIPE_STAT_FILL; i++)
+		seq_printf(seq, " %lu", sum.fill[i]);
+	seq_putc(seq, '\n');
+	seq_printf(seq, "write_waits %lu read_waits %lu\n", sum.write_waits,
+		   sum.read_waits);
+	seq_printf(seq, "resizes %lu\n", sum.resizes);
+
+	return 0;
+}
+
+DEFINE_SEQ_STAT_FILE(pipe_stat);
+#endif
+
 static struct vfsmount *pipe_mnt __read_mostly;
 static int pipefs_delete_dentry(struct dentry *dentry)
 {
@@ -112,6 +112,12 @@ enum pid_directory_inos {
 #ifdef CONFIG_SCHEDSTATS
 	PROC_TGID_SCHEDSTAT,
 #endif
+#ifdef CONFIG_SCHED_FAIR
+	PROC_TGID_SCHED,
+#endif
+#ifdef CONFIG_SCHED_LATENCY_HIST
+	PROC_TGID_SCHEDLAT,
+#endif
 #ifdef CONFIG_CPUSETS
 	PROC_TGID_CPUSET,
 #endif
@@ -153,6 +159,12 @@ enum pid_directory_inos {
 #ifdef CONFIG_SCHEDSTATS
 	PROC_TID_SCHEDSTAT,
 #endif
+#ifdef CONFIG_SCHED_FAIR
+	PROC_TID_SCHED,
+#endif
+#ifdef CONFIG_SCHED_LATENCY_HIST
+	PROC_TID_SCHEDLAT,
+#endif
 #ifdef CONFIG_CPUSETS
 	PROC_TID_CPUSET,
 #endif
@@ -216,6 +228,12 @@ static struct pid_entry tgid_base_stuff[] = {
 #ifdef CONFIG_SCHEDSTATS
 	E(PROC_TGID_SCHEDSTAT, "schedstat", S_IFREG|S_IRUGO),
 #endif
+#ifdef CONFIG_SCHED_FAIR
+	E(PROC_TGID_SCHED,     "sched",   S_IFREG|S_IRUGO),
+#endif
+#ifdef CONFIG_SCHED_LATENCY_HIST
+	E(PROC_TGID_SCHEDLAT,  "schedlat", S_IFREG|S_IRUGO),
+#endif
 #ifdef CONFIG_CPUSETS
 	E(PROC_TGID_CPUSET,    "cpuset",  S_IFREG|S_IRUGO),
 #endif
@@ -258,6 +276,12 @@ static struct pid_entry tid_base_stuff[] = {
 #ifdef CONFIG_SCHEDSTATS
 	E(PROC_TID_SCHEDSTAT, "schedstat",S_IFREG|S_IRUGO),
 #endif
+#ifdef CONFIG_SCHED_FAIR
+	E(PROC_TID_SCHED,      "sched",   S_IFREG|S_IRUGO),
+#endif
+#ifdef CONFIG_SCHED_LATENCY_HIST
+	E(PROC_TID_SCHEDLAT,   "schedlat", S_IFREG|S_IRUGO),
+#endif
 #ifdef CONFIG_CPUSETS
 	E(PROC_TID_CPUSET,     "cpuset",  S_IFREG|S_IRUGO),
 #endif
@@ -1817,6 +1841,20 @@ static struct dentry *proc_pident_lookup(struct inode *dir,
 			ei->op.proc_read = proc_pid_schedstat;
 			break;
 #endif
+#ifdef CONFIG_SCHED_FAIR
+		case PROC_TID_SCHED:
+		case PROC_TGID_SCHED:
+			inode->i_fop = &proc_info_file_operations;
+			ei->op.proc_read = proc_pid_sched;
+			break;
+#endif
+#ifdef CONFIG_SCHED_LATENCY_HIST
+		case PROC_TID_SCHEDLAT:
+		case PROC_TGID_SCHEDLAT:
+			inode->i_fop = &proc_info_file_operations;
+			ei->op.proc_read = proc_pid_schedlat;
+			break;
+#endif
 #ifdef CONFIG_CPUSETS
 		case PROC_TID_CPUSET:
 		case PROC_TGID_CPUSET:
@@ -2128,42 +2166,30 @@ out:
 #define PROC_MAXPIDS 20
 
 /*
- * Get a few tgid's to return for filldir - we need to hold the
- * tasklist lock while doing this, and we must release it before
- * we actually do the filldir itself, so we use a temp buffer..
+ * The first thread group leader with a tgid of at least 'tgid', or -1.
+ * The PIDs are walked in order, so a readdir that is interrupted and
+ * continued neither misses nor repeats processes that stay around.
  */
-static int get_tgid_list(int index, unsigned long version, unsigned int *tgids)
+static int next_tgid(int tgid)
 {
-	struct task_struct *p;
-	int nr_tgids = 0;
-
-	index--;
-	read_lock(&tasklist_lock);
-	p = NULL;
-	if (version) {
-		p = find_task_by_pid(version);
-		if (p && !thread_group_leader(p))
-			p = NULL;
-	}
-
-	if (p)
-		index = 0;
-	else
-		p = next_task(&init_task);
+	struct task_struct *task;
+	struct pid *pid;
 
-	for ( ; p != &init_task; p = next_task(p)) {
-		int tgid = p->pid;
-		if (!pid_alive(p))
-			continue;
-		if (--index >= 0)
-			continue;
-		tgids[nr_tgids] = tgid;
-		nr_tgids++;
-		if (nr_tgids >= PROC_MAXPIDS)
+	rcu_read_lock();
+	for (;;) {
+		pid = find_ge_pid(tgid);
+		if (!pid) {
+			tgid = -1;
+			break;
+		}
+		tgid = pid->nr;
+		task = pid_task(pid, PIDTYPE_PID);
+		if (task && thread_group_leader(task))
 			break;
+		tgid++;
 	}
-	read_unlock(&tasklist_lock);
-	return nr_tgids;
+	rcu_read_unlock();
+	return tgid;
 }
 
 /*
@@ -2199,62 +2225,41 @@ static int get_tid_list(int index, unsigned int *tids, struct inode *dir)
 	return nr_tids;
 }
 
+/*
+ * The process entries of /proc are at f_pos tgid + TGID_OFFSET, after
+ * "self" at FIRST_PROCESS_ENTRY:
+ */
+#define TGID_OFFSET (FIRST_PROCESS_ENTRY + 1)
+
 /* for the /proc/ directory itself, after non-process stuff has been done */
 int proc_pid_readdir(struct file * filp, void * dirent, filldir_t filldir)
 {
-	unsigned int tgid_array[PROC_MAXPIDS];
 	char buf[PROC_NUMBUF];
 	unsigned int nr = filp->f_pos - FIRST_PROCESS_ENTRY;
-	unsigned int nr_tgids, i;
-	int next_tgid;
+	int tgid;
 
 	if (!nr) {
 		ino_t ino = fake_ino(0,PROC_TGID_INO);
 		if (filldir(dirent, "self", 4, filp->f_pos, ino, DT_LNK) < 0)
 			return 0;
 		filp->f_pos++;
-		nr++;
 	}
 
-	/* f_version caches the tgid value that the last readdir call couldn't
-	 * return. lseek aka telldir automagically resets f_version to 0.
-	 */
-	next_tgid = filp->f_version;
-	filp->f_version = 0;
-	for (;;) {
-		nr_tgids = get_tgid_list(nr, next_tgid, tgid_array);
-		if (!nr_tgids) {
-			/* no more entries ! */
-			break;
-		}
-		next_tgid = 0;
-
-		/* do not use the last found pid, reserve it for next_tgid */
-		if (nr_tgids == PROC_MAXPIDS) {
-			nr_tgids--;
-			next_tgid = tgid_array[nr_tgids];
-		}
-
-		for (i=0;i<nr_tgids;i++) {
-			int tgid = tgid_array[i];
-			ino_t ino = fake_ino(tgid,PROC_TGID_INO);
-			unsigned long j = PROC_NUMBUF;
+	for (tgid = next_tgid(filp->f_pos - TGID_OFFSET); tgid >= 0;
+	     tgid = next_tgid(tgid + 1)) {
+		ino_t ino = fake_ino(tgid,PROC_TGID_INO);
+		unsigned long j = PROC_NUMBUF;
+		int i = tgid;
 
-			do
-				buf[--j] = '0' + (tgid % 10);
-			while ((tgid /= 10) != 0);
+		do
+			buf[--j] = '0' + (i % 10);
+		while ((i /= 10) != 0);
 
-			if (filldir(dirent, buf+j, PROC_NUMBUF-j, filp->f_pos, ino, DT_DIR) < 0) {
-				/* returning this tgid failed, save it as the first
-				 * pid for the next readir call */
-				filp->f_version = tgid_array[i];
-				goto out;
-			}
-			filp->f_pos++;
-			nr++;
-		}
+		filp->f_pos = tgid + TGID_OFFSET;
+		if (filldir(dirent, buf+j, PROC_NUMBUF-j, filp->f_pos, ino, DT_DIR) < 0)
+			return 0;
 	}
-out:
+	filp->f_pos = PID_MAX_LIMIT + TGID_OFFSET;
 	return 0;
 }
 
@@ -46,6 +46,11 @@
 #include <linux/sysrq.h>
 #include <linux/vmalloc.h>
 #include <linux/crash_dump.h>
+#include <linux/futex.h>
+#include <linux/rcupdate.h>
+#include <linux/workqueue.h>
+#include <linux/eventpoll.h>
+#include <linux/pipe_fs_i.h>
 #include <asm/uaccess.h>
 #include <asm/pgtable.h>
 #include <asm/io.h>
@@ -701,6 +706,37 @@ void __init proc_misc_init(void)
 #ifdef CONFIG_SCHEDSTATS
 	create_seq_entry("schedstat", 0, &proc_schedstat_operations);
 #endif
+#ifdef CONFIG_SCHED_LATENCY_HIST
+	create_seq_entry("schedlat", 0, &proc_schedlat_operations);
+#endif
+#ifdef CONFIG_TIMER_HIST
+	create_seq_entry("timer_hist", 0, &proc_timer_hist_operations);
+#endif
+#ifdef CONFIG_FUTEX
+	create_seq_entry("futex_stat", 0, &proc_futex_stat_operations);
+#endif
+#ifdef CONFIG_RCU_STATS
+	create_seq_entry("rcu_stat", 0, &proc_rcu_stat_operations);
+#endif
+#ifdef CONFIG_WORKQUEUE_STATS
+	create_seq_entry("workqueue_stat", 0, &proc_workqueue_stat_operations);
+#endif
+#ifdef CONFIG_MUTEX_STATS
+	create_seq_entry("mutex_stat", 0, &proc_mutex_stat_operations);
+#endif
+#ifdef CONFIG_BLK_PLUG_STATS
+	create_seq_entry("plug_stat", 0, &proc_plug_stat_operations);
+#endif
+#ifdef CONFIG_EPOLL_STATS
+	create_seq_entry("epoll_stat", 0, &proc_epoll_stat_operations);
+#endif
+#ifdef CONFIG_PIPE_STATS
+	create_seq_entry("pipe_stat", 0, &proc_pipe_stat_operations);
+#endif
+#ifdef CONFIG_LOCK_STAT
+	create_seq_entry("lock_stat", S_IWUSR|S_IRUGO,
+			 &proc_lock_stat_operations);
+#endif
 #ifdef CONFIG_PROC_KCORE
 	proc_root_kcore = create_proc_entry("kcore", S_IRUSR, NULL);
 	if (proc_root_kcore) {
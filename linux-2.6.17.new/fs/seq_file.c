@@ -447,3 +447,21 @@ int seq_puts(struct seq_file *m, const char *s)
 	return -1;
 }
 EXPORT_SYMBOL(seq_puts);
+
+/**
+ *	seq_put_hist -	print a histogram
+ *	@m: seq_file to print into
+ *	@hist: the buckets
+ *	@nr: number of buckets
+ *
+ *	Prints each bucket preceded by a space, and ends the line.
+ */
+int seq_put_hist(struct seq_file *m, const unsigned int *hist, int nr)
+{
+	int i;
+
+	for (i = 0; i < nr; i++)
+		seq_printf(m, " %u", hist[i]);
+	return seq_putc(m, '\n');
+}
+EXPORT_SYMBOL(seq_put_hist);
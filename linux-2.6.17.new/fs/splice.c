@@ -41,10 +41,46 @@ struct splice_pipe_desc {
 	struct page **pages;		/* page map */
 	struct partial_page *partial;	/* pages[] may not be contig */
 	int nr_pages;			/* number of pages in map */
+	int nr_pages_max;		/* size of the map */
 	unsigned int flags;		/* splice flags */
 	struct pipe_buf_operations *ops;/* ops associated with output pipe */
 };
 
+/*
+ * The page map of a splice_pipe_desc starts out as PIPE_DEF_BUFFERS entries
+ * on the stack. For a pipe that has been grown, allocate one the size of
+ * its ring, so that a single call can fill all of it.
+ */
+static int splice_grow_spd(struct pipe_inode_info *pipe,
+			   struct splice_pipe_desc *spd)
+{
+	unsigned int buffers = pipe->buffers;
+
+	spd->nr_pages_max = PIPE_DEF_BUFFERS;
+	if (buffers <= PIPE_DEF_BUFFERS)
+		return 0;
+
+	spd->pages = kmalloc(buffers * sizeof(struct page *), GFP_KERNEL);
+	spd->partial = kmalloc(buffers * sizeof(struct partial_page),
+			       GFP_KERNEL);
+	if (!spd->pages || !spd->partial) {
+		kfree(spd->pages);
+		kfree(spd->partial);
+		return -ENOMEM;
+	}
+	spd->nr_pages_max = buffers;
+	return 0;
+}
+
+static void splice_shrink_spd(struct splice_pipe_desc *spd)
+{
+	if (spd->nr_pages_max <= PIPE_DEF_BUFFERS)
+		return;
+
+	kfree(spd->pages);
+	kfree(spd->partial);
+}
+
 /*
  * Attempt to steal a page from a pipe buffer. This should perhaps go into
  * a vm helper function, it's already simplified quite a bit by the
@@ -173,6 +209,8 @@ static ssize_t splice_to_pipe(struct pipe_inode_info *pipe,
 	if (pipe->inode)
 		mutex_lock(&pipe->inode->i_mutex);
 
+	pipe_stat_write(pipe);
+
 	for (;;) {
 		if (!pipe->readers) {
 			send_sig(SIGPIPE, current, 0);
@@ -181,8 +219,8 @@ static ssize_t splice_to_pipe(struct pipe_inode_info *pipe,
 			break;
 		}
 
-		if (pipe->nrbufs < PIPE_BUFFERS) {
-			int newbuf = (pipe->curbuf + pipe->nrbufs) & (PIPE_BUFFERS - 1);
+		if (pipe->nrbufs < pipe->buffers) {
+			int newbuf = (pipe->curbuf + pipe->nrbufs) & (pipe->buffers - 1);
 			struct pipe_buffer *buf = pipe->bufs + newbuf;
 
 			buf->page = spd->pages[page_nr];
@@ -201,7 +239,7 @@ static ssize_t splice_to_pipe(struct pipe_inode_info *pipe,
 
 			if (!--spd->nr_pages)
 				break;
-			if (pipe->nrbufs < PIPE_BUFFERS)
+			if (pipe->nrbufs < pipe->buffers)
 				continue;
 
 			break;
@@ -228,6 +266,7 @@ static ssize_t splice_to_pipe(struct pipe_inode_info *pipe,
 		}
 
 		pipe->waiting_writers++;
+		pipe_stat_inc(write_waits);
 		pipe_wait(pipe);
 		pipe->waiting_writers--;
 	}
@@ -255,26 +294,31 @@ __generic_file_splice_read(struct file *in, loff_t *ppos,
 {
 	struct address_space *mapping = in->f_mapping;
 	unsigned int loff, nr_pages;
-	struct page *pages[PIPE_BUFFERS];
-	struct partial_page partial[PIPE_BUFFERS];
+	struct page *pages_def[PIPE_DEF_BUFFERS], **pages;
+	struct partial_page partial_def[PIPE_DEF_BUFFERS], *partial;
 	struct page *page;
 	pgoff_t index, end_index;
 	loff_t isize;
 	size_t total_len;
 	int error, page_nr;
 	struct splice_pipe_desc spd = {
-		.pages = pages,
-		.partial = partial,
+		.pages = pages_def,
+		.partial = partial_def,
 		.flags = flags,
 		.ops = &page_cache_pipe_buf_ops,
 	};
 
+	if (splice_grow_spd(pipe, &spd))
+		return -ENOMEM;
+	pages = spd.pages;
+	partial = spd.partial;
+
 	index = *ppos >> PAGE_CACHE_SHIFT;
 	loff = *ppos & ~PAGE_CACHE_MASK;
 	nr_pages = (len + loff + PAGE_CACHE_SIZE - 1) >> PAGE_CACHE_SHIFT;
 
-	if (nr_pages > PIPE_BUFFERS)
-		nr_pages = PIPE_BUFFERS;
+	if (nr_pages > spd.nr_pages_max)
+		nr_pages = spd.nr_pages_max;
 
 	/*
 	 * Initiate read-ahead on this page range. however, don't call into
@@ -447,8 +491,9 @@ fill_it:
 		page_cache_release(pages[page_nr++]);
 
 	if (spd.nr_pages)
-		return splice_to_pipe(pipe, &spd);
+		error = splice_to_pipe(pipe, &spd);
 
+	splice_shrink_spd(&spd);
 	return error;
 }
 
@@ -743,7 +788,7 @@ ssize_t splice_from_pipe(struct pipe_inode_info *pipe, struct file *out,
 			if (!buf->len) {
 				buf->ops = NULL;
 				ops->release(pipe, buf);
-				pipe->curbuf = (pipe->curbuf + 1) & (PIPE_BUFFERS - 1);
+				pipe->curbuf = (pipe->curbuf + 1) & (pipe->buffers - 1);
 				pipe->nrbufs--;
 				if (pipe->inode)
 					do_wakeup = 1;
@@ -782,6 +827,7 @@ ssize_t splice_from_pipe(struct pipe_inode_info *pipe, struct file *out,
 			do_wakeup = 0;
 		}
 
+		pipe_stat_inc(read_waits);
 		pipe_wait(pipe);
 	}
 
@@ -964,9 +1010,9 @@ long do_splice_direct(struct file *in, loff_t *ppos, struct file *out,
 		size_t read_len, max_read_len;
 
 		/*
-		 * Do at most PIPE_BUFFERS pages worth of transfer:
+		 * Do at most one ring worth of transfer:
 		 */
-		max_read_len = min(len, (size_t)(PIPE_BUFFERS*PAGE_SIZE));
+		max_read_len = min(len, (size_t)(pipe->buffers*PAGE_SIZE));
 
 		ret = do_splice_to(in, ppos, pipe, max_read_len, flags);
 		if (unlikely(ret < 0))
@@ -1008,7 +1054,7 @@ out_release:
 	 * If we did an incomplete transfer we must release
 	 * the pipe buffers in question:
 	 */
-	for (i = 0; i < PIPE_BUFFERS; i++) {
+	for (i = 0; i < pipe->buffers; i++) {
 		struct pipe_buffer *buf = pipe->bufs + i;
 
 		if (buf->ops) {
@@ -1089,12 +1135,13 @@ static long do_splice(struct file *in, loff_t __user *off_in,
  * Map an iov into an array of pages and offset/length tupples. With the
  * partial_page structure, we can map several non-contiguous ranges into
  * our ones pages[] map instead of splitting that operation into pieces.
- * Could easily be exported as a generic helper for other users, in which
- * case one would probably want to add a 'max_nr_pages' parameter as well.
+ * Could easily be exported as a generic helper for other users. At most
+ * 'max_nr_pages' pages are mapped.
  */
 static int get_iovec_page_array(const struct iovec __user *iov,
 				unsigned int nr_vecs, struct page **pages,
-				struct partial_page *partial, int aligned)
+				struct partial_page *partial, int aligned,
+				int max_nr_pages)
 {
 	int buffers = 0, error = 0;
 
@@ -1144,8 +1191,8 @@ static int get_iovec_page_array(const struct iovec __user *iov,
 			break;
 
 		npages = (off + len + PAGE_SIZE - 1) >> PAGE_SHIFT;
-		if (npages > PIPE_BUFFERS - buffers)
-			npages = PIPE_BUFFERS - buffers;
+		if (npages > max_nr_pages - buffers)
+			npages = max_nr_pages - buffers;
 
 		error = get_user_pages(current, current->mm,
 				       (unsigned long) base, npages, 0, 0,
@@ -1181,7 +1228,7 @@ static int get_iovec_page_array(const struct iovec __user *iov,
 		 * or if we mapped the max number of pages that we have
 		 * room for.
 		 */
-		if (error < npages || buffers == PIPE_BUFFERS)
+		if (error < npages || buffers == max_nr_pages)
 			break;
 
 		nr_vecs--;
@@ -1220,14 +1267,15 @@ static long do_vmsplice(struct file *file, const struct iovec __user *iov,
 			unsigned long nr_segs, unsigned int flags)
 {
 	struct pipe_inode_info *pipe = file->f_dentry->d_inode->i_pipe;
-	struct page *pages[PIPE_BUFFERS];
-	struct partial_page partial[PIPE_BUFFERS];
+	struct page *pages[PIPE_DEF_BUFFERS];
+	struct partial_page partial[PIPE_DEF_BUFFERS];
 	struct splice_pipe_desc spd = {
 		.pages = pages,
 		.partial = partial,
 		.flags = flags,
 		.ops = &user_page_pipe_buf_ops,
 	};
+	long ret;
 
 	if (unlikely(!pipe))
 		return -EBADF;
@@ -1236,12 +1284,19 @@ static long do_vmsplice(struct file *file, const struct iovec __user *iov,
 	else if (unlikely(!nr_segs))
 		return 0;
 
-	spd.nr_pages = get_iovec_page_array(iov, nr_segs, pages, partial,
-					    flags & SPLICE_F_GIFT);
+	if (splice_grow_spd(pipe, &spd))
+		return -ENOMEM;
+
+	spd.nr_pages = get_iovec_page_array(iov, nr_segs, spd.pages,
+					    spd.partial, flags & SPLICE_F_GIFT,
+					    spd.nr_pages_max);
 	if (spd.nr_pages <= 0)
-		return spd.nr_pages;
+		ret = spd.nr_pages;
+	else
+		ret = splice_to_pipe(pipe, &spd);
 
-	return splice_to_pipe(pipe, &spd);
+	splice_shrink_spd(&spd);
+	return ret;
 }
 
 asmlinkage long sys_vmsplice(int fd, const struct iovec __user *iov,
@@ -1320,6 +1375,8 @@ static int link_pipe(struct pipe_inode_info *ipipe,
 		mutex_lock(&ipipe->inode->i_mutex);
 	}
 
+	pipe_stat_write(opipe);
+
 	for (i = 0;; i++) {
 		if (!opipe->readers) {
 			send_sig(SIGPIPE, current, 0);
@@ -1328,13 +1385,13 @@ static int link_pipe(struct pipe_inode_info *ipipe,
 			break;
 		}
 		if (ipipe->nrbufs - i) {
-			ibuf = ipipe->bufs + ((ipipe->curbuf + i) & (PIPE_BUFFERS - 1));
+			ibuf = ipipe->bufs + ((ipipe->curbuf + i) & (ipipe->buffers - 1));
 
 			/*
 			 * If we have room, fill this buffer
 			 */
-			if (opipe->nrbufs < PIPE_BUFFERS) {
-				int nbuf = (opipe->curbuf + opipe->nrbufs) & (PIPE_BUFFERS - 1);
+			if (opipe->nrbufs < opipe->buffers) {
+				int nbuf = (opipe->curbuf + opipe->nrbufs) & (opipe->buffers - 1);
 
 				/*
 				 * Get a reference to this pipe buffer,
@@ -1361,7 +1418,7 @@ static int link_pipe(struct pipe_inode_info *ipipe,
 
 				if (!len)
 					break;
-				if (opipe->nrbufs < PIPE_BUFFERS)
+				if (opipe->nrbufs < opipe->buffers)
 					continue;
 			}
 
@@ -1390,6 +1447,7 @@ static int link_pipe(struct pipe_inode_info *ipipe,
 			}
 
 			opipe->waiting_writers++;
+			pipe_stat_inc(write_waits);
 			pipe_wait(opipe);
 			opipe->waiting_writers--;
 			continue;
@@ -1425,6 +1483,7 @@ static int link_pipe(struct pipe_inode_info *ipipe,
 			wake_up_interruptible_sync(&ipipe->wait);
 		kill_fasync(&ipipe->fasync_writers, SIGIO, POLL_OUT);
 
+		pipe_stat_inc(read_waits);
 		pipe_wait(ipipe);
 	}
 
@@ -89,6 +89,11 @@ fastcall int  __down_failed_interruptible(void  /* params in registers */);
 fastcall int  __down_failed_trylock(void  /* params in registers */);
 fastcall void __up_wakeup(void /* special register calling convention */);
 
+#ifdef CONFIG_LOCK_STAT
+fastcall void lock_stat_down(struct semaphore *sem);
+fastcall int lock_stat_down_interruptible(struct semaphore *sem);
+#endif
+
 /*
  * This is ugly, but we want the default case to fall through.
  * "__down_failed" is a special asm handler that calls the C
@@ -97,6 +102,11 @@ fastcall void __up_wakeup(void /* special register calling convention */);
 static inline void down(struct semaphore * sem)
 {
 	might_sleep();
+#ifdef CONFIG_LOCK_STAT
+	/* the same, but accounting the contention to our caller */
+	if (unlikely(atomic_add_negative(-1, &sem->count)))
+		lock_stat_down(sem);
+#else
 	__asm__ __volatile__(
 		"# atomic down operation\n\t"
 		LOCK_PREFIX "decl %0\n\t"     /* --sem->count */
@@ -110,6 +120,7 @@ static inline void down(struct semaphore * sem)
 		:"=m" (sem->count)
 		:
 		:"memory","ax");
+#endif
 }
 
 /*
@@ -121,6 +132,11 @@ static inline int down_interruptible(struct semaphore * sem)
 	int result;
 
 	might_sleep();
+#ifdef CONFIG_LOCK_STAT
+	result = 0;
+	if (unlikely(atomic_add_negative(-1, &sem->count)))
+		result = lock_stat_down_interruptible(sem);
+#else
 	__asm__ __volatile__(
 		"# atomic interruptible down operation\n\t"
 		LOCK_PREFIX "decl %1\n\t"     /* --sem->count */
@@ -135,6 +151,7 @@ static inline int down_interruptible(struct semaphore * sem)
 		:"=a" (result), "=m" (sem->count)
 		:
 		:"memory");
+#endif
 	return result;
 }
 
@@ -13,11 +13,84 @@
  * Simple spin lock operations.  There are two variants, one clears IRQ's
  * on the local processor, one does not.
  *
- * We make no fairness assumptions. They have a cost.
+ * We make no fairness assumptions, unless CONFIG_TICKET_SPINLOCKS is
+ * set. They have a cost.
  *
  * (the type definitions are in asm/spinlock_types.h)
  */
 
+#ifdef CONFIG_TICKET_SPINLOCKS
+/*
+ * Ticket spinlocks: the low 16 bits of the lock word are the ticket now
+ * being served, the high 16 bits the next ticket to be handed out. A CPU
+ * draws a ticket with a single locked xadd and then only reads the lock
+ * word until its number comes up, so the lock is granted in FIFO order.
+ * Only the holder writes the low half, so unlock is a plain incw (locked
+ * on PPro SMP and OOSTORE, see below).
+ */
+#define TICKET_SHIFT	16
+
+static inline int __raw_spin_is_locked(raw_spinlock_t *lock)
+{
+	unsigned int tmp = lock->slock;
+
+	return ((tmp >> TICKET_SHIFT) ^ tmp) & 0xffff;
+}
+
+static inline void __raw_spin_lock(raw_spinlock_t *lock)
+{
+	int inc = 1 << TICKET_SHIFT;
+	int tmp;
+
+	__asm__ __volatile__(
+		LOCK_PREFIX "xaddl %0,%1\n\t"
+		"movzwl %w0,%2\n\t"
+		"shrl $16,%0\n"
+		"1:\t"
+		"cmpl %0,%2\n\t"
+		"je 2f\n\t"
+		"rep;nop\n\t"
+		"movzwl %1,%2\n\t"
+		"jmp 1b\n"
+		"2:"
+		:"+r" (inc), "+m" (lock->slock), "=&r" (tmp)
+		: : "memory", "cc");
+}
+
+/* a waiter holds its place in the queue, it cannot enable interrupts */
+#define __raw_spin_lock_flags(lock, flags) __raw_spin_lock(lock)
+
+static inline int __raw_spin_trylock(raw_spinlock_t *lock)
+{
+	unsigned int old = lock->slock, prev;
+
+	if (((old >> TICKET_SHIFT) ^ old) & 0xffff)
+		return 0;
+
+	__asm__ __volatile__(
+		LOCK_PREFIX "cmpxchgl %2,%1"
+		:"=a" (prev), "+m" (lock->slock)
+		:"r" (old + (1 << TICKET_SHIFT)), "0" (old)
+		: "memory", "cc");
+
+	return prev == old;
+}
+
+#if !defined(CONFIG_X86_OOSTORE) && !defined(CONFIG_X86_PPRO_FENCE)
+# define __raw_spin_unlock_prefix
+#else
+# define __raw_spin_unlock_prefix	LOCK_PREFIX
+#endif
+
+static inline void __raw_spin_unlock(raw_spinlock_t *lock)
+{
+	__asm__ __volatile__(
+		__raw_spin_unlock_prefix "incw %0"
+		:"+m" (lock->slock) : : "memory", "cc");
+}
+
+#else /* !CONFIG_TICKET_SPINLOCKS */
+
 #define __raw_spin_is_locked(x) \
 		(*(volatile signed char *)(&(x)->slock) <= 0)
 
@@ -121,6 +194,8 @@ static inline void __raw_spin_unlock(raw_spinlock_t *lock)
 
 #endif
 
+#endif /* CONFIG_TICKET_SPINLOCKS */
+
 #define __raw_spin_unlock_wait(lock) \
 	do { while (__raw_spin_is_locked(lock)) cpu_relax(); } while (0)
 
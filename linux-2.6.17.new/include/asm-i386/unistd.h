@@ -322,8 +322,10 @@
 #define __NR_sync_file_range	314
 #define __NR_tee		315
 #define __NR_vmsplice		316
+#define __NR_ioring_setup	317
+#define __NR_ioring_enter	318
 
-#define NR_syscalls 317
+#define NR_syscalls 319
 
 /*
  * user-visible error numbers are in the range -1 - -128: see
@@ -90,6 +90,11 @@ asmlinkage int  __down_failed_interruptible(void  /* params in registers */);
 asmlinkage int  __down_failed_trylock(void  /* params in registers */);
 asmlinkage void __up_wakeup(void /* special register calling convention */);
 
+#ifdef CONFIG_LOCK_STAT
+fastcall void lock_stat_down(struct semaphore *sem);
+fastcall int lock_stat_down_interruptible(struct semaphore *sem);
+#endif
+
 asmlinkage void __down(struct semaphore * sem);
 asmlinkage int  __down_interruptible(struct semaphore * sem);
 asmlinkage int  __down_trylock(struct semaphore * sem);
@@ -104,6 +109,11 @@ static inline void down(struct semaphore * sem)
 {
 	might_sleep();
 
+#ifdef CONFIG_LOCK_STAT
+	/* the same, but accounting the contention to our caller */
+	if (unlikely(atomic_add_negative(-1, &sem->count)))
+		lock_stat_down(sem);
+#else
 	__asm__ __volatile__(
 		"# atomic down operation\n\t"
 		LOCK "decl %0\n\t"     /* --sem->count */
@@ -116,6 +126,7 @@ static inline void down(struct semaphore * sem)
 		:"=m" (sem->count)
 		:"D" (sem)
 		:"memory");
+#endif
 }
 
 /*
@@ -128,6 +139,11 @@ static inline int down_interruptible(struct semaphore * sem)
 
 	might_sleep();
 
+#ifdef CONFIG_LOCK_STAT
+	result = 0;
+	if (unlikely(atomic_add_negative(-1, &sem->count)))
+		result = lock_stat_down_interruptible(sem);
+#else
 	__asm__ __volatile__(
 		"# atomic interruptible down operation\n\t"
 		LOCK "decl %1\n\t"     /* --sem->count */
@@ -141,6 +157,7 @@ static inline int down_interruptible(struct semaphore * sem)
 		:"=a" (result), "=m" (sem->count)
 		:"D" (sem)
 		:"memory");
+#endif
 	return result;
 }
 
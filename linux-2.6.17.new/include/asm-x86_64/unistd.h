@@ -617,8 +617,12 @@ __SYSCALL(__NR_tee, sys_tee)
 __SYSCALL(__NR_sync_file_range, sys_sync_file_range)
 #define __NR_vmsplice		278
 __SYSCALL(__NR_vmsplice, sys_vmsplice)
+#define __NR_ioring_setup	279
+__SYSCALL(__NR_ioring_setup, sys_ioring_setup)
+#define __NR_ioring_enter	280
+__SYSCALL(__NR_ioring_enter, sys_ioring_enter)
 
-#define __NR_syscall_max __NR_vmsplice
+#define __NR_syscall_max __NR_ioring_enter
 
 #ifndef __NO_STUBS
 
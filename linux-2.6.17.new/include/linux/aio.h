@@ -3,6 +3,8 @@
 
 #include <linux/list.h>
 #include <linux/workqueue.h>
+#include <linux/mutex.h>
+#include <linux/uio.h>
 #include <linux/aio_abi.h>
 
 #include <asm/atomic.h>
@@ -11,6 +13,7 @@
 #define AIO_KIOGRP_NR_ATOMIC	8
 
 struct kioctx;
+struct kioctx_ops;
 
 /* Notes on cancelling a kiocb:
  *	If a kiocb is cancelled, aio_complete may return 0 to indicate 
@@ -76,7 +79,11 @@ struct kioctx;
  * If ki_retry returns -EIOCBRETRY it has made a promise that kick_iocb()
  * will be called on the kiocb pointer in the future.  This may happen
  * through generic helpers that associate kiocb->ki_wait with a wait
- * queue head that ki_retry uses via current->io_wait.  It can also happen
+ * queue head that ki_retry uses via current->io_wait, such as
+ * lock_page_async().  current->io_wait is the wait_queue_t of a
+ * struct wait_bit_queue, so that bit waits can fill in the key they
+ * wait for and not be kicked by other bits sharing their hashed wait
+ * queue.  It can also happen
  * with custom tracking and manual calls to kick_iocb(), though that is
  * discouraged.  In either case, kick_iocb() must be called once and only
  * once.  ki_retry must ensure forward progress, the AIO core will wait
@@ -100,7 +107,7 @@ struct kiocb {
 	} ki_obj;
 
 	__u64			ki_user_data;	/* user's data for completion */
-	wait_queue_t		ki_wait;
+	struct wait_bit_queue	ki_wait;
 	loff_t			ki_pos;
 
 	void			*private;
@@ -113,6 +120,12 @@ struct kiocb {
 	long			ki_kicked; 	/* just for testing */
 	long			ki_queued; 	/* just for testing */
 
+	/* IOCB_CMD_PREADV and IOCB_CMD_PWRITEV */
+	struct iovec		ki_inline_vec;	/* for a single segment */
+	struct iovec		*ki_iovec;	/* what is left to do */
+	unsigned long		ki_nr_segs;
+	unsigned long		ki_cur_seg;
+
 	struct list_head	ki_list;	/* the aio core uses this
 						 * for cancellation */
 };
@@ -131,7 +144,9 @@ struct kiocb {
 		(x)->ki_dtor = NULL;			\
 		(x)->ki_obj.tsk = tsk;			\
 		(x)->ki_user_data = 0;                  \
-		init_wait((&(x)->ki_wait));             \
+		init_wait((&(x)->ki_wait.wait));        \
+		(x)->ki_wait.key.flags = NULL;          \
+		(x)->ki_iovec = NULL;                   \
 	} while (0)
 
 #define AIO_RING_MAGIC			0xa10a10a1
@@ -160,7 +175,7 @@ struct aio_ring_info {
 	unsigned long		mmap_size;
 
 	struct page		**ring_pages;
-	spinlock_t		ring_lock;
+	struct mutex		ring_lock;	/* serializes readers of the ring */
 	long			nr_pages;
 
 	unsigned		nr, tail;
@@ -191,6 +206,21 @@ struct kioctx {
 	struct aio_ring_info	ring_info;
 
 	struct work_struct	wq;
+
+	/* set for the kioctx behind an I/O ring, see fs/ioring.c */
+	const struct kioctx_ops	*ops;
+	void			*private;
+};
+
+/*
+ * An I/O ring's kioctx has completions go to complete() instead of the
+ * event ring. exit() is called first thing by exit_aio(), and free()
+ * by __put_ioctx(), so private stays around as long as the kioctx.
+ */
+struct kioctx_ops {
+	void	(*complete)(struct kioctx *, struct kiocb *, long res, long res2);
+	void	(*exit)(struct kioctx *);
+	void	(*free)(struct kioctx *);
 };
 
 /* prototypes */
@@ -205,12 +235,22 @@ struct mm_struct;
 extern void FASTCALL(exit_aio(struct mm_struct *mm));
 extern struct kioctx *lookup_ioctx(unsigned long ctx_id);
 extern int FASTCALL(io_submit_one(struct kioctx *ctx,
-			struct iocb __user *user_iocb, struct iocb *iocb));
+			struct iocb __user *user_iocb, struct iocb *iocb,
+			int compat));
 
 /* semi private, but used by the 32bit emulations: */
 struct kioctx *lookup_ioctx(unsigned long ctx_id);
 int FASTCALL(io_submit_one(struct kioctx *ctx, struct iocb __user *user_iocb,
-				  struct iocb *iocb));
+				  struct iocb *iocb, int compat));
+long do_io_submit(aio_context_t ctx_id, long nr,
+		  struct iocb __user * __user *iocbpp, int compat);
+
+/* for fs/ioring.c */
+extern struct kioctx *ioctx_alloc_ring(unsigned nr_events,
+		const struct kioctx_ops *ops, void *private);
+extern void io_destroy(struct kioctx *ioctx);
+extern void use_mm(struct mm_struct *mm);
+extern void unuse_mm(struct mm_struct *mm);
 
 #define get_ioctx(kioctx) do {						\
 	BUG_ON(unlikely(atomic_read(&(kioctx)->users) <= 0));		\
@@ -233,7 +273,7 @@ do {									\
 	}								\
 } while (0)
 
-#define io_wait_to_kiocb(wait) container_of(wait, struct kiocb, ki_wait)
+#define io_wait_to_kiocb(wait) container_of(wait, struct kiocb, ki_wait.wait)
 #define is_retried_kiocb(iocb) ((iocb)->ki_retried > 1)
 
 #include <linux/aio_abi.h>
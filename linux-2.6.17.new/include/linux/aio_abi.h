@@ -41,6 +41,10 @@ enum {
 	 * IOCB_CMD_POLL = 5,
 	 */
 	IOCB_CMD_NOOP = 6,
+	IOCB_CMD_PREADV = 7,
+	IOCB_CMD_PWRITEV = 8,
+	IOCB_CMD_SENDMSG = 9,
+	IOCB_CMD_RECVMSG = 10,
 };
 
 /* read() from /dev/aio returns these structures. */
@@ -76,8 +80,10 @@ struct iocb {
 	__s16	aio_reqprio;
 	__u32	aio_fildes;
 
-	__u64	aio_buf;
-	__u64	aio_nbytes;
+	__u64	aio_buf;	/* PREADV, PWRITEV: struct iovec array,
+				 * SENDMSG, RECVMSG: struct msghdr */
+	__u64	aio_nbytes;	/* PREADV, PWRITEV: number of iovecs,
+				 * SENDMSG, RECVMSG: MSG_* flags */
 	__s64	aio_offset;
 
 	/* extra parameters */
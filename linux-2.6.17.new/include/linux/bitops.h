@@ -60,4 +60,17 @@ static inline unsigned fls_long(unsigned long l)
 	return fls64(l);
 }
 
+/*
+ * log2_bucket - bucket of @val in a log2 histogram of @nr buckets
+ *
+ * Bucket 0 counts zeroes, bucket k values in [2^(k-1), 2^k), and the
+ * last bucket everything above.
+ */
+static inline int log2_bucket(unsigned long long val, int nr)
+{
+	int idx = fls64(val);
+
+	return idx < nr ? idx : nr - 1;
+}
+
 #endif
@@ -0,0 +1,94 @@
+#ifndef BLK_MQ_H
+#define BLK_MQ_H
+
+/*
+ * Multi-queue block devices, see Documentation/block/multiqueue.txt
+ */
+
+#include <linux/blkdev.h>
+
+/*
+ * Every CPU submits to a software queue of its own. The software queues
+ * are mapped onto the hardware dispatch contexts of the driver, one for
+ * every submission queue the device has.
+ */
+struct blk_mq_ctx {
+	spinlock_t		lock;
+	struct list_head	rq_list;	/* requests not dispatched yet */
+	unsigned int		cpu;
+	unsigned int		last_tag;	/* where to look for a free tag */
+	struct blk_mq_hw_ctx	*hctx;
+} ____cacheline_aligned_in_smp;
+
+struct blk_mq_hw_ctx {
+	unsigned long		state;		/* BLK_MQ_S_* */
+	cpumask_t		pending;	/* software queues with requests */
+
+	/*
+	 * Requests the driver was busy for. Only touched by whoever runs
+	 * the context, see blk_mq_run_hw_queue().
+	 */
+	struct list_head	dispatch;
+
+	struct blk_queue_tag	*tags;
+	struct request		*rqs;		/* one for every tag */
+	wait_queue_head_t	wait;		/* for a free tag */
+
+	request_queue_t		*queue;
+	unsigned int		queue_num;
+	cpumask_t		cpumask;	/* CPUs mapped to this context */
+	struct work_struct	run_work;
+	void			*driver_data;
+} ____cacheline_aligned_in_smp;
+
+enum {
+	BLK_MQ_RQ_QUEUE_OK	= 0,	/* the driver took the request */
+	BLK_MQ_RQ_QUEUE_BUSY	= 1,	/* no room, the context was stopped */
+	BLK_MQ_RQ_QUEUE_ERROR	= 2,	/* end the request with an error */
+
+	BLK_MQ_S_STOPPED	= 0,
+	BLK_MQ_S_RUNNING	= 1,
+
+	BLK_MQ_MAX_DEPTH	= 256,
+};
+
+typedef int (queue_rq_fn)(struct blk_mq_hw_ctx *, struct request *);
+
+struct blk_mq_ops {
+	/*
+	 * Hand a request to the hardware. Called in process context, with
+	 * the requests of one hardware context serialized. A driver that
+	 * returns BLK_MQ_RQ_QUEUE_BUSY must have stopped the context with
+	 * blk_mq_stop_hw_queue() first, and start it again once it has
+	 * room.
+	 */
+	queue_rq_fn		*queue_rq;
+};
+
+struct blk_mq_reg {
+	struct blk_mq_ops	*ops;
+	unsigned int		nr_hw_queues;
+	unsigned int		queue_depth;	/* per hardware context */
+	int			numa_node;
+};
+
+extern request_queue_t *blk_mq_init_queue(struct blk_mq_reg *, void *);
+extern void blk_mq_end_io(struct request *, int);
+
+extern void blk_mq_run_hw_queue(struct blk_mq_hw_ctx *, int);
+extern void blk_mq_run_queues(request_queue_t *, int);
+extern void blk_mq_stop_hw_queue(struct blk_mq_hw_ctx *);
+extern void blk_mq_start_hw_queue(struct blk_mq_hw_ctx *);
+extern void blk_mq_start_stopped_hw_queues(request_queue_t *);
+
+#define queue_for_each_hw_ctx(q, hctx, i)				\
+	for ((i) = 0; (i) < (q)->nr_hw_queues &&			\
+	     ({ hctx = (q)->queue_hw_ctx[i]; 1; }); (i)++)
+
+static inline struct request *blk_mq_tag_to_rq(struct blk_mq_hw_ctx *hctx,
+					       int tag)
+{
+	return hctx->tags->tag_index[tag];
+}
+
+#endif
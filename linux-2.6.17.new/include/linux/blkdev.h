@@ -25,9 +25,13 @@ struct elevator_queue;
 typedef struct elevator_queue elevator_t;
 struct request_pm_state;
 struct blk_trace;
+struct blk_mq_ops;
+struct blk_mq_ctx;
+struct blk_mq_hw_ctx;
 
 #define BLKDEV_MIN_RQ	4
 #define BLKDEV_MAX_RQ	128	/* Default maximum */
+#define BLK_POLL_MAX_NS	50000	/* Default longest completion poll */
 
 /*
  * This is the per-process anticipatory I/O scheduler state.
@@ -158,6 +162,14 @@ struct request {
 	struct gendisk *rq_disk;
 	int errors;
 	unsigned long start_time;
+#ifdef CONFIG_BLK_RQ_TIMESTAMPS
+	unsigned long long queue_ns;	/* sched_clock() when queued, */
+	unsigned long long issue_ns;	/* and when issued to the driver */
+#endif
+#ifdef CONFIG_BLK_DEV_IO_TRACE
+	pid_t trace_pid;		/* who queued it, see blktrace_api.h */
+	unsigned int trace_flags;
+#endif
 
 	/* Number of scatter-gather DMA addr+len pairs after
 	 * physical address coalescing is performed.
@@ -174,6 +186,13 @@ struct request {
 	int tag;
 	char *buffer;
 
+	/*
+	 * multi-queue: the software queue the request was submitted to,
+	 * and the CPU to complete it on
+	 */
+	struct blk_mq_ctx *mq_ctx;
+	int cpu;
+
 	int ref_count;
 	request_queue_t *q;
 	struct request_list *rl;
@@ -302,6 +321,7 @@ typedef void (activity_fn) (void *data, int rw);
 typedef int (issue_flush_fn) (request_queue_t *, struct gendisk *, sector_t *);
 typedef void (prepare_flush_fn) (request_queue_t *, struct request *);
 typedef void (softirq_done_fn)(struct request *);
+typedef int (poll_q_fn) (request_queue_t *);
 
 enum blk_queue_state {
 	Queue_down,
@@ -318,6 +338,20 @@ struct blk_queue_tag {
 	atomic_t refcnt;		/* map can be shared */
 };
 
+/*
+ * Polled completion, see blk_poll(). Times are in ns from the start of
+ * the wait. Per CPU.
+ */
+struct blk_poll_stats {
+	unsigned long		hits;		/* completed while spinning */
+	unsigned long		misses;		/* spun, then slept */
+	unsigned long		skipped;	/* slept without spinning */
+	unsigned long		reaped;		/* completions found by poll_fn */
+	unsigned long long	hit_ns;		/* waited, by the hits */
+	unsigned long long	miss_ns;	/* spun in vain, by the misses */
+	unsigned long long	sleep_ns;	/* waited, by misses and skipped */
+};
+
 struct request_queue
 {
 	/*
@@ -344,6 +378,7 @@ struct request_queue
 	issue_flush_fn		*issue_flush_fn;
 	prepare_flush_fn	*prepare_flush_fn;
 	softirq_done_fn		*softirq_done_fn;
+	poll_q_fn		*poll_fn;
 
 	/*
 	 * Dispatch queue sorting
@@ -425,6 +460,23 @@ struct request_queue
 
 	struct blk_trace	*blk_trace;
 
+	/*
+	 * polled completion, see blk_poll(). The average and the budget
+	 * are updated without a lock: a racing update may lose a sample.
+	 */
+	unsigned int		poll_max_ns;	/* longest spin worth doing */
+	unsigned int		poll_budget_ns;	/* how long the next spin is */
+	unsigned int		poll_mean_ns;	/* average time to complete */
+	struct blk_poll_stats	*poll_stat;
+
+	/*
+	 * multi-queue devices, see block/blk-mq.c
+	 */
+	struct blk_mq_ops	*mq_ops;
+	struct blk_mq_ctx	*queue_ctx;	/* per-cpu software queues */
+	struct blk_mq_hw_ctx	**queue_hw_ctx;
+	unsigned int		nr_hw_queues;
+
 	/*
 	 * reserved for flush operations
 	 */
@@ -452,6 +504,8 @@ struct request_queue
 #define QUEUE_FLAG_REENTER	6	/* Re-entrancy avoidance */
 #define QUEUE_FLAG_PLUGGED	7	/* queue is plugged */
 #define QUEUE_FLAG_ELVSWITCH	8	/* don't use elevator, just do FIFO */
+#define QUEUE_FLAG_SAME_COMP	9	/* complete on the submitting CPU */
+#define QUEUE_FLAG_POLL		10	/* sync waiters poll for completion */
 
 enum {
 	/*
@@ -496,6 +550,7 @@ enum {
 #define blk_queue_plugged(q)	test_bit(QUEUE_FLAG_PLUGGED, &(q)->queue_flags)
 #define blk_queue_tagged(q)	test_bit(QUEUE_FLAG_QUEUED, &(q)->queue_flags)
 #define blk_queue_stopped(q)	test_bit(QUEUE_FLAG_STOPPED, &(q)->queue_flags)
+#define blk_queue_polled(q)	test_bit(QUEUE_FLAG_POLL, &(q)->queue_flags)
 #define blk_queue_flushing(q)	((q)->ordseq)
 
 #define blk_fs_request(rq)	((rq)->flags & REQ_CMD)
@@ -620,6 +675,7 @@ extern void blk_stop_queue(request_queue_t *q);
 extern void blk_sync_queue(struct request_queue *q);
 extern void __blk_stop_queue(request_queue_t *q);
 extern void blk_run_queue(request_queue_t *);
+extern void __blk_run_queue(request_queue_t *);
 extern void blk_queue_activity_fn(request_queue_t *, activity_fn *, void *);
 extern int blk_rq_map_user(request_queue_t *, struct request *, void __user *, unsigned int);
 extern int blk_rq_unmap_user(struct bio *, unsigned int);
@@ -648,6 +704,67 @@ static inline void blk_run_address_space(struct address_space *mapping)
 		blk_run_backing_dev(mapping->backing_dev_info, NULL);
 }
 
+/*
+ * A task that is about to submit a batch of I/O puts a blk_plug on its
+ * stack and calls blk_start_plug(). The requests it builds are then held
+ * back on the plug, where further bios merge into them without taking
+ * the queue lock, until blk_finish_plug() hands them to the elevators in
+ * one sorted batch. If the task sleeps first, schedule() does it for it.
+ * Plugs do not nest; only the outermost one collects requests.
+ */
+struct blk_plug {
+	struct list_head list;		/* requests held back */
+	unsigned int count;		/* number of them */
+};
+#define BLK_MAX_REQUEST_COUNT	16
+
+extern void blk_start_plug(struct blk_plug *);
+extern void blk_finish_plug(struct blk_plug *);
+extern void blk_flush_plug_list(struct blk_plug *, int);
+
+static inline int blk_needs_flush_plug(struct task_struct *tsk)
+{
+	struct blk_plug *plug = tsk->plug;
+
+	return plug && !list_empty(&plug->list);
+}
+
+/*
+ * Called from schedule(): the queues are run from kblockd rather than
+ * on top of whatever stack the task went to sleep with.
+ */
+static inline void blk_schedule_flush_plug(struct task_struct *tsk)
+{
+	blk_flush_plug_list(tsk->plug, 1);
+}
+
+/*
+ * Timestamps for the latency histograms of the disk, see disk_lat_account(),
+ * and for the blktrace summaries
+ */
+#ifdef CONFIG_BLK_RQ_TIMESTAMPS
+static inline void blk_lat_queued(struct request *rq)
+{
+	rq->queue_ns = sched_clock();
+	rq->issue_ns = 0;
+}
+
+static inline void blk_lat_issued(struct request *rq)
+{
+	rq->issue_ns = sched_clock();
+}
+
+static inline void blk_lat_merged(struct request *rq, struct request *next)
+{
+	if (next->queue_ns < rq->queue_ns)
+		rq->queue_ns = next->queue_ns;
+}
+#else
+#define blk_lat_queued(rq)		do { } while (0)
+#define blk_lat_issued(rq)		do { } while (0)
+#define blk_lat_merged(rq, next)	do { } while (0)
+#endif
+
 /*
  * end_request() and friends. Must be called with the request queue spinlock
  * acquired. All functions called within end_request() _must_be_ atomic.
@@ -721,6 +838,10 @@ extern void blk_queue_prep_rq(request_queue_t *, prep_rq_fn *pfn);
 extern void blk_queue_merge_bvec(request_queue_t *, merge_bvec_fn *);
 extern void blk_queue_dma_alignment(request_queue_t *, int);
 extern void blk_queue_softirq_done(request_queue_t *, softirq_done_fn *);
+extern void blk_queue_poll(request_queue_t *, poll_q_fn *);
+extern int blk_poll(request_queue_t *, int (*)(void *), void *,
+		    unsigned long long *);
+extern void blk_poll_slept(request_queue_t *, unsigned long long);
 extern struct backing_dev_info *blk_get_backing_dev_info(struct block_device *bdev);
 extern int blk_queue_ordered(request_queue_t *, unsigned, prepare_flush_fn *);
 extern void blk_queue_issue_flush_fn(request_queue_t *, issue_flush_fn *);
@@ -753,6 +874,10 @@ extern int blk_queue_init_tags(request_queue_t *, int, struct blk_queue_tag *);
 extern void blk_queue_free_tags(request_queue_t *);
 extern int blk_queue_resize_tags(request_queue_t *, int);
 extern void blk_queue_invalidate_tags(request_queue_t *);
+extern struct blk_queue_tag *blk_init_tags(int);
+extern void blk_free_tags(struct blk_queue_tag *);
+extern int blk_get_tag(struct blk_queue_tag *, int);
+extern void blk_put_tag(struct blk_queue_tag *, int);
 extern long blk_congestion_wait(int rw, long timeout);
 
 extern void blk_rq_bio_prep(request_queue_t *, struct request *, struct bio *);
@@ -827,8 +952,13 @@ static inline void put_dev_sector(Sector p)
 
 struct work_struct;
 int kblockd_schedule_work(struct work_struct *work);
+int kblockd_schedule_work_on(int cpu, struct work_struct *work);
 void kblockd_flush(void);
 
+#ifdef CONFIG_BLK_PLUG_STATS
+extern struct file_operations proc_plug_stat_operations;
+#endif
+
 #ifdef CONFIG_LBD
 # include <asm/div64.h>
 # define sector_div(a, b) do_div(a, b)
@@ -4,6 +4,7 @@
 #include <linux/config.h>
 #include <linux/blkdev.h>
 #include <linux/relay.h>
+#include <linux/hash.h>
 
 /*
  * Trace categories
@@ -20,6 +21,7 @@ enum blktrace_cat {
 	BLK_TC_FS	= 1 << 8,	/* fs requests */
 	BLK_TC_PC	= 1 << 9,	/* pc requests */
 	BLK_TC_NOTIFY	= 1 << 10,	/* special message */
+	BLK_TC_SUMMARY	= 1 << 11,	/* in-kernel summaries */
 
 	BLK_TC_END	= 1 << 15,	/* only 16-bits, reminder */
 };
@@ -46,6 +48,7 @@ enum blktrace_act {
 	__BLK_TA_SPLIT,			/* bio was split */
 	__BLK_TA_BOUNCE,		/* bio was bounced */
 	__BLK_TA_REMAP,			/* bio was remapped */
+	__BLK_TA_SUMMARY,		/* summary of an interval */
 };
 
 /*
@@ -66,6 +69,7 @@ enum blktrace_act {
 #define BLK_TA_SPLIT		(__BLK_TA_SPLIT)
 #define BLK_TA_BOUNCE		(__BLK_TA_BOUNCE)
 #define BLK_TA_REMAP		(__BLK_TA_REMAP | BLK_TC_ACT(BLK_TC_QUEUE))
+#define BLK_TA_SUMMARY		(__BLK_TA_SUMMARY | BLK_TC_ACT(BLK_TC_SUMMARY))
 
 #define BLK_IO_TRACE_MAGIC	0x65617400
 #define BLK_IO_TRACE_VERSION	0x07
@@ -96,6 +100,35 @@ struct blk_io_trace_remap {
 	u64 sector;
 };
 
+/*
+ * The payload of a BLK_TA_SUMMARY event, in host byte order like struct
+ * blk_io_trace: what a process, or an area of the disk, did over the last
+ * interval. See Documentation/block/blktrace-summary.txt
+ */
+struct blk_io_trace_summary {
+	u32 type;		/* BLK_TS_PID or BLK_TS_RANGE */
+	u32 flags;		/* BLK_TS_OTHER */
+	u64 start;		/* time the interval began, as trace time */
+	u64 key;		/* pid, or first sector of the range */
+	u64 nr_sectors;		/* size of the range */
+	u64 bytes[2];		/* read and written by completed requests */
+	u64 q2d_total;		/* queued to issued, ns, summed */
+	u64 d2c_total;		/* issued to completed, ns, summed */
+	u64 q2d_max;
+	u64 d2c_max;
+	u32 ios[2];		/* completed requests */
+	u32 bios;		/* bios submitted */
+	u32 merges;		/* of those, merged into a queued request */
+};
+
+enum {
+	BLK_TS_PID = 1,
+	BLK_TS_RANGE,
+};
+
+/* more keys than there was room for, summed in one entry */
+#define BLK_TS_OTHER		(1 << 0)
+
 enum {
 	Blktrace_setup = 1,
 	Blktrace_running,
@@ -114,6 +147,8 @@ struct blk_trace {
 	struct dentry *dir;
 	struct dentry *dropped_file;
 	atomic_t dropped;
+	struct blk_trace_sum *sum;	/* summary mode */
+	u32 sample;			/* relay 1 in this many requests */
 };
 
 /*
@@ -129,10 +164,55 @@ struct blk_user_trace_setup {
 	u32 pid;
 };
 
+/*
+ * User setup structure passed with BLKTRACESETUPSUM
+ */
+struct blk_user_trace_summary_setup {
+	struct blk_user_trace_setup buts;
+	u32 interval;			/* ms between summaries, 0: 1000 */
+	u32 sample;			/* relay 1 in this many requests */
+	u32 range_shift;		/* log2 of range size in sectors, 0: 21 */
+	u32 __pad;
+};
+
 #if defined(CONFIG_BLK_DEV_IO_TRACE)
 extern int blk_trace_ioctl(struct block_device *, unsigned, char __user *);
 extern void blk_trace_shutdown(request_queue_t *);
 extern void __blk_add_trace(struct blk_trace *, sector_t, int, int, u32, int, int, void *);
+extern int __blk_trace_sum_rq(struct blk_trace *, struct request *, u32);
+extern int __blk_trace_sum_bio(struct blk_trace *, struct bio *, u32);
+
+#define BLK_RQ_TRACE_SAMPLED	(1 << 0)	/* relayed in summary mode */
+#define BLK_RQ_TRACE_DONE	(1 << 1)	/* completion summed */
+
+/*
+ * In summary mode only the events of 1 in bt->sample requests are relayed,
+ * picked by the sector the request started at, and those of the bios in
+ * that sector. Events not tied to a request or bio are not relayed.
+ */
+static inline int blk_trace_sampled(struct blk_trace *bt, sector_t sector)
+{
+	if (likely(!bt->sum))
+		return 1;
+	return bt->sample &&
+		hash_long((unsigned long) sector, 32) % bt->sample == 0;
+}
+
+/**
+ * blk_trace_init_rq - Note who queued a request, and if it is sampled
+ * @rq:		the new request
+ * @bio:	the bio it is built from
+ *
+ **/
+static inline void blk_trace_init_rq(struct request *rq, struct bio *bio)
+{
+	struct blk_trace *bt = rq->q->blk_trace;
+
+	rq->trace_pid = current->pid;
+	rq->trace_flags = 0;
+	if (unlikely(bt) && blk_trace_sampled(bt, bio->bi_sector))
+		rq->trace_flags = BLK_RQ_TRACE_SAMPLED;
+}
 
 /**
  * blk_add_trace_rq - Add a trace for a request oriented action
@@ -152,6 +232,8 @@ static inline void blk_add_trace_rq(struct request_queue *q, struct request *rq,
 
 	if (likely(!bt))
 		return;
+	if (unlikely(bt->sum) && !__blk_trace_sum_rq(bt, rq, what))
+		return;
 
 	if (blk_pc_request(rq)) {
 		what |= BLK_TC_ACT(BLK_TC_PC);
@@ -179,6 +261,8 @@ static inline void blk_add_trace_bio(struct request_queue *q, struct bio *bio,
 
 	if (likely(!bt))
 		return;
+	if (unlikely(bt->sum) && !__blk_trace_sum_bio(bt, bio, what))
+		return;
 
 	__blk_add_trace(bt, bio->bi_sector, bio->bi_size, bio->bi_rw, what, !bio_flagged(bio, BIO_UPTODATE), 0, NULL);
 }
@@ -204,7 +288,7 @@ static inline void blk_add_trace_generic(struct request_queue *q,
 
 	if (bio)
 		blk_add_trace_bio(q, bio, what);
-	else
+	else if (likely(!bt->sum))
 		__blk_add_trace(bt, 0, 0, rw, what, 0, 0, NULL);
 }
 
@@ -230,9 +314,10 @@ static inline void blk_add_trace_pdu_int(struct request_queue *q, u32 what,
 	if (likely(!bt))
 		return;
 
-	if (bio)
-		__blk_add_trace(bt, bio->bi_sector, bio->bi_size, bio->bi_rw, what, !bio_flagged(bio, BIO_UPTODATE), sizeof(rpdu), &rpdu);
-	else
+	if (bio) {
+		if (blk_trace_sampled(bt, bio->bi_sector))
+			__blk_add_trace(bt, bio->bi_sector, bio->bi_size, bio->bi_rw, what, !bio_flagged(bio, BIO_UPTODATE), sizeof(rpdu), &rpdu);
+	} else if (likely(!bt->sum))
 		__blk_add_trace(bt, 0, 0, 0, what, 0, sizeof(rpdu), &rpdu);
 }
 
@@ -255,7 +340,7 @@ static inline void blk_add_trace_remap(struct request_queue *q, struct bio *bio,
 	struct blk_trace *bt = q->blk_trace;
 	struct blk_io_trace_remap r;
 
-	if (likely(!bt))
+	if (likely(!bt) || !blk_trace_sampled(bt, from))
 		return;
 
 	r.device = cpu_to_be32(dev);
@@ -267,6 +352,7 @@ static inline void blk_add_trace_remap(struct request_queue *q, struct bio *bio,
 #else /* !CONFIG_BLK_DEV_IO_TRACE */
 #define blk_trace_ioctl(bdev, cmd, arg)		(-ENOTTY)
 #define blk_trace_shutdown(q)			do { } while (0)
+#define blk_trace_init_rq(rq, bio)		do { } while (0)
 #define blk_add_trace_rq(q, rq, what)		do { } while (0)
 #define blk_add_trace_bio(q, rq, what)		do { } while (0)
 #define blk_add_trace_generic(q, rq, rw, what)	do { } while (0)
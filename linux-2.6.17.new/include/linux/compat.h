@@ -157,6 +157,11 @@ struct compat_robust_list_head {
 	compat_uptr_t			list_op_pending;
 };
 
+struct compat_futex_wait_block {
+	compat_uptr_t			uaddr;
+	u32				val;
+};
+
 extern void compat_exit_robust_list(struct task_struct *curr);
 
 asmlinkage long
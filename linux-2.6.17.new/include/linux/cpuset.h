@@ -12,6 +12,11 @@
 #include <linux/cpumask.h>
 #include <linux/nodemask.h>
 
+/* cpuset io_weight */
+#define CPUSET_IO_WEIGHT_MIN		1
+#define CPUSET_IO_WEIGHT_DEFAULT	100
+#define CPUSET_IO_WEIGHT_MAX		1000
+
 #ifdef CONFIG_CPUSETS
 
 extern int number_of_cpusets;	/* How many cpusets are defined in system? */
@@ -53,6 +58,8 @@ extern void cpuset_unlock(void);
 
 extern int cpuset_mem_spread_node(void);
 
+extern unsigned long cpuset_io_group(unsigned int *weight);
+
 static inline int cpuset_do_page_mem_spread(void)
 {
 	return current->flags & PF_SPREAD_PAGE;
@@ -116,6 +123,12 @@ static inline int cpuset_mem_spread_node(void)
 	return 0;
 }
 
+static inline unsigned long cpuset_io_group(unsigned int *weight)
+{
+	*weight = CPUSET_IO_WEIGHT_DEFAULT;
+	return 0;
+}
+
 static inline int cpuset_do_page_mem_spread(void)
 {
 	return 0;
@@ -22,6 +22,12 @@
 #define EPOLL_CTL_DEL 2
 #define EPOLL_CTL_MOD 3
 
+/*
+ * Wake up only one of the tasks waiting inside epoll_wait() on the epoll
+ * descriptor when the target file descriptor gets ready
+ */
+#define EPOLLEXCLUSIVE (1 << 28)
+
 /* Set the One Shot behaviour for the target file descriptor */
 #define EPOLLONESHOT (1 << 30)
 
@@ -62,6 +68,10 @@ static inline void eventpoll_init_file(struct file *file)
 /* Used to release the epoll bits inside the "struct file" */
 void eventpoll_release_file(struct file *file);
 
+#ifdef CONFIG_EPOLL_STATS
+extern struct file_operations proc_epoll_stat_operations;
+#endif
+
 /*
  * This is called from inside fs/file_table.c:__fput() to unlink files
  * from the eventpoll interface. We need to have this facility to cleanup
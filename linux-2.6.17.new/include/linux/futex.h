@@ -12,6 +12,23 @@
 #define FUTEX_REQUEUE		3
 #define FUTEX_CMP_REQUEUE	4
 #define FUTEX_WAKE_OP		5
+#define FUTEX_LOCK_PI		6
+#define FUTEX_UNLOCK_PI		7
+#define FUTEX_TRYLOCK_PI	8
+#define FUTEX_WAIT_MULTIPLE	9
+#define FUTEX_REQUEUE_OP	10
+
+/*
+ * FUTEX_WAIT_MULTIPLE sleeps on an array of these (uaddr points to
+ * the array, val is the number of entries), until one of the futexes
+ * is woken. It returns the index of that futex.
+ */
+struct futex_wait_block {
+	u32 __user *uaddr;
+	u32 val;
+};
+
+#define FUTEX_WAIT_MULTIPLE_MAX	128
 
 /*
  * Support for robust futexes: the kernel cleans up held futexes at
@@ -95,13 +112,21 @@ long do_futex(unsigned long uaddr, int op, int val,
 		int val3);
 
 extern int handle_futex_death(u32 __user *uaddr, struct task_struct *curr);
+extern unsigned long futex_abs_timeout(struct timespec *ts);
+extern long futex_wait_multiple(struct futex_wait_block *blocks, int count,
+				unsigned long timeout);
 
 #ifdef CONFIG_FUTEX
 extern void exit_robust_list(struct task_struct *curr);
+extern void exit_pi_state_list(struct task_struct *curr);
+extern struct file_operations proc_futex_stat_operations;
 #else
 static inline void exit_robust_list(struct task_struct *curr)
 {
 }
+static inline void exit_pi_state_list(struct task_struct *curr)
+{
+}
 #endif
 
 #define FUTEX_OP_SET		0	/* *(int *)UADDR2 = OPARG; */
@@ -123,7 +148,11 @@ static inline void exit_robust_list(struct task_struct *curr)
    int oldval = *(int *)UADDR2;
    *(int *)UADDR2 = oldval OP OPARG;
    if (oldval CMP CMPARG)
-     wake UADDR2;  */
+     wake UADDR2;
+
+   FUTEX_REQUEUE_OP does the same operation, but instead of waking
+   UADDR2 it requeues further waiters of UADDR1 to UADDR2 if the
+   comparison holds, and wakes them if it does not.  */
 
 #define FUTEX_OP(op, oparg, cmp, cmparg) \
   (((op & 0xf) << 28) | ((cmp & 0xf) << 24)		\
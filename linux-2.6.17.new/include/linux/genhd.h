@@ -89,6 +89,23 @@ struct hd_struct {
 #define GENHD_FL_UP				16
 #define GENHD_FL_SUPPRESS_PARTITION_INFO	32
 
+#ifdef CONFIG_BLK_LATENCY_HIST
+/*
+ * log2 histograms of request latency in units of 1024ns, and of the
+ * number of requests in the driver, by direction. See
+ * Documentation/block/stat.txt
+ */
+enum {
+	DISK_LAT_QUEUE,			/* queued to issued to the driver */
+	DISK_LAT_SERVICE,		/* issued to completed */
+	DISK_LAT_TOTAL,			/* queued to completed */
+	DISK_LAT_NR,
+};
+
+#define DISK_LAT_BUCKETS	24
+#define DISK_DEPTH_BUCKETS	12
+#endif
+
 struct disk_stats {
 	unsigned long sectors[2];	/* READs and WRITEs */
 	unsigned long ios[2];
@@ -96,6 +113,10 @@ struct disk_stats {
 	unsigned long ticks[2];
 	unsigned long io_ticks;
 	unsigned long time_in_queue;
+#ifdef CONFIG_BLK_LATENCY_HIST
+	unsigned long lat_hist[2][DISK_LAT_NR][DISK_LAT_BUCKETS];
+	unsigned long depth_hist[2][DISK_DEPTH_BUCKETS];
+#endif
 };
 	
 struct gendisk {
@@ -221,6 +242,11 @@ static inline void free_disk_stats(struct gendisk *disk)
 
 /* drivers/block/ll_rw_blk.c */
 extern void disk_round_stats(struct gendisk *disk);
+#ifdef CONFIG_BLK_LATENCY_HIST
+struct request;
+extern void disk_lat_account(struct gendisk *disk, struct request *rq,
+			     int depth);
+#endif
 
 /* drivers/block/genhd.c */
 extern int get_blkdev_list(char *, int);
@@ -0,0 +1,105 @@
+#ifndef _LINUX_IORING_H
+#define _LINUX_IORING_H
+
+/*
+ * I/O rings: requests are queued on a submission ring and their results
+ * come back on a completion ring, both shared between the process and
+ * the kernel. See Documentation/ioring.txt.
+ */
+
+#include <linux/types.h>
+
+/*
+ * A submission queue entry, 64 bytes
+ */
+struct ioring_sqe {
+	__u8	opcode;		/* IORING_OP_* */
+	__u8	flags;		/* none yet, must be 0 */
+	__u16	__pad1;
+	__s32	fd;
+	__u64	off;		/* file offset */
+	__u64	addr;		/* buffer, iovec array or struct msghdr */
+	__u32	len;		/* buffer size, or number of iovecs */
+	__u32	op_flags;	/* IORING_FSYNC_DATASYNC, or MSG_* flags */
+	__u64	user_data;	/* passed back in the completion */
+	__u64	__pad2[3];
+};
+
+enum {
+	IORING_OP_NOP,
+	IORING_OP_READ,
+	IORING_OP_WRITE,
+	IORING_OP_READV,
+	IORING_OP_WRITEV,
+	IORING_OP_FSYNC,
+	IORING_OP_SENDMSG,
+	IORING_OP_RECVMSG,
+};
+
+#define IORING_FSYNC_DATASYNC	(1U << 0)
+
+/*
+ * A completion queue entry
+ */
+struct ioring_cqe {
+	__u64	user_data;	/* as submitted */
+	__s32	res;		/* what the system call would have returned */
+	__u32	flags;
+};
+
+/*
+ * Where the fields of the two rings are, from the start of their mapping
+ */
+struct ioring_sqring_offsets {
+	__u32	head;		/* next entry the kernel takes */
+	__u32	tail;		/* next entry user space fills in */
+	__u32	ring_mask;
+	__u32	ring_entries;
+	__u32	flags;		/* IORING_SQ_* */
+	__u32	dropped;	/* entries with a bad index */
+	__u32	array;		/* the ring, of indexes into the sqes */
+	__u32	resv1;
+	__u64	resv2;
+};
+
+#define IORING_SQ_NEED_WAKEUP	(1U << 0)	/* the polling thread sleeps */
+
+struct ioring_cqring_offsets {
+	__u32	head;		/* next entry user space takes */
+	__u32	tail;		/* next entry the kernel fills in */
+	__u32	ring_mask;
+	__u32	ring_entries;
+	__u32	overflow;	/* completions that found no room */
+	__u32	cqes;
+	__u64	resv[2];
+};
+
+/*
+ * Passed to ioring_setup(), which fills in the rest
+ */
+struct ioring_params {
+	__u32	sq_entries;
+	__u32	cq_entries;
+	__u32	flags;		/* IORING_SETUP_* */
+	__u32	sq_thread_cpu;	/* IORING_SETUP_SQ_AFF */
+	__u32	sq_thread_idle;	/* ms, 0: 1000 */
+	__u32	resv[5];
+	struct ioring_sqring_offsets sq_off;
+	struct ioring_cqring_offsets cq_off;
+};
+
+#define IORING_SETUP_SQPOLL	(1U << 0)	/* a kernel thread submits */
+#define IORING_SETUP_SQ_AFF	(1U << 1)	/* on sq_thread_cpu */
+
+/* mmap() offsets of the rings */
+#define IORING_OFF_SQ_RING	0ULL
+#define IORING_OFF_CQ_RING	0x8000000ULL
+#define IORING_OFF_SQES		0x10000000ULL
+
+/* ioring_enter() flags */
+#define IORING_ENTER_GETEVENTS	(1U << 0)
+#define IORING_ENTER_SQ_WAKEUP	(1U << 1)
+
+#define IORING_MAX_ENTRIES	4096
+
+#endif /* _LINUX_IORING_H */
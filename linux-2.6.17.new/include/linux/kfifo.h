@@ -25,6 +25,8 @@
 
 #include <linux/kernel.h>
 #include <linux/spinlock.h>
+#include <linux/compiler.h>
+#include <asm/atomic.h>
 
 struct kfifo {
 	unsigned char *buffer;	/* the buffer holding the data */
@@ -43,6 +45,25 @@ extern unsigned int __kfifo_put(struct kfifo *fifo,
 				unsigned char *buffer, unsigned int len);
 extern unsigned int __kfifo_get(struct kfifo *fifo,
 				unsigned char *buffer, unsigned int len);
+extern int __kfifo_put_user(struct kfifo *fifo,
+			    const unsigned char __user *from, unsigned int len);
+extern int __kfifo_get_user(struct kfifo *fifo,
+			    unsigned char __user *to, unsigned int len);
+
+/* record mode: records up to KFIFO_REC_MAX bytes with a length header */
+#define KFIFO_REC_HDR	2
+#define KFIFO_REC_MAX	0xffff
+
+extern unsigned int __kfifo_put_rec(struct kfifo *fifo,
+				    unsigned char *buffer, unsigned int len);
+extern int __kfifo_put_rec_user(struct kfifo *fifo,
+				const unsigned char __user *from,
+				unsigned int len);
+extern unsigned int __kfifo_rec_len(struct kfifo *fifo);
+extern unsigned int __kfifo_get_rec(struct kfifo *fifo,
+				    unsigned char *buffer, unsigned int len);
+extern int __kfifo_get_rec_user(struct kfifo *fifo,
+				unsigned char __user *to, unsigned int len);
 
 /**
  * __kfifo_reset - removes the entire FIFO contents, no locking version
@@ -151,6 +172,160 @@ static inline unsigned int kfifo_len(struct kfifo *fifo)
 	return ret;
 }
 
+/**
+ * __kfifo_put_elems - puts whole elements into the FIFO, no locking version
+ * @fifo: the fifo to be used.
+ * @buffer: the elements to be added.
+ * @n: the number of elements to be added.
+ * @esize: the size of an element.
+ *
+ * Like __kfifo_put(), but copies only whole elements and returns the
+ * number of elements copied. A FIFO used this way always holds whole
+ * elements, as long as all its users pass the same size.
+ */
+static inline unsigned int __kfifo_put_elems(struct kfifo *fifo,
+				void *buffer, unsigned int n, unsigned int esize)
+{
+	n = min(n, (fifo->size - fifo->in + fifo->out) / esize);
+	return __kfifo_put(fifo, buffer, n * esize) / esize;
+}
+
+/**
+ * __kfifo_get_elems - gets whole elements from the FIFO, no locking version
+ * @fifo: the fifo to be used.
+ * @buffer: where the elements must be copied.
+ * @n: the number of elements the buffer holds.
+ * @esize: the size of an element.
+ *
+ * Returns the number of elements copied.
+ */
+static inline unsigned int __kfifo_get_elems(struct kfifo *fifo,
+				void *buffer, unsigned int n, unsigned int esize)
+{
+	n = min(n, (fifo->in - fifo->out) / esize);
+	return __kfifo_get(fifo, buffer, n * esize) / esize;
+}
+
+/*
+ * Typed element FIFOs: the element size is taken from the type 'ptr'
+ * points to, e.g.
+ *
+ *	struct event ev[8];
+ *	n = kfifo_get_typed(fifo, ev, 8);
+ */
+#define __kfifo_put_typed(fifo, ptr, n) \
+	__kfifo_put_elems((fifo), (ptr), (n), sizeof(*(ptr)))
+#define __kfifo_get_typed(fifo, ptr, n) \
+	__kfifo_get_elems((fifo), (ptr), (n), sizeof(*(ptr)))
+#define __kfifo_len_typed(fifo, type) \
+	(__kfifo_len(fifo) / sizeof(type))
+
+#define kfifo_put_typed(fifo, ptr, n) ({			\
+	unsigned long __flags;					\
+	unsigned int __ret;					\
+	spin_lock_irqsave((fifo)->lock, __flags);		\
+	__ret = __kfifo_put_typed((fifo), (ptr), (n));		\
+	spin_unlock_irqrestore((fifo)->lock, __flags);		\
+	__ret;							\
+})
+
+#define kfifo_get_typed(fifo, ptr, n) ({			\
+	unsigned long __flags;					\
+	unsigned int __ret;					\
+	spin_lock_irqsave((fifo)->lock, __flags);		\
+	__ret = __kfifo_get_typed((fifo), (ptr), (n));		\
+	spin_unlock_irqrestore((fifo)->lock, __flags);		\
+	__ret;							\
+})
+
+/**
+ * kfifo_put_rec - puts a record into the FIFO
+ * @fifo: the fifo to be used.
+ * @buffer: the record to be added.
+ * @len: the length of the record.
+ *
+ * Returns 'len', or 0 if the record did not fit.
+ */
+static inline unsigned int kfifo_put_rec(struct kfifo *fifo,
+					 unsigned char *buffer, unsigned int len)
+{
+	unsigned long flags;
+	unsigned int ret;
+
+	spin_lock_irqsave(fifo->lock, flags);
+
+	ret = __kfifo_put_rec(fifo, buffer, len);
+
+	spin_unlock_irqrestore(fifo->lock, flags);
+
+	return ret;
+}
+
+/**
+ * kfifo_get_rec - gets a record from the FIFO
+ * @fifo: the fifo to be used.
+ * @buffer: where the record must be copied.
+ * @len: the size of the destination buffer.
+ *
+ * Returns the length of the record, or 0 if the FIFO is empty or the
+ * record does not fit into 'buffer'.
+ */
+static inline unsigned int kfifo_get_rec(struct kfifo *fifo,
+					 unsigned char *buffer, unsigned int len)
+{
+	unsigned long flags;
+	unsigned int ret;
+
+	spin_lock_irqsave(fifo->lock, flags);
+
+	ret = __kfifo_get_rec(fifo, buffer, len);
+
+	spin_unlock_irqrestore(fifo->lock, flags);
+
+	return ret;
+}
+
+/*
+ * Multi-producer multi-consumer ring of fixed size elements, lock-free
+ * on both sides. See kernel/kfifo.c.
+ */
+struct kfifo_ring {
+	atomic_t head;		/* next position for the producers */
+	atomic_t tail;		/* next position for the consumers */
+	unsigned int mask;	/* number of elements - 1 */
+	unsigned int esize;	/* size of an element */
+	unsigned int stride;	/* size of a slot */
+	unsigned char *slots;
+};
+
+extern struct kfifo_ring *kfifo_ring_alloc(unsigned int nr,
+					   unsigned int esize, gfp_t gfp_mask);
+extern void kfifo_ring_free(struct kfifo_ring *ring);
+extern void *kfifo_ring_reserve(struct kfifo_ring *ring);
+extern void kfifo_ring_commit(struct kfifo_ring *ring, void *elem);
+extern void kfifo_ring_abort(struct kfifo_ring *ring, void *elem);
+extern void *kfifo_ring_claim(struct kfifo_ring *ring);
+extern void kfifo_ring_release(struct kfifo_ring *ring, void *elem);
+extern int kfifo_ring_put(struct kfifo_ring *ring, const void *elem);
+extern int kfifo_ring_get(struct kfifo_ring *ring, void *elem);
+extern int kfifo_ring_put_user(struct kfifo_ring *ring,
+			       const void __user *from);
+extern int kfifo_ring_get_user(struct kfifo_ring *ring, void __user *to);
+
+/**
+ * kfifo_ring_len - returns the number of elements reserved and not claimed
+ * @ring: the ring to be used.
+ *
+ * Only a snapshot, the producers and consumers may move on any time.
+ */
+static inline unsigned int kfifo_ring_len(struct kfifo_ring *ring)
+{
+	unsigned int tail = atomic_read(&ring->tail);
+
+	smp_rmb();
+	return (unsigned int)atomic_read(&ring->head) - tail;
+}
+
 #else
 #warning "don't include kernel headers in userspace"
 #endif /* __KERNEL__ */
@@ -0,0 +1,125 @@
+#ifndef __LINUX_LOCKSTAT_H
+#define __LINUX_LOCKSTAT_H
+
+/*
+ * include/linux/lockstat.h - lock contention statistics
+ *
+ * With CONFIG_LOCK_STAT, the time spent waiting for contended spinlocks,
+ * rwlocks, mutexes, semaphores and rw-semaphores is accounted to the class
+ * of the lock and shown in /proc/lock_stat, along with the places the
+ * class was contended at. With kernel.lock_stat set to 2, acquisitions
+ * and hold times of spinlocks, rwlocks and mutexes are accounted too.
+ * See Documentation/lockstat.txt.
+ */
+
+#include <linux/stringify.h>
+
+/*
+ * A lock class: every spin_lock_init()/rwlock_init()/mutex_init() call
+ * site has a static key of its own. Locks without a key are classed by
+ * their address if they are part of the kernel image, or else by the
+ * place they were first found contended.
+ */
+struct lock_class_key {
+	const char *name;
+	unsigned int idx;	/* class index + 1, 0 if not registered yet */
+};
+
+enum lock_stat_kind {
+	LOCK_STAT_SPIN,
+	LOCK_STAT_RW,
+	LOCK_STAT_MUTEX,
+	LOCK_STAT_SEM,
+	LOCK_STAT_RWSEM,
+};
+
+#ifdef CONFIG_LOCK_STAT
+
+/*
+ * The name of the class of a lock initialized at this line:
+ */
+#define __LOCK_CLASS_NAME(lock) \
+	__FILE__ ":" __stringify(__LINE__) " " #lock
+
+struct file_operations;
+extern struct file_operations proc_lock_stat_operations;
+
+/* 0: off, 1: contention (default), 2: acquisitions and hold times too */
+extern int sysctl_lock_stat;
+
+extern void lock_stat_contended(struct lock_class_key **keyp, void *lock,
+				enum lock_stat_kind kind, void *ip,
+				unsigned long long wait);
+extern void lock_stat_acquired(struct lock_class_key **keyp, void *lock,
+			       enum lock_stat_kind kind, void *ip,
+			       unsigned long long *hold_start);
+extern void lock_stat_released(struct lock_class_key *key,
+			       unsigned long long *hold_start);
+
+/*
+ * Helpers for the lock functions: lock_stat_begin() is called every time
+ * the lock was found contended, lock_stat_end() once it was taken.
+ */
+#define lock_stat_begin(start)						\
+	do {								\
+		if (!(start) && sysctl_lock_stat)			\
+			(start) = sched_clock();			\
+	} while (0)
+
+#define lock_stat_end(lock, kind, start, ip)				\
+	do {								\
+		if (start)						\
+			lock_stat_contended(&(lock)->key, (lock), (kind), \
+					    (ip), sched_clock() - (start)); \
+	} while (0)
+
+/*
+ * Semaphores and rw-semaphores have no key, their classes are looked up
+ * on every contention:
+ */
+#define lock_stat_end_keyless(lock, kind, start, ip)			\
+	do {								\
+		if (start)						\
+			lock_stat_contended(NULL, (lock), (kind), (ip),	\
+					    sched_clock() - (start));	\
+	} while (0)
+
+/*
+ * Every acquisition calls lock_stat_acquire(), every release of a lock
+ * with a single holder lock_stat_release(). They only do something when
+ * hold times are being accounted.
+ */
+#define lock_stat_acquire(lock, kind, ip)				\
+	do {								\
+		if (unlikely(sysctl_lock_stat > 1))			\
+			lock_stat_acquired(&(lock)->key, (lock), (kind), \
+					   (ip), &(lock)->hold_start);	\
+	} while (0)
+
+#define lock_stat_acquire_shared(lock, kind, ip)			\
+	do {								\
+		if (unlikely(sysctl_lock_stat > 1))			\
+			lock_stat_acquired(&(lock)->key, (lock), (kind), \
+					   (ip), NULL);			\
+	} while (0)
+
+#define lock_stat_release(lock)						\
+	do {								\
+		if (unlikely((lock)->hold_start))			\
+			lock_stat_released((lock)->key,			\
+					   &(lock)->hold_start);	\
+	} while (0)
+
+#else
+
+#define lock_stat_begin(start)			do { } while (0)
+#define lock_stat_end(lock, kind, start, ip)	do { (void)(start); } while (0)
+#define lock_stat_end_keyless(lock, kind, start, ip) \
+						do { (void)(start); } while (0)
+#define lock_stat_acquire(lock, kind, ip)	do { } while (0)
+#define lock_stat_acquire_shared(lock, kind, ip) do { } while (0)
+#define lock_stat_release(lock)			do { } while (0)
+
+#endif /* CONFIG_LOCK_STAT */
+
+#endif /* __LINUX_LOCKSTAT_H */
@@ -48,6 +48,15 @@ struct mutex {
 	atomic_t		count;
 	spinlock_t		wait_lock;
 	struct list_head	wait_list;
+#ifdef CONFIG_MUTEX_SPIN_ON_OWNER
+	struct task_struct	*spin_owner;	/* holder, for spinning waiters */
+	atomic_t		spin_tail;	/* last spinning CPU + 1, or 0 */
+#endif
+#ifdef CONFIG_LOCK_STAT
+	struct lock_class_key	*key;
+	unsigned long long	hold_start;
+	unsigned long long	wait;		/* of the owner, ns */
+#endif
 #ifdef CONFIG_DEBUG_MUTEXES
 	struct thread_info	*owner;
 	struct list_head	held_list;
@@ -74,7 +83,19 @@ struct mutex_waiter {
 # include <linux/mutex-debug.h>
 #else
 # define __DEBUG_MUTEX_INITIALIZER(lockname)
-# define mutex_init(mutex)			__mutex_init(mutex, NULL)
+# ifdef CONFIG_LOCK_STAT
+/* every mutex_init() site is a lock class, like spin_lock_init() */
+#  define mutex_init(mutex)					\
+do {								\
+	static struct lock_class_key __key =			\
+		{ .name = __LOCK_CLASS_NAME(mutex) };		\
+								\
+	__mutex_init(mutex, NULL);				\
+	(mutex)->key = &__key;					\
+} while (0)
+# else
+#  define mutex_init(mutex)			__mutex_init(mutex, NULL)
+# endif
 # define mutex_destroy(mutex)				do { } while (0)
 # define mutex_debug_show_all_locks()			do { } while (0)
 # define mutex_debug_show_held_locks(p)			do { } while (0)
@@ -117,4 +138,13 @@ extern int fastcall mutex_lock_interruptible(struct mutex *lock);
 extern int fastcall mutex_trylock(struct mutex *lock);
 extern void fastcall mutex_unlock(struct mutex *lock);
 
+#ifdef CONFIG_MUTEX_SPIN_ON_OWNER
+extern int mutex_spin_on_owner(struct mutex *lock);
+#endif
+
+#ifdef CONFIG_MUTEX_STATS
+struct file_operations;
+extern struct file_operations proc_mutex_stat_operations;
+#endif
+
 #endif
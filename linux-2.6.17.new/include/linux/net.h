@@ -118,6 +118,7 @@ struct socket {
 struct vm_area_struct;
 struct page;
 struct kiocb;
+struct io_event;
 struct sockaddr;
 struct msghdr;
 struct module;
@@ -194,6 +195,8 @@ extern int   	     sock_sendmsg(struct socket *sock, struct msghdr *msg,
 				  size_t len);
 extern int	     sock_recvmsg(struct socket *sock, struct msghdr *msg,
 				  size_t size, int flags);
+extern ssize_t	     sock_aio_msg_retry(struct kiocb *iocb);
+extern int	     sock_aio_msg_cancel(struct kiocb *iocb, struct io_event *res);
 extern int 	     sock_map_fd(struct socket *sock);
 extern struct socket *sockfd_lookup(int fd, int *err);
 #define		     sockfd_put(sock) fput(sock->file)
@@ -168,6 +168,7 @@ static inline pgoff_t linear_page_index(struct vm_area_struct *vma,
 }
 
 extern void FASTCALL(__lock_page(struct page *page));
+extern int FASTCALL(__lock_page_async(struct page *page));
 extern void FASTCALL(unlock_page(struct page *page));
 
 static inline void lock_page(struct page *page)
@@ -176,6 +177,18 @@ static inline void lock_page(struct page *page)
 	if (TestSetPageLocked(page))
 		__lock_page(page);
 }
+
+/*
+ * Like lock_page(), but in an AIO retry returns -EIOCBRETRY instead of
+ * sleeping, see __lock_page_async().
+ */
+static inline int lock_page_async(struct page *page)
+{
+	might_sleep();
+	if (TestSetPageLocked(page))
+		return __lock_page_async(page);
+	return 0;
+}
 	
 /*
  * This is exported only for wait_on_page_locked/wait_on_page_writeback.
@@ -16,8 +16,8 @@ enum pid_type
  *
  * A struct pid is the kernel's internal notion of a process identifier.
  * It refers to individual tasks, process groups, and sessions.  While
- * there are processes attached to it the struct pid lives in a hash
- * table, so it and then the processes that it refers to can be found
+ * there are processes attached to it the struct pid lives in an IDR,
+ * so it and then the processes that it refers to can be found
  * quickly from the numeric pid value.  The attached processes may be
  * quickly accessed by following pointers from struct pid.
  *
@@ -42,9 +42,7 @@ enum pid_type
 struct pid
 {
 	atomic_t count;
-	/* Try to keep pid_chain in the same cacheline as nr for find_pid */
 	int nr;
-	struct hlist_node pid_chain;
 	/* lists of tasks that use this pid */
 	struct hlist_head tasks[PIDTYPE_MAX];
 	struct rcu_head rcu;
@@ -78,16 +76,22 @@ extern int FASTCALL(attach_pid(struct task_struct *task,
 extern void FASTCALL(detach_pid(struct task_struct *task, enum pid_type));
 
 /*
- * look up a PID in the hash table. Must be called with the tasklist_lock
- * or rcu_read_lock() held.
+ * look up a PID. Must be called with the tasklist_lock or rcu_read_lock()
+ * held.
  */
 extern struct pid *FASTCALL(find_pid(int nr));
 
 /*
- * Lookup a PID in the hash table, and return with it's count elevated.
+ * Lookup a PID, and return with it's count elevated.
  */
 extern struct pid *find_get_pid(int nr);
 
+/*
+ * The PID with the lowest number at or above nr, for walking the PIDs in
+ * order. The same locking as for find_pid() applies.
+ */
+extern struct pid *find_ge_pid(int nr);
+
 extern struct pid *alloc_pid(void);
 extern void FASTCALL(free_pid(struct pid *pid));
 
@@ -1,9 +1,16 @@
 #ifndef _LINUX_PIPE_FS_I_H
 #define _LINUX_PIPE_FS_I_H
 
+#include <linux/percpu.h>
+
 #define PIPEFS_MAGIC 0x50495045
 
-#define PIPE_BUFFERS (16)
+/*
+ * Size of the buffer ring of a new pipe. F_SETPIPE_SZ changes it, to a
+ * power of two of at most PIPE_MAX_BUFFERS.
+ */
+#define PIPE_DEF_BUFFERS	16
+#define PIPE_MAX_BUFFERS	4096
 
 #define PIPE_BUF_FLAG_LRU	0x01	/* page is on the LRU */
 #define PIPE_BUF_FLAG_ATOMIC	0x02	/* was atomically mapped */
@@ -40,8 +47,9 @@ struct pipe_buf_operations {
 
 struct pipe_inode_info {
 	wait_queue_head_t wait;
-	unsigned int nrbufs, curbuf;
-	struct pipe_buffer bufs[PIPE_BUFFERS];
+	unsigned int nrbufs, curbuf, buffers;
+	struct pipe_buffer *bufs;
+	struct user_struct *user;	/* charged with the buffers */
 	struct page *tmp_page;
 	unsigned int start;
 	unsigned int readers;
@@ -65,6 +73,56 @@ struct pipe_inode_info * alloc_pipe_info(struct inode * inode);
 void free_pipe_info(struct inode * inode);
 void __free_pipe_info(struct pipe_inode_info *);
 
+/* F_SETPIPE_SZ and F_GETPIPE_SZ */
+long pipe_fcntl(struct file *, unsigned int, unsigned long);
+
+/* fs.pipe-max-size and fs.pipe-user-pages */
+extern int pipe_max_size, pipe_user_pages;
+
+#ifdef CONFIG_PIPE_STATS
+/*
+ * Occupancy statistics, reported in /proc/pipe_stat. Writes into a pipe
+ * are counted by how full they find its ring: 0-24%, 25-49%, 50-74%,
+ * 75-99% and full.
+ */
+#define PIPE_STAT_FILL	5
+
+struct pipe_stat {
+	unsigned long writes;
+	unsigned long fill[PIPE_STAT_FILL];
+	unsigned long write_waits;	/* writers waiting for room */
+	unsigned long read_waits;	/* readers waiting for data */
+	unsigned long resizes;
+};
+
+DECLARE_PER_CPU(struct pipe_stat, pipe_stats);
+
+#define pipe_stat_inc(field)						\
+	do {								\
+		get_cpu_var(pipe_stats).field++;			\
+		put_cpu_var(pipe_stats);				\
+	} while (0)
+
+/*
+ * Accounts a write into the pipe, which must be locked. The ring size
+ * is a power of two.
+ */
+static inline void pipe_stat_write(struct pipe_inode_info *pipe)
+{
+	struct pipe_stat *st = &get_cpu_var(pipe_stats);
+
+	st->writes++;
+	st->fill[(pipe->nrbufs * (PIPE_STAT_FILL - 1)) >>
+		 (fls(pipe->buffers) - 1)]++;
+	put_cpu_var(pipe_stats);
+}
+
+extern struct file_operations proc_pipe_stat_operations;
+#else
+#define pipe_stat_inc(field)		do { } while (0)
+#define pipe_stat_write(pipe)		do { } while (0)
+#endif
+
 /* Generic pipe buffer ops functions */
 void *generic_pipe_buf_map(struct pipe_inode_info *, struct pipe_buffer *, int);
 void generic_pipe_buf_unmap(struct pipe_inode_info *, struct pipe_buffer *, void *);
@@ -60,15 +60,71 @@ struct rcu_head {
 
 
 
+/*
+ * Quiescent states are collected in a combining tree of rcu_nodes: each
+ * leaf covers RCU_FANOUT CPUs, each inner node RCU_FANOUT nodes of the
+ * level below. A CPU only takes the lock of its leaf to report that it
+ * passed a quiescent state, and only the last CPU of a group goes on to
+ * the parent, so no lock or cacheline is shared by all CPUs.
+ */
+#ifdef CONFIG_RCU_FANOUT
+#define RCU_FANOUT	CONFIG_RCU_FANOUT
+#else
+#define RCU_FANOUT	16
+#endif
+
+#define RCU_FANOUT_SQ	(RCU_FANOUT * RCU_FANOUT)
+#define RCU_FANOUT_CUBE	(RCU_FANOUT_SQ * RCU_FANOUT)
+#define RCU_NODES_FOR(span)	(((NR_CPUS) + (span) - 1) / (span))
+
+#define NUM_RCU_LEAVES	RCU_NODES_FOR(RCU_FANOUT)
+
+#if NR_CPUS <= RCU_FANOUT
+# define NUM_RCU_LVLS	1
+# define NUM_RCU_NODES	1
+#elif NR_CPUS <= RCU_FANOUT_SQ
+# define NUM_RCU_LVLS	2
+# define NUM_RCU_NODES	(1 + NUM_RCU_LEAVES)
+#elif NR_CPUS <= RCU_FANOUT_CUBE
+# define NUM_RCU_LVLS	3
+# define NUM_RCU_NODES	(1 + RCU_NODES_FOR(RCU_FANOUT_SQ) + NUM_RCU_LEAVES)
+#elif NR_CPUS <= RCU_FANOUT_CUBE * RCU_FANOUT
+# define NUM_RCU_LVLS	4
+# define NUM_RCU_NODES	(1 + RCU_NODES_FOR(RCU_FANOUT_CUBE) + \
+			 RCU_NODES_FOR(RCU_FANOUT_SQ) + NUM_RCU_LEAVES)
+#else
+# error "CONFIG_RCU_FANOUT too small for NR_CPUS"
+#endif
+
+struct rcu_node {
+	spinlock_t	lock;
+	long		gpnum;		/* Batch # qsmask belongs to */
+	unsigned long	qsmask;		/* CPUs/groups still to pass a   */
+					/* quiescent state in gpnum      */
+	unsigned long	qsmaskinit;	/* qsmask for the next batch     */
+	unsigned long	grpmask;	/* Our bit in parent->qsmask     */
+	int		grplo;		/* Lowest CPU in this group      */
+	int		grphi;		/* Highest CPU in this group     */
+	struct rcu_node	*parent;
+} ____cacheline_internodealigned_in_smp;
+
+#define RCU_STATS_BUCKETS	24
+
 /* Global control variables for rcupdate callback mechanism. */
 struct rcu_ctrlblk {
 	long	cur;		/* Current batch number.                      */
 	long	completed;	/* Number of the last completed batch         */
 	int	next_pending;	/* Is the next batch already waiting?         */
 
+	/* Starts and completes batches: */
 	spinlock_t	lock	____cacheline_internodealigned_in_smp;
-	cpumask_t	cpumask; /* CPUs that need to switch in order    */
-	                         /* for current batch to proceed.        */
+	/* The tree, breadth first: root first, leaves last. */
+	struct rcu_node	node[NUM_RCU_NODES];
+#ifdef CONFIG_RCU_STATS
+	unsigned long long gp_start;	/* sched_clock() at batch start */
+	unsigned long	forced;		/* force_quiescent_state() IPIs */
+	unsigned int	gp_latency[RCU_STATS_BUCKETS];
+#endif
 } ____cacheline_internodealigned_in_smp;
 
 /* Is batch a before batch b ? */
@@ -108,6 +164,12 @@ struct rcu_data {
 	struct rcu_head barrier;
 #ifdef CONFIG_SMP
 	long		last_rs_qlen;	 /* qlen during the last resched */
+#endif
+	struct rcu_node	*mynode;	 /* Leaf we report to */
+	unsigned long	grpmask;	 /* Our bit in mynode->qsmask */
+#ifdef CONFIG_RCU_STATS
+	unsigned long	invoked;	 /* # of callbacks invoked */
+	long		qlen_max;	 /* Longest qlen seen */
 #endif
 };
 
@@ -266,8 +328,13 @@ extern void FASTCALL(call_rcu_bh(struct rcu_head *head,
 				void (*func)(struct rcu_head *head)));
 extern __deprecated_for_modules void synchronize_kernel(void);
 extern void synchronize_rcu(void);
+extern void synchronize_rcu_expedited(void);
 void synchronize_idle(void);
 extern void rcu_barrier(void);
 
+#ifdef CONFIG_RCU_STATS
+extern struct file_operations proc_rcu_stat_operations;
+#endif
+
 #endif /* __KERNEL__ */
 #endif /* __LINUX_RCUPDATE_H */
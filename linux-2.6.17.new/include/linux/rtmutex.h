@@ -0,0 +1,72 @@
+/*
+ * RT Mutexes: blocking mutual exclusion locks with priority inheritance
+ *
+ * This file contains the public data structure and API definitions.
+ */
+
+#ifndef __LINUX_RT_MUTEX_H
+#define __LINUX_RT_MUTEX_H
+
+#include <linux/linkage.h>
+#include <linux/list.h>
+#include <linux/spinlock_types.h>
+
+/*
+ * The rt_mutex structure
+ *
+ * @wait_lock:	spinlock to protect the structure
+ * @wait_list:	list of blocked waiters, sorted by priority (FIFO among
+ *		waiters of equal priority)
+ * @owner:	the mutex owner, NULL if the mutex is free
+ *
+ * There is no lock stealing: on unlock the mutex is handed over to the
+ * top waiter directly, so a mutex with waiters always has an owner.
+ */
+struct rt_mutex {
+	spinlock_t		wait_lock;
+	struct list_head	wait_list;
+	struct task_struct	*owner;
+};
+
+struct rt_mutex_waiter;
+
+#define __RT_MUTEX_INITIALIZER(mutexname) \
+	{ .wait_lock = SPIN_LOCK_UNLOCKED \
+	, .wait_list = LIST_HEAD_INIT(mutexname.wait_list) \
+	, .owner = NULL }
+
+#define DEFINE_RT_MUTEX(mutexname) \
+	struct rt_mutex mutexname = __RT_MUTEX_INITIALIZER(mutexname)
+
+/**
+ * rt_mutex_is_locked - is the mutex locked
+ * @lock: the mutex to be queried
+ *
+ * Returns 1 if the mutex is locked, 0 if unlocked.
+ */
+static inline int rt_mutex_is_locked(struct rt_mutex *lock)
+{
+	return lock->owner != NULL;
+}
+
+extern void rt_mutex_init(struct rt_mutex *lock);
+
+extern void rt_mutex_lock(struct rt_mutex *lock);
+extern int rt_mutex_lock_interruptible(struct rt_mutex *lock,
+				       int detect_deadlock);
+extern int rt_mutex_timed_lock(struct rt_mutex *lock, long timeout,
+			       int detect_deadlock);
+
+extern int rt_mutex_trylock(struct rt_mutex *lock);
+
+extern void rt_mutex_unlock(struct rt_mutex *lock);
+
+#ifdef CONFIG_RT_MUTEXES
+# define INIT_RT_MUTEXES(tsk)						\
+	.pi_waiters	= LIST_HEAD_INIT(tsk.pi_waiters),		\
+	.pi_blocked_on	= NULL,
+#else
+# define INIT_RT_MUTEXES(tsk)
+#endif
+
+#endif
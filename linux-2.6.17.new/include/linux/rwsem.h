@@ -27,6 +27,11 @@ struct rw_semaphore;
 #include <asm/rwsem.h> /* use an arch-specific implementation */
 #endif
 
+#ifdef CONFIG_LOCK_STAT
+extern void lock_stat_down_read(struct rw_semaphore *sem);
+extern void lock_stat_down_write(struct rw_semaphore *sem);
+#endif
+
 #ifndef rwsemtrace
 #if RWSEM_DEBUG
 extern void FASTCALL(rwsemtrace(struct rw_semaphore *sem, const char *str));
@@ -42,7 +47,12 @@ static inline void down_read(struct rw_semaphore *sem)
 {
 	might_sleep();
 	rwsemtrace(sem,"Entering down_read");
+#ifdef CONFIG_LOCK_STAT
+	if (unlikely(!__down_read_trylock(sem)))
+		lock_stat_down_read(sem);
+#else
 	__down_read(sem);
+#endif
 	rwsemtrace(sem,"Leaving down_read");
 }
 
@@ -65,7 +75,12 @@ static inline void down_write(struct rw_semaphore *sem)
 {
 	might_sleep();
 	rwsemtrace(sem,"Entering down_write");
+#ifdef CONFIG_LOCK_STAT
+	if (unlikely(!__down_write_trylock(sem)))
+		lock_stat_down_write(sem);
+#else
 	__down_write(sem);
+#endif
 	rwsemtrace(sem,"Leaving down_write");
 }
 
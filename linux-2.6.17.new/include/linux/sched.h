@@ -483,7 +483,8 @@ struct signal_struct {
 
 #define MAX_PRIO		(MAX_RT_PRIO + 40)
 
-#define rt_task(p)		(unlikely((p)->prio < MAX_RT_PRIO))
+#define rt_prio(prio)		(unlikely((prio) < MAX_RT_PRIO))
+#define rt_task(p)		rt_prio((p)->prio)
 #define batch_task(p)		(unlikely((p)->policy == SCHED_BATCH))
 
 /*
@@ -494,6 +495,7 @@ struct user_struct {
 	atomic_t processes;	/* How many processes does this user have? */
 	atomic_t files;		/* How many open files does this user have? */
 	atomic_t sigpending;	/* How many pending signals does this user have? */
+	atomic_t pipe_bufs;	/* How many pipe buffers does this user have? */
 #ifdef CONFIG_INOTIFY
 	atomic_t inotify_watches; /* How many inotify watches does this user have? */
 	atomic_t inotify_devs;	/* How many inotify devs does this user have opened? */
@@ -536,6 +538,49 @@ struct sched_info {
 extern struct file_operations proc_schedstat_operations;
 #endif
 
+#ifdef CONFIG_SCHED_FAIR
+extern unsigned int sysctl_sched_latency;
+extern unsigned int sysctl_sched_min_granularity;
+extern unsigned int sysctl_sched_wakeup_granularity;
+
+extern int proc_pid_sched(struct task_struct *p, char *buffer);
+#endif
+
+#ifdef CONFIG_SCHED_LATENCY_HIST
+enum schedlat_type {
+	SCHEDLAT_WAKEUP,	/* wakeup until running */
+	SCHEDLAT_SLICE,		/* time on the cpu per switch-in */
+	SCHEDLAT_PREEMPT,	/* preemption until running again */
+	SCHEDLAT_NR,
+};
+
+/* log2 buckets of 1024ns units, the last one is open-ended */
+#define SCHEDLAT_BUCKETS	24
+
+struct schedlat_hist {
+	unsigned int count[SCHEDLAT_BUCKETS];
+};
+
+extern struct file_operations proc_schedlat_operations;
+extern int proc_pid_schedlat(struct task_struct *p, char *buffer);
+#endif
+
+#ifdef CONFIG_FAIR_GROUP_SCHED
+struct task_group;
+
+extern struct task_group *sched_create_group(struct task_group *parent);
+extern void sched_destroy_group(struct task_group *tg);
+extern void sched_move_task(struct task_struct *tsk, struct task_group *tg);
+extern int sched_group_set_shares(struct task_group *tg, unsigned long shares);
+extern unsigned long sched_group_shares(struct task_group *tg);
+extern int sched_group_set_bandwidth(struct task_group *tg,
+				     long quota_us, long period_us);
+extern long sched_group_quota(struct task_group *tg);
+extern long sched_group_period(struct task_group *tg);
+extern unsigned long long sched_group_usage(struct task_group *tg);
+extern int sched_group_stat(struct task_group *tg, char *buffer);
+#endif
+
 enum idle_type
 {
 	SCHED_IDLE,
@@ -558,6 +603,7 @@ enum idle_type
 #define SD_WAKE_AFFINE		32	/* Wake task to waking CPU */
 #define SD_WAKE_BALANCE		64	/* Perform balancing at task wakeup */
 #define SD_SHARE_CPUPOWER	128	/* Domain members share cpu power */
+#define SD_SHARE_PKG_RESOURCES	256	/* Domain members share cache */
 
 struct sched_group {
 	struct sched_group *next;	/* Must be a circular list */
@@ -640,6 +686,8 @@ extern unsigned int max_cache_size;
 
 
 struct io_context;			/* See blkdev.h */
+struct blk_plug;			/* See blkdev.h */
+struct worker;				/* See kernel/workqueue.c */
 void exit_io_context(void);
 struct cpuset;
 
@@ -685,6 +733,8 @@ static inline void prefetch_stack(struct task_struct *t) { }
 struct audit_context;		/* See audit.c */
 struct mempolicy;
 struct pipe_inode_info;
+struct rt_mutex_waiter;
+struct futex_pi_state;
 
 enum sleep_type {
 	SLEEP_NORMAL,
@@ -705,7 +755,7 @@ struct task_struct {
 #if defined(CONFIG_SMP) && defined(__ARCH_WANT_UNLOCKED_CTXSW)
 	int oncpu;
 #endif
-	int prio, static_prio;
+	int prio, static_prio, normal_prio;
 	struct list_head run_list;
 	prio_array_t *array;
 
@@ -720,10 +770,34 @@ struct task_struct {
 	unsigned long policy;
 	cpumask_t cpus_allowed;
 	unsigned int time_slice, first_time_slice;
+#ifdef CONFIG_SMP
+	/* how many different tasks this one wakes, see wake_wide() */
+	struct task_struct *last_wakee;
+	unsigned int wakee_flips;
+	unsigned long wakee_flip_decay_ts;
+#endif
 
 #ifdef CONFIG_SCHEDSTATS
 	struct sched_info sched_info;
 #endif
+#ifdef CONFIG_SCHED_FAIR
+	/* virtual runtime accounting, see kernel/sched.c */
+	struct rb_node run_node;
+	unsigned long load_weight;
+	unsigned long long vruntime;
+	unsigned long long exec_start;
+	unsigned long long sum_exec_runtime, prev_sum_exec_runtime;
+	unsigned long long wait_start, sum_wait_runtime, wait_max;
+	unsigned long nr_wakeups;
+#endif
+#ifdef CONFIG_FAIR_GROUP_SCHED
+	struct task_group *task_group;	/* changed under task_lock + rq lock */
+#endif
+#ifdef CONFIG_SCHED_LATENCY_HIST
+	unsigned int schedlat_flags;
+	unsigned long nr_migrations;
+	struct schedlat_hist schedlat[SCHEDLAT_NR];
+#endif
 
 	struct list_head tasks;
 	/*
@@ -834,6 +908,16 @@ struct task_struct {
 /* Protection of proc_dentry: nesting proc_lock, dcache_lock, write_lock_irq(&tasklist_lock); */
 	spinlock_t proc_lock;
 
+	/* Protection of the PI data structures: */
+	spinlock_t pi_lock;
+
+#ifdef CONFIG_RT_MUTEXES
+	/* PI waiters blocked on a rt_mutex held by this task */
+	struct list_head pi_waiters;
+	/* Deadlock detection and priority inheritance handling */
+	struct rt_mutex_waiter *pi_blocked_on;
+#endif
+
 #ifdef CONFIG_DEBUG_MUTEXES
 	/* mutex deadlock detection */
 	struct mutex_waiter *blocked_on;
@@ -849,6 +933,7 @@ struct task_struct {
 	struct backing_dev_info *backing_dev_info;
 
 	struct io_context *io_context;
+	struct blk_plug *plug;		/* requests held back, see blkdev.h */
 
 	unsigned long ptrace_message;
 	siginfo_t *last_siginfo; /* For ptrace use.  */
@@ -880,6 +965,8 @@ struct task_struct {
 #ifdef CONFIG_COMPAT
 	struct compat_robust_list_head __user *compat_robust_list;
 #endif
+	struct list_head pi_state_list;
+	struct futex_pi_state *pi_state_cache;
 
 	atomic_t fs_excl;	/* holding fs exclusive resources */
 	struct rcu_head rcu;
@@ -888,6 +975,10 @@ struct task_struct {
 	 * cache last used pipe for splice
 	 */
 	struct pipe_inode_info *splice_pipe;
+	/*
+	 * workqueue worker this thread is, if PF_WQ_WORKER
+	 */
+	struct worker *wq_worker;
 };
 
 static inline pid_t process_group(struct task_struct *tsk)
@@ -927,6 +1018,7 @@ static inline void put_task_struct(struct task_struct *t)
 #define PF_STARTING	0x00000002	/* being created */
 #define PF_EXITING	0x00000004	/* getting shut down */
 #define PF_DEAD		0x00000008	/* Dead */
+#define PF_WQ_WORKER	0x00000020	/* I'm a workqueue worker */
 #define PF_FORKNOEXEC	0x00000040	/* forked but didn't exec */
 #define PF_SUPERPRIV	0x00000100	/* used super-user privileges */
 #define PF_DUMPCORE	0x00000200	/* dumped core */
@@ -1002,6 +1094,19 @@ static inline void idle_task_exit(void) {}
 #endif
 
 extern void sched_idle_next(void);
+
+#ifdef CONFIG_RT_MUTEXES
+extern int rt_mutex_getprio(task_t *p);
+extern void rt_mutex_setprio(task_t *p, int prio);
+extern void rt_mutex_adjust_pi(task_t *p);
+#else
+static inline int rt_mutex_getprio(task_t *p)
+{
+	return p->normal_prio;
+}
+# define rt_mutex_adjust_pi(p)		do { } while (0)
+#endif
+
 extern void set_user_nice(task_t *p, long nice);
 extern int task_prio(const task_t *p);
 extern int task_nice(const task_t *p);
@@ -1371,6 +1476,10 @@ static inline unsigned int task_cpu(const struct task_struct *p)
 
 static inline void set_task_cpu(struct task_struct *p, unsigned int cpu)
 {
+#ifdef CONFIG_SCHED_LATENCY_HIST
+	if (task_thread_info(p)->cpu != cpu)
+		p->nr_migrations++;
+#endif
 	task_thread_info(p)->cpu = cpu;
 }
 
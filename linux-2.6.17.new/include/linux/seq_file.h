@@ -47,6 +47,27 @@ int seq_path(struct seq_file *, struct vfsmount *, struct dentry *, char *);
 int single_open(struct file *, int (*)(struct seq_file *, void *), void *);
 int single_release(struct inode *, struct file *);
 int seq_release_private(struct inode *, struct file *);
+int seq_put_hist(struct seq_file *, const unsigned int *, int);
+
+/*
+ * Statistics files in /proc start with a "version N" line; N is bumped
+ * whenever the format, or the meaning of an existing field, changes.
+ *
+ * DEFINE_SEQ_STAT_FILE(foo) defines proc_foo_operations, a single_open()
+ * file showing show_foo().
+ */
+#define DEFINE_SEQ_STAT_FILE(name)					\
+static int name##_open(struct inode *inode, struct file *file)		\
+{									\
+	return single_open(file, show_##name, NULL);			\
+}									\
+									\
+struct file_operations proc_##name##_operations = {			\
+	.open		= name##_open,					\
+	.read		= seq_read,					\
+	.llseek		= seq_lseek,					\
+	.release	= single_release,				\
+}
 
 #define SEQ_START_TOKEN ((void *)1)
 
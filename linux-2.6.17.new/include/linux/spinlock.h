@@ -89,8 +89,31 @@ extern int __lockfunc generic__raw_read_trylock(raw_rwlock_t *lock);
 # include <linux/spinlock_up.h>
 #endif
 
-#define spin_lock_init(lock)	do { *(lock) = SPIN_LOCK_UNLOCKED; } while (0)
-#define rwlock_init(lock)	do { *(lock) = RW_LOCK_UNLOCKED; } while (0)
+#ifdef CONFIG_LOCK_STAT
+/*
+ * Every call site gets a lock class of its own for /proc/lock_stat,
+ * named after the site and the lock:
+ */
+# define spin_lock_init(lock)					\
+do {								\
+	static struct lock_class_key __key =			\
+		{ .name = __LOCK_CLASS_NAME(lock) };		\
+								\
+	*(lock) = SPIN_LOCK_UNLOCKED;				\
+	(lock)->key = &__key;					\
+} while (0)
+# define rwlock_init(lock)					\
+do {								\
+	static struct lock_class_key __key =			\
+		{ .name = __LOCK_CLASS_NAME(lock) };		\
+								\
+	*(lock) = RW_LOCK_UNLOCKED;				\
+	(lock)->key = &__key;					\
+} while (0)
+#else
+# define spin_lock_init(lock)	do { *(lock) = SPIN_LOCK_UNLOCKED; } while (0)
+# define rwlock_init(lock)	do { *(lock) = RW_LOCK_UNLOCKED; } while (0)
+#endif
 
 #define spin_is_locked(lock)	__raw_spin_is_locked(&(lock)->raw_lock)
 
@@ -171,9 +194,11 @@ extern int __lockfunc generic__raw_read_trylock(raw_rwlock_t *lock);
 #define write_lock_bh(lock)		_write_lock_bh(lock)
 
 /*
- * We inline the unlock functions in the nondebug case:
+ * We inline the unlock functions in the nondebug case (lock statistics
+ * need them out of line for the hold times):
  */
-#if defined(CONFIG_DEBUG_SPINLOCK) || defined(CONFIG_PREEMPT) || !defined(CONFIG_SMP)
+#if defined(CONFIG_DEBUG_SPINLOCK) || defined(CONFIG_PREEMPT) || \
+	!defined(CONFIG_SMP) || defined(CONFIG_LOCK_STAT)
 # define spin_unlock(lock)		_spin_unlock(lock)
 # define read_unlock(lock)		_read_unlock(lock)
 # define write_unlock(lock)		_write_unlock(lock)
@@ -183,7 +208,8 @@ extern int __lockfunc generic__raw_read_trylock(raw_rwlock_t *lock);
 # define write_unlock(lock)		__raw_write_unlock(&(lock)->raw_lock)
 #endif
 
-#if defined(CONFIG_DEBUG_SPINLOCK) || defined(CONFIG_PREEMPT) || !defined(CONFIG_SMP)
+#if defined(CONFIG_DEBUG_SPINLOCK) || defined(CONFIG_PREEMPT) || \
+	!defined(CONFIG_SMP) || defined(CONFIG_LOCK_STAT)
 # define spin_unlock_irq(lock)		_spin_unlock_irq(lock)
 # define read_unlock_irq(lock)		_read_unlock_irq(lock)
 # define write_unlock_irq(lock)		_write_unlock_irq(lock)
@@ -15,6 +15,8 @@
 # include <linux/spinlock_types_up.h>
 #endif
 
+#include <linux/lockstat.h>
+
 typedef struct {
 	raw_spinlock_t raw_lock;
 #if defined(CONFIG_PREEMPT) && defined(CONFIG_SMP)
@@ -24,6 +26,10 @@ typedef struct {
 	unsigned int magic, owner_cpu;
 	void *owner;
 #endif
+#ifdef CONFIG_LOCK_STAT
+	struct lock_class_key *key;
+	unsigned long long hold_start;
+#endif
 } spinlock_t;
 
 #define SPINLOCK_MAGIC		0xdead4ead
@@ -37,6 +43,10 @@ typedef struct {
 	unsigned int magic, owner_cpu;
 	void *owner;
 #endif
+#ifdef CONFIG_LOCK_STAT
+	struct lock_class_key *key;
+	unsigned long long hold_start;	/* of the writer */
+#endif
 } rwlock_t;
 
 #define RWLOCK_MAGIC		0xdeaf1eed
@@ -16,6 +16,7 @@ struct iattr;
 struct inode;
 struct iocb;
 struct io_event;
+struct ioring_params;
 struct iovec;
 struct itimerspec;
 struct itimerval;
@@ -580,6 +581,11 @@ asmlinkage long sys_vmsplice(int fd, const struct iovec __user *iov,
 
 asmlinkage long sys_tee(int fdin, int fdout, size_t len, unsigned int flags);
 
+asmlinkage long sys_ioring_setup(u32 entries,
+				 struct ioring_params __user *params);
+asmlinkage long sys_ioring_enter(unsigned int fd, u32 to_submit,
+				 u32 min_complete, u32 flags);
+
 asmlinkage long sys_sync_file_range(int fd, loff_t offset, loff_t nbytes,
 					unsigned int flags);
 asmlinkage long sys_get_robust_list(int pid,
@@ -148,6 +148,11 @@ enum
 	KERN_SPIN_RETRY=70,	/* int: number of spinlock retries */
 	KERN_ACPI_VIDEO_FLAGS=71, /* int: flags for setting up video after ACPI sleep */
 	KERN_IA64_UNALIGNED=72, /* int: ia64 unaligned userland trap enable */
+	KERN_SCHED_LATENCY=73,	/* int: fair scheduler latency target (ns) */
+	KERN_SCHED_MIN_GRANULARITY=74, /* int: fair scheduler min slice (ns) */
+	KERN_SCHED_WAKEUP_GRANULARITY=75, /* int: fair wakeup preemption (ns) */
+	KERN_MAX_LOCK_DEPTH=76,	/* int: rtmutex's maximum lock depth */
+	KERN_LOCK_STAT=77,	/* int: lock statistics level */
 };
 
 
@@ -787,6 +792,8 @@ enum
 	FS_AIO_NR=18,	/* current system-wide number of aio requests */
 	FS_AIO_MAX_NR=19,	/* system-wide maximum number of aio requests */
 	FS_INOTIFY=20,	/* inotify submenu */
+	FS_PIPE_MAX_SIZE=21,	/* int: largest pipe buffer for unprivileged users */
+	FS_PIPE_USER_PAGES=22,	/* int: maximum pipe buffers per user */
 };
 
 /* /proc/sys/fs/quota/ */
@@ -16,6 +16,7 @@ struct timer_list {
 	unsigned long data;
 
 	struct tvec_t_base_s *base;
+	int slack;
 };
 
 extern struct tvec_t_base_s boot_tvec_bases;
@@ -25,6 +26,7 @@ extern struct tvec_t_base_s boot_tvec_bases;
 		.expires = (_expires),				\
 		.data = (_data),				\
 		.base = &boot_tvec_bases,			\
+		.slack = -1,					\
 	}
 
 #define DEFINE_TIMER(_name, _function, _expires, _data)		\
@@ -62,6 +64,8 @@ extern int del_timer(struct timer_list * timer);
 extern int __mod_timer(struct timer_list *timer, unsigned long expires);
 extern int mod_timer(struct timer_list *timer, unsigned long expires);
 
+extern void set_timer_slack(struct timer_list *timer, int slack_hz);
+
 extern unsigned long next_timer_interrupt(void);
 
 /***
@@ -81,7 +85,7 @@ extern unsigned long next_timer_interrupt(void);
 static inline void add_timer(struct timer_list *timer)
 {
 	BUG_ON(timer_pending(timer));
-	__mod_timer(timer, timer->expires);
+	mod_timer(timer, timer->expires);
 }
 
 #ifdef CONFIG_SMP
@@ -99,4 +103,8 @@ extern void run_local_timers(void);
 struct hrtimer;
 extern int it_real_fn(struct hrtimer *);
 
+#ifdef CONFIG_TIMER_HIST
+extern struct file_operations proc_timer_hist_operations;
+#endif
+
 #endif
@@ -10,6 +10,7 @@
 #include <linux/bitops.h>
 
 struct workqueue_struct;
+struct task_struct;
 
 struct work_struct {
 	unsigned long pending;
@@ -17,6 +18,10 @@ struct work_struct {
 	void (*func)(void *);
 	void *data;
 	void *wq_data;
+	int color;
+#ifdef CONFIG_WORKQUEUE_STATS
+	unsigned long long queued;
+#endif
 	struct timer_list timer;
 };
 
@@ -54,14 +59,25 @@ struct execute_work {
 		init_timer(&(_work)->timer);			\
 	} while (0)
 
+/*
+ * workqueue flags:
+ */
+#define WQ_SINGLE_THREAD	0x1	/* one thread, works run in order */
+#define WQ_UNBOUND		0x2	/* not bound to the queueing CPU */
+#define WQ_HIGHPRI		0x4	/* run by high priority workers */
+
 extern struct workqueue_struct *__create_workqueue(const char *name,
-						    int singlethread);
+						    unsigned int flags);
 #define create_workqueue(name) __create_workqueue((name), 0)
-#define create_singlethread_workqueue(name) __create_workqueue((name), 1)
+#define create_singlethread_workqueue(name) \
+	__create_workqueue((name), WQ_SINGLE_THREAD)
+#define create_unbound_workqueue(name) __create_workqueue((name), WQ_UNBOUND)
+#define create_highpri_workqueue(name) __create_workqueue((name), WQ_HIGHPRI)
 
 extern void destroy_workqueue(struct workqueue_struct *wq);
 
 extern int FASTCALL(queue_work(struct workqueue_struct *wq, struct work_struct *work));
+extern int queue_work_on(int cpu, struct workqueue_struct *wq, struct work_struct *work);
 extern int FASTCALL(queue_delayed_work(struct workqueue_struct *wq, struct work_struct *work, unsigned long delay));
 extern void FASTCALL(flush_workqueue(struct workqueue_struct *wq));
 
@@ -75,12 +91,18 @@ extern int current_is_keventd(void);
 extern int keventd_up(void);
 
 extern void init_workqueues(void);
+extern void wq_worker_sleeping(struct task_struct *task);
+extern void wq_worker_running(struct task_struct *task);
 void cancel_rearming_delayed_work(struct work_struct *work);
 void cancel_rearming_delayed_workqueue(struct workqueue_struct *,
 				       struct work_struct *);
 int execute_in_process_context(void (*fn)(void *), void *,
 			       struct execute_work *);
 
+#ifdef CONFIG_WORKQUEUE_STATS
+extern struct file_operations proc_workqueue_stat_operations;
+#endif
+
 /*
  * Kill off a pending schedule_delayed_work().  Note that the work callback
  * function may still be running on return from cancel_delayed_work().  Run
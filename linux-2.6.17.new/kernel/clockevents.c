@@ -0,0 +1,166 @@
+/*
+ * linux/kernel/clockevents.c
+ *
+ * This file contains functions which manage clock event devices.
+ *
+ * Architecture timer code registers the one-shot capable timers it does
+ * not use for the tick, the high resolution timer code claims one per
+ * CPU and programs it for the next hrtimer expiry.
+ *
+ * For licencing details see kernel-base/COPYING
+ */
+
+#include <linux/clockchips.h>
+#include <linux/interrupt.h>
+#include <linux/module.h>
+#include <linux/errno.h>
+
+/* The registered clock event devices */
+static LIST_HEAD(clockevent_devices);
+static DEFINE_SPINLOCK(clockevents_lock);
+
+/* Number of registered one-shot devices no one has claimed yet */
+static int clockevents_nr_free;
+
+/**
+ * clockevent_delta2ns - Convert a latch value (device ticks) to nanoseconds
+ * @latch:	value to convert
+ * @evt:	pointer to clock event device descriptor
+ *
+ * Math helper, returns latch value converted to nanoseconds (bound checked)
+ */
+unsigned long clockevent_delta2ns(unsigned long latch,
+				  struct clock_event_device *evt)
+{
+	u64 clc = ((u64) latch << evt->shift);
+
+	do_div(clc, evt->mult);
+	if (clc < 1000)
+		clc = 1000;
+	if (clc > LONG_MAX)
+		clc = LONG_MAX;
+
+	return (unsigned long) clc;
+}
+
+/**
+ * clockevents_program_event - Reprogram the clock event device.
+ * @dev:	device to program
+ * @expires:	absolute expiry event time
+ * @now:	current time
+ *
+ * Returns 0 on success, -ETIME when the event is in the past. The delta
+ * is clamped to the range the device can do, so the event may come
+ * early if it is too far in the future - the caller has to cope with
+ * that and program the device again.
+ */
+int clockevents_program_event(struct clock_event_device *dev, ktime_t expires,
+			      ktime_t now)
+{
+	unsigned long long clc;
+	s64 delta;
+
+	delta = ktime_to_ns(ktime_sub(expires, now));
+	if (delta <= 0)
+		return -ETIME;
+
+	dev->next_event = expires;
+
+	if (dev->mode == CLOCK_EVT_MODE_SHUTDOWN)
+		return 0;
+
+	if (delta > dev->max_delta_ns)
+		delta = dev->max_delta_ns;
+	if (delta < dev->min_delta_ns)
+		delta = dev->min_delta_ns;
+
+	clc = delta * dev->mult;
+	clc >>= dev->shift;
+
+	return dev->set_next_event((unsigned long) clc, dev);
+}
+
+/**
+ * clockevents_register_device - register a clock event device
+ * @dev:	device to register
+ */
+void clockevents_register_device(struct clock_event_device *dev)
+{
+	unsigned long flags;
+
+	BUG_ON(dev->mode != CLOCK_EVT_MODE_UNUSED);
+	BUG_ON(!dev->set_next_event || !dev->set_mode);
+
+	spin_lock_irqsave(&clockevents_lock, flags);
+	list_add(&dev->list, &clockevent_devices);
+	if (dev->features & CLOCK_EVT_FEAT_ONESHOT)
+		clockevents_nr_free++;
+	spin_unlock_irqrestore(&clockevents_lock, flags);
+
+	printk(KERN_INFO "clockevents: registered %s, rating %d\n",
+	       dev->name, dev->rating);
+}
+EXPORT_SYMBOL_GPL(clockevents_register_device);
+
+/*
+ * Cheap check, without the lock, whether clockevents_request_device()
+ * could succeed. Called from the timer tick.
+ */
+int clockevents_oneshot_available(void)
+{
+	return clockevents_nr_free > 0;
+}
+
+/**
+ * clockevents_request_device - claim a one-shot device for a CPU
+ * @cpu:	the CPU the device interrupts will be handled on
+ * @handler:	event handler, called from the device interrupt
+ *
+ * Picks the free one-shot device with the highest rating that can
+ * interrupt @cpu and switches it to one-shot mode. Returns NULL if
+ * there is none.
+ */
+struct clock_event_device *
+clockevents_request_device(int cpu, void (*handler)(struct clock_event_device *))
+{
+	struct clock_event_device *dev, *best = NULL;
+	unsigned long flags;
+
+	spin_lock_irqsave(&clockevents_lock, flags);
+	list_for_each_entry(dev, &clockevent_devices, list) {
+		if (dev->event_handler ||
+		    !(dev->features & CLOCK_EVT_FEAT_ONESHOT))
+			continue;
+		if (!cpu_isset(cpu, dev->cpumask))
+			continue;
+		if (!best || dev->rating > best->rating)
+			best = dev;
+	}
+	if (best) {
+		best->event_handler = handler;
+		best->next_event.tv64 = KTIME_MAX;
+		best->mode = CLOCK_EVT_MODE_ONESHOT;
+		best->set_mode(CLOCK_EVT_MODE_ONESHOT, best);
+		clockevents_nr_free--;
+	}
+	spin_unlock_irqrestore(&clockevents_lock, flags);
+
+	return best;
+}
+
+/**
+ * clockevents_release_device - give a device back
+ * @dev:	device claimed with clockevents_request_device()
+ */
+void clockevents_release_device(struct clock_event_device *dev)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&clockevents_lock, flags);
+	dev->mode = CLOCK_EVT_MODE_SHUTDOWN;
+	dev->set_mode(CLOCK_EVT_MODE_SHUTDOWN, dev);
+	dev->event_handler = NULL;
+	dev->mode = CLOCK_EVT_MODE_UNUSED;
+	clockevents_nr_free++;
+	spin_unlock_irqrestore(&clockevents_lock, flags);
+}
@@ -99,6 +99,17 @@ struct cpuset {
 	int mems_generation;
 
 	struct fmeter fmeter;		/* memory_pressure filter */
+
+	/*
+	 * Share of the disks for I/O schedulers that divide them up by
+	 * cpuset, and an identifier for them that is never reused.
+	 */
+	unsigned int io_weight;
+	unsigned long io_id;
+
+#ifdef CONFIG_FAIR_GROUP_SCHED
+	struct task_group *tg;		/* CPU scheduling group */
+#endif
 };
 
 /* bits in struct cpuset flags field */
@@ -169,11 +180,15 @@ static inline int is_spread_slab(const struct cpuset *cs)
  */
 static int cpuset_mems_generation;
 
+/* Last cpuset->io_id handed out, guarded by manage_mutex. */
+static unsigned long cpuset_io_id;
+
 static struct cpuset top_cpuset = {
 	.flags = ((1 << CS_CPU_EXCLUSIVE) | (1 << CS_MEM_EXCLUSIVE)),
 	.cpus_allowed = CPU_MASK_ALL,
 	.mems_allowed = NODE_MASK_ALL,
 	.count = ATOMIC_INIT(0),
+	.io_weight = CPUSET_IO_WEIGHT_DEFAULT,
 	.sibling = LIST_HEAD_INIT(top_cpuset.sibling),
 	.children = LIST_HEAD_INIT(top_cpuset.children),
 };
@@ -303,6 +318,9 @@ static void cpuset_diput(struct dentry *dentry, struct inode *inode)
 	if (S_ISDIR(inode->i_mode)) {
 		struct cpuset *cs = dentry->d_fsdata;
 		BUG_ON(!(is_removed(cs)));
+#ifdef CONFIG_FAIR_GROUP_SCHED
+		sched_destroy_group(cs->tg);
+#endif
 		kfree(cs);
 	}
 	iput(inode);
@@ -683,6 +701,29 @@ void cpuset_update_task_memory_state(void)
 	}
 }
 
+/**
+ * cpuset_io_group - the cpuset of the current task, for I/O scheduling
+ * @weight: set to the io_weight of the cpuset
+ *
+ * Returns an identifier of the cpuset, which is never reused for
+ * another one, for I/O schedulers that share out a disk between
+ * cpusets. The top cpuset is 0.
+ */
+unsigned long cpuset_io_group(unsigned int *weight)
+{
+	struct cpuset *cs;
+	unsigned long id;
+
+	rcu_read_lock();
+	cs = rcu_dereference(current->cpuset);
+	id = cs->io_id;
+	*weight = cs->io_weight;
+	rcu_read_unlock();
+
+	return id;
+}
+EXPORT_SYMBOL_GPL(cpuset_io_group);
+
 /*
  * is_cpuset_subset(p, q) - Is cpuset p a subset of cpuset q?
  *
@@ -1062,6 +1103,19 @@ static int update_flag(cpuset_flagbits_t bit, struct cpuset *cs, char *buf)
 	return 0;
 }
 
+/*
+ * Call with manage_mutex held.
+ */
+static int update_io_weight(struct cpuset *cs, char *buf)
+{
+	unsigned long weight = simple_strtoul(buf, NULL, 10);
+
+	if (weight < CPUSET_IO_WEIGHT_MIN || weight > CPUSET_IO_WEIGHT_MAX)
+		return -EINVAL;
+	cs->io_weight = weight;
+	return 0;
+}
+
 /*
  * Frequency meter - How fast is some event occuring?
  *
@@ -1217,6 +1271,9 @@ static int attach_task(struct cpuset *cs, char *pidbuf, char **ppathbuf)
 	}
 	atomic_inc(&cs->count);
 	rcu_assign_pointer(tsk->cpuset, cs);
+#ifdef CONFIG_FAIR_GROUP_SCHED
+	sched_move_task(tsk, cs->tg);
+#endif
 	task_unlock(tsk);
 
 	guarantee_online_cpus(cs, &cpus);
@@ -1257,6 +1314,14 @@ typedef enum {
 	FILE_MEMORY_PRESSURE,
 	FILE_SPREAD_PAGE,
 	FILE_SPREAD_SLAB,
+	FILE_IO_WEIGHT,
+#ifdef CONFIG_FAIR_GROUP_SCHED
+	FILE_CPU_SHARES,
+	FILE_CPU_QUOTA,
+	FILE_CPU_PERIOD,
+	FILE_CPU_USAGE,
+	FILE_CPU_STAT,
+#endif
 	FILE_TASKLIST,
 } cpuset_filetype_t;
 
@@ -1324,6 +1389,29 @@ static ssize_t cpuset_common_file_write(struct file *file, const char __user *us
 		retval = update_flag(CS_SPREAD_SLAB, cs, buffer);
 		cs->mems_generation = cpuset_mems_generation++;
 		break;
+	case FILE_IO_WEIGHT:
+		retval = update_io_weight(cs, buffer);
+		break;
+#ifdef CONFIG_FAIR_GROUP_SCHED
+	case FILE_CPU_SHARES:
+		retval = sched_group_set_shares(cs->tg,
+					simple_strtoul(buffer, NULL, 10));
+		break;
+	case FILE_CPU_QUOTA:
+		retval = sched_group_set_bandwidth(cs->tg,
+					simple_strtol(buffer, NULL, 10),
+					sched_group_period(cs->tg));
+		break;
+	case FILE_CPU_PERIOD:
+		retval = sched_group_set_bandwidth(cs->tg,
+					sched_group_quota(cs->tg),
+					simple_strtol(buffer, NULL, 10));
+		break;
+	case FILE_CPU_USAGE:
+	case FILE_CPU_STAT:
+		retval = -EACCES;
+		break;
+#endif
 	case FILE_TASKLIST:
 		retval = attach_task(cs, buffer, &pathbuf);
 		break;
@@ -1439,6 +1527,26 @@ static ssize_t cpuset_common_file_read(struct file *file, char __user *buf,
 	case FILE_SPREAD_SLAB:
 		*s++ = is_spread_slab(cs) ? '1' : '0';
 		break;
+	case FILE_IO_WEIGHT:
+		s += sprintf(s, "%u", cs->io_weight);
+		break;
+#ifdef CONFIG_FAIR_GROUP_SCHED
+	case FILE_CPU_SHARES:
+		s += sprintf(s, "%lu", sched_group_shares(cs->tg));
+		break;
+	case FILE_CPU_QUOTA:
+		s += sprintf(s, "%ld", sched_group_quota(cs->tg));
+		break;
+	case FILE_CPU_PERIOD:
+		s += sprintf(s, "%ld", sched_group_period(cs->tg));
+		break;
+	case FILE_CPU_USAGE:
+		s += sprintf(s, "%llu", sched_group_usage(cs->tg));
+		break;
+	case FILE_CPU_STAT:
+		s += sched_group_stat(cs->tg, s);
+		break;
+#endif
 	default:
 		retval = -EINVAL;
 		goto out;
@@ -1812,6 +1920,38 @@ static struct cftype cft_spread_slab = {
 	.private = FILE_SPREAD_SLAB,
 };
 
+static struct cftype cft_io_weight = {
+	.name = "io_weight",
+	.private = FILE_IO_WEIGHT,
+};
+
+#ifdef CONFIG_FAIR_GROUP_SCHED
+static struct cftype cft_cpu_shares = {
+	.name = "cpu_shares",
+	.private = FILE_CPU_SHARES,
+};
+
+static struct cftype cft_cpu_quota = {
+	.name = "cpu_quota_us",
+	.private = FILE_CPU_QUOTA,
+};
+
+static struct cftype cft_cpu_period = {
+	.name = "cpu_period_us",
+	.private = FILE_CPU_PERIOD,
+};
+
+static struct cftype cft_cpu_usage = {
+	.name = "cpu_usage",
+	.private = FILE_CPU_USAGE,
+};
+
+static struct cftype cft_cpu_stat = {
+	.name = "cpu_stat",
+	.private = FILE_CPU_STAT,
+};
+#endif
+
 static int cpuset_populate_dir(struct dentry *cs_dentry)
 {
 	int err;
@@ -1834,6 +1974,20 @@ static int cpuset_populate_dir(struct dentry *cs_dentry)
 		return err;
 	if ((err = cpuset_add_file(cs_dentry, &cft_spread_slab)) < 0)
 		return err;
+	if ((err = cpuset_add_file(cs_dentry, &cft_io_weight)) < 0)
+		return err;
+#ifdef CONFIG_FAIR_GROUP_SCHED
+	if ((err = cpuset_add_file(cs_dentry, &cft_cpu_shares)) < 0)
+		return err;
+	if ((err = cpuset_add_file(cs_dentry, &cft_cpu_quota)) < 0)
+		return err;
+	if ((err = cpuset_add_file(cs_dentry, &cft_cpu_period)) < 0)
+		return err;
+	if ((err = cpuset_add_file(cs_dentry, &cft_cpu_usage)) < 0)
+		return err;
+	if ((err = cpuset_add_file(cs_dentry, &cft_cpu_stat)) < 0)
+		return err;
+#endif
 	if ((err = cpuset_add_file(cs_dentry, &cft_tasks)) < 0)
 		return err;
 	return 0;
@@ -1856,6 +2010,13 @@ static long cpuset_create(struct cpuset *parent, const char *name, int mode)
 	cs = kmalloc(sizeof(*cs), GFP_KERNEL);
 	if (!cs)
 		return -ENOMEM;
+#ifdef CONFIG_FAIR_GROUP_SCHED
+	cs->tg = sched_create_group(parent->tg);
+	if (!cs->tg) {
+		kfree(cs);
+		return -ENOMEM;
+	}
+#endif
 
 	mutex_lock(&manage_mutex);
 	cpuset_update_task_memory_state();
@@ -1872,6 +2033,8 @@ static long cpuset_create(struct cpuset *parent, const char *name, int mode)
 	INIT_LIST_HEAD(&cs->sibling);
 	INIT_LIST_HEAD(&cs->children);
 	cs->mems_generation = cpuset_mems_generation++;
+	cs->io_weight = CPUSET_IO_WEIGHT_DEFAULT;
+	cs->io_id = ++cpuset_io_id;
 	fmeter_init(&cs->fmeter);
 
 	cs->parent = parent;
@@ -1898,6 +2061,9 @@ static long cpuset_create(struct cpuset *parent, const char *name, int mode)
 err:
 	list_del(&cs->sibling);
 	mutex_unlock(&manage_mutex);
+#ifdef CONFIG_FAIR_GROUP_SCHED
+	sched_destroy_group(cs->tg);
+#endif
 	kfree(cs);
 	return err;
 }
@@ -2043,6 +2209,9 @@ void cpuset_fork(struct task_struct *child)
 	task_lock(current);
 	child->cpuset = current->cpuset;
 	atomic_inc(&child->cpuset->count);
+#ifdef CONFIG_FAIR_GROUP_SCHED
+	child->task_group = child->cpuset->tg;
+#endif
 	task_unlock(current);
 }
 
@@ -2111,6 +2280,11 @@ void cpuset_exit(struct task_struct *tsk)
 
 	cs = tsk->cpuset;
 	tsk->cpuset = &top_cpuset;	/* the_top_cpuset_hack - see above */
+#ifdef CONFIG_FAIR_GROUP_SCHED
+	task_lock(tsk);
+	sched_move_task(tsk, NULL);
+	task_unlock(tsk);
+#endif
 
 	if (notify_on_release(cs)) {
 		char *pathbuf = NULL;
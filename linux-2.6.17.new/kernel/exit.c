@@ -903,6 +903,10 @@ fastcall NORET_TYPE void do_exit(long code)
 	if (unlikely(tsk->compat_robust_list))
 		compat_exit_robust_list(tsk);
 #endif
+	if (unlikely(!list_empty(&tsk->pi_state_list)))
+		exit_pi_state_list(tsk);
+	if (unlikely(tsk->pi_state_cache))
+		kfree(tsk->pi_state_cache);
 	if (unlikely(tsk->audit_context))
 		audit_free(tsk);
 	exit_mm(tsk);
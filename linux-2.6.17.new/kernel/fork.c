@@ -891,11 +891,20 @@ static inline void cleanup_signal(struct task_struct *tsk)
 		__cleanup_signal(sig);
 }
 
+static inline void rt_mutex_init_task(struct task_struct *p)
+{
+	spin_lock_init(&p->pi_lock);
+#ifdef CONFIG_RT_MUTEXES
+	INIT_LIST_HEAD(&p->pi_waiters);
+	p->pi_blocked_on = NULL;
+#endif
+}
+
 static inline void copy_flags(unsigned long clone_flags, struct task_struct *p)
 {
 	unsigned long new_flags = p->flags;
 
-	new_flags &= ~(PF_SUPERPRIV | PF_NOFREEZE);
+	new_flags &= ~(PF_SUPERPRIV | PF_NOFREEZE | PF_WQ_WORKER);
 	new_flags |= PF_FORKNOEXEC;
 	if (!(clone_flags & CLONE_PTRACE))
 		p->ptrace = 0;
@@ -984,6 +993,7 @@ static task_t *copy_process(unsigned long clone_flags,
 	p->did_exec = 0;
 	copy_flags(clone_flags, p);
 	p->pid = pid;
+	p->wq_worker = NULL;
 	retval = -EFAULT;
 	if (clone_flags & CLONE_PARENT_SETTID)
 		if (put_user(p->pid, parent_tidptr))
@@ -996,6 +1006,7 @@ static task_t *copy_process(unsigned long clone_flags,
 	p->vfork_done = NULL;
 	spin_lock_init(&p->alloc_lock);
 	spin_lock_init(&p->proc_lock);
+	rt_mutex_init_task(p);
 
 	clear_tsk_thread_flag(p, TIF_SIGPENDING);
 	init_sigpending(&p->pending);
@@ -1020,6 +1031,7 @@ static task_t *copy_process(unsigned long clone_flags,
 	do_posix_clock_monotonic_gettime(&p->start_time);
 	p->security = NULL;
 	p->io_context = NULL;
+	p->plug = NULL;
 	p->io_wait = NULL;
 	p->audit_context = NULL;
 	cpuset_fork(p);
@@ -1075,6 +1087,8 @@ static task_t *copy_process(unsigned long clone_flags,
 #ifdef CONFIG_COMPAT
 	p->compat_robust_list = NULL;
 #endif
+	INIT_LIST_HEAD(&p->pi_state_list);
+	p->pi_state_cache = NULL;
 	/*
 	 * sigaltstack should be cleared when sharing the same VM
 	 */
@@ -12,6 +12,9 @@
  *  (C) Copyright 2006 Red Hat Inc, All Rights Reserved
  *  Thanks to Thomas Gleixner for suggestions, analysis and fixes.
  *
+ *  PI-futex support: FUTEX_LOCK_PI, FUTEX_UNLOCK_PI and FUTEX_TRYLOCK_PI
+ *  on top of rt-mutexes, see Documentation/pi-futex.txt
+ *
  *  Thanks to Ben LaHaise for yelling "hashed waitqueues" loudly
  *  enough at me, Linus for the original (flawed) idea, Matthew
  *  Kirkwood for proof-of-concept implementation.
@@ -44,9 +47,19 @@
 #include <linux/pagemap.h>
 #include <linux/syscalls.h>
 #include <linux/signal.h>
+#include <linux/vmalloc.h>
+#include <linux/nodemask.h>
+#include <linux/percpu.h>
+#include <linux/seq_file.h>
 #include <asm/futex.h>
 
-#define FUTEX_HASHBITS (CONFIG_BASE_SMALL ? 4 : 8)
+#include "rtmutex_common.h"
+
+/*
+ * Hash buckets per possible CPU; a BASE_SMALL kernel gets a fixed
+ * table of 16 buckets.
+ */
+#define FUTEX_HASH_PER_CPU	256
 
 /*
  * Futexes are matched on equal values of this key.
@@ -74,6 +87,27 @@ union futex_key {
 	} both;
 };
 
+/*
+ * Priority Inheritance state:
+ */
+struct futex_pi_state {
+	/*
+	 * list of 'owned' pi_state instances - these have to be
+	 * cleaned up in do_exit() if the task exits prematurely:
+	 */
+	struct list_head list;
+
+	/*
+	 * The PI object:
+	 */
+	struct rt_mutex pi_mutex;
+
+	struct task_struct *owner;
+	atomic_t refcount;
+
+	union futex_key key;
+};
+
 /*
  * We use this hashed waitqueue instead of a normal wait_queue_t, so
  * we can wake only the relevant ones (hashed queues may be shared).
@@ -82,6 +116,9 @@ union futex_key {
  * It is considered woken when list_empty(&q->list) || q->lock_ptr == 0.
  * The order of wakup is always to make the first condition true, then
  * wake up q->waiters, then make the second condition true.
+ *
+ * PI futex waiters are not woken this way, they block on
+ * pi_state->pi_mutex and unqueue themselves.
  */
 struct futex_q {
 	struct list_head list;
@@ -96,17 +133,46 @@ struct futex_q {
 	/* For fd, sigio sent using these. */
 	int fd;
 	struct file *filp;
+
+	/* Optional priority inheritance state: */
+	struct futex_pi_state *pi_state;
+	struct task_struct *task;
 };
 
 /*
  * Split the global futex_lock into every hash list lock.
  */
 struct futex_hash_bucket {
-       spinlock_t              lock;
-       struct list_head       chain;
+	spinlock_t		lock;
+	struct list_head	chain;
+	unsigned int		nr_waiters;	/* futex_qs on chain */
 };
 
-static struct futex_hash_bucket futex_queues[1<<FUTEX_HASHBITS];
+/*
+ * The hash table scales with the number of possible CPUs. It is split
+ * into a power of two number of chunks which are spread round robin
+ * over the online nodes and allocated there, so the bucket locks of a
+ * big table are not all homed on node 0. The low bits of the hash
+ * select the bucket within a chunk, the bits above select the chunk.
+ */
+static struct futex_hash_bucket *futex_queues[MAX_NUMNODES];
+static unsigned long futex_hashsize;
+static unsigned int futex_chunk_shift;
+
+/*
+ * Hash statistics, reported in /proc/futex_stat. Only updated with
+ * a bucket lock held, so preemption is off:
+ */
+struct futex_stat {
+	unsigned long queued;		/* futex_qs hashed */
+	unsigned long shared;		/* ... into a bucket already in use */
+	unsigned long collisions;	/* other futexes' waiters walked past */
+	unsigned long pi_waits;		/* PI lockers that had to block */
+};
+
+static DEFINE_PER_CPU(struct futex_stat, futex_stats);
+
+#define futex_stat_inc(field)	(__get_cpu_var(futex_stats).field++)
 
 /* Futex-fs vfsmount entry: */
 static struct vfsmount *futex_mnt;
@@ -119,7 +185,10 @@ static struct futex_hash_bucket *hash_futex(union futex_key *key)
 	u32 hash = jhash2((u32*)&key->both.word,
 			  (sizeof(key->both.word)+sizeof(key->both.ptr))/4,
 			  key->both.offset);
-	return &futex_queues[hash & ((1 << FUTEX_HASHBITS)-1)];
+
+	hash &= futex_hashsize - 1;
+	return &futex_queues[hash >> futex_chunk_shift]
+			    [hash & ((1UL << futex_chunk_shift) - 1)];
 }
 
 /*
@@ -132,6 +201,18 @@ static inline int match_futex(union futex_key *key1, union futex_key *key2)
 		&& key1->both.offset == key2->both.offset);
 }
 
+/*
+ * match_futex() for walks of a hash chain, which also counts the
+ * waiters of other futexes sharing the bucket. Hash bucket lock held.
+ */
+static inline int match_futex_q(struct futex_q *q, union futex_key *key)
+{
+	if (likely(match_futex(&q->key, key)))
+		return 1;
+	futex_stat_inc(collisions);
+	return 0;
+}
+
 /*
  * Get parameters which are the keys for a futex.
  *
@@ -257,6 +338,277 @@ static inline int get_futex_value_locked(int *dest, int __user *from)
 	return ret ? -EFAULT : 0;
 }
 
+static inline u32 cmpxchg_futex_value_locked(u32 __user *uaddr, u32 uval,
+					     u32 newval)
+{
+	u32 curval;
+
+	inc_preempt_count();
+	curval = futex_atomic_cmpxchg_inatomic((int __user *)uaddr, uval,
+					       newval);
+	dec_preempt_count();
+
+	return curval;
+}
+
+/*
+ * Fault the futex word in writable, for the cmpxchg and atomic op
+ * paths that can't sleep. Called with current->mm->mmap_sem held but
+ * no hash bucket lock; gives up on the second attempt.
+ */
+static int futex_handle_fault(unsigned long address, int attempt)
+{
+	struct vm_area_struct * vma;
+	struct mm_struct *mm = current->mm;
+
+	if (attempt >= 2 ||
+	    !(vma = find_vma(mm, address)) ||
+	    vma->vm_start > address ||
+	    !(vma->vm_flags & VM_WRITE))
+		return -EFAULT;
+
+	switch (handle_mm_fault(mm, vma, address, 1)) {
+	case VM_FAULT_MINOR:
+		current->min_flt++;
+		break;
+	case VM_FAULT_MAJOR:
+		current->maj_flt++;
+		break;
+	default:
+		return -EFAULT;
+	}
+	return 0;
+}
+
+static inline struct futex_hash_bucket *lock_to_bucket(spinlock_t *lock_ptr)
+{
+	return container_of(lock_ptr, struct futex_hash_bucket, lock);
+}
+
+/*
+ * PI code:
+ */
+static int refill_pi_state_cache(void)
+{
+	struct futex_pi_state *pi_state;
+
+	if (likely(current->pi_state_cache))
+		return 0;
+
+	pi_state = kmalloc(sizeof(*pi_state), GFP_KERNEL);
+
+	if (!pi_state)
+		return -ENOMEM;
+
+	memset(pi_state, 0, sizeof(*pi_state));
+	INIT_LIST_HEAD(&pi_state->list);
+	/* pi_mutex gets initialized later */
+	pi_state->owner = NULL;
+	atomic_set(&pi_state->refcount, 1);
+
+	current->pi_state_cache = pi_state;
+
+	return 0;
+}
+
+static struct futex_pi_state * alloc_pi_state(void)
+{
+	struct futex_pi_state *pi_state = current->pi_state_cache;
+
+	WARN_ON(!pi_state);
+	current->pi_state_cache = NULL;
+
+	return pi_state;
+}
+
+static void free_pi_state(struct futex_pi_state *pi_state)
+{
+	if (!atomic_dec_and_test(&pi_state->refcount))
+		return;
+
+	/*
+	 * If pi_state->owner is NULL, the owner is most probably dying
+	 * and has cleaned up the pi_state already
+	 */
+	if (pi_state->owner) {
+		spin_lock_irq(&pi_state->owner->pi_lock);
+		list_del_init(&pi_state->list);
+		spin_unlock_irq(&pi_state->owner->pi_lock);
+
+		rt_mutex_proxy_unlock(&pi_state->pi_mutex, pi_state->owner);
+	}
+
+	if (current->pi_state_cache)
+		kfree(pi_state);
+	else {
+		/*
+		 * pi_state->list is already empty.
+		 * clear pi_state->owner.
+		 * refcount is at 0 - put it back to 1.
+		 */
+		pi_state->owner = NULL;
+		atomic_set(&pi_state->refcount, 1);
+		current->pi_state_cache = pi_state;
+	}
+}
+
+/*
+ * Look up the task based on what TID userspace gave us.
+ * We dont trust it.
+ */
+static struct task_struct * futex_find_get_task(pid_t pid)
+{
+	struct task_struct *p;
+
+	read_lock(&tasklist_lock);
+	p = find_task_by_pid(pid);
+	if (!p || p->exit_state)
+		goto out_unlock;
+	if ((current->euid != p->euid) && (current->euid != p->uid)) {
+		p = NULL;
+		goto out_unlock;
+	}
+	get_task_struct(p);
+	read_unlock(&tasklist_lock);
+	return p;
+
+out_unlock:
+	read_unlock(&tasklist_lock);
+	return NULL;
+}
+
+/*
+ * This task is holding PI mutexes at exit time => bad.
+ * Kernel cleans up PI-state, but userspace is likely hosed.
+ * (Robust-futex cleanup is separate and might save the day for userspace.)
+ */
+void exit_pi_state_list(struct task_struct *curr)
+{
+	struct list_head *next, *head = &curr->pi_state_list;
+	struct futex_pi_state *pi_state;
+	struct futex_hash_bucket *hb;
+	union futex_key key;
+
+	/*
+	 * PF_EXITING is set, so nobody can attach new pi_state to us
+	 * anymore, but we have to be careful versus waiters unqueueing
+	 * themselves:
+	 */
+	spin_lock_irq(&curr->pi_lock);
+	while (!list_empty(head)) {
+
+		next = head->next;
+		pi_state = list_entry(next, struct futex_pi_state, list);
+		key = pi_state->key;
+		spin_unlock_irq(&curr->pi_lock);
+
+		hb = hash_futex(&key);
+		spin_lock(&hb->lock);
+
+		spin_lock_irq(&curr->pi_lock);
+		/*
+		 * We dropped the pi-lock, so re-check whether this
+		 * task still owns the PI-state:
+		 */
+		if (head->next != next) {
+			spin_unlock(&hb->lock);
+			continue;
+		}
+
+		WARN_ON(pi_state->owner != curr);
+		list_del_init(&pi_state->list);
+		pi_state->owner = NULL;
+		spin_unlock_irq(&curr->pi_lock);
+
+		/*
+		 * The rt_mutex may already have gone to a waiter that
+		 * did not fix up the pi_state yet:
+		 */
+		if (pi_state->pi_mutex.owner == curr)
+			rt_mutex_unlock(&pi_state->pi_mutex);
+
+		spin_unlock(&hb->lock);
+
+		spin_lock_irq(&curr->pi_lock);
+	}
+	spin_unlock_irq(&curr->pi_lock);
+}
+
+static int
+lookup_pi_state(u32 uval, struct futex_hash_bucket *hb, struct futex_q *me)
+{
+	struct futex_pi_state *pi_state = NULL;
+	struct futex_q *this, *next;
+	struct list_head *head;
+	struct task_struct *p;
+	pid_t pid;
+
+	head = &hb->chain;
+
+	list_for_each_entry_safe(this, next, head, list) {
+		if (match_futex_q(this, &me->key)) {
+			/*
+			 * Another waiter already exists - bump up
+			 * the refcount and return its pi_state:
+			 */
+			pi_state = this->pi_state;
+			/*
+			 * Userspace might have messed up non PI and PI futexes
+			 */
+			if (unlikely(!pi_state))
+				return -EINVAL;
+
+			atomic_inc(&pi_state->refcount);
+			me->pi_state = pi_state;
+
+			return 0;
+		}
+	}
+
+	/*
+	 * We are the first waiter - try to look up the real owner and
+	 * attach the new pi_state to it:
+	 */
+	pid = uval & FUTEX_TID_MASK;
+	p = pid ? futex_find_get_task(pid) : NULL;
+	if (!p)
+		return -ESRCH;
+
+	/*
+	 * do_exit() sets PF_EXITING before it cleans up the pi_state
+	 * list under p->pi_lock, so checking the flag under the same
+	 * lock makes sure we never attach to a task that is past that:
+	 */
+	spin_lock_irq(&p->pi_lock);
+	if (unlikely(p->flags & PF_EXITING)) {
+		spin_unlock_irq(&p->pi_lock);
+		put_task_struct(p);
+		return -EAGAIN;
+	}
+
+	pi_state = alloc_pi_state();
+
+	/*
+	 * Initialize the pi_mutex in locked state and make 'p'
+	 * the owner of it:
+	 */
+	rt_mutex_init_proxy_locked(&pi_state->pi_mutex, p);
+
+	/* Store the key for possible exit cleanups: */
+	pi_state->key = me->key;
+
+	WARN_ON(!list_empty(&pi_state->list));
+	list_add(&pi_state->list, &p->pi_state_list);
+	pi_state->owner = p;
+	spin_unlock_irq(&p->pi_lock);
+
+	put_task_struct(p);
+
+	me->pi_state = pi_state;
+
+	return 0;
+}
+
 /*
  * The hash bucket lock must be held when this is called.
  * Afterwards, the futex_q must not be accessed.
@@ -264,6 +616,7 @@ static inline int get_futex_value_locked(int *dest, int __user *from)
 static void wake_futex(struct futex_q *q)
 {
 	list_del_init(&q->list);
+	lock_to_bucket(q->lock_ptr)->nr_waiters--;
 	if (q->filp)
 		send_sigio(&q->filp->f_owner, q->fd, POLL_IN);
 	/*
@@ -284,6 +637,116 @@ static void wake_futex(struct futex_q *q)
 	q->lock_ptr = NULL;
 }
 
+static int wake_futex_pi(u32 __user *uaddr, u32 uval, struct futex_q *this)
+{
+	struct task_struct *new_owner;
+	struct futex_pi_state *pi_state = this->pi_state;
+	u32 curval, newval;
+
+	if (!pi_state)
+		return -EINVAL;
+
+	spin_lock(&pi_state->pi_mutex.wait_lock);
+	new_owner = rt_mutex_next_owner(&pi_state->pi_mutex);
+
+	/*
+	 * A waiter that is queued on the futex but did not block on the
+	 * rt_mutex yet (or gave up on it) - it takes the rt_mutex once
+	 * it gets there, so make it the next owner:
+	 */
+	if (!new_owner)
+		new_owner = this->task;
+
+	/*
+	 * We pass it to the next owner. (The WAITERS bit is always
+	 * kept enabled while there is PI state around. We must also
+	 * preserve the owner died bit.)
+	 */
+	newval = (uval & FUTEX_OWNER_DIED) | FUTEX_WAITERS | new_owner->pid;
+
+	curval = cmpxchg_futex_value_locked(uaddr, uval, newval);
+
+	if (curval != uval) {
+		spin_unlock(&pi_state->pi_mutex.wait_lock);
+		return curval == -EFAULT ? -EFAULT : -EINVAL;
+	}
+
+	spin_lock_irq(&pi_state->owner->pi_lock);
+	WARN_ON(list_empty(&pi_state->list));
+	list_del_init(&pi_state->list);
+	spin_unlock_irq(&pi_state->owner->pi_lock);
+
+	spin_lock_irq(&new_owner->pi_lock);
+	WARN_ON(!list_empty(&pi_state->list));
+	list_add(&pi_state->list, &new_owner->pi_state_list);
+	pi_state->owner = new_owner;
+	spin_unlock_irq(&new_owner->pi_lock);
+
+	spin_unlock(&pi_state->pi_mutex.wait_lock);
+	rt_mutex_unlock(&pi_state->pi_mutex);
+
+	return 0;
+}
+
+static int unlock_futex_pi(u32 __user *uaddr, u32 uval)
+{
+	u32 oldval;
+
+	/*
+	 * There is no waiter, so we unlock the futex. The owner died
+	 * bit has not to be preserved here. We are the owner:
+	 */
+	oldval = cmpxchg_futex_value_locked(uaddr, uval, 0);
+
+	if (oldval == -EFAULT)
+		return oldval;
+	if (oldval != uval)
+		return -EAGAIN;
+
+	return 0;
+}
+
+/*
+ * Lock two hash buckets in address order, to avoid ABBA deadlocks
+ * against other double lockers. bh1 and bh2 may be the same bucket.
+ */
+static inline void
+double_lock_hb(struct futex_hash_bucket *bh1, struct futex_hash_bucket *bh2)
+{
+	if (bh1 < bh2)
+		spin_lock(&bh1->lock);
+	spin_lock(&bh2->lock);
+	if (bh1 > bh2)
+		spin_lock(&bh1->lock);
+}
+
+static inline void
+double_unlock_hb(struct futex_hash_bucket *bh1, struct futex_hash_bucket *bh2)
+{
+	spin_unlock(&bh1->lock);
+	if (bh1 != bh2)
+		spin_unlock(&bh2->lock);
+}
+
+/*
+ * Move a waiter from bh1 over to the futex key2 hashes to (bh2). Both
+ * bucket locks must be held. The waiter takes a reference on key2, the
+ * caller has to drop the one it held on its old key, outside of the
+ * spinlocks.
+ */
+static inline void requeue_futex(struct futex_q *q,
+				 struct futex_hash_bucket *bh1,
+				 struct futex_hash_bucket *bh2,
+				 union futex_key *key2)
+{
+	list_move_tail(&q->list, &bh2->chain);
+	bh1->nr_waiters--;
+	bh2->nr_waiters++;
+	q->lock_ptr = &bh2->lock;
+	q->key = *key2;
+	get_key_refs(key2);
+}
+
 /*
  * Wake up all waiters hashed on the physical page that is mapped
  * to this virtual address:
@@ -307,7 +770,11 @@ static int futex_wake(unsigned long uaddr, int nr_wake)
 	head = &bh->chain;
 
 	list_for_each_entry_safe(this, next, head, list) {
-		if (match_futex (&this->key, &key)) {
+		if (match_futex_q(this, &key)) {
+			if (this->pi_state) {
+				ret = -EINVAL;
+				break;
+			}
 			wake_futex(this);
 			if (++ret >= nr_wake)
 				break;
@@ -321,16 +788,26 @@ out:
 }
 
 /*
- * Wake up all waiters hashed on the physical page that is mapped
- * to this virtual address:
+ * Atomically do 'op' on *uaddr2 and wake up to nr_wake waiters of
+ * uaddr1. If the comparison in 'op' holds for the old value of
+ * *uaddr2, then in addition:
+ *
+ *  FUTEX_WAKE_OP:	up to nr2 waiters of uaddr2 are woken
+ *  FUTEX_REQUEUE_OP:	up to nr2 further waiters of uaddr1 are requeued
+ *			to uaddr2, instead of being woken
+ *
+ * For FUTEX_REQUEUE_OP, if the comparison fails those nr2 waiters of
+ * uaddr1 are woken instead, so nobody gets parked on a futex the op
+ * found in the wrong state.
  */
-static int futex_wake_op(unsigned long uaddr1, unsigned long uaddr2, int nr_wake, int nr_wake2, int op)
+static int futex_wake_op(unsigned long uaddr1, unsigned long uaddr2,
+			 int nr_wake, int nr2, int op, int requeue)
 {
 	union futex_key key1, key2;
 	struct futex_hash_bucket *bh1, *bh2;
 	struct list_head *head;
 	struct futex_q *this, *next;
-	int ret, op_ret, attempt = 0;
+	int ret, op_ret, attempt = 0, drop_count = 0;
 
 retryfull:
 	down_read(&current->mm->mmap_sem);
@@ -346,19 +823,13 @@ retryfull:
 	bh2 = hash_futex(&key2);
 
 retry:
-	if (bh1 < bh2)
-		spin_lock(&bh1->lock);
-	spin_lock(&bh2->lock);
-	if (bh1 > bh2)
-		spin_lock(&bh1->lock);
+	double_lock_hb(bh1, bh2);
 
 	op_ret = futex_atomic_op_inuser(op, (int __user *)uaddr2);
 	if (unlikely(op_ret < 0)) {
 		int dummy;
 
-		spin_unlock(&bh1->lock);
-		if (bh1 != bh2)
-			spin_unlock(&bh2->lock);
+		double_unlock_hb(bh1, bh2);
 
 #ifndef CONFIG_MMU
 		/* we don't get EFAULT from MMU faults if we don't have an MMU,
@@ -378,26 +849,9 @@ retry:
 		 * enough, we need to handle the fault ourselves, while
 		 * still holding the mmap_sem.  */
 		if (attempt++) {
-			struct vm_area_struct * vma;
-			struct mm_struct *mm = current->mm;
-
-			ret = -EFAULT;
-			if (attempt >= 2 ||
-			    !(vma = find_vma(mm, uaddr2)) ||
-			    vma->vm_start > uaddr2 ||
-			    !(vma->vm_flags & VM_WRITE))
+			ret = futex_handle_fault(uaddr2, attempt);
+			if (ret)
 				goto out;
-
-			switch (handle_mm_fault(mm, vma, uaddr2, 1)) {
-			case VM_FAULT_MINOR:
-				current->min_flt++;
-				break;
-			case VM_FAULT_MAJOR:
-				current->maj_flt++;
-				break;
-			default:
-				goto out;
-			}
 			goto retry;
 		}
 
@@ -412,33 +866,67 @@ retry:
 		goto retryfull;
 	}
 
+	/* A failed FUTEX_REQUEUE_OP comparison wakes the nr2 as well: */
+	if (requeue && !op_ret)
+		nr_wake += nr2;
+
 	head = &bh1->chain;
 
 	list_for_each_entry_safe(this, next, head, list) {
-		if (match_futex (&this->key, &key1)) {
+		if (match_futex_q(this, &key1)) {
+			if (this->pi_state) {
+				ret = -EINVAL;
+				goto out_unlock;
+			}
 			wake_futex(this);
 			if (++ret >= nr_wake)
 				break;
 		}
 	}
 
-	if (op_ret > 0) {
+	if (op_ret > 0 && requeue) {
+		op_ret = 0;
+		list_for_each_entry_safe(this, next, head, list) {
+			if (op_ret >= nr2)
+				break;
+			if (!match_futex_q(this, &key1))
+				continue;
+			if (this->pi_state) {
+				ret = -EINVAL;
+				goto out_unlock;
+			}
+			requeue_futex(this, bh1, bh2, &key2);
+			drop_count++;
+			op_ret++;
+			/* Make sure to stop if key1 == key2 */
+			if (head == &bh2->chain && head != &next->list)
+				head = &this->list;
+		}
+		ret += op_ret;
+	} else if (op_ret > 0) {
 		head = &bh2->chain;
 
 		op_ret = 0;
 		list_for_each_entry_safe(this, next, head, list) {
-			if (match_futex (&this->key, &key2)) {
+			if (match_futex_q(this, &key2)) {
+				if (this->pi_state) {
+					ret = -EINVAL;
+					goto out_unlock;
+				}
 				wake_futex(this);
-				if (++op_ret >= nr_wake2)
+				if (++op_ret >= nr2)
 					break;
 			}
 		}
 		ret += op_ret;
 	}
 
-	spin_unlock(&bh1->lock);
-	if (bh1 != bh2)
-		spin_unlock(&bh2->lock);
+out_unlock:
+	double_unlock_hb(bh1, bh2);
+
+	/* drop_key_refs() must be called outside the spinlocks. */
+	while (--drop_count >= 0)
+		drop_key_refs(&key1);
 out:
 	up_read(&current->mm->mmap_sem);
 	return ret;
@@ -470,11 +958,7 @@ static int futex_requeue(unsigned long uaddr1, unsigned long uaddr2,
 	bh1 = hash_futex(&key1);
 	bh2 = hash_futex(&key2);
 
-	if (bh1 < bh2)
-		spin_lock(&bh1->lock);
-	spin_lock(&bh2->lock);
-	if (bh1 > bh2)
-		spin_lock(&bh1->lock);
+	double_lock_hb(bh1, bh2);
 
 	if (likely(valp != NULL)) {
 		int curval;
@@ -482,9 +966,7 @@ static int futex_requeue(unsigned long uaddr1, unsigned long uaddr2,
 		ret = get_futex_value_locked(&curval, (int __user *)uaddr1);
 
 		if (unlikely(ret)) {
-			spin_unlock(&bh1->lock);
-			if (bh1 != bh2)
-				spin_unlock(&bh2->lock);
+			double_unlock_hb(bh1, bh2);
 
 			/* If we would have faulted, release mmap_sem, fault
 			 * it in and start all over again.
@@ -506,15 +988,16 @@ static int futex_requeue(unsigned long uaddr1, unsigned long uaddr2,
 
 	head1 = &bh1->chain;
 	list_for_each_entry_safe(this, next, head1, list) {
-		if (!match_futex (&this->key, &key1))
+		if (!match_futex_q(this, &key1))
 			continue;
+		if (this->pi_state) {
+			ret = -EINVAL;
+			break;
+		}
 		if (++ret <= nr_wake) {
 			wake_futex(this);
 		} else {
-			list_move_tail(&this->list, &bh2->chain);
-			this->lock_ptr = &bh2->lock;
-			this->key = key2;
-			get_key_refs(&key2);
+			requeue_futex(this, bh1, bh2, &key2);
 			drop_count++;
 
 			if (ret - nr_wake >= nr_requeue)
@@ -526,9 +1009,7 @@ static int futex_requeue(unsigned long uaddr1, unsigned long uaddr2,
 	}
 
 out_unlock:
-	spin_unlock(&bh1->lock);
-	if (bh1 != bh2)
-		spin_unlock(&bh2->lock);
+	double_unlock_hb(bh1, bh2);
 
 	/* drop_key_refs() must be called outside the spinlocks. */
 	while (--drop_count >= 0)
@@ -549,6 +1030,8 @@ queue_lock(struct futex_q *q, int fd, struct file *filp)
 	q->filp = filp;
 
 	init_waitqueue_head(&q->waiters);
+	q->pi_state = NULL;
+	q->task = current;
 
 	get_key_refs(&q->key);
 	bh = hash_futex(&q->key);
@@ -560,6 +1043,9 @@ queue_lock(struct futex_q *q, int fd, struct file *filp)
 
 static inline void __queue_me(struct futex_q *q, struct futex_hash_bucket *bh)
 {
+	futex_stat_inc(queued);
+	if (bh->nr_waiters++)
+		futex_stat_inc(shared);
 	list_add_tail(&q->list, &bh->chain);
 	spin_unlock(&bh->lock);
 }
@@ -614,6 +1100,7 @@ static int unqueue_me(struct futex_q *q)
 		}
 		WARN_ON(list_empty(&q->list));
 		list_del(&q->list);
+		lock_to_bucket(lock_ptr)->nr_waiters--;
 		spin_unlock(lock_ptr);
 		ret = 1;
 	}
@@ -622,6 +1109,25 @@ static int unqueue_me(struct futex_q *q)
 	return ret;
 }
 
+/*
+ * PI futexes can not be requeued and must remove themself from the
+ * hash bucket. The hash bucket lock is held on entry and dropped here.
+ */
+static void unqueue_me_pi(struct futex_q *q, struct futex_hash_bucket *hb)
+{
+	WARN_ON(list_empty(&q->list));
+	list_del_init(&q->list);
+	hb->nr_waiters--;
+
+	BUG_ON(!q->pi_state);
+	free_pi_state(q->pi_state);
+	q->pi_state = NULL;
+
+	spin_unlock(&hb->lock);
+
+	drop_key_refs(&q->key);
+}
+
 static int futex_wait(unsigned long uaddr, int val, unsigned long time)
 {
 	DECLARE_WAITQUEUE(wait, current);
@@ -729,6 +1235,479 @@ static int futex_wait(unsigned long uaddr, int val, unsigned long time)
 	return ret;
 }
 
+/*
+ * One futex of a FUTEX_WAIT_MULTIPLE: the waker wakes q.waiters, which
+ * the sleeping task is on via 'wait'.
+ */
+struct futex_wait_q {
+	struct futex_q q;
+	wait_queue_t wait;
+};
+
+/*
+ * Unqueue the first 'count' futexes of a multiple wait. Returns the
+ * index of the first one that was woken, -1 if none was.
+ */
+static int unqueue_multiple(struct futex_wait_q *qs, int count)
+{
+	int i, woken = -1;
+
+	for (i = 0; i < count; i++)
+		if (!unqueue_me(&qs[i].q) && woken < 0)
+			woken = i;
+	return woken;
+}
+
+/*
+ * Sleep until one of several futexes is woken. Every futex is checked
+ * and queued just like futex_wait() does it, with the same ordering
+ * guarantee, and none is queued unless all of them still contain the
+ * expected value. 'blocks' is a kernel copy of the user's array.
+ *
+ * Returns the index of a futex that was woken. More than one may have
+ * been woken by the time we unqueue; the lowest index is returned and
+ * the other wakeups are absorbed, just like a futex_wait() that races
+ * with a value change absorbs one.
+ */
+long futex_wait_multiple(struct futex_wait_block *blocks, int count,
+			 unsigned long time)
+{
+	struct futex_wait_q *qs;
+	struct futex_hash_bucket *bh;
+	int i, ret, curval, woken;
+
+	if (count <= 0 || count > FUTEX_WAIT_MULTIPLE_MAX)
+		return -EINVAL;
+
+	qs = kmalloc(count * sizeof(*qs), GFP_KERNEL);
+	if (!qs)
+		return -ENOMEM;
+
+ retry:
+	down_read(&current->mm->mmap_sem);
+
+	for (i = 0; i < count; i++) {
+		unsigned long uaddr = (unsigned long)blocks[i].uaddr;
+
+		ret = get_futex_key(uaddr, &qs[i].q.key);
+		if (unlikely(ret != 0))
+			goto out_unqueue;
+
+		bh = queue_lock(&qs[i].q, -1, NULL);
+
+		/* See futex_wait() for why we look at the value only now: */
+		ret = get_futex_value_locked(&curval, (int __user *)uaddr);
+
+		if (unlikely(ret)) {
+			queue_unlock(&qs[i].q, bh);
+			up_read(&current->mm->mmap_sem);
+
+			woken = unqueue_multiple(qs, i);
+			if (woken >= 0) {
+				ret = woken;
+				goto out_free;
+			}
+
+			ret = get_user(curval, (int __user *)uaddr);
+			if (!ret)
+				goto retry;
+			goto out_free;
+		}
+		if (curval != blocks[i].val) {
+			queue_unlock(&qs[i].q, bh);
+			ret = -EWOULDBLOCK;
+			goto out_unqueue;
+		}
+
+		__queue_me(&qs[i].q, bh);
+	}
+
+	up_read(&current->mm->mmap_sem);
+
+	/*
+	 * add_wait_queue is the barrier after __set_current_state. A
+	 * wakeup of any futex before its wait entry got added has taken
+	 * it off the hash list already, which the check below catches.
+	 */
+	__set_current_state(TASK_INTERRUPTIBLE);
+	woken = 0;
+	for (i = 0; i < count; i++) {
+		init_waitqueue_entry(&qs[i].wait, current);
+		add_wait_queue(&qs[i].q.waiters, &qs[i].wait);
+		if (list_empty(&qs[i].q.list))
+			woken = 1;
+	}
+	if (likely(!woken))
+		time = schedule_timeout(time);
+	__set_current_state(TASK_RUNNING);
+
+	woken = unqueue_multiple(qs, count);
+	if (woken >= 0)
+		ret = woken;
+	else if (time == 0)
+		ret = -ETIMEDOUT;
+	else
+		ret = -EINTR;
+	goto out_free;
+
+ out_unqueue:
+	up_read(&current->mm->mmap_sem);
+	/* A wakeup that hit one of the queued futexes meanwhile wins: */
+	woken = unqueue_multiple(qs, i);
+	if (woken >= 0)
+		ret = woken;
+ out_free:
+	kfree(qs);
+	return ret;
+}
+
+/*
+ * FUTEX_WAIT_MULTIPLE: 'count' struct futex_wait_block at 'uaddr'.
+ */
+static long futex_wait_multiple_user(unsigned long uaddr, int count,
+				     unsigned long time)
+{
+	struct futex_wait_block *blocks;
+	unsigned long size;
+	long ret;
+
+	if (count <= 0 || count > FUTEX_WAIT_MULTIPLE_MAX)
+		return -EINVAL;
+
+	size = count * sizeof(*blocks);
+	blocks = kmalloc(size, GFP_KERNEL);
+	if (!blocks)
+		return -ENOMEM;
+	if (copy_from_user(blocks, (void __user *)uaddr, size))
+		ret = -EFAULT;
+	else
+		ret = futex_wait_multiple(blocks, count, time);
+	kfree(blocks);
+	return ret;
+}
+
+/*
+ * Userspace tried a 0 -> TID atomic transition of the futex value
+ * and failed. The kernel side here does the whole locking operation:
+ * if there are waiters then it will block, it does PI, etc. (Due to
+ * races the kernel might see a 0 value of the futex too.)
+ */
+static int futex_lock_pi(unsigned long uaddr, int detect, unsigned long time,
+			 int trylock)
+{
+	struct task_struct *curr = current;
+	struct futex_hash_bucket *hb;
+	u32 uval, newval, curval;
+	struct futex_q q;
+	int ret, attempt = 0, ownerdied = 0;
+
+	if (refill_pi_state_cache())
+		return -ENOMEM;
+
+ retry:
+	down_read(&curr->mm->mmap_sem);
+
+	ret = get_futex_key(uaddr, &q.key);
+	if (unlikely(ret != 0))
+		goto out_release_sem;
+
+	hb = queue_lock(&q, -1, NULL);
+
+ retry_locked:
+	/*
+	 * To avoid races, we attempt to take the lock here again
+	 * (by doing a 0 -> TID atomic cmpxchg), while holding all
+	 * the locks. It will most likely not succeed.
+	 */
+	newval = current->pid;
+
+	curval = cmpxchg_futex_value_locked((u32 __user *)uaddr, 0, newval);
+
+	if (unlikely(curval == -EFAULT))
+		goto uaddr_faulted;
+
+	/* We own the lock already */
+	if (unlikely((curval & FUTEX_TID_MASK) == current->pid)) {
+		ret = -EDEADLK;
+		goto out_unlock_release_sem;
+	}
+
+	/*
+	 * Surprise - we got the lock. Just return
+	 * to userspace:
+	 */
+	if (unlikely(!curval))
+		goto out_unlock_release_sem;
+
+	uval = curval;
+	/*
+	 * The owner died and left no PI state behind: take the futex
+	 * over and let userspace see the OWNER_DIED bit. Otherwise set
+	 * the WAITERS bit, so the owner comes into the kernel to unlock:
+	 */
+	if (unlikely(ownerdied))
+		newval = (uval & FUTEX_OWNER_DIED) | current->pid;
+	else
+		newval = uval | FUTEX_WAITERS;
+
+	curval = cmpxchg_futex_value_locked((u32 __user *)uaddr, uval, newval);
+
+	if (unlikely(curval == -EFAULT))
+		goto uaddr_faulted;
+	if (unlikely(curval != uval))
+		goto retry_locked;
+
+	if (unlikely(ownerdied))
+		goto out_unlock_release_sem;
+
+	/*
+	 * We dont have the lock. Look up the PI state (or create it if
+	 * we are the first waiter):
+	 */
+	ret = lookup_pi_state(uval, hb, &q);
+
+	if (unlikely(ret)) {
+		switch (ret) {
+
+		case -EAGAIN:
+			/*
+			 * The owner is exiting: give it a tick to clean
+			 * up its PI state and try again.
+			 */
+			queue_unlock(&q, hb);
+			up_read(&curr->mm->mmap_sem);
+			schedule_timeout_uninterruptible(1);
+			goto retry;
+
+		case -ESRCH:
+			/*
+			 * No owner found for this futex. Check if the
+			 * OWNER_DIED bit is set to figure out whether
+			 * this is a robust futex or not.
+			 */
+			if (get_futex_value_locked(&curval, (int __user *)uaddr))
+				goto uaddr_faulted;
+
+			/*
+			 * We simply start over in case of a robust
+			 * futex. The code above will take the futex
+			 * and return happy.
+			 */
+			if (curval & FUTEX_OWNER_DIED) {
+				ownerdied = 1;
+				ret = 0;
+				goto retry_locked;
+			}
+		default:
+			goto out_unlock_release_sem;
+		}
+	}
+
+	/*
+	 * Only actually queue now that the atomic ops are done:
+	 */
+	futex_stat_inc(pi_waits);
+	__queue_me(&q, hb);
+
+	/*
+	 * Now the futex is queued and we have checked the data, we
+	 * don't want to hold mmap_sem while we sleep.
+	 */
+	up_read(&curr->mm->mmap_sem);
+
+	if (!trylock)
+		ret = rt_mutex_timed_lock(&q.pi_state->pi_mutex, time, 1);
+	else {
+		ret = rt_mutex_trylock(&q.pi_state->pi_mutex);
+		/* Fixup the trylock return value: */
+		ret = ret ? 0 : -EWOULDBLOCK;
+	}
+
+	down_read(&curr->mm->mmap_sem);
+	spin_lock(q.lock_ptr);
+
+	/*
+	 * Got the lock. We might not be the anticipated owner if the
+	 * rt_mutex went to us instead of the waiter the unlocker picked -
+	 * fix up the PI-state and the futex value in that case.
+	 */
+	if (!ret && q.pi_state->owner != curr) {
+		struct futex_pi_state *pi_state = q.pi_state;
+		u32 newtid = current->pid | FUTEX_WAITERS;
+
+		/* Owner died? */
+		if (pi_state->owner != NULL) {
+			spin_lock_irq(&pi_state->owner->pi_lock);
+			WARN_ON(list_empty(&pi_state->list));
+			list_del_init(&pi_state->list);
+			spin_unlock_irq(&pi_state->owner->pi_lock);
+		} else
+			newtid |= FUTEX_OWNER_DIED;
+
+		pi_state->owner = current;
+
+		spin_lock_irq(&current->pi_lock);
+		WARN_ON(!list_empty(&pi_state->list));
+		list_add(&pi_state->list, &current->pi_state_list);
+		spin_unlock_irq(&current->pi_lock);
+
+		/*
+		 * We own it, so we have to replace the owner TID. This
+		 * must be atomic as we have preserve the owner died bit
+		 * here.
+		 */
+		attempt = 0;
+ retry_fixup:
+		ret = get_futex_value_locked(&uval, (int __user *)uaddr);
+		while (!ret) {
+			newval = (uval & FUTEX_OWNER_DIED) | newtid;
+			curval = cmpxchg_futex_value_locked((u32 __user *)uaddr,
+							    uval, newval);
+			if (curval == -EFAULT)
+				ret = -EFAULT;
+			else if (curval == uval)
+				break;
+			uval = curval;
+		}
+		if (unlikely(ret == -EFAULT)) {
+			spin_unlock(q.lock_ptr);
+			ret = futex_handle_fault(uaddr, attempt++);
+			spin_lock(q.lock_ptr);
+			if (!ret)
+				goto retry_fixup;
+		}
+	} else if (ret && q.pi_state->owner == curr) {
+		/*
+		 * Catch the rare case, where the unlocker picked us as
+		 * the next owner after we gave up on the rt_mutex:
+		 */
+		if (rt_mutex_trylock(&q.pi_state->pi_mutex))
+			ret = 0;
+	}
+
+	/* Unqueue and drop the lock */
+	unqueue_me_pi(&q, hb);
+	up_read(&curr->mm->mmap_sem);
+
+	return ret != -EINTR ? ret : -ERESTARTNOINTR;
+
+ out_unlock_release_sem:
+	queue_unlock(&q, hb);
+
+ out_release_sem:
+	up_read(&curr->mm->mmap_sem);
+	return ret;
+
+ uaddr_faulted:
+	/*
+	 * We have to r/w  *(int __user *)uaddr, but we can't modify it
+	 * non-atomically. Drop the bucket lock, fault the page in
+	 * writable while still holding the mmap_sem, and start over.
+	 */
+	queue_unlock(&q, hb);
+	ret = futex_handle_fault(uaddr, attempt++);
+	up_read(&curr->mm->mmap_sem);
+	if (ret)
+		return ret;
+
+	goto retry;
+}
+
+/*
+ * Userspace attempted a TID -> 0 atomic transition, and failed.
+ * This is the in-kernel slowpath: we look up the PI state (if any),
+ * and do the rt-mutex unlock.
+ */
+static int futex_unlock_pi(unsigned long uaddr)
+{
+	struct futex_hash_bucket *hb;
+	struct futex_q *this, *next;
+	u32 uval;
+	struct list_head *head;
+	union futex_key key;
+	int ret, attempt = 0;
+
+retry:
+	if (get_user(uval, (u32 __user *)uaddr))
+		return -EFAULT;
+	/*
+	 * We release only a lock we actually own:
+	 */
+	if ((uval & FUTEX_TID_MASK) != current->pid)
+		return -EPERM;
+	/*
+	 * First take all the futex related locks:
+	 */
+	down_read(&current->mm->mmap_sem);
+
+	ret = get_futex_key(uaddr, &key);
+	if (unlikely(ret != 0))
+		goto out;
+
+	hb = hash_futex(&key);
+	spin_lock(&hb->lock);
+
+	/*
+	 * To avoid races, try to do the TID -> 0 atomic transition
+	 * again. If it succeeds then we can return without waking
+	 * anyone else up:
+	 */
+	if (!(uval & FUTEX_OWNER_DIED))
+		uval = cmpxchg_futex_value_locked((u32 __user *)uaddr,
+						  current->pid, 0);
+
+	if (unlikely(uval == -EFAULT))
+		goto pi_faulted;
+	/*
+	 * Rare case: we managed to release the lock atomically,
+	 * no need to wake anyone else up:
+	 */
+	if (unlikely(uval == current->pid))
+		goto out_unlock;
+
+	/*
+	 * Ok, other tasks may need to be woken up - check waiters
+	 * and do the wakeup if necessary:
+	 */
+	head = &hb->chain;
+
+	list_for_each_entry_safe(this, next, head, list) {
+		if (!match_futex_q(this, &key))
+			continue;
+		ret = wake_futex_pi((u32 __user *)uaddr, uval, this);
+		/*
+		 * The atomic access to the futex value
+		 * generated a pagefault, so retry the
+		 * user-access and the wakeup:
+		 */
+		if (ret == -EFAULT)
+			goto pi_faulted;
+		goto out_unlock;
+	}
+	/*
+	 * No waiters - kernel unlocks the futex:
+	 */
+	ret = unlock_futex_pi((u32 __user *)uaddr, uval);
+	if (ret == -EFAULT)
+		goto pi_faulted;
+
+out_unlock:
+	spin_unlock(&hb->lock);
+out:
+	up_read(&current->mm->mmap_sem);
+
+	return ret;
+
+pi_faulted:
+	spin_unlock(&hb->lock);
+	ret = futex_handle_fault(uaddr, attempt++);
+	up_read(&current->mm->mmap_sem);
+	if (ret)
+		return ret;
+
+	goto retry;
+}
+
 static int futex_close(struct inode *inode, struct file *filp)
 {
 	struct futex_q *q = filp->private_data;
@@ -1022,7 +2001,22 @@ long do_futex(unsigned long uaddr, int op, int val, unsigned long timeout,
 		ret = futex_requeue(uaddr, uaddr2, val, val2, &val3);
 		break;
 	case FUTEX_WAKE_OP:
-		ret = futex_wake_op(uaddr, uaddr2, val, val2, val3);
+		ret = futex_wake_op(uaddr, uaddr2, val, val2, val3, 0);
+		break;
+	case FUTEX_LOCK_PI:
+		ret = futex_lock_pi(uaddr, val, timeout, 0);
+		break;
+	case FUTEX_UNLOCK_PI:
+		ret = futex_unlock_pi(uaddr);
+		break;
+	case FUTEX_TRYLOCK_PI:
+		ret = futex_lock_pi(uaddr, 0, timeout, 1);
+		break;
+	case FUTEX_WAIT_MULTIPLE:
+		ret = futex_wait_multiple_user(uaddr, val, timeout);
+		break;
+	case FUTEX_REQUEUE_OP:
+		ret = futex_wake_op(uaddr, uaddr2, val, val2, val3, 1);
 		break;
 	default:
 		ret = -ENOSYS;
@@ -1030,6 +2024,21 @@ long do_futex(unsigned long uaddr, int op, int val, unsigned long timeout,
 	return ret;
 }
 
+/*
+ * FUTEX_LOCK_PI takes an absolute CLOCK_REALTIME timeout, convert it
+ * to the jiffies left from now:
+ */
+unsigned long futex_abs_timeout(struct timespec *ts)
+{
+	struct timespec now, rel;
+
+	getnstimeofday(&now);
+	if (timespec_compare(ts, &now) <= 0)
+		return 0;
+	set_normalized_timespec(&rel, ts->tv_sec - now.tv_sec,
+				ts->tv_nsec - now.tv_nsec);
+	return timespec_to_jiffies(&rel) + 1;
+}
 
 asmlinkage long sys_futex(u32 __user *uaddr, int op, int val,
 			  struct timespec __user *utime, u32 __user *uaddr2,
@@ -1039,17 +2048,22 @@ asmlinkage long sys_futex(u32 __user *uaddr, int op, int val,
 	unsigned long timeout = MAX_SCHEDULE_TIMEOUT;
 	int val2 = 0;
 
-	if (utime && (op == FUTEX_WAIT)) {
+	if (utime && (op == FUTEX_WAIT || op == FUTEX_LOCK_PI ||
+		      op == FUTEX_WAIT_MULTIPLE)) {
 		if (copy_from_user(&t, utime, sizeof(t)) != 0)
 			return -EFAULT;
 		if (!timespec_valid(&t))
 			return -EINVAL;
-		timeout = timespec_to_jiffies(&t) + 1;
+		if (op == FUTEX_LOCK_PI)
+			timeout = futex_abs_timeout(&t);
+		else
+			timeout = timespec_to_jiffies(&t) + 1;
 	}
 	/*
 	 * requeue parameter in 'utime' if op == FUTEX_REQUEUE.
 	 */
-	if (op >= FUTEX_REQUEUE)
+	if (op == FUTEX_REQUEUE || op == FUTEX_CMP_REQUEUE ||
+	    op == FUTEX_WAKE_OP || op == FUTEX_REQUEUE_OP)
 		val2 = (int) (unsigned long) utime;
 
 	return do_futex((unsigned long)uaddr, op, val, timeout,
@@ -1069,17 +2083,97 @@ static struct file_system_type futex_fs_type = {
 	.kill_sb	= kill_anon_super,
 };
 
+#ifdef CONFIG_PROC_FS
+#define FUTEX_STAT_VERSION 1
+
+static int show_futex_stat(struct seq_file *seq, void *v)
+{
+	struct futex_stat sum;
+	unsigned long i, in_use = 0, longest = 0;
+	int cpu;
+
+	memset(&sum, 0, sizeof(sum));
+	for_each_possible_cpu(cpu) {
+		struct futex_stat *st = &per_cpu(futex_stats, cpu);
+
+		sum.queued += st->queued;
+		sum.shared += st->shared;
+		sum.collisions += st->collisions;
+		sum.pi_waits += st->pi_waits;
+	}
+
+	/* a snapshot, the buckets are not locked */
+	for (i = 0; i < futex_hashsize; i++) {
+		unsigned int nr = futex_queues[i >> futex_chunk_shift]
+			[i & ((1UL << futex_chunk_shift) - 1)].nr_waiters;
+
+		if (nr)
+			in_use++;
+		if (nr > longest)
+			longest = nr;
+	}
+
+	seq_printf(seq, "version %d\n", FUTEX_STAT_VERSION);
+	seq_printf(seq, "buckets %lu chunks %lu\n", futex_hashsize,
+		   futex_hashsize >> futex_chunk_shift);
+	seq_printf(seq, "queued %lu\n", sum.queued);
+	seq_printf(seq, "shared %lu\n", sum.shared);
+	seq_printf(seq, "collisions %lu\n", sum.collisions);
+	seq_printf(seq, "pi_waits %lu\n", sum.pi_waits);
+	seq_printf(seq, "in_use %lu longest %lu\n", in_use, longest);
+
+	return 0;
+}
+
+DEFINE_SEQ_STAT_FILE(futex_stat);
+#endif
+
+static void * __init futex_alloc_chunk(unsigned long size, int node)
+{
+	if (size <= PAGE_SIZE << 2)
+		return kmalloc_node(size, GFP_KERNEL, node);
+	return vmalloc_node(size, node);
+}
+
 static int __init init(void)
 {
-	unsigned int i;
+	unsigned long i, chunks, chunk_size;
+	int node = first_node(node_online_map);
 
 	register_filesystem(&futex_fs_type);
 	futex_mnt = kern_mount(&futex_fs_type);
 
-	for (i = 0; i < ARRAY_SIZE(futex_queues); i++) {
-		INIT_LIST_HEAD(&futex_queues[i].chain);
-		spin_lock_init(&futex_queues[i].lock);
+	if (CONFIG_BASE_SMALL)
+		futex_hashsize = 16;
+	else
+		futex_hashsize = roundup_pow_of_two(FUTEX_HASH_PER_CPU *
+						    num_possible_cpus());
+	chunks = roundup_pow_of_two(num_online_nodes());
+	if (chunks > futex_hashsize)
+		chunks = futex_hashsize;
+	chunk_size = futex_hashsize / chunks;
+	futex_chunk_shift = long_log2(chunk_size);
+
+	for (i = 0; i < chunks; i++) {
+		struct futex_hash_bucket *hb;
+		unsigned long j;
+
+		hb = futex_alloc_chunk(chunk_size * sizeof(*hb), node);
+		if (!hb)
+			panic("Failed to allocate futex hash table\n");
+		for (j = 0; j < chunk_size; j++) {
+			INIT_LIST_HEAD(&hb[j].chain);
+			spin_lock_init(&hb[j].lock);
+			hb[j].nr_waiters = 0;
+		}
+		futex_queues[i] = hb;
+
+		node = next_node(node, node_online_map);
+		if (node == MAX_NUMNODES)
+			node = first_node(node_online_map);
 	}
+	printk(KERN_INFO "futex hash table entries: %lu (%lu chunks)\n",
+	       futex_hashsize, chunks);
 	return 0;
 }
 __initcall(init);
@@ -9,6 +9,7 @@
 #include <linux/linkage.h>
 #include <linux/compat.h>
 #include <linux/futex.h>
+#include <linux/slab.h>
 
 #include <asm/uaccess.h>
 
@@ -121,6 +122,38 @@ err_unlock:
 	return ret;
 }
 
+/*
+ * FUTEX_WAIT_MULTIPLE with an array of 32-bit futex_wait_blocks:
+ */
+static long
+compat_futex_wait_multiple(struct compat_futex_wait_block __user *ublocks,
+			   int count, unsigned long timeout)
+{
+	struct futex_wait_block *blocks;
+	compat_uptr_t uaddr;
+	long ret;
+	int i;
+
+	if (count <= 0 || count > FUTEX_WAIT_MULTIPLE_MAX)
+		return -EINVAL;
+
+	blocks = kmalloc(count * sizeof(*blocks), GFP_KERNEL);
+	if (!blocks)
+		return -ENOMEM;
+
+	ret = -EFAULT;
+	for (i = 0; i < count; i++) {
+		if (get_user(uaddr, &ublocks[i].uaddr) ||
+		    get_user(blocks[i].val, &ublocks[i].val))
+			goto out;
+		blocks[i].uaddr = compat_ptr(uaddr);
+	}
+	ret = futex_wait_multiple(blocks, count, timeout);
+out:
+	kfree(blocks);
+	return ret;
+}
+
 asmlinkage long compat_sys_futex(u32 __user *uaddr, int op, u32 val,
 		struct compat_timespec __user *utime, u32 __user *uaddr2,
 		u32 val3)
@@ -129,15 +162,24 @@ asmlinkage long compat_sys_futex(u32 __user *uaddr, int op, u32 val,
 	unsigned long timeout = MAX_SCHEDULE_TIMEOUT;
 	int val2 = 0;
 
-	if (utime && (op == FUTEX_WAIT)) {
+	if (utime && (op == FUTEX_WAIT || op == FUTEX_LOCK_PI ||
+		      op == FUTEX_WAIT_MULTIPLE)) {
 		if (get_compat_timespec(&t, utime))
 			return -EFAULT;
 		if (!timespec_valid(&t))
 			return -EINVAL;
-		timeout = timespec_to_jiffies(&t) + 1;
+		if (op == FUTEX_LOCK_PI)
+			timeout = futex_abs_timeout(&t);
+		else
+			timeout = timespec_to_jiffies(&t) + 1;
 	}
-	if (op >= FUTEX_REQUEUE)
+	if (op == FUTEX_REQUEUE || op == FUTEX_CMP_REQUEUE ||
+	    op == FUTEX_WAKE_OP || op == FUTEX_REQUEUE_OP)
 		val2 = (int) (unsigned long) utime;
+	if (op == FUTEX_WAIT_MULTIPLE)
+		return compat_futex_wait_multiple(
+			(struct compat_futex_wait_block __user *)uaddr,
+			val, timeout);
 
 	return do_futex((unsigned long)uaddr, op, val, timeout,
 			(unsigned long)uaddr2, val2, val3);
@@ -37,6 +37,7 @@
 #include <linux/notifier.h>
 #include <linux/syscalls.h>
 #include <linux/interrupt.h>
+#include <linux/clockchips.h>
 
 #include <asm/uaccess.h>
 
@@ -297,6 +298,186 @@ void unlock_hrtimer_base(const struct hrtimer *timer, unsigned long *flags)
 	spin_unlock_irqrestore(&timer->base->lock, *flags);
 }
 
+#ifdef CONFIG_HIGH_RES_TIMERS
+
+/*
+ * High resolution mode:
+ *
+ * Once a CPU got hold of a one-shot clock event device, it is programmed
+ * for the earliest expiry of all timers queued on the CPU. Its interrupt
+ * raises HRTIMER_SOFTIRQ, which expires the timers against the current
+ * time (not the jiffy based softirq time) and programs the device for
+ * the next one. The periodic tick stays as it is; it only expires timers
+ * that went due without an event, e.g. CLOCK_REALTIME timers after the
+ * clock was set.
+ */
+struct hrtimer_hres {
+	struct clock_event_device	*dev;
+	ktime_t				expires_next;
+};
+
+static DEFINE_PER_CPU(struct hrtimer_hres, hrtimer_hres);
+
+static int hrtimer_hres_enabled __read_mostly = 1;
+
+#define KTIME_HIGH_RES		(ktime_t) { .tv64 = 1 }
+
+/*
+ * highres=on|off: enable/disable high resolution mode
+ */
+static int __init setup_hrtimer_hres(char *str)
+{
+	if (!strcmp(str, "off"))
+		hrtimer_hres_enabled = 0;
+	else if (!strcmp(str, "on"))
+		hrtimer_hres_enabled = 1;
+	else
+		return 0;
+	return 1;
+}
+
+__setup("highres=", setup_hrtimer_hres);
+
+static inline int hrtimer_hres_active(void)
+{
+	return __get_cpu_var(hrtimer_hres).dev != NULL;
+}
+
+/*
+ * The event device is programmed in CLOCK_MONOTONIC time, convert the
+ * expiry time of a CLOCK_REALTIME timer:
+ */
+static ktime_t hrtimer_mono_expires(struct hrtimer *timer)
+{
+	struct timespec tomono;
+	unsigned long seq;
+
+	if (timer->base->index != CLOCK_REALTIME)
+		return timer->expires;
+
+	do {
+		seq = read_seqbegin(&xtime_lock);
+		tomono = wall_to_monotonic;
+	} while (read_seqretry(&xtime_lock, seq));
+
+	return ktime_add(timer->expires, timespec_to_ktime(tomono));
+}
+
+/*
+ * Program the event device of this CPU for the first expiring timer of
+ * all bases. Called with interrupts disabled and no base lock held.
+ * Returns -ETIME if that timer is already due.
+ */
+static int hrtimer_force_reprogram(void)
+{
+	struct hrtimer_hres *hres = &__get_cpu_var(hrtimer_hres);
+	struct hrtimer_base *base = __get_cpu_var(hrtimer_bases);
+	ktime_t expires, next = { .tv64 = KTIME_MAX };
+	int i;
+
+	for (i = 0; i < MAX_HRTIMER_BASES; i++, base++) {
+		spin_lock(&base->lock);
+		if (base->first) {
+			expires = hrtimer_mono_expires(rb_entry(base->first,
+							struct hrtimer, node));
+			if (expires.tv64 < next.tv64)
+				next = expires;
+		}
+		spin_unlock(&base->lock);
+	}
+
+	hres->expires_next = next;
+	if (next.tv64 == KTIME_MAX)
+		return 0;
+
+	return clockevents_program_event(hres->dev, next, ktime_get());
+}
+
+static void hrtimer_reprogram_all(void)
+{
+	local_irq_disable();
+	if (hrtimer_force_reprogram())
+		raise_softirq_irqoff(HRTIMER_SOFTIRQ);
+	local_irq_enable();
+}
+
+/*
+ * A timer became the first one of its base: program the event device if
+ * the timer expires before the event it is programmed for. Called with
+ * the base lock held and interrupts disabled.
+ *
+ * Timers on other CPUs' bases (a running timer is not moved, see
+ * switch_hrtimer_base()) are picked up by the softirq of their CPU when
+ * the running timer has finished.
+ */
+static void hrtimer_reprogram(struct hrtimer *timer, struct hrtimer_base *base)
+{
+	struct hrtimer_hres *hres = &__get_cpu_var(hrtimer_hres);
+	ktime_t expires;
+
+	if (!hres->dev || base != __get_cpu_var(hrtimer_bases) + base->index)
+		return;
+
+	expires = hrtimer_mono_expires(timer);
+	if (expires.tv64 >= hres->expires_next.tv64)
+		return;
+
+	hres->expires_next = expires;
+	if (clockevents_program_event(hres->dev, expires, ktime_get()))
+		raise_softirq_irqoff(HRTIMER_SOFTIRQ);
+}
+
+/*
+ * The event device interrupt:
+ */
+static void hrtimer_interrupt(struct clock_event_device *dev)
+{
+	struct hrtimer_hres *hres = &__get_cpu_var(hrtimer_hres);
+
+	/* Let hrtimer_reprogram() know that the device is idle */
+	hres->expires_next.tv64 = KTIME_MAX;
+	raise_softirq_irqoff(HRTIMER_SOFTIRQ);
+}
+
+/*
+ * Switch this CPU to high resolution mode if there is an event device
+ * for it. Called from the timer softirq.
+ */
+static int hrtimer_switch_to_hres(void)
+{
+	struct hrtimer_hres *hres = &__get_cpu_var(hrtimer_hres);
+	struct hrtimer_base *base = __get_cpu_var(hrtimer_bases);
+	struct clock_event_device *dev;
+	int i;
+
+	if (!hrtimer_hres_enabled || !clockevents_oneshot_available())
+		return 0;
+
+	dev = clockevents_request_device(smp_processor_id(), hrtimer_interrupt);
+	if (!dev)
+		return 0;
+
+	local_irq_disable();
+	for (i = 0; i < MAX_HRTIMER_BASES; i++)
+		base[i].resolution = KTIME_HIGH_RES;
+	hres->dev = dev;
+	if (hrtimer_force_reprogram())
+		raise_softirq_irqoff(HRTIMER_SOFTIRQ);
+	local_irq_enable();
+
+	printk(KERN_INFO "hrtimers: switched to high resolution mode on CPU %d "
+	       "using %s\n", smp_processor_id(), dev->name);
+
+	return 1;
+}
+
+#else /* CONFIG_HIGH_RES_TIMERS */
+
+static inline void
+hrtimer_reprogram(struct hrtimer *timer, struct hrtimer_base *base) { }
+
+#endif /* !CONFIG_HIGH_RES_TIMERS */
+
 /**
  * hrtimer_forward - forward the timer expiry
  *
@@ -452,6 +633,9 @@ hrtimer_start(struct hrtimer *timer, ktime_t tim, const enum hrtimer_mode mode)
 
 	enqueue_hrtimer(timer, new_base);
 
+	if (new_base->first == &timer->node)
+		hrtimer_reprogram(timer, new_base);
+
 	unlock_hrtimer_base(timer, &flags);
 
 	return ret;
@@ -607,14 +791,15 @@ int hrtimer_get_res(const clockid_t which_clock, struct timespec *tp)
 EXPORT_SYMBOL_GPL(hrtimer_get_res);
 
 /*
- * Expire the per base hrtimer-queue:
+ * Expire the per base hrtimer-queue, returns the number of timers run:
  */
-static inline void run_hrtimer_queue(struct hrtimer_base *base)
+static inline int run_hrtimer_queue(struct hrtimer_base *base)
 {
 	struct rb_node *node;
+	int nr = 0;
 
 	if (!base->first)
-		return;
+		return 0;
 
 	if (base->get_softirq_time)
 		base->softirq_time = base->get_softirq_time();
@@ -636,6 +821,7 @@ static inline void run_hrtimer_queue(struct hrtimer_base *base)
 		spin_unlock_irq(&base->lock);
 
 		restart = fn(timer);
+		nr++;
 
 		spin_lock_irq(&base->lock);
 
@@ -646,8 +832,38 @@ static inline void run_hrtimer_queue(struct hrtimer_base *base)
 	}
 	set_curr_timer(base, NULL);
 	spin_unlock_irq(&base->lock);
+
+	return nr;
+}
+
+#ifdef CONFIG_HIGH_RES_TIMERS
+
+/*
+ * Expire the timers of this CPU against the current time:
+ */
+static int hrtimer_run_hres_queues(void)
+{
+	struct hrtimer_base *base = __get_cpu_var(hrtimer_bases);
+	int i, nr = 0;
+
+	for (i = 0; i < MAX_HRTIMER_BASES; i++, base++) {
+		if (!base->first)
+			continue;
+		/* itimers and POSIX timers forward relative to this: */
+		base->softirq_time = base->get_time();
+		nr += run_hrtimer_queue(base);
+	}
+	return nr;
+}
+
+static void run_hrtimer_softirq(struct softirq_action *h)
+{
+	hrtimer_run_hres_queues();
+	hrtimer_reprogram_all();
 }
 
+#endif
+
 /*
  * Called from timer softirq every jiffy, expire hrtimers:
  */
@@ -656,6 +872,16 @@ void hrtimer_run_queues(void)
 	struct hrtimer_base *base = __get_cpu_var(hrtimer_bases);
 	int i;
 
+#ifdef CONFIG_HIGH_RES_TIMERS
+	if (hrtimer_hres_active()) {
+		if (hrtimer_run_hres_queues())
+			hrtimer_reprogram_all();
+		return;
+	}
+	if (hrtimer_switch_to_hres())
+		return;
+#endif
+
 	hrtimer_get_softirq_time(base);
 
 	for (i = 0; i < MAX_HRTIMER_BASES; i++)
@@ -837,8 +1063,25 @@ static void migrate_hrtimers(int cpu)
 		new_base++;
 	}
 
+#ifdef CONFIG_HIGH_RES_TIMERS
+	/* The timers may expire before the event we are programmed for */
+	if (hrtimer_hres_active() && hrtimer_force_reprogram())
+		raise_softirq_irqoff(HRTIMER_SOFTIRQ);
+#endif
+
 	local_irq_enable();
 	put_cpu_var(hrtimer_bases);
+
+#ifdef CONFIG_HIGH_RES_TIMERS
+	/* The dead CPU starts in low resolution mode when it comes back */
+	if (per_cpu(hrtimer_hres, cpu).dev) {
+		old_base = per_cpu(hrtimer_bases, cpu);
+		old_base[CLOCK_REALTIME].resolution = KTIME_REALTIME_RES;
+		old_base[CLOCK_MONOTONIC].resolution = KTIME_MONOTONIC_RES;
+		clockevents_release_device(per_cpu(hrtimer_hres, cpu).dev);
+		per_cpu(hrtimer_hres, cpu).dev = NULL;
+	}
+#endif
 }
 #endif /* CONFIG_HOTPLUG_CPU */
 
@@ -875,5 +1118,8 @@ void __init hrtimers_init(void)
 	hrtimer_cpu_notify(&hrtimers_nb, (unsigned long)CPU_UP_PREPARE,
 			  (void *)(long)smp_processor_id());
 	register_cpu_notifier(&hrtimers_nb);
+#ifdef CONFIG_HIGH_RES_TIMERS
+	open_softirq(HRTIMER_SOFTIRQ, run_hrtimer_softirq, NULL);
+#endif
 }
 
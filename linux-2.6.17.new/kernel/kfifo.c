@@ -24,6 +24,7 @@
 #include <linux/slab.h>
 #include <linux/err.h>
 #include <linux/kfifo.h>
+#include <asm/uaccess.h>
 
 /**
  * kfifo_init - allocates a new FIFO using a preallocated buffer
@@ -102,6 +103,71 @@ void kfifo_free(struct kfifo *fifo)
 }
 EXPORT_SYMBOL(kfifo_free);
 
+/*
+ * Copy 'len' bytes in and out at index 'off', wrapping around the end of
+ * the buffer. The callers have checked the space and order the copy
+ * against the index updates.
+ */
+static void __kfifo_copy_in(struct kfifo *fifo, unsigned int off,
+			    const unsigned char *from, unsigned int len)
+{
+	unsigned int l;
+
+	off &= fifo->size - 1;
+
+	/* first put the data starting from off to buffer end */
+	l = min(len, fifo->size - off);
+	memcpy(fifo->buffer + off, from, l);
+
+	/* then put the rest (if any) at the beginning of the buffer */
+	memcpy(fifo->buffer, from + l, len - l);
+}
+
+static void __kfifo_copy_out(struct kfifo *fifo, unsigned int off,
+			     unsigned char *to, unsigned int len)
+{
+	unsigned int l;
+
+	off &= fifo->size - 1;
+
+	/* first get the data from off until the end of the buffer */
+	l = min(len, fifo->size - off);
+	memcpy(to, fifo->buffer + off, l);
+
+	/* then get the rest (if any) from the beginning of the buffer */
+	memcpy(to + l, fifo->buffer, len - l);
+}
+
+/* The same with user space on the other side, nonzero if it faulted. */
+static int __kfifo_copy_in_user(struct kfifo *fifo, unsigned int off,
+				const unsigned char __user *from,
+				unsigned int len)
+{
+	unsigned int l;
+
+	off &= fifo->size - 1;
+	l = min(len, fifo->size - off);
+	if (copy_from_user(fifo->buffer + off, from, l))
+		return -EFAULT;
+	if (copy_from_user(fifo->buffer, from + l, len - l))
+		return -EFAULT;
+	return 0;
+}
+
+static int __kfifo_copy_out_user(struct kfifo *fifo, unsigned int off,
+				 unsigned char __user *to, unsigned int len)
+{
+	unsigned int l;
+
+	off &= fifo->size - 1;
+	l = min(len, fifo->size - off);
+	if (copy_to_user(to, fifo->buffer + off, l))
+		return -EFAULT;
+	if (copy_to_user(to + l, fifo->buffer, len - l))
+		return -EFAULT;
+	return 0;
+}
+
 /**
  * __kfifo_put - puts some data into the FIFO, no locking version
  * @fifo: the fifo to be used.
@@ -118,16 +184,21 @@ EXPORT_SYMBOL(kfifo_free);
 unsigned int __kfifo_put(struct kfifo *fifo,
 			 unsigned char *buffer, unsigned int len)
 {
-	unsigned int l;
-
 	len = min(len, fifo->size - fifo->in + fifo->out);
 
-	/* first put the data starting from fifo->in to buffer end */
-	l = min(len, fifo->size - (fifo->in & (fifo->size - 1)));
-	memcpy(fifo->buffer + (fifo->in & (fifo->size - 1)), buffer, l);
+	/*
+	 * Ensure that we sample the fifo->out index -before- we
+	 * start putting bytes into the kfifo.
+	 */
+	smp_mb();
 
-	/* then put the rest (if any) at the beginning of the buffer */
-	memcpy(fifo->buffer, buffer + l, len - l);
+	__kfifo_copy_in(fifo, fifo->in, buffer, len);
+
+	/*
+	 * Ensure that we add the bytes to the kfifo -before-
+	 * we update the fifo->in index.
+	 */
+	smp_wmb();
 
 	fifo->in += len;
 
@@ -150,19 +221,514 @@ EXPORT_SYMBOL(__kfifo_put);
 unsigned int __kfifo_get(struct kfifo *fifo,
 			 unsigned char *buffer, unsigned int len)
 {
-	unsigned int l;
-
 	len = min(len, fifo->in - fifo->out);
 
-	/* first get the data from fifo->out until the end of the buffer */
-	l = min(len, fifo->size - (fifo->out & (fifo->size - 1)));
-	memcpy(buffer, fifo->buffer + (fifo->out & (fifo->size - 1)), l);
+	/*
+	 * Ensure that we sample the fifo->in index -before- we
+	 * start removing bytes from the kfifo.
+	 */
+	smp_rmb();
 
-	/* then get the rest (if any) from the beginning of the buffer */
-	memcpy(buffer + l, fifo->buffer, len - l);
+	__kfifo_copy_out(fifo, fifo->out, buffer, len);
+
+	/*
+	 * Ensure that we remove the bytes from the kfifo -before-
+	 * we update the fifo->out index.
+	 */
+	smp_mb();
 
 	fifo->out += len;
 
 	return len;
 }
 EXPORT_SYMBOL(__kfifo_get);
+
+/**
+ * __kfifo_put_user - puts data from user space into the FIFO
+ * @fifo: the fifo to be used.
+ * @from: the user space data to be added.
+ * @len: the length of the data to be added.
+ *
+ * Like __kfifo_put(), but the data is copied straight from user space
+ * into the FIFO. Returns the number of bytes copied, or -EFAULT, in
+ * which case nothing is added. This may sleep, so the caller must not
+ * hold a spinlock; with more than one writer, serialize them with a
+ * mutex.
+ */
+int __kfifo_put_user(struct kfifo *fifo, const unsigned char __user *from,
+		     unsigned int len)
+{
+	len = min(len, fifo->size - fifo->in + fifo->out);
+
+	smp_mb();
+
+	if (__kfifo_copy_in_user(fifo, fifo->in, from, len))
+		return -EFAULT;
+
+	smp_wmb();
+
+	fifo->in += len;
+
+	return len;
+}
+EXPORT_SYMBOL(__kfifo_put_user);
+
+/**
+ * __kfifo_get_user - gets data from the FIFO into user space
+ * @fifo: the fifo to be used.
+ * @to: where the data must be copied.
+ * @len: the size of the destination buffer.
+ *
+ * Like __kfifo_get(), but the data is copied straight into user space.
+ * Returns the number of bytes copied, or -EFAULT, in which case the data
+ * stays in the FIFO. The same locking rules as for __kfifo_put_user()
+ * apply.
+ */
+int __kfifo_get_user(struct kfifo *fifo, unsigned char __user *to,
+		     unsigned int len)
+{
+	len = min(len, fifo->in - fifo->out);
+
+	smp_rmb();
+
+	if (__kfifo_copy_out_user(fifo, fifo->out, to, len))
+		return -EFAULT;
+
+	smp_mb();
+
+	fifo->out += len;
+
+	return len;
+}
+EXPORT_SYMBOL(__kfifo_get_user);
+
+/*
+ * Record mode: every record is stored behind a KFIFO_REC_HDR bytes
+ * header holding its length, and is put and got as a whole.
+ */
+static inline unsigned int __kfifo_rec_space(struct kfifo *fifo,
+					     unsigned int len)
+{
+	if (!len || len > KFIFO_REC_MAX)
+		return 0;
+	return fifo->size - fifo->in + fifo->out >= len + KFIFO_REC_HDR;
+}
+
+static inline void __kfifo_put_rec_hdr(struct kfifo *fifo, unsigned int len)
+{
+	u16 hdr = len;
+
+	__kfifo_copy_in(fifo, fifo->in, (unsigned char *)&hdr, KFIFO_REC_HDR);
+}
+
+/**
+ * __kfifo_put_rec - puts a record into the FIFO, no locking version
+ * @fifo: the fifo to be used.
+ * @buffer: the record to be added.
+ * @len: the length of the record, 1 to KFIFO_REC_MAX bytes.
+ *
+ * Adds the record if there is room for all of it. Returns 'len', or 0
+ * if it did not fit. The same locking rules as for __kfifo_put() apply.
+ */
+unsigned int __kfifo_put_rec(struct kfifo *fifo,
+			     unsigned char *buffer, unsigned int len)
+{
+	if (!__kfifo_rec_space(fifo, len))
+		return 0;
+
+	smp_mb();
+
+	__kfifo_put_rec_hdr(fifo, len);
+	__kfifo_copy_in(fifo, fifo->in + KFIFO_REC_HDR, buffer, len);
+
+	smp_wmb();
+
+	fifo->in += len + KFIFO_REC_HDR;
+
+	return len;
+}
+EXPORT_SYMBOL(__kfifo_put_rec);
+
+/**
+ * __kfifo_put_rec_user - puts a record from user space into the FIFO
+ * @fifo: the fifo to be used.
+ * @from: the user space record to be added.
+ * @len: the length of the record, 1 to KFIFO_REC_MAX bytes.
+ *
+ * Returns 'len', 0 if the record did not fit, or -EFAULT. The same
+ * locking rules as for __kfifo_put_user() apply.
+ */
+int __kfifo_put_rec_user(struct kfifo *fifo, const unsigned char __user *from,
+			 unsigned int len)
+{
+	if (!__kfifo_rec_space(fifo, len))
+		return 0;
+
+	smp_mb();
+
+	if (__kfifo_copy_in_user(fifo, fifo->in + KFIFO_REC_HDR, from, len))
+		return -EFAULT;
+	__kfifo_put_rec_hdr(fifo, len);
+
+	smp_wmb();
+
+	fifo->in += len + KFIFO_REC_HDR;
+
+	return len;
+}
+EXPORT_SYMBOL(__kfifo_put_rec_user);
+
+/**
+ * __kfifo_rec_len - returns the length of the next record in the FIFO
+ * @fifo: the fifo to be used.
+ *
+ * Returns 0 if the FIFO is empty.
+ */
+unsigned int __kfifo_rec_len(struct kfifo *fifo)
+{
+	u16 hdr;
+
+	if (fifo->in == fifo->out)
+		return 0;
+
+	smp_rmb();
+
+	__kfifo_copy_out(fifo, fifo->out, (unsigned char *)&hdr,
+			 KFIFO_REC_HDR);
+	return hdr;
+}
+EXPORT_SYMBOL(__kfifo_rec_len);
+
+/**
+ * __kfifo_get_rec - gets a record from the FIFO, no locking version
+ * @fifo: the fifo to be used.
+ * @buffer: where the record must be copied.
+ * @len: the size of the destination buffer.
+ *
+ * Returns the length of the record, or 0 if the FIFO is empty or the
+ * next record is longer than 'len'; it stays in the FIFO then, see
+ * __kfifo_rec_len(). The same locking rules as for __kfifo_get() apply.
+ */
+unsigned int __kfifo_get_rec(struct kfifo *fifo,
+			     unsigned char *buffer, unsigned int len)
+{
+	unsigned int rec = __kfifo_rec_len(fifo);
+
+	if (!rec || rec > len)
+		return 0;
+
+	__kfifo_copy_out(fifo, fifo->out + KFIFO_REC_HDR, buffer, rec);
+
+	smp_mb();
+
+	fifo->out += rec + KFIFO_REC_HDR;
+
+	return rec;
+}
+EXPORT_SYMBOL(__kfifo_get_rec);
+
+/**
+ * __kfifo_get_rec_user - gets a record from the FIFO into user space
+ * @fifo: the fifo to be used.
+ * @to: where the record must be copied.
+ * @len: the size of the destination buffer.
+ *
+ * Returns the length of the record, 0 as for __kfifo_get_rec(), or
+ * -EFAULT, in which case the record stays in the FIFO. The same locking
+ * rules as for __kfifo_get_user() apply.
+ */
+int __kfifo_get_rec_user(struct kfifo *fifo, unsigned char __user *to,
+			 unsigned int len)
+{
+	unsigned int rec = __kfifo_rec_len(fifo);
+
+	if (!rec || rec > len)
+		return 0;
+
+	if (__kfifo_copy_out_user(fifo, fifo->out + KFIFO_REC_HDR, to, rec))
+		return -EFAULT;
+
+	smp_mb();
+
+	fifo->out += rec + KFIFO_REC_HDR;
+
+	return rec;
+}
+EXPORT_SYMBOL(__kfifo_get_rec_user);
+
+/*
+ * Multi-producer multi-consumer ring of fixed size elements.
+ *
+ * Every slot carries a sequence number telling whose turn it is: a
+ * producer may fill slot 'pos & mask' when its sequence is 'pos', a
+ * consumer may empty it when it is 'pos + 1'. Producers and consumers
+ * claim positions by advancing ring->head and ring->tail with cmpxchg,
+ * and hand the slot over by setting its sequence, so no one ever waits
+ * for a lock. A slot that is reserved but not yet committed holds up the
+ * consumers of the slots behind it, not the producers.
+ */
+struct kfifo_slot {
+	unsigned int seq;
+	unsigned int valid;	/* 0 if the producer aborted */
+	unsigned long data[0];
+};
+
+static inline struct kfifo_slot *kfifo_ring_slot(struct kfifo_ring *ring,
+						 unsigned int pos)
+{
+	return (struct kfifo_slot *)
+		(ring->slots + (pos & ring->mask) * ring->stride);
+}
+
+/**
+ * kfifo_ring_alloc - allocates a multi-producer multi-consumer ring
+ * @nr: the number of elements, rounded up to a power of 2.
+ * @esize: the size of an element.
+ * @gfp_mask: get_free_pages mask, passed to kmalloc()
+ *
+ * Returns -EINVAL if @nr is 0 or the ring would not fit in an unsigned int.
+ */
+struct kfifo_ring *kfifo_ring_alloc(unsigned int nr, unsigned int esize,
+				    gfp_t gfp_mask)
+{
+	struct kfifo_ring *ring;
+	unsigned int i, stride;
+
+	if (!nr || esize > UINT_MAX - sizeof(struct kfifo_slot) -
+			   sizeof(unsigned long))
+		return ERR_PTR(-EINVAL);
+	stride = ALIGN(sizeof(struct kfifo_slot) + esize,
+		       sizeof(unsigned long));
+
+	if (nr & (nr - 1)) {
+		BUG_ON(nr > 0x80000000);
+		nr = roundup_pow_of_two(nr);
+	}
+	if (nr > UINT_MAX / stride)
+		return ERR_PTR(-EINVAL);
+
+	ring = kmalloc(sizeof(struct kfifo_ring), gfp_mask);
+	if (!ring)
+		return ERR_PTR(-ENOMEM);
+
+	ring->esize = esize;
+	ring->stride = stride;
+	ring->mask = nr - 1;
+	atomic_set(&ring->head, 0);
+	atomic_set(&ring->tail, 0);
+	ring->slots = kmalloc(nr * ring->stride, gfp_mask);
+	if (!ring->slots) {
+		kfree(ring);
+		return ERR_PTR(-ENOMEM);
+	}
+	for (i = 0; i < nr; i++)
+		kfifo_ring_slot(ring, i)->seq = i;
+
+	return ring;
+}
+EXPORT_SYMBOL(kfifo_ring_alloc);
+
+/**
+ * kfifo_ring_free - frees the ring
+ * @ring: the ring to be freed.
+ */
+void kfifo_ring_free(struct kfifo_ring *ring)
+{
+	kfree(ring->slots);
+	kfree(ring);
+}
+EXPORT_SYMBOL(kfifo_ring_free);
+
+/**
+ * kfifo_ring_reserve - reserves an element at the end of the ring
+ * @ring: the ring to be used.
+ *
+ * Returns a pointer to the element to be filled in, or NULL if the ring
+ * is full. The element must be handed over with kfifo_ring_commit() or
+ * kfifo_ring_abort().
+ */
+void *kfifo_ring_reserve(struct kfifo_ring *ring)
+{
+	struct kfifo_slot *slot;
+	unsigned int pos;
+	int diff;
+
+	for (;;) {
+		pos = atomic_read(&ring->head);
+		slot = kfifo_ring_slot(ring, pos);
+		diff = slot->seq - pos;
+		smp_rmb();
+		if (diff < 0)
+			return NULL;
+		if (!diff && atomic_cmpxchg(&ring->head, pos, pos + 1) == pos)
+			return slot->data;
+		cpu_relax();
+	}
+}
+EXPORT_SYMBOL(kfifo_ring_reserve);
+
+static inline void kfifo_ring_publish(void *elem, unsigned int valid,
+				      unsigned int seq_add)
+{
+	struct kfifo_slot *slot = container_of(elem, struct kfifo_slot, data);
+
+	slot->valid = valid;
+	/* the element has to be complete before the slot is handed over */
+	smp_wmb();
+	slot->seq += seq_add;
+}
+
+/**
+ * kfifo_ring_commit - hands a reserved element over to the consumers
+ * @ring: the ring to be used.
+ * @elem: the element returned by kfifo_ring_reserve().
+ */
+void kfifo_ring_commit(struct kfifo_ring *ring, void *elem)
+{
+	kfifo_ring_publish(elem, 1, 1);
+}
+EXPORT_SYMBOL(kfifo_ring_commit);
+
+/**
+ * kfifo_ring_abort - gives back a reserved element unused
+ * @ring: the ring to be used.
+ * @elem: the element returned by kfifo_ring_reserve().
+ *
+ * The consumers skip the element.
+ */
+void kfifo_ring_abort(struct kfifo_ring *ring, void *elem)
+{
+	kfifo_ring_publish(elem, 0, 1);
+}
+EXPORT_SYMBOL(kfifo_ring_abort);
+
+/**
+ * kfifo_ring_claim - claims the element at the head of the ring
+ * @ring: the ring to be used.
+ *
+ * Returns a pointer to the oldest committed element, or NULL if the ring
+ * is empty. The element must be given back with kfifo_ring_release()
+ * once it has been read.
+ */
+void *kfifo_ring_claim(struct kfifo_ring *ring)
+{
+	struct kfifo_slot *slot;
+	unsigned int pos;
+	int diff;
+
+	for (;;) {
+		pos = atomic_read(&ring->tail);
+		slot = kfifo_ring_slot(ring, pos);
+		diff = slot->seq - (pos + 1);
+		smp_rmb();
+		if (diff < 0)
+			return NULL;
+		if (!diff && atomic_cmpxchg(&ring->tail, pos, pos + 1) == pos) {
+			if (slot->valid)
+				return slot->data;
+			/* aborted by its producer, skip it */
+			kfifo_ring_publish(slot->data, 0, ring->mask);
+			continue;
+		}
+		cpu_relax();
+	}
+}
+EXPORT_SYMBOL(kfifo_ring_claim);
+
+/**
+ * kfifo_ring_release - gives a claimed element back to the producers
+ * @ring: the ring to be used.
+ * @elem: the element returned by kfifo_ring_claim().
+ */
+void kfifo_ring_release(struct kfifo_ring *ring, void *elem)
+{
+	/* the element has to be read before a producer may reuse it */
+	smp_mb();
+	kfifo_ring_publish(elem, 0, ring->mask);
+}
+EXPORT_SYMBOL(kfifo_ring_release);
+
+/**
+ * kfifo_ring_put - puts an element into the ring
+ * @ring: the ring to be used.
+ * @elem: the element to be added, ring->esize bytes.
+ *
+ * Returns 1, or 0 if the ring is full.
+ */
+int kfifo_ring_put(struct kfifo_ring *ring, const void *elem)
+{
+	void *slot = kfifo_ring_reserve(ring);
+
+	if (!slot)
+		return 0;
+	memcpy(slot, elem, ring->esize);
+	kfifo_ring_commit(ring, slot);
+	return 1;
+}
+EXPORT_SYMBOL(kfifo_ring_put);
+
+/**
+ * kfifo_ring_get - gets an element from the ring
+ * @ring: the ring to be used.
+ * @elem: where the element must be copied, ring->esize bytes.
+ *
+ * Returns 1, or 0 if the ring is empty.
+ */
+int kfifo_ring_get(struct kfifo_ring *ring, void *elem)
+{
+	void *slot = kfifo_ring_claim(ring);
+
+	if (!slot)
+		return 0;
+	memcpy(elem, slot, ring->esize);
+	kfifo_ring_release(ring, slot);
+	return 1;
+}
+EXPORT_SYMBOL(kfifo_ring_get);
+
+/**
+ * kfifo_ring_put_user - puts an element from user space into the ring
+ * @ring: the ring to be used.
+ * @from: the element to be added, ring->esize bytes.
+ *
+ * The element is copied straight into its slot. Returns 1, 0 if the ring
+ * is full, or -EFAULT, in which case nothing is added. This may sleep,
+ * and the consumers wait for this element meanwhile.
+ */
+int kfifo_ring_put_user(struct kfifo_ring *ring, const void __user *from)
+{
+	void *slot = kfifo_ring_reserve(ring);
+
+	if (!slot)
+		return 0;
+	if (copy_from_user(slot, from, ring->esize)) {
+		kfifo_ring_abort(ring, slot);
+		return -EFAULT;
+	}
+	kfifo_ring_commit(ring, slot);
+	return 1;
+}
+EXPORT_SYMBOL(kfifo_ring_put_user);
+
+/**
+ * kfifo_ring_get_user - gets an element from the ring into user space
+ * @ring: the ring to be used.
+ * @to: where the element must be copied, ring->esize bytes.
+ *
+ * Returns 1, 0 if the ring is empty, or -EFAULT. An element that could
+ * not be copied is lost, other consumers may already have taken the
+ * ones behind it.
+ */
+int kfifo_ring_get_user(struct kfifo_ring *ring, void __user *to)
+{
+	void *slot = kfifo_ring_claim(ring);
+	int ret = 1;
+
+	if (!slot)
+		return 0;
+	if (copy_to_user(to, slot, ring->esize))
+		ret = -EFAULT;
+	kfifo_ring_release(ring, slot);
+	return ret;
+}
+EXPORT_SYMBOL(kfifo_ring_get_user);
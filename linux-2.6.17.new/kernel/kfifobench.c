@@ -0,0 +1,308 @@
+/*
+ * kfifo throughput benchmark
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * Producer threads push elements carrying their producer number and a
+ * sequence number through a FIFO to consumer threads for 'seconds'
+ * seconds, then the elements per second and MB/s are printed. Consumers
+ * check that the elements of each producer arrive in order. The module
+ * stays loaded after a successful run.
+ *
+ *	modprobe kfifobench mode=ring nproducers=4 nconsumers=4
+ *
+ * See also:  Documentation/kfifo.txt
+ */
+#include <linux/types.h>
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/kthread.h>
+#include <linux/err.h>
+#include <linux/slab.h>
+#include <linux/sched.h>
+#include <linux/delay.h>
+#include <linux/kfifo.h>
+#include <linux/cpumask.h>
+#include <asm/atomic.h>
+
+MODULE_LICENSE("GPL");
+
+static char *mode = "spsc";	/* spsc, locked, typed, record, ring */
+static int nproducers = 1;
+static int nconsumers = 1;
+static int size = 4096;		/* FIFO bytes, or ring elements */
+static int esize = 16;		/* element size, largest record size */
+static int seconds = 5;
+
+module_param(mode, charp, 0);
+MODULE_PARM_DESC(mode, "FIFO flavour: spsc, locked, typed, record or ring");
+module_param(nproducers, int, 0);
+MODULE_PARM_DESC(nproducers, "Number of producer threads");
+module_param(nconsumers, int, 0);
+MODULE_PARM_DESC(nconsumers, "Number of consumer threads");
+module_param(size, int, 0);
+MODULE_PARM_DESC(size, "FIFO size in bytes, ring size in elements");
+module_param(esize, int, 0);
+MODULE_PARM_DESC(esize, "Element size in bytes, maximum size for records");
+module_param(seconds, int, 0);
+MODULE_PARM_DESC(seconds, "Duration of the test in seconds");
+
+#define BENCH_FLAG "kfifobench: "
+#define BENCH_MAX_THREADS 64
+
+enum bench_mode { BENCH_SPSC, BENCH_LOCKED, BENCH_TYPED, BENCH_RECORD,
+		  BENCH_RING };
+
+static const char *bench_modes[] = {
+	"spsc", "locked", "typed", "record", "ring",
+};
+
+struct bench_elem {
+	u32 producer;
+	u32 seq;
+};
+
+/* the element type of mode=typed */
+struct bench_typed {
+	struct bench_elem e;
+	u64 payload;
+};
+
+struct bench_thread {
+	struct task_struct *task;
+	int id;
+	unsigned long ops;
+	unsigned long bytes;
+	unsigned long errors;
+	u32 last[BENCH_MAX_THREADS];	/* consumers: last seq per producer */
+	unsigned char buf[0];
+};
+
+static enum bench_mode bench_mode;
+static struct kfifo *bench_fifo;
+static struct kfifo_ring *bench_ring;
+static DEFINE_SPINLOCK(bench_lock);
+static atomic_t bench_running;
+
+static int bench_put(struct bench_thread *t, u32 seq)
+{
+	struct bench_elem *e = (struct bench_elem *)t->buf;
+	unsigned int len;
+
+	e->producer = t->id;
+	e->seq = seq;
+	switch (bench_mode) {
+	case BENCH_SPSC:
+		len = __kfifo_put_elems(bench_fifo, t->buf, 1, esize) * esize;
+		break;
+	case BENCH_LOCKED:
+		spin_lock(&bench_lock);
+		len = __kfifo_put_elems(bench_fifo, t->buf, 1, esize) * esize;
+		spin_unlock(&bench_lock);
+		break;
+	case BENCH_TYPED:
+		len = kfifo_put_typed(bench_fifo, (struct bench_typed *)t->buf,
+				      1) * sizeof(struct bench_typed);
+		break;
+	case BENCH_RECORD:
+		/* record lengths from sizeof(*e) to esize */
+		len = sizeof(*e) + seq % (esize - sizeof(*e) + 1);
+		len = kfifo_put_rec(bench_fifo, t->buf, len);
+		break;
+	default:
+		len = kfifo_ring_put(bench_ring, t->buf) * esize;
+		break;
+	}
+	if (len) {
+		t->ops++;
+		t->bytes += len;
+	}
+	return len;
+}
+
+static int bench_get(struct bench_thread *t)
+{
+	struct bench_elem *e = (struct bench_elem *)t->buf;
+	unsigned int len;
+
+	switch (bench_mode) {
+	case BENCH_SPSC:
+		len = __kfifo_get_elems(bench_fifo, t->buf, 1, esize) * esize;
+		break;
+	case BENCH_LOCKED:
+		spin_lock(&bench_lock);
+		len = __kfifo_get_elems(bench_fifo, t->buf, 1, esize) * esize;
+		spin_unlock(&bench_lock);
+		break;
+	case BENCH_TYPED:
+		len = kfifo_get_typed(bench_fifo, (struct bench_typed *)t->buf,
+				      1) * sizeof(struct bench_typed);
+		break;
+	case BENCH_RECORD:
+		len = kfifo_get_rec(bench_fifo, t->buf, esize);
+		break;
+	default:
+		len = kfifo_ring_get(bench_ring, t->buf) * esize;
+		break;
+	}
+	if (!len)
+		return 0;
+
+	t->ops++;
+	t->bytes += len;
+	/* with several consumers, each sees a part of a producer's stream */
+	if (e->producer >= nproducers || e->seq <= t->last[e->producer])
+		t->errors++;
+	else
+		t->last[e->producer] = e->seq;
+	return len;
+}
+
+static int bench_producer(void *arg)
+{
+	struct bench_thread *t = arg;
+	u32 seq = 1;
+
+	atomic_inc(&bench_running);
+	while (!kthread_should_stop()) {
+		if (bench_put(t, seq))
+			seq++;
+		else
+			cpu_relax();
+		cond_resched();
+	}
+	return 0;
+}
+
+static int bench_consumer(void *arg)
+{
+	struct bench_thread *t = arg;
+
+	atomic_inc(&bench_running);
+	while (!kthread_should_stop()) {
+		if (!bench_get(t))
+			cpu_relax();
+		cond_resched();
+	}
+	return 0;
+}
+
+static struct bench_thread *bench_threads[2 * BENCH_MAX_THREADS];
+
+static int bench_start(int i, int id, int (*fn)(void *), const char *name)
+{
+	struct bench_thread *t;
+	int cpu, n = i % num_online_cpus();
+
+	t = kzalloc(sizeof(*t) + max(esize, (int)sizeof(struct bench_typed)),
+		    GFP_KERNEL);
+	if (!t)
+		return -ENOMEM;
+	t->id = id;
+	bench_threads[i] = t;
+
+	t->task = kthread_create(fn, t, "kfifobench_%s/%d", name, id);
+	if (IS_ERR(t->task)) {
+		int err = PTR_ERR(t->task);
+
+		t->task = NULL;
+		return err;
+	}
+	/* spread the threads over the online CPUs */
+	for_each_online_cpu(cpu)
+		if (!n--)
+			break;
+	kthread_bind(t->task, cpu);
+	wake_up_process(t->task);
+	return 0;
+}
+
+static int __init kfifobench_init(void)
+{
+	unsigned long ops = 0, bytes = 0, errors = 0;
+	int i, err = 0, nthreads = nproducers + nconsumers;
+
+	for (i = 0; i < ARRAY_SIZE(bench_modes); i++)
+		if (!strcmp(mode, bench_modes[i]))
+			break;
+	if (i == ARRAY_SIZE(bench_modes)) {
+		printk(KERN_ERR BENCH_FLAG "unknown mode %s\n", mode);
+		return -EINVAL;
+	}
+	bench_mode = i;
+	if (bench_mode == BENCH_SPSC)
+		nproducers = nconsumers = 1;
+	if (bench_mode == BENCH_TYPED)
+		esize = sizeof(struct bench_typed);
+	nthreads = nproducers + nconsumers;
+	if (nproducers < 1 || nconsumers < 1 ||
+	    nproducers > BENCH_MAX_THREADS || nconsumers > BENCH_MAX_THREADS ||
+	    esize < sizeof(struct bench_elem) || esize > KFIFO_REC_MAX ||
+	    size < 2 || seconds < 1)
+		return -EINVAL;
+
+	if (bench_mode == BENCH_RING)
+		bench_ring = kfifo_ring_alloc(size, esize, GFP_KERNEL);
+	else
+		bench_fifo = kfifo_alloc(size, GFP_KERNEL, &bench_lock);
+	if (IS_ERR(bench_ring) || IS_ERR(bench_fifo))
+		return -ENOMEM;
+
+	for (i = 0; i < nconsumers && !err; i++)
+		err = bench_start(i, i, bench_consumer, "c");
+	for (i = 0; i < nproducers && !err; i++)
+		err = bench_start(nconsumers + i, i, bench_producer, "p");
+
+	if (!err) {
+		while (atomic_read(&bench_running) < nthreads)
+			msleep(1);
+		ssleep(seconds);
+	}
+
+	for (i = 0; i < nthreads; i++) {
+		struct bench_thread *t = bench_threads[i];
+
+		if (!t)
+			break;
+		if (t->task)
+			kthread_stop(t->task);
+		if (i < nconsumers) {
+			ops += t->ops;
+			bytes += t->bytes;
+			errors += t->errors;
+		}
+		kfree(t);
+		bench_threads[i] = NULL;
+	}
+
+	if (bench_ring)
+		kfifo_ring_free(bench_ring);
+	else
+		kfifo_free(bench_fifo);
+
+	if (err)
+		return err;
+
+	printk(KERN_INFO BENCH_FLAG "mode %s producers %d consumers %d "
+	       "size %d esize %d: %lu elements/s %lu MB/s, %lu out of order\n",
+	       mode, nproducers, nconsumers, size, esize, ops / seconds,
+	       (bytes / seconds) >> 20, errors);
+	return errors ? -EIO : 0;
+}
+
+static void __exit kfifobench_exit(void)
+{
+}
+
+module_init(kfifobench_init);
+module_exit(kfifobench_exit);
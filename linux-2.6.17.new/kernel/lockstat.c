@@ -0,0 +1,426 @@
+/*
+ * kernel/lockstat.c
+ *
+ * Lock statistics: the time spent waiting for contended spinlocks,
+ * rwlocks, mutexes, semaphores and rw-semaphores, and optionally the
+ * acquisitions and hold times, per lock class, in /proc/lock_stat.
+ *
+ * The lock functions call lock_stat_contended() once they got a lock
+ * they had to wait for. With kernel.lock_stat set to 2 they also call
+ * lock_stat_acquired() on every acquisition, and lock_stat_released()
+ * when a lock with a single holder is released. Classes are registered
+ * on their first use and never freed.
+ *
+ * See Documentation/lockstat.txt.
+ */
+#include <linux/config.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/spinlock.h>
+#include <linux/rwsem.h>
+#include <linux/percpu.h>
+#include <linux/sched.h>
+#include <linux/hash.h>
+#include <linux/string.h>
+#include <linux/kallsyms.h>
+#include <linux/fs.h>
+#include <linux/seq_file.h>
+#include <asm/sections.h>
+#include <asm/uaccess.h>
+
+#define MAX_LOCK_CLASSES	1024
+#define LOCK_CLASS_HASH_BITS	9
+#define LOCK_CLASS_NAME_LEN	64
+#define LOCK_STAT_POINTS	4	/* contention points kept per class */
+
+int sysctl_lock_stat = 1;
+
+enum lock_class_type {
+	LOCK_CLASS_KEY,		/* spin_lock_init()/rwlock_init()/... site */
+	LOCK_CLASS_STATIC,	/* lock in the kernel image, by address */
+	LOCK_CLASS_SITE,	/* other lock, by first contention site */
+};
+
+static const char *lock_class_types[] = { "key", "static", "site" };
+
+static const char *lock_stat_kinds[] = {
+	"spin", "rw", "mutex", "sem", "rwsem"
+};
+
+struct lock_class {
+	struct lock_class_key	key;	/* for locks without one */
+	const void		*id;	/* key, lock address or site */
+	enum lock_class_type	type;
+	enum lock_stat_kind	kind;
+	struct lock_class	*hash_next;
+	void			*points[LOCK_STAT_POINTS];
+	char			name[LOCK_CLASS_NAME_LEN];
+};
+
+struct lock_class_stats {
+	unsigned long		contended;
+	unsigned long		acquired;
+	unsigned long long	wait_total;	/* ns */
+	unsigned long long	wait_max;
+	unsigned long long	hold_total;
+	unsigned long long	hold_max;
+	unsigned long		points[LOCK_STAT_POINTS];
+};
+
+static struct lock_class lock_classes[MAX_LOCK_CLASSES];
+static struct lock_class *lock_class_hash[1 << LOCK_CLASS_HASH_BITS];
+static unsigned int nr_lock_classes;
+static unsigned long lock_class_overflow;
+static raw_spinlock_t lock_class_lock = __RAW_SPIN_LOCK_UNLOCKED;
+
+static DEFINE_PER_CPU(struct lock_class_stats [MAX_LOCK_CLASSES],
+		      lock_class_stats);
+
+static void lock_stat_symbol(char *buf, const void *addr, int exact)
+{
+	char namebuf[KSYM_NAME_LEN + 1];
+	unsigned long size, offset;
+	const char *sym;
+	char *modname;
+
+	sym = kallsyms_lookup((unsigned long)addr, &size, &offset, &modname,
+			      namebuf);
+	if (!sym)
+		snprintf(buf, LOCK_CLASS_NAME_LEN, "%p", addr);
+	else if (exact && !offset)
+		strlcpy(buf, sym, LOCK_CLASS_NAME_LEN);
+	else
+		snprintf(buf, LOCK_CLASS_NAME_LEN, "%s+%#lx%s%s", sym, offset,
+			 modname ? " " : "", modname ? modname : "");
+}
+
+/*
+ * Name the class now: the key, symbol or module it refers to may be
+ * gone by the time /proc/lock_stat is read.
+ */
+static void lock_class_name(struct lock_class *class)
+{
+	if (class->type == LOCK_CLASS_KEY)
+		strlcpy(class->name, ((struct lock_class_key *)class->id)->name,
+			LOCK_CLASS_NAME_LEN);
+	else
+		lock_stat_symbol(class->name, class->id,
+				 class->type == LOCK_CLASS_STATIC);
+}
+
+static struct lock_class *lock_class_find(const void *id,
+					  enum lock_class_type type,
+					  enum lock_stat_kind kind)
+{
+	struct lock_class **head, *class;
+	unsigned long flags;
+
+	head = &lock_class_hash[hash_ptr((void *)id, LOCK_CLASS_HASH_BITS)];
+
+	/* classes are never removed, look without the lock first */
+	for (class = *head; class; class = class->hash_next) {
+		smp_read_barrier_depends();
+		if (class->id == id)
+			return class;
+	}
+
+	local_irq_save(flags);
+	__raw_spin_lock(&lock_class_lock);
+
+	for (class = *head; class; class = class->hash_next)
+		if (class->id == id)
+			goto out;
+
+	if (nr_lock_classes == MAX_LOCK_CLASSES) {
+		lock_class_overflow++;
+		goto out;
+	}
+	class = &lock_classes[nr_lock_classes];
+	class->id = id;
+	class->type = type;
+	class->kind = kind;
+	class->key.name = class->name;
+	class->key.idx = nr_lock_classes + 1;
+	lock_class_name(class);
+	class->hash_next = *head;
+	/*
+	 * the class has to be complete before the lockless lookups and
+	 * /proc/lock_stat see it
+	 */
+	smp_wmb();
+	*head = class;
+	nr_lock_classes++;
+out:
+	__raw_spin_unlock(&lock_class_lock);
+	local_irq_restore(flags);
+	return class;
+}
+
+/*
+ * Find the class of a lock on its first use, and remember it in the
+ * lock if it has a key pointer.
+ */
+static struct lock_class *lock_class_register(struct lock_class_key **keyp,
+					      void *lock,
+					      enum lock_stat_kind kind,
+					      void *ip)
+{
+	struct lock_class_key *key = keyp ? *keyp : NULL;
+	struct lock_class *class;
+
+	if (key)
+		class = lock_class_find(key, LOCK_CLASS_KEY, kind);
+	else if ((char *)lock >= _stext && (char *)lock < _end)
+		class = lock_class_find(lock, LOCK_CLASS_STATIC, kind);
+	else
+		class = lock_class_find(ip, LOCK_CLASS_SITE, kind);
+	if (!class)
+		return NULL;
+
+	if (key)
+		key->idx = class->key.idx;
+	else if (keyp)
+		*keyp = &class->key;
+	return class;
+}
+
+static inline struct lock_class *lock_class_get(struct lock_class_key **keyp,
+						void *lock,
+						enum lock_stat_kind kind,
+						void *ip)
+{
+	struct lock_class_key *key = keyp ? *keyp : NULL;
+
+	if (likely(key && key->idx))
+		return &lock_classes[key->idx - 1];
+	return lock_class_register(keyp, lock, kind, ip);
+}
+
+/*
+ * The slot of a contention point of the class, -1 if all slots are
+ * taken by other points.
+ */
+static int lock_stat_point(struct lock_class *class, void *ip)
+{
+	unsigned long flags;
+	int i;
+
+	for (i = 0; i < LOCK_STAT_POINTS; i++) {
+		void *point = class->points[i];
+
+		if (point == ip)
+			return i;
+		if (!point)
+			break;
+	}
+	if (i == LOCK_STAT_POINTS)
+		return -1;
+
+	local_irq_save(flags);
+	__raw_spin_lock(&lock_class_lock);
+	for (; i < LOCK_STAT_POINTS; i++) {
+		if (!class->points[i])
+			class->points[i] = ip;
+		if (class->points[i] == ip)
+			break;
+	}
+	__raw_spin_unlock(&lock_class_lock);
+	local_irq_restore(flags);
+
+	return i < LOCK_STAT_POINTS ? i : -1;
+}
+
+/**
+ * lock_stat_contended - account the time spent waiting for a lock
+ * @keyp: the lock's class key pointer, or NULL
+ * @lock: the lock
+ * @kind: the kind of lock
+ * @ip: where the lock was taken
+ * @wait: the time spent waiting, in ns
+ */
+void lock_stat_contended(struct lock_class_key **keyp, void *lock,
+			 enum lock_stat_kind kind, void *ip,
+			 unsigned long long wait)
+{
+	struct lock_class_stats *stats;
+	struct lock_class *class;
+	unsigned long flags;
+	int point;
+
+	class = lock_class_get(keyp, lock, kind, ip);
+	if (unlikely(!class))
+		return;
+	point = lock_stat_point(class, ip);
+
+	local_irq_save(flags);
+	stats = &__get_cpu_var(lock_class_stats)[class - lock_classes];
+	stats->contended++;
+	stats->wait_total += wait;
+	if (wait > stats->wait_max)
+		stats->wait_max = wait;
+	if (point >= 0)
+		stats->points[point]++;
+	local_irq_restore(flags);
+}
+EXPORT_SYMBOL(lock_stat_contended);
+
+/**
+ * lock_stat_acquired - account an acquisition of a lock
+ * @keyp: the lock's class key pointer
+ * @lock: the lock
+ * @kind: the kind of lock
+ * @ip: where the lock was taken
+ * @hold_start: where to note the time for the hold time, or NULL
+ */
+void lock_stat_acquired(struct lock_class_key **keyp, void *lock,
+			enum lock_stat_kind kind, void *ip,
+			unsigned long long *hold_start)
+{
+	struct lock_class *class;
+	unsigned long flags;
+
+	class = lock_class_get(keyp, lock, kind, ip);
+	if (unlikely(!class))
+		return;
+
+	local_irq_save(flags);
+	__get_cpu_var(lock_class_stats)[class - lock_classes].acquired++;
+	local_irq_restore(flags);
+
+	if (hold_start)
+		*hold_start = sched_clock();
+}
+EXPORT_SYMBOL(lock_stat_acquired);
+
+/**
+ * lock_stat_released - account the hold time of a lock being released
+ * @key: the lock's class key
+ * @hold_start: the time noted by lock_stat_acquired()
+ */
+void lock_stat_released(struct lock_class_key *key,
+			unsigned long long *hold_start)
+{
+	unsigned long long hold = sched_clock() - *hold_start;
+	struct lock_class_stats *stats;
+	unsigned long flags;
+
+	*hold_start = 0;
+	if (unlikely(!key || !key->idx))
+		return;
+
+	local_irq_save(flags);
+	stats = &__get_cpu_var(lock_class_stats)[key->idx - 1];
+	stats->hold_total += hold;
+	if (hold > stats->hold_max)
+		stats->hold_max = hold;
+	local_irq_restore(flags);
+}
+EXPORT_SYMBOL(lock_stat_released);
+
+/*
+ * down_read() and down_write() call these when the rw-semaphore is
+ * not free. The caller of down_*() is the contention point.
+ */
+void lock_stat_down_read(struct rw_semaphore *sem)
+{
+	unsigned long long start = 0;
+
+	lock_stat_begin(start);
+	__down_read(sem);
+	lock_stat_end_keyless(sem, LOCK_STAT_RWSEM, start,
+			      __builtin_return_address(0));
+}
+EXPORT_SYMBOL(lock_stat_down_read);
+
+void lock_stat_down_write(struct rw_semaphore *sem)
+{
+	unsigned long long start = 0;
+
+	lock_stat_begin(start);
+	__down_write(sem);
+	lock_stat_end_keyless(sem, LOCK_STAT_RWSEM, start,
+			      __builtin_return_address(0));
+}
+EXPORT_SYMBOL(lock_stat_down_write);
+
+#define LOCK_STAT_VERSION 2
+
+static int show_lock_stat(struct seq_file *seq, void *v)
+{
+	char namebuf[LOCK_CLASS_NAME_LEN];
+	unsigned int i, nr = nr_lock_classes;
+	int cpu, j;
+
+	smp_rmb();
+	seq_printf(seq, "version %d\n", LOCK_STAT_VERSION);
+	seq_printf(seq, "classes %u max %d overflow %lu level %d\n", nr,
+		   MAX_LOCK_CLASSES, lock_class_overflow, sysctl_lock_stat);
+	for (i = 0; i < nr; i++) {
+		struct lock_class *class = &lock_classes[i];
+		struct lock_class_stats sum;
+
+		memset(&sum, 0, sizeof(sum));
+		for_each_possible_cpu(cpu) {
+			struct lock_class_stats *stats =
+				&per_cpu(lock_class_stats, cpu)[i];
+
+			sum.contended += stats->contended;
+			sum.acquired += stats->acquired;
+			sum.wait_total += stats->wait_total;
+			if (stats->wait_max > sum.wait_max)
+				sum.wait_max = stats->wait_max;
+			sum.hold_total += stats->hold_total;
+			if (stats->hold_max > sum.hold_max)
+				sum.hold_max = stats->hold_max;
+			for (j = 0; j < LOCK_STAT_POINTS; j++)
+				sum.points[j] += stats->points[j];
+		}
+		seq_printf(seq, "%s %s contended %lu wait_total %llu "
+			   "wait_max %llu acquired %lu hold_total %llu "
+			   "hold_max %llu %s\n", lock_class_types[class->type],
+			   lock_stat_kinds[class->kind], sum.contended,
+			   sum.wait_total, sum.wait_max, sum.acquired,
+			   sum.hold_total, sum.hold_max, class->name);
+		for (j = 0; j < LOCK_STAT_POINTS && class->points[j]; j++) {
+			lock_stat_symbol(namebuf, class->points[j], 0);
+			seq_printf(seq, "  point %lu %s\n", sum.points[j],
+				   namebuf);
+		}
+	}
+	return 0;
+}
+
+static int lock_stat_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, show_lock_stat, NULL);
+}
+
+/*
+ * Writing 0 clears the statistics. The classes and their contention
+ * points stay.
+ */
+static ssize_t lock_stat_write(struct file *file, const char __user *buf,
+			       size_t count, loff_t *ppos)
+{
+	char c;
+	int cpu;
+
+	if (count) {
+		if (get_user(c, buf))
+			return -EFAULT;
+		if (c != '0')
+			return -EINVAL;
+		for_each_possible_cpu(cpu)
+			memset(per_cpu(lock_class_stats, cpu), 0,
+			       sizeof(per_cpu(lock_class_stats, cpu)));
+	}
+	return count;
+}
+
+struct file_operations proc_lock_stat_operations = {
+	.open    = lock_stat_open,
+	.read    = seq_read,
+	.write   = lock_stat_write,
+	.llseek  = seq_lseek,
+	.release = single_release,
+};
@@ -0,0 +1,233 @@
+/*
+ * Spinlock stress test and benchmark
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * One thread per online CPU (or 'nthreads') takes and releases one lock
+ * for 'seconds' seconds, spinning 'hold' loops inside and 'delay' loops
+ * outside the critical section. Then the acquisitions per second, the
+ * fewest and most acquisitions of a thread and the longest wait for the
+ * lock are printed, followed by the acquisitions of every thread. With
+ * fair locks the threads get the lock about equally often. Writers
+ * check that they are alone in the critical section.
+ *
+ *	modprobe lockstress mode=irq hold=100
+ *
+ * See also:  Documentation/lockstat.txt
+ */
+#include <linux/types.h>
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/kthread.h>
+#include <linux/err.h>
+#include <linux/slab.h>
+#include <linux/sched.h>
+#include <linux/delay.h>
+#include <linux/spinlock.h>
+#include <linux/cpumask.h>
+#include <asm/atomic.h>
+
+MODULE_LICENSE("GPL");
+
+static char *mode = "spin";	/* spin, irq, read, write */
+static int nthreads;		/* 0: one per online CPU */
+static int seconds = 5;
+static int hold = 10;
+static int delay;
+
+module_param(mode, charp, 0);
+MODULE_PARM_DESC(mode, "Lock to stress: spin, irq (spin_lock_irq), read or write");
+module_param(nthreads, int, 0);
+MODULE_PARM_DESC(nthreads, "Number of threads, default one per online CPU");
+module_param(seconds, int, 0);
+MODULE_PARM_DESC(seconds, "Duration of the test in seconds");
+module_param(hold, int, 0);
+MODULE_PARM_DESC(hold, "Loops spent holding the lock");
+module_param(delay, int, 0);
+MODULE_PARM_DESC(delay, "Loops spent between releasing and taking the lock");
+
+#define STRESS_FLAG "lockstress: "
+
+enum stress_mode { STRESS_SPIN, STRESS_IRQ, STRESS_READ, STRESS_WRITE };
+
+static const char *stress_modes[] = { "spin", "irq", "read", "write" };
+
+struct stress_thread {
+	struct task_struct *task;
+	unsigned long ops;
+	unsigned long long wait_max;
+};
+
+static enum stress_mode stress_mode;
+static DEFINE_SPINLOCK(stress_spinlock);
+static DEFINE_RWLOCK(stress_rwlock);
+static struct stress_thread *stress_threads;
+static atomic_t stress_running;
+static unsigned long stress_errors;
+static int stress_owner = -1;
+
+static inline void stress_loop(int n)
+{
+	while (n--)
+		cpu_relax();
+}
+
+static int stress_thread(void *arg)
+{
+	struct stress_thread *t = arg;
+	int id = t - stress_threads;
+	unsigned long long start, wait;
+
+	atomic_inc(&stress_running);
+	while (atomic_read(&stress_running) < nthreads)
+		schedule_timeout_uninterruptible(1);
+
+	while (!kthread_should_stop()) {
+		start = sched_clock();
+		switch (stress_mode) {
+		case STRESS_SPIN:
+			spin_lock(&stress_spinlock);
+			break;
+		case STRESS_IRQ:
+			spin_lock_irq(&stress_spinlock);
+			break;
+		case STRESS_READ:
+			read_lock(&stress_rwlock);
+			break;
+		case STRESS_WRITE:
+			write_lock(&stress_rwlock);
+			break;
+		}
+		wait = sched_clock() - start;
+
+		if (stress_mode != STRESS_READ) {
+			if (stress_owner != -1)
+				stress_errors++;
+			stress_owner = id;
+		}
+		stress_loop(hold);
+		if (stress_mode != STRESS_READ) {
+			if (stress_owner != id)
+				stress_errors++;
+			stress_owner = -1;
+		}
+
+		switch (stress_mode) {
+		case STRESS_SPIN:
+			spin_unlock(&stress_spinlock);
+			break;
+		case STRESS_IRQ:
+			spin_unlock_irq(&stress_spinlock);
+			break;
+		case STRESS_READ:
+			read_unlock(&stress_rwlock);
+			break;
+		case STRESS_WRITE:
+			write_unlock(&stress_rwlock);
+			break;
+		}
+
+		t->ops++;
+		if (wait > t->wait_max)
+			t->wait_max = wait;
+		stress_loop(delay);
+		cond_resched();
+	}
+	return 0;
+}
+
+static int __init lockstress_init(void)
+{
+	unsigned long total = 0, ops_min = ~0UL, ops_max = 0;
+	unsigned long long wait_max = 0;
+	int i, cpu, err = 0, started = 0;
+
+	for (i = 0; i < ARRAY_SIZE(stress_modes); i++)
+		if (!strcmp(mode, stress_modes[i]))
+			break;
+	if (i == ARRAY_SIZE(stress_modes)) {
+		printk(KERN_ERR STRESS_FLAG "unknown mode %s\n", mode);
+		return -EINVAL;
+	}
+	stress_mode = i;
+	if (!nthreads)
+		nthreads = num_online_cpus();
+	if (nthreads < 1 || seconds < 1 || hold < 0 || delay < 0)
+		return -EINVAL;
+
+	stress_threads = kzalloc(nthreads * sizeof(*stress_threads),
+				 GFP_KERNEL);
+	if (!stress_threads)
+		return -ENOMEM;
+
+	/* spread the threads over the online CPUs */
+	cpu = first_cpu(cpu_online_map);
+	for (i = 0; i < nthreads; i++) {
+		struct stress_thread *t = &stress_threads[i];
+
+		t->task = kthread_create(stress_thread, t, "lockstress/%d", i);
+		if (IS_ERR(t->task)) {
+			err = PTR_ERR(t->task);
+			t->task = NULL;
+			break;
+		}
+		kthread_bind(t->task, cpu);
+		cpu = next_cpu(cpu, cpu_online_map);
+		if (cpu >= NR_CPUS)
+			cpu = first_cpu(cpu_online_map);
+	}
+	if (!err) {
+		for (i = 0; i < nthreads; i++)
+			wake_up_process(stress_threads[i].task);
+		started = 1;
+		ssleep(seconds);
+	} else {
+		/* let the threads that were created start and stop */
+		atomic_set(&stress_running, nthreads);
+	}
+
+	for (i = 0; i < nthreads; i++) {
+		struct stress_thread *t = &stress_threads[i];
+
+		if (!t->task)
+			break;
+		kthread_stop(t->task);
+		total += t->ops;
+		ops_min = min(ops_min, t->ops);
+		ops_max = max(ops_max, t->ops);
+		wait_max = max(wait_max, t->wait_max);
+	}
+
+	if (started) {
+		printk(KERN_INFO STRESS_FLAG "mode %s threads %d hold %d "
+		       "delay %d: %lu acquisitions/s, per thread min %lu "
+		       "max %lu, longest wait %lluns, %lu errors\n",
+		       mode, nthreads, hold, delay, total / seconds, ops_min,
+		       ops_max, wait_max, stress_errors);
+		for (i = 0; i < nthreads; i++)
+			printk(KERN_INFO STRESS_FLAG "thread %d: %lu\n", i,
+			       stress_threads[i].ops);
+	}
+	kfree(stress_threads);
+
+	if (err)
+		return err;
+	return stress_errors ? -EIO : 0;
+}
+
+static void __exit lockstress_exit(void)
+{
+}
+
+module_init(lockstress_init);
+module_exit(lockstress_exit);
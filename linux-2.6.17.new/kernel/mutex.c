@@ -17,6 +17,9 @@
 #include <linux/module.h>
 #include <linux/spinlock.h>
 #include <linux/interrupt.h>
+#include <linux/percpu.h>
+#include <linux/fs.h>
+#include <linux/seq_file.h>
 
 /*
  * In the DEBUG case we are using the "NULL fastpath" for mutexes,
@@ -43,12 +46,199 @@ void fastcall __mutex_init(struct mutex *lock, const char *name)
 	atomic_set(&lock->count, 1);
 	spin_lock_init(&lock->wait_lock);
 	INIT_LIST_HEAD(&lock->wait_list);
+#ifdef CONFIG_MUTEX_SPIN_ON_OWNER
+	lock->spin_owner = NULL;
+	atomic_set(&lock->spin_tail, 0);
+#endif
+#ifdef CONFIG_LOCK_STAT
+	lock->key = NULL;
+	lock->hold_start = 0;
+	lock->wait = 0;
+#endif
 
 	debug_mutex_init(lock, name);
 }
 
 EXPORT_SYMBOL(__mutex_init);
 
+#ifdef CONFIG_MUTEX_STATS
+/*
+ * log2 histogram buckets of the spin time, in units of 1024ns: bucket 0
+ * counts zeroes, bucket k values in [2^(k-1), 2^k), the last bucket is
+ * open-ended.
+ */
+#define MUTEX_STATS_BUCKETS	24
+
+struct mutex_stats {
+	unsigned long contended;	/* slowpath entered */
+	unsigned long spin;		/* spun on the owner */
+	unsigned long spin_acquired;	/* ... and got the mutex */
+	unsigned long sleep;		/* went to sleep */
+	unsigned int spin_time[MUTEX_STATS_BUCKETS];
+};
+
+static DEFINE_PER_CPU(struct mutex_stats, mutex_stats);
+
+/* racy against preemption, but these are statistics */
+#define mutex_stats_inc(field)	\
+	(per_cpu(mutex_stats, raw_smp_processor_id()).field++)
+#else
+#define mutex_stats_inc(field)	do { } while (0)
+#endif
+
+#ifdef CONFIG_MUTEX_SPIN_ON_OWNER
+/*
+ * Adaptive spinning: a task that finds the mutex held by a task running
+ * on another CPU spins until the owner releases it, instead of going to
+ * sleep, as long as the owner keeps running and the spinner need not
+ * reschedule. The owner is recorded in lock->spin_owner outside the
+ * fastpath; it may be NULL for a moment after the mutex was taken.
+ *
+ * Only the first spinner watches the owner and the lock count; the
+ * others wait in a MCS queue of per-CPU nodes, each on its own cache
+ * line, so a contended mutex is not bounced between all spinning CPUs.
+ * Spinning happens with preemption disabled, so a CPU has at most one
+ * node queued. lock->spin_tail holds the CPU number + 1 of the last
+ * node in the queue.
+ */
+struct mutex_spinner {
+	struct mutex_spinner *next;
+	int locked;
+} ____cacheline_aligned_in_smp;
+
+static DEFINE_PER_CPU(struct mutex_spinner, mutex_spinners);
+
+static inline void mutex_set_owner(struct mutex *lock)
+{
+	lock->spin_owner = current;
+}
+
+static inline void mutex_clear_owner(struct mutex *lock)
+{
+	lock->spin_owner = NULL;
+}
+
+static void mutex_spin_queue_lock(struct mutex *lock,
+				  struct mutex_spinner *node)
+{
+	int old;
+
+	node->next = NULL;
+	node->locked = 0;
+	old = atomic_xchg(&lock->spin_tail, smp_processor_id() + 1);
+	if (likely(!old))
+		return;
+
+	per_cpu(mutex_spinners, old - 1).next = node;
+	while (!*(volatile int *)&node->locked)
+		cpu_relax();
+	smp_mb();
+}
+
+static void mutex_spin_queue_unlock(struct mutex *lock,
+				    struct mutex_spinner *node)
+{
+	struct mutex_spinner *next;
+	int cpu = smp_processor_id() + 1;
+
+	next = *(struct mutex_spinner * volatile *)&node->next;
+	if (likely(!next)) {
+		if (atomic_cmpxchg(&lock->spin_tail, cpu, 0) == cpu)
+			return;
+		/* someone queued behind us, wait for it to link itself */
+		while (!(next = *(struct mutex_spinner * volatile *)&node->next))
+			cpu_relax();
+	}
+	smp_mb();
+	next->locked = 1;
+}
+
+/*
+ * Returns 1 if we got the mutex by spinning, 0 if we have to take the
+ * slowpath.
+ */
+static int mutex_optimistic_spin(struct mutex *lock)
+{
+	struct mutex_spinner *node;
+	int acquired = 0;
+#ifdef CONFIG_MUTEX_STATS
+	unsigned long long start = sched_clock();
+#endif
+
+	preempt_disable();
+	node = &__get_cpu_var(mutex_spinners);
+	mutex_spin_queue_lock(lock, node);
+	mutex_stats_inc(spin);
+
+	for (;;) {
+		/* the owner went to sleep, or we have to */
+		if (!mutex_spin_on_owner(lock))
+			break;
+
+		if (atomic_read(&lock->count) == 1 &&
+		    atomic_cmpxchg(&lock->count, 1, 0) == 1) {
+			mutex_set_owner(lock);
+			acquired = 1;
+			break;
+		}
+
+		/*
+		 * No owner recorded: either it is just about to set itself,
+		 * or the mutex was taken by a waiter or another CPU in a
+		 * window we cannot see. Don't let an RT task spin forever
+		 * on a lower priority owner that cannot run.
+		 */
+		if (need_resched() || rt_task(current))
+			break;
+
+		cpu_relax();
+	}
+
+	mutex_spin_queue_unlock(lock, node);
+#ifdef CONFIG_MUTEX_STATS
+	if (acquired) {
+		struct mutex_stats *stats = &__get_cpu_var(mutex_stats);
+
+		stats->spin_acquired++;
+		stats->spin_time[log2_bucket((sched_clock() - start) >> 10,
+					     MUTEX_STATS_BUCKETS)]++;
+	}
+#endif
+	preempt_enable();
+	return acquired;
+}
+#else
+#define mutex_set_owner(lock)		do { } while (0)
+#define mutex_clear_owner(lock)		do { } while (0)
+#endif
+
+#ifdef CONFIG_LOCK_STAT
+/*
+ * The slowpath does not know who called mutex_lock(), so it leaves the
+ * time it waited in the mutex for mutex_lock_stat() to account once the
+ * fastpath returned. Only the owner touches lock->wait.
+ */
+static inline void mutex_stat_wait(struct mutex *lock,
+				   unsigned long long start)
+{
+	if (start)
+		lock->wait = sched_clock() - start;
+}
+
+static inline void mutex_lock_stat(struct mutex *lock, void *ip)
+{
+	if (unlikely(lock->wait)) {
+		lock_stat_contended(&lock->key, lock, LOCK_STAT_MUTEX, ip,
+				    lock->wait);
+		lock->wait = 0;
+	}
+	lock_stat_acquire(lock, LOCK_STAT_MUTEX, ip);
+}
+#else
+#define mutex_stat_wait(lock, start)	do { (void)(start); } while (0)
+#define mutex_lock_stat(lock, ip)	do { } while (0)
+#endif
+
 /*
  * We split the mutex lock/unlock logic into separate fastpath and
  * slowpath functions, to reduce the register pressure on the fastpath.
@@ -87,6 +277,8 @@ void fastcall __sched mutex_lock(struct mutex *lock)
 	 * 'unlocked' into 'locked' state.
 	 */
 	__mutex_fastpath_lock(&lock->count, __mutex_lock_slowpath);
+	mutex_set_owner(lock);
+	mutex_lock_stat(lock, __builtin_return_address(0));
 }
 
 EXPORT_SYMBOL(mutex_lock);
@@ -111,6 +303,8 @@ void fastcall __sched mutex_unlock(struct mutex *lock)
 	 * The unlocking fastpath is the 0->1 transition from 'locked'
 	 * into 'unlocked' state:
 	 */
+	lock_stat_release(lock);
+	mutex_clear_owner(lock);
 	__mutex_fastpath_unlock(&lock->count, __mutex_unlock_slowpath);
 }
 
@@ -125,6 +319,16 @@ __mutex_lock_common(struct mutex *lock, long state __IP_DECL__)
 	struct task_struct *task = current;
 	struct mutex_waiter waiter;
 	unsigned int old_val;
+	unsigned long long start = 0;
+
+	mutex_stats_inc(contended);
+#ifdef CONFIG_MUTEX_SPIN_ON_OWNER
+	lock_stat_begin(start);
+	if (mutex_optimistic_spin(lock)) {
+		mutex_stat_wait(lock, start);
+		return 0;
+	}
+#endif
 
 	debug_mutex_init_waiter(&waiter);
 
@@ -166,6 +370,8 @@ __mutex_lock_common(struct mutex *lock, long state __IP_DECL__)
 
 		/* didnt get the lock, go to sleep: */
 		spin_unlock_mutex(&lock->wait_lock);
+		mutex_stats_inc(sleep);
+		lock_stat_begin(start);
 		schedule();
 		spin_lock_mutex(&lock->wait_lock);
 	}
@@ -173,6 +379,8 @@ __mutex_lock_common(struct mutex *lock, long state __IP_DECL__)
 	/* got the lock - rejoice! */
 	mutex_remove_waiter(lock, &waiter, task->thread_info);
 	debug_mutex_set_owner(lock, task->thread_info __IP__);
+	mutex_set_owner(lock);
+	mutex_stat_wait(lock, start);
 
 	/* set it to 0 if there are no waiters left: */
 	if (likely(list_empty(&lock->wait_list)))
@@ -254,9 +462,16 @@ __mutex_lock_interruptible_slowpath(atomic_t *lock_count __IP_DECL__);
  */
 int fastcall __sched mutex_lock_interruptible(struct mutex *lock)
 {
+	int ret;
+
 	might_sleep();
-	return __mutex_fastpath_lock_retval
+	ret = __mutex_fastpath_lock_retval
 			(&lock->count, __mutex_lock_interruptible_slowpath);
+	if (!ret) {
+		mutex_set_owner(lock);
+		mutex_lock_stat(lock, __builtin_return_address(0));
+	}
+	return ret;
 }
 
 EXPORT_SYMBOL(mutex_lock_interruptible);
@@ -308,8 +523,43 @@ static inline int __mutex_trylock_slowpath(atomic_t *lock_count)
  */
 int fastcall mutex_trylock(struct mutex *lock)
 {
-	return __mutex_fastpath_trylock(&lock->count,
-					__mutex_trylock_slowpath);
+	int ret = __mutex_fastpath_trylock(&lock->count,
+					   __mutex_trylock_slowpath);
+
+	if (ret) {
+		mutex_set_owner(lock);
+		lock_stat_acquire(lock, LOCK_STAT_MUTEX,
+				  __builtin_return_address(0));
+	}
+	return ret;
 }
 
 EXPORT_SYMBOL(mutex_trylock);
+
+#ifdef CONFIG_MUTEX_STATS
+#define MUTEX_STAT_VERSION 1
+
+static int show_mutex_stat(struct seq_file *seq, void *v)
+{
+	unsigned int spin_time[MUTEX_STATS_BUCKETS] = { 0, };
+	int cpu, i;
+
+	seq_printf(seq, "version %d\n", MUTEX_STAT_VERSION);
+	seq_printf(seq, "buckets %d\n", MUTEX_STATS_BUCKETS);
+	for_each_online_cpu(cpu) {
+		struct mutex_stats *stats = &per_cpu(mutex_stats, cpu);
+
+		seq_printf(seq, "cpu%d contended %lu spin %lu "
+			   "spin_acquired %lu sleep %lu\n", cpu,
+			   stats->contended, stats->spin,
+			   stats->spin_acquired, stats->sleep);
+		for (i = 0; i < MUTEX_STATS_BUCKETS; i++)
+			spin_time[i] += stats->spin_time[i];
+	}
+	seq_printf(seq, "spin_time");
+	seq_put_hist(seq, spin_time, MUTEX_STATS_BUCKETS);
+	return 0;
+}
+
+DEFINE_SEQ_STAT_FILE(mutex_stat);
+#endif /* CONFIG_MUTEX_STATS */
@@ -1,35 +1,31 @@
 /*
- * Generic pidhash and scalable, time-bounded PID allocator
+ * Generic PID allocator and lookup
  *
  * (C) 2002-2003 William Irwin, IBM
  * (C) 2004 William Irwin, Oracle
  * (C) 2002-2004 Ingo Molnar, Red Hat
  *
  * pid-structures are backing objects for tasks sharing a given ID to chain
- * against. There is very little to them aside from hashing them and
+ * against. There is very little to them aside from looking them up and
  * parking tasks using given ID's on a list.
  *
- * The hash is always changed with the tasklist_lock write-acquired,
- * and the hash is only accessed with the tasklist_lock at least
- * read-acquired, so there's no additional SMP locking needed here.
- *
- * We have a list of bitmap pages, which bitmaps represent the PID space.
- * Allocating and freeing PIDs is completely lockless. The worst-case
- * allocation scenario when all but one out of 1 million PIDs possible are
- * allocated already: the scanning of 32 list entries and at most PAGE_SIZE
- * bytes. The typical fastpath is a single successful setbit. Freeing is O(1).
+ * The PIDs in use are kept in an IDR, which maps them to their struct
+ * pid. It is changed under pidmap_lock; find_pid() needs either the
+ * tasklist_lock or rcu_read_lock(), since the IDR is RCU safe and struct
+ * pids are freed after a grace period. Allocation is cyclic: it looks
+ * for the first free PID after the last one handed out with the bitmaps
+ * of the IDR layers, which skip full ranges of PIDs a layer at a time,
+ * so it costs a few cache lines no matter how many PIDs are in use.
+ * Walking the IDR with find_ge_pid() yields the PIDs in order.
  */
 
 #include <linux/mm.h>
 #include <linux/module.h>
 #include <linux/slab.h>
 #include <linux/init.h>
-#include <linux/bootmem.h>
-#include <linux/hash.h>
+#include <linux/idr.h>
 
-#define pid_hashfn(nr) hash_long((unsigned long)nr, pidhash_shift)
-static struct hlist_head *pid_hash;
-static int pidhash_shift;
+static struct idr pid_idr;
 static kmem_cache_t *pid_cachep;
 
 int pid_max = PID_MAX_DEFAULT;
@@ -40,27 +36,6 @@ int last_pid;
 int pid_max_min = RESERVED_PIDS + 1;
 int pid_max_max = PID_MAX_LIMIT;
 
-#define PIDMAP_ENTRIES		((PID_MAX_LIMIT + 8*PAGE_SIZE - 1)/PAGE_SIZE/8)
-#define BITS_PER_PAGE		(PAGE_SIZE*8)
-#define BITS_PER_PAGE_MASK	(BITS_PER_PAGE-1)
-#define mk_pid(map, off)	(((map) - pidmap_array)*BITS_PER_PAGE + (off))
-#define find_next_offset(map, off)					\
-		find_next_zero_bit((map)->page, BITS_PER_PAGE, off)
-
-/*
- * PID-map pages start out as NULL, they get allocated upon
- * first use and are never deallocated. This way a low pid_max
- * value does not cause lots of bitmaps to be allocated, but
- * the scheme scales to up to 4 million PIDs, runtime.
- */
-typedef struct pidmap {
-	atomic_t nr_free;
-	void *page;
-} pidmap_t;
-
-static pidmap_t pidmap_array[PIDMAP_ENTRIES] =
-	 { [ 0 ... PIDMAP_ENTRIES-1 ] = { ATOMIC_INIT(BITS_PER_PAGE), NULL } };
-
 /*
  * Note: disable interrupts while the pidmap_lock is held as an
  * interrupt might come in and do read_lock(&tasklist_lock).
@@ -76,73 +51,31 @@ static pidmap_t pidmap_array[PIDMAP_ENTRIES] =
  */
 static  __cacheline_aligned_in_smp DEFINE_SPINLOCK(pidmap_lock);
 
-static fastcall void free_pidmap(int pid)
-{
-	pidmap_t *map = pidmap_array + pid / BITS_PER_PAGE;
-	int offset = pid & BITS_PER_PAGE_MASK;
-
-	clear_bit(offset, map->page);
-	atomic_inc(&map->nr_free);
-}
-
-static int alloc_pidmap(void)
+/*
+ * Reserve the next free PID after last_pid, wrapping around to
+ * RESERVED_PIDS at pid_max. The PID maps to NULL until the struct pid
+ * is set up. Called with pidmap_lock held.
+ */
+static int alloc_pidnr(void)
 {
-	int i, offset, max_scan, pid, last = last_pid;
-	pidmap_t *map;
-
-	pid = last + 1;
-	if (pid >= pid_max)
-		pid = RESERVED_PIDS;
-	offset = pid & BITS_PER_PAGE_MASK;
-	map = &pidmap_array[pid/BITS_PER_PAGE];
-	max_scan = (pid_max + BITS_PER_PAGE - 1)/BITS_PER_PAGE - !offset;
-	for (i = 0; i <= max_scan; ++i) {
-		if (unlikely(!map->page)) {
-			unsigned long page = get_zeroed_page(GFP_KERNEL);
-			/*
-			 * Free the page if someone raced with us
-			 * installing it:
-			 */
-			spin_lock_irq(&pidmap_lock);
-			if (map->page)
-				free_page(page);
-			else
-				map->page = (void *)page;
-			spin_unlock_irq(&pidmap_lock);
-			if (unlikely(!map->page))
-				break;
-		}
-		if (likely(atomic_read(&map->nr_free))) {
-			do {
-				if (!test_and_set_bit(offset, map->page)) {
-					atomic_dec(&map->nr_free);
-					last_pid = pid;
-					return pid;
-				}
-				offset = find_next_offset(map, offset);
-				pid = mk_pid(map, offset);
-			/*
-			 * find_next_offset() found a bit, the pid from it
-			 * is in-bounds, and if we fell back to the last
-			 * bitmap block and the final block was the same
-			 * as the starting point, pid is before last_pid.
-			 */
-			} while (offset < BITS_PER_PAGE && pid < pid_max &&
-					(i != max_scan || pid < last ||
-					    !((last+1) & BITS_PER_PAGE_MASK)));
+	int nr, start = last_pid + 1, err;
+
+	if (start >= pid_max)
+		start = RESERVED_PIDS;
+	for (;;) {
+		err = idr_get_new_above(&pid_idr, NULL, start, &nr);
+		if (err)
+			return err;
+		if (nr < pid_max) {
+			last_pid = nr;
+			return nr;
 		}
-		if (map < &pidmap_array[(pid_max-1)/BITS_PER_PAGE]) {
-			++map;
-			offset = 0;
-		} else {
-			map = &pidmap_array[0];
-			offset = RESERVED_PIDS;
-			if (unlikely(last == offset))
-				break;
-		}
-		pid = mk_pid(map, offset);
+		/* nothing free up to pid_max */
+		idr_remove(&pid_idr, nr);
+		if (start == RESERVED_PIDS)
+			return -ENOSPC;
+		start = RESERVED_PIDS;
 	}
-	return -1;
 }
 
 fastcall void put_pid(struct pid *pid)
@@ -166,10 +99,9 @@ fastcall void free_pid(struct pid *pid)
 	unsigned long flags;
 
 	spin_lock_irqsave(&pidmap_lock, flags);
-	hlist_del_rcu(&pid->pid_chain);
+	idr_remove(&pid_idr, pid->nr);
 	spin_unlock_irqrestore(&pidmap_lock, flags);
 
-	free_pidmap(pid->nr);
 	call_rcu(&pid->rcu, delayed_put_pid);
 }
 
@@ -183,7 +115,13 @@ struct pid *alloc_pid(void)
 	if (!pid)
 		goto out;
 
-	nr = alloc_pidmap();
+	do {
+		if (!idr_pre_get(&pid_idr, GFP_KERNEL))
+			goto out_free;
+		spin_lock_irq(&pidmap_lock);
+		nr = alloc_pidnr();
+		spin_unlock_irq(&pidmap_lock);
+	} while (nr == -EAGAIN);
 	if (nr < 0)
 		goto out_free;
 
@@ -192,8 +130,9 @@ struct pid *alloc_pid(void)
 	for (type = 0; type < PIDTYPE_MAX; ++type)
 		INIT_HLIST_HEAD(&pid->tasks[type]);
 
+	/* make it visible to find_pid() */
 	spin_lock_irq(&pidmap_lock);
-	hlist_add_head_rcu(&pid->pid_chain, &pid_hash[pid_hashfn(pid->nr)]);
+	idr_replace(&pid_idr, pid, nr);
 	spin_unlock_irq(&pidmap_lock);
 
 out:
@@ -207,15 +146,16 @@ out_free:
 
 struct pid * fastcall find_pid(int nr)
 {
-	struct hlist_node *elem;
-	struct pid *pid;
+	return idr_find(&pid_idr, nr);
+}
 
-	hlist_for_each_entry_rcu(pid, elem,
-			&pid_hash[pid_hashfn(nr)], pid_chain) {
-		if (pid->nr == nr)
-			return pid;
-	}
-	return NULL;
+/*
+ * The pid with the lowest number at or above nr, or NULL. Must be called
+ * under rcu_read_lock() or with tasklist_lock read-held, like find_pid().
+ */
+struct pid *find_ge_pid(int nr)
+{
+	return idr_get_next(&pid_idr, &nr);
 }
 
 int fastcall attach_pid(task_t *task, enum pid_type type, int nr)
@@ -296,37 +236,10 @@ struct pid *find_get_pid(pid_t nr)
 	return pid;
 }
 
-/*
- * The pid hash table is scaled according to the amount of memory in the
- * machine.  From a minimum of 16 slots up to 4096 slots at one gigabyte or
- * more.
- */
-void __init pidhash_init(void)
-{
-	int i, pidhash_size;
-	unsigned long megabytes = nr_kernel_pages >> (20 - PAGE_SHIFT);
-
-	pidhash_shift = max(4, fls(megabytes * 4));
-	pidhash_shift = min(12, pidhash_shift);
-	pidhash_size = 1 << pidhash_shift;
-
-	printk("PID hash table entries: %d (order: %d, %Zd bytes)\n",
-		pidhash_size, pidhash_shift,
-		pidhash_size * sizeof(struct hlist_head));
-
-	pid_hash = alloc_bootmem(pidhash_size *	sizeof(*(pid_hash)));
-	if (!pid_hash)
-		panic("Could not alloc pidhash!\n");
-	for (i = 0; i < pidhash_size; i++)
-		INIT_HLIST_HEAD(&pid_hash[i]);
-}
-
 void __init pidmap_init(void)
 {
-	pidmap_array->page = (void *)get_zeroed_page(GFP_KERNEL);
-	/* Reserve PID 0. We never call free_pidmap(0) */
-	set_bit(0, pidmap_array->page);
-	atomic_dec(&pidmap_array->nr_free);
+	/* PID 0 is never allocated: alloc_pidnr() starts at last_pid + 1 */
+	idr_init(&pid_idr);
 
 	pid_cachep = kmem_cache_create("pid", sizeof(struct pid),
 					__alignof__(struct pid),
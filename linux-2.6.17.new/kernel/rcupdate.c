@@ -48,19 +48,19 @@
 #include <linux/rcupdate.h>
 #include <linux/cpu.h>
 #include <linux/mutex.h>
+#include <linux/fs.h>
+#include <linux/seq_file.h>
 
 /* Definition for rcupdate control block. */
 static struct rcu_ctrlblk rcu_ctrlblk = {
 	.cur = -300,
 	.completed = -300,
 	.lock = SPIN_LOCK_UNLOCKED,
-	.cpumask = CPU_MASK_NONE,
 };
 static struct rcu_ctrlblk rcu_bh_ctrlblk = {
 	.cur = -300,
 	.completed = -300,
 	.lock = SPIN_LOCK_UNLOCKED,
-	.cpumask = CPU_MASK_NONE,
 };
 
 DEFINE_PER_CPU(struct rcu_data, rcu_data) = { 0L };
@@ -71,10 +71,29 @@ static DEFINE_PER_CPU(struct tasklet_struct, rcu_tasklet) = {NULL};
 static int blimit = 10;
 static int qhimark = 10000;
 static int qlowmark = 100;
+static int rcu_divisor = 7;
 #ifdef CONFIG_SMP
 static int rsinterval = 1000;
 #endif
 
+#ifdef CONFIG_RCU_STATS
+/*
+ * log2 histograms for /proc/rcu_stat: bucket 0 counts zeroes, bucket k
+ * values in [2^(k-1), 2^k), the last bucket is open-ended.
+ */
+static DEFINE_SPINLOCK(rcu_expedited_lock);
+static unsigned long rcu_expedited_count;
+static unsigned int rcu_expedited_latency[RCU_STATS_BUCKETS];
+
+#define rcu_stats_inc(field)		((field)++)
+#define rcu_stats_hist(hist, val)	((hist)[log2_bucket(val, RCU_STATS_BUCKETS)]++)
+#define rcu_stats_clock()		sched_clock()
+#else
+#define rcu_stats_inc(field)		do { } while (0)
+#define rcu_stats_hist(hist, val)	do { (void)(val); } while (0)
+#define rcu_stats_clock()		0ULL
+#endif
+
 static atomic_t rcu_barrier_cpu_count;
 static DEFINE_MUTEX(rcu_barrier_mutex);
 static struct completion rcu_barrier_completion;
@@ -83,19 +102,27 @@ static struct completion rcu_barrier_completion;
 static void force_quiescent_state(struct rcu_data *rdp,
 			struct rcu_ctrlblk *rcp)
 {
+	struct rcu_node *rnp;
+	unsigned long mask;
 	int cpu;
-	cpumask_t cpumask;
+
 	set_need_resched();
 	if (unlikely(rdp->qlen - rdp->last_rs_qlen > rsinterval)) {
 		rdp->last_rs_qlen = rdp->qlen;
+		rcu_stats_inc(rcp->forced);
 		/*
+		 * Kick the CPUs the leaves still wait for. The masks are
+		 * read without locks, a stale one only costs an IPI.
 		 * Don't send IPI to itself. With irqs disabled,
 		 * rdp->cpu is the current cpu.
 		 */
-		cpumask = rcp->cpumask;
-		cpu_clear(rdp->cpu, cpumask);
-		for_each_cpu_mask(cpu, cpumask)
-			smp_send_reschedule(cpu);
+		for (rnp = &rcp->node[NUM_RCU_NODES - NUM_RCU_LEAVES];
+		     rnp < &rcp->node[NUM_RCU_NODES]; rnp++) {
+			mask = rnp->qsmask;
+			for (cpu = rnp->grplo; mask; cpu++, mask >>= 1)
+				if ((mask & 1) && cpu != rdp->cpu)
+					smp_send_reschedule(cpu);
+		}
 	}
 }
 #else
@@ -133,6 +160,10 @@ void fastcall call_rcu(struct rcu_head *head,
 		rdp->blimit = INT_MAX;
 		force_quiescent_state(rdp, &rcu_ctrlblk);
 	}
+#ifdef CONFIG_RCU_STATS
+	if (rdp->qlen > rdp->qlen_max)
+		rdp->qlen_max = rdp->qlen;
+#endif
 	local_irq_restore(flags);
 }
 
@@ -169,6 +200,10 @@ void fastcall call_rcu_bh(struct rcu_head *head,
 		rdp->blimit = INT_MAX;
 		force_quiescent_state(rdp, &rcu_bh_ctrlblk);
 	}
+#ifdef CONFIG_RCU_STATS
+	if (rdp->qlen > rdp->qlen_max)
+		rdp->qlen_max = rdp->qlen;
+#endif
 
 	local_irq_restore(flags);
 }
@@ -225,7 +260,15 @@ EXPORT_SYMBOL_GPL(rcu_barrier);
 static void rcu_do_batch(struct rcu_data *rdp)
 {
 	struct rcu_head *next, *list;
-	int count = 0;
+	long count = 0, limit;
+
+	/*
+	 * Invoke at least blimit callbacks, and a fraction of the queue
+	 * if it is long: a CPU that queues more than blimit callbacks per
+	 * tick would otherwise fall further behind with every batch, until
+	 * it hits qhimark.
+	 */
+	limit = max(rdp->blimit, rdp->qlen >> rcu_divisor);
 
 	list = rdp->donelist;
 	while (list) {
@@ -233,9 +276,12 @@ static void rcu_do_batch(struct rcu_data *rdp)
 		list->func(list);
 		list = next;
 		rdp->qlen--;
-		if (++count >= rdp->blimit)
+		if (++count >= limit)
 			break;
 	}
+#ifdef CONFIG_RCU_STATS
+	rdp->invoked += count;
+#endif
 	if (rdp->blimit == INT_MAX && rdp->qlen <= qlowmark)
 		rdp->blimit = blimit;
 	if (!rdp->donelist)
@@ -249,19 +295,99 @@ static void rcu_do_batch(struct rcu_data *rdp)
  * The grace period handling consists out of two steps:
  * - A new grace period is started.
  *   This is done by rcu_start_batch. The start is not broadcasted to
- *   all cpus, they must pick this up by comparing rcp->cur with
- *   rdp->quiescbatch. All cpus are recorded  in the
- *   rcu_ctrlblk.cpumask bitmap.
+ *   all cpus, they must pick this up by comparing the gpnum of their
+ *   leaf rcu_node with rdp->quiescbatch. All cpus are recorded in the
+ *   qsmask of their leaf, and every group with cpus in the qsmask of
+ *   its parent.
  * - All cpus must go through a quiescent state.
  *   Since the start of the grace period is not broadcasted, at least two
  *   calls to rcu_check_quiescent_state are required:
  *   The first call just notices that a new grace period is running. The
  *   following calls check if there was a quiescent state since the beginning
- *   of the grace period. If so, it updates rcu_ctrlblk.cpumask. If
- *   the bitmap is empty, then the grace period is completed.
- *   rcu_check_quiescent_state calls rcu_start_batch(0) to start the next grace
- *   period (if necessary).
+ *   of the grace period. If so, the cpu is cleared from its leaf. The last
+ *   cpu of a leaf clears the leaf from its parent, and so on. When the
+ *   root becomes empty, the grace period is completed and
+ *   rcu_start_batch is called to start the next grace period (if
+ *   necessary).
+ *
+ * Lock order: rcp->lock nests outside the rcu_node locks. Only one node
+ * lock is held at a time.
+ */
+
+/*
+ * Set up the rcu_node tree. Level l (0 is the root) has one node per
+ * RCU_FANOUT^(NUM_RCU_LVLS - l) cpus.
  */
+static void __init rcu_init_tree(struct rcu_ctrlblk *rcp)
+{
+	int levelcnt[NUM_RCU_LVLS], levelspan[NUM_RCU_LVLS];
+	struct rcu_node *rnp = rcp->node, *parents = NULL;
+	int i, j;
+
+	levelspan[NUM_RCU_LVLS - 1] = RCU_FANOUT;
+	for (i = NUM_RCU_LVLS - 2; i >= 0; i--)
+		levelspan[i] = levelspan[i + 1] * RCU_FANOUT;
+	for (i = 0; i < NUM_RCU_LVLS; i++)
+		levelcnt[i] = (NR_CPUS + levelspan[i] - 1) / levelspan[i];
+
+	for (i = 0; i < NUM_RCU_LVLS; i++) {
+		for (j = 0; j < levelcnt[i]; j++, rnp++) {
+			spin_lock_init(&rnp->lock);
+			rnp->gpnum = rcp->completed;
+			rnp->qsmask = 0;
+			rnp->grplo = j * levelspan[i];
+			rnp->grphi = min(rnp->grplo + levelspan[i], NR_CPUS) - 1;
+			rnp->parent = parents ? parents + j / RCU_FANOUT : NULL;
+			rnp->grpmask = parents ? 1UL << (j % RCU_FANOUT) : 0;
+		}
+		parents = rnp - levelcnt[i];
+	}
+	BUG_ON(rnp != &rcp->node[NUM_RCU_NODES]);
+}
+
+static inline struct rcu_node *rcu_cpu_node(struct rcu_ctrlblk *rcp, int cpu)
+{
+	return &rcp->node[NUM_RCU_NODES - NUM_RCU_LEAVES + cpu / RCU_FANOUT];
+}
+
+/*
+ * Fill the qsmasks of all nodes for the batch rcp->cur: bottom up for
+ * the masks, then top down under the node locks, so that a cpu that
+ * sees the new gpnum in its leaf finds the parents already set up.
+ * Caller must hold rcp->lock. Returns 0 if no cpu has to pass a
+ * quiescent state.
+ */
+static int rcu_init_qsmask(struct rcu_ctrlblk *rcp, cpumask_t *cpumask)
+{
+	struct rcu_node *rnp;
+	int cpu;
+
+	for (rnp = rcp->node; rnp < &rcp->node[NUM_RCU_NODES]; rnp++)
+		rnp->qsmaskinit = 0;
+	for_each_cpu_mask(cpu, *cpumask)
+		rcu_cpu_node(rcp, cpu)->qsmaskinit |= 1UL << (cpu % RCU_FANOUT);
+	for (rnp = &rcp->node[NUM_RCU_NODES - 1]; rnp->parent; rnp--)
+		if (rnp->qsmaskinit)
+			rnp->parent->qsmaskinit |= rnp->grpmask;
+
+	for (rnp = rcp->node; rnp < &rcp->node[NUM_RCU_NODES]; rnp++) {
+		spin_lock(&rnp->lock);
+		rnp->qsmask = rnp->qsmaskinit;
+		rnp->gpnum = rcp->cur;
+		spin_unlock(&rnp->lock);
+	}
+	return rcp->node[0].qsmask != 0;
+}
+
+static void rcu_batch_done(struct rcu_ctrlblk *rcp)
+{
+	rcp->completed = rcp->cur;
+#ifdef CONFIG_RCU_STATS
+	rcu_stats_hist(rcp->gp_latency,
+		       (rcu_stats_clock() - rcp->gp_start) >> 10);
+#endif
+}
+
 /*
  * Register a new batch of callbacks, and start it up if there is currently no
  * active batch and the batch to be registered has not already occurred.
@@ -269,6 +395,8 @@ static void rcu_do_batch(struct rcu_data *rdp)
  */
 static void rcu_start_batch(struct rcu_ctrlblk *rcp)
 {
+	cpumask_t cpumask;
+
 	if (rcp->next_pending &&
 			rcp->completed == rcp->cur) {
 		rcp->next_pending = 0;
@@ -278,32 +406,57 @@ static void rcu_start_batch(struct rcu_ctrlblk *rcp)
 		 */
 		smp_wmb();
 		rcp->cur++;
+#ifdef CONFIG_RCU_STATS
+		rcp->gp_start = rcu_stats_clock();
+#endif
 
 		/*
 		 * Accessing nohz_cpu_mask before incrementing rcp->cur needs a
 		 * Barrier  Otherwise it can cause tickless idle CPUs to be
-		 * included in rcp->cpumask, which will extend graceperiods
+		 * included in the qsmasks, which will extend graceperiods
 		 * unnecessarily.
 		 */
 		smp_mb();
-		cpus_andnot(rcp->cpumask, cpu_online_map, nohz_cpu_mask);
-
+		cpus_andnot(cpumask, cpu_online_map, nohz_cpu_mask);
+		if (!rcu_init_qsmask(rcp, &cpumask))
+			rcu_batch_done(rcp);
 	}
 }
 
 /*
- * cpu went through a quiescent state since the beginning of the grace period.
- * Clear it from the cpu mask and complete the grace period if it was the last
- * cpu. Start another grace period if someone has further entries pending
+ * Clear mask from rnp for batch gpnum, and propagate it towards the root
+ * as groups become empty. Complete the grace period if it was the last
+ * cpu. Start another grace period if someone has further entries
+ * pending. Nothing is done if the batch is over already or the bit was
+ * never set, e.g. for a cpu that came online during the batch.
  */
-static void cpu_quiet(int cpu, struct rcu_ctrlblk *rcp)
+static void cpu_quiet(struct rcu_ctrlblk *rcp, struct rcu_node *rnp,
+		      unsigned long mask, long gpnum)
 {
-	cpu_clear(cpu, rcp->cpumask);
-	if (cpus_empty(rcp->cpumask)) {
-		/* batch completed ! */
-		rcp->completed = rcp->cur;
-		rcu_start_batch(rcp);
+	for (;;) {
+		spin_lock(&rnp->lock);
+		if (rnp->gpnum != gpnum || !(rnp->qsmask & mask)) {
+			spin_unlock(&rnp->lock);
+			return;
+		}
+		rnp->qsmask &= ~mask;
+		if (rnp->qsmask || !rnp->parent)
+			break;
+		mask = rnp->grpmask;
+		spin_unlock(&rnp->lock);
+		rnp = rnp->parent;
 	}
+	if (rnp->qsmask) {
+		spin_unlock(&rnp->lock);
+		return;
+	}
+	spin_unlock(&rnp->lock);
+
+	/* batch completed ! */
+	spin_lock(&rcp->lock);
+	rcu_batch_done(rcp);
+	rcu_start_batch(rcp);
+	spin_unlock(&rcp->lock);
 }
 
 /*
@@ -314,11 +467,11 @@ static void cpu_quiet(int cpu, struct rcu_ctrlblk *rcp)
 static void rcu_check_quiescent_state(struct rcu_ctrlblk *rcp,
 					struct rcu_data *rdp)
 {
-	if (rdp->quiescbatch != rcp->cur) {
+	if (rdp->quiescbatch != rdp->mynode->gpnum) {
 		/* start new grace period: */
 		rdp->qs_pending = 1;
 		rdp->passed_quiesc = 0;
-		rdp->quiescbatch = rcp->cur;
+		rdp->quiescbatch = rdp->mynode->gpnum;
 		return;
 	}
 
@@ -337,15 +490,12 @@ static void rcu_check_quiescent_state(struct rcu_ctrlblk *rcp,
 		return;
 	rdp->qs_pending = 0;
 
-	spin_lock(&rcp->lock);
 	/*
-	 * rdp->quiescbatch/rcp->cur and the cpu bitmap can come out of sync
-	 * during cpu startup. Ignore the quiescent state.
+	 * The batch in the leaf is checked against rdp->quiescbatch under
+	 * the leaf lock, so a quiescent state that raced with the start of
+	 * the next batch is ignored.
 	 */
-	if (likely(rdp->quiescbatch == rcp->cur))
-		cpu_quiet(rdp->cpu, rcp);
-
-	spin_unlock(&rcp->lock);
+	cpu_quiet(rcp, rdp->mynode, rdp->grpmask, rdp->quiescbatch);
 }
 
 
@@ -372,10 +522,9 @@ static void __rcu_offline_cpu(struct rcu_data *this_rdp,
 	 * we can block indefinitely waiting for it, so flush
 	 * it here
 	 */
-	spin_lock_bh(&rcp->lock);
-	if (rcp->cur != rcp->completed)
-		cpu_quiet(rdp->cpu, rcp);
-	spin_unlock_bh(&rcp->lock);
+	local_bh_disable();
+	cpu_quiet(rcp, rdp->mynode, rdp->grpmask, rdp->mynode->gpnum);
+	local_bh_enable();
 	rcu_move_batch(this_rdp, rdp->curlist, rdp->curtail);
 	rcu_move_batch(this_rdp, rdp->nxtlist, rdp->nxttail);
 	rcu_move_batch(this_rdp, rdp->donelist, rdp->donetail);
@@ -472,7 +621,7 @@ static int __rcu_pending(struct rcu_ctrlblk *rcp, struct rcu_data *rdp)
 		return 1;
 
 	/* The rcu core waits for a quiescent state from the cpu */
-	if (rdp->quiescbatch != rcp->cur || rdp->qs_pending)
+	if (rdp->quiescbatch != rdp->mynode->gpnum || rdp->qs_pending)
 		return 1;
 
 	/* nothing to do */
@@ -527,6 +676,8 @@ static void rcu_init_percpu_data(int cpu, struct rcu_ctrlblk *rcp,
 	rdp->qs_pending = 0;
 	rdp->cpu = cpu;
 	rdp->blimit = blimit;
+	rdp->mynode = rcu_cpu_node(rcp, cpu);
+	rdp->grpmask = 1UL << (cpu % RCU_FANOUT);
 }
 
 static void __devinit rcu_online_cpu(int cpu)
@@ -568,6 +719,8 @@ static struct notifier_block rcu_nb = {
  */
 void __init rcu_init(void)
 {
+	rcu_init_tree(&rcu_ctrlblk);
+	rcu_init_tree(&rcu_bh_ctrlblk);
 	rcu_cpu_notify(&rcu_nb, CPU_UP_PREPARE,
 			(void *)(long)smp_processor_id());
 	/* Register notifier for non-boot CPUs */
@@ -612,6 +765,43 @@ void synchronize_rcu(void)
 	wait_for_completion(&rcu.completion);
 }
 
+/**
+ * synchronize_rcu_expedited - wait until a grace period has elapsed, quickly.
+ *
+ * Like synchronize_rcu(), but instead of waiting for every CPU to pass
+ * a quiescent state on its own, which takes a few ticks per CPU that
+ * has to notice the grace period, it forces one: the caller is run on
+ * every online CPU in turn. A CPU that switched to the caller has left
+ * any RCU read-side critical section it was in before. This takes
+ * microseconds instead of milliseconds on a mostly idle system, but
+ * costs a context switch and migration on every CPU, so use it where
+ * an updater's latency matters, not in loops.
+ *
+ * Must not be called from CPU hotplug notifiers.
+ */
+void synchronize_rcu_expedited(void)
+{
+	cpumask_t saved = current->cpus_allowed;
+	unsigned long long start = rcu_stats_clock();
+	int cpu;
+
+	might_sleep();
+	lock_cpu_hotplug();
+	for_each_online_cpu(cpu)
+		set_cpus_allowed(current, cpumask_of_cpu(cpu));
+	set_cpus_allowed(current, saved);
+	unlock_cpu_hotplug();
+
+#ifdef CONFIG_RCU_STATS
+	spin_lock(&rcu_expedited_lock);
+	rcu_expedited_count++;
+	rcu_stats_hist(rcu_expedited_latency, (rcu_stats_clock() - start) >> 10);
+	spin_unlock(&rcu_expedited_lock);
+#else
+	(void)start;
+#endif
+}
+
 /*
  * Deprecated, use synchronize_rcu() or synchronize_sched() instead.
  */
@@ -623,6 +813,7 @@ void synchronize_kernel(void)
 module_param(blimit, int, 0);
 module_param(qhimark, int, 0);
 module_param(qlowmark, int, 0);
+module_param(rcu_divisor, int, 0);
 #ifdef CONFIG_SMP
 module_param(rsinterval, int, 0);
 #endif
@@ -630,4 +821,46 @@ EXPORT_SYMBOL_GPL(rcu_batches_completed);
 EXPORT_SYMBOL_GPL_FUTURE(call_rcu);	/* WARNING: GPL-only in April 2006. */
 EXPORT_SYMBOL_GPL_FUTURE(call_rcu_bh);	/* WARNING: GPL-only in April 2006. */
 EXPORT_SYMBOL_GPL(synchronize_rcu);
+EXPORT_SYMBOL_GPL(synchronize_rcu_expedited);
 EXPORT_SYMBOL_GPL_FUTURE(synchronize_kernel); /* WARNING: GPL-only in April 2006. */
+
+#ifdef CONFIG_RCU_STATS
+#define RCU_STAT_VERSION 1
+
+static void rcu_stat_hist(struct seq_file *seq, const char *name,
+			  unsigned int *count)
+{
+	seq_printf(seq, "%s", name);
+	seq_put_hist(seq, count, RCU_STATS_BUCKETS);
+}
+
+static int show_rcu_stat(struct seq_file *seq, void *v)
+{
+	int cpu;
+
+	seq_printf(seq, "version %d\n", RCU_STAT_VERSION);
+	seq_printf(seq, "buckets %d\n", RCU_STATS_BUCKETS);
+	seq_printf(seq, "fanout %d levels %d nodes %d\n",
+		   RCU_FANOUT, NUM_RCU_LVLS, NUM_RCU_NODES);
+	seq_printf(seq, "rcu completed %ld forced %lu\n",
+		   rcu_ctrlblk.completed, rcu_ctrlblk.forced);
+	rcu_stat_hist(seq, "rcu latency", rcu_ctrlblk.gp_latency);
+	seq_printf(seq, "rcu_bh completed %ld forced %lu\n",
+		   rcu_bh_ctrlblk.completed, rcu_bh_ctrlblk.forced);
+	rcu_stat_hist(seq, "rcu_bh latency", rcu_bh_ctrlblk.gp_latency);
+	seq_printf(seq, "expedited %lu\n", rcu_expedited_count);
+	rcu_stat_hist(seq, "expedited latency", rcu_expedited_latency);
+	for_each_online_cpu(cpu) {
+		struct rcu_data *rdp = &per_cpu(rcu_data, cpu);
+		struct rcu_data *bh_rdp = &per_cpu(rcu_bh_data, cpu);
+
+		seq_printf(seq, "cpu%d rcu qlen %ld max %ld invoked %lu "
+			   "rcu_bh qlen %ld max %ld invoked %lu\n", cpu,
+			   rdp->qlen, rdp->qlen_max, rdp->invoked,
+			   bh_rdp->qlen, bh_rdp->qlen_max, bh_rdp->invoked);
+	}
+	return 0;
+}
+
+DEFINE_SEQ_STAT_FILE(rcu_stat);
+#endif /* CONFIG_RCU_STATS */
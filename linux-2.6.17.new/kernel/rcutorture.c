@@ -53,6 +53,7 @@ static int stat_interval;	/* Interval between stats, in seconds. */
 static int verbose;		/* Print more debug info. */
 static int test_no_idle_hz;	/* Test RCU's support for tickless idle CPUs. */
 static int shuffle_interval = 5; /* Interval between shuffles (in sec)*/
+static int expedited;		/* Use synchronize_rcu_expedited(). */
 
 module_param(nreaders, int, 0);
 MODULE_PARM_DESC(nreaders, "Number of RCU reader threads");
@@ -64,6 +65,8 @@ module_param(test_no_idle_hz, bool, 0);
 MODULE_PARM_DESC(test_no_idle_hz, "Test support for tickless idle CPUs");
 module_param(shuffle_interval, int, 0);
 MODULE_PARM_DESC(shuffle_interval, "Number of seconds between shuffles");
+module_param(expedited, bool, 0);
+MODULE_PARM_DESC(expedited, "Free with synchronize_rcu_expedited()");
 #define TORTURE_FLAG "rcutorture: "
 #define PRINTK_STRING(s) \
 	do { printk(KERN_ALERT TORTURE_FLAG s "\n"); } while (0)
@@ -161,6 +164,26 @@ rcu_torture_cb(struct rcu_head *p)
 		call_rcu(p, rcu_torture_cb);
 }
 
+/*
+ * Retire an element through the whole pipeline with expedited grace
+ * periods instead of callbacks.
+ */
+static void
+rcu_torture_expedited_free(struct rcu_torture *rp)
+{
+	int i;
+
+	do {
+		synchronize_rcu_expedited();
+		i = rp->rtort_pipe_count;
+		if (i > RCU_TORTURE_PIPE_LEN)
+			i = RCU_TORTURE_PIPE_LEN;
+		atomic_inc(&rcu_torture_wcount[i]);
+	} while (++rp->rtort_pipe_count < RCU_TORTURE_PIPE_LEN && !fullstop);
+	rp->rtort_mbtest = 0;
+	rcu_torture_free(rp);
+}
+
 struct rcu_random_state {
 	unsigned long rrs_state;
 	unsigned long rrs_count;
@@ -209,7 +232,7 @@ rcu_torture_writer(void *arg)
 
 	do {
 		schedule_timeout_uninterruptible(1);
-		if (rcu_batches_completed() == oldbatch)
+		if (!expedited && rcu_batches_completed() == oldbatch)
 			continue;
 		if ((rp = rcu_torture_alloc()) == NULL)
 			continue;
@@ -225,7 +248,10 @@ rcu_torture_writer(void *arg)
 				i = RCU_TORTURE_PIPE_LEN;
 			atomic_inc(&rcu_torture_wcount[i]);
 			old_rp->rtort_pipe_count++;
-			call_rcu(&old_rp->rtort_rcu, rcu_torture_cb);
+			if (expedited)
+				rcu_torture_expedited_free(old_rp);
+			else
+				call_rcu(&old_rp->rtort_rcu, rcu_torture_cb);
 		}
 		rcu_torture_current_version++;
 		oldbatch = rcu_batches_completed();
@@ -446,9 +472,9 @@ rcu_torture_print_module_parms(char *tag)
 {
 	printk(KERN_ALERT TORTURE_FLAG "--- %s: nreaders=%d "
 		"stat_interval=%d verbose=%d test_no_idle_hz=%d "
-		"shuffle_interval = %d\n",
+		"shuffle_interval = %d expedited=%d\n",
 		tag, nrealreaders, stat_interval, verbose, test_no_idle_hz,
-		shuffle_interval);
+		shuffle_interval, expedited);
 }
 
 static void
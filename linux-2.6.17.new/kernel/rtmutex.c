@@ -0,0 +1,704 @@
+/*
+ * RT-Mutexes: simple blocking mutual exclusion locks with PI support
+ *
+ * The owner of a rt_mutex runs at least at the priority of the highest
+ * priority task blocked on it. Boosting (and deboosting) is transitive:
+ * when the owner is blocked on another rt_mutex itself, the boost is
+ * propagated along the chain of owners, see rt_mutex_adjust_prio_chain().
+ *
+ * See Documentation/pi-futex.txt for the user space side.
+ */
+#include <linux/spinlock.h>
+#include <linux/module.h>
+#include <linux/sched.h>
+
+#include "rtmutex_common.h"
+
+/*
+ * Locking rules:
+ *
+ *  lock->wait_lock protects lock->owner, lock->wait_list and waiter->prio
+ *  task->pi_lock protects task->pi_waiters, task->pi_blocked_on and
+ *  waiter->pi_prio
+ *
+ * Lock order is lock->wait_lock -> task->pi_lock -> rq->lock. The chain
+ * walk has to go the other way round (task->pi_lock -> lock->wait_lock of
+ * the lock the task is blocked on), so it trylocks and retries. At most
+ * two of these locks are held at any time, which keeps the chain walk
+ * preemptible between the steps.
+ */
+
+/*
+ * Max number of times we'll walk the boosting chain:
+ */
+int max_lock_depth = 1024;
+
+/*
+ * Insert @waiter into the priority sorted @lock->wait_list, behind
+ * waiters of the same priority:
+ */
+static void rt_mutex_enqueue(struct rt_mutex *lock,
+			     struct rt_mutex_waiter *waiter)
+{
+	struct list_head *pos;
+
+	list_for_each(pos, &lock->wait_list) {
+		struct rt_mutex_waiter *w;
+
+		w = list_entry(pos, struct rt_mutex_waiter, list_entry);
+		if (waiter->prio < w->prio)
+			break;
+	}
+	list_add_tail(&waiter->list_entry, pos);
+}
+
+/*
+ * Same for the pi_waiters list of the lock owner @task:
+ */
+static void rt_mutex_enqueue_pi(struct task_struct *task,
+				struct rt_mutex_waiter *waiter)
+{
+	struct list_head *pos;
+
+	waiter->pi_prio = waiter->prio;
+	list_for_each(pos, &task->pi_waiters) {
+		struct rt_mutex_waiter *w;
+
+		w = list_entry(pos, struct rt_mutex_waiter, pi_list_entry);
+		if (waiter->pi_prio < w->pi_prio)
+			break;
+	}
+	list_add_tail(&waiter->pi_list_entry, pos);
+}
+
+/*
+ * Calculate task priority from the waiter list priority
+ *
+ * Return task->normal_prio when the waiter list is empty.
+ */
+int rt_mutex_getprio(struct task_struct *task)
+{
+	if (likely(!task_has_pi_waiters(task)))
+		return task->normal_prio;
+
+	return min(task_top_pi_waiter(task)->pi_prio, task->normal_prio);
+}
+
+/*
+ * Adjust the priority of a task, after its pi_waiters got modified.
+ *
+ * This can be both boosting and unboosting. task->pi_lock must be held.
+ */
+static void __rt_mutex_adjust_prio(struct task_struct *task)
+{
+	int prio = rt_mutex_getprio(task);
+
+	if (task->prio != prio)
+		rt_mutex_setprio(task, prio);
+}
+
+/*
+ * Adjust task priority (undo boosting). Called from the exit path of
+ * rt_mutex_slowunlock().
+ *
+ * (Note: We do this outside of the protection of lock->wait_lock to
+ * allow the lock to be taken while or before we readjust the priority
+ * of task.)
+ */
+static void rt_mutex_adjust_prio(struct task_struct *task)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&task->pi_lock, flags);
+	__rt_mutex_adjust_prio(task);
+	spin_unlock_irqrestore(&task->pi_lock, flags);
+}
+
+/*
+ * Adjust the priority chain. Also used for deadlock detection.
+ * Decreases task's usage by one - may thus free the task.
+ *
+ * @task:	the task owning the mutex (owner) for which a chain walk is
+ *		probably needed
+ * @deadlock_detect: do we have to carry out deadlock detection?
+ * @orig_lock:	the mutex (can be NULL if we are walking the chain to
+ *		recheck things for a task that has just got its priority
+ *		adjusted, and is waiting on a mutex)
+ * @orig_waiter: rt_mutex_waiter struct for the task that has just
+ *		donated its priority to the mutex owner (can be NULL in the
+ *		cases we are just deboosting or rechecking)
+ * @top_task:	the current top waiter
+ *
+ * Returns 0 or -EDEADLK.
+ */
+static int rt_mutex_adjust_prio_chain(struct task_struct *task,
+				      int deadlock_detect,
+				      struct rt_mutex *orig_lock,
+				      struct rt_mutex_waiter *orig_waiter,
+				      struct task_struct *top_task)
+{
+	struct rt_mutex *lock;
+	struct rt_mutex_waiter *waiter, *top_waiter = orig_waiter;
+	int ret = 0, depth = 0;
+	unsigned long flags;
+
+	/*
+	 * The (de)boosting is a step by step approach with a lot of
+	 * pitfalls. We want this to be preemptible and we want hold a
+	 * maximum of two locks per step. So we have to check
+	 * carefully whether things change under us.
+	 */
+ again:
+	if (++depth > max_lock_depth) {
+		static int prev_max;
+
+		/*
+		 * Print this only once. If the admin changes the limit,
+		 * print a new message when reaching the limit again.
+		 */
+		if (prev_max != max_lock_depth) {
+			prev_max = max_lock_depth;
+			printk(KERN_WARNING "Maximum lock depth %d reached "
+			       "task: %s (%d)\n", max_lock_depth,
+			       top_task->comm, top_task->pid);
+		}
+		put_task_struct(task);
+
+		return deadlock_detect ? -EDEADLK : 0;
+	}
+ retry:
+	/*
+	 * Task can not go away as we did a get_task() before !
+	 */
+	spin_lock_irqsave(&task->pi_lock, flags);
+
+	waiter = task->pi_blocked_on;
+	/*
+	 * Check whether the end of the boosting chain has been
+	 * reached or the state of the chain has changed while we
+	 * dropped the locks.
+	 */
+	if (!waiter || !waiter->task)
+		goto out_unlock_pi;
+
+	/*
+	 * The original waiter got the lock handed over or gave up
+	 * while we dropped the locks:
+	 */
+	if (orig_waiter && !orig_waiter->task)
+		goto out_unlock_pi;
+
+	/*
+	 * Drop out, when the task has no waiters. Note,
+	 * top_waiter can be NULL, when we are in the deboosting
+	 * mode!
+	 */
+	if (top_waiter && (!task_has_pi_waiters(task) ||
+			   top_waiter != task_top_pi_waiter(task)))
+		goto out_unlock_pi;
+
+	/*
+	 * When deadlock detection is off then we check, if further
+	 * priority adjustment is necessary.
+	 */
+	if (!deadlock_detect && waiter->prio == task->prio)
+		goto out_unlock_pi;
+
+	lock = waiter->lock;
+	if (!spin_trylock(&lock->wait_lock)) {
+		spin_unlock_irqrestore(&task->pi_lock, flags);
+		cpu_relax();
+		goto retry;
+	}
+
+	/* Deadlock detection */
+	if (lock == orig_lock || lock->owner == top_task) {
+		spin_unlock(&lock->wait_lock);
+		ret = deadlock_detect ? -EDEADLK : 0;
+		goto out_unlock_pi;
+	}
+
+	top_waiter = rt_mutex_top_waiter(lock);
+
+	/* Requeue the waiter */
+	list_del(&waiter->list_entry);
+	waiter->prio = task->prio;
+	rt_mutex_enqueue(lock, waiter);
+
+	/* Release the task */
+	spin_unlock_irqrestore(&task->pi_lock, flags);
+	put_task_struct(task);
+
+	/* Grab the next task */
+	task = lock->owner;
+	get_task_struct(task);
+	spin_lock_irqsave(&task->pi_lock, flags);
+
+	if (waiter == rt_mutex_top_waiter(lock)) {
+		/* Boost the owner */
+		list_del(&top_waiter->pi_list_entry);
+		rt_mutex_enqueue_pi(task, waiter);
+		__rt_mutex_adjust_prio(task);
+
+	} else if (top_waiter == waiter) {
+		/* Deboost the owner */
+		list_del(&waiter->pi_list_entry);
+		waiter = rt_mutex_top_waiter(lock);
+		rt_mutex_enqueue_pi(task, waiter);
+		__rt_mutex_adjust_prio(task);
+	}
+
+	spin_unlock_irqrestore(&task->pi_lock, flags);
+
+	top_waiter = rt_mutex_top_waiter(lock);
+	spin_unlock(&lock->wait_lock);
+
+	if (!deadlock_detect && waiter != top_waiter)
+		goto out_put_task;
+
+	goto again;
+
+ out_unlock_pi:
+	spin_unlock_irqrestore(&task->pi_lock, flags);
+ out_put_task:
+	put_task_struct(task);
+
+	return ret;
+}
+
+/*
+ * Try to take an rt-mutex
+ *
+ * Must be called with lock->wait_lock held. As the lock is handed over
+ * to the top waiter on unlock, a free lock never has waiters and
+ * current's pi_waiters do not change.
+ */
+static inline int try_to_take_rt_mutex(struct rt_mutex *lock)
+{
+	if (lock->owner)
+		return 0;
+
+	lock->owner = current;
+	return 1;
+}
+
+/*
+ * Task blocks on lock.
+ *
+ * Prepare waiter and propagate pi chain
+ *
+ * This must be called with lock->wait_lock held.
+ */
+static int task_blocks_on_rt_mutex(struct rt_mutex *lock,
+				   struct rt_mutex_waiter *waiter,
+				   int detect_deadlock)
+{
+	struct task_struct *owner = lock->owner;
+	struct rt_mutex_waiter *top_waiter = waiter;
+	unsigned long flags;
+	int boost = 0, res;
+
+	spin_lock_irqsave(&current->pi_lock, flags);
+	__rt_mutex_adjust_prio(current);
+	waiter->task = current;
+	waiter->lock = lock;
+	waiter->prio = current->prio;
+
+	/* Get the top priority waiter on the lock */
+	if (rt_mutex_has_waiters(lock))
+		top_waiter = rt_mutex_top_waiter(lock);
+	rt_mutex_enqueue(lock, waiter);
+
+	current->pi_blocked_on = waiter;
+
+	spin_unlock_irqrestore(&current->pi_lock, flags);
+
+	if (waiter == rt_mutex_top_waiter(lock)) {
+		spin_lock_irqsave(&owner->pi_lock, flags);
+		if (top_waiter != waiter)
+			list_del(&top_waiter->pi_list_entry);
+		rt_mutex_enqueue_pi(owner, waiter);
+
+		__rt_mutex_adjust_prio(owner);
+		if (owner->pi_blocked_on)
+			boost = 1;
+		spin_unlock_irqrestore(&owner->pi_lock, flags);
+	}
+
+	if (!boost && !detect_deadlock)
+		return 0;
+
+	/*
+	 * The owner can't disappear while holding a lock,
+	 * so the owner struct is protected by wait_lock.
+	 * Gets dropped in rt_mutex_adjust_prio_chain()!
+	 */
+	get_task_struct(owner);
+
+	spin_unlock(&lock->wait_lock);
+
+	res = rt_mutex_adjust_prio_chain(owner, detect_deadlock, lock, waiter,
+					 current);
+
+	spin_lock(&lock->wait_lock);
+
+	return res;
+}
+
+/*
+ * Hand the lock over to the top waiter and wake it up.
+ *
+ * Called with lock->wait_lock held.
+ */
+static void wakeup_next_waiter(struct rt_mutex *lock)
+{
+	struct task_struct *owner = lock->owner, *next;
+	struct rt_mutex_waiter *waiter;
+	unsigned long flags;
+
+	waiter = rt_mutex_top_waiter(lock);
+	next = waiter->task;
+	list_del(&waiter->list_entry);
+
+	/*
+	 * Remove it from the old owner's pi_waiters, the new top
+	 * waiter (if any) boosts the new owner below:
+	 */
+	spin_lock_irqsave(&owner->pi_lock, flags);
+	list_del(&waiter->pi_list_entry);
+	spin_unlock_irqrestore(&owner->pi_lock, flags);
+
+	spin_lock_irqsave(&next->pi_lock, flags);
+	lock->owner = next;
+	waiter->task = NULL;
+	next->pi_blocked_on = NULL;
+	if (rt_mutex_has_waiters(lock)) {
+		rt_mutex_enqueue_pi(next, rt_mutex_top_waiter(lock));
+		__rt_mutex_adjust_prio(next);
+	}
+	spin_unlock_irqrestore(&next->pi_lock, flags);
+
+	wake_up_process(next);
+}
+
+/*
+ * Remove a waiter from a lock
+ *
+ * Must be called with lock->wait_lock held and only if the lock was
+ * not handed over to current.
+ */
+static void remove_waiter(struct rt_mutex *lock,
+			  struct rt_mutex_waiter *waiter)
+{
+	int first = (waiter == rt_mutex_top_waiter(lock));
+	struct task_struct *owner = lock->owner;
+	unsigned long flags;
+	int chain_walk = 0;
+
+	spin_lock_irqsave(&current->pi_lock, flags);
+	list_del(&waiter->list_entry);
+	waiter->task = NULL;
+	current->pi_blocked_on = NULL;
+	spin_unlock_irqrestore(&current->pi_lock, flags);
+
+	if (first) {
+		spin_lock_irqsave(&owner->pi_lock, flags);
+
+		list_del(&waiter->pi_list_entry);
+
+		if (rt_mutex_has_waiters(lock))
+			rt_mutex_enqueue_pi(owner, rt_mutex_top_waiter(lock));
+
+		__rt_mutex_adjust_prio(owner);
+
+		if (owner->pi_blocked_on)
+			chain_walk = 1;
+
+		spin_unlock_irqrestore(&owner->pi_lock, flags);
+	}
+
+	if (!chain_walk)
+		return;
+
+	/* gets dropped in rt_mutex_adjust_prio_chain()! */
+	get_task_struct(owner);
+
+	spin_unlock(&lock->wait_lock);
+
+	rt_mutex_adjust_prio_chain(owner, 0, lock, NULL, current);
+
+	spin_lock(&lock->wait_lock);
+}
+
+/*
+ * Recheck the pi chain, in case we got a priority setting
+ *
+ * Called from sched_setscheduler
+ */
+void rt_mutex_adjust_pi(struct task_struct *task)
+{
+	struct rt_mutex_waiter *waiter;
+	unsigned long flags;
+
+	spin_lock_irqsave(&task->pi_lock, flags);
+
+	waiter = task->pi_blocked_on;
+	if (!waiter || waiter->prio == task->prio) {
+		spin_unlock_irqrestore(&task->pi_lock, flags);
+		return;
+	}
+
+	/* gets dropped in rt_mutex_adjust_prio_chain()! */
+	get_task_struct(task);
+	spin_unlock_irqrestore(&task->pi_lock, flags);
+
+	rt_mutex_adjust_prio_chain(task, 0, NULL, NULL, task);
+}
+
+/*
+ * Slow path lock function:
+ */
+static int __sched
+rt_mutex_slowlock(struct rt_mutex *lock, int state, long timeout,
+		  int detect_deadlock)
+{
+	struct rt_mutex_waiter waiter;
+	int ret;
+
+	spin_lock(&lock->wait_lock);
+
+	/* Try to acquire the lock again: */
+	if (try_to_take_rt_mutex(lock)) {
+		spin_unlock(&lock->wait_lock);
+		return 0;
+	}
+
+	set_current_state(state);
+
+	ret = task_blocks_on_rt_mutex(lock, &waiter, detect_deadlock);
+
+	for (;;) {
+		/*
+		 * The lock is handed over to us by the owner - this can
+		 * even have happened while task_blocks_on_rt_mutex()
+		 * walked the chain:
+		 */
+		if (lock->owner == current) {
+			ret = 0;
+			break;
+		}
+		if (unlikely(ret))
+			break;
+
+		/*
+		 * TASK_INTERRUPTIBLE checks for signals and
+		 * timeout. Ignored otherwise.
+		 */
+		if (state == TASK_INTERRUPTIBLE) {
+			if (signal_pending(current)) {
+				ret = -EINTR;
+				break;
+			}
+			if (!timeout) {
+				ret = -ETIMEDOUT;
+				break;
+			}
+		}
+
+		spin_unlock(&lock->wait_lock);
+
+		timeout = schedule_timeout(timeout);
+
+		spin_lock(&lock->wait_lock);
+		set_current_state(state);
+	}
+
+	set_current_state(TASK_RUNNING);
+
+	if (unlikely(lock->owner != current))
+		remove_waiter(lock, &waiter);
+
+	spin_unlock(&lock->wait_lock);
+
+	return ret;
+}
+
+/*
+ * Slow path to release a rt-mutex:
+ */
+static void __sched
+rt_mutex_slowunlock(struct rt_mutex *lock)
+{
+	spin_lock(&lock->wait_lock);
+
+	if (!rt_mutex_has_waiters(lock)) {
+		lock->owner = NULL;
+		spin_unlock(&lock->wait_lock);
+		return;
+	}
+
+	wakeup_next_waiter(lock);
+
+	spin_unlock(&lock->wait_lock);
+
+	/* Undo pi boosting if necessary: */
+	rt_mutex_adjust_prio(current);
+}
+
+/**
+ * rt_mutex_lock - lock a rt_mutex
+ *
+ * @lock: the rt_mutex to be locked
+ */
+void __sched rt_mutex_lock(struct rt_mutex *lock)
+{
+	might_sleep();
+
+	rt_mutex_slowlock(lock, TASK_UNINTERRUPTIBLE, MAX_SCHEDULE_TIMEOUT, 0);
+}
+EXPORT_SYMBOL_GPL(rt_mutex_lock);
+
+/**
+ * rt_mutex_lock_interruptible - lock a rt_mutex interruptible
+ *
+ * @lock: 		the rt_mutex to be locked
+ * @detect_deadlock:	deadlock detection on/off
+ *
+ * Returns:
+ *  0 		on success
+ * -EINTR 	when interrupted by a signal
+ * -EDEADLK	when the lock would deadlock (when deadlock detection is on)
+ */
+int __sched rt_mutex_lock_interruptible(struct rt_mutex *lock,
+					int detect_deadlock)
+{
+	might_sleep();
+
+	return rt_mutex_slowlock(lock, TASK_INTERRUPTIBLE,
+				 MAX_SCHEDULE_TIMEOUT, detect_deadlock);
+}
+EXPORT_SYMBOL_GPL(rt_mutex_lock_interruptible);
+
+/**
+ * rt_mutex_timed_lock - lock a rt_mutex interruptible
+ *			the timeout structure is provided
+ *			by the caller
+ *
+ * @lock: 		the rt_mutex to be locked
+ * @timeout:		timeout in jiffies, MAX_SCHEDULE_TIMEOUT for none
+ * @detect_deadlock:	deadlock detection on/off
+ *
+ * Returns:
+ *  0 		on success
+ * -EINTR 	when interrupted by a signal
+ * -ETIMEDOUT	when the timeout expired
+ * -EDEADLK	when the lock would deadlock (when deadlock detection is on)
+ */
+int __sched rt_mutex_timed_lock(struct rt_mutex *lock, long timeout,
+				int detect_deadlock)
+{
+	might_sleep();
+
+	return rt_mutex_slowlock(lock, TASK_INTERRUPTIBLE, timeout,
+				 detect_deadlock);
+}
+EXPORT_SYMBOL_GPL(rt_mutex_timed_lock);
+
+/**
+ * rt_mutex_trylock - try to lock a rt_mutex
+ *
+ * @lock:	the rt_mutex to be locked
+ *
+ * Returns 1 on success and 0 on contention
+ */
+int __sched rt_mutex_trylock(struct rt_mutex *lock)
+{
+	int ret;
+
+	spin_lock(&lock->wait_lock);
+	ret = try_to_take_rt_mutex(lock);
+	spin_unlock(&lock->wait_lock);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(rt_mutex_trylock);
+
+/**
+ * rt_mutex_unlock - unlock a rt_mutex
+ *
+ * @lock: the rt_mutex to be unlocked
+ */
+void __sched rt_mutex_unlock(struct rt_mutex *lock)
+{
+	rt_mutex_slowunlock(lock);
+}
+EXPORT_SYMBOL_GPL(rt_mutex_unlock);
+
+/**
+ * rt_mutex_init - initialize the rt lock
+ *
+ * @lock: the rt lock to be initialized
+ *
+ * Initialize the rt lock to unlocked state.
+ *
+ * Initializing of a locked rt lock is not allowed
+ */
+void rt_mutex_init(struct rt_mutex *lock)
+{
+	lock->owner = NULL;
+	spin_lock_init(&lock->wait_lock);
+	INIT_LIST_HEAD(&lock->wait_list);
+}
+EXPORT_SYMBOL_GPL(rt_mutex_init);
+
+/**
+ * rt_mutex_init_proxy_locked - initialize and lock a rt_mutex on behalf of a
+ *				proxy owner
+ *
+ * @lock: 	the rt_mutex to be locked
+ * @proxy_owner:the task to set as owner
+ *
+ * No locking. Caller has to do serializing itself
+ * Special API call for PI-futex support
+ */
+void rt_mutex_init_proxy_locked(struct rt_mutex *lock,
+				struct task_struct *proxy_owner)
+{
+	rt_mutex_init(lock);
+	lock->owner = proxy_owner;
+}
+
+/**
+ * rt_mutex_proxy_unlock - release a lock on behalf of owner
+ *
+ * @lock: 	the rt_mutex to be locked
+ *
+ * No locking. Caller has to do serializing itself
+ * Special API call for PI-futex support, only valid without waiters
+ */
+void rt_mutex_proxy_unlock(struct rt_mutex *lock,
+			   struct task_struct *proxy_owner)
+{
+	WARN_ON(rt_mutex_has_waiters(lock));
+	lock->owner = NULL;
+}
+
+/**
+ * rt_mutex_next_owner - return the next owner of the lock
+ *
+ * @lock: the rt lock query
+ *
+ * Returns the next owner of the lock or NULL
+ *
+ * Caller has to serialize against other accessors to the lock
+ * itself.
+ *
+ * Special API call for PI-futex support
+ */
+struct task_struct *rt_mutex_next_owner(struct rt_mutex *lock)
+{
+	if (!rt_mutex_has_waiters(lock))
+		return NULL;
+
+	return rt_mutex_top_waiter(lock)->task;
+}
@@ -0,0 +1,71 @@
+/*
+ * RT Mutexes: blocking mutual exclusion locks with priority inheritance
+ *
+ * This file contains the private data structure and API definitions.
+ */
+
+#ifndef __KERNEL_RTMUTEX_COMMON_H
+#define __KERNEL_RTMUTEX_COMMON_H
+
+#include <linux/rtmutex.h>
+
+/*
+ * This is the control structure for tasks blocked on a rt_mutex,
+ * which is allocated on the kernel stack of the blocked task.
+ *
+ * @list_entry:		entry on the lock's wait_list, sorted by @prio
+ * @pi_list_entry:	entry on the owner's pi_waiters, sorted by @pi_prio
+ * @task:		task reference to the blocked task, NULL once the
+ *			task got the lock handed over or gave up
+ * @lock:		the rt_mutex the task is blocked on
+ * @prio:		priority of @task when it was last (re)queued on the
+ *			lock, protected by lock->wait_lock
+ * @pi_prio:		snapshot of @prio used for the owner's pi_waiters,
+ *			protected by owner->pi_lock
+ */
+struct rt_mutex_waiter {
+	struct list_head	list_entry;
+	struct list_head	pi_list_entry;
+	struct task_struct	*task;
+	struct rt_mutex		*lock;
+	int			prio;
+	int			pi_prio;
+};
+
+/*
+ * Various helpers to access the waiters-list:
+ */
+static inline int rt_mutex_has_waiters(struct rt_mutex *lock)
+{
+	return !list_empty(&lock->wait_list);
+}
+
+static inline struct rt_mutex_waiter *
+rt_mutex_top_waiter(struct rt_mutex *lock)
+{
+	return list_entry(lock->wait_list.next, struct rt_mutex_waiter,
+			  list_entry);
+}
+
+static inline int task_has_pi_waiters(struct task_struct *p)
+{
+	return !list_empty(&p->pi_waiters);
+}
+
+static inline struct rt_mutex_waiter *
+task_top_pi_waiter(struct task_struct *p)
+{
+	return list_entry(p->pi_waiters.next, struct rt_mutex_waiter,
+			  pi_list_entry);
+}
+
+/*
+ * PI-futex support (proxy locking functions, etc.):
+ */
+extern struct task_struct *rt_mutex_next_owner(struct rt_mutex *lock);
+extern void rt_mutex_init_proxy_locked(struct rt_mutex *lock,
+				       struct task_struct *proxy_owner);
+extern void rt_mutex_proxy_unlock(struct rt_mutex *lock,
+				  struct task_struct *proxy_owner);
+
+#endif
@@ -45,11 +45,14 @@
 #include <linux/cpuset.h>
 #include <linux/percpu.h>
 #include <linux/kthread.h>
+#include <linux/workqueue.h>
+#include <linux/mutex.h>
 #include <linux/seq_file.h>
 #include <linux/syscalls.h>
 #include <linux/times.h>
 #include <linux/acct.h>
 #include <linux/kprobes.h>
+#include <linux/blkdev.h>
 #include <asm/tlb.h>
 
 #include <asm/unistd.h>
@@ -194,6 +197,21 @@ struct prio_array {
 	struct list_head queue[MAX_PRIO];
 };
 
+#ifdef CONFIG_SCHED_FAIR
+/*
+ * Timeline of the runnable SCHED_NORMAL/SCHED_BATCH tasks of a CPU,
+ * ordered by virtual runtime. RT tasks keep using the priority arrays.
+ */
+struct fair_rq {
+	struct rb_root tasks_timeline;
+	struct rb_node *rb_leftmost;
+	unsigned long nr_running;
+	unsigned long load;
+	unsigned long long min_vruntime;
+	unsigned long long exec_clock;
+};
+#endif
+
 /*
  * This is the main, per-CPU runqueue data structure.
  *
@@ -230,6 +248,10 @@ struct runqueue {
 	int best_expired_prio;
 	atomic_t nr_iowait;
 
+#ifdef CONFIG_SCHED_FAIR
+	struct fair_rq fair;
+#endif
+
 #ifdef CONFIG_SMP
 	struct sched_domain *sd;
 
@@ -260,6 +282,13 @@ struct runqueue {
 	/* try_to_wake_up() stats */
 	unsigned long ttwu_cnt;
 	unsigned long ttwu_local;
+
+	/* wakeup placement stats */
+	unsigned long ttwu_wake_wide;
+	unsigned long ttwu_affine_hot;
+	unsigned long ttwu_idle_prev;
+	unsigned long ttwu_idle_sibling;
+	unsigned long ttwu_cross_llc;
 #endif
 };
 
@@ -350,6 +379,25 @@ static inline void finish_lock_switch(runqueue_t *rq, task_t *prev)
 }
 #endif /* __ARCH_WANT_UNLOCKED_CTXSW */
 
+/*
+ * __task_rq_lock - lock the runqueue a given task resides on.
+ * Must be called interrupts disabled.
+ */
+static inline runqueue_t *__task_rq_lock(task_t *p)
+	__acquires(rq->lock)
+{
+	struct runqueue *rq;
+
+repeat_lock_task:
+	rq = task_rq(p);
+	spin_lock(&rq->lock);
+	if (unlikely(rq != task_rq(p))) {
+		spin_unlock(&rq->lock);
+		goto repeat_lock_task;
+	}
+	return rq;
+}
+
 /*
  * task_rq_lock - lock the runqueue a given task resides on and disable
  * interrupts.  Note the ordering: we can safely lookup the task_rq without
@@ -371,6 +419,12 @@ repeat_lock_task:
 	return rq;
 }
 
+static inline void __task_rq_unlock(runqueue_t *rq)
+	__releases(rq->lock)
+{
+	spin_unlock(&rq->lock);
+}
+
 static inline void task_rq_unlock(runqueue_t *rq, unsigned long *flags)
 	__releases(rq->lock)
 {
@@ -382,7 +436,7 @@ static inline void task_rq_unlock(runqueue_t *rq, unsigned long *flags)
  * bump this up when changing the output format or the meaning of an existing
  * format, so that tools can adapt (or abort)
  */
-#define SCHEDSTAT_VERSION 12
+#define SCHEDSTAT_VERSION 13
 
 static int show_schedstat(struct seq_file *seq, void *v)
 {
@@ -406,6 +460,10 @@ static int show_schedstat(struct seq_file *seq, void *v)
 		    rq->ttwu_cnt, rq->ttwu_local,
 		    rq->rq_sched_info.cpu_time,
 		    rq->rq_sched_info.run_delay, rq->rq_sched_info.pcnt);
+		seq_printf(seq, " %lu %lu %lu %lu %lu",
+		    rq->ttwu_wake_wide, rq->ttwu_affine_hot,
+		    rq->ttwu_idle_prev, rq->ttwu_idle_sibling,
+		    rq->ttwu_cross_llc);
 
 		seq_printf(seq, "\n");
 
@@ -596,11 +654,853 @@ static inline void sched_info_switch(task_t *prev, task_t *next)
 #define sched_info_switch(t, next)	do { } while (0)
 #endif /* CONFIG_SCHEDSTATS */
 
+#ifdef CONFIG_SCHED_LATENCY_HIST
+/*
+ * Scheduling latency histograms. A sample of n nanoseconds is counted
+ * in bucket fls64(n >> 10): bucket 0 is below ~1us, bucket k holds
+ * [2^(k-1), 2^k) units of 1024ns, the last bucket is open-ended. Every
+ * sample goes into the task's histogram and into that of the CPU it
+ * was taken on. All of them are only written under the runqueue lock
+ * of that CPU; readers do not lock and may see slightly stale counts.
+ */
+#define SCHEDLAT_WOKEN		1
+#define SCHEDLAT_PREEMPTED	2
+
+struct rq_schedlat {
+	struct schedlat_hist hist[SCHEDLAT_NR];
+	struct schedlat_hist depth;	/* runqueue length seen by wakeups */
+};
+
+static DEFINE_PER_CPU(struct rq_schedlat, rq_schedlat);
+
+static inline void schedlat_account(task_t *p, int cpu,
+				    enum schedlat_type type,
+				    unsigned long long delta)
+{
+	int idx;
+
+	if (unlikely((long long)delta < 0))
+		delta = 0;
+	idx = log2_bucket(delta >> 10, SCHEDLAT_BUCKETS);
+	p->schedlat[type].count[idx]++;
+	per_cpu(rq_schedlat, cpu).hist[type].count[idx]++;
+}
+
+/*
+ * p is being woken up onto rq, its wakeup latency starts now:
+ */
+static inline void schedlat_wakeup(task_t *p, runqueue_t *rq)
+{
+	int idx = log2_bucket(rq->nr_running, SCHEDLAT_BUCKETS);
+
+	p->schedlat_flags = SCHEDLAT_WOKEN;
+	per_cpu(rq_schedlat, task_cpu(p)).depth.count[idx]++;
+}
+
+/*
+ * prev leaves the CPU, next gets it. p->timestamp is the time of the
+ * last wakeup or switch of the task:
+ */
+static void schedlat_switch(runqueue_t *rq, task_t *prev, task_t *next,
+			    unsigned long long now)
+{
+	int cpu = task_cpu(prev);
+
+	if (prev == next)
+		return;
+
+	if (prev != rq->idle) {
+		schedlat_account(prev, cpu, SCHEDLAT_SLICE,
+				 now - prev->timestamp);
+		/* still runnable: it was preempted (or yielded) */
+		if (prev->array)
+			prev->schedlat_flags = SCHEDLAT_PREEMPTED;
+	}
+
+	if (next != rq->idle && next->schedlat_flags) {
+		schedlat_account(next, cpu,
+				 next->schedlat_flags & SCHEDLAT_WOKEN ?
+					SCHEDLAT_WAKEUP : SCHEDLAT_PREEMPT,
+				 now - next->timestamp);
+		next->schedlat_flags = 0;
+	}
+}
+
+static const char *schedlat_names[SCHEDLAT_NR] = {
+	[SCHEDLAT_WAKEUP]	= "wakeup",
+	[SCHEDLAT_SLICE]	= "slice",
+	[SCHEDLAT_PREEMPT]	= "preempt",
+};
+
+#define SCHEDLAT_VERSION 1
+
+static void schedlat_show_hist(struct seq_file *seq, const char *prefix,
+			       const char *name, struct schedlat_hist *hist)
+{
+	seq_printf(seq, "%s%s", prefix, name);
+	seq_put_hist(seq, hist->count, SCHEDLAT_BUCKETS);
+}
+
+static int show_schedlat(struct seq_file *seq, void *v)
+{
+	char prefix[16];
+	int cpu, type;
+
+	seq_printf(seq, "version %d\n", SCHEDLAT_VERSION);
+	seq_printf(seq, "buckets %d\n", SCHEDLAT_BUCKETS);
+	for_each_online_cpu(cpu) {
+		struct rq_schedlat *stat = &per_cpu(rq_schedlat, cpu);
+
+		snprintf(prefix, sizeof(prefix), "cpu%d ", cpu);
+		for (type = 0; type < SCHEDLAT_NR; type++)
+			schedlat_show_hist(seq, prefix, schedlat_names[type],
+					   &stat->hist[type]);
+		schedlat_show_hist(seq, prefix, "depth", &stat->depth);
+	}
+	return 0;
+}
+
+DEFINE_SEQ_STAT_FILE(schedlat);
+
+int proc_pid_schedlat(struct task_struct *p, char *buffer)
+{
+	char *s = buffer;
+	int type, i;
+
+	for (type = 0; type < SCHEDLAT_NR; type++) {
+		s += sprintf(s, "%s", schedlat_names[type]);
+		for (i = 0; i < SCHEDLAT_BUCKETS; i++)
+			s += sprintf(s, " %u", p->schedlat[type].count[i]);
+		*s++ = '\n';
+	}
+	s += sprintf(s, "migrations %lu\n", p->nr_migrations);
+	return s - buffer;
+}
+#else
+static inline void schedlat_wakeup(task_t *p, runqueue_t *rq)
+{
+}
+
+static inline void schedlat_switch(runqueue_t *rq, task_t *prev,
+				   task_t *next, unsigned long long now)
+{
+}
+#endif /* CONFIG_SCHED_LATENCY_HIST */
+
+#ifdef CONFIG_SCHED_FAIR
+/*
+ * Fair virtual-runtime scheduling of SCHED_NORMAL and SCHED_BATCH tasks.
+ *
+ * Instead of the active/expired arrays and the sleep_avg interactivity
+ * estimator, every non-RT task accumulates virtual runtime: the time it
+ * spent on the CPU, scaled down by its nice-level weight. Runnable tasks
+ * sit in a per-runqueue rbtree ordered by vruntime and the leftmost (the
+ * one that got the least service) runs next. RT tasks still live in the
+ * priority arrays and always run before any fair task.
+ *
+ * Each runnable fair task gets a turn within sysctl_sched_latency, but
+ * never less than sysctl_sched_min_granularity at a time - with more
+ * tasks than that allows the period is stretched instead.
+ *
+ * While a task is queued on a timeline its vruntime is absolute; when it
+ * is off the timeline (sleeping, RT, being migrated) it is kept relative
+ * to the min_vruntime of the runqueue it left, so it can be placed on
+ * any CPU's timeline later on.
+ */
+unsigned int sysctl_sched_latency = 20000000;		/* 20 msec */
+unsigned int sysctl_sched_min_granularity = 4000000;	/* 4 msec */
+unsigned int sysctl_sched_wakeup_granularity = 5000000;	/* 5 msec */
+
+#define NICE_0_LOAD		1024
+
+/*
+ * Nice levels are multiplicative, with a gentle 10% change for every
+ * nice level changed: a CPU-bound task going from nice 0 to nice 1 gets
+ * ~10% less CPU time than a CPU-bound task that remains on nice 0. The
+ * ratio between neighbouring weights is ~1.25.
+ */
+static const unsigned long prio_to_weight[40] = {
+ /* -20 */     88761,     71755,     56483,     46273,     36291,
+ /* -15 */     29154,     23254,     18705,     14949,     11916,
+ /* -10 */      9548,      7620,      6100,      4904,      3906,
+ /*  -5 */      3121,      2501,      1991,      1586,      1277,
+ /*   0 */      1024,       820,       655,       526,       423,
+ /*   5 */       335,       272,       215,       172,       137,
+ /*  10 */       110,        87,        70,        56,        45,
+ /*  15 */        36,        29,        23,        18,        15,
+};
+
+#define fair_task(p)		(!rt_task(p))
+
+static inline unsigned long task_load_weight(task_t *p)
+{
+	return prio_to_weight[TASK_USER_PRIO(p)];
+}
+
+/*
+ * Scale a real time delta into virtual time for a given load weight:
+ * heavier tasks advance their vruntime more slowly.
+ */
+static inline unsigned long long
+calc_delta_fair(unsigned long long delta, unsigned long weight)
+{
+	if (likely(weight == NICE_0_LOAD))
+		return delta;
+	delta *= NICE_0_LOAD;
+	do_div(delta, weight);
+	return delta;
+}
+
+#ifdef CONFIG_FAIR_GROUP_SCHED
+/*
+ * Group scheduling. Every cpuset but the top one carries a task_group;
+ * tasks of the top cpuset are scheduled at the root level. On every CPU
+ * where a group has runnable tasks it competes with its siblings with
+ * the weight tg->shares, no matter how many tasks it has there, and
+ * splits that weight among its own tasks and child groups.
+ *
+ * The timeline stays flat: a task's vruntime is charged with its
+ * effective weight - its own weight scaled by weight/load of every
+ * group above it - so all tasks of a group together advance like one
+ * entity of the group's weight, and rq->fair.load is the load of the
+ * root level only.
+ *
+ * A group can also be limited to tg->quota ns of CPU time per
+ * tg->period ns, summed over all CPUs. CPUs draw runtime from the
+ * group's pool in slices; a CPU that finds the pool empty throttles
+ * the group: its tasks stay on the timeline but are skipped until the
+ * period timer refills the pool.
+ *
+ * Lock order: rq->lock nests outside tg->lock.
+ */
+#define MIN_SHARES		2
+#define MAX_SHARES		(1UL << 18)
+#define DEF_BANDWIDTH_PERIOD	100000000LL	/* 100 msec */
+#define BANDWIDTH_SLICE		5000000LL	/* 5 msec */
+
+struct task_group_cpu {
+	unsigned long nr_running;	/* queued tasks and child groups */
+	unsigned long load;		/* their summed weight */
+	unsigned long weight;		/* our weight in the parent */
+	long long runtime_remaining;	/* bandwidth drawn from the pool */
+	int throttled;
+	unsigned long long usage;	/* CPU time consumed, in ns */
+};
+
+struct task_group {
+	struct task_group *parent;
+	unsigned long shares;
+	struct task_group_cpu *cpu_data;	/* alloc_percpu() */
+
+	spinlock_t lock;		/* protects the fields below */
+	long long quota;		/* ns per period, < 0: unlimited */
+	long long period;
+	long long runtime;		/* left in the current period */
+	struct timer_list period_timer;
+	unsigned long nr_periods;
+	unsigned long nr_throttled;
+};
+
+static inline struct task_group_cpu *tg_cpu(struct task_group *tg, int cpu)
+{
+	return per_cpu_ptr(tg->cpu_data, cpu);
+}
+
+/*
+ * p gets queued: add its weight to its group on this CPU, and if the
+ * group was idle here, the group's weight to its parent and so on up.
+ */
+static void enqueue_group_load(runqueue_t *rq, task_t *p)
+{
+	unsigned long weight = p->load_weight;
+	struct task_group *tg;
+	int cpu = task_cpu(p);
+
+	for (tg = p->task_group; tg; tg = tg->parent) {
+		struct task_group_cpu *tgc = tg_cpu(tg, cpu);
+
+		tgc->load += weight;
+		if (tgc->nr_running++)
+			return;
+		tgc->weight = tg->shares;
+		weight = tgc->weight;
+	}
+	rq->fair.load += weight;
+}
+
+static void dequeue_group_load(runqueue_t *rq, task_t *p)
+{
+	unsigned long weight = p->load_weight;
+	struct task_group *tg;
+	int cpu = task_cpu(p);
+
+	for (tg = p->task_group; tg; tg = tg->parent) {
+		struct task_group_cpu *tgc = tg_cpu(tg, cpu);
+
+		tgc->load -= weight;
+		if (--tgc->nr_running)
+			return;
+		weight = tgc->weight;
+	}
+	rq->fair.load -= weight;
+}
+
+/*
+ * The weight p has at the root level of its CPU:
+ */
+static unsigned long task_fair_weight(task_t *p)
+{
+	unsigned long long weight = p->load_weight;
+	struct task_group *tg;
+	int cpu = task_cpu(p);
+
+	for (tg = p->task_group; tg; tg = tg->parent) {
+		struct task_group_cpu *tgc = tg_cpu(tg, cpu);
+
+		if (!tgc->nr_running) {
+			/* not queued, assume it would be alone */
+			weight = tg->shares;
+			continue;
+		}
+		weight *= tgc->weight;
+		do_div(weight, tgc->load);
+	}
+	return weight ? (unsigned long)weight : 1;
+}
+
+/*
+ * The weight p, not queued yet, will have at the root level of its CPU
+ * once it is, and in *root_load what it will add to rq->fair.load: its
+ * top group's shares if that group isn't runnable there yet, else 0.
+ */
+static unsigned long task_fair_new_weight(task_t *p, unsigned long *root_load)
+{
+	unsigned long long weight = p->load_weight;
+	unsigned long add = p->load_weight;
+	struct task_group *tg;
+	int cpu = task_cpu(p);
+
+	for (tg = p->task_group; tg; tg = tg->parent) {
+		struct task_group_cpu *tgc = tg_cpu(tg, cpu);
+
+		if (!tgc->nr_running) {
+			/* p will be alone in it */
+			weight = tg->shares;
+			add = tg->shares;
+			continue;
+		}
+		weight *= tgc->weight;
+		do_div(weight, tgc->load + add);
+		add = 0;
+	}
+	*root_load = add;
+	return weight ? (unsigned long)weight : 1;
+}
+
+static int task_throttled(task_t *p)
+{
+	struct task_group *tg;
+	int cpu = task_cpu(p);
+
+	for (tg = p->task_group; tg; tg = tg->parent)
+		if (tg_cpu(tg, cpu)->throttled)
+			return 1;
+	return 0;
+}
+
+/*
+ * Charge delta_exec of CPU time to the groups of the running task p and
+ * draw bandwidth for it. Returns 1 if p can't continue because one of
+ * its groups got throttled on this CPU.
+ */
+static int account_group_exec(task_t *p, unsigned long long delta_exec)
+{
+	struct task_group *tg;
+	int cpu = task_cpu(p), throttled = 0;
+
+	for (tg = p->task_group; tg; tg = tg->parent) {
+		struct task_group_cpu *tgc = tg_cpu(tg, cpu);
+		long long amount;
+
+		tgc->usage += delta_exec;
+		if (tg->quota < 0)
+			continue;
+
+		tgc->runtime_remaining -= delta_exec;
+		if (tgc->runtime_remaining > 0)
+			continue;
+
+		spin_lock(&tg->lock);
+		if (tg->quota >= 0) {
+			amount = BANDWIDTH_SLICE - tgc->runtime_remaining;
+			if (amount > tg->runtime)
+				amount = tg->runtime;
+			tg->runtime -= amount;
+			tgc->runtime_remaining += amount;
+			if (tgc->runtime_remaining <= 0 && !tgc->throttled) {
+				tgc->throttled = 1;
+				tg->nr_throttled++;
+			}
+		} else
+			tgc->runtime_remaining = 0;
+		spin_unlock(&tg->lock);
+
+		throttled |= tgc->throttled;
+	}
+	return throttled;
+}
+
+/*
+ * Pull tasks of groups that have more runnable entities on src_cpu than
+ * on this_cpu first, so that groups get spread over the CPUs:
+ */
+static int group_prefers_move(task_t *p, int src_cpu, int this_cpu)
+{
+	struct task_group *tg = p->task_group;
+
+	if (!tg)
+		return 1;
+	return tg_cpu(tg, src_cpu)->nr_running >
+				tg_cpu(tg, this_cpu)->nr_running + 1;
+}
+#else
+static inline void enqueue_group_load(runqueue_t *rq, task_t *p)
+{
+	rq->fair.load += p->load_weight;
+}
+
+static inline void dequeue_group_load(runqueue_t *rq, task_t *p)
+{
+	rq->fair.load -= p->load_weight;
+}
+
+static inline unsigned long task_fair_weight(task_t *p)
+{
+	return p->load_weight;
+}
+
+static inline unsigned long task_fair_new_weight(task_t *p,
+						 unsigned long *root_load)
+{
+	*root_load = p->load_weight;
+	return p->load_weight;
+}
+
+static inline int task_throttled(task_t *p)
+{
+	return 0;
+}
+
+static inline int account_group_exec(task_t *p,
+				     unsigned long long delta_exec)
+{
+	return 0;
+}
+
+static inline int group_prefers_move(task_t *p, int src_cpu, int this_cpu)
+{
+	return 1;
+}
+#endif /* CONFIG_FAIR_GROUP_SCHED */
+
+static inline long long fair_key(struct fair_rq *fair_rq, task_t *p)
+{
+	return (long long)(p->vruntime - fair_rq->min_vruntime);
+}
+
+static void __enqueue_fair(struct fair_rq *fair_rq, task_t *p)
+{
+	struct rb_node **link = &fair_rq->tasks_timeline.rb_node;
+	struct rb_node *parent = NULL;
+	long long key = fair_key(fair_rq, p);
+	int leftmost = 1;
+
+	while (*link) {
+		task_t *entry;
+
+		parent = *link;
+		entry = rb_entry(parent, task_t, run_node);
+		/*
+		 * Tasks with equal keys go to the right, so they are
+		 * served in FIFO order:
+		 */
+		if (key < fair_key(fair_rq, entry))
+			link = &parent->rb_left;
+		else {
+			link = &parent->rb_right;
+			leftmost = 0;
+		}
+	}
+
+	if (leftmost)
+		fair_rq->rb_leftmost = &p->run_node;
+
+	rb_link_node(&p->run_node, parent, link);
+	rb_insert_color(&p->run_node, &fair_rq->tasks_timeline);
+}
+
+static void __dequeue_fair(struct fair_rq *fair_rq, task_t *p)
+{
+	if (fair_rq->rb_leftmost == &p->run_node)
+		fair_rq->rb_leftmost = rb_next(&p->run_node);
+	rb_erase(&p->run_node, &fair_rq->tasks_timeline);
+}
+
+static inline task_t *__first_fair(struct fair_rq *fair_rq)
+{
+	struct rb_node *left = fair_rq->rb_leftmost;
+
+	if (!left)
+		return NULL;
+	return rb_entry(left, task_t, run_node);
+}
+
+static inline task_t *__last_fair(struct fair_rq *fair_rq)
+{
+	struct rb_node *last = rb_last(&fair_rq->tasks_timeline);
+
+	if (!last)
+		return NULL;
+	return rb_entry(last, task_t, run_node);
+}
+
+/*
+ * min_vruntime only ever moves forward, it tracks the leftmost task:
+ */
+static inline void update_min_vruntime(struct fair_rq *fair_rq)
+{
+	task_t *first = __first_fair(fair_rq);
+
+	if (first && fair_key(fair_rq, first) > 0)
+		fair_rq->min_vruntime = first->vruntime;
+}
+
+/*
+ * The period in which every runnable fair task gets to run once:
+ */
+static unsigned long long sched_period(unsigned long nr_running)
+{
+	unsigned long long period = sysctl_sched_latency;
+	unsigned long nr_latency;
+
+	nr_latency = sysctl_sched_latency / sysctl_sched_min_granularity;
+	if (unlikely(nr_running > nr_latency))
+		period = (unsigned long long)sysctl_sched_min_granularity *
+								nr_running;
+	return period;
+}
+
+/*
+ * The wall-time slice of the period that p is entitled to:
+ */
+static unsigned long long sched_slice(struct fair_rq *fair_rq, task_t *p)
+{
+	unsigned long long slice = sched_period(fair_rq->nr_running);
+
+	if (fair_rq->load) {
+		slice *= task_fair_weight(p);
+		do_div(slice, fair_rq->load);
+	}
+	return slice;
+}
+
+static inline void fair_wait_start(task_t *p, unsigned long long now)
+{
+	p->wait_start = now;
+}
+
+static void fair_wait_end(task_t *p, unsigned long long now)
+{
+	unsigned long long delta;
+
+	if (!p->wait_start)
+		return;
+	delta = now - p->wait_start;
+	if (unlikely((long long)delta < 0))
+		delta = 0;
+	p->sum_wait_runtime += delta;
+	if (delta > p->wait_max)
+		p->wait_max = delta;
+	p->wait_start = 0;
+}
+
+static void enqueue_task_fair(task_t *p, prio_array_t *array)
+{
+	runqueue_t *rq = task_rq(p);
+
+	sched_info_queued(p);
+	p->load_weight = task_load_weight(p);
+	__enqueue_fair(&rq->fair, p);
+	rq->fair.nr_running++;
+	enqueue_group_load(rq, p);
+	if (p != rq->curr && !p->wait_start)
+		fair_wait_start(p, sched_clock());
+	p->array = array;
+}
+
+static void dequeue_task_fair(task_t *p)
+{
+	runqueue_t *rq = task_rq(p);
+
+	__dequeue_fair(&rq->fair, p);
+	rq->fair.nr_running--;
+	dequeue_group_load(rq, p);
+	fair_wait_end(p, sched_clock());
+}
+
+/*
+ * Move a task behind every other task on the timeline (sched_yield):
+ */
+static void requeue_task_fair(task_t *p)
+{
+	struct fair_rq *fair_rq = &task_rq(p)->fair;
+	task_t *last = __last_fair(fair_rq);
+
+	__dequeue_fair(fair_rq, p);
+	if (last != p && (long long)(last->vruntime - p->vruntime) > 0)
+		p->vruntime = last->vruntime;
+	__enqueue_fair(fair_rq, p);
+}
+
+/*
+ * Charge the running task for the time it spent on the CPU since the
+ * last update. Must be called with the runqueue locked.
+ */
+static void update_curr_fair(runqueue_t *rq, unsigned long long now)
+{
+	task_t *curr = rq->curr;
+	unsigned long long delta_exec;
+
+	if (!fair_task(curr) || curr == rq->idle)
+		return;
+
+	delta_exec = now - curr->exec_start;
+	if (unlikely((long long)delta_exec <= 0))
+		return;
+	curr->exec_start = now;
+	curr->sum_exec_runtime += delta_exec;
+	rq->fair.exec_clock += delta_exec;
+
+	if (curr->array)
+		__dequeue_fair(&rq->fair, curr);
+	curr->vruntime += calc_delta_fair(delta_exec, task_fair_weight(curr));
+	if (curr->array)
+		__enqueue_fair(&rq->fair, curr);
+	update_min_vruntime(&rq->fair);
+
+	if (account_group_exec(curr, delta_exec))
+		set_tsk_need_resched(curr);
+}
+
+/*
+ * The leftmost task that is allowed to run, or NULL:
+ */
+static task_t *pick_next_fair(runqueue_t *rq)
+{
+	struct rb_node *node;
+
+	for (node = rq->fair.rb_leftmost; node; node = rb_next(node)) {
+		task_t *p = rb_entry(node, task_t, run_node);
+
+		if (!task_throttled(p))
+			return p;
+	}
+	return NULL;
+}
+
+/*
+ * Place a waking task on the timeline. Its vruntime is still relative
+ * to the runqueue it went to sleep on; min_vruntime kept advancing at
+ * roughly wall-time / load while it slept, so discount that, but never
+ * give a sleeper more than half a latency period of credit.
+ */
+static void place_task_fair(runqueue_t *rq, task_t *p,
+			    unsigned long long slept)
+{
+	long long thresh = sysctl_sched_latency / 2;
+	long long lag = (long long)p->vruntime;
+
+	if (unlikely((long long)slept < 0))
+		slept = 0;
+	/* ~18 minutes is as good as forever, and can't overflow below */
+	if (slept > (1ULL << 40))
+		slept = 1ULL << 40;
+
+	if (rq->fair.load) {
+		slept *= NICE_0_LOAD;
+		do_div(slept, rq->fair.load);
+		lag -= (long long)slept;
+	} else
+		lag = -thresh;
+
+	if (lag < -thresh)
+		lag = -thresh;
+	p->vruntime = (unsigned long long)lag;
+	p->nr_wakeups++;
+}
+
+/*
+ * New tasks start one virtual slice right of min_vruntime, so that a
+ * fork storm cannot starve the tasks that are already running. The
+ * slice is that of the weight the task will have within its groups:
+ */
+static void place_new_task_fair(runqueue_t *rq, task_t *p)
+{
+	unsigned long long slice;
+	unsigned long weight, root_load;
+
+	p->load_weight = task_load_weight(p);
+	weight = task_fair_new_weight(p, &root_load);
+	slice = sched_period(rq->fair.nr_running + 1);
+	slice *= weight;
+	do_div(slice, rq->fair.load + root_load);
+	p->vruntime = calc_delta_fair(slice, weight);
+}
+
+/*
+ * Child-runs-first: give the new child the smaller of the two vruntimes.
+ */
+static void child_runs_first_fair(runqueue_t *rq, task_t *p)
+{
+	task_t *curr = rq->curr;
+	unsigned long long tmp;
+
+	if (!fair_task(curr))
+		return;
+	update_curr_fair(rq, sched_clock());
+	if ((long long)(p->vruntime - curr->vruntime) <= 0)
+		return;
+
+	__dequeue_fair(&rq->fair, curr);
+	__dequeue_fair(&rq->fair, p);
+	tmp = curr->vruntime;
+	curr->vruntime = p->vruntime;
+	p->vruntime = tmp;
+	__enqueue_fair(&rq->fair, curr);
+	__enqueue_fair(&rq->fair, p);
+}
+
+/*
+ * A queued task moves from src_rq's timeline to dst_rq's: keep its
+ * distance to min_vruntime.
+ */
+static inline void migrate_vruntime(task_t *p, runqueue_t *src_rq,
+				    runqueue_t *dst_rq)
+{
+	if (fair_task(p))
+		p->vruntime += dst_rq->fair.min_vruntime -
+				src_rq->fair.min_vruntime;
+}
+
+/*
+ * The running fair task has used up its share of the period:
+ */
+static void fair_tick(runqueue_t *rq, task_t *curr, unsigned long long now)
+{
+	unsigned long long ran;
+
+	update_curr_fair(rq, now);
+	if (rq->fair.nr_running <= 1)
+		return;
+
+	ran = curr->sum_exec_runtime - curr->prev_sum_exec_runtime;
+	if (ran > sched_slice(&rq->fair, curr))
+		set_tsk_need_resched(curr);
+}
+
+/*
+ * Bookkeeping for prev leaving and next getting the CPU:
+ */
+static void fair_switch(runqueue_t *rq, task_t *prev, task_t *next,
+			unsigned long long now)
+{
+	if (prev != next && prev->array && fair_task(prev) &&
+							prev != rq->idle)
+		fair_wait_start(prev, now);
+
+	if (fair_task(next) && next != rq->idle) {
+		fair_wait_end(next, now);
+		next->exec_start = now;
+		next->prev_sum_exec_runtime = next->sum_exec_runtime;
+	}
+}
+
+/*
+ * Does a freshly woken (or migrated) task p deserve to preempt the task
+ * currently running on rq? Between two fair tasks this is decided on
+ * vruntime, with a wakeup granularity to avoid overscheduling. SCHED_BATCH
+ * tasks never preempt on wakeup.
+ */
+static int task_preempts_curr(task_t *p, runqueue_t *rq)
+{
+	task_t *curr = rq->curr;
+	unsigned long long gran;
+
+	if (rt_task(p) || rt_task(curr) || curr == rq->idle)
+		return TASK_PREEMPTS_CURR(p, rq);
+	if (batch_task(p) || task_throttled(p))
+		return 0;
+
+	gran = calc_delta_fair(sysctl_sched_wakeup_granularity,
+						task_fair_weight(curr));
+	return (long long)(curr->vruntime - p->vruntime) > (long long)gran;
+}
+
+static void init_fair_rq(struct fair_rq *fair_rq)
+{
+	fair_rq->tasks_timeline = RB_ROOT;
+	fair_rq->rb_leftmost = NULL;
+	fair_rq->nr_running = 0;
+	fair_rq->load = 0;
+	fair_rq->min_vruntime = 0;
+	fair_rq->exec_clock = 0;
+}
+
+int proc_pid_sched(struct task_struct *p, char *buffer)
+{
+	return sprintf(buffer,
+		"vruntime            %llu\n"
+		"sum_exec_runtime    %llu\n"
+		"sum_wait_runtime    %llu\n"
+		"wait_max            %llu\n"
+		"nr_wakeups          %lu\n"
+		"nr_switches         %lu\n"
+		"nr_voluntary        %lu\n"
+		"nr_involuntary      %lu\n"
+		"load_weight         %lu\n",
+		p->vruntime, p->sum_exec_runtime, p->sum_wait_runtime,
+		p->wait_max, p->nr_wakeups, p->nvcsw + p->nivcsw,
+		p->nvcsw, p->nivcsw, p->load_weight);
+}
+#else
+#define task_preempts_curr(p, rq)	TASK_PREEMPTS_CURR(p, rq)
+
+static inline void update_curr_fair(runqueue_t *rq, unsigned long long now)
+{
+}
+
+static inline void migrate_vruntime(task_t *p, runqueue_t *src_rq,
+				    runqueue_t *dst_rq)
+{
+}
+
+static inline void fair_switch(runqueue_t *rq, task_t *prev, task_t *next,
+			       unsigned long long now)
+{
+}
+#endif /* CONFIG_SCHED_FAIR */
+
 /*
  * Adding/removing a task to/from a priority array:
  */
 static void dequeue_task(struct task_struct *p, prio_array_t *array)
 {
+#ifdef CONFIG_SCHED_FAIR
+	if (fair_task(p)) {
+		dequeue_task_fair(p);
+		return;
+	}
+#endif
 	array->nr_active--;
 	list_del(&p->run_list);
 	if (list_empty(array->queue + p->prio))
@@ -609,6 +1509,12 @@ static void dequeue_task(struct task_struct *p, prio_array_t *array)
 
 static void enqueue_task(struct task_struct *p, prio_array_t *array)
 {
+#ifdef CONFIG_SCHED_FAIR
+	if (fair_task(p)) {
+		enqueue_task_fair(p, array);
+		return;
+	}
+#endif
 	sched_info_queued(p);
 	list_add_tail(&p->run_list, array->queue + p->prio);
 	__set_bit(p->prio, array->bitmap);
@@ -622,6 +1528,12 @@ static void enqueue_task(struct task_struct *p, prio_array_t *array)
  */
 static void requeue_task(struct task_struct *p, prio_array_t *array)
 {
+#ifdef CONFIG_SCHED_FAIR
+	if (fair_task(p)) {
+		requeue_task_fair(p);
+		return;
+	}
+#endif
 	list_move_tail(&p->run_list, array->queue + p->prio);
 }
 
@@ -634,7 +1546,7 @@ static inline void enqueue_task_head(struct task_struct *p, prio_array_t *array)
 }
 
 /*
- * effective_prio - return the priority that is based on the static
+ * __effective_prio - return the priority that is based on the static
  * priority but is modified by bonuses/penalties.
  *
  * We scale the actual sleep average [0 .... MAX_SLEEP_AVG]
@@ -647,12 +1559,14 @@ static inline void enqueue_task_head(struct task_struct *p, prio_array_t *array)
  *
  * Both properties are important to certain workloads.
  */
-static int effective_prio(task_t *p)
+static int __effective_prio(task_t *p)
 {
 	int bonus, prio;
 
-	if (rt_task(p))
-		return p->prio;
+#ifdef CONFIG_SCHED_FAIR
+	/* vruntime ordering takes care of sleepers, no bonus needed */
+	return p->static_prio;
+#endif
 
 	bonus = CURRENT_BONUS(p) - MAX_BONUS / 2;
 
@@ -664,6 +1578,30 @@ static int effective_prio(task_t *p)
 	return prio;
 }
 
+static int effective_prio(task_t *p)
+{
+	/* RT tasks, and tasks boosted into the RT range, keep their prio */
+	if (rt_task(p))
+		return p->prio;
+
+	return __effective_prio(p);
+}
+
+#define has_rt_policy(p) \
+	unlikely((p)->policy != SCHED_NORMAL && (p)->policy != SCHED_BATCH)
+
+/*
+ * normal_prio - the priority of a task without priority inheritance
+ * boosting: derived from rt_priority for RT tasks and from the nice
+ * level for everyone else.
+ */
+static inline int normal_prio(task_t *p)
+{
+	if (has_rt_policy(p))
+		return MAX_RT_PRIO-1 - p->rt_priority;
+	return p->static_prio;
+}
+
 /*
  * __activate_task - move a task to the runqueue.
  */
@@ -671,6 +1609,11 @@ static void __activate_task(task_t *p, runqueue_t *rq)
 {
 	prio_array_t *target = rq->active;
 
+#ifdef CONFIG_SCHED_FAIR
+	if (fair_task(p))
+		p->vruntime += rq->fair.min_vruntime;
+	else
+#endif
 	if (batch_task(p))
 		target = rq->expired;
 	enqueue_task(p, target);
@@ -795,6 +1738,16 @@ static void activate_task(task_t *p, runqueue_t *rq, int local)
 			p->sleep_type = SLEEP_INTERACTIVE;
 		}
 	}
+#ifdef CONFIG_SCHED_FAIR
+	/*
+	 * Only a task that is waking up gets placed, tasks that are
+	 * migrated while runnable keep their vruntime:
+	 */
+	if (fair_task(p) && p->state != TASK_RUNNING)
+		place_task_fair(rq, p, now - p->timestamp);
+#endif
+	if (p->state != TASK_RUNNING)
+		schedlat_wakeup(p, rq);
 	p->timestamp = now;
 
 	__activate_task(p, rq);
@@ -808,6 +1761,10 @@ static void deactivate_task(struct task_struct *p, runqueue_t *rq)
 	rq->nr_running--;
 	dequeue_task(p, p->array);
 	p->array = NULL;
+#ifdef CONFIG_SCHED_FAIR
+	if (fair_task(p))
+		p->vruntime -= rq->fair.min_vruntime;
+#endif
 }
 
 /*
@@ -846,6 +1803,60 @@ static inline void resched_task(task_t *p)
 }
 #endif
 
+#ifdef CONFIG_FAIR_GROUP_SCHED
+static unsigned long tg_period_jiffies(struct task_group *tg)
+{
+	unsigned long long period = tg->period;
+
+	do_div(period, NSEC_PER_USEC);
+	return usecs_to_jiffies((unsigned int)period);
+}
+
+/*
+ * Let the group run again on every CPU it got throttled on:
+ */
+static void tg_unthrottle(struct task_group *tg)
+{
+	unsigned long flags;
+	int cpu;
+
+	for_each_online_cpu(cpu) {
+		struct task_group_cpu *tgc = tg_cpu(tg, cpu);
+		runqueue_t *rq = cpu_rq(cpu);
+
+		spin_lock_irqsave(&rq->lock, flags);
+		tgc->runtime_remaining = 0;
+		if (tgc->throttled) {
+			tgc->throttled = 0;
+			if (tgc->nr_running)
+				resched_task(rq->curr);
+		}
+		spin_unlock_irqrestore(&rq->lock, flags);
+	}
+}
+
+/*
+ * A new bandwidth period starts: refill the pool.
+ */
+static void tg_period_timer(unsigned long data)
+{
+	struct task_group *tg = (struct task_group *)data;
+	unsigned long flags;
+
+	spin_lock_irqsave(&tg->lock, flags);
+	if (tg->quota < 0) {
+		spin_unlock_irqrestore(&tg->lock, flags);
+		return;
+	}
+	tg->runtime = tg->quota;
+	tg->nr_periods++;
+	mod_timer(&tg->period_timer, jiffies + tg_period_jiffies(tg));
+	spin_unlock_irqrestore(&tg->lock, flags);
+
+	tg_unthrottle(tg);
+}
+#endif
+
 /**
  * task_curr - is this task currently executing on a CPU?
  * @p: the task in question.
@@ -1102,35 +2113,123 @@ nextlevel:
 		/* while loop will break here if sd == NULL */
 	}
 
-	return cpu;
+	return cpu;
+}
+
+#endif /* CONFIG_SMP */
+
+#ifdef CONFIG_SMP
+/*
+ * Each CPU's largest sched domain whose CPUs share its last level
+ * cache (SD_SHARE_PKG_RESOURCES), identified by its first CPU, and the
+ * number of CPUs in it. Set up by cpu_attach_domain().
+ */
+static DEFINE_PER_CPU(int, sd_llc_id);
+static DEFINE_PER_CPU(int, sd_llc_size);
+
+static inline int cpus_share_cache(int this_cpu, int that_cpu)
+{
+	return per_cpu(sd_llc_id, this_cpu) == per_cpu(sd_llc_id, that_cpu);
+}
+
+/*
+ * Track how often the current task switches between the tasks it
+ * wakes up. The count decays by half every second.
+ */
+static void record_wakee(task_t *p)
+{
+	task_t *curr = current;
+
+	if (in_interrupt())
+		return;
+
+	if (time_after(jiffies, curr->wakee_flip_decay_ts + HZ)) {
+		curr->wakee_flips >>= 1;
+		curr->wakee_flip_decay_ts = jiffies;
+	}
+	if (curr->last_wakee != p) {
+		curr->last_wakee = p;
+		curr->wakee_flips++;
+	}
+}
+
+/*
+ * A waker that keeps switching between more wakees than its cache
+ * domain has CPUs, waking a wakee that does the same, is a 1:N
+ * pattern (a dispatcher and its workers): pulling all of them onto the
+ * waker's CPU would just stack them up, so spread them instead.
+ */
+static int wake_wide(task_t *p)
+{
+	unsigned int master = current->wakee_flips;
+	unsigned int slave = p->wakee_flips;
+	unsigned int factor = __get_cpu_var(sd_llc_size);
+
+	if (master < slave) {
+		unsigned int tmp = master;
+		master = slave;
+		slave = tmp;
+	}
+	if (slave < factor || master < slave * factor)
+		return 0;
+	return 1;
 }
 
+/*
+ * May p be woken onto the waking CPU at all? Not in a 1:N wakeup
+ * pattern, and for non-sync wakeups not away from a cache p is still
+ * hot in, unless this_cpu shares that cache.
+ */
+static int wake_affine_allowed(task_t *p, runqueue_t *rq, int cpu,
+			       int this_cpu, struct sched_domain *sd, int sync)
+{
+	if (wake_wide(p)) {
+		schedstat_inc(rq, ttwu_wake_wide);
+		return 0;
+	}
+	if (!sync && !cpus_share_cache(cpu, this_cpu) &&
+			task_hot(p, rq->timestamp_last_tick, sd)) {
+		schedstat_inc(rq, ttwu_affine_hot);
+		return 0;
+	}
+	return 1;
+}
 #endif /* CONFIG_SMP */
 
 /*
  * wake_idle() will wake a task on an idle cpu if task->cpu is
- * not idle and an idle cpu is available.  The span of cpus to
- * search starts with cpus closest then further out as needed,
+ * not idle and an idle cpu is available.  The CPU the task ran on
+ * last is tried first if it shares cache with cpu, then the span of
+ * cpus to search starts with cpus closest then further out as needed,
  * so we always favor a closer, idle cpu.
  *
  * Returns the CPU we should wake onto.
  */
-#if defined(ARCH_HAS_SCHED_WAKE_IDLE)
+#if defined(ARCH_HAS_SCHED_WAKE_IDLE) || defined(CONFIG_SCHED_MC)
 static int wake_idle(int cpu, task_t *p)
 {
 	cpumask_t tmp;
 	struct sched_domain *sd;
-	int i;
+	int i, prev = task_cpu(p);
 
 	if (idle_cpu(cpu))
 		return cpu;
 
+	if (prev != cpu && idle_cpu(prev) && cpus_share_cache(prev, cpu) &&
+			cpu_isset(prev, p->cpus_allowed)) {
+		schedstat_inc(task_rq(p), ttwu_idle_prev);
+		return prev;
+	}
+
 	for_each_domain(cpu, sd) {
 		if (sd->flags & SD_WAKE_IDLE) {
 			cpus_and(tmp, sd->span, p->cpus_allowed);
 			for_each_cpu_mask(i, tmp) {
-				if (idle_cpu(i))
+				if (idle_cpu(i)) {
+					schedstat_inc(task_rq(p),
+						      ttwu_idle_sibling);
 					return i;
+				}
 			}
 		}
 		else
@@ -1189,6 +2288,7 @@ static int try_to_wake_up(task_t *p, unsigned int state, int sync)
 	new_cpu = cpu;
 
 	schedstat_inc(rq, ttwu_cnt);
+	record_wakee(p);
 	if (cpu == this_cpu) {
 		schedstat_inc(rq, ttwu_local);
 		goto out_set_cpu;
@@ -1219,7 +2319,8 @@ static int try_to_wake_up(task_t *p, unsigned int state, int sync)
 
 		new_cpu = this_cpu; /* Wake to this CPU if we can */
 
-		if (this_sd->flags & SD_WAKE_AFFINE) {
+		if ((this_sd->flags & SD_WAKE_AFFINE) &&
+		    wake_affine_allowed(p, rq, cpu, this_cpu, this_sd, sync)) {
 			unsigned long tl = this_load;
 			/*
 			 * If sync wakeup then subtract the (maximum possible)
@@ -1257,6 +2358,8 @@ static int try_to_wake_up(task_t *p, unsigned int state, int sync)
 	new_cpu = cpu; /* Could not wake to this_cpu. Wake to cpu instead */
 out_set_cpu:
 	new_cpu = wake_idle(new_cpu, p);
+	if (!cpus_share_cache(new_cpu, this_cpu))
+		schedstat_inc(rq, ttwu_cross_llc);
 	if (new_cpu != cpu) {
 		set_task_cpu(p, new_cpu);
 		task_rq_unlock(rq, &flags);
@@ -1302,7 +2405,7 @@ out_activate:
 	 * to be considered on this CPU.)
 	 */
 	if (!sync || cpu != this_cpu) {
-		if (TASK_PREEMPTS_CURR(p, rq))
+		if (task_preempts_curr(p, rq))
 			resched_task(rq->curr);
 	}
 	success = 1;
@@ -1350,9 +2453,30 @@ void fastcall sched_fork(task_t *p, int clone_flags)
 	p->state = TASK_RUNNING;
 	INIT_LIST_HEAD(&p->run_list);
 	p->array = NULL;
+	/*
+	 * Make sure we do not leak PI boosting priority to the child:
+	 */
+	p->prio = current->normal_prio;
 #ifdef CONFIG_SCHEDSTATS
 	memset(&p->sched_info, 0, sizeof(p->sched_info));
 #endif
+#ifdef CONFIG_SCHED_FAIR
+	p->vruntime = 0;
+	p->exec_start = 0;
+	p->sum_exec_runtime = p->prev_sum_exec_runtime = 0;
+	p->wait_start = p->sum_wait_runtime = p->wait_max = 0;
+	p->nr_wakeups = 0;
+#endif
+#ifdef CONFIG_SCHED_LATENCY_HIST
+	p->schedlat_flags = 0;
+	p->nr_migrations = 0;
+	memset(p->schedlat, 0, sizeof(p->schedlat));
+#endif
+#ifdef CONFIG_SMP
+	p->last_wakee = NULL;
+	p->wakee_flips = 0;
+	p->wakee_flip_decay_ts = jiffies;
+#endif
 #if defined(CONFIG_SMP) && defined(__ARCH_WANT_UNLOCKED_CTXSW)
 	p->oncpu = 0;
 #endif
@@ -1415,6 +2539,10 @@ void fastcall wake_up_new_task(task_t *p, unsigned long clone_flags)
 		CHILD_PENALTY / 100 * MAX_SLEEP_AVG / MAX_BONUS);
 
 	p->prio = effective_prio(p);
+#ifdef CONFIG_SCHED_FAIR
+	if (fair_task(p))
+		place_new_task_fair(rq, p);
+#endif
 
 	if (likely(cpu == this_cpu)) {
 		if (!(clone_flags & CLONE_VM)) {
@@ -1425,6 +2553,16 @@ void fastcall wake_up_new_task(task_t *p, unsigned long clone_flags)
 			 */
 			if (unlikely(!current->array))
 				__activate_task(p, rq);
+			/* don't share the queue slot of a PI-boosted parent */
+			else if (current->prio != current->normal_prio &&
+				 rt_task(current))
+				__activate_task(p, rq);
+#ifdef CONFIG_SCHED_FAIR
+			else if (fair_task(p)) {
+				__activate_task(p, rq);
+				child_runs_first_fair(rq, p);
+			}
+#endif
 			else {
 				p->prio = current->prio;
 				list_add_tail(&p->run_list, &current->run_list);
@@ -1453,7 +2591,7 @@ void fastcall wake_up_new_task(task_t *p, unsigned long clone_flags)
 		p->timestamp = (p->timestamp - this_rq->timestamp_last_tick)
 					+ rq->timestamp_last_tick;
 		__activate_task(p, rq);
-		if (TASK_PREEMPTS_CURR(p, rq))
+		if (task_preempts_curr(p, rq))
 			resched_task(rq->curr);
 
 		/*
@@ -1800,6 +2938,7 @@ void pull_task(runqueue_t *src_rq, prio_array_t *src_array, task_t *p,
 {
 	dequeue_task(p, src_array);
 	src_rq->nr_running--;
+	migrate_vruntime(p, src_rq, this_rq);
 	set_task_cpu(p, this_cpu);
 	this_rq->nr_running++;
 	enqueue_task(p, this_array);
@@ -1809,7 +2948,7 @@ void pull_task(runqueue_t *src_rq, prio_array_t *src_array, task_t *p,
 	 * Note that idle threads have a prio of MAX_PRIO, for this test
 	 * to be always true for them.
 	 */
-	if (TASK_PREEMPTS_CURR(p, this_rq))
+	if (task_preempts_curr(p, this_rq))
 		resched_task(this_rq->curr);
 }
 
@@ -1848,6 +2987,64 @@ int can_migrate_task(task_t *p, runqueue_t *rq, int this_cpu,
 	return 1;
 }
 
+#ifdef CONFIG_SCHED_FAIR
+/*
+ * Pull up to max_nr_move fair tasks from busiest. Tasks at the right end
+ * of the timeline are tried first: they would wait longest on busiest.
+ * With group scheduling, a first pass only takes tasks whose group is
+ * more crowded on busiest than on this CPU.
+ */
+static int move_fair_tasks(runqueue_t *this_rq, int this_cpu,
+			   runqueue_t *busiest, unsigned long max_nr_move,
+			   struct sched_domain *sd, enum idle_type idle,
+			   int *pinned)
+{
+	struct rb_node *node, *prev;
+	int pulled = 0, first_pass = 1;
+	task_t *tmp;
+
+#ifdef CONFIG_FAIR_GROUP_SCHED
+next_pass:
+#endif
+	for (node = rb_last(&busiest->fair.tasks_timeline);
+			node && pulled < max_nr_move; node = prev) {
+		prev = rb_prev(node);
+		tmp = rb_entry(node, task_t, run_node);
+
+		if (first_pass &&
+		    !group_prefers_move(tmp, task_cpu(tmp), this_cpu))
+			continue;
+		if (!can_migrate_task(tmp, busiest, this_cpu, sd, idle, pinned))
+			continue;
+
+#ifdef CONFIG_SCHEDSTATS
+		if (task_hot(tmp, busiest->timestamp_last_tick, sd))
+			schedstat_inc(sd, lb_hot_gained[idle]);
+#endif
+
+		pull_task(busiest, tmp->array, tmp, this_rq, this_rq->active,
+								this_cpu);
+		pulled++;
+	}
+#ifdef CONFIG_FAIR_GROUP_SCHED
+	if (first_pass && pulled < max_nr_move) {
+		first_pass = 0;
+		goto next_pass;
+	}
+#endif
+	return pulled;
+}
+#else
+static inline int move_fair_tasks(runqueue_t *this_rq, int this_cpu,
+				  runqueue_t *busiest,
+				  unsigned long max_nr_move,
+				  struct sched_domain *sd, enum idle_type idle,
+				  int *pinned)
+{
+	return 0;
+}
+#endif
+
 /*
  * move_tasks tries to move up to max_nr_move tasks from busiest to this_rq,
  * as part of a balancing operation within "domain". Returns the number of
@@ -1897,7 +3094,7 @@ skip_bitmap:
 			dst_array = this_rq->active;
 			goto new_array;
 		}
-		goto out;
+		goto fair;
 	}
 
 	head = array->queue + idx;
@@ -1929,6 +3126,10 @@ skip_queue:
 		idx++;
 		goto skip_bitmap;
 	}
+	goto out;
+fair:
+	pulled += move_fair_tasks(this_rq, this_cpu, busiest,
+				  max_nr_move - pulled, sd, idle, &pinned);
 out:
 	/*
 	 * Right now, this is the only place pull_task() is called,
@@ -2631,6 +3832,10 @@ void scheduler_tick(void)
 		}
 		goto out_unlock;
 	}
+#ifdef CONFIG_SCHED_FAIR
+	fair_tick(rq, p, now);
+	goto out_unlock;
+#endif
 	if (!--p->time_slice) {
 		dequeue_task(p, rq->active);
 		set_tsk_need_resched(p);
@@ -2774,8 +3979,15 @@ static int dependent_sleeper(int this_cpu, runqueue_t *this_rq)
 	array = this_rq->active;
 	if (!array->nr_active)
 		array = this_rq->expired;
+#ifdef CONFIG_SCHED_FAIR
+	if (!array->nr_active) {
+		p = pick_next_fair(this_rq);
+		if (!p)
+			goto out_unlock;
+	} else
+#else
 	BUG_ON(!array->nr_active);
-
+#endif
 	p = list_entry(array->queue[sched_find_first_bit(array->bitmap)].next,
 		task_t, run_list);
 
@@ -2916,6 +4128,15 @@ asmlinkage void __sched schedule(void)
 	}
 	profile_hit(SCHED_PROFILING, __builtin_return_address(0));
 
+	/*
+	 * Requests held back on the plug of a task going to sleep may be
+	 * what it is about to wait for; submit them now.
+	 */
+	if (current->state != TASK_RUNNING &&
+	    !(preempt_count() & PREEMPT_ACTIVE) &&
+	    blk_needs_flush_plug(current))
+		blk_schedule_flush_plug(current);
+
 need_resched:
 	preempt_disable();
 	prev = current;
@@ -2947,7 +4168,16 @@ need_resched_nonpreemptible:
 	 */
 	run_time /= (CURRENT_BONUS(prev) ? : 1);
 
+	/*
+	 * A workqueue worker going to sleep lets its pool start another
+	 * worker, before we take the runqueue lock that needs:
+	 */
+	if (unlikely(prev->flags & PF_WQ_WORKER) && prev->state &&
+	    !(preempt_count() & PREEMPT_ACTIVE))
+		wq_worker_sleeping(prev);
+
 	spin_lock_irq(&rq->lock);
+	update_curr_fair(rq, now);
 
 	if (unlikely(prev->flags & PF_DEAD))
 		prev->state = EXIT_DEAD;
@@ -2996,6 +4226,19 @@ go_idle:
 	}
 
 	array = rq->active;
+#ifdef CONFIG_SCHED_FAIR
+	/*
+	 * Fair tasks never go to the expired array: with no RT task
+	 * runnable, the leftmost task of the timeline is next.
+	 */
+	if (!array->nr_active) {
+		next = pick_next_fair(rq);
+		if (unlikely(!next))
+			/* everything runnable here is throttled */
+			next = rq->idle;
+		goto switch_tasks;
+	}
+#endif
 	if (unlikely(!array->nr_active)) {
 		/*
 		 * Switch the active and expired arrays.
@@ -3039,6 +4282,8 @@ switch_tasks:
 	rcu_qsctr_inc(task_cpu(prev));
 
 	update_cpu_clock(prev, rq, now);
+	fair_switch(rq, prev, next, now);
+	schedlat_switch(rq, prev, next, now);
 
 	prev->sleep_avg -= run_time;
 	if ((long)prev->sleep_avg <= 0)
@@ -3065,6 +4310,8 @@ switch_tasks:
 		spin_unlock_irq(&rq->lock);
 
 	prev = current;
+	if (unlikely(prev->flags & PF_WQ_WORKER))
+		wq_worker_running(prev);
 	if (unlikely(reacquire_kernel_lock(prev) < 0))
 		goto need_resched_nonpreemptible;
 	preempt_enable_no_resched();
@@ -3493,8 +4740,14 @@ void set_user_nice(task_t *p, long nice)
 	 * it wont have any effect on scheduling until the task is
 	 * not SCHED_NORMAL/SCHED_BATCH:
 	 */
+	if (has_rt_policy(p)) {
+		p->static_prio = NICE_TO_PRIO(nice);
+		goto out_unlock;
+	}
 	if (rt_task(p)) {
+		/* boosted by priority inheritance, applies once deboosted */
 		p->static_prio = NICE_TO_PRIO(nice);
+		p->normal_prio = p->static_prio;
 		goto out_unlock;
 	}
 	array = p->array;
@@ -3505,6 +4758,7 @@ void set_user_nice(task_t *p, long nice)
 	new_prio = NICE_TO_PRIO(nice);
 	delta = new_prio - old_prio;
 	p->static_prio = NICE_TO_PRIO(nice);
+	p->normal_prio = p->static_prio;
 	p->prio += delta;
 
 	if (array) {
@@ -3619,6 +4873,64 @@ task_t *idle_task(int cpu)
 	return cpu_rq(cpu)->idle;
 }
 
+#ifdef CONFIG_RT_MUTEXES
+
+/*
+ * rt_mutex_setprio - set the current priority of a task
+ * @p: task
+ * @prio: prio value (kernel-internal form)
+ *
+ * This function changes the 'effective' priority of a task. It does
+ * not touch ->normal_prio like __setscheduler().
+ *
+ * Used by the rt_mutex code to implement priority inheritance logic.
+ */
+void rt_mutex_setprio(task_t *p, int prio)
+{
+	unsigned long flags;
+	prio_array_t *array;
+	runqueue_t *rq;
+	int oldprio;
+
+	BUG_ON(prio < 0 || prio > MAX_PRIO);
+
+	rq = task_rq_lock(p, &flags);
+
+	oldprio = p->prio;
+	array = p->array;
+#ifdef CONFIG_SCHED_FAIR
+	/* charge the fair time run so far before p changes class */
+	if (array && task_running(rq, p))
+		update_curr_fair(rq, sched_clock());
+#endif
+	if (array)
+		deactivate_task(p, rq);
+	p->prio = prio;
+	/* deboosted: pick the interactivity bonus up again */
+	if (!rt_task(p))
+		p->prio = min(prio, __effective_prio(p));
+#ifdef CONFIG_SCHED_FAIR
+	p->exec_start = sched_clock();
+#endif
+
+	if (array) {
+		__activate_task(p, rq);
+		/*
+		 * Reschedule if we are currently running on this runqueue and
+		 * our priority decreased, or if we are not currently running on
+		 * this runqueue and our priority is higher than the current's
+		 */
+		if (task_running(rq, p)) {
+			if (p->prio > oldprio)
+				resched_task(rq->curr);
+		} else if (task_preempts_curr(p, rq))
+			resched_task(rq->curr);
+	}
+	task_rq_unlock(rq, &flags);
+}
+
+#endif
+
 /**
  * find_process_by_pid - find a process with a matching PID value.
  * @pid: the pid in question.
@@ -3634,16 +4946,18 @@ static void __setscheduler(struct task_struct *p, int policy, int prio)
 	BUG_ON(p->array);
 	p->policy = policy;
 	p->rt_priority = prio;
-	if (policy != SCHED_NORMAL && policy != SCHED_BATCH) {
-		p->prio = MAX_RT_PRIO-1 - p->rt_priority;
-	} else {
-		p->prio = p->static_prio;
-		/*
-		 * SCHED_BATCH tasks are treated as perpetual CPU hogs:
-		 */
-		if (policy == SCHED_BATCH)
-			p->sleep_avg = 0;
-	}
+#ifdef CONFIG_SCHED_FAIR
+	/* don't charge a running task for time it spent as an RT task */
+	p->exec_start = sched_clock();
+#endif
+	p->normal_prio = normal_prio(p);
+	/* we are holding p->pi_lock already */
+	p->prio = rt_mutex_getprio(p);
+	/*
+	 * SCHED_BATCH tasks are treated as perpetual CPU hogs:
+	 */
+	if (policy == SCHED_BATCH)
+		p->sleep_avg = 0;
 }
 
 /**
@@ -3709,15 +5023,21 @@ recheck:
 	retval = security_task_setscheduler(p, policy, param);
 	if (retval)
 		return retval;
+	/*
+	 * make sure no PI-waiters arrive (or leave) while we are
+	 * changing the priority of the task:
+	 */
+	spin_lock_irqsave(&p->pi_lock, flags);
 	/*
 	 * To be able to change p->policy safely, the apropriate
 	 * runqueue lock must be held.
 	 */
-	rq = task_rq_lock(p, &flags);
+	rq = __task_rq_lock(p);
 	/* recheck policy now with rq lock held */
 	if (unlikely(oldpolicy != -1 && oldpolicy != p->policy)) {
 		policy = oldpolicy = -1;
-		task_rq_unlock(rq, &flags);
+		__task_rq_unlock(rq);
+		spin_unlock_irqrestore(&p->pi_lock, flags);
 		goto recheck;
 	}
 	array = p->array;
@@ -3735,10 +5055,14 @@ recheck:
 		if (task_running(rq, p)) {
 			if (p->prio > oldprio)
 				resched_task(rq->curr);
-		} else if (TASK_PREEMPTS_CURR(p, rq))
+		} else if (task_preempts_curr(p, rq))
 			resched_task(rq->curr);
 	}
-	task_rq_unlock(rq, &flags);
+	__task_rq_unlock(rq);
+	spin_unlock_irqrestore(&p->pi_lock, flags);
+
+	rt_mutex_adjust_pi(p);
+
 	return 0;
 }
 EXPORT_SYMBOL_GPL(sched_setscheduler);
@@ -4014,6 +5338,14 @@ asmlinkage long sys_sched_yield(void)
 	 */
 	if (rt_task(current))
 		target = rq->active;
+#ifdef CONFIG_SCHED_FAIR
+	/*
+	 * Fair tasks stay on the timeline, requeue_task() moves them
+	 * behind the rightmost task instead:
+	 */
+	else
+		target = rq->active;
+#endif
 
 	if (array->nr_active == 1) {
 		schedstat_inc(rq, yld_act_empty);
@@ -4133,6 +5465,41 @@ void __sched yield(void)
 
 EXPORT_SYMBOL(yield);
 
+#ifdef CONFIG_MUTEX_SPIN_ON_OWNER
+/**
+ * mutex_spin_on_owner - spin while the owner of a mutex is running
+ * @lock: the mutex
+ *
+ * Spins as long as the recorded owner of @lock does not change and is
+ * running on its CPU. Returns 0 if the owner stopped running or the
+ * current task has to reschedule, in which case the caller should go to
+ * sleep, and 1 if the owner released the mutex (or none is recorded).
+ * Must be called with preemption disabled.
+ *
+ * The owner cannot go away under us: its task_struct is freed from an
+ * RCU callback, and it held the mutex when we read it.
+ */
+int mutex_spin_on_owner(struct mutex *lock)
+{
+	struct task_struct *owner;
+	int ret = 1;
+
+	rcu_read_lock();
+	owner = *(struct task_struct * volatile *)&lock->spin_owner;
+	while (owner) {
+		if (!task_running(task_rq(owner), owner) || need_resched()) {
+			ret = 0;
+			break;
+		}
+		cpu_relax();
+		if (*(struct task_struct * volatile *)&lock->spin_owner != owner)
+			break;
+	}
+	rcu_read_unlock();
+	return ret;
+}
+#endif
+
 /*
  * This task is about to go to sleep on IO.  Increment rq->nr_iowait so
  * that process accounting knows that this is a task in IO wait state.
@@ -4363,7 +5730,7 @@ void __devinit init_idle(task_t *idle, int cpu)
 	idle->timestamp = sched_clock();
 	idle->sleep_avg = 0;
 	idle->array = NULL;
-	idle->prio = MAX_PRIO;
+	idle->prio = idle->normal_prio = MAX_PRIO;
 	idle->state = TASK_RUNNING;
 	idle->cpus_allowed = cpumask_of_cpu(cpu);
 	set_task_cpu(idle, cpu);
@@ -4463,6 +5830,7 @@ EXPORT_SYMBOL_GPL(set_cpus_allowed);
 static void __migrate_task(struct task_struct *p, int src_cpu, int dest_cpu)
 {
 	runqueue_t *rq_dest, *rq_src;
+	int on_rq;
 
 	if (unlikely(cpu_is_offline(dest_cpu)))
 		return;
@@ -4478,8 +5846,15 @@ static void __migrate_task(struct task_struct *p, int src_cpu, int dest_cpu)
 	if (!cpu_isset(dest_cpu, p->cpus_allowed))
 		goto out;
 
+	/*
+	 * The task has to leave rq_src before its cpu is changed, the
+	 * fair timeline it sits on is found through task_rq():
+	 */
+	on_rq = p->array != NULL;
+	if (on_rq)
+		deactivate_task(p, rq_src);
 	set_task_cpu(p, dest_cpu);
-	if (p->array) {
+	if (on_rq) {
 		/*
 		 * Sync timestamp with rq_dest's before activating.
 		 * The same thing could be achieved by doing this step
@@ -4488,9 +5863,8 @@ static void __migrate_task(struct task_struct *p, int src_cpu, int dest_cpu)
 		 */
 		p->timestamp = p->timestamp - rq_src->timestamp_last_tick
 				+ rq_dest->timestamp_last_tick;
-		deactivate_task(p, rq_src);
 		activate_task(p, rq_dest, 0);
-		if (TASK_PREEMPTS_CURR(p, rq_dest))
+		if (task_preempts_curr(p, rq_dest))
 			resched_task(rq_dest->curr);
 	}
 
@@ -4712,6 +6086,10 @@ static void migrate_dead_tasks(unsigned int dead_cpu)
 							run_list));
 		}
 	}
+#ifdef CONFIG_SCHED_FAIR
+	while (rq->fair.rb_leftmost)
+		migrate_dead(dead_cpu, __first_fair(&rq->fair));
+#endif
 }
 #endif /* CONFIG_HOTPLUG_CPU */
 
@@ -4949,6 +6327,29 @@ static int sd_parent_degenerate(struct sched_domain *sd,
 	return 1;
 }
 
+/*
+ * Remember the largest domain of cpu whose CPUs share its last level
+ * cache, for wakeup placement. Called by cpu_attach_domain() once the
+ * domains it keeps are known.
+ */
+static void update_top_cache_domain(struct sched_domain *sd, int cpu)
+{
+	struct sched_domain *llc = NULL;
+	int id = cpu, size = 1;
+
+	for (; sd; sd = sd->parent) {
+		if (!(sd->flags & SD_SHARE_PKG_RESOURCES))
+			break;
+		llc = sd;
+	}
+	if (llc) {
+		id = first_cpu(llc->span);
+		size = cpus_weight(llc->span);
+	}
+	per_cpu(sd_llc_id, cpu) = id;
+	per_cpu(sd_llc_size, cpu) = size;
+}
+
 /*
  * Attach the domain 'sd' to 'cpu' as its base domain.  Callers must
  * hold the hotplug lock.
@@ -4973,6 +6374,7 @@ static void cpu_attach_domain(struct sched_domain *sd, int cpu)
 	sched_domain_debug(sd, cpu);
 
 	rcu_assign_pointer(rq->sd, sd);
+	update_top_cache_domain(sd, cpu);
 }
 
 /* cpus with isolated domains */
@@ -5755,6 +7157,12 @@ void build_sched_domains(const cpumask_t *cpu_map)
 		sd = &per_cpu(core_domains, i);
 		group = cpu_to_core_group(i);
 		*sd = SD_MC_INIT;
+		/*
+		 * cpu_coregroup_map() is the set of CPUs sharing the last
+		 * level cache with i (x86 reads it from cpuid), so wakeups
+		 * may look for an idle CPU in it:
+		 */
+		sd->flags |= SD_SHARE_PKG_RESOURCES | SD_WAKE_IDLE;
 		sd->span = cpu_coregroup_map(i);
 		cpus_and(sd->span, sd->span, *cpu_map);
 		sd->parent = p;
@@ -5766,6 +7174,7 @@ void build_sched_domains(const cpumask_t *cpu_map)
 		sd = &per_cpu(cpu_domains, i);
 		group = cpu_to_cpu_group(i);
 		*sd = SD_SIBLING_INIT;
+		sd->flags |= SD_SHARE_PKG_RESOURCES;
 		sd->span = cpu_sibling_map[i];
 		cpus_and(sd->span, sd->span, *cpu_map);
 		sd->parent = p;
@@ -6103,6 +7512,202 @@ int in_sched_functions(unsigned long addr)
 		&& addr < (unsigned long)__sched_text_end);
 }
 
+#ifdef CONFIG_FAIR_GROUP_SCHED
+/*
+ * Scheduling groups are created and configured by kernel/cpuset.c,
+ * which serializes all of the calls below with its manage_mutex.
+ */
+struct task_group *sched_create_group(struct task_group *parent)
+{
+	struct task_group *tg;
+
+	tg = kzalloc(sizeof(*tg), GFP_KERNEL);
+	if (!tg)
+		return NULL;
+	tg->cpu_data = alloc_percpu(struct task_group_cpu);
+	if (!tg->cpu_data) {
+		kfree(tg);
+		return NULL;
+	}
+	tg->parent = parent;
+	tg->shares = NICE_0_LOAD;
+	spin_lock_init(&tg->lock);
+	tg->quota = -1;
+	tg->period = DEF_BANDWIDTH_PERIOD;
+	init_timer(&tg->period_timer);
+	tg->period_timer.function = tg_period_timer;
+	tg->period_timer.data = (unsigned long)tg;
+	return tg;
+}
+
+/*
+ * The group must not have tasks or child groups any more:
+ */
+void sched_destroy_group(struct task_group *tg)
+{
+	del_timer_sync(&tg->period_timer);
+	free_percpu(tg->cpu_data);
+	kfree(tg);
+}
+
+/*
+ * Move tsk to group tg (NULL is the root level). Called with
+ * task_lock(tsk) held.
+ */
+void sched_move_task(struct task_struct *tsk, struct task_group *tg)
+{
+	prio_array_t *array;
+	unsigned long flags;
+	runqueue_t *rq;
+	int on_rq;
+
+	rq = task_rq_lock(tsk, &flags);
+	if (tsk->task_group == tg)
+		goto out;
+
+	array = tsk->array;
+	on_rq = array && fair_task(tsk);
+	if (on_rq) {
+		if (task_running(rq, tsk))
+			update_curr_fair(rq, sched_clock());
+		dequeue_task(tsk, array);
+	}
+	tsk->task_group = tg;
+	if (on_rq) {
+		enqueue_task(tsk, array);
+		if (task_running(rq, tsk) && task_throttled(tsk))
+			resched_task(tsk);
+	}
+out:
+	task_rq_unlock(rq, &flags);
+}
+
+int sched_group_set_shares(struct task_group *tg, unsigned long shares)
+{
+	int cpu;
+
+	if (!tg)
+		return -EINVAL;
+	if (shares < MIN_SHARES)
+		shares = MIN_SHARES;
+	if (shares > MAX_SHARES)
+		shares = MAX_SHARES;
+
+	tg->shares = shares;
+	/*
+	 * Reweight the group where it is runnable right now, it picks up
+	 * the new weight everywhere else when it next becomes runnable:
+	 */
+	for_each_possible_cpu(cpu) {
+		struct task_group_cpu *tgc = tg_cpu(tg, cpu);
+		runqueue_t *rq = cpu_rq(cpu);
+		unsigned long flags;
+		unsigned long *load;
+
+		spin_lock_irqsave(&rq->lock, flags);
+		if (tgc->nr_running) {
+			if (tg->parent)
+				load = &tg_cpu(tg->parent, cpu)->load;
+			else
+				load = &rq->fair.load;
+			*load += shares - tgc->weight;
+			tgc->weight = shares;
+		}
+		spin_unlock_irqrestore(&rq->lock, flags);
+	}
+	return 0;
+}
+
+unsigned long sched_group_shares(struct task_group *tg)
+{
+	return tg ? tg->shares : NICE_0_LOAD;
+}
+
+/*
+ * quota_us < 0 removes the limit:
+ */
+int sched_group_set_bandwidth(struct task_group *tg, long quota_us,
+			      long period_us)
+{
+	long long quota = (long long)quota_us * NSEC_PER_USEC;
+
+	if (!tg)
+		return -EINVAL;
+	if (period_us < 1000 || period_us > USEC_PER_SEC)
+		return -EINVAL;
+	if (quota_us >= 0 && quota_us < 1000)
+		return -EINVAL;
+	if (quota_us < 0)
+		quota = -1;
+
+	spin_lock_irq(&tg->lock);
+	tg->quota = quota;
+	tg->period = (long long)period_us * NSEC_PER_USEC;
+	tg->runtime = quota;
+	spin_unlock_irq(&tg->lock);
+
+	if (quota < 0) {
+		del_timer_sync(&tg->period_timer);
+		tg_unthrottle(tg);
+	} else
+		mod_timer(&tg->period_timer, jiffies + tg_period_jiffies(tg));
+	return 0;
+}
+
+long sched_group_quota(struct task_group *tg)
+{
+	unsigned long long quota;
+
+	if (!tg || tg->quota < 0)
+		return -1;
+	quota = tg->quota;
+	do_div(quota, NSEC_PER_USEC);
+	return (long)quota;
+}
+
+long sched_group_period(struct task_group *tg)
+{
+	unsigned long long period = tg ? tg->period : DEF_BANDWIDTH_PERIOD;
+
+	do_div(period, NSEC_PER_USEC);
+	return (long)period;
+}
+
+/*
+ * CPU time consumed by the tasks of tg and its children, in ns. The
+ * root level reports the fair time of all CPUs.
+ */
+unsigned long long sched_group_usage(struct task_group *tg)
+{
+	unsigned long long usage = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		if (tg)
+			usage += tg_cpu(tg, cpu)->usage;
+		else
+			usage += cpu_rq(cpu)->fair.exec_clock;
+	}
+	return usage;
+}
+
+int sched_group_stat(struct task_group *tg, char *buffer)
+{
+	unsigned long nr_periods = 0, nr_throttled = 0;
+	int cpu, throttled = 0;
+
+	if (tg) {
+		nr_periods = tg->nr_periods;
+		nr_throttled = tg->nr_throttled;
+		for_each_online_cpu(cpu)
+			throttled += tg_cpu(tg, cpu)->throttled;
+	}
+	return sprintf(buffer, "nr_periods %lu\nnr_throttled %lu\n"
+			"throttled_cpus %d",
+			nr_periods, nr_throttled, throttled);
+}
+#endif /* CONFIG_FAIR_GROUP_SCHED */
+
 void __init sched_init(void)
 {
 	runqueue_t *rq;
@@ -6117,6 +7722,9 @@ void __init sched_init(void)
 		rq->active = rq->arrays;
 		rq->expired = rq->arrays + 1;
 		rq->best_expired_prio = MAX_PRIO;
+#ifdef CONFIG_SCHED_FAIR
+		init_fair_rq(&rq->fair);
+#endif
 
 #ifdef CONFIG_SMP
 		rq->sd = NULL;
@@ -15,6 +15,24 @@
 #include <linux/spinlock.h>
 #include <linux/interrupt.h>
 #include <linux/module.h>
+#include <linux/sched.h>
+
+/*
+ * Lock statistics are accounted to the caller of the lock function:
+ */
+#define LOCK_IP		__builtin_return_address(0)
+
+#define spin_lock_stat_kind		LOCK_STAT_SPIN
+#define read_lock_stat_kind		LOCK_STAT_RW
+#define write_lock_stat_kind		LOCK_STAT_RW
+
+/* readers do not account hold times, there may be many of them */
+#define spin_lock_stat_acquire(lock, ip) \
+		lock_stat_acquire(lock, LOCK_STAT_SPIN, ip)
+#define read_lock_stat_acquire(lock, ip) \
+		lock_stat_acquire_shared(lock, LOCK_STAT_RW, ip)
+#define write_lock_stat_acquire(lock, ip) \
+		lock_stat_acquire(lock, LOCK_STAT_RW, ip)
 
 /*
  * Generic declaration of the raw read_trylock() function,
@@ -30,8 +48,10 @@ EXPORT_SYMBOL(generic__raw_read_trylock);
 int __lockfunc _spin_trylock(spinlock_t *lock)
 {
 	preempt_disable();
-	if (_raw_spin_trylock(lock))
+	if (_raw_spin_trylock(lock)) {
+		spin_lock_stat_acquire(lock, LOCK_IP);
 		return 1;
+	}
 	
 	preempt_enable();
 	return 0;
@@ -41,8 +61,10 @@ EXPORT_SYMBOL(_spin_trylock);
 int __lockfunc _read_trylock(rwlock_t *lock)
 {
 	preempt_disable();
-	if (_raw_read_trylock(lock))
+	if (_raw_read_trylock(lock)) {
+		read_lock_stat_acquire(lock, LOCK_IP);
 		return 1;
+	}
 
 	preempt_enable();
 	return 0;
@@ -52,22 +74,49 @@ EXPORT_SYMBOL(_read_trylock);
 int __lockfunc _write_trylock(rwlock_t *lock)
 {
 	preempt_disable();
-	if (_raw_write_trylock(lock))
+	if (_raw_write_trylock(lock)) {
+		write_lock_stat_acquire(lock, LOCK_IP);
 		return 1;
+	}
 
 	preempt_enable();
 	return 0;
 }
 EXPORT_SYMBOL(_write_trylock);
 
-#if !defined(CONFIG_PREEMPT) || !defined(CONFIG_SMP)
+#if !defined(CONFIG_PREEMPT) || !defined(CONFIG_SMP) || \
+	defined(CONFIG_TICKET_SPINLOCKS)
 
-void __lockfunc _read_lock(rwlock_t *lock)
+#if defined(CONFIG_PREEMPT) && defined(CONFIG_SMP)
+/*
+ * A waiter for a ticket spinlock has to keep its place in the queue, so
+ * unlike the BUILD_LOCK_OPS() functions below it cannot enable
+ * preemption while it waits. It only asks the holder to break the lock.
+ */
+# define spin_lock_break(lock)		((lock)->break_lock = 1)
+# define spin_lock_break_done(lock)	((lock)->break_lock = 0)
+#else
+# define spin_lock_break(lock)		do { } while (0)
+# define spin_lock_break_done(lock)	do { } while (0)
+#endif
+
+/*
+ * The spinlock was held when we tried to take it:
+ */
+static void __lockfunc
+__spin_lock_contended(spinlock_t *lock, unsigned long *flags, void *ip)
 {
-	preempt_disable();
-	_raw_read_lock(lock);
+	unsigned long long start = 0;
+
+	lock_stat_begin(start);
+	spin_lock_break(lock);
+	if (flags)
+		_raw_spin_lock_flags(lock, flags);
+	else
+		_raw_spin_lock(lock);
+	spin_lock_break_done(lock);
+	lock_stat_end(lock, LOCK_STAT_SPIN, start, ip);
 }
-EXPORT_SYMBOL(_read_lock);
 
 unsigned long __lockfunc _spin_lock_irqsave(spinlock_t *lock)
 {
@@ -75,7 +124,9 @@ unsigned long __lockfunc _spin_lock_irqsave(spinlock_t *lock)
 
 	local_irq_save(flags);
 	preempt_disable();
-	_raw_spin_lock_flags(lock, &flags);
+	if (unlikely(!_raw_spin_trylock(lock)))
+		__spin_lock_contended(lock, &flags, LOCK_IP);
+	spin_lock_stat_acquire(lock, LOCK_IP);
 	return flags;
 }
 EXPORT_SYMBOL(_spin_lock_irqsave);
@@ -84,7 +135,9 @@ void __lockfunc _spin_lock_irq(spinlock_t *lock)
 {
 	local_irq_disable();
 	preempt_disable();
-	_raw_spin_lock(lock);
+	if (unlikely(!_raw_spin_trylock(lock)))
+		__spin_lock_contended(lock, NULL, LOCK_IP);
+	spin_lock_stat_acquire(lock, LOCK_IP);
 }
 EXPORT_SYMBOL(_spin_lock_irq);
 
@@ -92,17 +145,65 @@ void __lockfunc _spin_lock_bh(spinlock_t *lock)
 {
 	local_bh_disable();
 	preempt_disable();
-	_raw_spin_lock(lock);
+	if (unlikely(!_raw_spin_trylock(lock)))
+		__spin_lock_contended(lock, NULL, LOCK_IP);
+	spin_lock_stat_acquire(lock, LOCK_IP);
 }
 EXPORT_SYMBOL(_spin_lock_bh);
 
+void __lockfunc _spin_lock(spinlock_t *lock)
+{
+	preempt_disable();
+	if (unlikely(!_raw_spin_trylock(lock)))
+		__spin_lock_contended(lock, NULL, LOCK_IP);
+	spin_lock_stat_acquire(lock, LOCK_IP);
+}
+
+EXPORT_SYMBOL(_spin_lock);
+
+#endif
+
+#if !defined(CONFIG_PREEMPT) || !defined(CONFIG_SMP)
+
+/*
+ * The rwlock was held in a conflicting mode when we tried to take it:
+ */
+static void __lockfunc __read_lock_contended(rwlock_t *lock, void *ip)
+{
+	unsigned long long start = 0;
+
+	lock_stat_begin(start);
+	_raw_read_lock(lock);
+	lock_stat_end(lock, LOCK_STAT_RW, start, ip);
+}
+
+static void __lockfunc __write_lock_contended(rwlock_t *lock, void *ip)
+{
+	unsigned long long start = 0;
+
+	lock_stat_begin(start);
+	_raw_write_lock(lock);
+	lock_stat_end(lock, LOCK_STAT_RW, start, ip);
+}
+
+void __lockfunc _read_lock(rwlock_t *lock)
+{
+	preempt_disable();
+	if (unlikely(!_raw_read_trylock(lock)))
+		__read_lock_contended(lock, LOCK_IP);
+	read_lock_stat_acquire(lock, LOCK_IP);
+}
+EXPORT_SYMBOL(_read_lock);
+
 unsigned long __lockfunc _read_lock_irqsave(rwlock_t *lock)
 {
 	unsigned long flags;
 
 	local_irq_save(flags);
 	preempt_disable();
-	_raw_read_lock(lock);
+	if (unlikely(!_raw_read_trylock(lock)))
+		__read_lock_contended(lock, LOCK_IP);
+	read_lock_stat_acquire(lock, LOCK_IP);
 	return flags;
 }
 EXPORT_SYMBOL(_read_lock_irqsave);
@@ -111,7 +212,9 @@ void __lockfunc _read_lock_irq(rwlock_t *lock)
 {
 	local_irq_disable();
 	preempt_disable();
-	_raw_read_lock(lock);
+	if (unlikely(!_raw_read_trylock(lock)))
+		__read_lock_contended(lock, LOCK_IP);
+	read_lock_stat_acquire(lock, LOCK_IP);
 }
 EXPORT_SYMBOL(_read_lock_irq);
 
@@ -119,7 +222,9 @@ void __lockfunc _read_lock_bh(rwlock_t *lock)
 {
 	local_bh_disable();
 	preempt_disable();
-	_raw_read_lock(lock);
+	if (unlikely(!_raw_read_trylock(lock)))
+		__read_lock_contended(lock, LOCK_IP);
+	read_lock_stat_acquire(lock, LOCK_IP);
 }
 EXPORT_SYMBOL(_read_lock_bh);
 
@@ -129,7 +234,9 @@ unsigned long __lockfunc _write_lock_irqsave(rwlock_t *lock)
 
 	local_irq_save(flags);
 	preempt_disable();
-	_raw_write_lock(lock);
+	if (unlikely(!_raw_write_trylock(lock)))
+		__write_lock_contended(lock, LOCK_IP);
+	write_lock_stat_acquire(lock, LOCK_IP);
 	return flags;
 }
 EXPORT_SYMBOL(_write_lock_irqsave);
@@ -138,7 +245,9 @@ void __lockfunc _write_lock_irq(rwlock_t *lock)
 {
 	local_irq_disable();
 	preempt_disable();
-	_raw_write_lock(lock);
+	if (unlikely(!_raw_write_trylock(lock)))
+		__write_lock_contended(lock, LOCK_IP);
+	write_lock_stat_acquire(lock, LOCK_IP);
 }
 EXPORT_SYMBOL(_write_lock_irq);
 
@@ -146,22 +255,18 @@ void __lockfunc _write_lock_bh(rwlock_t *lock)
 {
 	local_bh_disable();
 	preempt_disable();
-	_raw_write_lock(lock);
+	if (unlikely(!_raw_write_trylock(lock)))
+		__write_lock_contended(lock, LOCK_IP);
+	write_lock_stat_acquire(lock, LOCK_IP);
 }
 EXPORT_SYMBOL(_write_lock_bh);
 
-void __lockfunc _spin_lock(spinlock_t *lock)
-{
-	preempt_disable();
-	_raw_spin_lock(lock);
-}
-
-EXPORT_SYMBOL(_spin_lock);
-
 void __lockfunc _write_lock(rwlock_t *lock)
 {
 	preempt_disable();
-	_raw_write_lock(lock);
+	if (unlikely(!_raw_write_trylock(lock)))
+		__write_lock_contended(lock, LOCK_IP);
+	write_lock_stat_acquire(lock, LOCK_IP);
 }
 
 EXPORT_SYMBOL(_write_lock);
@@ -179,24 +284,31 @@ EXPORT_SYMBOL(_write_lock);
 #define BUILD_LOCK_OPS(op, locktype)					\
 void __lockfunc _##op##_lock(locktype##_t *lock)			\
 {									\
+	unsigned long long start = 0;					\
+									\
 	for (;;) {							\
 		preempt_disable();					\
 		if (likely(_raw_##op##_trylock(lock)))			\
 			break;						\
 		preempt_enable();					\
 									\
+		lock_stat_begin(start);					\
 		if (!(lock)->break_lock)				\
 			(lock)->break_lock = 1;				\
 		while (!op##_can_lock(lock) && (lock)->break_lock)	\
 			cpu_relax();					\
 	}								\
 	(lock)->break_lock = 0;						\
+	lock_stat_end(lock, op##_lock_stat_kind, start, LOCK_IP);	\
+	op##_lock_stat_acquire(lock, LOCK_IP);				\
 }									\
 									\
 EXPORT_SYMBOL(_##op##_lock);						\
 									\
-unsigned long __lockfunc _##op##_lock_irqsave(locktype##_t *lock)	\
+static unsigned long __lockfunc						\
+__##op##_lock_irqsave(locktype##_t *lock, void *ip)			\
 {									\
+	unsigned long long start = 0;					\
 	unsigned long flags;						\
 									\
 	for (;;) {							\
@@ -207,20 +319,28 @@ unsigned long __lockfunc _##op##_lock_irqsave(locktype##_t *lock)	\
 		local_irq_restore(flags);				\
 		preempt_enable();					\
 									\
+		lock_stat_begin(start);					\
 		if (!(lock)->break_lock)				\
 			(lock)->break_lock = 1;				\
 		while (!op##_can_lock(lock) && (lock)->break_lock)	\
 			cpu_relax();					\
 	}								\
 	(lock)->break_lock = 0;						\
+	lock_stat_end(lock, op##_lock_stat_kind, start, ip);		\
+	op##_lock_stat_acquire(lock, ip);				\
 	return flags;							\
 }									\
 									\
+unsigned long __lockfunc _##op##_lock_irqsave(locktype##_t *lock)	\
+{									\
+	return __##op##_lock_irqsave(lock, LOCK_IP);			\
+}									\
+									\
 EXPORT_SYMBOL(_##op##_lock_irqsave);					\
 									\
 void __lockfunc _##op##_lock_irq(locktype##_t *lock)			\
 {									\
-	_##op##_lock_irqsave(lock);					\
+	__##op##_lock_irqsave(lock, LOCK_IP);				\
 }									\
 									\
 EXPORT_SYMBOL(_##op##_lock_irq);					\
@@ -234,7 +354,7 @@ void __lockfunc _##op##_lock_bh(locktype##_t *lock)			\
 	/* irq-disabling. We use the generic preemption-aware	*/	\
 	/* function:						*/	\
 	/**/								\
-	flags = _##op##_lock_irqsave(lock);				\
+	flags = __##op##_lock_irqsave(lock, LOCK_IP);			\
 	local_bh_disable();						\
 	local_irq_restore(flags);					\
 }									\
@@ -249,8 +369,12 @@ EXPORT_SYMBOL(_##op##_lock_bh)
  *         _[spin|read|write]_lock_irq()
  *         _[spin|read|write]_lock_irqsave()
  *         _[spin|read|write]_lock_bh()
+ *
+ * (ticket spinlocks are built above)
  */
+#ifndef CONFIG_TICKET_SPINLOCKS
 BUILD_LOCK_OPS(spin, spinlock);
+#endif
 BUILD_LOCK_OPS(read, rwlock);
 BUILD_LOCK_OPS(write, rwlock);
 
@@ -258,6 +382,7 @@ BUILD_LOCK_OPS(write, rwlock);
 
 void __lockfunc _spin_unlock(spinlock_t *lock)
 {
+	lock_stat_release(lock);
 	_raw_spin_unlock(lock);
 	preempt_enable();
 }
@@ -265,6 +390,7 @@ EXPORT_SYMBOL(_spin_unlock);
 
 void __lockfunc _write_unlock(rwlock_t *lock)
 {
+	lock_stat_release(lock);
 	_raw_write_unlock(lock);
 	preempt_enable();
 }
@@ -279,6 +405,7 @@ EXPORT_SYMBOL(_read_unlock);
 
 void __lockfunc _spin_unlock_irqrestore(spinlock_t *lock, unsigned long flags)
 {
+	lock_stat_release(lock);
 	_raw_spin_unlock(lock);
 	local_irq_restore(flags);
 	preempt_enable();
@@ -287,6 +414,7 @@ EXPORT_SYMBOL(_spin_unlock_irqrestore);
 
 void __lockfunc _spin_unlock_irq(spinlock_t *lock)
 {
+	lock_stat_release(lock);
 	_raw_spin_unlock(lock);
 	local_irq_enable();
 	preempt_enable();
@@ -295,6 +423,7 @@ EXPORT_SYMBOL(_spin_unlock_irq);
 
 void __lockfunc _spin_unlock_bh(spinlock_t *lock)
 {
+	lock_stat_release(lock);
 	_raw_spin_unlock(lock);
 	preempt_enable_no_resched();
 	local_bh_enable();
@@ -327,6 +456,7 @@ EXPORT_SYMBOL(_read_unlock_bh);
 
 void __lockfunc _write_unlock_irqrestore(rwlock_t *lock, unsigned long flags)
 {
+	lock_stat_release(lock);
 	_raw_write_unlock(lock);
 	local_irq_restore(flags);
 	preempt_enable();
@@ -335,6 +465,7 @@ EXPORT_SYMBOL(_write_unlock_irqrestore);
 
 void __lockfunc _write_unlock_irq(rwlock_t *lock)
 {
+	lock_stat_release(lock);
 	_raw_write_unlock(lock);
 	local_irq_enable();
 	preempt_enable();
@@ -343,6 +474,7 @@ EXPORT_SYMBOL(_write_unlock_irq);
 
 void __lockfunc _write_unlock_bh(rwlock_t *lock)
 {
+	lock_stat_release(lock);
 	_raw_write_unlock(lock);
 	preempt_enable_no_resched();
 	local_bh_enable();
@@ -353,8 +485,10 @@ int __lockfunc _spin_trylock_bh(spinlock_t *lock)
 {
 	local_bh_disable();
 	preempt_disable();
-	if (_raw_spin_trylock(lock))
+	if (_raw_spin_trylock(lock)) {
+		spin_lock_stat_acquire(lock, LOCK_IP);
 		return 1;
+	}
 
 	preempt_enable_no_resched();
 	local_bh_enable();
@@ -34,6 +34,7 @@
 #include <linux/cpu.h>
 #include <linux/syscalls.h>
 #include <linux/delay.h>
+#include <linux/seq_file.h>
 
 #include <asm/uaccess.h>
 #include <asm/unistd.h>
@@ -52,32 +53,66 @@ u64 jiffies_64 __cacheline_aligned_in_smp = INITIAL_JIFFIES;
 EXPORT_SYMBOL(jiffies_64);
 
 /*
- * per-CPU timer vector definitions:
+ * per-CPU timer wheel definitions.
+ *
+ * The wheel has LVL_DEPTH levels of LVL_SIZE buckets each. Level 0 has
+ * a granularity of one jiffy, every further level is LVL_CLK_DIV times
+ * coarser. A timer is queued once, on the level whose range covers its
+ * timeout, in the bucket its expiry time is rounded *up* to, and stays
+ * there until it expires. Timers are never cascaded down into finer
+ * levels, instead a timer on level n may fire up to LVL_GRAN(n) - 1
+ * jiffies late. As a level's range starts at LVL_SIZE - 1 granules of
+ * the level below, that is at most 1/8th of the timeout.
+ *
+ * At HZ=1000 the levels look like this:
+ *
+ *	level	granularity	range
+ *	0	1ms		0 - 62ms
+ *	1	8ms		63ms - 503ms
+ *	2	64ms		504ms - 4s
+ *	3	512ms		4s - 32s
+ *	4	4s		32s - 4m
+ *	5	32s		4m - 34m
+ *	6	4m		34m - 4h
+ *	7	34m		4h - 1d
+ *	8	4h		1d - 12d
+ *
+ * Timers beyond the last level are queued at its end, and queued again
+ * from there until they are due. Most timeouts (TCP retransmits and
+ * keepalives, socket timeouts, ...) are deleted or modified long
+ * before they expire, so never touching them in between saves a lot
+ * of work compared to cascading them, which moved whole buckets under
+ * base->lock every LVL_SIZE jiffies.
  */
-#define TVN_BITS (CONFIG_BASE_SMALL ? 4 : 6)
-#define TVR_BITS (CONFIG_BASE_SMALL ? 6 : 8)
-#define TVN_SIZE (1 << TVN_BITS)
-#define TVR_SIZE (1 << TVR_BITS)
-#define TVN_MASK (TVN_SIZE - 1)
-#define TVR_MASK (TVR_SIZE - 1)
-
-typedef struct tvec_s {
-	struct list_head vec[TVN_SIZE];
-} tvec_t;
+#define LVL_CLK_SHIFT	3
+#define LVL_CLK_DIV	(1UL << LVL_CLK_SHIFT)
+#define LVL_CLK_MASK	(LVL_CLK_DIV - 1)
+#define LVL_SHIFT(n)	((n) * LVL_CLK_SHIFT)
+#define LVL_GRAN(n)	(1UL << LVL_SHIFT(n))
+
+/* First jiffy delta handled by level n: */
+#define LVL_START(n)	((LVL_SIZE - 1) << (((n) - 1) * LVL_CLK_SHIFT))
+
+#define LVL_BITS	6
+#define LVL_SIZE	(1UL << LVL_BITS)
+#define LVL_MASK	(LVL_SIZE - 1)
+#define LVL_OFFS(n)	((n) * LVL_SIZE)
+
+#if HZ > 100
+# define LVL_DEPTH	9
+#else
+# define LVL_DEPTH	8
+#endif
 
-typedef struct tvec_root_s {
-	struct list_head vec[TVR_SIZE];
-} tvec_root_t;
+#define WHEEL_TIMEOUT_CUTOFF	(LVL_START(LVL_DEPTH))
+#define WHEEL_TIMEOUT_MAX	(WHEEL_TIMEOUT_CUTOFF - LVL_GRAN(LVL_DEPTH - 1))
+#define WHEEL_SIZE	(LVL_SIZE * LVL_DEPTH)
 
 struct tvec_t_base_s {
 	spinlock_t lock;
 	struct timer_list *running_timer;
 	unsigned long timer_jiffies;
-	tvec_root_t tv1;
-	tvec_t tv2;
-	tvec_t tv3;
-	tvec_t tv4;
-	tvec_t tv5;
+	struct list_head vectors[WHEEL_SIZE];
 } ____cacheline_aligned_in_smp;
 
 typedef struct tvec_t_base_s tvec_base_t;
@@ -86,6 +121,31 @@ tvec_base_t boot_tvec_bases;
 EXPORT_SYMBOL(boot_tvec_bases);
 static DEFINE_PER_CPU(tvec_base_t *, tvec_bases) = { &boot_tvec_bases };
 
+#ifdef CONFIG_TIMER_HIST
+/*
+ * Per-CPU log2 histograms of the wheel's work, shown in /proc/timer_hist.
+ * Bucket 0 counts zeroes, bucket k counts values in [2^(k-1), 2^k), the
+ * last bucket is open-ended. Only updated by the CPU itself, with
+ * base->lock held.
+ */
+#define TIMER_HIST_BUCKETS	24
+
+struct timer_hist {
+	unsigned int expired[TIMER_HIST_BUCKETS];  /* timers run per jiffy */
+	unsigned int late[TIMER_HIST_BUCKETS];	   /* jiffies past ->expires */
+	unsigned int runtime[TIMER_HIST_BUCKETS];  /* __run_timers, in 1024ns */
+};
+
+static DEFINE_PER_CPU(struct timer_hist, timer_hist);
+
+#define timer_hist_inc(field, val) \
+	(__get_cpu_var(timer_hist).field[log2_bucket(val, TIMER_HIST_BUCKETS)]++)
+#define timer_hist_clock()	sched_clock()
+#else
+#define timer_hist_inc(field, val)	do { (void)(val); } while (0)
+#define timer_hist_clock()	0ULL
+#endif
+
 static inline void set_running_timer(tvec_base_t *base,
 					struct timer_list *timer)
 {
@@ -94,46 +154,74 @@ static inline void set_running_timer(tvec_base_t *base,
 #endif
 }
 
+/*
+ * Bucket of a timer on level lvl. The expiry time is rounded up to the
+ * level's granularity, so the timer never fires early.
+ */
+static inline unsigned int calc_index(unsigned long expires, int lvl)
+{
+	expires = (expires + LVL_GRAN(lvl) - 1) >> LVL_SHIFT(lvl);
+	return LVL_OFFS(lvl) + (expires & LVL_MASK);
+}
+
 static void internal_add_timer(tvec_base_t *base, struct timer_list *timer)
 {
 	unsigned long expires = timer->expires;
-	unsigned long idx = expires - base->timer_jiffies;
-	struct list_head *vec;
-
-	if (idx < TVR_SIZE) {
-		int i = expires & TVR_MASK;
-		vec = base->tv1.vec + i;
-	} else if (idx < 1 << (TVR_BITS + TVN_BITS)) {
-		int i = (expires >> TVR_BITS) & TVN_MASK;
-		vec = base->tv2.vec + i;
-	} else if (idx < 1 << (TVR_BITS + 2 * TVN_BITS)) {
-		int i = (expires >> (TVR_BITS + TVN_BITS)) & TVN_MASK;
-		vec = base->tv3.vec + i;
-	} else if (idx < 1 << (TVR_BITS + 3 * TVN_BITS)) {
-		int i = (expires >> (TVR_BITS + 2 * TVN_BITS)) & TVN_MASK;
-		vec = base->tv4.vec + i;
-	} else if ((signed long) idx < 0) {
+	unsigned long clk = base->timer_jiffies;
+	unsigned long delta = expires - clk;
+	unsigned int idx;
+	int lvl;
+
+	if ((long) delta < 0) {
 		/*
 		 * Can happen if you add a timer with expires == jiffies,
 		 * or you set a timer to go off in the past
 		 */
-		vec = base->tv1.vec + (base->timer_jiffies & TVR_MASK);
+		idx = clk & LVL_MASK;
 	} else {
-		int i;
-		/* If the timeout is larger than 0xffffffff on 64-bit
-		 * architectures then we use the maximum timeout:
-		 */
-		if (idx > 0xffffffffUL) {
-			idx = 0xffffffffUL;
-			expires = idx + base->timer_jiffies;
+		if (delta >= WHEEL_TIMEOUT_CUTOFF) {
+			expires = clk + WHEEL_TIMEOUT_MAX;
+			delta = WHEEL_TIMEOUT_MAX;
 		}
-		i = (expires >> (TVR_BITS + 3 * TVN_BITS)) & TVN_MASK;
-		vec = base->tv5.vec + i;
+		for (lvl = 0; delta >= LVL_START(lvl + 1); lvl++)
+			;
+		idx = calc_index(expires, lvl);
 	}
 	/*
 	 * Timers are FIFO:
 	 */
-	list_add_tail(&timer->entry, vec);
+	list_add_tail(&timer->entry, base->vectors + idx);
+}
+
+/*
+ * Round the expiry time of a timer up so that timers with similar
+ * timeouts end up expiring in the same jiffy: the result is the value
+ * within [expires, expires + slack] with the most trailing zero bits.
+ * A slack of -1 (the default) means 0.4% of the timeout.
+ */
+static inline unsigned long apply_slack(struct timer_list *timer,
+					unsigned long expires)
+{
+	unsigned long expires_limit, mask;
+	int bit;
+
+	if (timer->slack >= 0) {
+		expires_limit = expires + timer->slack;
+	} else {
+		long delta = expires - jiffies;
+
+		if (delta < 256)
+			return expires;
+		expires_limit = expires + delta / 256;
+	}
+	mask = expires ^ expires_limit;
+	if (mask == 0)
+		return expires;
+
+	bit = fls_long(mask) - 1;
+	mask = (1UL << bit) - 1;
+
+	return expires_limit & ~mask;
 }
 
 /***
@@ -146,10 +234,28 @@ static void internal_add_timer(tvec_base_t *base, struct timer_list *timer)
 void fastcall init_timer(struct timer_list *timer)
 {
 	timer->entry.next = NULL;
+	timer->slack = -1;
 	timer->base = per_cpu(tvec_bases, raw_smp_processor_id());
 }
 EXPORT_SYMBOL(init_timer);
 
+/**
+ * set_timer_slack - set the allowed slack for a timer
+ * @timer: the timer to be modified
+ * @slack_hz: the amount of time (in jiffies) allowed for rounding
+ *
+ * mod_timer() may delay the expiry of @timer by up to @slack_hz
+ * jiffies, to have it expire together with other timers and so cut
+ * down the number of timer runs. By default the slack is 0.4% of the
+ * timeout, timers that must not be delayed can set it to 0, timers
+ * that can be delayed a lot to more.
+ */
+void set_timer_slack(struct timer_list *timer, int slack_hz)
+{
+	timer->slack = slack_hz;
+}
+EXPORT_SYMBOL_GPL(set_timer_slack);
+
 static inline void detach_timer(struct timer_list *timer,
 					int clear_pending)
 {
@@ -273,11 +379,16 @@ void add_timer_on(struct timer_list *timer, int cpu)
  * The function returns whether it has modified a pending timer or not.
  * (ie. mod_timer() of an inactive timer returns 0, mod_timer() of an
  * active timer returns 1.)
+ *
+ * The timer may expire later than @expires by its slack, see
+ * set_timer_slack().
  */
 int mod_timer(struct timer_list *timer, unsigned long expires)
 {
 	BUG_ON(!timer->function);
 
+	expires = apply_slack(timer, expires);
+
 	/*
 	 * This is a common optimization triggered by the
 	 * networking code - if the timer is re-modified
@@ -380,59 +491,45 @@ int del_timer_sync(struct timer_list *timer)
 EXPORT_SYMBOL(del_timer_sync);
 #endif
 
-static int cascade(tvec_base_t *base, tvec_t *tv, int index)
+/*
+ * Move the buckets that are due at base->timer_jiffies to 'head': the
+ * current bucket of level 0 and, while the clock is at a multiple of
+ * its granularity, that of the next level.
+ */
+static void collect_expired_timers(tvec_base_t *base, struct list_head *head)
 {
-	/* cascade all the timers from tv up one level */
-	struct list_head *head, *curr;
-
-	head = tv->vec + index;
-	curr = head->next;
-	/*
-	 * We are removing _all_ timers from the list, so we don't  have to
-	 * detach them individually, just clear the list afterwards.
-	 */
-	while (curr != head) {
-		struct timer_list *tmp;
+	unsigned long clk = base->timer_jiffies;
+	int lvl;
 
-		tmp = list_entry(curr, struct timer_list, entry);
-		BUG_ON(tmp->base != base);
-		curr = curr->next;
-		internal_add_timer(base, tmp);
+	for (lvl = 0; lvl < LVL_DEPTH; lvl++) {
+		list_splice_init(base->vectors + LVL_OFFS(lvl) +
+				 (clk & LVL_MASK), head);
+		if (clk & LVL_CLK_MASK)
+			break;
+		clk >>= LVL_CLK_SHIFT;
 	}
-	INIT_LIST_HEAD(head);
-
-	return index;
 }
 
 /***
  * __run_timers - run all expired timers (if any) on this CPU.
  * @base: the timer vector to be processed.
  *
- * This function cascades all vectors and executes all expired timer
- * vectors.
+ * This function executes all expired timer vectors.
  */
-#define INDEX(N) (base->timer_jiffies >> (TVR_BITS + N * TVN_BITS)) & TVN_MASK
-
 static inline void __run_timers(tvec_base_t *base)
 {
 	struct timer_list *timer;
+	unsigned long long start = timer_hist_clock();
 
 	spin_lock_irq(&base->lock);
 	while (time_after_eq(jiffies, base->timer_jiffies)) {
 		struct list_head work_list = LIST_HEAD_INIT(work_list);
 		struct list_head *head = &work_list;
- 		int index = base->timer_jiffies & TVR_MASK;
- 
-		/*
-		 * Cascade timers:
-		 */
-		if (!index &&
-			(!cascade(base, &base->tv2, INDEX(0))) &&
-				(!cascade(base, &base->tv3, INDEX(1))) &&
-					!cascade(base, &base->tv4, INDEX(2)))
-			cascade(base, &base->tv5, INDEX(3));
-		++base->timer_jiffies; 
-		list_splice_init(base->tv1.vec + index, &work_list);
+		unsigned long clk = base->timer_jiffies;
+		unsigned long nr = 0;
+
+		collect_expired_timers(base, head);
+		++base->timer_jiffies;
 		while (!list_empty(head)) {
 			void (*fn)(unsigned long);
 			unsigned long data;
@@ -441,6 +538,18 @@ static inline void __run_timers(tvec_base_t *base)
  			fn = timer->function;
  			data = timer->data;
 
+			/*
+			 * Timers beyond the wheel's range are queued at its
+			 * end: queue them again until they are due.
+			 */
+			if (time_before(clk, timer->expires)) {
+				list_del(&timer->entry);
+				internal_add_timer(base, timer);
+				continue;
+			}
+			timer_hist_inc(late, clk - timer->expires);
+			nr++;
+
 			set_running_timer(base, timer);
 			detach_timer(timer, 1);
 			spin_unlock_irq(&base->lock);
@@ -458,8 +567,11 @@ static inline void __run_timers(tvec_base_t *base)
 			}
 			spin_lock_irq(&base->lock);
 		}
+		timer_hist_inc(expired, nr);
 	}
 	set_running_timer(base, NULL);
+	timer_hist_inc(runtime, (unsigned long)
+		       ((timer_hist_clock() - start) >> 10));
 	spin_unlock_irq(&base->lock);
 }
 
@@ -472,13 +584,10 @@ static inline void __run_timers(tvec_base_t *base)
 unsigned long next_timer_interrupt(void)
 {
 	tvec_base_t *base;
-	struct list_head *list;
-	struct timer_list *nte;
-	unsigned long expires;
+	unsigned long expires, clk, adj;
 	unsigned long hr_expires = MAX_JIFFY_OFFSET;
 	ktime_t hr_delta;
-	tvec_t *varray[4];
-	int i, j;
+	int i, lvl;
 
 	hr_delta = hrtimer_get_next_event();
 	if (hr_delta.tv64 != KTIME_MAX) {
@@ -493,51 +602,28 @@ unsigned long next_timer_interrupt(void)
 	base = __get_cpu_var(tvec_bases);
 	spin_lock(&base->lock);
 	expires = base->timer_jiffies + (LONG_MAX >> 1);
-	list = NULL;
+	clk = base->timer_jiffies;
 
-	/* Look for timer events in tv1. */
-	j = base->timer_jiffies & TVR_MASK;
-	do {
-		list_for_each_entry(nte, base->tv1.vec + j, entry) {
-			expires = nte->expires;
-			if (j < (base->timer_jiffies & TVR_MASK))
-				list = base->tv2.vec + (INDEX(0));
-			goto found;
-		}
-		j = (j + 1) & TVR_MASK;
-	} while (j != (base->timer_jiffies & TVR_MASK));
-
-	/* Check tv2-tv5. */
-	varray[0] = &base->tv2;
-	varray[1] = &base->tv3;
-	varray[2] = &base->tv4;
-	varray[3] = &base->tv5;
-	for (i = 0; i < 4; i++) {
-		j = INDEX(i);
-		do {
-			if (list_empty(varray[i]->vec + j)) {
-				j = (j + 1) & TVN_MASK;
+	/*
+	 * The first non-empty bucket of each level, from the current
+	 * position on. A bucket is due when the clock reaches it at the
+	 * level's granularity; when the clock is not at a multiple of
+	 * that, the level's current bucket has been run already, so the
+	 * search there starts one bucket later.
+	 */
+	for (lvl = 0; lvl < LVL_DEPTH; lvl++) {
+		struct list_head *vec = base->vectors + LVL_OFFS(lvl);
+
+		for (i = 0; i < LVL_SIZE; i++) {
+			if (list_empty(vec + ((clk + i) & LVL_MASK)))
 				continue;
-			}
-			list_for_each_entry(nte, varray[i]->vec + j, entry)
-				if (time_before(nte->expires, expires))
-					expires = nte->expires;
-			if (j < (INDEX(i)) && i < 3)
-				list = varray[i + 1]->vec + (INDEX(i + 1));
-			goto found;
-		} while (j != (INDEX(i)));
-	}
-found:
-	if (list) {
-		/*
-		 * The search wrapped. We need to look at the next list
-		 * from next tv element that would cascade into tv element
-		 * where we found the timer element.
-		 */
-		list_for_each_entry(nte, list, entry) {
-			if (time_before(nte->expires, expires))
-				expires = nte->expires;
+			if (time_before((clk + i) << LVL_SHIFT(lvl), expires))
+				expires = (clk + i) << LVL_SHIFT(lvl);
+			break;
 		}
+		adj = clk & LVL_CLK_MASK ? 1 : 0;
+		clk >>= LVL_CLK_SHIFT;
+		clk += adj;
 	}
 	spin_unlock(&base->lock);
 
@@ -564,6 +650,36 @@ found:
 }
 #endif
 
+#ifdef CONFIG_TIMER_HIST
+#define TIMER_HIST_VERSION 1
+
+static void timer_hist_show(struct seq_file *seq, int cpu, const char *name,
+			    unsigned int *count)
+{
+	seq_printf(seq, "cpu%d %s", cpu, name);
+	seq_put_hist(seq, count, TIMER_HIST_BUCKETS);
+}
+
+static int show_timer_hist(struct seq_file *seq, void *v)
+{
+	int cpu;
+
+	seq_printf(seq, "version %d\n", TIMER_HIST_VERSION);
+	seq_printf(seq, "buckets %d\n", TIMER_HIST_BUCKETS);
+	seq_printf(seq, "levels %d\n", LVL_DEPTH);
+	for_each_online_cpu(cpu) {
+		struct timer_hist *hist = &per_cpu(timer_hist, cpu);
+
+		timer_hist_show(seq, cpu, "expired", hist->expired);
+		timer_hist_show(seq, cpu, "late", hist->late);
+		timer_hist_show(seq, cpu, "runtime", hist->runtime);
+	}
+	return 0;
+}
+
+DEFINE_SEQ_STAT_FILE(timer_hist);
+#endif /* CONFIG_TIMER_HIST */
+
 /******************************************************************/
 
 /*
@@ -1272,14 +1388,8 @@ static int __devinit init_timers_cpu(int cpu)
 	}
 
 	spin_lock_init(&base->lock);
-	for (j = 0; j < TVN_SIZE; j++) {
-		INIT_LIST_HEAD(base->tv5.vec + j);
-		INIT_LIST_HEAD(base->tv4.vec + j);
-		INIT_LIST_HEAD(base->tv3.vec + j);
-		INIT_LIST_HEAD(base->tv2.vec + j);
-	}
-	for (j = 0; j < TVR_SIZE; j++)
-		INIT_LIST_HEAD(base->tv1.vec + j);
+	for (j = 0; j < WHEEL_SIZE; j++)
+		INIT_LIST_HEAD(base->vectors + j);
 
 	base->timer_jiffies = jiffies;
 	return 0;
@@ -1314,14 +1424,8 @@ static void __devinit migrate_timers(int cpu)
 
 	BUG_ON(old_base->running_timer);
 
-	for (i = 0; i < TVR_SIZE; i++)
-		migrate_timer_list(new_base, old_base->tv1.vec + i);
-	for (i = 0; i < TVN_SIZE; i++) {
-		migrate_timer_list(new_base, old_base->tv2.vec + i);
-		migrate_timer_list(new_base, old_base->tv3.vec + i);
-		migrate_timer_list(new_base, old_base->tv4.vec + i);
-		migrate_timer_list(new_base, old_base->tv5.vec + i);
-	}
+	for (i = 0; i < WHEEL_SIZE; i++)
+		migrate_timer_list(new_base, old_base->vectors + i);
 
 	spin_unlock(&old_base->lock);
 	spin_unlock(&new_base->lock);
@@ -45,6 +45,7 @@ struct user_struct root_user = {
 	.processes	= ATOMIC_INIT(1),
 	.files		= ATOMIC_INIT(0),
 	.sigpending	= ATOMIC_INIT(0),
+	.pipe_bufs	= ATOMIC_INIT(0),
 	.mq_bytes	= 0,
 	.locked_shm     = 0,
 #ifdef CONFIG_KEYS
@@ -140,6 +141,7 @@ struct user_struct * alloc_uid(uid_t uid)
 		atomic_set(&new->processes, 0);
 		atomic_set(&new->files, 0);
 		atomic_set(&new->sigpending, 0);
+		atomic_set(&new->pipe_bufs, 0);
 #ifdef CONFIG_INOTIFY
 		atomic_set(&new->inotify_watches, 0);
 		atomic_set(&new->inotify_devs, 0);
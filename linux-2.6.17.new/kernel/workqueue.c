@@ -28,32 +28,133 @@
 #include <linux/notifier.h>
 #include <linux/kthread.h>
 #include <linux/hardirq.h>
+#include <linux/hash.h>
+#include <linux/fs.h>
+#include <linux/seq_file.h>
 
 /*
- * The per-CPU workqueue (if single thread, we always use the first
- * possible cpu).
+ * Works are not run by threads of their own workqueue but by the workers
+ * of shared pools. Every CPU has a pool for normal and one for WQ_HIGHPRI
+ * workqueues, and there is an unbound pool of each kind for WQ_UNBOUND
+ * workqueues. A single threaded workqueue has a private pool with exactly
+ * one worker, that keeps its works strictly ordered.
  *
- * The sequence counters are for flush_scheduled_work().  It wants to wait
- * until until all currently-scheduled works are completed, but it doesn't
- * want to be livelocked by new, incoming ones.  So it waits until
- * remove_sequence is >= the insert_sequence which pertained when
- * flush_scheduled_work() was called.
+ * The per-CPU pools are concurrency managed: the scheduler tells the pool
+ * when one of its workers blocks (wq_worker_sleeping()) and when it runs
+ * again (wq_worker_running()). As long as one worker of the pool is
+ * runnable, further works wait for it; when the last one blocks with
+ * works pending, an idle worker takes over. A worker that starts
+ * processing first makes sure an idle one is left to take over from it,
+ * creating one if needed. Idle workers beyond that are reaped after
+ * IDLE_WORKER_TIMEOUT.
+ *
+ * The unbound pools are not concurrency managed: every pending work gets
+ * a worker of its own, up to max_workers.
  */
-struct cpu_workqueue_struct {
 
-	spinlock_t lock;
+enum {
+	/* pool flags */
+	POOL_UNBOUND		= 1 << 0,	/* not concurrency managed */
+	POOL_SINGLE		= 1 << 1,	/* single thread workqueue pool */
+	POOL_MANAGING		= 1 << 2,	/* a worker creates a worker */
+	POOL_DISASSOCIATED	= 1 << 3,	/* the CPU is down or going down */
+
+	/* worker flags */
+	WORKER_IDLE		= 1 << 0,	/* on the idle list */
+	WORKER_PREP		= 1 << 1,	/* woken, not processing yet */
+	WORKER_SLEEPING		= 1 << 2,	/* blocked inside a work */
+	WORKER_UNBOUND		= 1 << 3,	/* not concurrency managed */
+	WORKER_DIE		= 1 << 4,	/* exit at the next chance */
+
+	WORKER_NOT_RUNNING	= WORKER_IDLE | WORKER_PREP | WORKER_SLEEPING |
+				  WORKER_UNBOUND,
+
+	NR_WORKER_PRIOS		= 2,		/* normal and WQ_HIGHPRI */
+
+	BUSY_WORKER_HASH_ORDER	= 4,
+	BUSY_WORKER_HASH_SIZE	= 1 << BUSY_WORKER_HASH_ORDER,
+
+	MAX_IDLE_WORKERS_RATIO	= 4,		/* 1/4 of the workers may idle */
+	IDLE_WORKER_TIMEOUT	= 300 * HZ,	/* before an idle one is reaped */
+	CREATE_COOLDOWN		= HZ,		/* after kthread_create failed */
+
+	/*
+	 * Works carry the flush color of their cpu_workqueue_struct at the
+	 * time they were queued, see flush_workqueue().
+	 */
+	WORK_NR_COLORS		= 16,
+};
+
+struct worker_pool {
+	spinlock_t		lock;
+	int			cpu;		/* bound CPU, -1 if unbound */
+	unsigned int		flags;		/* POOL_* */
+	int			nice;
+
+	struct list_head	worklist;	/* pending works */
+	int			nr_running;	/* workers not NOT_RUNNING */
+	int			nr_workers;
+	int			nr_idle;
+	int			max_workers;
+	int			next_id;
+	unsigned long		create_retry;	/* no kthread_create before */
+
+	struct list_head	idle_list;	/* most recently idle first */
+	struct list_head	workers;	/* all workers */
+	struct timer_list	idle_timer;	/* reaps idle workers */
+	struct worker		*new_worker;	/* created at CPU_UP_PREPARE */
+
+	/* workers executing a work, hashed by the work */
+	struct hlist_head	busy_hash[BUSY_WORKER_HASH_SIZE];
+
+	const char		*name;		/* of a single thread workqueue */
+} ____cacheline_aligned;
 
-	long remove_sequence;	/* Least-recently added (next to run) */
-	long insert_sequence;	/* Next to add */
+struct worker {
+	struct list_head	entry;		/* on idle_list while idle */
+	struct list_head	node;		/* on pool->workers */
+	struct hlist_node	hentry;		/* on busy_hash while busy */
+	struct work_struct	*current_work;
+	void			(*current_func)(void *);
+	struct cpu_workqueue_struct *current_cwq;
+	int			current_color;
+	struct list_head	scheduled;	/* works to run after current */
+	struct task_struct	*task;
+	struct worker_pool	*pool;
+	unsigned int		flags;		/* WORKER_*, under pool->lock */
+	unsigned long		last_active;	/* when it became idle */
+	int			id;
+};
 
-	struct list_head worklist;
-	wait_queue_head_t more_work;
-	wait_queue_head_t work_done;
+#ifdef CONFIG_WORKQUEUE_STATS
+#define WQ_STATS_BUCKETS	24
+
+/*
+ * Queueing latency (queue_work() to the start of the work) and execution
+ * time, in log2 histograms of 1024ns units.
+ */
+struct cwq_stats {
+	unsigned long		queued;
+	unsigned long		executed;
+	unsigned int		wait[WQ_STATS_BUCKETS];
+	unsigned int		exec[WQ_STATS_BUCKETS];
+};
+#endif
 
+/*
+ * The per-CPU part of a workqueue (if single thread or unbound, we always
+ * use the first possible cpu). It links the workqueue to the pool that
+ * runs its works and counts the works in flight per flush color.
+ */
+struct cpu_workqueue_struct {
+	struct worker_pool *pool;
 	struct workqueue_struct *wq;
-	task_t *thread;
 
-	int run_depth;		/* Detect run_workqueue() recursion depth */
+	int work_color;		/* color of newly queued works */
+	atomic_t nr_in_flight[WORK_NR_COLORS];
+#ifdef CONFIG_WORKQUEUE_STATS
+	struct cwq_stats stats;
+#endif
 } ____cacheline_aligned;
 
 /*
@@ -63,34 +164,204 @@ struct cpu_workqueue_struct {
 struct workqueue_struct {
 	struct cpu_workqueue_struct *cpu_wq;
 	const char *name;
-	struct list_head list; 	/* Empty if single thread */
+	unsigned int flags;	/* WQ_* */
+	struct list_head list;
+
+	spinlock_t flush_lock;
+	unsigned long work_epoch;	/* work_color is work_epoch % NR_COLORS */
+	wait_queue_head_t flush_wait;
+
+	struct worker_pool *single_pool;
 };
 
-/* All the per-cpu workqueues on the system, for hotplug cpu to add/remove
-   threads to each one as cpus come/go. */
+/* All the workqueues on the system, for /proc/workqueue_stat. */
 static DEFINE_SPINLOCK(workqueue_lock);
 static LIST_HEAD(workqueues);
 
 static int singlethread_cpu;
 
-/* If it's single threaded, it isn't in the list of workqueues. */
-static inline int is_single_threaded(struct workqueue_struct *wq)
+static DEFINE_PER_CPU(struct worker_pool [NR_WORKER_PRIOS], bound_pools);
+static struct worker_pool unbound_pools[NR_WORKER_PRIOS];
+
+static inline int wq_is_bound(struct workqueue_struct *wq)
+{
+	return !(wq->flags & (WQ_SINGLE_THREAD | WQ_UNBOUND));
+}
+
+/* The CPUs a workqueue has a cpu_workqueue_struct in use for. */
+#define for_each_cwq_cpu(cpu, wq)					\
+	for ((cpu) = wq_is_bound(wq) ?					\
+			first_cpu(cpu_possible_map) : singlethread_cpu;	\
+	     (cpu) < NR_CPUS;						\
+	     (cpu) = wq_is_bound(wq) ?					\
+			next_cpu((cpu), cpu_possible_map) : NR_CPUS)
+
+static inline struct worker *current_wq_worker(void)
 {
-	return list_empty(&wq->list);
+	if (current->flags & PF_WQ_WORKER)
+		return current->wq_worker;
+	return NULL;
+}
+
+/*
+ * Pool state, all called with pool->lock held.
+ */
+static inline int __need_more_worker(struct worker_pool *pool)
+{
+	return (pool->flags & POOL_UNBOUND) || !pool->nr_running;
+}
+
+/* Works are pending and nobody is running them. */
+static inline int need_more_worker(struct worker_pool *pool)
+{
+	return !list_empty(&pool->worklist) && __need_more_worker(pool);
+}
+
+/* A worker may start processing without creating a new idle one first. */
+static inline int may_start_working(struct worker_pool *pool)
+{
+	return pool->nr_idle || pool->nr_workers >= pool->max_workers ||
+		(pool->flags & (POOL_SINGLE | POOL_DISASSOCIATED)) ||
+		time_before(jiffies, pool->create_retry);
+}
+
+/* A worker that ran a work goes on with the next one. */
+static inline int keep_working(struct worker_pool *pool)
+{
+	return !list_empty(&pool->worklist) &&
+		((pool->flags & POOL_UNBOUND) || pool->nr_running <= 1);
+}
+
+static inline int too_many_idle(struct worker_pool *pool)
+{
+	int nr_busy = pool->nr_workers - pool->nr_idle;
+
+	return pool->nr_idle > 2 &&
+		(pool->nr_idle - 2) * MAX_IDLE_WORKERS_RATIO >= nr_busy;
+}
+
+static void wake_up_worker(struct worker_pool *pool)
+{
+	struct worker *worker;
+
+	if (list_empty(&pool->idle_list))
+		return;
+	worker = list_entry(pool->idle_list.next, struct worker, entry);
+	wake_up_process(worker->task);
+}
+
+/*
+ * Only workers without any WORKER_NOT_RUNNING flag count in
+ * pool->nr_running.
+ */
+static void worker_set_flags(struct worker *worker, unsigned int flags)
+{
+	if (!(worker->flags & WORKER_NOT_RUNNING) &&
+	    (flags & WORKER_NOT_RUNNING))
+		worker->pool->nr_running--;
+	worker->flags |= flags;
+}
+
+static void worker_clr_flags(struct worker *worker, unsigned int flags)
+{
+	unsigned int oflags = worker->flags;
+
+	worker->flags &= ~flags;
+	if ((oflags & WORKER_NOT_RUNNING) &&
+	    !(worker->flags & WORKER_NOT_RUNNING))
+		worker->pool->nr_running++;
+}
+
+static void worker_enter_idle(struct worker *worker)
+{
+	struct worker_pool *pool = worker->pool;
+
+	worker_set_flags(worker, WORKER_IDLE);
+	worker_clr_flags(worker, WORKER_PREP);
+	pool->nr_idle++;
+	worker->last_active = jiffies;
+	list_add(&worker->entry, &pool->idle_list);
+
+	if (too_many_idle(pool) && !timer_pending(&pool->idle_timer))
+		mod_timer(&pool->idle_timer, jiffies + IDLE_WORKER_TIMEOUT);
+}
+
+static void worker_leave_idle(struct worker *worker)
+{
+	struct worker_pool *pool = worker->pool;
+
+	worker_set_flags(worker, WORKER_PREP);
+	if (worker->flags & WORKER_IDLE) {
+		worker_clr_flags(worker, WORKER_IDLE);
+		pool->nr_idle--;
+		list_del_init(&worker->entry);
+	}
 }
 
+/*
+ * Called from schedule() when a worker blocks. If it was the last running
+ * worker of its pool and works are pending, an idle worker takes over.
+ */
+void wq_worker_sleeping(struct task_struct *task)
+{
+	struct worker *worker = task->wq_worker;
+	struct worker_pool *pool = worker->pool;
+	unsigned long flags;
+
+	if (worker->flags & WORKER_NOT_RUNNING)
+		return;
+
+	spin_lock_irqsave(&pool->lock, flags);
+	if (!(worker->flags & WORKER_NOT_RUNNING)) {
+		worker_set_flags(worker, WORKER_SLEEPING);
+		if (need_more_worker(pool))
+			wake_up_worker(pool);
+	}
+	spin_unlock_irqrestore(&pool->lock, flags);
+}
+
+/*
+ * Called at the end of schedule() for a worker.
+ */
+void wq_worker_running(struct task_struct *task)
+{
+	struct worker *worker = task->wq_worker;
+	struct worker_pool *pool = worker->pool;
+	unsigned long flags;
+
+	if (!(worker->flags & WORKER_SLEEPING))
+		return;
+
+	spin_lock_irqsave(&pool->lock, flags);
+	worker_clr_flags(worker, WORKER_SLEEPING);
+	spin_unlock_irqrestore(&pool->lock, flags);
+}
+
+#ifdef CONFIG_WORKQUEUE_STATS
+#define wq_stats_inc(field)		((field)++)
+#define wq_stats_hist(hist, val)	((hist)[log2_bucket(val, WQ_STATS_BUCKETS)]++)
+#define wq_stats_clock()		sched_clock()
+#endif
+
 /* Preempt must be disabled. */
 static void __queue_work(struct cpu_workqueue_struct *cwq,
 			 struct work_struct *work)
 {
+	struct worker_pool *pool = cwq->pool;
 	unsigned long flags;
 
-	spin_lock_irqsave(&cwq->lock, flags);
+	spin_lock_irqsave(&pool->lock, flags);
 	work->wq_data = cwq;
-	list_add_tail(&work->entry, &cwq->worklist);
-	cwq->insert_sequence++;
-	wake_up(&cwq->more_work);
-	spin_unlock_irqrestore(&cwq->lock, flags);
+	work->color = cwq->work_color;
+	atomic_inc(&cwq->nr_in_flight[work->color]);
+#ifdef CONFIG_WORKQUEUE_STATS
+	work->queued = wq_stats_clock();
+	wq_stats_inc(cwq->stats.queued);
+#endif
+	list_add_tail(&work->entry, &pool->worklist);
+	if (__need_more_worker(pool))
+		wake_up_worker(pool);
+	spin_unlock_irqrestore(&pool->lock, flags);
 }
 
 /*
@@ -105,7 +376,7 @@ int fastcall queue_work(struct workqueue_struct *wq, struct work_struct *work)
 	int ret = 0, cpu = get_cpu();
 
 	if (!test_and_set_bit(0, &work->pending)) {
-		if (unlikely(is_single_threaded(wq)))
+		if (!wq_is_bound(wq))
 			cpu = singlethread_cpu;
 		BUG_ON(!list_empty(&work->entry));
 		__queue_work(per_cpu_ptr(wq->cpu_wq, cpu), work);
@@ -115,13 +386,32 @@ int fastcall queue_work(struct workqueue_struct *wq, struct work_struct *work)
 	return ret;
 }
 
+/*
+ * Queue work on a specific CPU. The caller must make sure the CPU does
+ * not go away, for instance by disabling interrupts.
+ */
+int queue_work_on(int cpu, struct workqueue_struct *wq,
+		  struct work_struct *work)
+{
+	int ret = 0;
+
+	if (!test_and_set_bit(0, &work->pending)) {
+		if (!wq_is_bound(wq))
+			cpu = singlethread_cpu;
+		BUG_ON(!list_empty(&work->entry));
+		__queue_work(per_cpu_ptr(wq->cpu_wq, cpu), work);
+		ret = 1;
+	}
+	return ret;
+}
+
 static void delayed_work_timer_fn(unsigned long __data)
 {
 	struct work_struct *work = (struct work_struct *)__data;
 	struct workqueue_struct *wq = work->wq_data;
 	int cpu = smp_processor_id();
 
-	if (unlikely(is_single_threaded(wq)))
+	if (!wq_is_bound(wq))
 		cpu = singlethread_cpu;
 
 	__queue_work(per_cpu_ptr(wq->cpu_wq, cpu), work);
@@ -148,53 +438,142 @@ int fastcall queue_delayed_work(struct workqueue_struct *wq,
 	return ret;
 }
 
-static void run_workqueue(struct cpu_workqueue_struct *cwq)
+static inline struct hlist_head *busy_worker_head(struct worker_pool *pool,
+						  struct work_struct *work)
 {
-	unsigned long flags;
+	return &pool->busy_hash[hash_ptr(work, BUSY_WORKER_HASH_ORDER)];
+}
 
-	/*
-	 * Keep taking off work from the queue until
-	 * done.
-	 */
-	spin_lock_irqsave(&cwq->lock, flags);
-	cwq->run_depth++;
-	if (cwq->run_depth > 3) {
-		/* morton gets to eat his hat */
-		printk("%s: recursion depth exceeded: %d\n",
-			__FUNCTION__, cwq->run_depth);
-		dump_stack();
-	}
-	while (!list_empty(&cwq->worklist)) {
-		struct work_struct *work = list_entry(cwq->worklist.next,
-						struct work_struct, entry);
-		void (*f) (void *) = work->func;
-		void *data = work->data;
-
-		list_del_init(cwq->worklist.next);
-		spin_unlock_irqrestore(&cwq->lock, flags);
-
-		BUG_ON(work->wq_data != cwq);
-		clear_bit(0, &work->pending);
-		f(data);
-
-		spin_lock_irqsave(&cwq->lock, flags);
-		cwq->remove_sequence++;
-		wake_up(&cwq->work_done);
+/*
+ * The worker of the pool currently executing @work, if any. Comparing
+ * the function too keeps a freed and reused work_struct from being
+ * mistaken for the one that is running.
+ */
+static struct worker *find_worker_executing_work(struct hlist_head *bwh,
+						 struct work_struct *work)
+{
+	struct worker *worker;
+	struct hlist_node *pos;
+
+	hlist_for_each_entry(worker, pos, bwh, hentry)
+		if (worker->current_work == work &&
+		    worker->current_func == work->func)
+			return worker;
+	return NULL;
+}
+
+static void cwq_work_done(struct cpu_workqueue_struct *cwq, int color)
+{
+	if (atomic_dec_and_test(&cwq->nr_in_flight[color]) &&
+	    waitqueue_active(&cwq->wq->flush_wait))
+		wake_up(&cwq->wq->flush_wait);
+}
+
+/*
+ * Run one work, called and returning with pool->lock held. A work is
+ * never run by two workers of a pool at the same time: if it is still
+ * running from a previous queueing, it is handed to that worker.
+ */
+static void process_one_work(struct worker *worker, struct work_struct *work)
+{
+	struct worker_pool *pool = worker->pool;
+	struct cpu_workqueue_struct *cwq = work->wq_data;
+	void (*f)(void *) = work->func;
+	void *data = work->data;
+	int color = work->color;
+	struct hlist_head *bwh = NULL;
+	struct worker *collision;
+#ifdef CONFIG_WORKQUEUE_STATS
+	unsigned long long start;
+#endif
+
+	if (!(pool->flags & POOL_SINGLE)) {
+		bwh = busy_worker_head(pool, work);
+		collision = find_worker_executing_work(bwh, work);
+		if (unlikely(collision)) {
+			list_move_tail(&work->entry, &collision->scheduled);
+			return;
+		}
+		hlist_add_head(&worker->hentry, bwh);
 	}
-	cwq->run_depth--;
-	spin_unlock_irqrestore(&cwq->lock, flags);
+	worker->current_work = work;
+	worker->current_func = f;
+	worker->current_cwq = cwq;
+	worker->current_color = color;
+	list_del_init(&work->entry);
+
+	/* unbound pools run the next work in parallel */
+	if (need_more_worker(pool))
+		wake_up_worker(pool);
+
+	spin_unlock_irq(&pool->lock);
+
+#ifdef CONFIG_WORKQUEUE_STATS
+	start = wq_stats_clock();
+	wq_stats_hist(cwq->stats.wait, (start - work->queued) >> 10);
+#endif
+	clear_bit(0, &work->pending);
+	f(data);
+
+	spin_lock_irq(&pool->lock);
+#ifdef CONFIG_WORKQUEUE_STATS
+	wq_stats_inc(cwq->stats.executed);
+	wq_stats_hist(cwq->stats.exec, (wq_stats_clock() - start) >> 10);
+#endif
+	if (bwh)
+		hlist_del_init(&worker->hentry);
+	worker->current_work = NULL;
+	worker->current_func = NULL;
+	worker->current_cwq = NULL;
+	cwq_work_done(cwq, color);
+}
+
+static void process_scheduled_works(struct worker *worker)
+{
+	while (!list_empty(&worker->scheduled))
+		process_one_work(worker, list_entry(worker->scheduled.next,
+						    struct work_struct, entry));
+}
+
+static struct worker *create_worker(struct worker_pool *pool, int bind);
+static void start_worker(struct worker *worker);
+
+/*
+ * Create a worker so that an idle one is left when the caller starts
+ * processing. Only one worker of a pool does this at a time. Returns 1 if
+ * pool->lock was dropped.
+ */
+static int manage_workers(struct worker *worker)
+{
+	struct worker_pool *pool = worker->pool;
+	struct worker *new;
+
+	if (pool->flags & POOL_MANAGING)
+		return 0;
+	pool->flags |= POOL_MANAGING;
+	spin_unlock_irq(&pool->lock);
+
+	new = create_worker(pool, 1);
+
+	spin_lock_irq(&pool->lock);
+	if (new)
+		start_worker(new);
+	else
+		pool->create_retry = jiffies + CREATE_COOLDOWN;
+	pool->flags &= ~POOL_MANAGING;
+	return 1;
 }
 
-static int worker_thread(void *__cwq)
+static int worker_thread(void *__worker)
 {
-	struct cpu_workqueue_struct *cwq = __cwq;
-	DECLARE_WAITQUEUE(wait, current);
+	struct worker *worker = __worker;
+	struct worker_pool *pool = worker->pool;
 	struct k_sigaction sa;
 	sigset_t blocked;
 
 	current->flags |= PF_NOFREEZE;
 
-	set_user_nice(current, -5);
+	set_user_nice(current, pool->nice);
 
 	/* Block and flush all signals */
 	sigfillset(&blocked);
@@ -207,48 +586,230 @@ static int worker_thread(void *__cwq)
 	siginitset(&sa.sa.sa_mask, sigmask(SIGCHLD));
 	do_sigaction(SIGCHLD, &sa, (struct k_sigaction *)0);
 
-	set_current_state(TASK_INTERRUPTIBLE);
-	while (!kthread_should_stop()) {
-		add_wait_queue(&cwq->more_work, &wait);
-		if (list_empty(&cwq->worklist))
+	current->wq_worker = worker;
+	current->flags |= PF_WQ_WORKER;
+
+	spin_lock_irq(&pool->lock);
+	for (;;) {
+		if (unlikely(worker->flags & WORKER_DIE))
+			break;
+		worker_leave_idle(worker);
+
+		if (need_more_worker(pool)) {
+			if (!may_start_working(pool) && manage_workers(worker))
+				continue;
+
+			worker_clr_flags(worker, WORKER_PREP);
+			do {
+				process_one_work(worker,
+					list_entry(pool->worklist.next,
+						   struct work_struct, entry));
+				process_scheduled_works(worker);
+			} while (keep_working(pool) &&
+				 !(worker->flags & WORKER_DIE));
+			continue;
+		}
+
+		if (kthread_should_stop())
+			break;
+
+		worker_enter_idle(worker);
+		__set_current_state(TASK_INTERRUPTIBLE);
+		spin_unlock_irq(&pool->lock);
+		if (!kthread_should_stop())
 			schedule();
-		else
-			__set_current_state(TASK_RUNNING);
-		remove_wait_queue(&cwq->more_work, &wait);
+		__set_current_state(TASK_RUNNING);
+		spin_lock_irq(&pool->lock);
+	}
 
-		if (!list_empty(&cwq->worklist))
-			run_workqueue(cwq);
-		set_current_state(TASK_INTERRUPTIBLE);
+	/* destroy_worker() already took a dying worker off the pool */
+	if (!(worker->flags & WORKER_DIE)) {
+		list_del_init(&worker->node);
+		pool->nr_workers--;
 	}
-	__set_current_state(TASK_RUNNING);
+	spin_unlock_irq(&pool->lock);
+
+	current->flags &= ~PF_WQ_WORKER;
+	current->wq_worker = NULL;
+	kfree(worker);
 	return 0;
 }
 
-static void flush_cpu_workqueue(struct cpu_workqueue_struct *cwq)
+static struct worker *create_worker(struct worker_pool *pool, int bind)
 {
-	if (cwq->thread == current) {
-		/*
-		 * Probably keventd trying to flush its own queue. So simply run
-		 * it by hand rather than deadlocking.
-		 */
-		run_workqueue(cwq);
-	} else {
-		DEFINE_WAIT(wait);
-		long sequence_needed;
+	struct worker *worker;
+	struct task_struct *p;
 
-		spin_lock_irq(&cwq->lock);
-		sequence_needed = cwq->insert_sequence;
+	worker = kzalloc(sizeof(*worker), GFP_KERNEL);
+	if (!worker)
+		return NULL;
+	INIT_LIST_HEAD(&worker->entry);
+	INIT_LIST_HEAD(&worker->node);
+	INIT_HLIST_NODE(&worker->hentry);
+	INIT_LIST_HEAD(&worker->scheduled);
+	worker->pool = pool;
+	worker->flags = WORKER_PREP;
+	if (pool->flags & POOL_UNBOUND)
+		worker->flags |= WORKER_UNBOUND;
+
+	spin_lock_irq(&pool->lock);
+	worker->id = pool->next_id++;
+	spin_unlock_irq(&pool->lock);
+
+	if (pool->flags & POOL_SINGLE)
+		p = kthread_create(worker_thread, worker, "%s", pool->name);
+	else if (pool->cpu < 0)
+		p = kthread_create(worker_thread, worker, "kworker/u:%d%s",
+				   worker->id, pool->nice < -5 ? "H" : "");
+	else
+		p = kthread_create(worker_thread, worker, "kworker/%d:%d%s",
+				   pool->cpu, worker->id,
+				   pool->nice < -5 ? "H" : "");
+	if (IS_ERR(p)) {
+		kfree(worker);
+		return NULL;
+	}
+	worker->task = p;
+	if (bind && pool->cpu >= 0)
+		kthread_bind(p, pool->cpu);
+	return worker;
+}
 
-		while (sequence_needed - cwq->remove_sequence > 0) {
-			prepare_to_wait(&cwq->work_done, &wait,
-					TASK_UNINTERRUPTIBLE);
-			spin_unlock_irq(&cwq->lock);
-			schedule();
-			spin_lock_irq(&cwq->lock);
+/* Add a new worker to the pool as idle and let it run. */
+static void start_worker(struct worker *worker)
+{
+	struct worker_pool *pool = worker->pool;
+
+	pool->nr_workers++;
+	list_add_tail(&worker->node, &pool->workers);
+	worker_enter_idle(worker);
+	wake_up_process(worker->task);
+}
+
+/*
+ * Take a worker off the pool, it exits when it is done with its current
+ * work. Called with pool->lock held.
+ */
+static void destroy_worker(struct worker *worker)
+{
+	struct worker_pool *pool = worker->pool;
+
+	list_del_init(&worker->node);
+	pool->nr_workers--;
+	worker_set_flags(worker, WORKER_DIE | WORKER_UNBOUND);
+	if (worker->flags & WORKER_IDLE) {
+		worker->flags &= ~WORKER_IDLE;
+		pool->nr_idle--;
+		list_del_init(&worker->entry);
+		wake_up_process(worker->task);
+	}
+}
+
+static void idle_worker_timeout(unsigned long __pool)
+{
+	struct worker_pool *pool = (struct worker_pool *)__pool;
+	struct worker *worker;
+	unsigned long expires;
+
+	spin_lock_irq(&pool->lock);
+	while (too_many_idle(pool)) {
+		/* the idle list is ordered, the last one idled longest */
+		worker = list_entry(pool->idle_list.prev, struct worker, entry);
+		expires = worker->last_active + IDLE_WORKER_TIMEOUT;
+		if (time_before(jiffies, expires)) {
+			mod_timer(&pool->idle_timer, expires);
+			break;
 		}
-		finish_wait(&cwq->work_done, &wait);
-		spin_unlock_irq(&cwq->lock);
+		destroy_worker(worker);
 	}
+	spin_unlock_irq(&pool->lock);
+}
+
+static void init_worker_pool(struct worker_pool *pool, int cpu,
+			     unsigned int flags, int highpri)
+{
+	int i;
+
+	spin_lock_init(&pool->lock);
+	pool->cpu = cpu;
+	pool->flags = flags;
+	pool->nice = highpri ? -20 : -5;
+	INIT_LIST_HEAD(&pool->worklist);
+	INIT_LIST_HEAD(&pool->idle_list);
+	INIT_LIST_HEAD(&pool->workers);
+	pool->max_workers = INT_MAX;
+	pool->create_retry = jiffies;
+	setup_timer(&pool->idle_timer, idle_worker_timeout,
+		    (unsigned long)pool);
+	for (i = 0; i < BUSY_WORKER_HASH_SIZE; i++)
+		INIT_HLIST_HEAD(&pool->busy_hash[i]);
+}
+
+/*
+ * Works of @cwq with @color in flight, not counting the one the caller
+ * itself is running.
+ */
+static int cwq_nr_in_flight(struct cpu_workqueue_struct *cwq, int color)
+{
+	struct worker *worker = current_wq_worker();
+	int nr = atomic_read(&cwq->nr_in_flight[color]);
+
+	if (worker && worker->current_cwq == cwq &&
+	    worker->current_color == color)
+		nr--;
+	return nr;
+}
+
+/*
+ * All works queued up to @epoch are done. Epochs more than WORK_NR_COLORS
+ * before the current one are done, flush_workqueue() does not reuse a
+ * color before.
+ */
+static int wq_epoch_done(struct workqueue_struct *wq, unsigned long epoch)
+{
+	unsigned long e = wq->work_epoch - WORK_NR_COLORS + 1;
+	int cpu;
+
+	for (; (long)(epoch - e) >= 0; e++)
+		for_each_cwq_cpu(cpu, wq)
+			if (cwq_nr_in_flight(per_cpu_ptr(wq->cpu_wq, cpu),
+					     e % WORK_NR_COLORS))
+				return 0;
+	return 1;
+}
+
+static int wq_color_busy(struct workqueue_struct *wq, int color)
+{
+	int cpu;
+
+	for_each_cwq_cpu(cpu, wq)
+		if (atomic_read(&per_cpu_ptr(wq->cpu_wq, cpu)->nr_in_flight[color]))
+			return 1;
+	return 0;
+}
+
+/*
+ * The only worker of a single thread workqueue flushing it: run the
+ * pending works by hand rather than deadlocking.
+ */
+static void run_worklist(struct worker *worker)
+{
+	struct worker_pool *pool = worker->pool;
+	struct work_struct *work = worker->current_work;
+	void (*func)(void *) = worker->current_func;
+	struct cpu_workqueue_struct *cwq = worker->current_cwq;
+	int color = worker->current_color;
+
+	spin_lock_irq(&pool->lock);
+	while (!list_empty(&pool->worklist))
+		process_one_work(worker, list_entry(pool->worklist.next,
+						    struct work_struct, entry));
+	spin_unlock_irq(&pool->lock);
+
+	worker->current_work = work;
+	worker->current_func = func;
+	worker->current_cwq = cwq;
+	worker->current_color = color;
 }
 
 /*
@@ -257,62 +818,58 @@ static void flush_cpu_workqueue(struct cpu_workqueue_struct *cwq)
  * Forces execution of the workqueue and blocks until its completion.
  * This is typically used in driver shutdown handlers.
  *
- * This function will sample each workqueue's current insert_sequence number and
- * will sleep until the head sequence is greater than or equal to that.  This
- * means that we sleep until all works which were queued on entry have been
- * handled, but we are not livelocked by new incoming ones.
- *
- * This function used to run the workqueues itself.  Now we just wait for the
- * helper threads to do it.
+ * Newly queued works get the next color and this function waits until no
+ * works of the previous colors are in flight, so it is not livelocked by
+ * new incoming ones. The colors of works the caller itself is running
+ * don't count, so a work may flush its own workqueue. Only when all
+ * colors are in use by concurrent flushes it waits for the new works too.
  */
 void fastcall flush_workqueue(struct workqueue_struct *wq)
 {
+	struct worker *worker = current_wq_worker();
+	unsigned long epoch;
+	int cpu, next;
+
 	might_sleep();
 
-	if (is_single_threaded(wq)) {
-		/* Always use first cpu's area. */
-		flush_cpu_workqueue(per_cpu_ptr(wq->cpu_wq, singlethread_cpu));
-	} else {
-		int cpu;
+	spin_lock_irq(&wq->flush_lock);
+	epoch = wq->work_epoch;
+	next = (epoch + 1) % WORK_NR_COLORS;
+	if (!wq_color_busy(wq, next)) {
+		for_each_cwq_cpu(cpu, wq) {
+			struct cpu_workqueue_struct *cwq;
 
-		lock_cpu_hotplug();
-		for_each_online_cpu(cpu)
-			flush_cpu_workqueue(per_cpu_ptr(wq->cpu_wq, cpu));
-		unlock_cpu_hotplug();
+			cwq = per_cpu_ptr(wq->cpu_wq, cpu);
+			spin_lock(&cwq->pool->lock);
+			cwq->work_color = next;
+			spin_unlock(&cwq->pool->lock);
+		}
+		wq->work_epoch = epoch + 1;
 	}
-}
+	spin_unlock_irq(&wq->flush_lock);
 
-static struct task_struct *create_workqueue_thread(struct workqueue_struct *wq,
-						   int cpu)
-{
-	struct cpu_workqueue_struct *cwq = per_cpu_ptr(wq->cpu_wq, cpu);
-	struct task_struct *p;
+	if (worker && worker->pool == wq->single_pool)
+		run_worklist(worker);
 
-	spin_lock_init(&cwq->lock);
-	cwq->wq = wq;
-	cwq->thread = NULL;
-	cwq->insert_sequence = 0;
-	cwq->remove_sequence = 0;
-	INIT_LIST_HEAD(&cwq->worklist);
-	init_waitqueue_head(&cwq->more_work);
-	init_waitqueue_head(&cwq->work_done);
-
-	if (is_single_threaded(wq))
-		p = kthread_create(worker_thread, cwq, "%s", wq->name);
-	else
-		p = kthread_create(worker_thread, cwq, "%s/%d", wq->name, cpu);
-	if (IS_ERR(p))
-		return NULL;
-	cwq->thread = p;
-	return p;
+	wait_event(wq->flush_wait, wq_epoch_done(wq, epoch));
 }
 
+/**
+ * __create_workqueue - create a workqueue
+ * @name:	name, shown in /proc/workqueue_stat and as the thread name of
+ *		single thread workqueues
+ * @flags:	WQ_SINGLE_THREAD: one dedicated thread runs the works in order
+ *		WQ_UNBOUND: the works may run on any CPU, and as many at
+ *		once as are queued instead of one per CPU
+ *		WQ_HIGHPRI: the works are run by nice -20 workers
+ */
 struct workqueue_struct *__create_workqueue(const char *name,
-					    int singlethread)
+					    unsigned int flags)
 {
-	int cpu, destroy = 0;
+	int cpu, prio = !!(flags & WQ_HIGHPRI);
 	struct workqueue_struct *wq;
-	struct task_struct *p;
+	struct worker_pool *pool;
+	struct worker *worker;
 
 	wq = kzalloc(sizeof(*wq), GFP_KERNEL);
 	if (!wq)
@@ -325,73 +882,68 @@ struct workqueue_struct *__create_workqueue(const char *name,
 	}
 
 	wq->name = name;
-	/* We don't need the distraction of CPUs appearing and vanishing. */
-	lock_cpu_hotplug();
-	if (singlethread) {
-		INIT_LIST_HEAD(&wq->list);
-		p = create_workqueue_thread(wq, singlethread_cpu);
-		if (!p)
-			destroy = 1;
-		else
-			wake_up_process(p);
-	} else {
-		spin_lock(&workqueue_lock);
-		list_add(&wq->list, &workqueues);
-		spin_unlock(&workqueue_lock);
-		for_each_online_cpu(cpu) {
-			p = create_workqueue_thread(wq, cpu);
-			if (p) {
-				kthread_bind(p, cpu);
-				wake_up_process(p);
-			} else
-				destroy = 1;
+	wq->flags = flags;
+	spin_lock_init(&wq->flush_lock);
+	init_waitqueue_head(&wq->flush_wait);
+
+	if (flags & WQ_SINGLE_THREAD) {
+		pool = kmalloc(sizeof(*pool), GFP_KERNEL);
+		if (!pool)
+			goto fail;
+		init_worker_pool(pool, -1, POOL_UNBOUND | POOL_SINGLE, prio);
+		pool->name = name;
+		worker = create_worker(pool, 0);
+		if (!worker) {
+			kfree(pool);
+			goto fail;
 		}
+		spin_lock_irq(&pool->lock);
+		start_worker(worker);
+		spin_unlock_irq(&pool->lock);
+		wq->single_pool = pool;
 	}
-	unlock_cpu_hotplug();
 
-	/*
-	 * Was there any error during startup? If yes then clean up:
-	 */
-	if (destroy) {
-		destroy_workqueue(wq);
-		wq = NULL;
+	for_each_possible_cpu(cpu) {
+		struct cpu_workqueue_struct *cwq = per_cpu_ptr(wq->cpu_wq, cpu);
+
+		cwq->wq = wq;
+		if (flags & WQ_SINGLE_THREAD)
+			cwq->pool = wq->single_pool;
+		else if (flags & WQ_UNBOUND)
+			cwq->pool = &unbound_pools[prio];
+		else
+			cwq->pool = &per_cpu(bound_pools, cpu)[prio];
 	}
-	return wq;
-}
 
-static void cleanup_workqueue_thread(struct workqueue_struct *wq, int cpu)
-{
-	struct cpu_workqueue_struct *cwq;
-	unsigned long flags;
-	struct task_struct *p;
+	spin_lock(&workqueue_lock);
+	list_add_tail(&wq->list, &workqueues);
+	spin_unlock(&workqueue_lock);
+	return wq;
 
-	cwq = per_cpu_ptr(wq->cpu_wq, cpu);
-	spin_lock_irqsave(&cwq->lock, flags);
-	p = cwq->thread;
-	cwq->thread = NULL;
-	spin_unlock_irqrestore(&cwq->lock, flags);
-	if (p)
-		kthread_stop(p);
+fail:
+	free_percpu(wq->cpu_wq);
+	kfree(wq);
+	return NULL;
 }
 
 void destroy_workqueue(struct workqueue_struct *wq)
 {
-	int cpu;
+	struct worker_pool *pool = wq->single_pool;
 
 	flush_workqueue(wq);
 
-	/* We don't need the distraction of CPUs appearing and vanishing. */
-	lock_cpu_hotplug();
-	if (is_single_threaded(wq))
-		cleanup_workqueue_thread(wq, singlethread_cpu);
-	else {
-		for_each_online_cpu(cpu)
-			cleanup_workqueue_thread(wq, cpu);
-		spin_lock(&workqueue_lock);
-		list_del(&wq->list);
-		spin_unlock(&workqueue_lock);
+	spin_lock(&workqueue_lock);
+	list_del(&wq->list);
+	spin_unlock(&workqueue_lock);
+
+	if (pool) {
+		struct worker *worker;
+
+		worker = list_entry(pool->workers.next, struct worker, node);
+		kthread_stop(worker->task);
+		del_timer_sync(&pool->idle_timer);
+		kfree(pool);
 	}
-	unlock_cpu_hotplug();
 	free_percpu(wq->cpu_wq);
 	kfree(wq);
 }
@@ -512,38 +1064,88 @@ int keventd_up(void)
 
 int current_is_keventd(void)
 {
-	struct cpu_workqueue_struct *cwq;
-	int cpu = smp_processor_id();	/* preempt-safe: keventd is per-cpu */
-	int ret = 0;
+	struct worker *worker = current_wq_worker();
 
 	BUG_ON(!keventd_wq);
 
-	cwq = per_cpu_ptr(keventd_wq->cpu_wq, cpu);
-	if (current == cwq->thread)
-		ret = 1;
+	return worker && worker->current_cwq &&
+		worker->current_cwq->wq == keventd_wq;
+}
 
-	return ret;
+static void __devinit start_bound_workers(int cpu)
+{
+	struct worker_pool *pool;
+	int prio;
+
+	for (prio = 0; prio < NR_WORKER_PRIOS; prio++) {
+		pool = &per_cpu(bound_pools, cpu)[prio];
+		if (!pool->new_worker)
+			continue;
+		kthread_bind(pool->new_worker->task, cpu);
+		spin_lock_irq(&pool->lock);
+		pool->flags &= ~POOL_DISASSOCIATED;
+		start_worker(pool->new_worker);
+		pool->new_worker = NULL;
+		spin_unlock_irq(&pool->lock);
+	}
+}
 
+static int __devinit create_bound_workers(int cpu)
+{
+	struct worker_pool *pool;
+	int prio;
+
+	for (prio = 0; prio < NR_WORKER_PRIOS; prio++) {
+		pool = &per_cpu(bound_pools, cpu)[prio];
+		if (pool->nr_workers || pool->new_worker)
+			continue;
+		pool->new_worker = create_worker(pool, 0);
+		if (!pool->new_worker) {
+			printk("workqueue for %i failed\n", cpu);
+			return -ENOMEM;
+		}
+	}
+	return 0;
 }
 
 #ifdef CONFIG_HOTPLUG_CPU
-/* Take the work from this (downed) CPU. */
-static void take_over_work(struct workqueue_struct *wq, unsigned int cpu)
+/*
+ * No more workers are created for the pool of a CPU going down, wait for
+ * one that is being created.
+ */
+static void disassociate_pool(struct worker_pool *pool)
 {
-	struct cpu_workqueue_struct *cwq = per_cpu_ptr(wq->cpu_wq, cpu);
-	LIST_HEAD(list);
-	struct work_struct *work;
+	spin_lock_irq(&pool->lock);
+	pool->flags |= POOL_DISASSOCIATED;
+	while (pool->flags & POOL_MANAGING) {
+		spin_unlock_irq(&pool->lock);
+		schedule_timeout_uninterruptible(1);
+		spin_lock_irq(&pool->lock);
+	}
+	spin_unlock_irq(&pool->lock);
+}
 
-	spin_lock_irq(&cwq->lock);
-	list_splice_init(&cwq->worklist, &list);
+/*
+ * Take the work from this (downed) CPU, and let its workers exit once
+ * they are done with what they are running. The works keep their
+ * cpu_workqueue_struct, so flushing still waits for them.
+ */
+static void take_over_work(struct worker_pool *pool, struct worker_pool *to)
+{
+	LIST_HEAD(list);
 
-	while (!list_empty(&list)) {
-		printk("Taking work for %s\n", wq->name);
-		work = list_entry(list.next,struct work_struct,entry);
-		list_del(&work->entry);
-		__queue_work(per_cpu_ptr(wq->cpu_wq, smp_processor_id()), work);
-	}
-	spin_unlock_irq(&cwq->lock);
+	spin_lock_irq(&pool->lock);
+	while (!list_empty(&pool->workers))
+		destroy_worker(list_entry(pool->workers.next,
+					  struct worker, node));
+	list_splice_init(&pool->worklist, &list);
+	spin_unlock_irq(&pool->lock);
+
+	spin_lock_irq(&to->lock);
+	list_splice(&list, to->worklist.prev);
+	if (need_more_worker(to))
+		wake_up_worker(to);
+	spin_unlock_irq(&to->lock);
 }
 
 /* We're holding the cpucontrol mutex here */
@@ -552,44 +1154,52 @@ static int workqueue_cpu_callback(struct notifier_block *nfb,
 				  void *hcpu)
 {
 	unsigned int hotcpu = (unsigned long)hcpu;
-	struct workqueue_struct *wq;
+	struct worker_pool *pool;
+	int prio, cpu;
 
 	switch (action) {
 	case CPU_UP_PREPARE:
-		/* Create a new workqueue thread for it. */
-		list_for_each_entry(wq, &workqueues, list) {
-			if (!create_workqueue_thread(wq, hotcpu)) {
-				printk("workqueue for %i failed\n", hotcpu);
-				return NOTIFY_BAD;
-			}
-		}
+		/* Create the first workers of its pools. */
+		if (create_bound_workers(hotcpu))
+			return NOTIFY_BAD;
 		break;
 
 	case CPU_ONLINE:
 		/* Kick off worker threads. */
-		list_for_each_entry(wq, &workqueues, list) {
-			struct cpu_workqueue_struct *cwq;
+		start_bound_workers(hotcpu);
+		break;
 
-			cwq = per_cpu_ptr(wq->cpu_wq, hotcpu);
-			kthread_bind(cwq->thread, hotcpu);
-			wake_up_process(cwq->thread);
+	case CPU_UP_CANCELED:
+		for (prio = 0; prio < NR_WORKER_PRIOS; prio++) {
+			pool = &per_cpu(bound_pools, hotcpu)[prio];
+			if (pool->new_worker) {
+				/* never woken, it exits without running */
+				kthread_stop(pool->new_worker->task);
+				kfree(pool->new_worker);
+				pool->new_worker = NULL;
+			}
 		}
 		break;
 
-	case CPU_UP_CANCELED:
-		list_for_each_entry(wq, &workqueues, list) {
-			/* Unbind so it can run. */
-			kthread_bind(per_cpu_ptr(wq->cpu_wq, hotcpu)->thread,
-				     any_online_cpu(cpu_online_map));
-			cleanup_workqueue_thread(wq, hotcpu);
+	case CPU_DOWN_PREPARE:
+		for (prio = 0; prio < NR_WORKER_PRIOS; prio++)
+			disassociate_pool(&per_cpu(bound_pools, hotcpu)[prio]);
+		break;
+
+	case CPU_DOWN_FAILED:
+		for (prio = 0; prio < NR_WORKER_PRIOS; prio++) {
+			pool = &per_cpu(bound_pools, hotcpu)[prio];
+			spin_lock_irq(&pool->lock);
+			pool->flags &= ~POOL_DISASSOCIATED;
+			spin_unlock_irq(&pool->lock);
 		}
 		break;
 
 	case CPU_DEAD:
-		list_for_each_entry(wq, &workqueues, list)
-			cleanup_workqueue_thread(wq, hotcpu);
-		list_for_each_entry(wq, &workqueues, list)
-			take_over_work(wq, hotcpu);
+		cpu = any_online_cpu(cpu_online_map);
+		for (prio = 0; prio < NR_WORKER_PRIOS; prio++)
+			take_over_work(&per_cpu(bound_pools, hotcpu)[prio],
+				       &per_cpu(bound_pools, cpu)[prio]);
 		break;
 	}
 
@@ -599,14 +1209,103 @@ static int workqueue_cpu_callback(struct notifier_block *nfb,
 
 void init_workqueues(void)
 {
+	int cpu, prio;
+
 	singlethread_cpu = first_cpu(cpu_possible_map);
+	for (prio = 0; prio < NR_WORKER_PRIOS; prio++) {
+		struct worker_pool *pool = &unbound_pools[prio];
+
+		for_each_possible_cpu(cpu)
+			init_worker_pool(&per_cpu(bound_pools, cpu)[prio], cpu,
+					 POOL_DISASSOCIATED, prio);
+
+		init_worker_pool(pool, -1, POOL_UNBOUND, prio);
+		pool->max_workers = max(512, 4 * num_possible_cpus());
+		pool->new_worker = create_worker(pool, 0);
+		BUG_ON(!pool->new_worker);
+		spin_lock_irq(&pool->lock);
+		start_worker(pool->new_worker);
+		pool->new_worker = NULL;
+		spin_unlock_irq(&pool->lock);
+	}
+	for_each_online_cpu(cpu) {
+		BUG_ON(create_bound_workers(cpu));
+		start_bound_workers(cpu);
+	}
 	hotcpu_notifier(workqueue_cpu_callback, 0);
 	keventd_wq = create_workqueue("events");
 	BUG_ON(!keventd_wq);
 }
 
+#ifdef CONFIG_WORKQUEUE_STATS
+#define WORKQUEUE_STAT_VERSION 1
+
+static void wq_stat_hist(struct seq_file *seq, const char *name,
+			 const char *where, const char *what,
+			 unsigned int *count)
+{
+	seq_printf(seq, "wq %s %s %s", name, where, what);
+	seq_put_hist(seq, count, WQ_STATS_BUCKETS);
+}
+
+static void wq_stat_pool(struct seq_file *seq, const char *where, int prio,
+			 struct worker_pool *pool)
+{
+	seq_printf(seq, "pool %s %s workers %d idle %d running %d\n", where,
+		   prio ? "highpri" : "normal", pool->nr_workers,
+		   pool->nr_idle, pool->nr_running);
+}
+
+static int show_workqueue_stat(struct seq_file *seq, void *v)
+{
+	struct workqueue_struct *wq;
+	char where[16];
+	int cpu, prio;
+
+	seq_printf(seq, "version %d\n", WORKQUEUE_STAT_VERSION);
+	seq_printf(seq, "buckets %d\n", WQ_STATS_BUCKETS);
+	for_each_online_cpu(cpu) {
+		sprintf(where, "cpu%d", cpu);
+		for (prio = 0; prio < NR_WORKER_PRIOS; prio++)
+			wq_stat_pool(seq, where, prio,
+				     &per_cpu(bound_pools, cpu)[prio]);
+	}
+	for (prio = 0; prio < NR_WORKER_PRIOS; prio++)
+		wq_stat_pool(seq, "unbound", prio, &unbound_pools[prio]);
+
+	spin_lock(&workqueue_lock);
+	list_for_each_entry(wq, &workqueues, list) {
+		for_each_cwq_cpu(cpu, wq) {
+			struct cpu_workqueue_struct *cwq;
+
+			cwq = per_cpu_ptr(wq->cpu_wq, cpu);
+			if (!cpu_online(cpu) && !cwq->stats.queued)
+				continue;
+			if (wq->flags & WQ_SINGLE_THREAD)
+				strcpy(where, "single");
+			else if (wq->flags & WQ_UNBOUND)
+				strcpy(where, "unbound");
+			else
+				sprintf(where, "cpu%d", cpu);
+			seq_printf(seq, "wq %s %s queued %lu executed %lu\n",
+				   wq->name, where, cwq->stats.queued,
+				   cwq->stats.executed);
+			wq_stat_hist(seq, wq->name, where, "wait",
+				     cwq->stats.wait);
+			wq_stat_hist(seq, wq->name, where, "exec",
+				     cwq->stats.exec);
+		}
+	}
+	spin_unlock(&workqueue_lock);
+	return 0;
+}
+
+DEFINE_SEQ_STAT_FILE(workqueue_stat);
+#endif /* CONFIG_WORKQUEUE_STATS */
+
 EXPORT_SYMBOL_GPL(__create_workqueue);
 EXPORT_SYMBOL_GPL(queue_work);
+EXPORT_SYMBOL_GPL(queue_work_on);
 EXPORT_SYMBOL_GPL(queue_delayed_work);
 EXPORT_SYMBOL_GPL(flush_workqueue);
 EXPORT_SYMBOL_GPL(destroy_workqueue);
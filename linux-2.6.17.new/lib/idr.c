@@ -22,12 +22,19 @@
  * don't need to go to the memory "store" during an id allocate, just
  * so you don't need to be too concerned about locking and conflicts
  * with the slab allocator.
+ *
+ * idr_find() and idr_get_next() may run under rcu_read_lock() while the
+ * tree is being changed: layers and pointers are published with
+ * rcu_assign_pointer(), and layers taken out of the tree are only freed
+ * after a grace period. Every layer knows its height, so a lookup never
+ * depends on idp->layers matching the top it found.
  */
 
 #ifndef TEST                        // to test in user space...
 #include <linux/slab.h>
 #include <linux/init.h>
 #include <linux/module.h>
+#include <linux/err.h>
 #endif
 #include <linux/string.h>
 #include <linux/idr.h>
@@ -60,6 +67,35 @@ static void free_layer(struct idr *idp, struct idr_layer *p)
 	spin_unlock(&idp->lock);
 }
 
+static void idr_layer_rcu_free(struct rcu_head *head)
+{
+	struct idr_layer *layer;
+
+	layer = container_of(head, struct idr_layer, rcu_head);
+	/* the cache hands out zeroed layers */
+	memset(layer, 0, sizeof(*layer));
+	kmem_cache_free(idr_layer_cache, layer);
+}
+
+/*
+ * A layer taken out of the tree may still be walked by lockless
+ * lookups, free it after a grace period:
+ */
+static void free_layer_rcu(struct idr_layer *p)
+{
+	call_rcu(&p->rcu_head, idr_layer_rcu_free);
+}
+
+/*
+ * The largest id a tree with its top at 'layer' can hold:
+ */
+static inline int idr_max(int layer)
+{
+	int bits = min_t(int, (layer + 1) * IDR_BITS, MAX_ID_SHIFT);
+
+	return (1 << bits) - 1;
+}
+
 /**
  * idr_pre_get - reserver resources for idr allocation
  * @idp:	idr handle
@@ -128,7 +164,8 @@ static int sub_alloc(struct idr *idp, void *ptr, int *starting_id)
 		if (!p->ary[m]) {
 			if (!(new = alloc_layer(idp)))
 				return -1;
-			p->ary[m] = new;
+			new->layer = l - 1;
+			rcu_assign_pointer(p->ary[m], new);
 			p->count++;
 		}
 		pa[l--] = p;
@@ -138,7 +175,7 @@ static int sub_alloc(struct idr *idp, void *ptr, int *starting_id)
 	 * We have reached the leaf node, plant the
 	 * users pointer and return the raw id.
 	 */
-	p->ary[m] = (struct idr_layer *)ptr;
+	rcu_assign_pointer(p->ary[m], (struct idr_layer *)ptr);
 	__set_bit(m, &p->bitmap);
 	p->count++;
 	/*
@@ -169,6 +206,7 @@ build_up:
 	if (unlikely(!p)) {
 		if (!(p = alloc_layer(idp)))
 			return -1;
+		p->layer = 0;
 		layers = 1;
 	}
 	/*
@@ -177,8 +215,11 @@ build_up:
 	 */
 	while ((layers < (MAX_LEVEL - 1)) && (id >= (1 << (layers*IDR_BITS)))) {
 		layers++;
-		if (!p->count)
+		if (!p->count) {
+			/* an empty layer can just become higher */
+			p->layer++;
 			continue;
+		}
 		if (!(new = alloc_layer(idp))) {
 			/*
 			 * The allocation failed.  If we built part of
@@ -187,18 +228,19 @@ build_up:
 			for (new = p; p && p != idp->top; new = p) {
 				p = p->ary[0];
 				new->ary[0] = NULL;
-				new->bitmap = new->count = 0;
+				new->bitmap = new->count = new->layer = 0;
 				free_layer(idp, new);
 			}
 			return -1;
 		}
 		new->ary[0] = p;
 		new->count = 1;
+		new->layer = layers - 1;
 		if (p->bitmap == IDR_FULL)
 			__set_bit(0, &new->bitmap);
 		p = new;
 	}
-	idp->top = p;
+	rcu_assign_pointer(idp->top, p);
 	idp->layers = layers;
 	v = sub_alloc(idp, ptr, &id);
 	if (v == -2)
@@ -305,7 +347,7 @@ static void sub_remove(struct idr *idp, int shift, int id)
 		__clear_bit(n, &p->bitmap);
 		p->ary[n] = NULL;
 		while(*paa && ! --((**paa)->count)){
-			free_layer(idp, **paa);
+			free_layer_rcu(**paa);
 			**paa-- = NULL;
 		}
 		if (!*paa)
@@ -321,7 +363,7 @@ static void sub_remove(struct idr *idp, int shift, int id)
  */
 void idr_remove(struct idr *idp, int id)
 {
-	struct idr_layer *p;
+	struct idr_layer *p, *to_free;
 
 	/* Mask off upper bits we don't use for the search. */
 	id &= MAX_ID_MASK;
@@ -330,11 +372,13 @@ void idr_remove(struct idr *idp, int id)
 	if (idp->top && idp->top->count == 1 && (idp->layers > 1) &&
 	    idp->top->ary[0]) {  // We can drop a layer
 
-		p = idp->top->ary[0];
-		idp->top->bitmap = idp->top->count = 0;
-		free_layer(idp, idp->top);
-		idp->top = p;
+		/* lookups may still walk from the old top to p */
+		to_free = idp->top;
+		p = to_free->ary[0];
+		rcu_assign_pointer(idp->top, p);
 		--idp->layers;
+		to_free->bitmap = to_free->count = 0;
+		free_layer_rcu(to_free);
 	}
 	while (idp->id_free_cnt >= IDR_FREE_MAX) {
 		p = alloc_layer(idp);
@@ -366,30 +410,121 @@ EXPORT_SYMBOL(idr_destroy);
  * return indicates that @id is not valid or you passed %NULL in
  * idr_get_new().
  *
- * The caller must serialize idr_find() vs idr_get_new() and idr_remove().
+ * The caller must either serialize idr_find() vs idr_get_new() and
+ * idr_remove(), or hold rcu_read_lock() and take care that the object
+ * found is not freed before a grace period.
  */
 void *idr_find(struct idr *idp, int id)
 {
 	int n;
 	struct idr_layer *p;
 
-	n = idp->layers * IDR_BITS;
-	p = idp->top;
+	p = rcu_dereference(idp->top);
+	if (!p)
+		return NULL;
+	n = (p->layer + 1) * IDR_BITS;
 
 	/* Mask off upper bits we don't use for the search. */
 	id &= MAX_ID_MASK;
 
-	if (id >= (1 << n))
+	if (id > idr_max(p->layer))
 		return NULL;
 
 	while (n > 0 && p) {
 		n -= IDR_BITS;
-		p = p->ary[(id >> n) & IDR_MASK];
+		p = rcu_dereference(p->ary[(id >> n) & IDR_MASK]);
 	}
 	return((void *)p);
 }
 EXPORT_SYMBOL(idr_find);
 
+/**
+ * idr_get_next - return the next pointer at or above a given id
+ * @idp: idr handle
+ * @nextid: where to start, set to the id found
+ *
+ * Return the pointer registered with the lowest id at or above @nextid
+ * and store that id in @nextid, or return %NULL if there is none.
+ * Ids registered with a %NULL pointer are skipped. Iterate in id order
+ * by calling it again with @nextid + 1.
+ *
+ * The same locking rules as for idr_find() apply.
+ */
+void *idr_get_next(struct idr *idp, int *nextid)
+{
+	struct idr_layer *top, *p;
+	unsigned int id = *nextid, max;
+	int n;
+
+	top = rcu_dereference(idp->top);
+	if (!top || *nextid < 0)
+		return NULL;
+	max = idr_max(top->layer);
+
+	while (id <= max) {
+		n = (top->layer + 1) * IDR_BITS;
+		p = top;
+		while (n > 0 && p) {
+			n -= IDR_BITS;
+			p = rcu_dereference(p->ary[(id >> n) & IDR_MASK]);
+		}
+		if (p) {
+			*nextid = id;
+			return p;
+		}
+		/* nothing below the empty slot, skip all of its ids */
+		id = (id | ((1U << n) - 1)) + 1;
+	}
+	return NULL;
+}
+EXPORT_SYMBOL(idr_get_next);
+
+/**
+ * idr_replace - replace the pointer for a given id
+ * @idp: idr handle
+ * @ptr: the new pointer
+ * @id: lookup key
+ *
+ * Register @ptr with an allocated @id and return the old pointer, or
+ * ERR_PTR(-ENOENT) if @id is not allocated. Lockless idr_find() calls
+ * see either pointer. Ids can be allocated with a %NULL pointer, and
+ * the object published with idr_replace() once it is set up.
+ *
+ * The caller must serialize idr_replace() vs idr_get_new() and
+ * idr_remove().
+ */
+void *idr_replace(struct idr *idp, void *ptr, int id)
+{
+	int n;
+	struct idr_layer *p, *old_p;
+
+	p = idp->top;
+	if (!p)
+		return ERR_PTR(-ENOENT);
+	n = (p->layer + 1) * IDR_BITS;
+
+	id &= MAX_ID_MASK;
+
+	if (id > idr_max(p->layer))
+		return ERR_PTR(-ENOENT);
+
+	n -= IDR_BITS;
+	while ((n > 0) && p) {
+		p = p->ary[(id >> n) & IDR_MASK];
+		n -= IDR_BITS;
+	}
+
+	n = id & IDR_MASK;
+	if (unlikely(p == NULL || !test_bit(n, &p->bitmap)))
+		return ERR_PTR(-ENOENT);
+
+	old_p = (void *)p->ary[n];
+	rcu_assign_pointer(p->ary[n], (struct idr_layer *)ptr);
+
+	return old_p;
+}
+EXPORT_SYMBOL(idr_replace);
+
 static void idr_cache_ctor(void * idr_layer, kmem_cache_t *idr_layer_cache,
 		unsigned long flags)
 {
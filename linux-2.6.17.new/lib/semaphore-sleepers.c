@@ -16,6 +16,7 @@
 #include <linux/sched.h>
 #include <linux/err.h>
 #include <linux/init.h>
+#include <linux/module.h>
 #include <asm/semaphore.h>
 
 /*
@@ -146,6 +147,37 @@ fastcall int __sched __down_interruptible(struct semaphore * sem)
 	return retval;
 }
 
+#ifdef CONFIG_LOCK_STAT
+/*
+ * down() and down_interruptible() call these rather than the asm stubs
+ * when they find the semaphore taken, so that the contention point is
+ * their caller and not __down_failed.
+ */
+fastcall void __sched lock_stat_down(struct semaphore *sem)
+{
+	unsigned long long start = 0;
+
+	lock_stat_begin(start);
+	__down(sem);
+	lock_stat_end_keyless(sem, LOCK_STAT_SEM, start,
+			      __builtin_return_address(0));
+}
+EXPORT_SYMBOL(lock_stat_down);
+
+fastcall int __sched lock_stat_down_interruptible(struct semaphore *sem)
+{
+	unsigned long long start = 0;
+	int ret;
+
+	lock_stat_begin(start);
+	ret = __down_interruptible(sem);
+	lock_stat_end_keyless(sem, LOCK_STAT_SEM, start,
+			      __builtin_return_address(0));
+	return ret;
+}
+EXPORT_SYMBOL(lock_stat_down_interruptible);
+#endif
+
 /*
  * Trylock failed - make sure we correct for
  * having decremented the count.
@@ -544,6 +544,54 @@ void fastcall __lock_page(struct page *page)
 }
 EXPORT_SYMBOL(__lock_page);
 
+/*
+ * Queue the AIO wait @wait to be woken when @page is unlocked. Returns
+ * 0 if the page is unlocked already, with @wait off the queue again, or
+ * -EIOCBRETRY, and the iocb is kicked by the unlock. The wait is not
+ * exclusive: an iocb kicked for a page it then no longer needs must not
+ * take the wakeup of a task sleeping in lock_page().
+ */
+static int wait_on_page_locked_async(struct page *page, wait_queue_t *wait)
+{
+	struct wait_bit_queue *wb = container_of(wait, struct wait_bit_queue,
+						 wait);
+	wait_queue_head_t *wq = page_waitqueue(page);
+
+	wb->key.flags = &page->flags;
+	wb->key.bit_nr = PG_locked;
+	prepare_to_wait(wq, wait, TASK_RUNNING);
+	if (!PageLocked(page)) {
+		finish_wait(wq, wait);
+		return 0;
+	}
+	sync_page(&page->flags);
+	return -EIOCBRETRY;
+}
+
+/*
+ * Get a lock on the page from an AIO retry. Rather than sleeping, queue
+ * the iocb on the page and return -EIOCBRETRY: the caller backs out, and
+ * the retry starts over when the page is unlocked. Outside AIO retries,
+ * sleeps like __lock_page() and returns 0.
+ */
+int fastcall __lock_page_async(struct page *page)
+{
+	wait_queue_t *wait = current->io_wait;
+	int ret;
+
+	if (is_sync_wait(wait)) {
+		__lock_page(page);
+		return 0;
+	}
+	while (TestSetPageLocked(page)) {
+		ret = wait_on_page_locked_async(page, wait);
+		if (ret)
+			return ret;
+	}
+	return 0;
+}
+EXPORT_SYMBOL(__lock_page_async);
+
 /*
  * a rather lightweight function, finding and getting a reference to a
  * hashed page atomically.
@@ -891,8 +939,13 @@ page_ok:
 		goto out;
 
 page_not_up_to_date:
-		/* Get exclusive access to the page ... */
-		lock_page(page);
+		/*
+		 * Get exclusive access to the page ... An AIO read backs
+		 * out here and is retried when the page is unlocked.
+		 */
+		error = lock_page_async(page);
+		if (unlikely(error))
+			goto readpage_error;
 
 		/* Did it get unhashed before we got the lock? */
 		if (!page->mapping) {
@@ -920,7 +973,9 @@ readpage:
 		}
 
 		if (!PageUptodate(page)) {
-			lock_page(page);
+			error = lock_page_async(page);
+			if (unlikely(error))
+				goto readpage_error;
 			if (!PageUptodate(page)) {
 				if (page->mapping == NULL) {
 					/*
@@ -965,7 +1020,11 @@ readpage:
 		goto page_ok;
 
 readpage_error:
-		/* UHHUH! A synchronous read error occurred. Report it */
+		/*
+		 * UHHUH! A synchronous read error occurred. Report it. Or
+		 * -EIOCBRETRY, for the AIO retry to report what was read so
+		 * far and come back.
+		 */
 		desc->error = error;
 		page_cache_release(page);
 		goto out;
@@ -2248,21 +2307,20 @@ generic_file_write_nolock(struct file *file, const struct iovec *iov,
 }
 EXPORT_SYMBOL(generic_file_write_nolock);
 
-ssize_t generic_file_aio_write(struct kiocb *iocb, const char __user *buf,
-			       size_t count, loff_t pos)
+/*
+ * generic_file_aio_write() for several buffers, as for IOCB_CMD_PWRITEV
+ */
+ssize_t generic_file_aio_writev(struct kiocb *iocb, const struct iovec *iov,
+				unsigned long nr_segs, loff_t *ppos)
 {
 	struct file *file = iocb->ki_filp;
 	struct address_space *mapping = file->f_mapping;
 	struct inode *inode = mapping->host;
+	loff_t pos = *ppos;
 	ssize_t ret;
-	struct iovec local_iov = { .iov_base = (void __user *)buf,
-					.iov_len = count };
-
-	BUG_ON(iocb->ki_pos != pos);
 
 	mutex_lock(&inode->i_mutex);
-	ret = __generic_file_aio_write_nolock(iocb, &local_iov, 1,
-						&iocb->ki_pos);
+	ret = __generic_file_aio_write_nolock(iocb, iov, nr_segs, ppos);
 	mutex_unlock(&inode->i_mutex);
 
 	if (ret > 0 && ((file->f_flags & O_SYNC) || IS_SYNC(inode))) {
@@ -2274,6 +2332,17 @@ ssize_t generic_file_aio_write(struct kiocb *iocb, const char __user *buf,
 	}
 	return ret;
 }
+EXPORT_SYMBOL(generic_file_aio_writev);
+
+ssize_t generic_file_aio_write(struct kiocb *iocb, const char __user *buf,
+			       size_t count, loff_t pos)
+{
+	struct iovec local_iov = { .iov_base = (void __user *)buf,
+					.iov_len = count };
+
+	BUG_ON(iocb->ki_pos != pos);
+	return generic_file_aio_writev(iocb, &local_iov, 1, &iocb->ki_pos);
+}
 EXPORT_SYMBOL(generic_file_aio_write);
 
 ssize_t generic_file_write(struct file *file, const char __user *buf,
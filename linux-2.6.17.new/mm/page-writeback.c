@@ -557,15 +557,18 @@ void __init page_writeback_init(void)
 
 int do_writepages(struct address_space *mapping, struct writeback_control *wbc)
 {
+	struct blk_plug plug;
 	int ret;
 
 	if (wbc->nr_to_write <= 0)
 		return 0;
 	wbc->for_writepages = 1;
+	blk_start_plug(&plug);
 	if (mapping->a_ops->writepages)
 		ret =  mapping->a_ops->writepages(mapping, wbc);
 	else
 		ret = generic_writepages(mapping, wbc);
+	blk_finish_plug(&plug);
 	wbc->for_writepages = 0;
 	return ret;
 }
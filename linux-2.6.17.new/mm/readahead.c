@@ -169,8 +169,11 @@ static int read_pages(struct address_space *mapping, struct file *filp,
 {
 	unsigned page_idx;
 	struct pagevec lru_pvec;
+	struct blk_plug plug;
 	int ret;
 
+	blk_start_plug(&plug);
+
 	if (mapping->a_ops->readpages) {
 		ret = mapping->a_ops->readpages(filp, mapping, pages, nr_pages);
 		goto out;
@@ -194,6 +197,7 @@ static int read_pages(struct address_space *mapping, struct file *filp,
 	pagevec_lru_add(&lru_pvec);
 	ret = 0;
 out:
+	blk_finish_plug(&plug);
 	return ret;
 }
 
@@ -86,6 +86,7 @@
 #include <linux/kmod.h>
 #include <linux/audit.h>
 #include <linux/wireless.h>
+#include <linux/aio.h>
 
 #include <asm/uaccess.h>
 #include <asm/unistd.h>
@@ -1755,10 +1756,10 @@ asmlinkage long sys_shutdown(int fd, int how)
  *	BSD sendmsg interface
  */
 
-asmlinkage long sys_sendmsg(int fd, struct msghdr __user *msg, unsigned flags)
+static long __sys_sendmsg(struct socket *sock, struct msghdr __user *msg,
+			  unsigned flags)
 {
 	struct compat_msghdr __user *msg_compat = (struct compat_msghdr __user *)msg;
-	struct socket *sock;
 	char address[MAX_SOCK_ADDR];
 	struct iovec iovstack[UIO_FASTIOV], *iov = iovstack;
 	unsigned char ctl[sizeof(struct cmsghdr) + 20]
@@ -1767,7 +1768,6 @@ asmlinkage long sys_sendmsg(int fd, struct msghdr __user *msg, unsigned flags)
 	unsigned char *ctl_buf = ctl;
 	struct msghdr msg_sys;
 	int err, ctl_len, iov_size, total_len;
-	int fput_needed;
 	
 	err = -EFAULT;
 	if (MSG_CMSG_COMPAT & flags) {
@@ -1776,14 +1776,10 @@ asmlinkage long sys_sendmsg(int fd, struct msghdr __user *msg, unsigned flags)
 	} else if (copy_from_user(&msg_sys, msg, sizeof(struct msghdr)))
 		return -EFAULT;
 
-	sock = sockfd_lookup_light(fd, &err, &fput_needed);
-	if (!sock) 
-		goto out;
-
 	/* do not move before msg_sys is valid */
 	err = -EMSGSIZE;
 	if (msg_sys.msg_iovlen > UIO_MAXIOV)
-		goto out_put;
+		goto out;
 
 	/* Check whether to allocate the iovec area*/
 	err = -ENOMEM;
@@ -1791,7 +1787,7 @@ asmlinkage long sys_sendmsg(int fd, struct msghdr __user *msg, unsigned flags)
 	if (msg_sys.msg_iovlen > UIO_FASTIOV) {
 		iov = sock_kmalloc(sock->sk, iov_size, GFP_KERNEL);
 		if (!iov)
-			goto out_put;
+			goto out;
 	}
 
 	/* This will also move the address data into kernel space */
@@ -1843,26 +1839,36 @@ out_freectl:
 out_freeiov:
 	if (iov != iovstack)
 		sock_kfree_s(sock->sk, iov, iov_size);
-out_put:
-	fput_light(sock->file, fput_needed);
 out:       
 	return err;
 }
 
+asmlinkage long sys_sendmsg(int fd, struct msghdr __user *msg, unsigned flags)
+{
+	struct socket *sock;
+	int err, fput_needed;
+
+	sock = sockfd_lookup_light(fd, &err, &fput_needed);
+	if (!sock)
+		return err;
+	err = __sys_sendmsg(sock, msg, flags);
+	fput_light(sock->file, fput_needed);
+	return err;
+}
+
 /*
  *	BSD recvmsg interface
  */
 
-asmlinkage long sys_recvmsg(int fd, struct msghdr __user *msg, unsigned int flags)
+static long __sys_recvmsg(struct socket *sock, struct msghdr __user *msg,
+			  unsigned int flags)
 {
 	struct compat_msghdr __user *msg_compat = (struct compat_msghdr __user *)msg;
-	struct socket *sock;
 	struct iovec iovstack[UIO_FASTIOV];
 	struct iovec *iov=iovstack;
 	struct msghdr msg_sys;
 	unsigned long cmsg_ptr;
 	int err, iov_size, total_len, len;
-	int fput_needed;
 
 	/* kernel mode address */
 	char addr[MAX_SOCK_ADDR];
@@ -1878,13 +1884,9 @@ asmlinkage long sys_recvmsg(int fd, struct msghdr __user *msg, unsigned int flag
 		if (copy_from_user(&msg_sys,msg,sizeof(struct msghdr)))
 			return -EFAULT;
 
-	sock = sockfd_lookup_light(fd, &err, &fput_needed);
-	if (!sock)
-		goto out;
-
 	err = -EMSGSIZE;
 	if (msg_sys.msg_iovlen > UIO_MAXIOV)
-		goto out_put;
+		goto out;
 	
 	/* Check whether to allocate the iovec area*/
 	err = -ENOMEM;
@@ -1892,7 +1894,7 @@ asmlinkage long sys_recvmsg(int fd, struct msghdr __user *msg, unsigned int flag
 	if (msg_sys.msg_iovlen > UIO_FASTIOV) {
 		iov = sock_kmalloc(sock->sk, iov_size, GFP_KERNEL);
 		if (!iov)
-			goto out_put;
+			goto out;
 	}
 
 	/*
@@ -1944,12 +1946,112 @@ asmlinkage long sys_recvmsg(int fd, struct msghdr __user *msg, unsigned int flag
 out_freeiov:
 	if (iov != iovstack)
 		sock_kfree_s(sock->sk, iov, iov_size);
-out_put:
-	fput_light(sock->file, fput_needed);
 out:
 	return err;
 }
 
+asmlinkage long sys_recvmsg(int fd, struct msghdr __user *msg, unsigned int flags)
+{
+	struct socket *sock;
+	int err, fput_needed;
+
+	sock = sockfd_lookup_light(fd, &err, &fput_needed);
+	if (!sock)
+		return err;
+	err = __sys_recvmsg(sock, msg, flags);
+	fput_light(sock->file, fput_needed);
+	return err;
+}
+
+/*
+ * Takes the iocb's wait off the socket, if it is still queued there.
+ * Whoever does owns the iocb: the socket can no longer kick it.
+ */
+static int sock_aio_msg_dequeue(struct socket *sock, wait_queue_t *wait)
+{
+	unsigned long flags;
+	int queued;
+
+	spin_lock_irqsave(&sock->wait.lock, flags);
+	queued = !list_empty(&wait->task_list);
+	if (queued)
+		list_del_init(&wait->task_list);
+	spin_unlock_irqrestore(&sock->wait.lock, flags);
+	return queued;
+}
+
+/*
+ * The ki_retry method of IOCB_CMD_SENDMSG and IOCB_CMD_RECVMSG, see
+ * fs/aio.c. The message is sent or received as with MSG_DONTWAIT; if the
+ * socket isn't ready for it, the iocb's wait stays queued on the socket
+ * and -EIOCBRETRY has it tried again when the socket wakes it up.
+ * ki_nbytes holds the flags, MSG_CMSG_COMPAT for 32 bit submitters.
+ */
+ssize_t sock_aio_msg_retry(struct kiocb *iocb)
+{
+	struct msghdr __user *msg = (struct msghdr __user *)iocb->ki_buf;
+	unsigned int flags = iocb->ki_nbytes;
+	wait_queue_t *wait = current->io_wait;
+	struct socket *sock;
+	int err, nonblock;
+
+	sock = sock_from_file(iocb->ki_filp, &err);
+	if (!sock)
+		return err;
+	nonblock = (flags & MSG_DONTWAIT) || (iocb->ki_filp->f_flags & O_NONBLOCK);
+
+	/*
+	 * Queue the wait before trying, so that a wakeup coming in between
+	 * isn't lost. As poll does, ask for write space wakeups. The task
+	 * itself doesn't sleep: the wakeup only kicks the iocb.
+	 */
+	if (!nonblock && !is_sync_wait(wait)) {
+		prepare_to_wait(&sock->wait, wait, TASK_RUNNING);
+		if (iocb->ki_opcode == IOCB_CMD_SENDMSG)
+			set_bit(SOCK_NOSPACE, &sock->flags);
+	}
+
+	if (iocb->ki_opcode == IOCB_CMD_SENDMSG)
+		err = __sys_sendmsg(sock, msg, flags | MSG_DONTWAIT);
+	else
+		err = __sys_recvmsg(sock, msg, flags | MSG_DONTWAIT);
+
+	if (!nonblock && !is_sync_wait(wait)) {
+		if (err != -EAGAIN) {
+			finish_wait(&sock->wait, wait);
+			return err;
+		}
+		/*
+		 * A cancel that came in meanwhile either found the wait
+		 * queued, and completes the iocb, or left it to us.
+		 */
+		if (kiocbIsCancelled(iocb) && sock_aio_msg_dequeue(sock, wait))
+			return -EINTR;
+		return -EIOCBRETRY;
+	}
+	return err;
+}
+
+/*
+ * The ki_cancel method of IOCB_CMD_SENDMSG and IOCB_CMD_RECVMSG: an iocb
+ * waiting on its socket is completed with -EINTR. One being retried will
+ * see it is cancelled, and complete itself.
+ */
+int sock_aio_msg_cancel(struct kiocb *iocb, struct io_event *res)
+{
+	struct socket *sock = iocb->ki_filp->private_data;
+	int ret = -EAGAIN;
+
+	if (sock_aio_msg_dequeue(sock, &iocb->ki_wait.wait)) {
+		aio_complete(iocb, -EINTR, 0);
+		res->res = -EINTR;
+		res->res2 = 0;
+		ret = 0;
+	}
+	aio_put_req(iocb);
+	return ret;
+}
+
 #ifdef __ARCH_WANT_SYS_SOCKETCALL
 
 /* Argument list sizes for sys_socketcall */
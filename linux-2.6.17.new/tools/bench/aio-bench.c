@@ -0,0 +1,299 @@
+/*
+ * aio-bench.c: benchmark for native AIO submission, see Documentation/aio.txt.
+ *
+ * Build:	gcc -O2 -Wall -o aio-bench aio-bench.c
+ *
+ * aio-bench read [-d depth] [-b bs] [-v segs] [-s seconds] [-u] [-o] <file>
+ *	Random reads of 'bs' bytes at offsets aligned to 'bs', keeping
+ *	'depth' of them in flight. With -v each read is an IOCB_CMD_PREADV
+ *	of 'segs' buffers. Completions are reaped with io_getevents, or
+ *	with -u straight from the completion ring mapped into the process.
+ *	With -o the file is opened O_DIRECT.
+ *
+ * aio-bench fsync [-d depth] [-b bs] [-s seconds] <file>
+ *	Writes 'depth' blocks, then an IOCB_CMD_FDSYNC, and waits for all
+ *	of them, over and over.
+ *
+ * Both print the requests completed per second, and how long io_submit
+ * took on average and at most: the time the caller was blocked.
+ * Drop the page cache before a buffered read run, or the reads never
+ * have to wait.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdint.h>
+#include <sys/time.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/syscall.h>
+#include <linux/aio_abi.h>
+
+#include "bench.h"
+
+#ifndef IOCB_CMD_PREADV
+#define IOCB_CMD_PREADV		7
+#define IOCB_CMD_PWRITEV	8
+#endif
+
+#define AIO_RING_MAGIC		0xa10a10a1
+
+struct aio_ring {
+	unsigned id, nr, head, tail;
+	unsigned magic, compat_features, incompat_features, header_length;
+	struct io_event io_events[0];
+};
+
+#define MAX_DEPTH	1024
+#define MAX_SEGS	64
+
+static int depth = 32, segs, user_reap, seconds = 5;
+static size_t bs = 4096;
+
+static struct iocb iocbs[MAX_DEPTH];
+static char *bufs[MAX_DEPTH];
+static struct iovec iovs[MAX_DEPTH][MAX_SEGS];
+static struct io_event events[MAX_DEPTH];
+static double submit_total, submit_max;
+static unsigned long nr_submits;
+
+static int io_setup(unsigned nr, aio_context_t *ctx)
+{
+	return syscall(__NR_io_setup, nr, ctx);
+}
+
+static int io_getevents(aio_context_t ctx, long min_nr, long nr,
+			struct io_event *ev)
+{
+	return syscall(__NR_io_getevents, ctx, min_nr, nr, ev, NULL);
+}
+
+/*
+ * Time every io_submit: if it blocks, that is where it shows
+ */
+static void submit(aio_context_t ctx, struct iocb **list, int nr)
+{
+	double t = now();
+	int ret;
+
+	ret = syscall(__NR_io_submit, ctx, nr, list);
+	if (ret != nr) {
+		fprintf(stderr, "io_submit: %s\n",
+			ret < 0 ? strerror(errno) : "short");
+		exit(1);
+	}
+	t = now() - t;
+	submit_total += t;
+	if (t > submit_max)
+		submit_max = t;
+	nr_submits++;
+}
+
+/*
+ * Reap completions from the ring the kernel maps into the process: the
+ * context id is its address. Sleeps in io_getevents only if it's empty.
+ */
+static int reap(aio_context_t ctx, int min_nr)
+{
+	struct aio_ring *ring = (struct aio_ring *)ctx;
+	unsigned head, tail;
+	int nr = 0;
+
+	if (!user_reap || ring->magic != AIO_RING_MAGIC ||
+	    ring->incompat_features)
+		return io_getevents(ctx, min_nr, depth, events);
+
+	while (nr < min_nr) {
+		head = ring->head;
+		tail = ring->tail;
+		__sync_synchronize();	/* read the tail before the events */
+		while (head != tail && nr < depth) {
+			events[nr++] = ring->io_events[head];
+			head = (head + 1) % ring->nr;
+		}
+		__sync_synchronize();	/* done with them before the head moves */
+		ring->head = head;
+		if (nr < min_nr && io_getevents(ctx, 1, 1, &events[nr]) == 1)
+			nr++;
+	}
+	return nr;
+}
+
+static void prep_read(int fd, struct iocb *cb, int i, off_t blocks)
+{
+	size_t seg_len;
+	int s;
+
+	memset(cb, 0, sizeof(*cb));
+	cb->aio_fildes = fd;
+	cb->aio_data = i;
+	cb->aio_offset = (off_t)(random() % blocks) * bs;
+	if (!segs) {
+		cb->aio_lio_opcode = IOCB_CMD_PREAD;
+		cb->aio_buf = (uintptr_t)bufs[i];
+		cb->aio_nbytes = bs;
+		return;
+	}
+	seg_len = bs / segs;
+	for (s = 0; s < segs; s++) {
+		iovs[i][s].iov_base = bufs[i] + s * seg_len;
+		iovs[i][s].iov_len = seg_len;
+	}
+	cb->aio_lio_opcode = IOCB_CMD_PREADV;
+	cb->aio_buf = (uintptr_t)iovs[i];
+	cb->aio_nbytes = segs;
+}
+
+static unsigned long run_read(aio_context_t ctx, int fd, off_t size)
+{
+	off_t blocks = size / bs;
+	struct iocb *list[MAX_DEPTH];
+	unsigned long done = 0;
+	double end = now() + seconds;
+	int i, n;
+
+	if (blocks < 1) {
+		fprintf(stderr, "file smaller than one block\n");
+		exit(1);
+	}
+	for (i = 0; i < depth; i++) {
+		if (posix_memalign((void **)&bufs[i], 4096, bs))
+			exit(1);
+		prep_read(fd, &iocbs[i], i, blocks);
+		list[i] = &iocbs[i];
+	}
+	submit(ctx, list, depth);
+
+	while (now() < end) {
+		n = reap(ctx, 1);
+		if (n < 0)
+			die("io_getevents");
+		for (i = 0; i < n; i++) {
+			struct iocb *cb = &iocbs[events[i].data];
+
+			if (events[i].res < 0) {
+				fprintf(stderr, "read: %s\n",
+					strerror(-events[i].res));
+				exit(1);
+			}
+			prep_read(fd, cb, events[i].data, blocks);
+			list[i] = cb;
+		}
+		done += n;
+		if (n)
+			submit(ctx, list, n);
+	}
+	return done;
+}
+
+static unsigned long run_fsync(aio_context_t ctx, int fd)
+{
+	struct iocb *list[MAX_DEPTH + 1];
+	unsigned long done = 0;
+	double end = now() + seconds;
+	char *buf;
+	int i, n;
+
+	if (posix_memalign((void **)&buf, 4096, bs))
+		exit(1);
+	memset(buf, 0x5a, bs);
+
+	while (now() < end) {
+		for (i = 0; i < depth; i++) {
+			memset(&iocbs[i], 0, sizeof(iocbs[i]));
+			iocbs[i].aio_fildes = fd;
+			iocbs[i].aio_lio_opcode = IOCB_CMD_PWRITE;
+			iocbs[i].aio_buf = (uintptr_t)buf;
+			iocbs[i].aio_nbytes = bs;
+			iocbs[i].aio_offset = (off_t)i * bs;
+			list[i] = &iocbs[i];
+		}
+		submit(ctx, list, depth);
+		for (n = 0; n < depth; n += reap(ctx, depth - n))
+			;
+
+		memset(&iocbs[0], 0, sizeof(iocbs[0]));
+		iocbs[0].aio_fildes = fd;
+		iocbs[0].aio_lio_opcode = IOCB_CMD_FDSYNC;
+		list[0] = &iocbs[0];
+		submit(ctx, list, 1);
+		if (reap(ctx, 1) != 1 || events[0].res < 0) {
+			fprintf(stderr, "fdsync: %s\n",
+				strerror(-events[0].res));
+			exit(1);
+		}
+		done += depth + 1;
+	}
+	return done;
+}
+
+int main(int argc, char **argv)
+{
+	aio_context_t ctx = 0;
+	int c, fd, flags = O_RDONLY, do_fsync;
+	unsigned long done;
+	struct stat st;
+
+	if (argc < 2)
+		goto usage;
+	do_fsync = !strcmp(argv[1], "fsync");
+	if (!do_fsync && strcmp(argv[1], "read"))
+		goto usage;
+	if (do_fsync)
+		flags = O_WRONLY | O_CREAT;
+	optind = 2;
+
+	while ((c = getopt(argc, argv, "d:b:v:s:uo")) != -1) {
+		switch (c) {
+		case 'd':
+			depth = atoi(optarg);
+			break;
+		case 'b':
+			bs = atol(optarg);
+			break;
+		case 'v':
+			segs = atoi(optarg);
+			break;
+		case 's':
+			seconds = atoi(optarg);
+			break;
+		case 'u':
+			user_reap = 1;
+			break;
+		case 'o':
+			flags |= O_DIRECT;
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (optind != argc - 1 || depth < 1 || depth > MAX_DEPTH ||
+	    segs < 0 || segs > MAX_SEGS || !bs || (segs && bs % segs))
+		goto usage;
+
+	fd = open(argv[optind], flags, 0644);
+	if (fd < 0 || fstat(fd, &st) < 0)
+		die(argv[optind]);
+	if (io_setup(depth + 1, &ctx) < 0)
+		die("io_setup");
+
+	done = do_fsync ? run_fsync(ctx, fd) : run_read(ctx, fd, st.st_size);
+
+	printf("%.0f requests/s, io_submit %.1f us average, %.1f us max\n",
+	       (double)done / seconds,
+	       nr_submits ? submit_total * 1e6 / nr_submits : 0.0,
+	       submit_max * 1e6);
+	return 0;
+
+usage:
+	fprintf(stderr, "usage: aio-bench read [-d depth] [-b bs] [-v segs] "
+		"[-s seconds] [-u] [-o] <file>\n"
+		"       aio-bench fsync [-d depth] [-b bs] [-s seconds] "
+		"<file>\n");
+	return 1;
+}
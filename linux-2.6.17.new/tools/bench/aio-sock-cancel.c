@@ -0,0 +1,168 @@
+/*
+ * aio-sock-cancel.c: checks that IOCB_CMD_RECVMSG iocbs left waiting on
+ * an idle socket are cancelled by io_cancel(), io_destroy() and exit,
+ * see Documentation/aio.txt.
+ *
+ * Build:	gcc -O2 -Wall -o aio-sock-cancel aio-sock-cancel.c
+ *
+ * aio-sock-cancel
+ *	Prints what failed and exits with 1, or exits with 0. A kernel
+ *	that doesn't cancel them leaves the child stuck in D state; that
+ *	is reported after 5 seconds.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <linux/aio_abi.h>
+
+#include "bench.h"
+
+#ifndef IOCB_CMD_RECVMSG
+#define IOCB_CMD_RECVMSG	10
+#endif
+
+static int failed;
+
+static void fail(const char *what)
+{
+	fprintf(stderr, "FAIL: %s\n", what);
+	failed = 1;
+}
+
+/* Queues a RECVMSG on fd, which has nothing to receive */
+static void submit_recvmsg(aio_context_t ctx, int fd, struct iocb *cb,
+			   struct msghdr *msg, struct iovec *iov, char *buf)
+{
+	struct iocb *cbs[1] = { cb };
+
+	iov->iov_base = buf;
+	iov->iov_len = 64;
+	memset(msg, 0, sizeof(*msg));
+	msg->msg_iov = iov;
+	msg->msg_iovlen = 1;
+	memset(cb, 0, sizeof(*cb));
+	cb->aio_fildes = fd;
+	cb->aio_lio_opcode = IOCB_CMD_RECVMSG;
+	cb->aio_buf = (unsigned long)msg;
+	if (syscall(SYS_io_submit, ctx, 1, cbs) != 1)
+		die("io_submit");
+}
+
+/* Runs fn in a child, which must exit within 5 seconds */
+static void in_child(const char *what, void (*fn)(void))
+{
+	int status, i;
+	pid_t pid;
+
+	pid = fork();
+	if (pid < 0)
+		die("fork");
+	if (!pid) {
+		fn();
+		exit(0);
+	}
+	for (i = 0; i < 50; i++) {
+		if (waitpid(pid, &status, WNOHANG) == pid) {
+			if (!WIFEXITED(status) || WEXITSTATUS(status))
+				fail(what);
+			return;
+		}
+		usleep(100000);
+	}
+	fail(what);
+	kill(pid, SIGKILL);
+}
+
+static void destroy(void)
+{
+	struct msghdr msg;
+	struct iovec iov;
+	struct iocb cb;
+	aio_context_t ctx = 0;
+	char buf[64];
+	int sv[2];
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+		die("socketpair");
+	if (syscall(SYS_io_setup, 8, &ctx) < 0)
+		die("io_setup");
+	submit_recvmsg(ctx, sv[0], &cb, &msg, &iov, buf);
+	if (syscall(SYS_io_destroy, ctx) < 0)
+		die("io_destroy");
+}
+
+static void leave(void)
+{
+	struct msghdr msg;
+	struct iovec iov;
+	struct iocb cb;
+	aio_context_t ctx = 0;
+	char buf[64];
+	int sv[2];
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+		die("socketpair");
+	if (syscall(SYS_io_setup, 8, &ctx) < 0)
+		die("io_setup");
+	submit_recvmsg(ctx, sv[0], &cb, &msg, &iov, buf);
+	/* exit_aio() cancels it */
+}
+
+int main(void)
+{
+	struct timespec ts = { 0, 100000000 };
+	struct io_event ev;
+	struct msghdr msg;
+	struct iovec iov;
+	struct iocb cb;
+	aio_context_t ctx = 0;
+	char buf[64];
+	int sv[2];
+	long ret;
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+		die("socketpair");
+	if (syscall(SYS_io_setup, 8, &ctx) < 0)
+		die("io_setup");
+
+	/* nothing to receive: it must wait */
+	submit_recvmsg(ctx, sv[0], &cb, &msg, &iov, buf);
+	if (syscall(SYS_io_getevents, ctx, 1, 1, &ev, &ts) != 0)
+		fail("RECVMSG completed with nothing to receive");
+
+	/* io_cancel() hands back its event */
+	memset(&ev, 0, sizeof(ev));
+	ret = syscall(SYS_io_cancel, ctx, &cb, &ev);
+	if (ret < 0)
+		fail("io_cancel");
+	else if ((long)ev.res != -EINTR || ev.obj != (unsigned long)&cb)
+		fail("io_cancel event");
+	if (syscall(SYS_io_getevents, ctx, 1, 1, &ev, &ts) != 0)
+		fail("cancelled RECVMSG completed again");
+
+	/* it still works after that */
+	submit_recvmsg(ctx, sv[0], &cb, &msg, &iov, buf);
+	if (write(sv[1], "x", 1) != 1)
+		die("write");
+	ts.tv_sec = 5;
+	if (syscall(SYS_io_getevents, ctx, 1, 1, &ev, &ts) != 1 ||
+	    ev.res != 1)
+		fail("RECVMSG after a cancel");
+	syscall(SYS_io_destroy, ctx);
+
+	in_child("io_destroy with a RECVMSG waiting", destroy);
+	in_child("exit with a RECVMSG waiting", leave);
+
+	if (!failed)
+		printf("ok\n");
+	return failed;
+}
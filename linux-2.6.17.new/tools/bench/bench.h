@@ -0,0 +1,67 @@
+/*
+ * bench.h - helpers shared by the programs in tools/bench
+ *
+ * Each program is a single file built on its own, see the Build: line at
+ * its top; this header only needs to be next to it.
+ */
+#ifndef _BENCH_H
+#define _BENCH_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <sys/time.h>
+
+static inline void die(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+/* Wall clock time in seconds */
+static inline double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/*
+ * Reads the counters named in names[] from a statistics file in /proc
+ * into s[], all zeroes if the file isn't there. Lines are words followed
+ * by numbers: "foo 1 bar 2" sets foo and bar, a word followed by several
+ * numbers as in "hist 1 2 3" sets hist0, hist1 and hist2.
+ */
+static inline void read_stat_file(const char *path, const char **names,
+				  int nr, unsigned long *s)
+{
+	char tok[64], key[64], name[80];
+	unsigned long val;
+	int i, idx = 0;
+	FILE *f;
+
+	memset(s, 0, nr * sizeof(*s));
+	key[0] = '\0';
+	f = fopen(path, "r");
+	if (!f)
+		return;
+	while (fscanf(f, "%63s", tok) == 1) {
+		if (!isdigit((unsigned char)tok[0])) {
+			strcpy(key, tok);
+			idx = 0;
+			continue;
+		}
+		val = strtoul(tok, NULL, 10);
+		snprintf(name, sizeof(name), "%s%d", key, idx);
+		for (i = 0; i < nr; i++)
+			if ((!idx && !strcmp(names[i], key)) ||
+			    !strcmp(names[i], name))
+				s[i] = val;
+		idx++;
+	}
+	fclose(f);
+}
+
+#endif /* _BENCH_H */
@@ -0,0 +1,335 @@
+/*
+ * btsum.c: print the in-kernel blktrace summaries of a disk, see
+ * Documentation/block/blktrace-summary.txt.
+ *
+ * Build:	gcc -O2 -Wall -o btsum btsum.c
+ *
+ * btsum [-i ms] [-s sample] [-r range_shift] [-d debugfs] <device>
+ *	Sets up a summary mode trace on <device>, and every interval
+ *	prints what each process and each area of the disk did: requests
+ *	and MB per second, the share of bios merged, and the mean and
+ *	maximum queue-to-dispatch and dispatch-to-complete times. Events
+ *	of sampled requests (-s, 1 in 'sample') are counted, not decoded.
+ *	debugfs must be mounted, by default on /sys/kernel/debug.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <sys/ioctl.h>
+
+#include "bench.h"
+
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+
+#define BDEVNAME_SIZE		32
+#define BLK_TC_SHIFT		16
+#define BLK_TC_NOTIFY		(1 << 10)
+#define BLK_TC_SUMMARY		(1 << 11)
+#define BLK_IO_TRACE_MAGIC	0x65617400
+
+struct blk_io_trace {
+	u32 magic, sequence;
+	u64 time, sector;
+	u32 bytes, action, pid, device, cpu;
+	u16 error, pdu_len;
+};
+
+struct blk_io_trace_summary {
+	u32 type, flags;
+	u64 start, key, nr_sectors;
+	u64 bytes[2];
+	u64 q2d_total, d2c_total, q2d_max, d2c_max;
+	u32 ios[2], bios, merges;
+};
+
+#define BLK_TS_PID	1
+#define BLK_TS_RANGE	2
+#define BLK_TS_OTHER	(1 << 0)
+
+struct blk_user_trace_setup {
+	char name[BDEVNAME_SIZE];
+	u16 act_mask;
+	u32 buf_size, buf_nr;
+	u64 start_lba, end_lba;
+	u32 pid;
+};
+
+struct blk_user_trace_summary_setup {
+	struct blk_user_trace_setup buts;
+	u32 interval, sample, range_shift, __pad;
+};
+
+#define BLKTRACESTART		_IO(0x12, 116)
+#define BLKTRACESTOP		_IO(0x12, 117)
+#define BLKTRACETEARDOWN	_IO(0x12, 118)
+#define BLKTRACESETUPSUM	_IOWR(0x12, 119, struct blk_user_trace_summary_setup)
+
+#define MAX_CPUS	256
+#define MAX_KEYS	1024
+#define MAX_COMMS	1024
+
+static struct blk_io_trace_summary sums[MAX_KEYS];
+static int nr_sums;
+static struct { u32 pid; char comm[16]; } comms[MAX_COMMS];
+static int nr_comms;
+static unsigned long sampled;
+static volatile int done;
+
+static void add_comm(u32 pid, const char *comm)
+{
+	int i;
+
+	for (i = 0; i < nr_comms; i++)
+		if (comms[i].pid == pid)
+			break;
+	if (i == MAX_COMMS)
+		return;
+	if (i == nr_comms)
+		nr_comms++;
+	comms[i].pid = pid;
+	memcpy(comms[i].comm, comm, 15);
+}
+
+static const char *comm_of(u32 pid)
+{
+	int i;
+
+	for (i = 0; i < nr_comms; i++)
+		if (comms[i].pid == pid)
+			return comms[i].comm;
+	return "?";
+}
+
+/*
+ * The kernel relays the tables of every CPU separately, add them up
+ */
+static void add_sum(struct blk_io_trace_summary *s)
+{
+	struct blk_io_trace_summary *d;
+	int i, rw;
+
+	for (i = 0; i < nr_sums; i++)
+		if (sums[i].type == s->type && sums[i].flags == s->flags &&
+		    sums[i].key == s->key)
+			break;
+	if (i == MAX_KEYS)
+		return;
+	d = &sums[i];
+	if (i == nr_sums) {
+		nr_sums++;
+		*d = *s;
+		return;
+	}
+	for (rw = 0; rw < 2; rw++) {
+		d->bytes[rw] += s->bytes[rw];
+		d->ios[rw] += s->ios[rw];
+	}
+	d->bios += s->bios;
+	d->merges += s->merges;
+	d->q2d_total += s->q2d_total;
+	d->d2c_total += s->d2c_total;
+	if (s->q2d_max > d->q2d_max)
+		d->q2d_max = s->q2d_max;
+	if (s->d2c_max > d->d2c_max)
+		d->d2c_max = s->d2c_max;
+}
+
+/*
+ * Returns how much was parsed; the rest is the start of an event cut by
+ * the read
+ */
+static size_t parse(char *buf, size_t len)
+{
+	struct blk_io_trace *t;
+	size_t off = 0;
+
+	while (off + sizeof(*t) <= len) {
+		t = (struct blk_io_trace *)(buf + off);
+		if ((t->magic & 0xffffff00) != BLK_IO_TRACE_MAGIC) {
+			fprintf(stderr, "btsum: bad trace magic\n");
+			exit(1);
+		}
+		if (off + sizeof(*t) + t->pdu_len > len)
+			break;
+
+		if (t->action == (BLK_TC_NOTIFY << BLK_TC_SHIFT))
+			add_comm(t->pid, (char *)(t + 1));
+		else if ((t->action >> BLK_TC_SHIFT) & BLK_TC_SUMMARY)
+			add_sum((struct blk_io_trace_summary *)(t + 1));
+		else
+			sampled++;
+
+		off += sizeof(*t) + t->pdu_len;
+	}
+	return off;
+}
+
+static void print_sums(double secs)
+{
+	struct blk_io_trace_summary *s;
+	unsigned long ios;
+	int i, type;
+
+	printf("%-24s %9s %9s %9s %9s %6s %9s %9s %9s %9s\n",
+	       "", "r/s", "w/s", "rMB/s", "wMB/s", "merge%",
+	       "q2d(us)", "max", "d2c(us)", "max");
+
+	for (type = BLK_TS_PID; type <= BLK_TS_RANGE; type++) {
+		for (i = 0; i < nr_sums; i++) {
+			char name[32];
+
+			s = &sums[i];
+			if (s->type != type)
+				continue;
+			if (s->flags & BLK_TS_OTHER)
+				snprintf(name, sizeof(name), "%s (other)",
+					 type == BLK_TS_PID ? "pid" : "range");
+			else if (type == BLK_TS_PID)
+				snprintf(name, sizeof(name), "%llu %s",
+					 (unsigned long long)s->key,
+					 comm_of(s->key));
+			else
+				snprintf(name, sizeof(name), "@%lluM",
+					 (unsigned long long)(s->key >> 11));
+
+			ios = s->ios[0] + s->ios[1];
+			printf("%-24s %9.1f %9.1f %9.2f %9.2f %6.1f "
+			       "%9.1f %9.1f %9.1f %9.1f\n", name,
+			       s->ios[0] / secs, s->ios[1] / secs,
+			       s->bytes[0] / secs / 1048576,
+			       s->bytes[1] / secs / 1048576,
+			       s->bios ? 100.0 * s->merges / s->bios : 0.0,
+			       ios ? s->q2d_total / 1000.0 / ios : 0.0,
+			       s->q2d_max / 1000.0,
+			       ios ? s->d2c_total / 1000.0 / ios : 0.0,
+			       s->d2c_max / 1000.0);
+		}
+	}
+	if (sampled)
+		printf("%lu sampled events\n", sampled);
+	printf("\n");
+	fflush(stdout);
+
+	nr_sums = 0;
+	sampled = 0;
+}
+
+#define BUF_SIZE	(1 << 20)
+
+static void drain(int *fds, int nr)
+{
+	static char *bufs[MAX_CPUS];
+	static size_t held[MAX_CPUS];
+	size_t off;
+	ssize_t n;
+	int i;
+
+	for (i = 0; i < nr; i++) {
+		if (!bufs[i] && !(bufs[i] = malloc(BUF_SIZE)))
+			die("malloc");
+		while ((n = read(fds[i], bufs[i] + held[i],
+				 BUF_SIZE - held[i])) > 0) {
+			n += held[i];
+			off = parse(bufs[i], n);
+			held[i] = n - off;
+			memmove(bufs[i], bufs[i] + off, held[i]);
+		}
+	}
+}
+
+static void stop(int sig)
+{
+	done = 1;
+}
+
+int main(int argc, char **argv)
+{
+	struct blk_user_trace_summary_setup buss;
+	const char *debugfs = "/sys/kernel/debug";
+	unsigned int interval = 1000;
+	int fds[MAX_CPUS], nr = 0;
+	char path[256];
+	int c, dev, fd;
+
+	memset(&buss, 0, sizeof(buss));
+	while ((c = getopt(argc, argv, "i:s:r:d:")) != -1) {
+		switch (c) {
+		case 'i':
+			interval = atoi(optarg);
+			break;
+		case 's':
+			buss.sample = atoi(optarg);
+			break;
+		case 'r':
+			buss.range_shift = atoi(optarg);
+			break;
+		case 'd':
+			debugfs = optarg;
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (optind != argc - 1 || !interval)
+		goto usage;
+
+	dev = open(argv[optind], O_RDONLY | O_NONBLOCK);
+	if (dev < 0)
+		die(argv[optind]);
+
+	buss.buts.buf_size = 512 * 1024;
+	buss.buts.buf_nr = 4;
+	buss.interval = interval;
+	if (ioctl(dev, BLKTRACESETUPSUM, &buss) < 0)
+		die("BLKTRACESETUPSUM");
+
+	for (c = 0; c < MAX_CPUS; c++) {
+		snprintf(path, sizeof(path), "%s/block/%s/trace%d", debugfs,
+			 buss.buts.name, c);
+		fd = open(path, O_RDONLY | O_NONBLOCK);
+		if (fd >= 0)
+			fds[nr++] = fd;
+	}
+	if (!nr) {
+		fprintf(stderr, "btsum: no trace files in %s/block/%s\n",
+			debugfs, buss.buts.name);
+		ioctl(dev, BLKTRACETEARDOWN);
+		return 1;
+	}
+
+	signal(SIGINT, stop);
+	signal(SIGTERM, stop);
+	if (ioctl(dev, BLKTRACESTART) < 0) {
+		perror("BLKTRACESTART");
+		ioctl(dev, BLKTRACETEARDOWN);
+		return 1;
+	}
+
+	while (!done) {
+		usleep(interval * 1000);
+		drain(fds, nr);
+		if (nr_sums)
+			print_sums(interval / 1000.0);
+	}
+
+	/*
+	 * stopping relays what was summed since the last interval
+	 */
+	ioctl(dev, BLKTRACESTOP);
+	drain(fds, nr);
+	ioctl(dev, BLKTRACETEARDOWN);
+	return 0;
+
+usage:
+	fprintf(stderr, "usage: btsum [-i ms] [-s sample] [-r range_shift] "
+		"[-d debugfs] <device>\n");
+	return 1;
+}
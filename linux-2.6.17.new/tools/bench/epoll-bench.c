@@ -0,0 +1,201 @@
+/*
+ * epoll-bench.c: threads accepting on one listening socket through one
+ * epoll descriptor, see Documentation/epoll.txt.
+ *
+ * Build:	gcc -O2 -Wall -o epoll-bench epoll-bench.c -lpthread
+ *
+ * epoll-bench [-t threads] [-c clients] [-s seconds] [-x] [-e]
+ *	'threads' server threads (default 8) wait in epoll_wait() on an epoll
+ *	descriptor holding a non-blocking listening socket on 127.0.0.1,
+ *	accept what they can and close it. 'clients' threads (default 2)
+ *	connect and close in a loop. -x adds the socket with EPOLLEXCLUSIVE,
+ *	-e with EPOLLET.
+ *
+ * Prints the connections accepted per second, how many times epoll_wait
+ * returned and accept() failed with EAGAIN per connection, and what
+ * /proc/epoll_stat counted meanwhile.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "bench.h"
+
+#ifndef EPOLLEXCLUSIVE
+#define EPOLLEXCLUSIVE	(1 << 28)
+#endif
+
+#define NSTATS		9
+
+static const char *stat_names[NSTATS] = {
+	"callbacks", "queued", "wake_all", "wake_one", "sleeps", "wakeups",
+	"spurious", "events", "copies",
+};
+
+static int lfd, epfd;
+static struct sockaddr_in addr;
+static volatile int stop;
+
+struct counts {
+	unsigned long accepted;
+	unsigned long returns;
+	unsigned long eagain;
+} __attribute__((aligned(64)));
+
+static struct counts *counts;
+
+static void *server(void *arg)
+{
+	struct counts *c = arg;
+	struct epoll_event ev;
+	int fd;
+
+	while (!stop) {
+		if (epoll_wait(epfd, &ev, 1, 100) <= 0)
+			continue;
+		c->returns++;
+		for (;;) {
+			fd = accept(lfd, NULL, NULL);
+			if (fd < 0) {
+				if (errno == EAGAIN || errno == EWOULDBLOCK)
+					c->eagain++;
+				break;
+			}
+			close(fd);
+			c->accepted++;
+		}
+	}
+	return NULL;
+}
+
+static void *client(void *arg)
+{
+	int fd;
+
+	while (!stop) {
+		fd = socket(AF_INET, SOCK_STREAM, 0);
+		if (fd < 0)
+			die("socket");
+		if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 &&
+		    errno != ECONNREFUSED && errno != EAGAIN)
+			die("connect");
+		close(fd);
+	}
+	return NULL;
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: epoll-bench [-t threads] [-c clients] "
+		"[-s seconds] [-x] [-e]\n");
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	int nservers = 8, nclients = 2, seconds = 5, one = 1, i, opt;
+	unsigned long before[NSTATS], after[NSTATS];
+	struct counts sum = { 0, 0, 0 };
+	struct epoll_event ev;
+	socklen_t len = sizeof(addr);
+	pthread_t *threads;
+	double t;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	while ((opt = getopt(argc, argv, "t:c:s:xe")) != -1) {
+		switch (opt) {
+		case 't':
+			nservers = atoi(optarg);
+			break;
+		case 'c':
+			nclients = atoi(optarg);
+			break;
+		case 's':
+			seconds = atoi(optarg);
+			break;
+		case 'x':
+			ev.events |= EPOLLEXCLUSIVE;
+			break;
+		case 'e':
+			ev.events |= EPOLLET;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (nservers <= 0 || nclients <= 0 || seconds <= 0)
+		usage();
+
+	lfd = socket(AF_INET, SOCK_STREAM, 0);
+	if (lfd < 0)
+		die("socket");
+	setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+	    getsockname(lfd, (struct sockaddr *)&addr, &len) < 0 ||
+	    listen(lfd, 1024) < 0)
+		die("listen");
+	fcntl(lfd, F_SETFL, O_NONBLOCK);
+
+	epfd = epoll_create(1);
+	if (epfd < 0)
+		die("epoll_create");
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, lfd, &ev) < 0)
+		die("epoll_ctl");
+
+	counts = calloc(nservers, sizeof(*counts));
+	threads = calloc(nservers + nclients, sizeof(*threads));
+	if (!counts || !threads)
+		die("calloc");
+
+	read_stat_file("/proc/epoll_stat", stat_names, NSTATS, before);
+	t = now();
+	for (i = 0; i < nservers; i++)
+		if (pthread_create(&threads[i], NULL, server, &counts[i]))
+			die("pthread_create");
+	for (i = 0; i < nclients; i++)
+		if (pthread_create(&threads[nservers + i], NULL, client, NULL))
+			die("pthread_create");
+	sleep(seconds);
+	stop = 1;
+	for (i = 0; i < nservers + nclients; i++)
+		pthread_join(threads[i], NULL);
+	t = now() - t;
+	read_stat_file("/proc/epoll_stat", stat_names, NSTATS, after);
+
+	for (i = 0; i < nservers; i++) {
+		sum.accepted += counts[i].accepted;
+		sum.returns += counts[i].returns;
+		sum.eagain += counts[i].eagain;
+	}
+	if (!sum.accepted) {
+		fprintf(stderr, "no connection accepted\n");
+		return 1;
+	}
+
+	printf("%d threads%s%s: %.0f connections/s\n", nservers,
+	       (ev.events & EPOLLEXCLUSIVE) ? " exclusive" : "",
+	       (ev.events & EPOLLET) ? " edge" : "", sum.accepted / t);
+	printf("per connection: %.2f epoll_wait returns, %.2f accept EAGAIN\n",
+	       (double)sum.returns / sum.accepted,
+	       (double)sum.eagain / sum.accepted);
+	printf("/proc/epoll_stat, per connection:\n");
+	for (i = 0; i < NSTATS; i++)
+		printf("\t%-10s %.2f\n", stat_names[i],
+		       (double)(after[i] - before[i]) / sum.accepted);
+	return 0;
+}
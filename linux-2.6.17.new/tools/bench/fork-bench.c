@@ -0,0 +1,226 @@
+/*
+ * fork-bench.c: fork/exit microbenchmark for the PID allocator and
+ * lookup, and for walking /proc.
+ *
+ * Build:	gcc -O2 -Wall -o fork-bench fork-bench.c
+ *
+ * fork-bench fork [-n workers] [-s seconds] [-i idle]
+ *	'workers' processes (default 1) each fork a child that exits
+ *	at once and reap it, as fast as they can. Before they start,
+ *	'idle' processes are created that just sleep, to fill the PID
+ *	space. Prints forks per second.
+ *
+ * fork-bench readdir [-s seconds] [-i idle]
+ *	Reads all of /proc over and over, with 'idle' extra processes.
+ *	Prints readdirs per second and the number of entries seen.
+ *
+ * For a large PID space, raise /proc/sys/kernel/pid_max first, e.g.
+ *
+ *	echo 4194304 > /proc/sys/kernel/pid_max
+ *	ulimit -u unlimited
+ *	fork-bench fork -n 8 -i 100000
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <dirent.h>
+#include <sys/time.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "bench.h"
+
+#define MAX_WORKERS	1024
+
+static volatile int stop;
+
+static void on_alarm(int sig)
+{
+	stop = 1;
+}
+
+/*
+ * The idle processes sleep until killed, in one process group so they
+ * can be killed at once.
+ */
+static pid_t idle_group;
+
+static void start_idle(int nr)
+{
+	pid_t pid;
+	int i;
+
+	for (i = 0; i < nr; i++) {
+		pid = fork();
+		if (pid < 0) {
+			perror("fork");
+			break;
+		}
+		if (!pid) {
+			for (;;)
+				pause();
+		}
+		if (!idle_group)
+			idle_group = pid;
+		setpgid(pid, idle_group);
+	}
+	if (i)
+		printf("%d idle processes\n", i);
+	/* or the workers print it again when they exit */
+	fflush(stdout);
+}
+
+static void stop_idle(void)
+{
+	if (!idle_group)
+		return;
+	kill(-idle_group, SIGKILL);
+	while (waitpid(-idle_group, NULL, 0) > 0 || errno == EINTR)
+		;
+}
+
+/*
+ * fork test. Every worker counts its forks in its slot of a shared
+ * mapping.
+ */
+static unsigned long *counts;
+
+static void fork_worker(int id)
+{
+	unsigned long n = 0;
+	pid_t pid;
+
+	while (!stop) {
+		pid = fork();
+		if (pid < 0) {
+			if (errno == EAGAIN || errno == EINTR)
+				continue;
+			die("fork");
+		}
+		if (!pid)
+			_exit(0);
+		while (waitpid(pid, NULL, 0) < 0 && errno == EINTR)
+			;
+		counts[id] = ++n;
+	}
+	exit(0);
+}
+
+static unsigned long run_fork(int nr_workers, int seconds)
+{
+	pid_t workers[MAX_WORKERS];
+	unsigned long total = 0;
+	int i;
+
+	counts = mmap(NULL, nr_workers * sizeof(*counts),
+		      PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS,
+		      -1, 0);
+	if (counts == MAP_FAILED)
+		die("mmap");
+	for (i = 0; i < nr_workers; i++) {
+		workers[i] = fork();
+		if (workers[i] < 0)
+			die("fork");
+		if (!workers[i]) {
+			alarm(seconds);
+			fork_worker(i);
+		}
+	}
+	for (i = 0; i < nr_workers; i++)
+		while (waitpid(workers[i], NULL, 0) < 0 && errno == EINTR)
+			;
+	for (i = 0; i < nr_workers; i++)
+		total += counts[i];
+	return total;
+}
+
+/*
+ * readdir test
+ */
+static unsigned long entries;
+
+static unsigned long run_readdir(int seconds)
+{
+	unsigned long rounds = 0;
+	struct dirent *de;
+	DIR *dir;
+
+	alarm(seconds);
+	while (!stop) {
+		dir = opendir("/proc");
+		if (!dir)
+			die("/proc");
+		entries = 0;
+		while ((de = readdir(dir)))
+			entries++;
+		closedir(dir);
+		rounds++;
+	}
+	return rounds;
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: fork-bench fork [-n workers] [-s seconds] "
+			"[-i idle]\n"
+			"       fork-bench readdir [-s seconds] [-i idle]\n");
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	int opt, seconds = 5, nr_workers = 1, nr_idle = 0, readdir_test;
+	unsigned long rounds;
+	double start, elapsed;
+
+	if (argc < 2)
+		usage();
+	if (!strcmp(argv[1], "fork"))
+		readdir_test = 0;
+	else if (!strcmp(argv[1], "readdir"))
+		readdir_test = 1;
+	else
+		usage();
+
+	optind = 2;
+	while ((opt = getopt(argc, argv, "n:s:i:")) != -1) {
+		switch (opt) {
+		case 'n':
+			nr_workers = atoi(optarg);
+			if (nr_workers < 1 || nr_workers > MAX_WORKERS)
+				usage();
+			break;
+		case 's':
+			seconds = atoi(optarg);
+			if (seconds < 1)
+				usage();
+			break;
+		case 'i':
+			nr_idle = atoi(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+
+	signal(SIGALRM, on_alarm);
+	start_idle(nr_idle);
+
+	start = now();
+	rounds = readdir_test ? run_readdir(seconds) :
+				run_fork(nr_workers, seconds);
+	elapsed = now() - start;
+	if (readdir_test)
+		printf("%lu readdirs of %lu entries in %.2fs, %.1f readdirs/s\n",
+		       rounds, entries, elapsed, rounds / elapsed);
+	else
+		printf("%lu forks by %d workers in %.2fs, %.0f forks/s\n",
+		       rounds, nr_workers, elapsed, rounds / elapsed);
+
+	stop_idle();
+	return 0;
+}
@@ -0,0 +1,281 @@
+/*
+ * futex-bench.c: microbenchmark for FUTEX_WAIT_MULTIPLE and
+ * FUTEX_REQUEUE_OP, see Documentation/futex-multiwait.txt.
+ *
+ * Build:	gcc -O2 -Wall -o futex-bench futex-bench.c -lpthread
+ *
+ * futex-bench wait [-k words] [-s seconds]
+ *	Ping-pong between a waker and one thread sleeping on 'words'
+ *	futexes with FUTEX_WAIT_MULTIPLE. The waker wakes the futexes in
+ *	turn and waits for the sleeper to acknowledge. With -k 0 the
+ *	sleeper uses a plain FUTEX_WAIT on a single futex, as a baseline.
+ *
+ * futex-bench bcast [-n threads] [-s seconds] [-r]
+ *	A condition variable broadcast to 'threads' waiters that all
+ *	have to get the same mutex afterwards. By default the broadcast
+ *	wakes all waiters with FUTEX_WAKE, with -r it wakes one and
+ *	requeues the others to the mutex with FUTEX_REQUEUE_OP.
+ *
+ * Both print the number of rounds per second.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/time.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "bench.h"
+
+#ifndef FUTEX_WAIT_MULTIPLE
+#define FUTEX_WAIT_MULTIPLE	9
+#define FUTEX_REQUEUE_OP	10
+
+struct futex_wait_block {
+	unsigned int *uaddr;
+	unsigned int val;
+};
+#endif
+
+#ifndef FUTEX_OP
+#define FUTEX_OP_OR		2
+#define FUTEX_OP_CMP_NE		1
+#define FUTEX_OP(op, oparg, cmp, cmparg) \
+  (((op & 0xf) << 28) | ((cmp & 0xf) << 24)		\
+   | ((oparg & 0xfff) << 12) | (cmparg & 0xfff))
+#endif
+
+#define MAX_WORDS	128
+
+static volatile int stop;
+
+static long futex(void *uaddr, int op, int val, void *utime, void *uaddr2,
+		  int val3)
+{
+	return syscall(SYS_futex, uaddr, op, val, utime, uaddr2, val3);
+}
+
+/*
+ * wait test
+ */
+static unsigned int words[MAX_WORDS];
+static unsigned int ack;
+static int nr_words = 4;
+
+static void *sleeper(void *arg)
+{
+	struct futex_wait_block blocks[MAX_WORDS];
+	unsigned int seen[MAX_WORDS];
+	int i;
+
+	memset(seen, 0, sizeof(seen));
+	while (!stop) {
+		if (!nr_words) {
+			futex(&words[0], FUTEX_WAIT, seen[0], NULL, NULL, 0);
+		} else {
+			for (i = 0; i < nr_words; i++) {
+				blocks[i].uaddr = &words[i];
+				blocks[i].val = seen[i];
+			}
+			if (futex(blocks, FUTEX_WAIT_MULTIPLE, nr_words,
+				  NULL, NULL, 0) < 0 &&
+			    errno != EWOULDBLOCK && errno != EINTR)
+				die("FUTEX_WAIT_MULTIPLE");
+		}
+		/* a word may have changed before we slept, look at all */
+		for (i = 0; i < (nr_words ? nr_words : 1); i++) {
+			if (words[i] == seen[i])
+				continue;
+			seen[i] = words[i];
+			__sync_fetch_and_add(&ack, 1);
+			futex(&ack, FUTEX_WAKE, 1, NULL, NULL, 0);
+		}
+	}
+	return NULL;
+}
+
+static unsigned long run_wait(void)
+{
+	unsigned long rounds = 0;
+	unsigned int a;
+	pthread_t t;
+	int i = 0;
+
+	pthread_create(&t, NULL, sleeper, NULL);
+	while (!stop) {
+		a = ack;
+		__sync_fetch_and_add(&words[i], 1);
+		futex(&words[i], FUTEX_WAKE, 1, NULL, NULL, 0);
+		while (ack == a && !stop)
+			futex(&ack, FUTEX_WAIT, a, NULL, NULL, 0);
+		if (nr_words && ++i == nr_words)
+			i = 0;
+		rounds++;
+	}
+	/* let the sleeper see 'stop' */
+	__sync_fetch_and_add(&words[0], 1);
+	futex(&words[0], FUTEX_WAKE, 1, NULL, NULL, 0);
+	pthread_join(t, NULL);
+	return rounds;
+}
+
+/*
+ * broadcast test. The mutex word has bit 0 set while it is locked and
+ * bit 1 while there may be waiters; unlock wakes one if bit 1 was set.
+ */
+static unsigned int mutex, cond;
+static volatile int waiting, done;
+static int nr_threads = 8, requeue;
+
+/* 'slept' is 2 if we might have been requeued to the mutex */
+static void mutex_lock(unsigned int slept)
+{
+	unsigned int v;
+
+	for (;;) {
+		v = mutex;
+		if (!(v & 1)) {
+			/* others may sleep with us, keep bit 1 once we slept */
+			if (__sync_bool_compare_and_swap(&mutex, v,
+							 v | 1 | slept))
+				return;
+			continue;
+		}
+		if (!(v & 2) &&
+		    !__sync_bool_compare_and_swap(&mutex, v, v | 2))
+			continue;
+		futex(&mutex, FUTEX_WAIT, v | 2, NULL, NULL, 0);
+		slept = 2;
+	}
+}
+
+static void mutex_unlock(void)
+{
+	if (__sync_lock_test_and_set(&mutex, 0) & 2)
+		futex(&mutex, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+static void *bcast_waiter(void *arg)
+{
+	unsigned int seq;
+
+	while (!stop) {
+		mutex_lock(0);
+		seq = cond;
+		waiting++;
+		mutex_unlock();
+
+		while (cond == seq && !stop)
+			futex(&cond, FUTEX_WAIT, seq, NULL, NULL, 0);
+
+		mutex_lock(requeue ? 2 : 0);
+		done++;
+		mutex_unlock();
+	}
+	return NULL;
+}
+
+static unsigned long run_bcast(void)
+{
+	pthread_t t[nr_threads];
+	unsigned long rounds = 0;
+	int i;
+
+	for (i = 0; i < nr_threads; i++)
+		pthread_create(&t[i], NULL, bcast_waiter, NULL);
+	while (!stop) {
+		while (waiting < nr_threads && !stop)
+			sched_yield();
+		mutex_lock(0);
+		waiting = 0;
+		done = 0;
+		mutex_unlock();
+
+		__sync_fetch_and_add(&cond, 1);
+		if (requeue)
+			/* mark the mutex contended, requeue only if held */
+			futex(&cond, FUTEX_REQUEUE_OP, 1, (void *)INT_MAX,
+			      &mutex, FUTEX_OP(FUTEX_OP_OR, 2,
+					       FUTEX_OP_CMP_NE, 0));
+		else
+			futex(&cond, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+
+		while (done < nr_threads && !stop)
+			sched_yield();
+		rounds++;
+	}
+	__sync_fetch_and_add(&cond, 1);
+	futex(&cond, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+	for (i = 0; i < nr_threads; i++)
+		pthread_join(t[i], NULL);
+	return rounds;
+}
+
+static void *timer_thread(void *arg)
+{
+	sleep(*(int *)arg);
+	stop = 1;
+	return NULL;
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: futex-bench wait [-k words] [-s seconds]\n"
+			"       futex-bench bcast [-n threads] [-s seconds] [-r]\n");
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long rounds;
+	int opt, seconds = 5, bcast;
+	pthread_t timer;
+	double start;
+
+	if (argc < 2)
+		usage();
+	if (!strcmp(argv[1], "wait"))
+		bcast = 0;
+	else if (!strcmp(argv[1], "bcast"))
+		bcast = 1;
+	else
+		usage();
+
+	optind = 2;
+	while ((opt = getopt(argc, argv, "k:n:s:r")) != -1) {
+		switch (opt) {
+		case 'k':
+			nr_words = atoi(optarg);
+			if (nr_words < 0 || nr_words > MAX_WORDS)
+				usage();
+			break;
+		case 'n':
+			nr_threads = atoi(optarg);
+			if (nr_threads < 1)
+				usage();
+			break;
+		case 's':
+			seconds = atoi(optarg);
+			break;
+		case 'r':
+			requeue = 1;
+			break;
+		default:
+			usage();
+		}
+	}
+
+	pthread_create(&timer, NULL, timer_thread, &seconds);
+	start = now();
+	rounds = bcast ? run_bcast() : run_wait();
+	printf("%lu rounds in %.2fs, %.0f rounds/s\n", rounds, now() - start,
+	       rounds / (now() - start));
+	pthread_join(timer, NULL);
+	return 0;
+}
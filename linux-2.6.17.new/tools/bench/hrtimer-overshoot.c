@@ -0,0 +1,187 @@
+/*
+ * hrtimer-overshoot.c: measure how late sleeps and timers expire, see
+ * Documentation/hrtimers-highres.txt.
+ *
+ * Build:	gcc -O2 -Wall -o hrtimer-overshoot hrtimer-overshoot.c -lrt
+ *
+ * hrtimer-overshoot [-i interval_us] [-n loops]
+ *
+ * Sleeps 'loops' times for 'interval_us' (default 100us, 1000 loops)
+ * with each of
+ *
+ *	nanosleep		relative sleep
+ *	clock_nanosleep		absolute CLOCK_MONOTONIC sleep
+ *	itimer			periodic ITIMER_REAL, waiting in sigsuspend
+ *
+ * and prints the minimum, average and maximum overshoot past the
+ * requested expiry time and a log2 histogram of it, in microseconds.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/time.h>
+
+#define NR_BUCKETS	24
+
+struct result {
+	const char *name;
+	long long min, max, sum;
+	unsigned long hist[NR_BUCKETS];
+	unsigned long nr;
+};
+
+static long long ts_ns(const struct timespec *ts)
+{
+	return ts->tv_sec * 1000000000LL + ts->tv_nsec;
+}
+
+static void ns_ts(long long ns, struct timespec *ts)
+{
+	ts->tv_sec = ns / 1000000000LL;
+	ts->tv_nsec = ns % 1000000000LL;
+}
+
+static long long now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts_ns(&ts);
+}
+
+/* bucket 0 counts less than 1us, bucket k [2^(k-1), 2^k) us */
+static void account(struct result *r, long long over)
+{
+	long long us = over / 1000;
+	int b = 0;
+
+	while (us && b < NR_BUCKETS - 1) {
+		us >>= 1;
+		b++;
+	}
+	r->hist[b]++;
+	if (!r->nr || over < r->min)
+		r->min = over;
+	if (!r->nr || over > r->max)
+		r->max = over;
+	r->sum += over;
+	r->nr++;
+}
+
+static void print(struct result *r)
+{
+	int i, last = 0;
+
+	for (i = 0; i < NR_BUCKETS; i++)
+		if (r->hist[i])
+			last = i;
+
+	printf("%-16s min %8.1fus avg %8.1fus max %8.1fus\n", r->name,
+	       r->min / 1e3, (double)r->sum / r->nr / 1e3, r->max / 1e3);
+	for (i = 0; i <= last; i++)
+		printf("\t< %8dus %8lu\n", 1 << i, r->hist[i]);
+}
+
+static void run_nanosleep(struct result *r, long long interval, int loops)
+{
+	struct timespec ts;
+	long long start;
+
+	while (loops--) {
+		ns_ts(interval, &ts);
+		start = now();
+		nanosleep(&ts, NULL);
+		account(r, now() - start - interval);
+	}
+}
+
+static void run_clock_nanosleep(struct result *r, long long interval,
+				int loops)
+{
+	struct timespec ts;
+	long long next = now();
+
+	while (loops--) {
+		next += interval;
+		ns_ts(next, &ts);
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+		account(r, now() - next);
+	}
+}
+
+static void alarm_handler(int sig)
+{
+}
+
+static void run_itimer(struct result *r, long long interval, int loops)
+{
+	struct itimerval it;
+	sigset_t mask, old;
+	long long next;
+
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGALRM);
+	sigprocmask(SIG_BLOCK, &mask, &old);
+	signal(SIGALRM, alarm_handler);
+
+	memset(&it, 0, sizeof(it));
+	it.it_value.tv_usec = it.it_interval.tv_usec = interval / 1000;
+	next = now();
+	setitimer(ITIMER_REAL, &it, NULL);
+	while (loops--) {
+		next += interval;
+		sigsuspend(&old);
+		account(r, now() - next);
+	}
+	memset(&it, 0, sizeof(it));
+	setitimer(ITIMER_REAL, &it, NULL);
+	sigprocmask(SIG_SETMASK, &old, NULL);
+}
+
+int main(int argc, char **argv)
+{
+	struct result r[3] = {
+		{ .name = "nanosleep" },
+		{ .name = "clock_nanosleep" },
+		{ .name = "itimer" },
+	};
+	long long interval = 100000;
+	struct timespec res;
+	int opt, loops = 1000;
+
+	while ((opt = getopt(argc, argv, "i:n:")) != -1) {
+		switch (opt) {
+		case 'i':
+			interval = atoll(optarg) * 1000;
+			break;
+		case 'n':
+			loops = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: hrtimer-overshoot "
+					"[-i interval_us] [-n loops]\n");
+			return 1;
+		}
+	}
+	if (interval < 1000 || interval >= 1000000000LL || loops < 1) {
+		fprintf(stderr, "interval must be 1us..1s, loops > 0\n");
+		return 1;
+	}
+
+	clock_getres(CLOCK_MONOTONIC, &res);
+	printf("CLOCK_MONOTONIC resolution %ldns, interval %lldus, "
+	       "%d loops\n", res.tv_nsec, interval / 1000, loops);
+
+	run_nanosleep(&r[0], interval, loops);
+	run_clock_nanosleep(&r[1], interval, loops);
+	run_itimer(&r[2], interval, loops);
+
+	print(&r[0]);
+	print(&r[1]);
+	print(&r[2]);
+	return 0;
+}
@@ -0,0 +1,378 @@
+/*
+ * ioring-bench.c: benchmark for I/O rings, see Documentation/ioring.txt.
+ *
+ * Build:	gcc -O2 -Wall -o ioring-bench ioring-bench.c
+ *
+ * ioring-bench nop [-d depth] [-s seconds] [-p] [-a]
+ *	NOPs, 'depth' of them in flight: what a request costs the ring
+ *	itself. With -a, getppid() calls instead.
+ *
+ * ioring-bench read [-d depth] [-b bs] [-s seconds] [-p] [-a] [-o] <file>
+ *	Random reads of 'bs' bytes at offsets aligned to 'bs'. With -o
+ *	the file is opened O_DIRECT. With -a, pread() calls instead.
+ *
+ * ioring-bench msg [-d depth] [-b bs] [-s seconds] [-p] [-a]
+ *	Datagrams of 'bs' bytes over an AF_UNIX socket pair, half of
+ *	'depth' sendmsg and half recvmsg requests. With -a, a sendmsg()
+ *	and a recvmsg() call for each message instead.
+ *
+ * With -p the ring has a polling thread (root only): requests are
+ * submitted without ioring_enter(), and completions reaped by spinning
+ * on the ring. All print the requests completed per second, and the
+ * system calls made per request.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdint.h>
+#include <sys/time.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+
+#include "bench.h"
+
+#ifndef __NR_ioring_setup
+#if defined(__x86_64__)
+#define __NR_ioring_setup	279
+#define __NR_ioring_enter	280
+#elif defined(__i386__)
+#define __NR_ioring_setup	317
+#define __NR_ioring_enter	318
+#else
+#error define __NR_ioring_setup and __NR_ioring_enter for this arch
+#endif
+#endif
+
+/* from <linux/ioring.h> */
+struct ioring_sqe {
+	uint8_t opcode, flags;
+	uint16_t __pad1;
+	int32_t fd;
+	uint64_t off, addr;
+	uint32_t len, op_flags;
+	uint64_t user_data;
+	uint64_t __pad2[3];
+};
+
+struct ioring_cqe {
+	uint64_t user_data;
+	int32_t res;
+	uint32_t flags;
+};
+
+struct ioring_params {
+	uint32_t sq_entries, cq_entries, flags, sq_thread_cpu, sq_thread_idle;
+	uint32_t resv[5];
+	struct {
+		uint32_t head, tail, ring_mask, ring_entries, flags, dropped;
+		uint32_t array, resv1;
+		uint64_t resv2;
+	} sq_off;
+	struct {
+		uint32_t head, tail, ring_mask, ring_entries, overflow, cqes;
+		uint64_t resv[2];
+	} cq_off;
+};
+
+#define IORING_OP_NOP		0
+#define IORING_OP_READ		1
+#define IORING_OP_SENDMSG	6
+#define IORING_OP_RECVMSG	7
+
+#define IORING_SETUP_SQPOLL	(1U << 0)
+#define IORING_SQ_NEED_WAKEUP	(1U << 0)
+#define IORING_OFF_SQ_RING	0ULL
+#define IORING_OFF_CQ_RING	0x8000000ULL
+#define IORING_OFF_SQES		0x10000000ULL
+#define IORING_ENTER_GETEVENTS	(1U << 0)
+#define IORING_ENTER_SQ_WAKEUP	(1U << 1)
+
+#define MAX_DEPTH	1024
+
+struct ring {
+	int fd, sqpoll;
+	volatile unsigned *sq_head, *sq_tail, *sq_flags;
+	unsigned *sq_array, sq_mask, sq_local_tail;
+	struct ioring_sqe *sqes;
+	volatile unsigned *cq_head, *cq_tail;
+	unsigned cq_mask;
+	struct ioring_cqe *cqes;
+};
+
+static int depth = 32, seconds = 5, sqpoll, baseline;
+static size_t bs = 4096;
+static unsigned long nr_syscalls;
+
+static struct ring ring;
+static char *bufs[MAX_DEPTH];
+static struct iovec iovs[MAX_DEPTH];
+static struct msghdr msgs[MAX_DEPTH];
+static int fd, socks[2];
+static off_t blocks;
+
+static void *map(int fd, size_t len, unsigned long long off)
+{
+	void *p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, off);
+
+	if (p == MAP_FAILED)
+		die("mmap");
+	return p;
+}
+
+static void ring_setup(unsigned entries)
+{
+	struct ioring_params p;
+	char *sq, *cq;
+
+	memset(&p, 0, sizeof(p));
+	if (sqpoll)
+		p.flags = IORING_SETUP_SQPOLL;
+	ring.fd = syscall(__NR_ioring_setup, entries, &p);
+	if (ring.fd < 0)
+		die("ioring_setup");
+	ring.sqpoll = sqpoll;
+
+	sq = map(ring.fd, p.sq_off.array + p.sq_entries * sizeof(unsigned),
+		 IORING_OFF_SQ_RING);
+	ring.sq_head = (unsigned *)(sq + p.sq_off.head);
+	ring.sq_tail = (unsigned *)(sq + p.sq_off.tail);
+	ring.sq_flags = (unsigned *)(sq + p.sq_off.flags);
+	ring.sq_array = (unsigned *)(sq + p.sq_off.array);
+	ring.sq_mask = *(unsigned *)(sq + p.sq_off.ring_mask);
+	ring.sq_local_tail = *ring.sq_tail;
+	ring.sqes = map(ring.fd, p.sq_entries * sizeof(struct ioring_sqe),
+			IORING_OFF_SQES);
+
+	cq = map(ring.fd, p.cq_off.cqes +
+		 p.cq_entries * sizeof(struct ioring_cqe), IORING_OFF_CQ_RING);
+	ring.cq_head = (unsigned *)(cq + p.cq_off.head);
+	ring.cq_tail = (unsigned *)(cq + p.cq_off.tail);
+	ring.cq_mask = *(unsigned *)(cq + p.cq_off.ring_mask);
+	ring.cqes = (struct ioring_cqe *)(cq + p.cq_off.cqes);
+}
+
+/*
+ * Fill in request i, in sqe i, and queue it on the submission ring
+ */
+static void prep(int mode, int i)
+{
+	struct ioring_sqe *sqe = &ring.sqes[i];
+
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->user_data = i;
+	switch (mode) {
+	case 'n':
+		sqe->opcode = IORING_OP_NOP;
+		break;
+	case 'r':
+		sqe->opcode = IORING_OP_READ;
+		sqe->fd = fd;
+		sqe->addr = (uintptr_t)bufs[i];
+		sqe->len = bs;
+		sqe->off = (off_t)(random() % blocks) * bs;
+		break;
+	case 'm':
+		sqe->opcode = i & 1 ? IORING_OP_RECVMSG : IORING_OP_SENDMSG;
+		sqe->fd = socks[i & 1];
+		sqe->addr = (uintptr_t)&msgs[i];
+		break;
+	}
+	ring.sq_array[ring.sq_local_tail++ & ring.sq_mask] = i;
+}
+
+/*
+ * Make what prep() queued visible, and have it submitted
+ */
+static int submit(int wait)
+{
+	unsigned to_submit = ring.sq_local_tail - *ring.sq_head;
+	unsigned flags = wait ? IORING_ENTER_GETEVENTS : 0;
+	int ret;
+
+	__sync_synchronize();	/* the entries before the tail */
+	*ring.sq_tail = ring.sq_local_tail;
+	__sync_synchronize();	/* the tail before looking at the flags */
+
+	if (ring.sqpoll) {
+		if (!(*ring.sq_flags & IORING_SQ_NEED_WAKEUP))
+			return 0;
+		flags = IORING_ENTER_SQ_WAKEUP;
+		wait = 0;
+	}
+	if (!to_submit && !flags)
+		return 0;
+	nr_syscalls++;
+	ret = syscall(__NR_ioring_enter, ring.fd, to_submit, wait, flags);
+	if (ret < 0 && errno != EBUSY && errno != EINTR)
+		die("ioring_enter");
+	return ret;
+}
+
+static unsigned long run_ring(int mode)
+{
+	unsigned long done = 0;
+	double end = now() + seconds;
+	unsigned head, tail;
+	int i;
+
+	ring_setup(depth);
+	for (i = 0; i < depth; i++)
+		prep(mode, i);
+
+	while (now() < end) {
+		head = *ring.cq_head;
+		tail = *ring.cq_tail;
+		__sync_synchronize();	/* the tail before the entries */
+		if (head == tail) {
+			/* with a polling thread, spin */
+			submit(!ring.sqpoll);
+			continue;
+		}
+		for (; head != tail; head++) {
+			struct ioring_cqe *cqe = &ring.cqes[head & ring.cq_mask];
+
+			if (cqe->res < 0) {
+				fprintf(stderr, "request %llu: %s\n",
+					(unsigned long long)cqe->user_data,
+					strerror(-cqe->res));
+				exit(1);
+			}
+			prep(mode, cqe->user_data);
+			done++;
+		}
+		__sync_synchronize();	/* done with them before the head moves */
+		*ring.cq_head = head;
+		/* without a polling thread, submit when waiting for more */
+		if (ring.sqpoll)
+			submit(0);
+	}
+	return done;
+}
+
+static unsigned long run_baseline(int mode)
+{
+	unsigned long done = 0;
+	double end = now() + seconds;
+	int i;
+
+	while (now() < end) {
+		for (i = 0; i < depth; i++) {
+			switch (mode) {
+			case 'n':
+				syscall(SYS_getppid);
+				break;
+			case 'r':
+				if (pread(fd, bufs[i], bs,
+					  (off_t)(random() % blocks) * bs) < 0)
+					die("pread");
+				break;
+			case 'm':
+				if (sendmsg(socks[i & 1], &msgs[i], 0) < 0)
+					die("sendmsg");
+				nr_syscalls++;
+				if (recvmsg(socks[!(i & 1)], &msgs[i], 0) < 0)
+					die("recvmsg");
+				nr_syscalls++;
+				done++;
+				break;
+			}
+			if (mode != 'm')
+				nr_syscalls++;
+			done++;
+		}
+	}
+	return done;
+}
+
+int main(int argc, char **argv)
+{
+	int c, i, mode, flags = O_RDONLY;
+	unsigned long done;
+	struct stat st;
+
+	if (argc < 2)
+		goto usage;
+	if (!strcmp(argv[1], "nop"))
+		mode = 'n';
+	else if (!strcmp(argv[1], "read"))
+		mode = 'r';
+	else if (!strcmp(argv[1], "msg"))
+		mode = 'm';
+	else
+		goto usage;
+	optind = 2;
+
+	while ((c = getopt(argc, argv, "d:b:s:pao")) != -1) {
+		switch (c) {
+		case 'd':
+			depth = atoi(optarg);
+			break;
+		case 'b':
+			bs = atol(optarg);
+			break;
+		case 's':
+			seconds = atoi(optarg);
+			break;
+		case 'p':
+			sqpoll = 1;
+			break;
+		case 'a':
+			baseline = 1;
+			break;
+		case 'o':
+			flags |= O_DIRECT;
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (optind != argc - (mode == 'r') || depth < 1 || depth > MAX_DEPTH ||
+	    !bs || (mode == 'm' && depth & 1))
+		goto usage;
+
+	for (i = 0; i < depth; i++) {
+		if (posix_memalign((void **)&bufs[i], 4096, bs))
+			return 1;
+		memset(bufs[i], 0x5a, bs);
+		iovs[i].iov_base = bufs[i];
+		iovs[i].iov_len = bs;
+		msgs[i].msg_iov = &iovs[i];
+		msgs[i].msg_iovlen = 1;
+	}
+
+	if (mode == 'r') {
+		fd = open(argv[optind], flags);
+		if (fd < 0 || fstat(fd, &st) < 0)
+			die(argv[optind]);
+		blocks = st.st_size / bs;
+		if (blocks < 1) {
+			fprintf(stderr, "file smaller than one block\n");
+			return 1;
+		}
+	}
+	if (mode == 'm' && socketpair(AF_UNIX, SOCK_DGRAM, 0, socks) < 0)
+		die("socketpair");
+
+	done = baseline ? run_baseline(mode) : run_ring(mode);
+
+	printf("%.0f requests/s, %.3f system calls per request\n",
+	       (double)done / seconds, done ? (double)nr_syscalls / done : 0.0);
+	return 0;
+
+usage:
+	fprintf(stderr, "usage: ioring-bench nop [-d depth] [-s seconds] "
+		"[-p] [-a]\n"
+		"       ioring-bench read [-d depth] [-b bs] [-s seconds] "
+		"[-p] [-a] [-o] <file>\n"
+		"       ioring-bench msg [-d depth] [-b bs] [-s seconds] "
+		"[-p] [-a]\n");
+	return 1;
+}
@@ -0,0 +1,171 @@
+/*
+ * pipe-bench.c: moves data through a pipe of a given size, see
+ * Documentation/pipe.txt.
+ *
+ * Build:	gcc -O2 -Wall -o pipe-bench pipe-bench.c
+ *
+ * pipe-bench [-p pipe_size] [-b block] [-m megabytes] [file]
+ *	Sets the pipe to 'pipe_size' bytes with F_SETPIPE_SZ (default: leave
+ *	it as it is), then a child writes 'megabytes' (default 1024) into it
+ *	'block' bytes (default 1MB) at a time, while the parent reads them
+ *	out as fast as it can. With 'file', the child splice()s the file into
+ *	the pipe instead, from the start again when it reaches its end.
+ *
+ * Prints the throughput, the system calls made on each side per megabyte,
+ * and what /proc/pipe_stat counted meanwhile.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+
+#include "bench.h"
+
+#ifndef F_SETPIPE_SZ
+#define F_SETPIPE_SZ	1031
+#define F_GETPIPE_SZ	1032
+#endif
+
+#define NSTATS		9
+
+static const char *stat_names[NSTATS] = {
+	"writes", "fill0", "fill1", "fill2", "fill3", "fill4",
+	"write_waits", "read_waits", "resizes",
+};
+
+/* Child: writes or splices total bytes into fd, returns the calls made */
+static unsigned long writer(int fd, int in, size_t block, long long total)
+{
+	unsigned long calls = 0;
+	loff_t off = 0;
+	char *buf = NULL;
+	ssize_t n;
+
+	if (in < 0) {
+		buf = malloc(block);
+		if (!buf)
+			die("malloc");
+		memset(buf, 'x', block);
+	}
+	while (total > 0) {
+		size_t len = total < (long long)block ? total : block;
+
+		if (in < 0)
+			n = write(fd, buf, len);
+		else
+			n = splice(in, &off, fd, NULL, len, SPLICE_F_MOVE);
+		calls++;
+		if (n < 0)
+			die(in < 0 ? "write" : "splice");
+		if (n == 0) {
+			/* end of the file, start over */
+			off = 0;
+			continue;
+		}
+		total -= n;
+	}
+	return calls;
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: pipe-bench [-p pipe_size] [-b block] "
+		"[-m megabytes] [file]\n");
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long before[NSTATS], after[NSTATS], rcalls = 0;
+	unsigned long *wcalls;
+	long long total, left;
+	size_t block = 1 << 20;
+	long psize = 0, mb = 1024;
+	int fds[2], in = -1, opt, i, status;
+	char *buf;
+	pid_t pid;
+	ssize_t n;
+	double t;
+
+	while ((opt = getopt(argc, argv, "p:b:m:")) != -1) {
+		switch (opt) {
+		case 'p':
+			psize = atol(optarg);
+			break;
+		case 'b':
+			block = atol(optarg);
+			break;
+		case 'm':
+			mb = atol(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (psize < 0 || block <= 0 || mb <= 0 || argc - optind > 1)
+		usage();
+	if (optind < argc) {
+		in = open(argv[optind], O_RDONLY);
+		if (in < 0)
+			die(argv[optind]);
+	}
+	total = (long long)mb << 20;
+
+	if (pipe(fds) < 0)
+		die("pipe");
+	if (psize && fcntl(fds[1], F_SETPIPE_SZ, psize) < 0)
+		die("F_SETPIPE_SZ");
+	psize = fcntl(fds[1], F_GETPIPE_SZ);
+	if (psize < 0)
+		psize = 65536;
+
+	buf = malloc(block);
+	wcalls = mmap(NULL, sizeof(*wcalls), PROT_READ | PROT_WRITE,
+		      MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (!buf || wcalls == MAP_FAILED)
+		die("malloc");
+
+	read_stat_file("/proc/pipe_stat", stat_names, NSTATS, before);
+	t = now();
+	pid = fork();
+	if (pid < 0)
+		die("fork");
+	if (!pid) {
+		close(fds[0]);
+		*wcalls = writer(fds[1], in, block, total);
+		exit(0);
+	}
+	close(fds[1]);
+	for (left = total; left > 0; left -= n) {
+		n = read(fds[0], buf, block);
+		rcalls++;
+		if (n < 0)
+			die("read");
+		if (n == 0)
+			break;
+	}
+	if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) ||
+	    WEXITSTATUS(status))
+		return 1;
+	t = now() - t;
+	read_stat_file("/proc/pipe_stat", stat_names, NSTATS, after);
+
+	printf("pipe %ld bytes, %s: %.0f MB/s\n", psize,
+	       in < 0 ? "write" : "splice", mb / t);
+	printf("per MB: %.2f %s calls, %.2f read calls\n",
+	       (double)*wcalls / mb, in < 0 ? "write" : "splice",
+	       (double)rcalls / mb);
+	printf("/proc/pipe_stat, per MB:\n");
+	for (i = 0; i < NSTATS; i++)
+		printf("\t%-12s %.2f\n", stat_names[i],
+		       (double)(after[i] - before[i]) / mb);
+	return 0;
+}